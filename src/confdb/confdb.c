@@ -1580,6 +1580,76 @@ static errno_t confdb_init_domain_subdomains(struct sss_domain_info *domain,
         }
     }
 
+    domain->cache_backend = CACHE_BACKEND_TDB;
+    tmp = ldb_msg_find_attr_as_string(res->msgs[0],
+                                      CONFDB_DOMAIN_CACHE_BACKEND,
+                                      CONFDB_DOMAIN_CACHE_BACKEND_TDB);
+    if (tmp != NULL) {
+        if (strcasecmp(tmp, CONFDB_DOMAIN_CACHE_BACKEND_TDB) == 0) {
+            domain->cache_backend = CACHE_BACKEND_TDB;
+        } else if (strcasecmp(tmp, CONFDB_DOMAIN_CACHE_BACKEND_MDB) == 0) {
+            domain->cache_backend = CACHE_BACKEND_MDB;
+        } else {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Invalid value %s for [%s]\n",
+                  tmp, CONFDB_DOMAIN_CACHE_BACKEND);
+            ret = EINVAL;
+            goto done;
+        }
+    }
+
+    domain->cache_commit_mode = CACHE_COMMIT_SYNC;
+    tmp = ldb_msg_find_attr_as_string(res->msgs[0],
+                                      CONFDB_DOMAIN_CACHE_COMMIT_MODE,
+                                      CONFDB_DOMAIN_CACHE_COMMIT_MODE_SYNC);
+    if (tmp != NULL) {
+        if (strcasecmp(tmp, CONFDB_DOMAIN_CACHE_COMMIT_MODE_SYNC) == 0) {
+            domain->cache_commit_mode = CACHE_COMMIT_SYNC;
+        } else if (strcasecmp(tmp, CONFDB_DOMAIN_CACHE_COMMIT_MODE_GROUP) == 0) {
+            domain->cache_commit_mode = CACHE_COMMIT_GROUP;
+        } else if (strcasecmp(tmp, CONFDB_DOMAIN_CACHE_COMMIT_MODE_NOSYNC) == 0) {
+            domain->cache_commit_mode = CACHE_COMMIT_NOSYNC;
+        } else {
+            DEBUG(SSSDBG_FATAL_FAILURE, "Invalid value %s for [%s]\n",
+                  tmp, CONFDB_DOMAIN_CACHE_COMMIT_MODE);
+            ret = EINVAL;
+            goto done;
+        }
+    }
+
+    ret = get_entry_as_uint32(res->msgs[0], &domain->cache_commit_window,
+                              CONFDB_DOMAIN_CACHE_COMMIT_WINDOW,
+                              CONFDB_DOMAIN_CACHE_COMMIT_WINDOW_DEFAULT);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n", CONFDB_DOMAIN_CACHE_COMMIT_WINDOW);
+        goto done;
+    }
+
+    ret = get_entry_as_bool(res->msgs[0], &domain->cache_query_stats,
+                            CONFDB_DOMAIN_CACHE_QUERY_STATS, false);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE,
+              "Invalid value for [%s]\n", CONFDB_DOMAIN_CACHE_QUERY_STATS);
+        goto done;
+    }
+
+    ret = get_entry_as_uint32(res->msgs[0], &domain->cache_slow_query_threshold,
+                              CONFDB_DOMAIN_CACHE_SLOW_QUERY_THRESHOLD, 0);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Invalid value for [%s]\n",
+              CONFDB_DOMAIN_CACHE_SLOW_QUERY_THRESHOLD);
+        goto done;
+    }
+
+    ret = get_entry_as_bool(res->msgs[0],
+                            &domain->cache_shared_search_results,
+                            CONFDB_DOMAIN_CACHE_SHARED_SEARCH_RESULTS, true);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Invalid value for [%s]\n",
+              CONFDB_DOMAIN_CACHE_SHARED_SEARCH_RESULTS);
+        goto done;
+    }
+
     ret = get_entry_as_uint32(res->msgs[0], &domain->subdomain_refresh_interval,
                               CONFDB_DOMAIN_SUBDOMAIN_REFRESH,
                               CONFDB_DOMAIN_SUBDOMAIN_REFRESH_DEFAULT_VALUE);
@@ -133,6 +133,8 @@
 #define CONFDB_PAM_VERBOSITY "pam_verbosity"
 #define CONFDB_PAM_RESPONSE_FILTER "pam_response_filter"
 #define CONFDB_PAM_ID_TIMEOUT "pam_id_timeout"
+#define CONFDB_PAM_OFFLINE_AUTH_TIMEOUT "pam_offline_auth_timeout"
+#define CONFDB_DEFAULT_PAM_OFFLINE_AUTH_TIMEOUT 0
 #define CONFDB_PAM_PWD_EXPIRATION_WARNING "pam_pwd_expiration_warning"
 #define CONFDB_PAM_TRUSTED_USERS "pam_trusted_users"
 #define CONFDB_PAM_PUBLIC_DOMAINS "pam_public_domains"
@@ -264,6 +266,18 @@
 #define CONFDB_DOMAIN_TYPE_POSIX "posix"
 #define CONFDB_DOMAIN_TYPE_APP "application"
 #define CONFDB_DOMAIN_INHERIT_FROM "inherit_from"
+#define CONFDB_DOMAIN_CACHE_BACKEND "cache_backend"
+#define CONFDB_DOMAIN_CACHE_BACKEND_TDB "tdb"
+#define CONFDB_DOMAIN_CACHE_BACKEND_MDB "mdb"
+#define CONFDB_DOMAIN_CACHE_COMMIT_MODE "cache_commit_mode"
+#define CONFDB_DOMAIN_CACHE_COMMIT_MODE_SYNC "sync"
+#define CONFDB_DOMAIN_CACHE_COMMIT_MODE_GROUP "group"
+#define CONFDB_DOMAIN_CACHE_COMMIT_MODE_NOSYNC "nosync"
+#define CONFDB_DOMAIN_CACHE_COMMIT_WINDOW "cache_commit_window"
+#define CONFDB_DOMAIN_CACHE_COMMIT_WINDOW_DEFAULT 100
+#define CONFDB_DOMAIN_CACHE_QUERY_STATS "cache_query_stats"
+#define CONFDB_DOMAIN_CACHE_SLOW_QUERY_THRESHOLD "cache_slow_query_threshold"
+#define CONFDB_DOMAIN_CACHE_SHARED_SEARCH_RESULTS "cache_shared_search_results"
 
 /* Proxy Provider */
 #define CONFDB_PROXY_LIBNAME "proxy_lib_name"
@@ -292,9 +306,12 @@
 #define CONFDB_KCM_KRB5_LIFETIME "krb5_lifetime"
 #define CONFDB_KCM_KRB5_RENEWABLE_LIFETIME "krb5_renewable_lifetime"
 #define CONFDB_KCM_KRB5_RENEW_INTERVAL "krb5_renew_interval"
+#define CONFDB_KCM_KRB5_RENEW_MAX_CONCURRENT "krb5_renew_max_concurrent"
 #define CONFDB_KCM_KRB5_VALIDATE "krb5_validate"
 #define CONFDB_KCM_KRB5_CANONICALIZE "krb5_canonicalize"
 #define CONFDB_KCM_KRB5_AUTH_TIMEOUT "krb5_auth_timeout"
+#define CONFDB_KCM_WRITE_BACK_WINDOW "write_back_window"
+#define CONFDB_KCM_WRITE_BACK_MAX_UIDS "write_back_max_uids"
 
 /* Certificate mapping rules */
 #define CONFDB_CERTMAP_BASEDN "cn=certmap,cn=config"
@@ -352,6 +369,24 @@ enum sss_domain_type {
     DOM_TYPE_APPLICATION,
 };
 
+/** ldb backend the domain cache is stored in */
+enum sss_cache_backend {
+    /** Default, TDB with a global lock for readers and writers */
+    CACHE_BACKEND_TDB,
+    /** LMDB, readers are not blocked by a running write transaction */
+    CACHE_BACKEND_MDB,
+};
+
+/** When committed cache transactions are flushed to disk */
+enum sss_cache_commit_mode {
+    /** Default, every commit is flushed before it returns */
+    CACHE_COMMIT_SYNC,
+    /** Commits are flushed together once per commit window */
+    CACHE_COMMIT_GROUP,
+    /** Commits are never flushed explicitly, the kernel writes them back */
+    CACHE_COMMIT_NOSYNC,
+};
+
 enum sss_domain_mpg_mode {
     MPG_DISABLED,
     MPG_ENABLED,
@@ -381,6 +416,12 @@ struct sss_domain_info {
 
     bool cache_credentials;
     uint32_t cache_credentials_min_ff_length;
+    enum sss_cache_backend cache_backend;
+    enum sss_cache_commit_mode cache_commit_mode;
+    uint32_t cache_commit_window;
+    bool cache_query_stats;
+    uint32_t cache_slow_query_threshold;
+    bool cache_shared_search_results;
     bool case_sensitive;
     bool case_preserve;
 
@@ -96,6 +96,8 @@ class SSSDOptions(object):
         'pam_verbosity': _('What kind of messages are displayed to the user during authentication'),
         'pam_response_filter': _('Filter PAM responses sent to the pam_sss'),
         'pam_id_timeout': _('How many seconds to keep identity information cached for PAM requests'),
+        'pam_offline_auth_timeout': _('How many seconds to authenticate with cached credentials without '
+                                      'contacting the backend after it reported the domain offline'),
         'pam_pwd_expiration_warning': _('How many days before password expiration a warning should be displayed'),
         'pam_trusted_users': _('List of trusted uids or user\'s name'),
         'pam_public_domains': _('List of domains accessible even for untrusted users.'),
@@ -185,7 +187,11 @@ class SSSDOptions(object):
                                          'miliseconds)'),
         'dns_resolver_op_timeout': _('How long should keep trying to resolve single DNS query (seconds)'),
         'dns_resolver_timeout': _('How long to wait for replies from DNS when resolving servers (seconds)'),
+        'dns_resolver_cache': _('Cache DNS answers for the time allowed by their TTL'),
+        'dns_resolver_cache_negative_ttl': _('How long to cache negative DNS answers (seconds)'),
         'dns_discovery_domain': _('The domain part of service discovery DNS query'),
+        'failover_prefer_faster_servers': _('Prefer servers with lower response time within the same priority group'),
+        'failover_latency_probe_interval': _('How often to probe the response time of the servers (seconds)'),
         'override_gid': _('Override GID value from the identity provider with this value'),
         'case_sensitive': _('Treat usernames as case sensitive'),
         'entry_cache_user_timeout': _('Entry cache timeout length (seconds)'),
@@ -212,6 +218,12 @@ class SSSDOptions(object):
         'subdomain_inherit': _('List of options that should be inherited into a subdomain'),
         'subdomain_homedir': _('Default subdomain homedir value'),
         'cached_auth_timeout': _('How long can cached credentials be used for cached authentication'),
+        'cache_backend': _('Database backend used to store the domain cache'),
+        'cache_commit_mode': _('When committed cache updates are flushed to disk'),
+        'cache_commit_window': _('How long to collect cache commits before flushing them to disk (in ms)'),
+        'cache_query_stats': _('Whether to collect statistics of cache searches'),
+        'cache_slow_query_threshold': _('Cache searches taking longer are logged (in ms)'),
+        'cache_shared_search_results': _('Whether responders share the results of cache searches'),
         'auto_private_groups': _('Whether to automatically create private groups for users'),
         'pwd_expiration_warning': _('Display a warning N days before the password expires.'),
         'realmd_tags': _('Various tags stored by the realmd configuration service for this domain.'),
@@ -344,6 +356,9 @@ class SSSDOptions(object):
         'krb5_canonicalize': _("Enables principal canonicalization"),
         'krb5_use_enterprise_principal': _("Enables enterprise principals"),
         'krb5_use_subdomain_realm': _("Enables using of subdomains realms for authentication"),
+        'krb5_child_pool_size': _("Number of krb5_child worker processes kept running"),
+        'krb5_child_max_requests': _("Number of requests a krb5_child worker process serves"),
+        'krb5_renew_max_concurrent': _("Maximal number of concurrent TGT renewals per realm"),
         'krb5_map_user': _('A mapping from user names to Kerberos principal names'),
 
         # [provider/krb5/chpass]
@@ -360,6 +375,7 @@ class SSSDOptions(object):
         'ldap_default_authtok_type': _('The type of the authentication token of the default bind DN'),
         'ldap_default_authtok': _('The authentication token of the default bind DN'),
         'ldap_network_timeout': _('Length of time to attempt connection'),
+        'ldap_connection_attempt_delay': _('Delay before racing a connection attempt to the next server address'),
         'ldap_opt_timeout': _('Length of time to attempt synchronous LDAP operations'),
         'ldap_offline_timeout': _('Length of time between attempts to reconnect while offline'),
         'ldap_force_upper_case_realm': _('Use only the upper case for realm names'),
@@ -491,6 +507,7 @@ class SSSDOptions(object):
         'ldap_pwdlockout_dn': _('DN for ppolicy queries'),
         'wildcard_limit': _('How many maximum entries to fetch during a wildcard request'),
         'ldap_library_debug_level': _('Set libldap debug level'),
+        'ldap_search_bases_parallel': _('Maximum number of search bases searched at the same time'),
 
         # [provider/ldap/auth]
         'ldap_pwd_policy': _('Policy to evaluate the password expiration'),
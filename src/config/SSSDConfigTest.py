@@ -578,7 +578,11 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'dns_resolver_server_timeout',
             'dns_resolver_op_timeout',
             'dns_resolver_timeout',
+            'dns_resolver_cache',
+            'dns_resolver_cache_negative_ttl',
             'dns_discovery_domain',
+            'failover_prefer_faster_servers',
+            'failover_latency_probe_interval',
             'dyndns_update',
             'dyndns_ttl',
             'dyndns_iface',
@@ -616,6 +620,12 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'full_name_format',
             're_expression',
             'cached_auth_timeout',
+            'cache_backend',
+            'cache_commit_mode',
+            'cache_commit_window',
+            'cache_query_stats',
+            'cache_slow_query_threshold',
+            'cache_shared_search_results',
             'auto_private_groups',
             'pam_gssapi_services',
             'pam_gssapi_check_upn',
@@ -677,6 +687,9 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
              'krb5_canonicalize',
              'krb5_use_enterprise_principal',
              'krb5_use_subdomain_realm',
+             'krb5_child_pool_size',
+             'krb5_child_max_requests',
+             'krb5_renew_max_concurrent',
              'krb5_use_kdcinfo',
              'krb5_map_user'])
 
@@ -841,6 +854,9 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'krb5_canonicalize',
             'krb5_use_enterprise_principal',
             'krb5_use_subdomain_realm',
+            'krb5_child_pool_size',
+            'krb5_child_max_requests',
+            'krb5_renew_max_concurrent',
             'krb5_use_kdcinfo',
             'krb5_map_user']
 
@@ -937,7 +953,11 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'dns_resolver_server_timeout',
             'dns_resolver_op_timeout',
             'dns_resolver_timeout',
+            'dns_resolver_cache',
+            'dns_resolver_cache_negative_ttl',
             'dns_discovery_domain',
+            'failover_prefer_faster_servers',
+            'failover_latency_probe_interval',
             'dyndns_update',
             'dyndns_ttl',
             'dyndns_iface',
@@ -974,6 +994,12 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
             'full_name_format',
             're_expression',
             'cached_auth_timeout',
+            'cache_backend',
+            'cache_commit_mode',
+            'cache_commit_window',
+            'cache_query_stats',
+            'cache_slow_query_threshold',
+            'cache_shared_search_results',
             'auto_private_groups',
             'pam_gssapi_services',
             'pam_gssapi_check_upn',
@@ -1038,6 +1064,9 @@ class SSSDConfigTestSSSDDomain(unittest.TestCase):
              'krb5_canonicalize',
              'krb5_use_enterprise_principal',
              'krb5_use_subdomain_realm',
+             'krb5_child_pool_size',
+             'krb5_child_max_requests',
+             'krb5_renew_max_concurrent',
              'krb5_use_kdcinfo',
              'krb5_map_user'])
 
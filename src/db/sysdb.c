@@ -28,6 +28,7 @@
 #include "confdb/confdb.h"
 #include "util/probes.h"
 #include <time.h>
+#include <fcntl.h>
 
 errno_t sysdb_dn_sanitize(TALLOC_CTX *mem_ctx, const char *input,
                           char **sanitized)
@@ -870,11 +871,80 @@ char *sysdb_group_strdn(TALLOC_CTX *mem_ctx,
 
 /* =Transactions========================================================== */
 
-int sysdb_transaction_start(struct sysdb_ctx *sysdb)
+/* Starts the outermost ldb transaction together with the ghost store one */
+static int sysdb_outer_transaction_start(struct sysdb_ctx *sysdb)
 {
     int ret;
 
     ret = ldb_transaction_start(sysdb->ldb);
+    if (ret == LDB_SUCCESS && sysdb->ghost_store != NULL) {
+        if (sysdb_ghost_store_transaction_start(sysdb->ghost_store) != EOK) {
+            ldb_transaction_cancel(sysdb->ldb);
+            ret = LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    return ret;
+}
+
+/* The ghost store is prepared first, if that or the ldb commit fails both
+ * transactions are still open and have to be cancelled. _ended tells
+ * whether the transaction is over, the ghost store commit can still fail
+ * after the ldb one on I/O errors. */
+static int sysdb_outer_transaction_commit(struct sysdb_ctx *sysdb,
+                                          bool *_ended)
+{
+    int ret;
+
+    *_ended = false;
+
+    if (sysdb->ghost_store != NULL) {
+        ret = sysdb_ghost_store_transaction_prepare(sysdb->ghost_store);
+        if (ret != EOK) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    ret = ldb_transaction_commit(sysdb->ldb);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+    *_ended = true;
+
+    if (sysdb->ghost_store != NULL) {
+        ret = sysdb_ghost_store_transaction_commit(sysdb->ghost_store);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "The cache was committed without "
+                  "the ghost members of its groups\n");
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    return LDB_SUCCESS;
+}
+
+static int sysdb_outer_transaction_cancel(struct sysdb_ctx *sysdb)
+{
+    int ret;
+
+    ret = ldb_transaction_cancel(sysdb->ldb);
+    if (sysdb->ghost_store != NULL) {
+        sysdb_ghost_store_transaction_cancel(sysdb->ghost_store);
+    }
+
+    return ret;
+}
+
+int sysdb_transaction_start(struct sysdb_ctx *sysdb)
+{
+    int ret;
+
+    if (sysdb->transaction_nesting > 0) {
+        ret = ldb_transaction_start(sysdb->ldb);
+    } else {
+        ret = sysdb_outer_transaction_start(sysdb);
+    }
+
     if (ret == LDB_SUCCESS) {
         PROBE(SYSDB_TRANSACTION_START, sysdb->transaction_nesting);
         sysdb->transaction_nesting++;
@@ -887,17 +957,26 @@ int sysdb_transaction_start(struct sysdb_ctx *sysdb)
 
 int sysdb_transaction_commit(struct sysdb_ctx *sysdb)
 {
+    bool ended;
     int ret;
 #ifdef HAVE_SYSTEMTAP
     int commit_nesting = sysdb->transaction_nesting-1;
 #endif
 
     PROBE(SYSDB_TRANSACTION_COMMIT_BEFORE, commit_nesting);
-    ret = ldb_transaction_commit(sysdb->ldb);
-    if (ret == LDB_SUCCESS) {
+    if (sysdb->transaction_nesting == 1) {
+        ret = sysdb_outer_transaction_commit(sysdb, &ended);
+    } else {
+        ret = ldb_transaction_commit(sysdb->ldb);
+        ended = (ret == LDB_SUCCESS);
+    }
+    if (ended) {
         sysdb->transaction_nesting--;
         PROBE(SYSDB_TRANSACTION_COMMIT_AFTER, sysdb->transaction_nesting);
-    } else {
+        sysdb_write_committed(sysdb);
+    }
+
+    if (ret != LDB_SUCCESS) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to commit ldb transaction! (%d)\n", ret);
     }
@@ -908,7 +987,11 @@ int sysdb_transaction_cancel(struct sysdb_ctx *sysdb)
 {
     int ret;
 
-    ret = ldb_transaction_cancel(sysdb->ldb);
+    if (sysdb->transaction_nesting == 1) {
+        ret = sysdb_outer_transaction_cancel(sysdb);
+    } else {
+        ret = ldb_transaction_cancel(sysdb->ldb);
+    }
     if (ret == LDB_SUCCESS) {
         sysdb->transaction_nesting--;
         PROBE(SYSDB_TRANSACTION_CANCEL, sysdb->transaction_nesting);
@@ -919,6 +1002,118 @@ int sysdb_transaction_cancel(struct sysdb_ctx *sysdb)
     return sysdb_error_to_errno(ret);
 }
 
+/* =Group-Commit========================================================== */
+
+/* With cache_commit_mode = group the cache and the ghost store are opened
+ * without flushing each commit. Every transaction is still committed on its
+ * own, so cancelling one never touches the others and the write lock is not
+ * held between them. Only the flush to disk is shared, it is done
+ * cache_commit_window after the first unflushed commit. */
+
+errno_t sysdb_sync(struct sysdb_ctx *sysdb)
+{
+    errno_t ret;
+    int fd;
+
+    fd = open(sysdb->ldb_file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s]: %d [%s]\n",
+              sysdb->ldb_file, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = fdatasync(fd);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot flush [%s]: %d [%s]\n",
+              sysdb->ldb_file, ret, sss_strerror(ret));
+    } else {
+        ret = EOK;
+    }
+    close(fd);
+
+    if (ret == EOK && sysdb->ghost_store != NULL) {
+        ret = sysdb_ghost_store_sync(sysdb->ghost_store);
+    }
+
+    if (ret == EOK) {
+        talloc_zfree(sysdb->flush_te);
+        sysdb->unsynced = false;
+    }
+
+    return ret;
+}
+
+static void sysdb_flush_timeout(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval tv,
+                                void *pvt)
+{
+    struct sysdb_ctx *sysdb = talloc_get_type(pvt, struct sysdb_ctx);
+    errno_t ret;
+
+    sysdb->flush_te = NULL;
+
+    ret = sysdb_sync(sysdb);
+    if (ret != EOK) {
+        /* The next commit schedules another attempt */
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot flush the cache, will retry after the next commit\n");
+    }
+}
+
+void sysdb_write_committed(struct sysdb_ctx *sysdb)
+{
+    struct timeval tv;
+
+    /* Without LDB_FLG_NOSYNC ldb has flushed the commit itself */
+    if (sysdb->transaction_nesting > 0
+            || sysdb->commit_mode != CACHE_COMMIT_GROUP) {
+        return;
+    }
+
+    sysdb->unsynced = true;
+    if (sysdb->flush_te != NULL) {
+        return;
+    }
+
+    if (sysdb->ev == NULL) {
+        sysdb_sync(sysdb);
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(sysdb->commit_window / 1000,
+                                    (sysdb->commit_window % 1000) * 1000);
+    sysdb->flush_te = tevent_add_timer(sysdb->ev, sysdb, tv,
+                                       sysdb_flush_timeout, sysdb);
+    if (sysdb->flush_te == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot schedule cache flush\n");
+        sysdb_sync(sysdb);
+    }
+}
+
+static int sysdb_group_commit_destructor(struct sysdb_ctx *sysdb)
+{
+    talloc_zfree(sysdb->flush_te);
+    if (sysdb->unsynced) {
+        sysdb_sync(sysdb);
+    }
+
+    return 0;
+}
+
+void sysdb_enable_group_commit(struct sysdb_ctx *sysdb,
+                               struct tevent_context *ev)
+{
+    if (sysdb->commit_mode != CACHE_COMMIT_GROUP) {
+        return;
+    }
+
+    sysdb->ev = ev;
+    talloc_set_destructor(sysdb, sysdb_group_commit_destructor);
+}
+
 int compare_ldb_dn_comp_num(const void *m1, const void *m2)
 {
     struct ldb_message *msg1 = talloc_get_type(*(void **) discard_const(m1),
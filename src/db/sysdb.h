@@ -85,6 +85,7 @@
 #define SYSDB_MEMBER "member"
 #define SYSDB_MEMBERUID "memberUid"
 #define SYSDB_GHOST "ghost"
+#define SYSDB_GHOST_STORE "ghostStore"
 #define SYSDB_POSIX "isPosix"
 #define SYSDB_USER_CATEGORY "userCategory"
 #define SYSDB_HOST_CATEGORY "hostCategory"
@@ -274,6 +275,7 @@
                            SYSDB_MEMBERUID, \
                            SYSDB_MEMBER, \
                            SYSDB_GHOST, \
+                           SYSDB_GHOST_STORE, \
                            SYSDB_DEFAULT_ATTRS, \
                            SYSDB_SID_STR, \
                            SYSDB_OVERRIDE_DN, \
@@ -512,6 +514,54 @@ int sysdb_transaction_start(struct sysdb_ctx *sysdb);
 int sysdb_transaction_commit(struct sysdb_ctx *sysdb);
 int sysdb_transaction_cancel(struct sysdb_ctx *sysdb);
 
+/* With cache_commit_mode = group the cache is opened without flushing each
+ * commit to disk. Commits are then flushed together cache_commit_window
+ * milliseconds after the first unflushed one if an event context was set
+ * with sysdb_enable_group_commit(), or immediately otherwise. */
+void sysdb_enable_group_commit(struct sysdb_ctx *sysdb,
+                               struct tevent_context *ev);
+/* Flushes all committed writes to disk */
+errno_t sysdb_sync(struct sysdb_ctx *sysdb);
+
+/* Cache searches aggregated by the shape of their filter, i.e. the filter
+ * with the asserted values replaced by '?', see cache_query_stats */
+struct sysdb_query_shape_stats {
+    char *shape;
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t entries;
+    bool unindexed;
+};
+
+/* Writes the statistics of this process next to the cache file. This is
+ * also done periodically while the cache is searched. */
+errno_t sysdb_query_stats_dump(struct sysdb_ctx *sysdb);
+
+/* Merges the statistics written by all processes for ldb_file, sorted by
+ * the total time spent */
+errno_t sysdb_query_stats_read(TALLOC_CTX *mem_ctx,
+                               const char *ldb_file,
+                               struct sysdb_query_shape_stats **_stats,
+                               size_t *_count);
+
+/* Keeps the results of searches of the cache in a memory mapped file next
+ * to it where all processes which enabled it find them. A stored result is
+ * used until the cache is modified, see cache_shared_search_results. */
+errno_t sysdb_obj_cache_enable(struct sysdb_ctx *sysdb);
+
+/* Ghost members of large groups are not stored in the SYSDB_GHOST attribute
+ * of the group but in a separate store, the group is flagged with
+ * SYSDB_GHOST_STORE then. sysdb_ghost_store_traverse() calls cb for each of
+ * them and for the stored ghost members of all groups nested in the group,
+ * as long as cb returns EOK. The message must contain SYSDB_GHOST_STORE and
+ * SYSDB_MEMBER. */
+typedef errno_t (*sysdb_ghost_store_cb)(const char *name, void *pvt);
+errno_t sysdb_ghost_store_traverse(struct sss_domain_info *domain,
+                                   struct ldb_message *group,
+                                   sysdb_ghost_store_cb cb,
+                                   void *pvt);
+
 /* functions related to subdomains */
 errno_t sysdb_domain_create(struct sysdb_ctx *sysdb, const char *domain_name);
 
@@ -0,0 +1,1354 @@
+/*
+   SSSD
+
+   System Database - separate store for the ghost members of large groups
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Groups with more ghost members than the store threshold do not keep them
+ * in the ghost attribute of the group entry, where every change of a single
+ * member would rewrite the whole entry. The members are kept in a tdb next
+ * to the cache instead and the group entry is flagged with the ghostStore
+ * attribute.
+ *
+ * Records, <group> is the casefolded DN of the group:
+ *   H<group>           - number of members and the ids of the chunks
+ *   C<group>\0<id>     - up to SYSDB_GHOST_STORE_CHUNK member names, each
+ *                        terminated by \0
+ *   M<group>\0<name>   - id of the chunk holding the name
+ *   U<name>            - all groups the name is stored in, each terminated
+ *                        by \0
+ *
+ * Adding or removing a member rewrites one chunk and the short U record of
+ * the member. Readers walk the members one chunk at a time.
+ *
+ * Changes are done in a tdb transaction that follows the outermost sysdb
+ * transaction, or in a transaction of their own outside of one.
+ */
+
+#include "tdb.h"
+
+#include "util/util.h"
+#include "db/sysdb_private.h"
+
+#define GS_HEADER_KEY 'H'
+#define GS_CHUNK_KEY  'C'
+#define GS_MEMBER_KEY 'M'
+#define GS_USER_KEY   'U'
+
+/* tdb hash size, the store holds a record per member */
+#define GS_HASH_SIZE 10007
+
+#define GS_HEADER_WORDS 3
+
+struct sysdb_ghost_store {
+    struct tdb_context *tdb;
+    bool in_transaction;
+};
+
+struct gs_header {
+    uint32_t num_members;
+    uint32_t next_id;
+    uint32_t num_chunks;
+    uint32_t *chunks;
+};
+
+static int ghost_store_destructor(struct sysdb_ghost_store *store)
+{
+    if (store->tdb != NULL) {
+        tdb_close(store->tdb);
+    }
+
+    return 0;
+}
+
+errno_t sysdb_ghost_store_open(TALLOC_CTX *mem_ctx,
+                               const char *ldb_file,
+                               bool nosync,
+                               struct sysdb_ghost_store **_store)
+{
+    struct sysdb_ghost_store *store;
+    char *path;
+    errno_t ret;
+
+    store = talloc_zero(mem_ctx, struct sysdb_ghost_store);
+    if (store == NULL) {
+        return ENOMEM;
+    }
+
+    path = talloc_asprintf(store, "%s%s", ldb_file, SYSDB_GHOST_STORE_SUFFIX);
+    if (path == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    store->tdb = tdb_open(path, GS_HASH_SIZE,
+                          nosync ? TDB_NOSYNC : TDB_DEFAULT,
+                          O_RDWR | O_CREAT, 0600);
+    if (store->tdb == NULL) {
+        ret = errno != 0 ? errno : EIO;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s]: %d [%s]\n",
+              path, ret, sss_strerror(ret));
+        goto done;
+    }
+    talloc_set_destructor(store, ghost_store_destructor);
+
+    *_store = store;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(store);
+    }
+    return ret;
+}
+
+errno_t sysdb_ghost_store_sync(struct sysdb_ghost_store *store)
+{
+    errno_t ret;
+
+    ret = fdatasync(tdb_fd(store->tdb));
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot flush the ghost store: %d [%s]\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+/* =Transactions========================================================== */
+
+errno_t sysdb_ghost_store_transaction_start(struct sysdb_ghost_store *store)
+{
+    if (tdb_transaction_start(store->tdb) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to start ghost store transaction: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    store->in_transaction = true;
+    return EOK;
+}
+
+errno_t sysdb_ghost_store_transaction_prepare(struct sysdb_ghost_store *store)
+{
+    if (tdb_transaction_prepare_commit(store->tdb) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to prepare ghost store commit: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ghost_store_transaction_commit(struct sysdb_ghost_store *store)
+{
+    store->in_transaction = false;
+
+    if (tdb_transaction_commit(store->tdb) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to commit ghost store transaction: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_ghost_store_transaction_cancel(struct sysdb_ghost_store *store)
+{
+    if (!store->in_transaction) {
+        /* Already ended by a failed commit */
+        return EOK;
+    }
+
+    store->in_transaction = false;
+
+    if (tdb_transaction_cancel(store->tdb) != 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to cancel ghost store transaction: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t gs_op_start(struct sysdb_ghost_store *store, bool *_own)
+{
+    errno_t ret;
+
+    *_own = false;
+    if (store->in_transaction) {
+        return EOK;
+    }
+
+    ret = sysdb_ghost_store_transaction_start(store);
+    if (ret == EOK) {
+        *_own = true;
+    }
+
+    return ret;
+}
+
+static errno_t gs_op_done(struct sysdb_ghost_store *store,
+                          bool own, errno_t ret)
+{
+    errno_t tret;
+
+    if (!own) {
+        return ret;
+    }
+
+    if (ret == EOK) {
+        return sysdb_ghost_store_transaction_commit(store);
+    }
+
+    tret = sysdb_ghost_store_transaction_cancel(store);
+    if (tret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Cannot cancel ghost store transaction\n");
+    }
+    return ret;
+}
+
+/* =Records=============================================================== */
+
+static errno_t gs_key(TALLOC_CTX *mem_ctx, char type, const char *first,
+                      const void *second, size_t second_len, TDB_DATA *_key)
+{
+    size_t first_len = strlen(first);
+    uint8_t *buf;
+    size_t len;
+
+    len = 1 + first_len;
+    if (second != NULL) {
+        len += 1 + second_len;
+    }
+
+    buf = talloc_size(mem_ctx, len);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    buf[0] = type;
+    memcpy(buf + 1, first, first_len);
+    if (second != NULL) {
+        buf[1 + first_len] = '\0';
+        memcpy(buf + 2 + first_len, second, second_len);
+    }
+
+    _key->dptr = buf;
+    _key->dsize = len;
+    return EOK;
+}
+
+static errno_t gs_fetch(TALLOC_CTX *mem_ctx,
+                        struct sysdb_ghost_store *store,
+                        TDB_DATA key,
+                        TDB_DATA *_data)
+{
+    TDB_DATA data;
+
+    data = tdb_fetch(store->tdb, key);
+    if (data.dptr == NULL) {
+        if (tdb_error(store->tdb) == TDB_ERR_NOEXIST) {
+            return ENOENT;
+        }
+
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read the ghost store: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    _data->dptr = talloc_memdup(mem_ctx, data.dptr, data.dsize);
+    _data->dsize = data.dsize;
+    free(data.dptr);
+    if (_data->dptr == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static errno_t gs_store(struct sysdb_ghost_store *store,
+                        TDB_DATA key,
+                        TDB_DATA data)
+{
+    if (tdb_store(store->tdb, key, data, TDB_REPLACE) != 0) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot write the ghost store: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+static errno_t gs_delete(struct sysdb_ghost_store *store, TDB_DATA key)
+{
+    if (tdb_delete(store->tdb, key) != 0
+            && tdb_error(store->tdb) != TDB_ERR_NOEXIST) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot delete from the ghost store: %s\n",
+              tdb_errorstr(store->tdb));
+        return EIO;
+    }
+
+    return EOK;
+}
+
+/* Lists of \0 terminated strings, used for chunks and U records */
+
+static bool gs_list_valid(TDB_DATA list)
+{
+    return list.dsize > 0 && list.dptr[list.dsize - 1] == '\0';
+}
+
+static size_t gs_list_count(TDB_DATA list)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < list.dsize; i++) {
+        if (list.dptr[i] == '\0') {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static uint8_t *gs_list_find(TDB_DATA list, const char *str)
+{
+    uint8_t *p;
+
+    for (p = list.dptr; p < list.dptr + list.dsize;
+         p += strlen((char *) p) + 1) {
+        if (strcmp((char *) p, str) == 0) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static errno_t gs_list_append(TALLOC_CTX *mem_ctx, TDB_DATA *list,
+                              const char *str)
+{
+    size_t len = strlen(str) + 1;
+    uint8_t *buf;
+
+    buf = talloc_realloc(mem_ctx, list->dptr, uint8_t, list->dsize + len);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    memcpy(buf + list->dsize, str, len);
+    list->dptr = buf;
+    list->dsize += len;
+    return EOK;
+}
+
+static bool gs_list_remove(TDB_DATA *list, const char *str)
+{
+    uint8_t *p;
+    size_t len;
+
+    p = gs_list_find(*list, str);
+    if (p == NULL) {
+        return false;
+    }
+
+    len = strlen(str) + 1;
+    memmove(p, p + len, list->dptr + list->dsize - (p + len));
+    list->dsize -= len;
+    return true;
+}
+
+static errno_t gs_header_get(TALLOC_CTX *mem_ctx,
+                             struct sysdb_ghost_store *store,
+                             const char *gdn,
+                             struct gs_header **_hdr)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct gs_header *hdr;
+    uint32_t *words;
+    TDB_DATA key;
+    TDB_DATA data;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_key(tmp_ctx, GS_HEADER_KEY, gdn, NULL, 0, &key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_fetch(tmp_ctx, store, key, &data);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    words = (uint32_t *) data.dptr;
+    if (data.dsize % sizeof(uint32_t) != 0
+            || data.dsize < GS_HEADER_WORDS * sizeof(uint32_t)
+            || words[2] != data.dsize / sizeof(uint32_t) - GS_HEADER_WORDS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Corrupted ghost store header of [%s]\n", gdn);
+        ret = EINVAL;
+        goto done;
+    }
+
+    hdr = talloc_zero(mem_ctx, struct gs_header);
+    if (hdr == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    hdr->num_members = words[0];
+    hdr->next_id = words[1];
+    hdr->num_chunks = words[2];
+    hdr->chunks = talloc_memdup(hdr, words + GS_HEADER_WORDS,
+                                hdr->num_chunks * sizeof(uint32_t));
+    if (hdr->chunks == NULL) {
+        talloc_free(hdr);
+        ret = ENOMEM;
+        goto done;
+    }
+
+    *_hdr = hdr;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t gs_header_set(struct sysdb_ghost_store *store,
+                             const char *gdn,
+                             struct gs_header *hdr)
+{
+    TALLOC_CTX *tmp_ctx;
+    uint32_t *words;
+    TDB_DATA key;
+    TDB_DATA data;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_key(tmp_ctx, GS_HEADER_KEY, gdn, NULL, 0, &key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (hdr->num_members == 0) {
+        ret = gs_delete(store, key);
+        goto done;
+    }
+
+    words = talloc_array(tmp_ctx, uint32_t, GS_HEADER_WORDS + hdr->num_chunks);
+    if (words == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    words[0] = hdr->num_members;
+    words[1] = hdr->next_id;
+    words[2] = hdr->num_chunks;
+    memcpy(words + GS_HEADER_WORDS, hdr->chunks,
+           hdr->num_chunks * sizeof(uint32_t));
+
+    data.dptr = (uint8_t *) words;
+    data.dsize = (GS_HEADER_WORDS + hdr->num_chunks) * sizeof(uint32_t);
+    ret = gs_store(store, key, data);
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t gs_chunk_key(TALLOC_CTX *mem_ctx, const char *gdn,
+                            uint32_t id, TDB_DATA *_key)
+{
+    return gs_key(mem_ctx, GS_CHUNK_KEY, gdn, &id, sizeof(id), _key);
+}
+
+static errno_t gs_member_key(TALLOC_CTX *mem_ctx, const char *gdn,
+                             const char *name, TDB_DATA *_key)
+{
+    return gs_key(mem_ctx, GS_MEMBER_KEY, gdn, name, strlen(name), _key);
+}
+
+static errno_t gs_user_link(struct sysdb_ghost_store *store,
+                            const char *name,
+                            const char *gdn,
+                            bool add)
+{
+    TALLOC_CTX *tmp_ctx;
+    TDB_DATA key;
+    TDB_DATA list = { NULL, 0 };
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_key(tmp_ctx, GS_USER_KEY, name, NULL, 0, &key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_fetch(tmp_ctx, store, key, &list);
+    if (ret == ENOENT) {
+        if (!add) {
+            ret = EOK;
+            goto done;
+        }
+    } else if (ret != EOK) {
+        goto done;
+    } else if (!gs_list_valid(list)) {
+        /* Rebuild a damaged record from scratch */
+        talloc_zfree(list.dptr);
+        list.dsize = 0;
+    }
+
+    if (add) {
+        if (gs_list_find(list, gdn) != NULL) {
+            ret = EOK;
+            goto done;
+        }
+
+        ret = gs_list_append(tmp_ctx, &list, gdn);
+        if (ret != EOK) {
+            goto done;
+        }
+    } else if (!gs_list_remove(&list, gdn)) {
+        ret = EOK;
+        goto done;
+    }
+
+    if (list.dsize == 0) {
+        ret = gs_delete(store, key);
+    } else {
+        ret = gs_store(store, key, list);
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Names which are already stored are skipped */
+static errno_t gs_add_names(struct sysdb_ghost_store *store,
+                            const char *gdn,
+                            struct gs_header *hdr,
+                            struct ldb_message_element *el)
+{
+    TALLOC_CTX *tmp_ctx;
+    TALLOC_CTX *name_ctx;
+    TDB_DATA chunk = { NULL, 0 };
+    TDB_DATA key;
+    TDB_DATA data;
+    const char *name;
+    uint32_t *chunks;
+    uint32_t id = 0;
+    size_t in_chunk;
+    bool dirty = false;
+    errno_t ret;
+    int i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    name_ctx = talloc_new(tmp_ctx);
+    if (name_ctx == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Start with the last chunk, it is the only one which is not full */
+    in_chunk = SYSDB_GHOST_STORE_CHUNK;
+    if (hdr->num_chunks > 0) {
+        id = hdr->chunks[hdr->num_chunks - 1];
+
+        ret = gs_chunk_key(tmp_ctx, gdn, id, &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_fetch(tmp_ctx, store, key, &chunk);
+        if (ret == EOK && gs_list_valid(chunk)) {
+            in_chunk = gs_list_count(chunk);
+        } else if (ret != ENOENT && ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        talloc_free_children(name_ctx);
+        name = (const char *) el->values[i].data;
+
+        ret = gs_member_key(name_ctx, gdn, name, &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        if (tdb_exists(store->tdb, key)) {
+            continue;
+        }
+
+        if (in_chunk >= SYSDB_GHOST_STORE_CHUNK) {
+            if (dirty) {
+                ret = gs_chunk_key(name_ctx, gdn, id, &key);
+                if (ret != EOK) {
+                    goto done;
+                }
+
+                ret = gs_store(store, key, chunk);
+                if (ret != EOK) {
+                    goto done;
+                }
+
+                ret = gs_member_key(name_ctx, gdn, name, &key);
+                if (ret != EOK) {
+                    goto done;
+                }
+            }
+
+            chunks = talloc_realloc(hdr, hdr->chunks, uint32_t,
+                                    hdr->num_chunks + 1);
+            if (chunks == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+            hdr->chunks = chunks;
+
+            id = hdr->next_id++;
+            hdr->chunks[hdr->num_chunks++] = id;
+
+            talloc_zfree(chunk.dptr);
+            chunk.dsize = 0;
+            in_chunk = 0;
+        }
+
+        ret = gs_list_append(tmp_ctx, &chunk, name);
+        if (ret != EOK) {
+            goto done;
+        }
+        in_chunk++;
+        dirty = true;
+
+        data.dptr = (uint8_t *) &id;
+        data.dsize = sizeof(id);
+        ret = gs_store(store, key, data);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_user_link(store, name, gdn, true);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        hdr->num_members++;
+    }
+
+    if (dirty) {
+        ret = gs_chunk_key(tmp_ctx, gdn, id, &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_store(store, key, chunk);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static void gs_header_remove_chunk(struct gs_header *hdr, uint32_t id)
+{
+    uint32_t i;
+
+    for (i = 0; i < hdr->num_chunks; i++) {
+        if (hdr->chunks[i] == id) {
+            memmove(&hdr->chunks[i], &hdr->chunks[i + 1],
+                    (hdr->num_chunks - i - 1) * sizeof(uint32_t));
+            hdr->num_chunks--;
+            return;
+        }
+    }
+}
+
+static errno_t gs_del_name(struct sysdb_ghost_store *store,
+                           const char *gdn,
+                           struct gs_header *hdr,
+                           const char *name)
+{
+    TALLOC_CTX *tmp_ctx;
+    TDB_DATA mkey;
+    TDB_DATA ckey;
+    TDB_DATA data;
+    TDB_DATA chunk;
+    uint32_t id;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_member_key(tmp_ctx, gdn, name, &mkey);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_fetch(tmp_ctx, store, mkey, &data);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    if (data.dsize != sizeof(id)) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Corrupted ghost store record of [%s] in [%s]\n", name, gdn);
+        ret = EINVAL;
+        goto done;
+    }
+    memcpy(&id, data.dptr, sizeof(id));
+
+    ret = gs_chunk_key(tmp_ctx, gdn, id, &ckey);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_fetch(tmp_ctx, store, ckey, &chunk);
+    if (ret == EOK) {
+        gs_list_remove(&chunk, name);
+        if (chunk.dsize == 0) {
+            ret = gs_delete(store, ckey);
+            gs_header_remove_chunk(hdr, id);
+        } else {
+            ret = gs_store(store, ckey, chunk);
+        }
+    } else if (ret == ENOENT) {
+        gs_header_remove_chunk(hdr, id);
+        ret = EOK;
+    }
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_delete(store, mkey);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_user_link(store, name, gdn, false);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (hdr->num_members > 0) {
+        hdr->num_members--;
+    }
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Calls cb for every name stored for the group */
+static errno_t gs_walk(struct sysdb_ghost_store *store,
+                       const char *gdn,
+                       sysdb_ghost_store_cb cb,
+                       void *pvt)
+{
+    TALLOC_CTX *tmp_ctx;
+    TALLOC_CTX *chunk_ctx;
+    struct gs_header *hdr;
+    TDB_DATA key;
+    TDB_DATA chunk;
+    uint8_t *p;
+    uint32_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_header_get(tmp_ctx, store, gdn, &hdr);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    chunk_ctx = talloc_new(tmp_ctx);
+    if (chunk_ctx == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < hdr->num_chunks; i++) {
+        talloc_free_children(chunk_ctx);
+
+        ret = gs_chunk_key(chunk_ctx, gdn, hdr->chunks[i], &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_fetch(chunk_ctx, store, key, &chunk);
+        if (ret == ENOENT) {
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+
+        if (!gs_list_valid(chunk)) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Corrupted ghost store chunk of [%s]\n", gdn);
+            continue;
+        }
+
+        for (p = chunk.dptr; p < chunk.dptr + chunk.dsize;
+             p += strlen((char *) p) + 1) {
+            ret = cb((const char *) p, pvt);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+struct gs_collect_state {
+    TALLOC_CTX *mem_ctx;
+    hash_table_t *keep;
+    const char **names;
+    size_t count;
+};
+
+static errno_t gs_collect_cb(const char *name, void *pvt)
+{
+    struct gs_collect_state *state = pvt;
+    hash_key_t key;
+
+    if (state->keep != NULL) {
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(name);
+        if (hash_has_key(state->keep, &key)) {
+            return EOK;
+        }
+    }
+
+    state->names = talloc_realloc(state->mem_ctx, state->names, const char *,
+                                  state->count + 1);
+    if (state->names == NULL) {
+        return ENOMEM;
+    }
+
+    state->names[state->count] = talloc_strdup(state->names, name);
+    if (state->names[state->count] == NULL) {
+        return ENOMEM;
+    }
+    state->count++;
+
+    return EOK;
+}
+
+/* =Public functions====================================================== */
+
+errno_t sysdb_ghost_store_set(struct sysdb_ghost_store *store,
+                              struct ldb_dn *group_dn,
+                              struct ldb_message_element *ghosts)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct gs_collect_state state = { 0 };
+    struct gs_header *hdr;
+    hash_key_t key;
+    hash_value_t value;
+    const char *gdn;
+    bool own = false;
+    errno_t ret;
+    size_t i;
+    int hret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    gdn = ldb_dn_get_casefold(group_dn);
+    if (gdn == NULL) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    ret = gs_op_start(store, &own);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_header_get(tmp_ctx, store, gdn, &hdr);
+    if (ret == ENOENT) {
+        hdr = talloc_zero(tmp_ctx, struct gs_header);
+        if (hdr == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    /* Only the members which are gone are removed, the others are kept */
+    if (hdr->num_members > 0) {
+        ret = sss_hash_create(tmp_ctx, ghosts->num_values, &state.keep);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        value.type = HASH_VALUE_UNDEF;
+        key.type = HASH_KEY_STRING;
+        for (i = 0; i < ghosts->num_values; i++) {
+            key.str = (char *) ghosts->values[i].data;
+            hret = hash_enter(state.keep, &key, &value);
+            if (hret != HASH_SUCCESS) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+
+        state.mem_ctx = tmp_ctx;
+        ret = gs_walk(store, gdn, gs_collect_cb, &state);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        for (i = 0; i < state.count; i++) {
+            ret = gs_del_name(store, gdn, hdr, state.names[i]);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+    ret = gs_add_names(store, gdn, hdr, ghosts);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_header_set(store, gdn, hdr);
+
+done:
+    ret = gs_op_done(store, own, ret);
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ghost_store_drop(struct sysdb_ghost_store *store,
+                               struct ldb_dn *group_dn)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct gs_collect_state state = { 0 };
+    struct gs_header *hdr;
+    const char *gdn;
+    TDB_DATA key;
+    bool own = false;
+    errno_t ret;
+    size_t i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    gdn = ldb_dn_get_casefold(group_dn);
+    if (gdn == NULL) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    /* Most entries are not in the store, do not start a transaction */
+    ret = gs_header_get(tmp_ctx, store, gdn, &hdr);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_op_start(store, &own);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    state.mem_ctx = tmp_ctx;
+    ret = gs_walk(store, gdn, gs_collect_cb, &state);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < state.count; i++) {
+        ret = gs_member_key(tmp_ctx, gdn, state.names[i], &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_delete(store, key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_user_link(store, state.names[i], gdn, false);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < hdr->num_chunks; i++) {
+        ret = gs_chunk_key(tmp_ctx, gdn, hdr->chunks[i], &key);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_delete(store, key);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    hdr->num_members = 0;
+    ret = gs_header_set(store, gdn, hdr);
+
+done:
+    ret = gs_op_done(store, own, ret);
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sysdb_ghost_store_remove_name(TALLOC_CTX *mem_ctx,
+                                      struct sysdb_ghost_store *store,
+                                      struct ldb_context *ldb,
+                                      const char *name,
+                                      struct ldb_dn ***_dns,
+                                      size_t *_count)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct gs_header *hdr;
+    struct ldb_dn **dns = NULL;
+    size_t count = 0;
+    TDB_DATA key;
+    TDB_DATA list;
+    uint8_t *p;
+    bool own = false;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = gs_key(tmp_ctx, GS_USER_KEY, name, NULL, 0, &key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = gs_fetch(tmp_ctx, store, key, &list);
+    if (ret == ENOENT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    if (!gs_list_valid(list)) {
+        ret = gs_delete(store, key);
+        goto done;
+    }
+
+    dns = talloc_zero_array(tmp_ctx, struct ldb_dn *, gs_list_count(list));
+    if (dns == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = gs_op_start(store, &own);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    /* gs_del_name() updates the U record, list is a copy of it */
+    for (p = list.dptr; p < list.dptr + list.dsize;
+         p += strlen((char *) p) + 1) {
+        ret = gs_header_get(tmp_ctx, store, (const char *) p, &hdr);
+        if (ret == ENOENT) {
+            ret = gs_user_link(store, name, (const char *) p, false);
+            if (ret != EOK) {
+                goto done;
+            }
+            continue;
+        } else if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_del_name(store, (const char *) p, hdr, name);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = gs_header_set(store, (const char *) p, hdr);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        dns[count] = ldb_dn_new(dns, ldb, (const char *) p);
+        if (dns[count] == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        count++;
+    }
+
+    ret = EOK;
+
+done:
+    ret = gs_op_done(store, own, ret);
+    if (ret == EOK) {
+        if (_dns != NULL) {
+            *_dns = talloc_steal(mem_ctx, dns);
+        }
+        if (_count != NULL) {
+            *_count = count;
+        }
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+struct gs_traverse_state {
+    hash_table_t *seen;
+    sysdb_ghost_store_cb cb;
+    void *pvt;
+};
+
+static errno_t gs_traverse_cb(const char *name, void *pvt)
+{
+    struct gs_traverse_state *state = pvt;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    if (state->seen != NULL) {
+        key.type = HASH_KEY_STRING;
+        key.str = discard_const(name);
+        if (hash_has_key(state->seen, &key)) {
+            return EOK;
+        }
+
+        value.type = HASH_VALUE_UNDEF;
+        hret = hash_enter(state->seen, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            return ENOMEM;
+        }
+    }
+
+    return state->cb(name, state->pvt);
+}
+
+/* Ghost members are not inherited through memberof from groups in the store,
+ * so nested groups have to be read too. Only groups with group members can
+ * have any. */
+static bool gs_has_group_members(struct ldb_message *group)
+{
+    struct ldb_message_element *el;
+    unsigned int i;
+
+    el = ldb_msg_find_element(group, SYSDB_MEMBER);
+    if (el == NULL) {
+        return false;
+    }
+
+    for (i = 0; i < el->num_values; i++) {
+        if (strstr((const char *) el->values[i].data,
+                   ","SYSDB_GROUPS_CONTAINER",") != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+errno_t sysdb_ghost_store_traverse(struct sss_domain_info *domain,
+                                   struct ldb_message *group,
+                                   sysdb_ghost_store_cb cb,
+                                   void *pvt)
+{
+    struct sysdb_ghost_store *store = domain->sysdb->ghost_store;
+    const char *attrs[] = { SYSDB_NAME, NULL };
+    struct gs_traverse_state state = { 0 };
+    struct ldb_message **nested = NULL;
+    size_t num_nested = 0;
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *base_dn;
+    char *sanitized_dn;
+    char *filter;
+    bool own_members;
+    bool locked = false;
+    const char *gdn;
+    errno_t ret;
+    size_t i;
+
+    own_members = ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false);
+    if (!own_members && !gs_has_group_members(group)) {
+        return EOK;
+    }
+
+    if (store == NULL) {
+        if (own_members) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Ghost members of [%s] are not "
+                  "available, the ghost store is not open\n",
+                  ldb_dn_get_linearized(group->dn));
+        }
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    if (gs_has_group_members(group)) {
+        ret = sss_filter_sanitize_dn(tmp_ctx, ldb_dn_get_linearized(group->dn),
+                                     &sanitized_dn);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        /* Both attributes are indexed and only a few groups are in the
+         * store, so this intersects two short index lists. Only groups are
+         * flagged, matching the object category would read the index of
+         * all groups. */
+        filter = talloc_asprintf(tmp_ctx, "(&(%s=TRUE)(%s=%s))",
+                                 SYSDB_GHOST_STORE,
+                                 SYSDB_MEMBEROF, sanitized_dn);
+        if (filter == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        /* Nesting may cross subdomains */
+        base_dn = ldb_dn_new(tmp_ctx, domain->sysdb->ldb, SYSDB_BASE);
+        if (base_dn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_search_entry(tmp_ctx, domain->sysdb, base_dn,
+                                 LDB_SCOPE_SUBTREE, filter, attrs,
+                                 &num_nested, &nested);
+        if (ret == ENOENT) {
+            num_nested = 0;
+        } else if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    if (!own_members && num_nested == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    state.cb = cb;
+    state.pvt = pvt;
+    if (own_members + num_nested > 1) {
+        ret = sss_hash_create(tmp_ctx, 0, &state.seen);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    /* Keep writers from changing the store between the chunks */
+    if (!store->in_transaction) {
+        if (tdb_lockall_read(store->tdb) != 0) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot lock the ghost store: %s\n",
+                  tdb_errorstr(store->tdb));
+            ret = EIO;
+            goto done;
+        }
+        locked = true;
+    }
+
+    if (own_members) {
+        gdn = ldb_dn_get_casefold(group->dn);
+        if (gdn == NULL) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = gs_walk(store, gdn, gs_traverse_cb, &state);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    for (i = 0; i < num_nested; i++) {
+        gdn = ldb_dn_get_casefold(nested[i]->dn);
+        if (gdn == NULL) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        ret = gs_walk(store, gdn, gs_traverse_cb, &state);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    if (locked) {
+        tdb_unlockall_read(store->tdb);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
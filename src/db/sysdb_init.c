@@ -27,9 +27,22 @@
 #include "confdb/confdb.h"
 #include "util/probes.h"
 #include <time.h>
+#include <fcntl.h>
 
 #define LDB_MODULES_PATH "LDB_MODULES_PATH"
 
+/* ldb selects the backend by the URL scheme, plain paths are opened as TDB */
+#define SYSDB_MDB_URL_PREFIX "mdb://"
+
+/* The first bytes of every TDB file */
+#define SYSDB_TDB_MAGIC "TDB file"
+
+/* An LMDB file starts with a meta page: the page header (page number,
+ * padding, flags, lower and upper bound) is followed by the magic number
+ * in host byte order. */
+#define SYSDB_MDB_MAGIC 0xBEEFC0DE
+#define SYSDB_MDB_MAGIC_OFFSET (sizeof(size_t) + 4 * sizeof(uint16_t))
+
 /* If an entry differs only in these attributes, they are written to
  * the timestamp cache only. In addition, objectclass/objectcategory is added
  * so that we can distinguish between users and groups.
@@ -46,15 +59,95 @@ const char *sysdb_ts_cache_attrs[] = {
     NULL,
 };
 
+errno_t sysdb_get_db_file_backend(const char *filename,
+                                  enum sss_cache_backend *_backend)
+{
+    uint8_t header[SYSDB_MDB_MAGIC_OFFSET + sizeof(uint32_t)];
+    uint32_t mdb_magic;
+    ssize_t len;
+    errno_t ret;
+    int fd;
+
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    len = sss_atomic_read_s(fd, header, sizeof(header));
+    if (len == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot read %s [%d]: %s\n",
+              filename, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    if (len == 0) {
+        /* An empty file is created from scratch by either backend */
+        ret = ENOENT;
+        goto done;
+    }
+
+    if ((size_t)len >= sizeof(SYSDB_TDB_MAGIC) - 1
+            && memcmp(header, SYSDB_TDB_MAGIC,
+                      sizeof(SYSDB_TDB_MAGIC) - 1) == 0) {
+        *_backend = CACHE_BACKEND_TDB;
+        ret = EOK;
+        goto done;
+    }
+
+    if ((size_t)len == sizeof(header)) {
+        memcpy(&mdb_magic, header + SYSDB_MDB_MAGIC_OFFSET, sizeof(mdb_magic));
+        if (mdb_magic == SYSDB_MDB_MAGIC) {
+            *_backend = CACHE_BACKEND_MDB;
+            ret = EOK;
+            goto done;
+        }
+    }
+
+    /* Opening it with a guessed backend could overwrite the file */
+    DEBUG(SSSDBG_FATAL_FAILURE,
+          "%s is neither a TDB nor an LMDB database\n", filename);
+    ret = EINVAL;
+
+done:
+    close(fd);
+    return ret;
+}
+
+const char *sysdb_cache_backend_str(enum sss_cache_backend backend)
+{
+    switch (backend) {
+    case CACHE_BACKEND_TDB:
+        return CONFDB_DOMAIN_CACHE_BACKEND_TDB;
+    case CACHE_BACKEND_MDB:
+        return CONFDB_DOMAIN_CACHE_BACKEND_MDB;
+    }
+
+    return "unknown";
+}
+
 errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx,
                           const char *filename,
                           int flags,
                           struct ldb_context **_ldb)
+{
+    return sysdb_ldb_connect_ext(mem_ctx, filename, CACHE_BACKEND_TDB,
+                                 flags, NULL, _ldb);
+}
+
+errno_t sysdb_ldb_connect_ext(TALLOC_CTX *mem_ctx,
+                              const char *filename,
+                              enum sss_cache_backend backend,
+                              int flags,
+                              const char *options[],
+                              struct ldb_context **_ldb)
 {
     TALLOC_CTX *tmp_ctx = NULL;
     errno_t ret;
     struct ldb_context *ldb;
     char *mod_path = NULL;
+    const char *url;
+    enum sss_cache_backend file_backend;
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
@@ -91,8 +184,31 @@ errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_connect(ldb, filename, flags, NULL);
+    /* An existing database is always opened with the backend it was
+     * created with, the requested one only applies to new files. Switching
+     * the backend of an existing cache is done by sysdb_upgrade_backend(). */
+    url = filename;
+    if (strstr(filename, "://") == NULL) {
+        ret = sysdb_get_db_file_backend(filename, &file_backend);
+        if (ret == EOK) {
+            backend = file_backend;
+        } else if (ret != ENOENT) {
+            goto done;
+        }
+
+        if (backend == CACHE_BACKEND_MDB) {
+            url = talloc_asprintf(tmp_ctx, SYSDB_MDB_URL_PREFIX"%s", filename);
+            if (url == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+        }
+    }
+
+    ret = ldb_connect(ldb, url, flags, options);
     if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to open [%s]: %s\n",
+              url, ldb_strerror(ret));
         ret = EIO;
         goto done;
     }
@@ -108,13 +224,14 @@ done:
 
 static errno_t sysdb_ldb_reconnect(TALLOC_CTX *mem_ctx,
                                    const char *ldb_file,
+                                   enum sss_cache_backend backend,
                                    int flags,
                                    struct ldb_context **ldb)
 {
     errno_t ret;
 
     talloc_zfree(*ldb);
-    ret = sysdb_ldb_connect(mem_ctx, ldb_file, flags, ldb);
+    ret = sysdb_ldb_connect_ext(mem_ctx, ldb_file, backend, flags, NULL, ldb);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
     }
@@ -122,27 +239,66 @@ static errno_t sysdb_ldb_reconnect(TALLOC_CTX *mem_ctx,
     return ret;
 }
 
-static errno_t sysdb_chown_db_files(struct sysdb_ctx *sysdb,
-                                    uid_t uid, gid_t gid)
+/* Files kept next to a database file: the reader table of the mdb backend,
+ * the timestamp map and the ghost store */
+static const char *sysdb_db_file_companions[] = {
+    SYSDB_MDB_LOCK_SUFFIX,
+    SYSDB_TS_MAP_SUFFIX,
+    SYSDB_GHOST_STORE_SUFFIX,
+    NULL
+};
+
+static errno_t sysdb_chown_db_file(const char *filename,
+                                   uid_t uid, gid_t gid)
 {
+    char *companion;
     errno_t ret;
+    int i;
 
-    ret = chown(sysdb->ldb_file, uid, gid);
+    ret = chown(filename, uid, gid);
     if (ret != 0) {
         ret = errno;
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Cannot set sysdb ownership of %s to %"SPRIuid":%"SPRIgid"\n",
-              sysdb->ldb_file, uid, gid);
+              filename, uid, gid);
         return ret;
     }
 
-    if (sysdb->ldb_ts_file != NULL) {
-        ret = chown(sysdb->ldb_ts_file, uid, gid);
-        if (ret != 0) {
+    for (i = 0; sysdb_db_file_companions[i] != NULL; i++) {
+        companion = talloc_asprintf(NULL, "%s%s", filename,
+                                    sysdb_db_file_companions[i]);
+        if (companion == NULL) {
+            return ENOMEM;
+        }
+
+        ret = chown(companion, uid, gid);
+        if (ret != 0 && errno != ENOENT) {
             ret = errno;
             DEBUG(SSSDBG_CRIT_FAILURE,
-                  "Cannot set sysdb ownership of %s to %"SPRIuid":%"SPRIgid"\n",
-                  sysdb->ldb_ts_file, uid, gid);
+                  "Cannot set sysdb ownership of %s to "
+                  "%"SPRIuid":%"SPRIgid"\n", companion, uid, gid);
+            talloc_free(companion);
+            return ret;
+        }
+        talloc_free(companion);
+    }
+
+    return EOK;
+}
+
+static errno_t sysdb_chown_db_files(struct sysdb_ctx *sysdb,
+                                    uid_t uid, gid_t gid)
+{
+    errno_t ret;
+
+    ret = sysdb_chown_db_file(sysdb->ldb_file, uid, gid);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    if (sysdb->ldb_ts_file != NULL) {
+        ret = sysdb_chown_db_file(sysdb->ldb_ts_file, uid, gid);
+        if (ret != EOK) {
             return ret;
         }
     }
@@ -603,6 +759,13 @@ static errno_t sysdb_domain_cache_upgrade(TALLOC_CTX *mem_ctx,
         }
     }
 
+    if (strcmp(version, SYSDB_VERSION_0_23) == 0) {
+        ret = sysdb_upgrade_23(sysdb, &version);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
     ret = EOK;
 done:
     sysdb->ldb = save_ldb;
@@ -611,25 +774,70 @@ done:
     return ret;
 }
 
-static errno_t remove_ts_cache(struct sysdb_ctx *sysdb)
+errno_t sysdb_remove_db_file(const char *filename)
 {
+    char *companion;
     errno_t ret;
+    int i;
+
+    ret = unlink(filename);
+    if (ret != EOK && errno != ENOENT) {
+        return errno;
+    }
 
+    for (i = 0; sysdb_db_file_companions[i] != NULL; i++) {
+        companion = talloc_asprintf(NULL, "%s%s", filename,
+                                    sysdb_db_file_companions[i]);
+        if (companion == NULL) {
+            return ENOMEM;
+        }
+
+        ret = unlink(companion);
+        talloc_free(companion);
+        if (ret != EOK && errno != ENOENT) {
+            return errno;
+        }
+    }
+
+    return EOK;
+}
+
+static errno_t remove_ts_cache(struct sysdb_ctx *sysdb)
+{
     if (sysdb->ldb_ts_file == NULL) {
         return EOK;
     }
 
-    ret = unlink(sysdb->ldb_ts_file);
-    if (ret != EOK && errno != ENOENT) {
-        return errno;
+    return sysdb_remove_db_file(sysdb->ldb_ts_file);
+}
+
+/* Stored ghost members of a removed cache must not show up in a new one */
+static errno_t remove_ghost_store(struct sysdb_ctx *sysdb)
+{
+    char *path;
+    errno_t ret;
+
+    path = talloc_asprintf(NULL, "%s%s", sysdb->ldb_file,
+                           SYSDB_GHOST_STORE_SUFFIX);
+    if (path == NULL) {
+        return ENOMEM;
     }
 
-    return EOK;
+    ret = unlink(path);
+    if (ret != 0 && errno != ENOENT) {
+        ret = errno;
+    } else {
+        ret = EOK;
+    }
+
+    talloc_free(path);
+    return ret;
 }
 
 static errno_t sysdb_cache_connect_helper(TALLOC_CTX *mem_ctx,
                                           struct sss_domain_info *domain,
                                           const char *ldb_file,
+                                          enum sss_cache_backend backend,
                                           int flags,
                                           const char *exp_version,
                                           const char *base_ldif,
@@ -652,7 +860,7 @@ static errno_t sysdb_cache_connect_helper(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = sysdb_ldb_connect(tmp_ctx, ldb_file, flags, &ldb);
+    ret = sysdb_ldb_connect_ext(tmp_ctx, ldb_file, backend, flags, NULL, &ldb);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "sysdb_ldb_connect failed.\n");
         goto done;
@@ -717,7 +925,7 @@ static errno_t sysdb_cache_connect_helper(TALLOC_CTX *mem_ctx,
      * (such as enabling the memberOf plugin and
      * the various indexes).
      */
-    ret = sysdb_ldb_reconnect(tmp_ctx, ldb_file, flags, &ldb);
+    ret = sysdb_ldb_reconnect(tmp_ctx, ldb_file, backend, flags, &ldb);
     if (ret != EOK) {
         goto done;
     }
@@ -741,6 +949,13 @@ done:
     return ret;
 }
 
+/* Unless each commit has to be flushed, sysdb_write_committed() takes care
+ * of flushing the cache */
+static int sysdb_cache_open_flags(struct sysdb_ctx *sysdb)
+{
+    return sysdb->commit_mode == CACHE_COMMIT_SYNC ? 0 : LDB_FLG_NOSYNC;
+}
+
 static errno_t sysdb_cache_connect(TALLOC_CTX *mem_ctx,
                                    struct sysdb_ctx *sysdb,
                                    struct sss_domain_info *domain,
@@ -754,7 +969,9 @@ static errno_t sysdb_cache_connect(TALLOC_CTX *mem_ctx,
     ldb_file_exists = !(access(sysdb->ldb_file, F_OK) == -1 && errno == ENOENT);
 
     ret = sysdb_cache_connect_helper(mem_ctx, domain, sysdb->ldb_file,
-                                      0, SYSDB_VERSION, SYSDB_BASE_LDIF,
+                                      sysdb->backend,
+                                      sysdb_cache_open_flags(sysdb),
+                                      SYSDB_VERSION, SYSDB_BASE_LDIF,
                                       &newly_created, ldb, version);
 
     /* The cache has been newly created. */
@@ -765,6 +982,13 @@ static errno_t sysdb_cache_connect(TALLOC_CTX *mem_ctx,
                   "Could not delete the timestamp ldb file (%d) (%s)\n",
                   ret, sss_strerror(ret));
         }
+
+        ret = remove_ghost_store(sysdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Could not delete the ghost store (%d) (%s)\n",
+                  ret, sss_strerror(ret));
+        }
     }
 
     return ret;
@@ -777,7 +1001,7 @@ static errno_t sysdb_ts_cache_connect(TALLOC_CTX *mem_ctx,
                                       const char **version)
 {
     return sysdb_cache_connect_helper(mem_ctx, domain, sysdb->ldb_ts_file,
-                                      LDB_FLG_NOSYNC, SYSDB_TS_VERSION,
+                                      sysdb->backend, LDB_FLG_NOSYNC, SYSDB_TS_VERSION,
                                       SYSDB_TS_BASE_LDIF, NULL,
                                       ldb, version);
 }
@@ -790,12 +1014,24 @@ static int sysdb_domain_cache_connect(struct sysdb_ctx *sysdb,
     const char *version = NULL;
     TALLOC_CTX *tmp_ctx;
     struct ldb_context *ldb;
+    struct stat st;
 
     tmp_ctx = talloc_new(NULL);
     if (tmp_ctx == NULL) {
         return ENOMEM;
     }
 
+    if (upgrade_ctx != NULL) {
+        ret = sysdb_upgrade_backend(sysdb->ldb_file, sysdb->backend);
+        if (ret != EOK) {
+            /* The cache is still usable with its current backend */
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Could not convert the cache of domain %s to %s [%d]: %s\n",
+                  domain->name, sysdb_cache_backend_str(sysdb->backend),
+                  ret, sss_strerror(ret));
+        }
+    }
+
     ret = sysdb_cache_connect(tmp_ctx, sysdb, domain, &ldb, &version);
     switch (ret) {
     case ERR_SYSDB_VERSION_TOO_OLD:
@@ -836,7 +1072,9 @@ static int sysdb_domain_cache_connect(struct sysdb_ctx *sysdb,
              * We need to reopen the LDB to ensure that
              * any changes made above take effect.
              */
-            ret = sysdb_ldb_reconnect(tmp_ctx, sysdb->ldb_file, 0, &ldb);
+            ret = sysdb_ldb_reconnect(tmp_ctx, sysdb->ldb_file,
+                                      sysdb->backend,
+                                      sysdb_cache_open_flags(sysdb), &ldb);
             goto done;
         }
         break;
@@ -852,6 +1090,10 @@ static int sysdb_domain_cache_connect(struct sysdb_ctx *sysdb,
 done:
     if (ret == EOK) {
         sysdb->ldb = talloc_steal(sysdb, ldb);
+        if (stat(sysdb->ldb_file, &st) == 0) {
+            sysdb->ldb_dev = st.st_dev;
+            sysdb->ldb_ino = st.st_ino;
+        }
     }
     talloc_free(tmp_ctx);
     return ret;
@@ -876,6 +1118,24 @@ static int sysdb_timestamp_cache_connect(struct sysdb_ctx *sysdb,
         return ENOMEM;
     }
 
+    if (upgrade_ctx != NULL) {
+        ret = sysdb_upgrade_backend(sysdb->ldb_ts_file, sysdb->backend);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Could not convert the timestamp cache of domain %s "
+                  "[%d]: %s, it will be recreated\n",
+                  domain->name, ret, sss_strerror(ret));
+            ret = remove_ts_cache(sysdb);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "Could not delete the timestamp ldb file (%d) (%s)\n",
+                      ret, sss_strerror(ret));
+                talloc_free(tmp_ctx);
+                return ret;
+            }
+        }
+    }
+
     ret = sysdb_ts_cache_connect(tmp_ctx, sysdb, domain, &ldb, &version);
     switch (ret) {
     case ERR_SYSDB_VERSION_TOO_OLD:
@@ -909,6 +1169,7 @@ static int sysdb_timestamp_cache_connect(struct sysdb_ctx *sysdb,
              */
             ret = sysdb_ldb_reconnect(tmp_ctx,
                                       sysdb->ldb_ts_file,
+                                      sysdb->backend,
                                       LDB_FLG_NOSYNC,
                                       &ldb);
             if (ret != EOK) {
@@ -953,6 +1214,17 @@ static int sysdb_timestamp_cache_connect(struct sysdb_ctx *sysdb,
 
     if (ret == EOK) {
         sysdb->ldb_ts = talloc_steal(sysdb, ldb);
+
+        /* The map only speeds up reading the timestamps, the cache works
+         * fine without it */
+        talloc_zfree(sysdb->ts_map);
+        ret = sysdb_ts_map_open(sysdb, sysdb->ldb_ts_file, &sysdb->ts_map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Could not open the timestamp map of domain %s "
+                  "[%d]: %s\n", domain->name, ret, sss_strerror(ret));
+            ret = EOK;
+        }
     }
     talloc_free(tmp_ctx);
     return ret;
@@ -978,6 +1250,9 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
         ret = ENOMEM;
         goto done;
     }
+    sysdb->backend = domain->cache_backend;
+    sysdb->commit_mode = domain->cache_commit_mode;
+    sysdb->commit_window = domain->cache_commit_window;
 
     ret = sysdb_get_db_file(sysdb, domain->provider, domain->name, db_path,
                             &sysdb->ldb_file, &sysdb->ldb_ts_file);
@@ -1007,6 +1282,32 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = sysdb_query_stats_init(sysdb, domain);
+    if (ret == EOK) {
+        ret = sysdb_query_stats_attach(sysdb, sysdb->ldb);
+    }
+    if (ret == EOK) {
+        ret = sysdb_query_stats_attach(sysdb, sysdb->ldb_ts);
+    }
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Could not set up the query statistics [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    /* Without the store all ghost members are kept in the group entries */
+    sysdb->ghost_store_threshold = SYSDB_GHOST_STORE_THRESHOLD;
+    ret = sysdb_ghost_store_open(sysdb, sysdb->ldb_file,
+                                 sysdb->commit_mode != CACHE_COMMIT_SYNC,
+                                 &sysdb->ghost_store);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Could not open the ghost store of domain %s [%d]: %s\n",
+              domain->name, ret, sss_strerror(ret));
+        ret = EOK;
+    }
+
 done:
     if (ret == EOK) {
         *_ctx = talloc_steal(mem_ctx, sysdb);
@@ -0,0 +1,852 @@
+/*
+   SSSD
+
+   System Database - search results shared between processes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The results of cache searches done through sysdb_ldb_search() are kept in
+ * a memory mapped file next to the cache, so that a search done by one
+ * responder can be answered from memory in all the others. The file is a
+ * direct-mapped table of fixed-size records keyed by a hash of the identity
+ * of the cache file and of the base, scope, filter and attributes of the
+ * search. Results which do not fit into a record are not stored.
+ *
+ * Every record is tagged with the ldb sequence number the search was done
+ * at. ldb increments it with every modification of the cache, including the
+ * ones done by the ldb modules on behalf of sysdb, so a record is only used
+ * while nothing was written to the cache since it was stored. Searches done
+ * inside a transaction bypass the table because the sequence numbers used
+ * by a cancelled transaction are handed out again.
+ *
+ * Writers serialize on an flock() of the file, readers copy the record
+ * protected by a sequence counter as in the timestamp map and treat any
+ * inconsistency as a miss.
+ */
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "shared/murmurhash3.h"
+#include "db/sysdb_private.h"
+
+#define SYSDB_OBJ_CACHE_OPAQUE    "sysdb_obj_cache"
+#define SYSDB_OBJ_CACHE_MAGIC     0x534f4243 /* SOBC */
+#define SYSDB_OBJ_CACHE_VERSION   1
+#define SYSDB_OBJ_CACHE_SLOTS     2048
+#define SYSDB_OBJ_CACHE_DATA_SIZE 4064
+#define SYSDB_OBJ_CACHE_KEY_WORDS 4
+#define SYSDB_OBJ_CACHE_RETRIES   64
+#define SYSDB_OBJ_CACHE_TMP_SUFFIX ".tmp"
+
+struct sysdb_obj_cache_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t rec_size;
+    uint32_t stale;
+    uint32_t reserved;
+};
+
+struct sysdb_obj_cache_rec {
+    uint32_t seq;
+    /* length of the packed result, zero for an empty slot */
+    uint32_t len;
+    /* ldb sequence number the result was read at */
+    uint64_t generation;
+    uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS];
+    uint8_t data[SYSDB_OBJ_CACHE_DATA_SIZE];
+};
+
+struct sysdb_obj_cache {
+    char *file;
+
+    int fd;
+    uint8_t *base;
+    size_t size;
+
+    struct sysdb_obj_cache_hdr *hdr;
+    struct sysdb_obj_cache_rec *recs;
+};
+
+/* Attached to every ldb context of the cache the table is used for */
+struct sysdb_obj_cache_ldb {
+    struct sysdb_ctx *sysdb;
+    struct sysdb_obj_cache *cache;
+    /* identity of the file the ldb context was opened from */
+    uint64_t dev;
+    uint64_t ino;
+};
+
+static size_t obj_cache_size(void)
+{
+    return sizeof(struct sysdb_obj_cache_hdr)
+            + (size_t) SYSDB_OBJ_CACHE_SLOTS
+                * sizeof(struct sysdb_obj_cache_rec);
+}
+
+static errno_t obj_cache_flock(int fd, int operation)
+{
+    int ret;
+
+    do {
+        ret = flock(fd, operation);
+    } while (ret != 0 && errno == EINTR);
+
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "flock() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+static int obj_cache_destructor(struct sysdb_obj_cache *cache)
+{
+    if (cache->base != NULL) {
+        munmap(cache->base, cache->size);
+    }
+
+    if (cache->fd != -1) {
+        close(cache->fd);
+    }
+
+    return 0;
+}
+
+static void obj_cache_detach(struct sysdb_obj_cache *cache)
+{
+    obj_cache_destructor(cache);
+
+    cache->fd = -1;
+    cache->base = NULL;
+    cache->size = 0;
+    cache->hdr = NULL;
+    cache->recs = NULL;
+}
+
+static bool obj_cache_is_stale(struct sysdb_obj_cache *cache)
+{
+    return cache->hdr == NULL
+            || __atomic_load_n(&cache->hdr->stale, __ATOMIC_ACQUIRE) != 0;
+}
+
+static bool obj_cache_hdr_valid(const struct sysdb_obj_cache_hdr *hdr)
+{
+    return hdr->magic == SYSDB_OBJ_CACHE_MAGIC
+            && hdr->version == SYSDB_OBJ_CACHE_VERSION
+            && hdr->num_slots == SYSDB_OBJ_CACHE_SLOTS
+            && hdr->rec_size == sizeof(struct sysdb_obj_cache_rec);
+}
+
+/* Creates an empty table in fd, which must be a new or empty file */
+static errno_t obj_cache_init_file(int fd, uint8_t **_base)
+{
+    struct sysdb_obj_cache_hdr *hdr;
+    void *base;
+    errno_t ret;
+
+    ret = ftruncate(fd, obj_cache_size());
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "ftruncate() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    base = mmap(NULL, obj_cache_size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    if (base == MAP_FAILED) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "mmap() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    hdr = base;
+    hdr->num_slots = SYSDB_OBJ_CACHE_SLOTS;
+    hdr->rec_size = sizeof(struct sysdb_obj_cache_rec);
+    hdr->stale = 0;
+    hdr->version = SYSDB_OBJ_CACHE_VERSION;
+    __atomic_store_n(&hdr->magic, SYSDB_OBJ_CACHE_MAGIC, __ATOMIC_RELEASE);
+
+    *_base = base;
+    return EOK;
+}
+
+/* Replaces a table written by a different version of SSSD, the processes
+ * still using it notice the stale flag and reopen the file */
+static errno_t obj_cache_replace(struct sysdb_obj_cache *cache)
+{
+    uint8_t *base = NULL;
+    char *tmp_file;
+    errno_t ret;
+    int fd = -1;
+
+    tmp_file = talloc_asprintf(NULL, "%s"SYSDB_OBJ_CACHE_TMP_SUFFIX,
+                               cache->file);
+    if (tmp_file == NULL) {
+        return ENOMEM;
+    }
+
+    fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = obj_cache_init_file(fd, &base);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = rename(tmp_file, cache->file);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot rename [%s] [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    if (cache->hdr != NULL && cache->size >= sizeof(*cache->hdr)
+            && cache->hdr->magic == SYSDB_OBJ_CACHE_MAGIC) {
+        __atomic_store_n(&cache->hdr->stale, 1, __ATOMIC_RELEASE);
+    }
+
+    obj_cache_detach(cache);
+    cache->fd = fd;
+    cache->base = base;
+    cache->size = obj_cache_size();
+    fd = -1;
+    base = NULL;
+    ret = EOK;
+
+done:
+    if (base != NULL) {
+        munmap(base, obj_cache_size());
+    }
+    if (fd != -1) {
+        close(fd);
+        unlink(tmp_file);
+    }
+    talloc_free(tmp_file);
+    return ret;
+}
+
+/* Maps the file currently stored at cache->file, a missing or foreign file
+ * is replaced with an empty table */
+static errno_t obj_cache_attach(struct sysdb_obj_cache *cache)
+{
+    struct stat st;
+    void *base;
+    errno_t ret;
+    int fd;
+
+    obj_cache_detach(cache);
+
+    fd = open(cache->file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              cache->file, ret, sss_strerror(ret));
+        return ret;
+    }
+    cache->fd = fd;
+
+    ret = obj_cache_flock(fd, LOCK_EX);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    if (st.st_size == 0) {
+        ret = obj_cache_init_file(fd, &cache->base);
+        if (ret == EOK) {
+            cache->size = obj_cache_size();
+        }
+    } else {
+        base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd, 0);
+        if (base == MAP_FAILED) {
+            ret = errno;
+            goto done;
+        }
+        cache->base = base;
+        cache->size = st.st_size;
+        cache->hdr = base;
+
+        if (cache->size >= sizeof(*cache->hdr)
+                && cache->hdr->magic == SYSDB_OBJ_CACHE_MAGIC
+                && cache->hdr->stale != 0) {
+            /* replaced between open() and flock(), try again */
+            ret = EAGAIN;
+            goto done;
+        }
+
+        if (cache->size != obj_cache_size()
+                || !obj_cache_hdr_valid(cache->hdr)) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Recreating [%s]\n", cache->file);
+            ret = obj_cache_replace(cache);
+        }
+    }
+
+done:
+    if (cache->fd != -1) {
+        obj_cache_flock(cache->fd, LOCK_UN);
+    }
+
+    if (ret != EOK) {
+        obj_cache_detach(cache);
+        return ret;
+    }
+
+    cache->hdr = (struct sysdb_obj_cache_hdr *) cache->base;
+    cache->recs = (struct sysdb_obj_cache_rec *) (cache->base
+                                                  + sizeof(*cache->hdr));
+    return EOK;
+}
+
+static errno_t obj_cache_check(struct sysdb_obj_cache *cache)
+{
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < SYSDB_OBJ_CACHE_RETRIES; i++) {
+        if (!obj_cache_is_stale(cache)) {
+            return EOK;
+        }
+
+        ret = obj_cache_attach(cache);
+        if (ret != EAGAIN) {
+            return ret;
+        }
+    }
+
+    return EAGAIN;
+}
+
+static errno_t obj_cache_key(struct sysdb_obj_cache_ldb *cldb,
+                             struct ldb_dn *base,
+                             enum ldb_scope scope,
+                             const char * const *attrs,
+                             const char *filter,
+                             uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS])
+{
+    const char *base_str = "";
+    char *str;
+    int i;
+
+    if (base != NULL) {
+        base_str = ldb_dn_get_casefold(base);
+        if (base_str == NULL) {
+            return EINVAL;
+        }
+    }
+
+    str = talloc_asprintf(NULL, "%"PRIu64":%"PRIu64":%d:%s:%s:",
+                          cldb->dev, cldb->ino, scope, base_str,
+                          filter != NULL ? filter : "");
+    if (str == NULL) {
+        return ENOMEM;
+    }
+
+    /* NULL requests all attributes which is not the same as an empty list */
+    if (attrs == NULL) {
+        str = talloc_strdup_append(str, "*");
+    }
+    for (i = 0; attrs != NULL && attrs[i] != NULL && str != NULL; i++) {
+        str = talloc_asprintf_append(str, "%s,", attrs[i]);
+    }
+    if (str == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < SYSDB_OBJ_CACHE_KEY_WORDS; i++) {
+        key[i] = murmurhash3(str, strlen(str), 0x0bca5e00 + i);
+    }
+
+    /* an all-zero key marks an empty slot */
+    key[0] |= 1;
+
+    talloc_free(str);
+    return EOK;
+}
+
+static struct sysdb_obj_cache_rec *
+obj_cache_slot(struct sysdb_obj_cache *cache,
+               const uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS])
+{
+    return &cache->recs[key[1] & (SYSDB_OBJ_CACHE_SLOTS - 1)];
+}
+
+/* Copies the packed result stored for key at generation to data which must
+ * hold SYSDB_OBJ_CACHE_DATA_SIZE bytes, returns ENOENT on a miss */
+static errno_t obj_cache_load(struct sysdb_obj_cache_rec *rec,
+                              const uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS],
+                              uint64_t generation,
+                              uint8_t *data,
+                              uint32_t *_len)
+{
+    uint32_t rec_key[SYSDB_OBJ_CACHE_KEY_WORDS];
+    uint64_t rec_generation;
+    uint32_t seq1;
+    uint32_t seq2;
+    uint32_t len;
+    int i;
+
+    for (i = 0; i < SYSDB_OBJ_CACHE_RETRIES; i++) {
+        seq1 = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq1 & 1) {
+            continue;
+        }
+
+        memcpy(rec_key, rec->key, sizeof(rec_key));
+        rec_generation = rec->generation;
+        len = rec->len;
+
+        /* A torn copy can only turn a hit into a miss here */
+        if (memcmp(rec_key, key, sizeof(rec_key)) != 0
+                || rec_generation != generation
+                || len == 0 || len > SYSDB_OBJ_CACHE_DATA_SIZE) {
+            return ENOENT;
+        }
+
+        memcpy(data, rec->data, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        seq2 = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+        if (seq1 == seq2) {
+            *_len = len;
+            return EOK;
+        }
+    }
+
+    return ENOENT;
+}
+
+/* Only called with the file locked, so there is a single writer */
+static void obj_cache_store(struct sysdb_obj_cache_rec *rec,
+                            const uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS],
+                            uint64_t generation,
+                            const uint8_t *data,
+                            uint32_t len)
+{
+    uint32_t seq;
+
+    /* An odd counter is left behind by a writer which crashed */
+    seq = rec->seq;
+    if (seq & 1) {
+        seq++;
+    }
+
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(rec->key, key, sizeof(rec->key));
+    rec->generation = generation;
+    rec->len = len;
+    memcpy(rec->data, data, len);
+
+    __atomic_store_n(&rec->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* The packed result holds the number of messages, then for every message
+ * its DN and number of elements and for every element its name, number of
+ * values and the values. Strings and values are prefixed by their length. */
+static bool obj_cache_pack(uint8_t *data, uint32_t *_pos,
+                           const void *blob, uint32_t len)
+{
+    if (*_pos + sizeof(uint32_t) + (size_t) len > SYSDB_OBJ_CACHE_DATA_SIZE) {
+        return false;
+    }
+
+    memcpy(data + *_pos, &len, sizeof(uint32_t));
+    *_pos += sizeof(uint32_t);
+    if (len > 0) {
+        memcpy(data + *_pos, blob, len);
+        *_pos += len;
+    }
+
+    return true;
+}
+
+static bool obj_cache_pack_str(uint8_t *data, uint32_t *_pos, const char *str)
+{
+    return obj_cache_pack(data, _pos, str, strlen(str));
+}
+
+static bool obj_cache_pack_num(uint8_t *data, uint32_t *_pos, uint32_t num)
+{
+    if (*_pos + sizeof(uint32_t) > SYSDB_OBJ_CACHE_DATA_SIZE) {
+        return false;
+    }
+
+    memcpy(data + *_pos, &num, sizeof(uint32_t));
+    *_pos += sizeof(uint32_t);
+    return true;
+}
+
+static bool obj_cache_pack_result(struct ldb_result *res,
+                                  uint8_t *data, uint32_t *_len)
+{
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    const char *dn;
+    uint32_t pos = 0;
+    unsigned int i;
+    unsigned int j;
+    unsigned int k;
+
+    if (!obj_cache_pack_num(data, &pos, res->count)) {
+        return false;
+    }
+
+    for (i = 0; i < res->count; i++) {
+        msg = res->msgs[i];
+
+        dn = ldb_dn_get_linearized(msg->dn);
+        if (dn == NULL
+                || !obj_cache_pack_str(data, &pos, dn)
+                || !obj_cache_pack_num(data, &pos, msg->num_elements)) {
+            return false;
+        }
+
+        for (j = 0; j < msg->num_elements; j++) {
+            el = &msg->elements[j];
+
+            if (!obj_cache_pack_str(data, &pos, el->name)
+                    || !obj_cache_pack_num(data, &pos, el->num_values)) {
+                return false;
+            }
+
+            for (k = 0; k < el->num_values; k++) {
+                if (!obj_cache_pack(data, &pos, el->values[k].data,
+                                    el->values[k].length)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    *_len = pos;
+    return true;
+}
+
+/* Returns a talloc copy of the next blob with a terminating NUL byte added,
+ * as ldb does for all values */
+static uint8_t *obj_cache_unpack(TALLOC_CTX *mem_ctx,
+                                 const uint8_t *data, uint32_t len,
+                                 uint32_t *_pos, uint32_t *_blob_len)
+{
+    uint32_t blob_len;
+    uint8_t *blob;
+
+    if (len - *_pos < sizeof(uint32_t)) {
+        return NULL;
+    }
+    memcpy(&blob_len, data + *_pos, sizeof(uint32_t));
+    *_pos += sizeof(uint32_t);
+
+    if (blob_len > len - *_pos) {
+        return NULL;
+    }
+
+    blob = talloc_size(mem_ctx, blob_len + 1);
+    if (blob == NULL) {
+        return NULL;
+    }
+    memcpy(blob, data + *_pos, blob_len);
+    blob[blob_len] = '\0';
+    *_pos += blob_len;
+
+    *_blob_len = blob_len;
+    return blob;
+}
+
+static bool obj_cache_unpack_num(const uint8_t *data, uint32_t len,
+                                 uint32_t *_pos, uint32_t *_num)
+{
+    uint32_t num;
+
+    if (len - *_pos < sizeof(uint32_t)) {
+        return false;
+    }
+
+    memcpy(&num, data + *_pos, sizeof(uint32_t));
+    *_pos += sizeof(uint32_t);
+
+    /* every counted item takes at least its length prefix */
+    if (num > (len - *_pos) / sizeof(uint32_t)) {
+        return false;
+    }
+
+    *_num = num;
+    return true;
+}
+
+static errno_t obj_cache_unpack_result(TALLOC_CTX *mem_ctx,
+                                       struct ldb_context *ldb,
+                                       const uint8_t *data, uint32_t len,
+                                       struct ldb_result **_res)
+{
+    struct ldb_message_element *el;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    uint32_t pos = 0;
+    uint32_t count;
+    uint32_t blob_len;
+    char *dn;
+    errno_t ret;
+    uint32_t i;
+    uint32_t j;
+    uint32_t k;
+
+    res = talloc_zero(mem_ctx, struct ldb_result);
+    if (res == NULL) {
+        return ENOMEM;
+    }
+
+    if (!obj_cache_unpack_num(data, len, &pos, &count)) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    res->msgs = talloc_zero_array(res, struct ldb_message *, count + 1);
+    if (res->msgs == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        msg = ldb_msg_new(res->msgs);
+        if (msg == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        res->msgs[i] = msg;
+        res->count = i + 1;
+
+        dn = (char *) obj_cache_unpack(msg, data, len, &pos, &blob_len);
+        if (dn == NULL
+                || !obj_cache_unpack_num(data, len, &pos,
+                                         &msg->num_elements)) {
+            ret = EINVAL;
+            goto done;
+        }
+
+        msg->dn = ldb_dn_new(msg, ldb, dn);
+        msg->elements = talloc_zero_array(msg, struct ldb_message_element,
+                                          msg->num_elements);
+        if (msg->dn == NULL || msg->elements == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        for (j = 0; j < msg->num_elements; j++) {
+            el = &msg->elements[j];
+
+            el->name = (char *) obj_cache_unpack(msg->elements, data, len,
+                                                 &pos, &blob_len);
+            if (el->name == NULL
+                    || !obj_cache_unpack_num(data, len, &pos,
+                                             &el->num_values)) {
+                ret = EINVAL;
+                goto done;
+            }
+
+            el->values = talloc_zero_array(msg->elements, struct ldb_val,
+                                           el->num_values);
+            if (el->values == NULL && el->num_values > 0) {
+                ret = ENOMEM;
+                goto done;
+            }
+
+            for (k = 0; k < el->num_values; k++) {
+                el->values[k].data = obj_cache_unpack(el->values, data, len,
+                                                      &pos, &blob_len);
+                if (el->values[k].data == NULL) {
+                    ret = EINVAL;
+                    goto done;
+                }
+                el->values[k].length = blob_len;
+            }
+        }
+    }
+
+    if (pos != len) {
+        ret = EINVAL;
+        goto done;
+    }
+
+    *_res = res;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(res);
+    }
+    return ret;
+}
+
+errno_t sysdb_obj_cache_attach(struct sysdb_ctx *sysdb,
+                               struct ldb_context *ldb,
+                               dev_t dev, ino_t ino)
+{
+    struct sysdb_obj_cache_ldb *cldb;
+    int ret;
+
+    if (sysdb->obj_cache == NULL || ldb == NULL || ino == 0) {
+        return EOK;
+    }
+
+    cldb = talloc_zero(ldb, struct sysdb_obj_cache_ldb);
+    if (cldb == NULL) {
+        return ENOMEM;
+    }
+    cldb->sysdb = sysdb;
+    cldb->cache = sysdb->obj_cache;
+    cldb->dev = dev;
+    cldb->ino = ino;
+
+    ret = ldb_set_opaque(ldb, SYSDB_OBJ_CACHE_OPAQUE, cldb);
+    if (ret != LDB_SUCCESS) {
+        talloc_free(cldb);
+        return sysdb_error_to_errno(ret);
+    }
+
+    return EOK;
+}
+
+errno_t sysdb_obj_cache_enable(struct sysdb_ctx *sysdb)
+{
+    struct sysdb_obj_cache *cache;
+    errno_t ret;
+
+    if (sysdb->obj_cache != NULL) {
+        return EOK;
+    }
+
+    cache = talloc_zero(sysdb, struct sysdb_obj_cache);
+    if (cache == NULL) {
+        return ENOMEM;
+    }
+    cache->fd = -1;
+    talloc_set_destructor(cache, obj_cache_destructor);
+
+    cache->file = talloc_asprintf(cache, "%s"SYSDB_OBJ_CACHE_SUFFIX,
+                                  sysdb->ldb_file);
+    if (cache->file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = obj_cache_check(cache);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    sysdb->obj_cache = cache;
+
+    ret = sysdb_obj_cache_attach(sysdb, sysdb->ldb,
+                                 sysdb->ldb_dev, sysdb->ldb_ino);
+    if (ret != EOK) {
+        sysdb->obj_cache = NULL;
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(cache);
+    }
+    return ret;
+}
+
+int sysdb_obj_cache_search(struct ldb_context *ldb,
+                           TALLOC_CTX *mem_ctx,
+                           struct ldb_result **_res,
+                           struct ldb_dn *base,
+                           enum ldb_scope scope,
+                           const char * const *attrs,
+                           const char *filter)
+{
+    struct sysdb_obj_cache_ldb *cldb;
+    struct sysdb_obj_cache_rec *rec;
+    uint32_t key[SYSDB_OBJ_CACHE_KEY_WORDS];
+    uint64_t generation;
+    uint8_t *data = NULL;
+    uint32_t len;
+    errno_t ret;
+    int lret;
+
+    cldb = ldb_get_opaque(ldb, SYSDB_OBJ_CACHE_OPAQUE);
+    if (cldb == NULL || cldb->sysdb->transaction_nesting > 0
+            || obj_cache_check(cldb->cache) != EOK
+            || obj_cache_key(cldb, base, scope, attrs, filter, key) != EOK) {
+        goto search;
+    }
+
+    /* Read before searching, a result stored with an older sequence number
+     * than the data it holds is never used */
+    lret = ldb_sequence_number(ldb, LDB_SEQ_HIGHEST_SEQ, &generation);
+    if (lret != LDB_SUCCESS) {
+        goto search;
+    }
+
+    data = talloc_size(NULL, SYSDB_OBJ_CACHE_DATA_SIZE);
+    if (data == NULL) {
+        goto search;
+    }
+
+    rec = obj_cache_slot(cldb->cache, key);
+    ret = obj_cache_load(rec, key, generation, data, &len);
+    if (ret == EOK) {
+        ret = obj_cache_unpack_result(mem_ctx, ldb, data, len, _res);
+        if (ret == EOK) {
+            talloc_free(data);
+            return LDB_SUCCESS;
+        }
+        DEBUG(SSSDBG_MINOR_FAILURE, "Ignoring invalid cached result\n");
+    }
+
+    lret = ldb_search(ldb, mem_ctx, _res, base, scope, attrs,
+                      filter != NULL ? "%s" : NULL, filter);
+    if (lret == LDB_SUCCESS && (*_res)->refs == NULL
+            && obj_cache_pack_result(*_res, data, &len)
+            && obj_cache_flock(cldb->cache->fd, LOCK_EX) == EOK) {
+        obj_cache_store(rec, key, generation, data, len);
+        obj_cache_flock(cldb->cache->fd, LOCK_UN);
+    }
+
+    talloc_free(data);
+    return lret;
+
+search:
+    return ldb_search(ldb, mem_ctx, _res, base, scope, attrs,
+                      filter != NULL ? "%s" : NULL, filter);
+}
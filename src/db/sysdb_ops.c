@@ -156,11 +156,22 @@ static int sysdb_delete_cache_entry(struct ldb_context *ldb,
 static int sysdb_delete_ts_entry(struct sysdb_ctx *sysdb,
                                  struct ldb_dn *dn)
 {
+    int ret;
+
     if (sysdb->ldb_ts == NULL) {
         return EOK;
     }
 
-    return sysdb_delete_cache_entry(sysdb->ldb_ts, dn, true);
+    ret = sysdb_ts_ldb_delete(sysdb, dn);
+    switch (ret) {
+    case LDB_SUCCESS:
+    case LDB_ERR_NO_SUCH_OBJECT:
+        return EOK;
+    default:
+        DEBUG(SSSDBG_CRIT_FAILURE, "LDB Error: %s (%d); error message: [%s]\n",
+                  ldb_strerror(ret), ret, ldb_errstring(sysdb->ldb_ts));
+        return sysdb_error_to_errno(ret);
+    }
 }
 
 int sysdb_delete_entry(struct sysdb_ctx *sysdb,
@@ -172,6 +183,16 @@ int sysdb_delete_entry(struct sysdb_ctx *sysdb,
 
     ret = sysdb_delete_cache_entry(sysdb->ldb, dn, ignore_not_found);
     if (ret == EOK) {
+        if (sysdb->ghost_store != NULL) {
+            tret = sysdb_ghost_store_drop(sysdb->ghost_store, dn);
+            if (tret != EOK) {
+                DEBUG(SSSDBG_MINOR_FAILURE,
+                      "sysdb_ghost_store_drop failed: %d\n", tret);
+                /* Not fatal */
+            }
+        }
+        sysdb_write_committed(sysdb);
+
         tret = sysdb_delete_ts_entry(sysdb, dn);
         if (tret != EOK) {
             DEBUG(SSSDBG_MINOR_FAILURE,
@@ -281,9 +302,9 @@ int sysdb_cache_search_entry(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(ldb, tmp_ctx, &res,
-                     base_dn, scope, attrs,
-                     filter?"%s":NULL, filter);
+    ret = sysdb_ldb_search(ldb, tmp_ctx, &res,
+                           base_dn, scope, attrs,
+                           filter?"%s":NULL, filter);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -343,6 +364,9 @@ int sysdb_search_ts_entry(TALLOC_CTX *mem_ctx,
         return EOK;
     }
 
+    /* Errors are not fatal, the search just returns older timestamps */
+    sysdb_ts_map_flush(sysdb, scope == LDB_SCOPE_BASE ? base_dn : NULL);
+
     return sysdb_cache_search_entry(mem_ctx, sysdb->ldb_ts, base_dn, scope,
                                     filter, attrs, _msgs_count, _msgs);
 }
@@ -680,9 +704,10 @@ int sysdb_search_user_by_upn_res(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
-                     base_dn, LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
-                     SYSDB_PWUPN_FILTER, sanitized, sanitized, sanitized);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res,
+                           base_dn, LDB_SCOPE_SUBTREE,
+                           attrs ? attrs : def_attrs,
+                           SYSDB_PWUPN_FILTER, sanitized, sanitized, sanitized);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -918,6 +943,7 @@ static errno_t sysdb_check_ts_cache(struct sss_domain_info *domain,
     TALLOC_CTX *tmp_ctx;
     size_t msgs_count;
     struct ldb_message **msgs;
+    struct ldb_message *ts_msg;
     bool mod_ts_differs;
 
     if (domain->sysdb->ldb_ts == NULL) {
@@ -929,15 +955,28 @@ static errno_t sysdb_check_ts_cache(struct sss_domain_info *domain,
         return ENOMEM;
     }
 
-    /* Check if the entry is in the timestamp cache */
-    ret = sysdb_search_ts_entry(tmp_ctx,
-                                domain->sysdb,
-                                entry_dn,
-                                LDB_SCOPE_BASE,
-                                NULL,
-                                sysdb_ts_cache_attrs,
-                                &msgs_count,
-                                &msgs);
+    /* Check if the entry is in the timestamp cache, the map holds the
+     * original modification timestamp as well */
+    ret = ENOENT;
+    if (domain->sysdb->ts_map != NULL) {
+        ret = sysdb_ts_map_get(tmp_ctx, domain->sysdb->ts_map, entry_dn,
+                               &ts_msg);
+        if (ret == EOK) {
+            msgs = &ts_msg;
+            msgs_count = 1;
+        }
+    }
+
+    if (ret != EOK) {
+        ret = sysdb_search_ts_entry(tmp_ctx,
+                                    domain->sysdb,
+                                    entry_dn,
+                                    LDB_SCOPE_BASE,
+                                    NULL,
+                                    sysdb_ts_cache_attrs,
+                                    &msgs_count,
+                                    &msgs);
+    }
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_INTERNAL,
               "Cannot find TS cache entry for [%s]: [%d]: %s\n",
@@ -997,7 +1036,7 @@ static errno_t sysdb_create_ts_entry(struct sysdb_ctx *sysdb,
         goto done;
     }
 
-    lret = ldb_add(sysdb->ldb_ts, msg);
+    lret = sysdb_ts_ldb_add(sysdb, msg);
     if (lret != LDB_SUCCESS) {
         DEBUG(SSSDBG_OP_FAILURE,
               "ldb_add failed: [%s](%d)[%s]\n",
@@ -1333,6 +1372,43 @@ done:
     return ret;
 }
 
+/* Same as sysdb_set_cache_entry_attr() on the timestamp cache, which must
+ * not be modified directly to keep the timestamp map in sync */
+static int sysdb_set_ts_cache_entry_attr(struct sysdb_ctx *sysdb,
+                                         struct ldb_dn *entry_dn,
+                                         struct sysdb_attrs *attrs,
+                                         int mod_op)
+{
+    struct ldb_message *msg;
+    int ret;
+    int lret;
+
+    if (entry_dn == NULL || attrs->num == 0) {
+        return EINVAL;
+    }
+
+    msg = sysdb_attrs2msg(NULL, entry_dn, attrs, mod_op);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    lret = sysdb_ts_ldb_modify(sysdb, msg);
+    if (lret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "ldb_modify failed: [%s](%d)[%s]\n",
+              ldb_strerror(lret), lret, ldb_errstring(sysdb->ldb_ts));
+    }
+
+    ret = sysdb_error_to_errno(lret);
+    if (ret == ENOENT) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No such entry\n");
+    } else if (ret) {
+        DEBUG(SSSDBG_OP_FAILURE, "Error: %d (%s)\n", ret, strerror(ret));
+    }
+    talloc_free(msg);
+    return ret;
+}
+
 static const char *get_attr_storage(int state_mask)
 {
     const char *storage = "";
@@ -1367,6 +1443,7 @@ int sysdb_set_entry_attr(struct sysdb_ctx *sysdb,
                   ldb_dn_get_linearized(entry_dn), ret, sss_strerror(ret));
         } else {
             state_mask |= SSS_SYSDB_CACHE;
+            sysdb_write_committed(sysdb);
         }
     }
 
@@ -1407,8 +1484,8 @@ static int sysdb_rep_ts_entry_attr(struct sysdb_ctx *sysdb,
         return EOK;
     }
 
-    return sysdb_set_cache_entry_attr(sysdb->ldb_ts, entry_dn,
-                                      attrs, SYSDB_MOD_REP);
+    return sysdb_set_ts_cache_entry_attr(sysdb, entry_dn,
+                                         attrs, SYSDB_MOD_REP);
 }
 
 static int sysdb_set_ts_entry_attr(struct sysdb_ctx *sysdb,
@@ -1749,6 +1826,67 @@ done:
     return ret;
 }
 
+/* Stored ghost members are always direct members of the group they are
+ * stored for, replace them with a member link to the user */
+static errno_t
+sysdb_link_stored_ghost(struct sss_domain_info *domain,
+                        const char *name,
+                        const char *userdn)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    struct ldb_dn **dns;
+    size_t count;
+    errno_t ret;
+    size_t i;
+
+    if (domain->sysdb->ghost_store == NULL) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_ghost_store_remove_name(tmp_ctx, domain->sysdb->ghost_store,
+                                        domain->sysdb->ldb, name,
+                                        &dns, &count);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        msg = ldb_msg_new(tmp_ctx);
+        if (msg == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        msg->dn = dns[i];
+
+        ret = sysdb_add_string(msg, SYSDB_MEMBER, userdn);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        ret = sss_ldb_modify_permissive(domain->sysdb->ldb, msg);
+        if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "sss_ldb_modify_permissive failed: [%s](%d)[%s]\n",
+                  ldb_strerror(ret), ret, ldb_errstring(domain->sysdb->ldb));
+            ret = sysdb_error_to_errno(ret);
+            goto done;
+        }
+        talloc_zfree(msg);
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static errno_t
 sysdb_remove_ghostattr_from_groups(struct sss_domain_info *domain,
                                    const char *orig_dn,
@@ -1840,6 +1978,24 @@ sysdb_remove_ghostattr_from_groups(struct sss_domain_info *domain,
                                       orig_dn, userdn);
     }
 
+    ret = sysdb_link_stored_ghost(domain, name, userdn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < alias_el->num_values; i++) {
+        if (strcmp((const char *)alias_el->values[i].data, name) == 0) {
+            continue;
+        }
+
+        ret = sysdb_link_stored_ghost(domain,
+                                      (const char *)alias_el->values[i].data,
+                                      userdn);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
     ret = EOK;
 
 done:
@@ -2786,6 +2942,84 @@ static errno_t sysdb_store_group_attrs(struct sss_domain_info *domain,
                                        uint64_t cache_timeout,
                                        time_t now);
 
+/* Moves the ghost members of large groups from attrs to the ghost store.
+ * Once a group is in the store it stays there until it is deleted, or
+ * until a view is applied to the domain. Ghost members have to be resolved
+ * before the overrides of a view are applied to a group, which only reads
+ * them from the group entry. */
+static errno_t sysdb_store_group_ghosts(struct sss_domain_info *domain,
+                                        const char *name,
+                                        struct ldb_message *group,
+                                        struct sysdb_attrs *attrs)
+{
+    struct sysdb_ctx *sysdb = domain->sysdb;
+    struct ldb_message_element *el;
+    struct ldb_dn *dn;
+    bool stored;
+    bool views;
+    errno_t ret;
+
+    if (sysdb->ghost_store == NULL) {
+        return EOK;
+    }
+
+    ret = sysdb_attrs_get_el_ext(attrs, SYSDB_GHOST, false, &el);
+    if (ret == ENOENT) {
+        /* Ghost members are not updated */
+        return EOK;
+    } else if (ret != EOK) {
+        return ret;
+    }
+
+    stored = group != NULL
+                && ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false);
+    views = DOM_HAS_VIEWS(domain) && !is_local_view(domain->view_name);
+    if (!stored && (views || el->num_values < sysdb->ghost_store_threshold)) {
+        return EOK;
+    }
+
+    dn = sysdb_group_dn(NULL, domain, name);
+    if (dn == NULL) {
+        return ENOMEM;
+    }
+
+    if (views) {
+        /* The new ghost members are written to the entry */
+        ret = sysdb_ghost_store_drop(sysdb->ghost_store, dn);
+        talloc_free(dn);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Cannot drop ghost members of %s [%d]: %s\n",
+                  name, ret, sss_strerror(ret));
+            return ret;
+        }
+
+        return sysdb_attrs_add_bool(attrs, SYSDB_GHOST_STORE, false);
+    }
+
+    ret = sysdb_ghost_store_set(sysdb->ghost_store, dn, el);
+    talloc_free(dn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot store ghost members of %s [%d]: %s\n",
+              name, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    /* Replacing the ghost attribute with no values also removes the ghost
+     * members the group had in the entry before */
+    el->num_values = 0;
+
+    if (!stored) {
+        ret = sysdb_attrs_add_bool(attrs, SYSDB_GHOST_STORE, true);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
 int sysdb_store_group(struct sss_domain_info *domain,
                       const char *name,
                       gid_t gid,
@@ -2847,6 +3081,12 @@ int sysdb_store_group(struct sss_domain_info *domain,
         }
     }
 
+    ret = sysdb_store_group_ghosts(domain, name, new_group ? NULL : msg,
+                                   attrs);
+    if (ret != EOK) {
+        goto done;
+    }
+
     if (new_group) {
         ret = sysdb_store_new_group(domain, name, gid, attrs,
                                     cache_timeout, now);
@@ -3784,6 +4024,9 @@ int sysdb_search_ts_users(TALLOC_CTX *mem_ctx,
         return ERR_NO_TS;
     }
 
+    /* Errors are not fatal, the search just returns older timestamps */
+    sysdb_ts_map_flush(domain->sysdb, NULL);
+
     ret = sysdb_cache_search_users(mem_ctx, domain, domain->sysdb->ldb_ts,
                                     sub_filter, attrs, &msgs_count, &msgs);
     if (ret == EOK) {
@@ -3932,6 +4175,16 @@ int sysdb_delete_user(struct sss_domain_info *domain,
             goto fail;
         }
 
+        if (domain->sysdb->ghost_store != NULL) {
+            ret = sysdb_ghost_store_remove_name(tmp_ctx,
+                                                domain->sysdb->ghost_store,
+                                                domain->sysdb->ldb, name,
+                                                NULL, NULL);
+            if (ret != EOK) {
+                goto fail;
+            }
+        }
+
         ret = sysdb_search_groups(tmp_ctx, domain, filter, attrs,
                                   &msg_count, &msgs);
         if (ret != EOK) {
@@ -4148,6 +4401,9 @@ int sysdb_search_ts_groups(TALLOC_CTX *mem_ctx,
         return ERR_NO_TS;
     }
 
+    /* Errors are not fatal, the search just returns older timestamps */
+    sysdb_ts_map_flush(domain->sysdb, NULL);
+
     ret = sysdb_cache_search_groups(mem_ctx, domain, domain->sysdb->ldb_ts,
                                     sub_filter, attrs, &msgs_count, &msgs);
     if (ret == EOK) {
@@ -4958,9 +5214,9 @@ static errno_t sysdb_search_object_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, basedn,
-                     LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
-                     "%s", filter);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, basedn,
+                           LDB_SCOPE_SUBTREE, attrs ? attrs : def_attrs,
+                           "%s", filter);
     if (ret != EOK) {
         ret = sysdb_error_to_errno(ret);
         DEBUG(SSSDBG_OP_FAILURE, "ldb_search failed.\n");
@@ -5564,7 +5820,7 @@ errno_t sysdb_mark_entry_as_expired_ldb_dn(struct sss_domain_info *dom,
     }
 
     if (dom->sysdb->ldb_ts != NULL) {
-        ret = ldb_modify(dom->sysdb->ldb_ts, msg);
+        ret = sysdb_ts_ldb_modify(dom->sysdb, msg);
         if (ret != LDB_SUCCESS) {
             DEBUG(SSSDBG_MINOR_FAILURE,
                   "Could not mark an entry as expired in the timestamp cache\n");
@@ -5659,8 +5915,8 @@ int sysdb_invalidate_cache_entry(struct sss_domain_info *domain,
     }
 
     if (sysdb->ldb_ts != NULL) {
-        ret = sysdb_set_cache_entry_attr(sysdb->ldb_ts, entry_dn,
-                                         attrs, SYSDB_MOD_REP);
+        ret = sysdb_set_ts_cache_entry_attr(sysdb, entry_dn,
+                                            attrs, SYSDB_MOD_REP);
         if (ret != EOK) {
             DEBUG(SSSDBG_MINOR_FAILURE,
                   "Cannot set attrs in the timestamp cache for %s, %d [%s]\n",
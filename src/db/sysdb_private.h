@@ -23,6 +23,7 @@
 #ifndef __INT_SYS_DB_H__
 #define __INT_SYS_DB_H__
 
+#define SYSDB_VERSION_0_24 "0.24"
 #define SYSDB_VERSION_0_23 "0.23"
 #define SYSDB_VERSION_0_22 "0.22"
 #define SYSDB_VERSION_0_21 "0.21"
@@ -47,7 +48,7 @@
 #define SYSDB_VERSION_0_2 "0.2"
 #define SYSDB_VERSION_0_1 "0.1"
 
-#define SYSDB_VERSION SYSDB_VERSION_0_23
+#define SYSDB_VERSION SYSDB_VERSION_0_24
 
 #define SYSDB_BASE_LDIF \
      "dn: @ATTRIBUTES\n" \
@@ -88,6 +89,7 @@
      "@IDXATTR: ipHostNumber\n" \
      "@IDXATTR: ipNetworkNumber\n" \
      "@IDXATTR: originalADgidNumber\n" \
+     "@IDXATTR: ghostStore\n" \
      "\n" \
      "dn: @MODULES\n" \
      "@LIST: asq,memberof\n" \
@@ -123,17 +125,92 @@
 
 #include "db/sysdb.h"
 
+/* The mdb backend keeps a lock file next to the database file */
+#define SYSDB_MDB_LOCK_SUFFIX "-lock"
+
+/* The timestamp map is stored next to the timestamp cache */
+#define SYSDB_TS_MAP_SUFFIX "-map"
+#define SYSDB_TS_MAP_MIN_SLOTS 1024
+
+struct sysdb_ts_map;
+
+/* Ghost members of groups with at least SYSDB_GHOST_STORE_THRESHOLD of them
+ * are kept in a tdb next to the cache, see sysdb_ghost_store.c */
+#define SYSDB_GHOST_STORE_SUFFIX "-ghosts"
+#define SYSDB_GHOST_STORE_THRESHOLD 1000
+
+/* Search results shared between processes, see sysdb_obj_cache.c */
+#define SYSDB_OBJ_CACHE_SUFFIX "-objcache"
+#define SYSDB_GHOST_STORE_CHUNK 128
+
+struct sysdb_ghost_store;
+
 struct sysdb_ctx {
     struct ldb_context *ldb;
     char *ldb_file;
+    /* identity of the file ldb was opened from, keys the shared results */
+    dev_t ldb_dev;
+    ino_t ldb_ino;
 
     struct ldb_context *ldb_ts;
     char *ldb_ts_file;
+    struct sysdb_ts_map *ts_map;
+
+    struct sysdb_ghost_store *ghost_store;
+    uint32_t ghost_store_threshold;
+
+    /* ldb backend used for newly created database files */
+    enum sss_cache_backend backend;
 
     int transaction_nesting;
+
+    /* Flushing of committed writes to disk, see sysdb_enable_group_commit() */
+    enum sss_cache_commit_mode commit_mode;
+    uint32_t commit_window;
+    struct tevent_context *ev;
+    struct tevent_timer *flush_te;
+    bool unsynced;
+
+    /* NULL if cache searches are not instrumented */
+    struct sysdb_query_stats *query_stats;
+
+    /* NULL if search results are not shared, see sysdb_obj_cache_enable() */
+    struct sysdb_obj_cache *obj_cache;
 };
 
 /* Internal utility functions */
+
+/* Instrumentation of cache searches, see sysdb_query_stats.c. Searches of
+ * the cache should go through sysdb_ldb_search() instead of ldb_search(). */
+errno_t sysdb_query_stats_init(struct sysdb_ctx *sysdb,
+                               struct sss_domain_info *domain);
+errno_t sysdb_query_stats_attach(struct sysdb_ctx *sysdb,
+                                 struct ldb_context *ldb);
+int sysdb_ldb_search(struct ldb_context *ldb,
+                     TALLOC_CTX *mem_ctx,
+                     struct ldb_result **_res,
+                     struct ldb_dn *base,
+                     enum ldb_scope scope,
+                     const char * const *attrs,
+                     const char *exp_fmt, ...) SSS_ATTRIBUTE_PRINTF(7, 8);
+
+/* Shared search results, see sysdb_obj_cache.c. sysdb_obj_cache_search()
+ * behaves like ldb_search() with a preformatted filter. */
+errno_t sysdb_obj_cache_attach(struct sysdb_ctx *sysdb,
+                               struct ldb_context *ldb,
+                               dev_t dev, ino_t ino);
+int sysdb_obj_cache_search(struct ldb_context *ldb,
+                           TALLOC_CTX *mem_ctx,
+                           struct ldb_result **_res,
+                           struct ldb_dn *base,
+                           enum ldb_scope scope,
+                           const char * const *attrs,
+                           const char *filter);
+
+/* Must be called after a write outside of a transaction or after the
+ * outermost transaction was committed */
+void sysdb_write_committed(struct sysdb_ctx *sysdb);
+
 int sysdb_get_db_file(TALLOC_CTX *mem_ctx,
                       const char *provider,
                       const char *name,
@@ -144,6 +221,20 @@ errno_t sysdb_ldb_connect(TALLOC_CTX *mem_ctx,
                           const char *filename,
                           int flags,
                           struct ldb_context **_ldb);
+/* Existing database files are always opened with the backend they are
+ * stored in, backend is only used if filename does not exist yet. */
+errno_t sysdb_ldb_connect_ext(TALLOC_CTX *mem_ctx,
+                              const char *filename,
+                              enum sss_cache_backend backend,
+                              int flags,
+                              const char *options[],
+                              struct ldb_context **_ldb);
+/* Returns ENOENT if the file does not exist or is empty and EINVAL if it
+ * is not a database of a known backend */
+errno_t sysdb_get_db_file_backend(const char *filename,
+                                  enum sss_cache_backend *_backend);
+const char *sysdb_cache_backend_str(enum sss_cache_backend backend);
+errno_t sysdb_remove_db_file(const char *filename);
 errno_t sysdb_ldb_mod_index(TALLOC_CTX *mem_ctx,
                             enum sysdb_index_actions action,
                             struct ldb_context *ldb,
@@ -165,6 +256,8 @@ int sysdb_domain_init_internal(TALLOC_CTX *mem_ctx,
 
 /* Upgrade routines */
 int sysdb_upgrade_01(struct ldb_context *ldb, const char **ver);
+int sysdb_upgrade_backend(const char *ldb_file,
+                          enum sss_cache_backend backend);
 int sysdb_check_upgrade_02(struct sss_domain_info *domains,
                            const char *db_path);
 int sysdb_upgrade_03(struct sysdb_ctx *sysdb, const char **ver);
@@ -191,6 +284,7 @@ int sysdb_upgrade_19(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_20(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_21(struct sysdb_ctx *sysdb, const char **ver);
 int sysdb_upgrade_22(struct sysdb_ctx *sysdb, const char **ver);
+int sysdb_upgrade_23(struct sysdb_ctx *sysdb, const char **ver);
 
 int sysdb_ts_upgrade_01(struct sysdb_ctx *sysdb, const char **ver);
 
@@ -238,6 +332,62 @@ errno_t sysdb_merge_res_ts_attrs(struct sysdb_ctx *ctx,
                                  struct ldb_result *res,
                                  const char *attrs[]);
 
+/* The timestamp map is a memory mapped copy of the timestamp attributes
+ * stored in the timestamp cache which can be read without any locking.
+ * All writes to the timestamp cache must go through the sysdb_ts_ldb_*()
+ * wrappers which keep the map in sync, they return ldb error codes.
+ * Modifications that only replace timestamps are stored in the map alone
+ * and written back to the timestamp cache by sysdb_ts_map_flush().
+ */
+errno_t sysdb_ts_map_open(TALLOC_CTX *mem_ctx,
+                          const char *ts_file,
+                          struct sysdb_ts_map **_map);
+
+/* Returns ENOENT if the map does not hold the timestamps of dn, the caller
+ * is supposed to look them up in the timestamp cache then */
+errno_t sysdb_ts_map_get(TALLOC_CTX *mem_ctx,
+                         struct sysdb_ts_map *map,
+                         struct ldb_dn *dn,
+                         struct ldb_message **_msg);
+
+/* Writes the timestamps stored only in the map to the timestamp cache, all
+ * of them if dn is NULL. Must be called before the timestamp cache is
+ * searched. */
+errno_t sysdb_ts_map_flush(struct sysdb_ctx *sysdb, struct ldb_dn *dn);
+
+/* The ghost store is not part of the ldb transactions, sysdb_transaction_*()
+ * start and finish its transaction together with the outermost one. All
+ * changes outside of a sysdb transaction use a transaction of their own. */
+errno_t sysdb_ghost_store_open(TALLOC_CTX *mem_ctx,
+                               const char *ldb_file,
+                               bool nosync,
+                               struct sysdb_ghost_store **_store);
+errno_t sysdb_ghost_store_sync(struct sysdb_ghost_store *store);
+errno_t sysdb_ghost_store_transaction_start(struct sysdb_ghost_store *store);
+errno_t sysdb_ghost_store_transaction_prepare(struct sysdb_ghost_store *store);
+errno_t sysdb_ghost_store_transaction_commit(struct sysdb_ghost_store *store);
+errno_t sysdb_ghost_store_transaction_cancel(struct sysdb_ghost_store *store);
+
+/* Replaces the stored ghost members of the group, only the names which were
+ * added or removed are written */
+errno_t sysdb_ghost_store_set(struct sysdb_ghost_store *store,
+                              struct ldb_dn *group_dn,
+                              struct ldb_message_element *ghosts);
+errno_t sysdb_ghost_store_drop(struct sysdb_ghost_store *store,
+                               struct ldb_dn *group_dn);
+/* Removes name from all groups and returns the DNs of the groups it was
+ * stored in */
+errno_t sysdb_ghost_store_remove_name(TALLOC_CTX *mem_ctx,
+                                      struct sysdb_ghost_store *store,
+                                      struct ldb_context *ldb,
+                                      const char *name,
+                                      struct ldb_dn ***_dns,
+                                      size_t *_count);
+
+int sysdb_ts_ldb_add(struct sysdb_ctx *sysdb, struct ldb_message *msg);
+int sysdb_ts_ldb_modify(struct sysdb_ctx *sysdb, struct ldb_message *msg);
+int sysdb_ts_ldb_delete(struct sysdb_ctx *sysdb, struct ldb_dn *dn);
+
 /* Given an array of ldb_message structures found in the timestamp cache,
  * merge in the corresponding full attributes from the sysdb cache. The
  * new attributes are allocated atop the ldb messages.
@@ -0,0 +1,723 @@
+/*
+   SSSD
+
+   System Database - Instrumentation of cache searches
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Searches done through sysdb_ldb_search() are timed when the domain enables
+ * cache_query_stats or cache_slow_query_threshold. Searches slower than the
+ * threshold are logged with their filter. With cache_query_stats, searches
+ * are aggregated by the shape of their filter, which is the filter with all
+ * asserted values replaced by '?'. Every process writes its aggregate next
+ * to the cache file, see sysdb_query_stats_dump(), where sssctl reads it.
+ * The aggregate is written at most once a minute while searches are done,
+ * and once more when the sysdb context is freed on shutdown.
+ *
+ * A search is flagged unindexed if ldb has to scan the whole database to
+ * answer it, the rules follow the index selection of ldb_kv: equality
+ * matches on indexed attributes are indexed, an AND is indexed if any of its
+ * parts is and an OR only if all of its parts are. */
+
+#include <glob.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "util/util.h"
+#include "db/sysdb_private.h"
+
+#define SYSDB_QUERY_STATS_OPAQUE "sysdb_query_stats"
+#define SYSDB_QUERY_STATS_SUFFIX ".stats."
+#define SYSDB_QUERY_STATS_DUMP_INTERVAL 60
+/* Limits the memory used by searches with generated filters */
+#define SYSDB_QUERY_SHAPES_MAX 1024
+#define SYSDB_QUERY_SHAPE_OTHER "(other)"
+
+struct sysdb_query_stats {
+    uint32_t slow_threshold_ms;
+
+    /* NULL if searches are not aggregated */
+    hash_table_t *shapes;
+    char *dump_file;
+    time_t last_dump;
+    bool dirty;
+};
+
+/* The indexes differ between the cache and the timestamp cache */
+struct sysdb_query_ldb {
+    struct sysdb_query_stats *stats;
+    char **index_attrs;
+    bool index_loaded;
+};
+
+static uint64_t sysdb_query_now_us(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0;
+    }
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static errno_t sysdb_query_stats_write(struct sysdb_query_stats *stats);
+
+static int sysdb_query_stats_destructor(struct sysdb_query_stats *stats)
+{
+    /* Searches since the last periodic dump would be lost otherwise */
+    if (stats->shapes != NULL && stats->dirty) {
+        sysdb_query_stats_write(stats);
+    }
+
+    return 0;
+}
+
+errno_t sysdb_query_stats_init(struct sysdb_ctx *sysdb,
+                               struct sss_domain_info *domain)
+{
+    struct sysdb_query_stats *stats;
+    errno_t ret;
+
+    if (!domain->cache_query_stats && domain->cache_slow_query_threshold == 0) {
+        return EOK;
+    }
+
+    stats = talloc_zero(sysdb, struct sysdb_query_stats);
+    if (stats == NULL) {
+        return ENOMEM;
+    }
+    stats->slow_threshold_ms = domain->cache_slow_query_threshold;
+    stats->last_dump = time(NULL);
+
+    if (domain->cache_query_stats) {
+        ret = sss_hash_create(stats, 0, &stats->shapes);
+        if (ret != EOK) {
+            goto done;
+        }
+
+        stats->dump_file = talloc_asprintf(stats, "%s"SYSDB_QUERY_STATS_SUFFIX
+                                           "%s", sysdb->ldb_file,
+                                           debug_prg_name);
+        if (stats->dump_file == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        talloc_set_destructor(stats, sysdb_query_stats_destructor);
+    }
+
+    sysdb->query_stats = stats;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(stats);
+    }
+    return ret;
+}
+
+errno_t sysdb_query_stats_attach(struct sysdb_ctx *sysdb,
+                                 struct ldb_context *ldb)
+{
+    struct sysdb_query_ldb *qldb;
+    int ret;
+
+    if (sysdb->query_stats == NULL || ldb == NULL) {
+        return EOK;
+    }
+
+    qldb = talloc_zero(ldb, struct sysdb_query_ldb);
+    if (qldb == NULL) {
+        return ENOMEM;
+    }
+    qldb->stats = sysdb->query_stats;
+
+    ret = ldb_set_opaque(ldb, SYSDB_QUERY_STATS_OPAQUE, qldb);
+    if (ret != LDB_SUCCESS) {
+        talloc_free(qldb);
+        return sysdb_error_to_errno(ret);
+    }
+
+    return EOK;
+}
+
+static void sysdb_query_load_index(struct ldb_context *ldb,
+                                   struct sysdb_query_ldb *qldb)
+{
+    const char *attrs[] = { "@IDXATTR", NULL };
+    struct ldb_message_element *el;
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    unsigned int i;
+    int ret;
+
+    qldb->index_loaded = true;
+
+    dn = ldb_dn_new(qldb, ldb, "@INDEXLIST");
+    if (dn == NULL) {
+        return;
+    }
+
+    ret = ldb_search(ldb, dn, &res, dn, LDB_SCOPE_BASE, attrs, NULL);
+    if (ret != LDB_SUCCESS || res->count != 1) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to read the index list\n");
+        talloc_free(dn);
+        return;
+    }
+
+    el = ldb_msg_find_element(res->msgs[0], "@IDXATTR");
+    if (el != NULL) {
+        qldb->index_attrs = talloc_zero_array(qldb, char *,
+                                              el->num_values + 1);
+        if (qldb->index_attrs != NULL) {
+            for (i = 0; i < el->num_values; i++) {
+                qldb->index_attrs[i] = talloc_strndup(qldb->index_attrs,
+                                              (const char *) el->values[i].data,
+                                              el->values[i].length);
+            }
+        }
+    }
+
+    talloc_free(dn);
+}
+
+static bool sysdb_query_attr_indexed(struct sysdb_query_ldb *qldb,
+                                     const char *attr)
+{
+    int i;
+
+    if (strcasecmp(attr, "dn") == 0
+            || strcasecmp(attr, "distinguishedName") == 0) {
+        return true;
+    }
+
+    if (qldb->index_attrs == NULL) {
+        return false;
+    }
+
+    for (i = 0; qldb->index_attrs[i] != NULL; i++) {
+        if (strcasecmp(attr, qldb->index_attrs[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool sysdb_query_tree_indexed(struct sysdb_query_ldb *qldb,
+                                     const struct ldb_parse_tree *tree)
+{
+    unsigned int i;
+
+    switch (tree->operation) {
+    case LDB_OP_AND:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (sysdb_query_tree_indexed(qldb, tree->u.list.elements[i])) {
+                return true;
+            }
+        }
+        return false;
+    case LDB_OP_OR:
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            if (!sysdb_query_tree_indexed(qldb, tree->u.list.elements[i])) {
+                return false;
+            }
+        }
+        return tree->u.list.num_elements > 0;
+    case LDB_OP_EQUALITY:
+        return sysdb_query_attr_indexed(qldb, tree->u.equality.attr);
+    default:
+        /* Presence, substring, range and negated matches are not indexed */
+        return false;
+    }
+}
+
+static char *sysdb_query_shape_append(char *shape,
+                                      const struct ldb_parse_tree *tree)
+{
+    unsigned int i;
+    char op;
+
+    if (shape == NULL) {
+        return NULL;
+    }
+
+    switch (tree->operation) {
+    case LDB_OP_AND:
+    case LDB_OP_OR:
+        op = tree->operation == LDB_OP_AND ? '&' : '|';
+        shape = talloc_asprintf_append_buffer(shape, "(%c", op);
+        for (i = 0; i < tree->u.list.num_elements; i++) {
+            shape = sysdb_query_shape_append(shape, tree->u.list.elements[i]);
+        }
+        return talloc_strdup_append_buffer(shape, ")");
+    case LDB_OP_NOT:
+        shape = talloc_strdup_append_buffer(shape, "(!");
+        shape = sysdb_query_shape_append(shape, tree->u.isnot.child);
+        return talloc_strdup_append_buffer(shape, ")");
+    case LDB_OP_EQUALITY:
+        /* The object category is what tells the searches apart */
+        if (strcasecmp(tree->u.equality.attr, SYSDB_OBJECTCATEGORY) == 0
+                || strcasecmp(tree->u.equality.attr, SYSDB_OBJECTCLASS) == 0) {
+            return talloc_asprintf_append_buffer(shape, "(%s=%.*s)",
+                                tree->u.equality.attr,
+                                (int) tree->u.equality.value.length,
+                                (const char *) tree->u.equality.value.data);
+        }
+        return talloc_asprintf_append_buffer(shape, "(%s=?)",
+                                             tree->u.equality.attr);
+    case LDB_OP_SUBSTRING:
+        return talloc_asprintf_append_buffer(shape, "(%s=*?*)",
+                                             tree->u.substring.attr);
+    case LDB_OP_GREATER:
+        return talloc_asprintf_append_buffer(shape, "(%s>=?)",
+                                             tree->u.comparison.attr);
+    case LDB_OP_LESS:
+        return talloc_asprintf_append_buffer(shape, "(%s<=?)",
+                                             tree->u.comparison.attr);
+    case LDB_OP_APPROX:
+        return talloc_asprintf_append_buffer(shape, "(%s~=?)",
+                                             tree->u.comparison.attr);
+    case LDB_OP_PRESENT:
+        return talloc_asprintf_append_buffer(shape, "(%s=*)",
+                                             tree->u.present.attr);
+    case LDB_OP_EXTENDED:
+        return talloc_asprintf_append_buffer(shape, "(%s:%s:=?)",
+                                      tree->u.extended.attr != NULL
+                                            ? tree->u.extended.attr : "",
+                                      tree->u.extended.rule_id);
+    }
+
+    return talloc_strdup_append_buffer(shape, "(?)");
+}
+
+static const char *sysdb_query_scope_str(enum ldb_scope scope)
+{
+    switch (scope) {
+    case LDB_SCOPE_BASE:
+        return "base";
+    case LDB_SCOPE_ONELEVEL:
+        return "one";
+    default:
+        return "sub";
+    }
+}
+
+static void sysdb_query_aggregate(struct sysdb_query_stats *stats,
+                                  const char *shape_str,
+                                  uint64_t spent_us,
+                                  unsigned int count,
+                                  bool unindexed)
+{
+    struct sysdb_query_shape_stats *shape;
+    hash_key_t key;
+    hash_value_t value;
+    int hret;
+
+    key.type = HASH_KEY_CONST_STRING;
+    key.c_str = shape_str;
+
+    hret = hash_lookup(stats->shapes, &key, &value);
+    if (hret == HASH_ERROR_KEY_NOT_FOUND) {
+        if (hash_count(stats->shapes) >= SYSDB_QUERY_SHAPES_MAX
+                && strcmp(shape_str, SYSDB_QUERY_SHAPE_OTHER) != 0) {
+            sysdb_query_aggregate(stats, SYSDB_QUERY_SHAPE_OTHER, spent_us,
+                                  count, unindexed);
+            return;
+        }
+
+        shape = talloc_zero(stats->shapes, struct sysdb_query_shape_stats);
+        if (shape == NULL) {
+            return;
+        }
+
+        shape->shape = talloc_strdup(shape, shape_str);
+        if (shape->shape == NULL) {
+            talloc_free(shape);
+            return;
+        }
+
+        key.c_str = shape->shape;
+        value.type = HASH_VALUE_PTR;
+        value.ptr = shape;
+        hret = hash_enter(stats->shapes, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            talloc_free(shape);
+            return;
+        }
+    } else if (hret != HASH_SUCCESS) {
+        return;
+    } else {
+        shape = talloc_get_type(value.ptr, struct sysdb_query_shape_stats);
+    }
+
+    shape->count++;
+    shape->total_us += spent_us;
+    shape->max_us = MAX(shape->max_us, spent_us);
+    shape->entries += count;
+    shape->unindexed |= unindexed;
+    stats->dirty = true;
+}
+
+static errno_t sysdb_query_stats_write(struct sysdb_query_stats *stats)
+{
+    struct sysdb_query_shape_stats *shape;
+    hash_value_t *values = NULL;
+    unsigned long count;
+    char *tmp_file;
+    FILE *f = NULL;
+    unsigned long i;
+    errno_t ret;
+    int hret;
+
+    stats->last_dump = time(NULL);
+
+    tmp_file = talloc_asprintf(stats, "%s.tmp", stats->dump_file);
+    if (tmp_file == NULL) {
+        return ENOMEM;
+    }
+
+    hret = hash_values(stats->shapes, &count, &values);
+    if (hret != HASH_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    f = fopen(tmp_file, "w");
+    if (f == NULL) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to open %s [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        shape = talloc_get_type(values[i].ptr, struct sysdb_query_shape_stats);
+        fprintf(f, "%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%d\t%s\n",
+                shape->count, shape->total_us, shape->max_us, shape->entries,
+                shape->unindexed ? 1 : 0, shape->shape);
+    }
+
+    ret = fclose(f);
+    f = NULL;
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to write %s [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    /* Readers never see a partially written file */
+    ret = rename(tmp_file, stats->dump_file);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to rename %s [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    stats->dirty = false;
+    ret = EOK;
+
+done:
+    if (f != NULL) {
+        fclose(f);
+    }
+    if (ret != EOK) {
+        unlink(tmp_file);
+    }
+    talloc_free(values);
+    talloc_free(tmp_file);
+    return ret;
+}
+
+errno_t sysdb_query_stats_dump(struct sysdb_ctx *sysdb)
+{
+    if (sysdb->query_stats == NULL || sysdb->query_stats->shapes == NULL) {
+        return EOK;
+    }
+
+    return sysdb_query_stats_write(sysdb->query_stats);
+}
+
+static struct sysdb_query_shape_stats *
+sysdb_query_stats_find(struct sysdb_query_shape_stats *stats,
+                       size_t count,
+                       const char *shape)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(stats[i].shape, shape) == 0) {
+            return &stats[i];
+        }
+    }
+
+    return NULL;
+}
+
+static errno_t
+sysdb_query_stats_read_file(TALLOC_CTX *mem_ctx,
+                            const char *path,
+                            struct sysdb_query_shape_stats **_stats,
+                            size_t *_count)
+{
+    struct sysdb_query_shape_stats *stats = *_stats;
+    struct sysdb_query_shape_stats line_stats;
+    struct sysdb_query_shape_stats *shape;
+    size_t count = *_count;
+    char line[4096];
+    int unindexed;
+    char *nl;
+    FILE *f;
+    int pos;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        /* The file may have just been replaced */
+        return errno == ENOENT ? EOK : errno;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        pos = 0;
+        if (sscanf(line, "%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%d\t%n",
+                   &line_stats.count, &line_stats.total_us,
+                   &line_stats.max_us, &line_stats.entries,
+                   &unindexed, &pos) != 5 || pos == 0) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Skipping malformed line in %s\n",
+                  path);
+            continue;
+        }
+
+        nl = strchr(line + pos, '\n');
+        if (nl != NULL) {
+            *nl = '\0';
+        }
+
+        shape = sysdb_query_stats_find(stats, count, line + pos);
+        if (shape == NULL) {
+            stats = talloc_realloc(mem_ctx, stats,
+                                   struct sysdb_query_shape_stats, count + 1);
+            if (stats == NULL) {
+                fclose(f);
+                return ENOMEM;
+            }
+            *_stats = stats;
+
+            shape = &stats[count];
+            memset(shape, 0, sizeof(*shape));
+            shape->shape = talloc_strdup(stats, line + pos);
+            if (shape->shape == NULL) {
+                fclose(f);
+                return ENOMEM;
+            }
+            count++;
+            *_count = count;
+        }
+
+        shape->count += line_stats.count;
+        shape->total_us += line_stats.total_us;
+        shape->max_us = MAX(shape->max_us, line_stats.max_us);
+        shape->entries += line_stats.entries;
+        shape->unindexed |= (unindexed != 0);
+    }
+
+    fclose(f);
+    return EOK;
+}
+
+static int sysdb_query_stats_cmp(const void *a, const void *b)
+{
+    const struct sysdb_query_shape_stats *sa = a;
+    const struct sysdb_query_shape_stats *sb = b;
+
+    if (sa->total_us != sb->total_us) {
+        return sa->total_us < sb->total_us ? 1 : -1;
+    }
+
+    return strcmp(sa->shape, sb->shape);
+}
+
+errno_t sysdb_query_stats_read(TALLOC_CTX *mem_ctx,
+                               const char *ldb_file,
+                               struct sysdb_query_shape_stats **_stats,
+                               size_t *_count)
+{
+    struct sysdb_query_shape_stats *stats = NULL;
+    size_t count = 0;
+    TALLOC_CTX *tmp_ctx;
+    glob_t globbuf = { 0 };
+    char *pattern;
+    size_t len;
+    size_t i;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    pattern = talloc_asprintf(tmp_ctx, "%s"SYSDB_QUERY_STATS_SUFFIX"*",
+                              ldb_file);
+    if (pattern == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = glob(pattern, 0, NULL, &globbuf);
+    if (ret == GLOB_NOMATCH) {
+        ret = EOK;
+        goto done;
+    } else if (ret != 0) {
+        ret = EIO;
+        goto done;
+    }
+
+    for (i = 0; i < globbuf.gl_pathc; i++) {
+        len = strlen(globbuf.gl_pathv[i]);
+        if (len > 4 && strcmp(globbuf.gl_pathv[i] + len - 4, ".tmp") == 0) {
+            continue;
+        }
+
+        ret = sysdb_query_stats_read_file(tmp_ctx, globbuf.gl_pathv[i],
+                                          &stats, &count);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Unable to read %s [%d]: %s\n",
+                  globbuf.gl_pathv[i], ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    if (ret == EOK) {
+        if (count > 0) {
+            qsort(stats, count, sizeof(*stats), sysdb_query_stats_cmp);
+        }
+        *_stats = talloc_steal(mem_ctx, stats);
+        *_count = count;
+    }
+    globfree(&globbuf);
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static void sysdb_query_record(struct ldb_context *ldb,
+                               struct sysdb_query_ldb *qldb,
+                               struct ldb_dn *base,
+                               enum ldb_scope scope,
+                               const char *filter,
+                               unsigned int count,
+                               uint64_t spent_us)
+{
+    struct sysdb_query_stats *stats = qldb->stats;
+    struct ldb_parse_tree *tree;
+    bool slow;
+    bool unindexed;
+    char *shape;
+    time_t now;
+
+    slow = stats->slow_threshold_ms > 0
+                && spent_us >= (uint64_t) stats->slow_threshold_ms * 1000;
+    if (!slow && stats->shapes == NULL) {
+        return;
+    }
+
+    tree = ldb_parse_tree(NULL, filter != NULL ? filter : "(objectClass=*)");
+    if (tree == NULL) {
+        return;
+    }
+
+    if (!qldb->index_loaded) {
+        sysdb_query_load_index(ldb, qldb);
+    }
+    unindexed = scope != LDB_SCOPE_BASE
+                    && !sysdb_query_tree_indexed(qldb, tree);
+
+    if (slow) {
+        DEBUG(SSSDBG_IMPORTANT_INFO,
+              "Slow cache search: %"PRIu64" ms, %u entries%s, base [%s], "
+              "scope %s, filter %s\n", spent_us / 1000, count,
+              unindexed ? ", unindexed" : "",
+              base != NULL ? ldb_dn_get_linearized(base) : "",
+              sysdb_query_scope_str(scope),
+              filter != NULL ? filter : "(none)");
+    } else if (unindexed) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Unindexed cache search: filter %s\n",
+              filter != NULL ? filter : "(none)");
+    }
+
+    if (stats->shapes != NULL) {
+        shape = talloc_asprintf(tree, "%s:", sysdb_query_scope_str(scope));
+        shape = sysdb_query_shape_append(shape, tree);
+        if (shape != NULL) {
+            sysdb_query_aggregate(stats, shape, spent_us, count, unindexed);
+        }
+
+        now = time(NULL);
+        if (stats->dirty
+                && now - stats->last_dump >= SYSDB_QUERY_STATS_DUMP_INTERVAL) {
+            sysdb_query_stats_write(stats);
+        }
+    }
+
+    talloc_free(tree);
+}
+
+int sysdb_ldb_search(struct ldb_context *ldb,
+                     TALLOC_CTX *mem_ctx,
+                     struct ldb_result **_res,
+                     struct ldb_dn *base,
+                     enum ldb_scope scope,
+                     const char * const *attrs,
+                     const char *exp_fmt, ...)
+{
+    struct sysdb_query_ldb *qldb;
+    char *filter = NULL;
+    uint64_t start;
+    va_list ap;
+    int ret;
+
+    if (exp_fmt != NULL) {
+        va_start(ap, exp_fmt);
+        filter = talloc_vasprintf(NULL, exp_fmt, ap);
+        va_end(ap);
+
+        if (filter == NULL) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    qldb = ldb_get_opaque(ldb, SYSDB_QUERY_STATS_OPAQUE);
+    if (qldb == NULL) {
+        ret = sysdb_obj_cache_search(ldb, mem_ctx, _res, base, scope, attrs,
+                                     filter);
+        talloc_free(filter);
+        return ret;
+    }
+
+    start = sysdb_query_now_us();
+    ret = sysdb_obj_cache_search(ldb, mem_ctx, _res, base, scope, attrs,
+                                 filter);
+    if (ret == LDB_SUCCESS) {
+        sysdb_query_record(ldb, qldb, base, scope, filter, (*_res)->count,
+                           sysdb_query_now_us() - start);
+    }
+
+    talloc_free(filter);
+    return ret;
+}
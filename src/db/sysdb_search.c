@@ -105,6 +105,7 @@ static errno_t merge_msg_ts_attrs(struct sysdb_ctx *sysdb,
     TALLOC_CTX *tmp_ctx;
     size_t msgs_count;
     struct ldb_message **ts_msgs;
+    struct ldb_message *ts_msg;
     bool ts_dn;
 
     ts_dn = is_ts_ldb_dn(sysdb_msg->dn);
@@ -117,6 +118,15 @@ static errno_t merge_msg_ts_attrs(struct sysdb_ctx *sysdb,
         return ENOMEM;
     }
 
+    if (sysdb->ts_map != NULL) {
+        ret = sysdb_ts_map_get(tmp_ctx, sysdb->ts_map, sysdb_msg->dn, &ts_msg);
+        if (ret == EOK) {
+            ret = merge_all_ts_attrs(ts_msg, sysdb_msg, attrs);
+            goto done;
+        }
+        /* Not in the map, fall back to the timestamp cache */
+    }
+
     ret = sysdb_search_ts_entry(tmp_ctx, sysdb, sysdb_msg->dn,
                                 LDB_SCOPE_BASE,
                                 NULL,
@@ -311,10 +321,10 @@ int sysdb_getpwnam(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWNAM_FILTER,
-                     lc_sanitized_name,
-                     sanitized_name, sanitized_name);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attrs, SYSDB_PWNAM_FILTER,
+                           lc_sanitized_name,
+                           sanitized_name, sanitized_name);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -441,8 +451,9 @@ int sysdb_getpwuid(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, SYSDB_PWUID_FILTER, ul_uid);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attrs, SYSDB_PWUID_FILTER,
+                           ul_uid);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -656,8 +667,8 @@ errno_t sysdb_search_ts_matches(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(sysdb->ldb, tmp_ctx, &res, NULL,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ldb_search(sysdb->ldb, tmp_ctx, &res, NULL,
+                           LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -945,8 +956,8 @@ int sysdb_enumpwent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -1121,7 +1132,10 @@ int sysdb_getgrnam_with_views(TALLOC_CTX *mem_ctx,
         if (DOM_HAS_VIEWS(domain)) {
             if (!is_local_view(domain->view_name)) {
                 el = ldb_msg_find_element(orig_obj->msgs[0], SYSDB_GHOST);
-                if (el != NULL && el->num_values != 0) {
+                if ((el != NULL && el->num_values != 0)
+                        || ldb_msg_find_attr_as_bool(orig_obj->msgs[0],
+                                                     SYSDB_GHOST_STORE,
+                                                     false)) {
                     DEBUG(SSSDBG_TRACE_ALL, "Group object [%s], contains ghost "
                           "entries which must be resolved before overrides can be "
                           "applied.\n",
@@ -1212,9 +1226,10 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter,
-                         lc_sanitized_name, sanitized_name, sanitized_name);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               lc_sanitized_name, sanitized_name,
+                               sanitized_name);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1244,9 +1259,10 @@ int sysdb_getgrnam(TALLOC_CTX *mem_ctx,
      * it's a MPG and we're dealing with a overridden group, which has to
      * use the very same filter as a non MPG domain. */
     if (res == NULL) {
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter,
-                         lc_sanitized_name, sanitized_name, sanitized_name);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               lc_sanitized_name, sanitized_name,
+                               sanitized_name);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1314,7 +1330,10 @@ int sysdb_getgrgid_with_views(TALLOC_CTX *mem_ctx,
         if (DOM_HAS_VIEWS(domain)) {
             if (!is_local_view(domain->view_name)) {
                 el = ldb_msg_find_element(orig_obj->msgs[0], SYSDB_GHOST);
-                if (el != NULL && el->num_values != 0) {
+                if ((el != NULL && el->num_values != 0)
+                        || ldb_msg_find_attr_as_bool(orig_obj->msgs[0],
+                                                     SYSDB_GHOST_STORE,
+                                                     false)) {
                     DEBUG(SSSDBG_TRACE_ALL, "Group object [%s], contains ghost "
                           "entries which must be resolved before overrides can be "
                           "applied.\n",
@@ -1411,8 +1430,9 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
             goto done;
         }
 
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid, ul_gid, ul_gid);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter,
+                               ul_gid, ul_gid, ul_gid);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1441,8 +1461,8 @@ int sysdb_getgrgid_attrs(TALLOC_CTX *mem_ctx,
      * it's a MPG and we're dealing with a overridden group, which has to
      * use the very same filter as a non MPG domain. */
     if (res == NULL) {
-        ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                         LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid);
+        ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                               LDB_SCOPE_SUBTREE, attrs, fmt_filter, ul_gid);
         if (ret != EOK) {
             ret = sysdb_error_to_errno(ret);
             goto done;
@@ -1554,8 +1574,8 @@ int sysdb_enumgrent_filter(TALLOC_CTX *mem_ctx,
     }
     DEBUG(SSSDBG_TRACE_LIBS, "Searching cache with [%s]\n", filter);
 
-    lret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                      LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+    lret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                            LDB_SCOPE_SUBTREE, attrs, "%s", filter);
     if (lret != LDB_SUCCESS) {
         ret = sysdb_error_to_errno(lret);
         goto done;
@@ -1961,10 +1981,10 @@ int sysdb_get_user_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
-                     LDB_SCOPE_SUBTREE, attributes,
-                     SYSDB_PWNAM_FILTER, lc_sanitized_name, sanitized_name,
-                     sanitized_name);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &res, base_dn,
+                           LDB_SCOPE_SUBTREE, attributes,
+                           SYSDB_PWNAM_FILTER, lc_sanitized_name,
+                           sanitized_name, sanitized_name);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
@@ -2406,12 +2426,12 @@ int sysdb_get_netgroup_attr(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = ldb_search(domain->sysdb->ldb, tmp_ctx, &result, base_dn,
-                     LDB_SCOPE_SUBTREE, attributes,
-                     SYSDB_NETGR_FILTER,
-                     lc_sanitized_netgroup,
-                     sanitized_netgroup,
-                     sanitized_netgroup);
+    ret = sysdb_ldb_search(domain->sysdb->ldb, tmp_ctx, &result, base_dn,
+                           LDB_SCOPE_SUBTREE, attributes,
+                           SYSDB_NETGR_FILTER,
+                           lc_sanitized_netgroup,
+                           sanitized_netgroup,
+                           sanitized_netgroup);
     if (ret) {
         ret = sysdb_error_to_errno(ret);
         goto done;
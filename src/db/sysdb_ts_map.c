@@ -0,0 +1,1345 @@
+/*
+   SSSD
+
+   System Database - memory mapped copy of the timestamp cache
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The map holds the timestamp attributes of users and groups in fixed-size
+ * records of an open addressing hash table keyed by a hash of the
+ * casefolded DN, so that looking up the timestamps of an entry does not
+ * need an ldb search.
+ *
+ * A modification that only replaces timestamps of an entry already in the
+ * map is stored in the map alone and the record is flagged as dirty. Dirty
+ * records are written back to the timestamp ldb in a single transaction
+ * before the ldb is searched, so that the searches filtering on the
+ * timestamps see the current values. All other modifications are written
+ * to the timestamp ldb: the record is invalidated before the ldb is
+ * modified and only marked valid again once the modification was
+ * committed, so a crash in between leaves the map consistent.
+ *
+ * Writers serialize on an flock() of the map file. The timestamp ldb is
+ * always locked first when both are needed. Every record is protected by a
+ * sequence counter which is odd while the record is being written, readers
+ * copy the record without taking any lock and retry if the counter changed
+ * in the meantime.
+ *
+ * Keys are never removed from the table in place. When it fills up, a new
+ * map holding only the valid records is written next to the current one and
+ * renamed over it, the old one is then flagged as stale and every process
+ * attaches to the new one on its next access. The same happens when the
+ * map does not belong to the timestamp ldb it is stored next to, e.g.
+ * because the ldb was removed.
+ */
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "shared/murmurhash3.h"
+#include "db/sysdb_private.h"
+
+#define SYSDB_TS_MAP_MAGIC      0x53544d50 /* STMP */
+#define SYSDB_TS_MAP_VERSION    2
+#define SYSDB_TS_MAP_VALUE_SIZE 32
+#define SYSDB_TS_MAP_DN_SIZE    256
+#define SYSDB_TS_MAP_NUM_ATTRS  5
+#define SYSDB_TS_MAP_KEY_WORDS  4
+#define SYSDB_TS_MAP_RETRIES    64
+#define SYSDB_TS_MAP_TMP_SUFFIX ".tmp"
+
+#define SYSDB_TS_MAP_REC_VALID  0x01
+/* the values are newer than the ones in the timestamp ldb */
+#define SYSDB_TS_MAP_REC_DIRTY  0x02
+
+/* Same as sysdb_ts_cache_attrs without objectClass and objectCategory which
+ * are never merged into the sysdb entries */
+static const char *ts_map_attrs[SYSDB_TS_MAP_NUM_ATTRS + 1] = {
+    SYSDB_LAST_UPDATE,
+    SYSDB_CACHE_EXPIRE,
+    SYSDB_ORIG_MODSTAMP,
+    SYSDB_INITGR_EXPIRE,
+    SYSDB_USN,
+    NULL,
+};
+
+struct sysdb_ts_map_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t used;
+    uint32_t stale;
+    uint32_t dirty;
+    uint32_t rec_size;
+    /* identity of the timestamp ldb the map belongs to */
+    uint64_t ts_dev;
+    uint64_t ts_ino;
+};
+
+struct sysdb_ts_map_rec {
+    uint32_t seq;
+    uint32_t flags;
+    uint32_t key[SYSDB_TS_MAP_KEY_WORDS];
+    /* NUL-terminated values, an empty string means the attribute is not set */
+    char values[SYSDB_TS_MAP_NUM_ATTRS][SYSDB_TS_MAP_VALUE_SIZE];
+    /* DN the values are written back to, only set in dirty records */
+    char dn[SYSDB_TS_MAP_DN_SIZE];
+};
+
+struct sysdb_ts_map {
+    char *file;
+    char *ts_file;
+
+    int fd;
+    uint8_t *base;
+    size_t size;
+    uint32_t num_slots;
+
+    struct sysdb_ts_map_hdr *hdr;
+    struct sysdb_ts_map_rec *recs;
+};
+
+static size_t ts_map_size(uint32_t num_slots)
+{
+    return sizeof(struct sysdb_ts_map_hdr)
+            + (size_t) num_slots * sizeof(struct sysdb_ts_map_rec);
+}
+
+static void ts_map_key(struct ldb_dn *dn, uint32_t key[SYSDB_TS_MAP_KEY_WORDS])
+{
+    const char *str;
+    int len;
+    int i;
+
+    str = ldb_dn_get_casefold(dn);
+    if (str == NULL) {
+        str = ldb_dn_get_linearized(dn);
+    }
+    if (str == NULL) {
+        str = "";
+    }
+    len = strlen(str);
+
+    for (i = 0; i < SYSDB_TS_MAP_KEY_WORDS; i++) {
+        key[i] = murmurhash3(str, len, 0xa7e5f00d + i);
+    }
+
+    /* an all-zero key marks an empty slot */
+    key[0] |= 1;
+}
+
+static bool ts_map_rec_empty(const struct sysdb_ts_map_rec *rec)
+{
+    return rec->key[0] == 0;
+}
+
+static bool ts_map_rec_match(const struct sysdb_ts_map_rec *rec,
+                             const uint32_t key[SYSDB_TS_MAP_KEY_WORDS])
+{
+    return memcmp(rec->key, key, sizeof(rec->key)) == 0;
+}
+
+/* Only called with the map locked, so there is a single writer */
+static void ts_map_rec_store(struct sysdb_ts_map_rec *rec,
+                             const struct sysdb_ts_map_rec *src)
+{
+    uint32_t seq;
+
+    seq = rec->seq;
+    __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(rec->key, src->key, sizeof(rec->key));
+    memcpy(rec->values, src->values, sizeof(rec->values));
+    memcpy(rec->dn, src->dn, sizeof(rec->dn));
+    rec->flags = src->flags;
+
+    __atomic_store_n(&rec->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static errno_t ts_map_rec_load(const struct sysdb_ts_map_rec *rec,
+                               struct sysdb_ts_map_rec *dst)
+{
+    uint32_t seq1;
+    uint32_t seq2;
+    int i;
+
+    for (i = 0; i < SYSDB_TS_MAP_RETRIES; i++) {
+        seq1 = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+        if (seq1 & 1) {
+            continue;
+        }
+
+        memcpy(dst, rec, sizeof(struct sysdb_ts_map_rec));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        seq2 = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+        if (seq1 == seq2) {
+            return EOK;
+        }
+    }
+
+    return EAGAIN;
+}
+
+static int ts_map_attr_idx(const char *name)
+{
+    int i;
+
+    for (i = 0; ts_map_attrs[i] != NULL; i++) {
+        if (strcasecmp(name, ts_map_attrs[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static errno_t ts_map_rec_set_value(struct sysdb_ts_map_rec *rec, int idx,
+                                    const struct ldb_val *val)
+{
+    if (val == NULL) {
+        rec->values[idx][0] = '\0';
+        return EOK;
+    }
+
+    if (val->length == 0 || val->length >= SYSDB_TS_MAP_VALUE_SIZE
+            || memchr(val->data, '\0', val->length) != NULL) {
+        return ERANGE;
+    }
+
+    memcpy(rec->values[idx], val->data, val->length);
+    rec->values[idx][val->length] = '\0';
+    return EOK;
+}
+
+/* Applies an ldb_add() or ldb_modify() message to a record, returns an error
+ * if the result can't be represented, e.g. because an attribute would become
+ * multi-valued */
+static errno_t ts_map_rec_apply(struct sysdb_ts_map_rec *rec,
+                                const struct ldb_message *msg,
+                                bool add)
+{
+    struct ldb_message_element *el;
+    errno_t ret;
+    unsigned int i;
+    int idx;
+
+    for (i = 0; i < msg->num_elements; i++) {
+        el = &msg->elements[i];
+
+        idx = ts_map_attr_idx(el->name);
+        if (idx < 0) {
+            continue;
+        }
+
+        if (el->num_values > 1) {
+            return ERANGE;
+        }
+
+        switch (add ? LDB_FLAG_MOD_ADD : LDB_FLAG_MOD_TYPE(el->flags)) {
+        case LDB_FLAG_MOD_ADD:
+            if (rec->values[idx][0] != '\0' || el->num_values == 0) {
+                return ERANGE;
+            }
+            ret = ts_map_rec_set_value(rec, idx, &el->values[0]);
+            break;
+        case LDB_FLAG_MOD_REPLACE:
+            ret = ts_map_rec_set_value(rec, idx, el->num_values == 0 ?
+                                                 NULL : &el->values[0]);
+            break;
+        case LDB_FLAG_MOD_DELETE:
+            ret = ts_map_rec_set_value(rec, idx, NULL);
+            break;
+        default:
+            ret = EINVAL;
+            break;
+        }
+
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+static int ts_map_destructor(struct sysdb_ts_map *map)
+{
+    if (map->base != NULL) {
+        munmap(map->base, map->size);
+    }
+
+    if (map->fd != -1) {
+        close(map->fd);
+    }
+
+    return 0;
+}
+
+static void ts_map_detach(struct sysdb_ts_map *map)
+{
+    ts_map_destructor(map);
+
+    map->fd = -1;
+    map->base = NULL;
+    map->size = 0;
+    map->num_slots = 0;
+    map->hdr = NULL;
+    map->recs = NULL;
+}
+
+static bool ts_map_is_stale(struct sysdb_ts_map *map)
+{
+    return map->hdr == NULL
+            || __atomic_load_n(&map->hdr->stale, __ATOMIC_ACQUIRE) != 0;
+}
+
+static errno_t ts_map_flock(int fd, int operation)
+{
+    int ret;
+
+    do {
+        ret = flock(fd, operation);
+    } while (ret != 0 && errno == EINTR);
+
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "flock() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    return EOK;
+}
+
+static errno_t ts_map_mmap(int fd, size_t size, uint8_t **_base)
+{
+    void *base;
+    errno_t ret;
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "mmap() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    *_base = base;
+    return EOK;
+}
+
+/* Creates an empty map in fd, which must be a new or empty file */
+static errno_t ts_map_init_file(int fd, uint32_t num_slots,
+                                const struct stat *ts_st,
+                                uint8_t **_base)
+{
+    struct sysdb_ts_map_hdr *hdr;
+    size_t size = ts_map_size(num_slots);
+    uint8_t *base;
+    errno_t ret;
+
+    ret = ftruncate(fd, size);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "ftruncate() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = ts_map_mmap(fd, size, &base);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    hdr = (struct sysdb_ts_map_hdr *) base;
+    hdr->num_slots = num_slots;
+    hdr->used = 0;
+    hdr->stale = 0;
+    hdr->dirty = 0;
+    hdr->rec_size = sizeof(struct sysdb_ts_map_rec);
+    hdr->ts_dev = ts_st->st_dev;
+    hdr->ts_ino = ts_st->st_ino;
+    hdr->version = SYSDB_TS_MAP_VERSION;
+    __atomic_store_n(&hdr->magic, SYSDB_TS_MAP_MAGIC, __ATOMIC_RELEASE);
+
+    *_base = base;
+    return EOK;
+}
+
+static bool ts_map_hdr_valid(const struct sysdb_ts_map_hdr *hdr,
+                             size_t size,
+                             const struct stat *ts_st)
+{
+    return hdr->magic == SYSDB_TS_MAP_MAGIC
+            && hdr->version == SYSDB_TS_MAP_VERSION
+            && hdr->rec_size == sizeof(struct sysdb_ts_map_rec)
+            && hdr->num_slots != 0
+            && (hdr->num_slots & (hdr->num_slots - 1)) == 0
+            && ts_map_size(hdr->num_slots) == size
+            && hdr->ts_dev == (uint64_t) ts_st->st_dev
+            && hdr->ts_ino == (uint64_t) ts_st->st_ino;
+}
+
+static errno_t ts_map_replace(struct sysdb_ts_map *map, uint32_t num_slots,
+                              const struct stat *ts_st);
+
+/* Attaches to the map file currently stored at map->file and returns with
+ * the map locked. A missing, foreign or corrupted map is replaced with an
+ * empty one. */
+static errno_t ts_map_attach_locked(struct sysdb_ts_map *map)
+{
+    struct stat ts_st;
+    struct stat st;
+    struct sysdb_ts_map_hdr *hdr;
+    uint8_t *base = NULL;
+    errno_t ret;
+    int fd = -1;
+
+    ts_map_detach(map);
+
+    ret = stat(map->ts_file, &ts_st);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot stat [%s] [%d]: %s\n",
+              map->ts_file, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    fd = open(map->file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              map->file, ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = ts_map_flock(fd, LOCK_EX);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = fstat(fd, &st);
+    if (ret != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    if (st.st_size == 0) {
+        ret = ts_map_init_file(fd, SYSDB_TS_MAP_MIN_SLOTS, &ts_st, &base);
+        if (ret != EOK) {
+            goto done;
+        }
+        st.st_size = ts_map_size(SYSDB_TS_MAP_MIN_SLOTS);
+    } else if ((size_t) st.st_size >= sizeof(struct sysdb_ts_map_hdr)) {
+        ret = ts_map_mmap(fd, st.st_size, &base);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    map->fd = fd;
+    map->base = base;
+    map->size = st.st_size;
+    map->hdr = (struct sysdb_ts_map_hdr *) base;
+    fd = -1;
+
+    hdr = map->hdr;
+    if (hdr != NULL && hdr->magic == SYSDB_TS_MAP_MAGIC && hdr->stale != 0) {
+        /* replaced between open() and flock(), try again */
+        ts_map_detach(map);
+        ret = EAGAIN;
+        goto done;
+    }
+
+    if (hdr == NULL || !ts_map_hdr_valid(hdr, st.st_size, &ts_st)) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+              "Map [%s] does not match [%s], recreating it\n",
+              map->file, map->ts_file);
+
+        ret = ts_map_replace(map, SYSDB_TS_MAP_MIN_SLOTS, &ts_st);
+        if (ret != EOK) {
+            ts_map_detach(map);
+        }
+        goto done;
+    }
+
+    map->num_slots = hdr->num_slots;
+    map->recs = (struct sysdb_ts_map_rec *) (base + sizeof(*hdr));
+    ret = EOK;
+
+done:
+    if (fd != -1) {
+        close(fd);
+    }
+    return ret;
+}
+
+static errno_t ts_map_lock(struct sysdb_ts_map *map)
+{
+    errno_t ret;
+    int i;
+
+    for (i = 0; i < SYSDB_TS_MAP_RETRIES; i++) {
+        if (ts_map_is_stale(map)) {
+            ret = ts_map_attach_locked(map);
+            if (ret == EAGAIN) {
+                continue;
+            }
+            return ret;
+        }
+
+        ret = ts_map_flock(map->fd, LOCK_EX);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        /* The map might have been replaced while we were waiting */
+        if (!ts_map_is_stale(map)) {
+            return EOK;
+        }
+
+        ts_map_flock(map->fd, LOCK_UN);
+    }
+
+    return EAGAIN;
+}
+
+static void ts_map_unlock(struct sysdb_ts_map *map)
+{
+    if (map->fd != -1) {
+        ts_map_flock(map->fd, LOCK_UN);
+    }
+}
+
+static struct sysdb_ts_map_rec *
+ts_map_probe(struct sysdb_ts_map_rec *recs, uint32_t num_slots,
+             const uint32_t key[SYSDB_TS_MAP_KEY_WORDS])
+{
+    uint32_t mask = num_slots - 1;
+    uint32_t idx;
+    uint32_t i;
+
+    for (i = 0; i < num_slots; i++) {
+        idx = (key[1] + i) & mask;
+        if (ts_map_rec_empty(&recs[idx])
+                || ts_map_rec_match(&recs[idx], key)) {
+            return &recs[idx];
+        }
+    }
+
+    return NULL;
+}
+
+/* Writes a map with num_slots slots holding the valid records of the current
+ * one, renames it over the current one and flags the current one as stale.
+ * Must be called with the map locked, returns with the new map locked. */
+static errno_t ts_map_replace(struct sysdb_ts_map *map, uint32_t num_slots,
+                              const struct stat *ts_st)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_ts_map_hdr *hdr;
+    struct sysdb_ts_map_rec *recs;
+    struct sysdb_ts_map_rec *rec;
+    struct stat st;
+    uint8_t *base = NULL;
+    char *tmp_file = NULL;
+    errno_t ret;
+    uint32_t i;
+    int fd = -1;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    tmp_file = talloc_asprintf(tmp_ctx, "%s"SYSDB_TS_MAP_TMP_SUFFIX,
+                               map->file);
+    if (tmp_file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot open [%s] [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = ts_map_flock(fd, LOCK_EX);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = ts_map_init_file(fd, num_slots, ts_st, &base);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    hdr = (struct sysdb_ts_map_hdr *) base;
+    recs = (struct sysdb_ts_map_rec *) (base + sizeof(*hdr));
+
+    for (i = 0; i < map->num_slots; i++) {
+        if (!(map->recs[i].flags & SYSDB_TS_MAP_REC_VALID)) {
+            continue;
+        }
+
+        rec = ts_map_probe(recs, num_slots, map->recs[i].key);
+        if (rec == NULL) {
+            ret = ENOSPC;
+            goto done;
+        }
+        memcpy(rec, &map->recs[i], sizeof(struct sysdb_ts_map_rec));
+        rec->seq = 0;
+        hdr->used++;
+        if (rec->flags & SYSDB_TS_MAP_REC_DIRTY) {
+            hdr->dirty++;
+        }
+    }
+
+    /* Keep the owner of the current map, the cache files are owned by the
+     * sssd user when it does not run as root */
+    if (map->fd != -1) {
+        ret = fstat(map->fd, &st);
+        if (ret == 0 && (st.st_uid != geteuid() || st.st_gid != getegid())) {
+            ret = fchown(fd, st.st_uid, st.st_gid);
+        }
+        if (ret != 0) {
+            ret = errno;
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot set owner of [%s] [%d]: %s\n",
+                  tmp_file, ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    ret = rename(tmp_file, map->file);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot rename [%s] [%d]: %s\n",
+              tmp_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    if (map->hdr != NULL) {
+        __atomic_store_n(&map->hdr->stale, 1, __ATOMIC_RELEASE);
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Map [%s] now has %u slots, %u used\n",
+          map->file, num_slots, hdr->used);
+
+    ts_map_detach(map);
+    map->fd = fd;
+    map->base = base;
+    map->size = ts_map_size(num_slots);
+    map->num_slots = num_slots;
+    map->hdr = hdr;
+    map->recs = recs;
+    fd = -1;
+    base = NULL;
+    ret = EOK;
+
+done:
+    if (base != NULL) {
+        munmap(base, ts_map_size(num_slots));
+    }
+    if (fd != -1) {
+        close(fd);
+        unlink(tmp_file);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Keys of deleted entries are dropped when the map is replaced, so a map
+ * mostly filled with those is only compacted */
+static uint32_t ts_map_new_size(struct sysdb_ts_map *map)
+{
+    uint32_t valid = 0;
+    uint32_t i;
+
+    for (i = 0; i < map->num_slots; i++) {
+        if (map->recs[i].flags & SYSDB_TS_MAP_REC_VALID) {
+            valid++;
+        }
+    }
+
+    if ((uint64_t) valid * 2 > map->num_slots) {
+        return map->num_slots * 2;
+    }
+
+    return map->num_slots;
+}
+
+/* Returns the slot of key, claiming an empty one if needed, or NULL if the
+ * map is full and could not be grown. Must be called with the map locked. */
+static struct sysdb_ts_map_rec *
+ts_map_claim(struct sysdb_ts_map *map,
+             const uint32_t key[SYSDB_TS_MAP_KEY_WORDS])
+{
+    struct sysdb_ts_map_rec new_rec = { 0 };
+    struct sysdb_ts_map_rec *rec;
+    struct stat ts_st;
+    errno_t ret;
+
+    rec = ts_map_probe(map->recs, map->num_slots, key);
+    if (rec != NULL && !ts_map_rec_empty(rec)) {
+        return rec;
+    }
+
+    /* keep the load factor below 3/4 */
+    if (((uint64_t) map->hdr->used + 1) * 4 > (uint64_t) map->num_slots * 3) {
+        ret = stat(map->ts_file, &ts_st);
+        if (ret == 0) {
+            ret = ts_map_replace(map, ts_map_new_size(map), &ts_st);
+        } else {
+            ret = errno;
+        }
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Cannot grow map [%s] [%d]: %s\n",
+                  map->file, ret, sss_strerror(ret));
+            return NULL;
+        }
+
+        rec = ts_map_probe(map->recs, map->num_slots, key);
+    }
+
+    if (rec == NULL) {
+        return NULL;
+    }
+
+    memcpy(new_rec.key, key, sizeof(new_rec.key));
+    ts_map_rec_store(rec, &new_rec);
+    map->hdr->used++;
+
+    return rec;
+}
+
+static errno_t ts_map_reread(struct ldb_context *ldb_ts,
+                             struct ldb_dn *dn,
+                             struct sysdb_ts_map_rec *rec)
+{
+    struct ldb_result *res;
+    struct ldb_message_element *el;
+    errno_t ret;
+    int i;
+
+    ret = ldb_search(ldb_ts, NULL, &res, dn, LDB_SCOPE_BASE,
+                     ts_map_attrs, NULL);
+    if (ret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(ret);
+    }
+
+    if (res->count != 1) {
+        ret = ENOENT;
+        goto done;
+    }
+
+    for (i = 0; ts_map_attrs[i] != NULL; i++) {
+        el = ldb_msg_find_element(res->msgs[0], ts_map_attrs[i]);
+        if (el != NULL && el->num_values > 1) {
+            ret = ERANGE;
+            goto done;
+        }
+
+        ret = ts_map_rec_set_value(rec, i, (el == NULL || el->num_values == 0)
+                                           ? NULL : &el->values[0]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(res);
+    return ret;
+}
+
+/* Writes the values of a dirty record to the timestamp ldb */
+static errno_t ts_map_write_back(struct ldb_context *ldb_ts,
+                                 struct sysdb_ts_map_rec *rec)
+{
+    struct ldb_message *msg;
+    char *value;
+    errno_t ret;
+    int lret;
+    int i;
+
+    msg = ldb_msg_new(NULL);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    rec->dn[SYSDB_TS_MAP_DN_SIZE - 1] = '\0';
+    msg->dn = ldb_dn_new(msg, ldb_ts, rec->dn);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; ts_map_attrs[i] != NULL; i++) {
+        lret = ldb_msg_add_empty(msg, ts_map_attrs[i], LDB_FLAG_MOD_REPLACE,
+                                 NULL);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+
+        if (rec->values[i][0] == '\0') {
+            continue;
+        }
+
+        rec->values[i][SYSDB_TS_MAP_VALUE_SIZE - 1] = '\0';
+        value = talloc_strdup(msg, rec->values[i]);
+        if (value == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        lret = ldb_msg_add_string(msg, ts_map_attrs[i], value);
+        if (lret != LDB_SUCCESS) {
+            ret = sysdb_error_to_errno(lret);
+            goto done;
+        }
+    }
+
+    lret = ldb_modify(ldb_ts, msg);
+    ret = sysdb_error_to_errno(lret);
+    if (ret != EOK && ret != ENOENT) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot write back timestamps of [%s] "
+              "[%d]: %s\n", rec->dn, ret, sss_strerror(ret));
+    }
+
+done:
+    talloc_free(msg);
+    return ret;
+}
+
+/* Stores a modification that only replaces timestamps of an entry whose
+ * record is valid in the map alone. Returns EAGAIN if the modification
+ * has to be written to the timestamp ldb. Must be called with the map
+ * locked. */
+static errno_t ts_map_defer(struct sysdb_ts_map *map,
+                            struct ldb_message *msg)
+{
+    uint32_t key[SYSDB_TS_MAP_KEY_WORDS];
+    struct sysdb_ts_map_rec *rec;
+    struct sysdb_ts_map_rec new_rec;
+    const char *dn;
+    unsigned int i;
+    size_t len;
+    errno_t ret;
+
+    for (i = 0; i < msg->num_elements; i++) {
+        if (ts_map_attr_idx(msg->elements[i].name) < 0
+                || LDB_FLAG_MOD_TYPE(msg->elements[i].flags)
+                        != LDB_FLAG_MOD_REPLACE) {
+            return EAGAIN;
+        }
+    }
+
+    dn = ldb_dn_get_linearized(msg->dn);
+    if (dn == NULL) {
+        return EAGAIN;
+    }
+
+    len = strlen(dn);
+    if (len >= SYSDB_TS_MAP_DN_SIZE) {
+        return EAGAIN;
+    }
+
+    ts_map_key(msg->dn, key);
+    rec = ts_map_probe(map->recs, map->num_slots, key);
+    if (rec == NULL || ts_map_rec_empty(rec)
+            || !(rec->flags & SYSDB_TS_MAP_REC_VALID)) {
+        return EAGAIN;
+    }
+
+    new_rec = *rec;
+    ret = ts_map_rec_apply(&new_rec, msg, false);
+    if (ret != EOK) {
+        return EAGAIN;
+    }
+
+    memcpy(new_rec.dn, dn, len + 1);
+    if (!(new_rec.flags & SYSDB_TS_MAP_REC_DIRTY)) {
+        new_rec.flags |= SYSDB_TS_MAP_REC_DIRTY;
+        map->hdr->dirty++;
+    }
+    ts_map_rec_store(rec, &new_rec);
+
+    return EOK;
+}
+
+enum ts_map_op {
+    TS_MAP_ADD,
+    TS_MAP_MODIFY,
+    TS_MAP_DELETE,
+};
+
+static int ts_map_write(struct sysdb_ctx *sysdb,
+                        enum ts_map_op op,
+                        struct ldb_dn *dn,
+                        struct ldb_message *msg)
+{
+    struct sysdb_ts_map *map = sysdb->ts_map;
+    uint32_t key[SYSDB_TS_MAP_KEY_WORDS];
+    struct sysdb_ts_map_rec *rec = NULL;
+    struct sysdb_ts_map_rec old_rec = { 0 };
+    struct sysdb_ts_map_rec new_rec = { 0 };
+    bool locked = false;
+    errno_t ret;
+    int lret;
+
+    if (map != NULL && op == TS_MAP_MODIFY) {
+        ret = ts_map_lock(map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Cannot lock the timestamp map [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+
+        ret = ts_map_defer(map, msg);
+        ts_map_unlock(map);
+        if (ret == EOK) {
+            return LDB_SUCCESS;
+        }
+    }
+
+    lret = ldb_transaction_start(sysdb->ldb_ts);
+    if (lret != LDB_SUCCESS) {
+        return lret;
+    }
+
+    if (map != NULL) {
+        ret = ts_map_lock(map);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Cannot lock the timestamp map [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            ldb_transaction_cancel(sysdb->ldb_ts);
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+        locked = true;
+
+        ts_map_key(dn, key);
+
+        if (op == TS_MAP_DELETE) {
+            rec = ts_map_probe(map->recs, map->num_slots, key);
+            if (rec != NULL && ts_map_rec_empty(rec)) {
+                rec = NULL;
+            }
+        } else {
+            /* If there is no room the key is not in the map either, so it
+             * is fine to just update the timestamp cache */
+            rec = ts_map_claim(map, key);
+        }
+
+        if (rec != NULL) {
+            old_rec = *rec;
+            new_rec = *rec;
+            new_rec.flags &= ~SYSDB_TS_MAP_REC_VALID;
+            ts_map_rec_store(rec, &new_rec);
+        }
+    }
+
+    lret = LDB_SUCCESS;
+    if (op != TS_MAP_DELETE
+            && (old_rec.flags & SYSDB_TS_MAP_REC_VALID)
+            && (old_rec.flags & SYSDB_TS_MAP_REC_DIRTY)) {
+        /* the modification is applied on top of the deferred values */
+        ret = ts_map_write_back(sysdb->ldb_ts, &old_rec);
+        if (ret != EOK && ret != ENOENT) {
+            lret = LDB_ERR_OPERATIONS_ERROR;
+        }
+    }
+
+    if (lret == LDB_SUCCESS) {
+        switch (op) {
+        case TS_MAP_ADD:
+            lret = ldb_add(sysdb->ldb_ts, msg);
+            break;
+        case TS_MAP_MODIFY:
+            lret = ldb_modify(sysdb->ldb_ts, msg);
+            break;
+        case TS_MAP_DELETE:
+            lret = ldb_delete(sysdb->ldb_ts, dn);
+            break;
+        default:
+            lret = LDB_ERR_OPERATIONS_ERROR;
+            break;
+        }
+    }
+
+    if (lret == LDB_SUCCESS) {
+        lret = ldb_transaction_commit(sysdb->ldb_ts);
+    } else {
+        ldb_transaction_cancel(sysdb->ldb_ts);
+    }
+
+    if (rec == NULL) {
+        goto done;
+    }
+
+    if (lret != LDB_SUCCESS) {
+        /* nothing was written, the record is still accurate */
+        ts_map_rec_store(rec, &old_rec);
+        goto done;
+    }
+
+    if (old_rec.flags & SYSDB_TS_MAP_REC_DIRTY) {
+        new_rec.flags &= ~SYSDB_TS_MAP_REC_DIRTY;
+        map->hdr->dirty--;
+    }
+
+    if (op == TS_MAP_DELETE) {
+        ts_map_rec_store(rec, &new_rec);
+        goto done;
+    }
+
+    if (op == TS_MAP_ADD) {
+        memset(new_rec.values, 0, sizeof(new_rec.values));
+        ret = ts_map_rec_apply(&new_rec, msg, true);
+    } else if (old_rec.flags & SYSDB_TS_MAP_REC_VALID) {
+        ret = ts_map_rec_apply(&new_rec, msg, false);
+    } else {
+        ret = ENOENT;
+    }
+
+    if (ret != EOK) {
+        /* fill the record from the timestamp cache itself */
+        ret = ts_map_reread(sysdb->ldb_ts, dn, &new_rec);
+    }
+
+    if (ret == EOK) {
+        new_rec.flags |= SYSDB_TS_MAP_REC_VALID;
+    } else {
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "[%s] is not stored in the timestamp map [%d]: %s\n",
+              ldb_dn_get_linearized(dn), ret, sss_strerror(ret));
+    }
+    ts_map_rec_store(rec, &new_rec);
+
+done:
+    if (locked) {
+        ts_map_unlock(map);
+    }
+    return lret;
+}
+
+struct ts_map_flushed {
+    uint32_t idx;
+    bool gone;
+};
+
+errno_t sysdb_ts_map_flush(struct sysdb_ctx *sysdb, struct ldb_dn *dn)
+{
+    struct sysdb_ts_map *map = sysdb->ts_map;
+    uint32_t key[SYSDB_TS_MAP_KEY_WORDS];
+    struct ts_map_flushed *flushed = NULL;
+    struct sysdb_ts_map_rec *rec;
+    struct sysdb_ts_map_rec copy;
+    uint32_t num_flushed = 0;
+    uint32_t first;
+    uint32_t last;
+    uint32_t i;
+    bool in_transaction = false;
+    bool locked = false;
+    errno_t ret;
+    int lret;
+
+    if (map == NULL || sysdb->ldb_ts == NULL) {
+        return EOK;
+    }
+
+    if (!ts_map_is_stale(map)
+            && __atomic_load_n(&map->hdr->dirty, __ATOMIC_RELAXED) == 0) {
+        return EOK;
+    }
+
+    lret = ldb_transaction_start(sysdb->ldb_ts);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = ts_map_lock(map);
+    if (ret != EOK) {
+        goto done;
+    }
+    locked = true;
+
+    if (map->hdr->dirty == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    first = 0;
+    last = map->num_slots;
+    if (dn != NULL) {
+        ts_map_key(dn, key);
+        rec = ts_map_probe(map->recs, map->num_slots, key);
+        if (rec == NULL || ts_map_rec_empty(rec)) {
+            ret = EOK;
+            goto done;
+        }
+        first = rec - map->recs;
+        last = first + 1;
+    }
+
+    flushed = talloc_array(NULL, struct ts_map_flushed, last - first);
+    if (flushed == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = first; i < last; i++) {
+        rec = &map->recs[i];
+        if (!(rec->flags & SYSDB_TS_MAP_REC_DIRTY)) {
+            continue;
+        }
+
+        if (!(rec->flags & SYSDB_TS_MAP_REC_VALID)) {
+            /* left behind by an interrupted write, the values are read
+             * from the timestamp ldb anyway */
+            copy = *rec;
+            copy.flags &= ~SYSDB_TS_MAP_REC_DIRTY;
+            ts_map_rec_store(rec, &copy);
+            map->hdr->dirty--;
+            continue;
+        }
+
+        copy = *rec;
+        ret = ts_map_write_back(sysdb->ldb_ts, &copy);
+        if (ret != EOK && ret != ENOENT) {
+            goto done;
+        }
+
+        flushed[num_flushed].idx = i;
+        flushed[num_flushed].gone = (ret == ENOENT);
+        num_flushed++;
+    }
+
+    lret = ldb_transaction_commit(sysdb->ldb_ts);
+    in_transaction = false;
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+
+    for (i = 0; i < num_flushed; i++) {
+        rec = &map->recs[flushed[i].idx];
+        copy = *rec;
+        copy.flags &= ~SYSDB_TS_MAP_REC_DIRTY;
+        if (flushed[i].gone) {
+            /* the entry was removed from the timestamp ldb */
+            copy.flags &= ~SYSDB_TS_MAP_REC_VALID;
+        }
+        ts_map_rec_store(rec, &copy);
+        map->hdr->dirty--;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Wrote back %u timestamp map records\n",
+          num_flushed);
+    ret = EOK;
+
+done:
+    if (locked) {
+        ts_map_unlock(map);
+    }
+    if (in_transaction) {
+        if (ret == EOK) {
+            lret = ldb_transaction_commit(sysdb->ldb_ts);
+            ret = sysdb_error_to_errno(lret);
+        } else {
+            ldb_transaction_cancel(sysdb->ldb_ts);
+        }
+    }
+    talloc_free(flushed);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "Cannot write back the timestamp map [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+    return ret;
+}
+
+int sysdb_ts_ldb_add(struct sysdb_ctx *sysdb, struct ldb_message *msg)
+{
+    return ts_map_write(sysdb, TS_MAP_ADD, msg->dn, msg);
+}
+
+int sysdb_ts_ldb_modify(struct sysdb_ctx *sysdb, struct ldb_message *msg)
+{
+    return ts_map_write(sysdb, TS_MAP_MODIFY, msg->dn, msg);
+}
+
+int sysdb_ts_ldb_delete(struct sysdb_ctx *sysdb, struct ldb_dn *dn)
+{
+    return ts_map_write(sysdb, TS_MAP_DELETE, dn, NULL);
+}
+
+static errno_t ts_map_add_value(struct ldb_message *msg,
+                                const char *attr,
+                                const char *value)
+{
+    struct ldb_message_element *el;
+    int ret;
+
+    ret = ldb_msg_add_empty(msg, attr, 0, &el);
+    if (ret != LDB_SUCCESS) {
+        return sysdb_error_to_errno(ret);
+    }
+
+    /* The values are stolen when merged into the sysdb message, so the
+     * data must be allocated on the values array like ldb does */
+    el->values = talloc_array(msg->elements, struct ldb_val, 1);
+    if (el->values == NULL) {
+        return ENOMEM;
+    }
+
+    el->values[0].data = (uint8_t *) talloc_strdup(el->values, value);
+    if (el->values[0].data == NULL) {
+        return ENOMEM;
+    }
+    el->values[0].length = strlen(value);
+    el->num_values = 1;
+
+    return EOK;
+}
+
+errno_t sysdb_ts_map_get(TALLOC_CTX *mem_ctx,
+                         struct sysdb_ts_map *map,
+                         struct ldb_dn *dn,
+                         struct ldb_message **_msg)
+{
+    uint32_t key[SYSDB_TS_MAP_KEY_WORDS];
+    struct sysdb_ts_map_rec rec;
+    struct ldb_message *msg;
+    uint32_t mask;
+    uint32_t idx;
+    uint32_t i;
+    errno_t ret;
+
+    if (ts_map_is_stale(map)) {
+        /* Attaching is rare, it's fine to take the lock for it */
+        ret = ts_map_lock(map);
+        if (ret != EOK) {
+            return ret;
+        }
+        ts_map_unlock(map);
+    }
+
+    ts_map_key(dn, key);
+    mask = map->num_slots - 1;
+
+    for (i = 0; i < map->num_slots; i++) {
+        idx = (key[1] + i) & mask;
+
+        ret = ts_map_rec_load(&map->recs[idx], &rec);
+        if (ret != EOK) {
+            return ret;
+        }
+
+        if (ts_map_rec_empty(&rec)) {
+            return ENOENT;
+        }
+
+        if (ts_map_rec_match(&rec, key)) {
+            break;
+        }
+    }
+
+    if (i == map->num_slots || !(rec.flags & SYSDB_TS_MAP_REC_VALID)) {
+        return ENOENT;
+    }
+
+    msg = ldb_msg_new(mem_ctx);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    msg->dn = ldb_dn_copy(msg, dn);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; ts_map_attrs[i] != NULL; i++) {
+        rec.values[i][SYSDB_TS_MAP_VALUE_SIZE - 1] = '\0';
+        if (rec.values[i][0] == '\0') {
+            continue;
+        }
+
+        ret = ts_map_add_value(msg, ts_map_attrs[i], rec.values[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    *_msg = msg;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(msg);
+    }
+    return ret;
+}
+
+errno_t sysdb_ts_map_open(TALLOC_CTX *mem_ctx,
+                          const char *ts_file,
+                          struct sysdb_ts_map **_map)
+{
+    struct sysdb_ts_map *map;
+    errno_t ret;
+
+    map = talloc_zero(mem_ctx, struct sysdb_ts_map);
+    if (map == NULL) {
+        return ENOMEM;
+    }
+    map->fd = -1;
+    talloc_set_destructor(map, ts_map_destructor);
+
+    map->ts_file = talloc_strdup(map, ts_file);
+    map->file = talloc_asprintf(map, "%s"SYSDB_TS_MAP_SUFFIX, ts_file);
+    if (map->ts_file == NULL || map->file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ts_map_lock(map);
+    if (ret != EOK) {
+        goto done;
+    }
+    ts_map_unlock(map);
+
+    *_map = map;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(map);
+    }
+    return ret;
+}
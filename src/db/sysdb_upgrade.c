@@ -136,6 +136,203 @@ static int finish_upgrade(int ret, struct upgrade_ctx **ctx, const char **ver)
     return ret;
 }
 
+/* Records that are not returned by a subtree search but must be carried
+ * over to keep the schema, indexes and modules of the database. */
+static const char *sysdb_special_records[] = {
+    "@ATTRIBUTES",
+    "@INDEXLIST",
+    "@MODULES",
+    NULL
+};
+
+static errno_t sysdb_copy_records(TALLOC_CTX *mem_ctx,
+                                  struct ldb_context *src,
+                                  struct ldb_context *dst,
+                                  struct ldb_dn *base,
+                                  enum ldb_scope scope,
+                                  size_t *_count)
+{
+    struct ldb_result *res;
+    size_t i;
+    int ret;
+
+    ret = ldb_search(src, mem_ctx, &res, base, scope, NULL, NULL);
+    if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+        *_count = 0;
+        return EOK;
+    } else if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to read records [%d]: %s\n",
+              ret, ldb_errstring(src));
+        return sysdb_error_to_errno(ret);
+    }
+
+    for (i = 0; i < res->count; i++) {
+        /* Added by ldb to every search result, it is not stored */
+        ldb_msg_remove_attr(res->msgs[i], "distinguishedName");
+
+        ret = ldb_add(dst, res->msgs[i]);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to copy [%s] [%d]: %s\n",
+                  ldb_dn_get_linearized(res->msgs[i]->dn),
+                  ret, ldb_errstring(dst));
+            talloc_free(res);
+            return sysdb_error_to_errno(ret);
+        }
+    }
+
+    *_count = res->count;
+    talloc_free(res);
+    return EOK;
+}
+
+/* Store the database in a different ldb backend. The records are copied to
+ * a new file, which then replaces the original one. */
+int sysdb_upgrade_backend(const char *ldb_file,
+                          enum sss_cache_backend backend)
+{
+    /* Copy the records verbatim, without running them through memberof
+     * and the other modules listed in @MODULES. */
+    const char *raw_options[] = { "modules:", NULL };
+    enum sss_cache_backend current;
+    struct ldb_context *src = NULL;
+    struct ldb_context *dst = NULL;
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_dn *dn;
+    char *new_file = NULL;
+    char *lock_file;
+    bool in_transaction = false;
+    size_t count;
+    size_t total = 0;
+    errno_t ret;
+    int lret;
+    int i;
+
+    ret = sysdb_get_db_file_backend(ldb_file, &current);
+    if (ret == ENOENT) {
+        /* Nothing to convert, the file is created with the new backend */
+        return EOK;
+    } else if (ret != EOK) {
+        return ret;
+    }
+
+    if (current == backend) {
+        return EOK;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "CONVERTING %s FROM %s TO %s\n", ldb_file,
+          sysdb_cache_backend_str(current), sysdb_cache_backend_str(backend));
+
+    new_file = talloc_asprintf(tmp_ctx, "%s.convert", ldb_file);
+    if (new_file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Leftover from an interrupted conversion */
+    ret = sysdb_remove_db_file(new_file);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_ldb_connect_ext(tmp_ctx, ldb_file, current,
+                                LDB_FLG_DONT_CREATE_DB, NULL, &src);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_ldb_connect_ext(tmp_ctx, new_file, backend,
+                                0, raw_options, &dst);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    lret = ldb_transaction_start(dst);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+    in_transaction = true;
+
+    for (i = 0; sysdb_special_records[i] != NULL; i++) {
+        dn = ldb_dn_new(tmp_ctx, src, sysdb_special_records[i]);
+        if (dn == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sysdb_copy_records(tmp_ctx, src, dst, dn, LDB_SCOPE_BASE,
+                                 &count);
+        if (ret != EOK) {
+            goto done;
+        }
+        talloc_free(dn);
+    }
+
+    ret = sysdb_copy_records(tmp_ctx, src, dst, NULL, LDB_SCOPE_SUBTREE,
+                             &total);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    lret = ldb_transaction_commit(dst);
+    if (lret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(lret);
+        goto done;
+    }
+    in_transaction = false;
+
+    /* Close both databases before replacing the file */
+    talloc_zfree(dst);
+    talloc_zfree(src);
+
+    ret = rename(new_file, ldb_file);
+    if (ret != 0) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to rename %s to %s [%d]: %s\n",
+              new_file, ldb_file, ret, sss_strerror(ret));
+        goto done;
+    }
+
+    /* Lock files of both the old and the temporary file are stale now */
+    lock_file = talloc_asprintf(tmp_ctx, "%s"SYSDB_MDB_LOCK_SUFFIX, ldb_file);
+    if (lock_file == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    ret = unlink(lock_file);
+    if (ret != 0 && errno != ENOENT) {
+        ret = errno;
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to remove %s [%d]: %s\n",
+              lock_file, ret, sss_strerror(ret));
+    }
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "Converted %zu entries of %s to %s\n",
+          total, ldb_file, sysdb_cache_backend_str(backend));
+
+    ret = EOK;
+
+done:
+    if (in_transaction) {
+        lret = ldb_transaction_cancel(dst);
+        if (lret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Could not cancel transaction! [%s]\n",
+                  ldb_strerror(lret));
+        }
+    }
+    talloc_zfree(dst);
+    talloc_zfree(src);
+    if (new_file != NULL && sysdb_remove_db_file(new_file) != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to remove %s\n", new_file);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 /* serach all groups that have a memberUid attribute.
  * change it into a member attribute for a user of same domain.
  * remove the memberUid attribute
@@ -2718,6 +2915,58 @@ done:
     return ret;
 }
 
+int sysdb_upgrade_23(struct sysdb_ctx *sysdb, const char **ver)
+{
+    struct upgrade_ctx *ctx;
+    errno_t ret;
+    struct ldb_message *msg = NULL;
+
+    ret = commence_upgrade(sysdb, sysdb->ldb, SYSDB_VERSION_0_24, &ctx);
+    if (ret) {
+        return ret;
+    }
+
+    /* Groups with members in the ghost store are searched on lookups */
+    msg = ldb_msg_new(ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = ldb_dn_new(msg, sysdb->ldb, "@INDEXLIST");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_empty(msg, "@IDXATTR", LDB_FLAG_MOD_ADD, NULL);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, "@IDXATTR", SYSDB_GHOST_STORE);
+    if (ret != LDB_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_modify(sysdb->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        ret = sysdb_error_to_errno(ret);
+        goto done;
+    }
+
+    talloc_free(msg);
+
+    /* conversion done, update version number */
+    ret = update_version(ctx);
+
+done:
+    ret = finish_upgrade(ret, &ctx, ver);
+    return ret;
+}
+
 int sysdb_ts_upgrade_01(struct sysdb_ctx *sysdb, const char **ver)
 {
     struct upgrade_ctx *ctx;
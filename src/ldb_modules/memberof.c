@@ -73,12 +73,15 @@ struct mbof_add_operation {
 struct mbof_memberuid_op {
     struct ldb_dn *dn;
     struct ldb_message_element *el;
+    hash_table_t *values;
 };
 
 struct mbof_add_ctx {
     struct mbof_ctx *ctx;
 
     struct mbof_add_operation *add_list;
+    struct mbof_add_operation *add_tail;
+    hash_table_t *add_index;
     struct mbof_add_operation *current_op;
 
     struct ldb_message *msg;
@@ -88,6 +91,7 @@ struct mbof_add_ctx {
     struct mbof_dn *missing;
 
     struct mbof_memberuid_op *muops;
+    hash_table_t *muop_index;
     int num_muops;
     int cur_muop;
 };
@@ -123,16 +127,18 @@ struct mbof_del_ctx {
     struct mbof_ctx *ctx;
 
     struct mbof_del_operation *first;
-    struct mbof_dn *history;
+    hash_table_t *history;
 
     struct ldb_message **mus;
     int num_mus;
 
     struct mbof_memberuid_op *muops;
+    hash_table_t *muop_index;
     int num_muops;
     int cur_muop;
 
     struct mbof_memberuid_op *ghops;
+    hash_table_t *ghop_index;
     int num_ghops;
     int cur_ghop;
 
@@ -193,6 +199,88 @@ static void hash_free(void *ptr, void *pvt)
     talloc_free(ptr);
 }
 
+/* Sets of strings, used to avoid quadratic scans when groups have many
+ * members. DNs are stored in their casefolded form so that a lookup matches
+ * what ldb_dn_compare() would consider equal. */
+static int mbof_set_create(TALLOC_CTX *memctx, hash_table_t **_set)
+{
+    int ret;
+
+    ret = hash_create_ex(0, _set, 0, 0, 0, 0,
+                         hash_alloc, hash_free, memctx, NULL, NULL);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    return LDB_SUCCESS;
+}
+
+static int mbof_set_add(hash_table_t *set, const char *str, bool *_added)
+{
+    hash_value_t value;
+    hash_key_t key;
+    int ret;
+
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(str);
+
+    if (hash_has_key(set, &key)) {
+        *_added = false;
+        return LDB_SUCCESS;
+    }
+
+    value.type = HASH_VALUE_UNDEF;
+    ret = hash_enter(set, &key, &value);
+    if (ret != HASH_SUCCESS) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    *_added = true;
+    return LDB_SUCCESS;
+}
+
+static const char *mbof_dn_key(struct ldb_dn *dn)
+{
+    const char *key;
+
+    if (!dn) {
+        return NULL;
+    }
+
+    key = ldb_dn_get_casefold(dn);
+    if (!key) {
+        /* invalid DNs can only match themselves */
+        key = ldb_dn_get_linearized(dn);
+    }
+
+    return key;
+}
+
+static int mbof_set_add_dn(hash_table_t *set, struct ldb_dn *dn, bool *_added)
+{
+    const char *str;
+
+    str = mbof_dn_key(dn);
+    if (!str) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    return mbof_set_add(set, str, _added);
+}
+
+static bool mbof_set_has_dn(hash_table_t *set, struct ldb_dn *dn)
+{
+    hash_key_t key;
+
+    key.str = discard_const(mbof_dn_key(dn));
+    if (!key.str) {
+        return false;
+    }
+    key.type = HASH_KEY_STRING;
+
+    return hash_has_key(set, &key);
+}
+
 static int entry_has_objectclass(struct ldb_message *entry,
                                  const char *objectclass)
 {
@@ -228,6 +316,7 @@ static int entry_is_group_object(struct ldb_message *entry)
 static int mbof_append_muop(TALLOC_CTX *memctx,
                             struct mbof_memberuid_op **_muops,
                             int *_num_muops,
+                            hash_table_t **_index,
                             int flags,
                             struct ldb_dn *parent,
                             const char *name,
@@ -237,18 +326,36 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
     int num_muops = *_num_muops;
     struct mbof_memberuid_op *op;
     struct ldb_val *val;
-    int i;
+    const char *dn_key;
+    hash_value_t value;
+    hash_key_t key;
+    size_t size;
+    bool added;
+    int ret;
 
-    op = NULL;
-    if (muops) {
-        for (i = 0; i < num_muops; i++) {
-            if (ldb_dn_compare(parent, muops[i].dn) == 0) {
-                op = &muops[i];
-                break;
-            }
+    dn_key = mbof_dn_key(parent);
+    if (!dn_key) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    if (!*_index) {
+        ret = mbof_set_create(memctx, _index);
+        if (ret != LDB_SUCCESS) {
+            return ret;
         }
     }
-    if (!op) {
+
+    /* the index maps each parent to its position in the muops array */
+    key.type = HASH_KEY_STRING;
+    key.str = discard_const(dn_key);
+
+    ret = hash_lookup(*_index, &key, &value);
+    switch (ret) {
+    case HASH_SUCCESS:
+        op = &muops[value.ul];
+        break;
+
+    case HASH_ERROR_KEY_NOT_FOUND:
         muops = talloc_realloc(memctx, muops,
                                struct mbof_memberuid_op,
                                num_muops + 1);
@@ -256,12 +363,25 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
             return LDB_ERR_OPERATIONS_ERROR;
         }
         op = &muops[num_muops];
+
+        value.type = HASH_VALUE_ULONG;
+        value.ul = num_muops;
+        ret = hash_enter(*_index, &key, &value);
+        if (ret != HASH_SUCCESS) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+
         num_muops++;
         *_muops = muops;
         *_num_muops = num_muops;
 
         op->dn = parent;
         op->el = NULL;
+        op->values = NULL;
+        break;
+
+    default:
+        return LDB_ERR_OPERATIONS_ERROR;
     }
 
     if (!op->el) {
@@ -274,27 +394,40 @@ static int mbof_append_muop(TALLOC_CTX *memctx,
             return LDB_ERR_OPERATIONS_ERROR;
         }
         op->el->flags = flags;
-    }
 
-    for (i = 0; i < op->el->num_values; i++) {
-        if (strcmp((char *)op->el->values[i].data, name) == 0) {
-            /* we already have this value, get out*/
-            return LDB_SUCCESS;
+        ret = mbof_set_create(op->el, &op->values);
+        if (ret != LDB_SUCCESS) {
+            return ret;
         }
     }
 
-    val = talloc_realloc(op->el, op->el->values,
-                         struct ldb_val, op->el->num_values + 1);
-    if (!val) {
-        return LDB_ERR_OPERATIONS_ERROR;
+    ret = mbof_set_add(op->values, name, &added);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+    if (!added) {
+        /* we already have this value, get out*/
+        return LDB_SUCCESS;
     }
+
+    /* grow geometrically, large groups get one value per member */
+    size = talloc_array_length(op->el->values);
+    if (op->el->num_values == size) {
+        val = talloc_realloc(op->el, op->el->values,
+                             struct ldb_val, MAX(2 * size, 4));
+        if (!val) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+        op->el->values = val;
+    }
+    val = op->el->values;
+
     val[op->el->num_values].data = (uint8_t *)talloc_strdup(val, name);
     if (!val[op->el->num_values].data) {
         return LDB_ERR_OPERATIONS_ERROR;
     }
     val[op->el->num_values].length = strlen(name);
 
-    op->el->values = val;
     op->el->num_values++;
 
     return LDB_SUCCESS;
@@ -346,25 +479,26 @@ static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
                              struct mbof_dn_array *parents,
                              struct ldb_dn *entry_dn)
 {
-    struct mbof_add_operation *lastop = NULL;
     struct mbof_add_operation *addop;
+    bool added;
+    int ret;
 
-    /* test if this is a duplicate */
-    /* FIXME: this is not efficient */
-    if (add_ctx->add_list) {
-        do {
-            if (lastop) {
-                lastop = lastop->next;
-            } else {
-                lastop = add_ctx->add_list;
-            }
+    if (!add_ctx->add_index) {
+        ret = mbof_set_create(add_ctx, &add_ctx->add_index);
+        if (ret != LDB_SUCCESS) {
+            return ret;
+        }
+    }
 
-            /* FIXME: check if this is right, might have to compare parents */
-            if (ldb_dn_compare(lastop->entry_dn, entry_dn) == 0) {
-                /* duplicate found */
-                return LDB_SUCCESS;
-            }
-        } while (lastop->next);
+    /* test if this is a duplicate */
+    /* FIXME: check if this is right, might have to compare parents */
+    ret = mbof_set_add_dn(add_ctx->add_index, entry_dn, &added);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+    if (!added) {
+        /* duplicate found */
+        return LDB_SUCCESS;
     }
 
     addop = talloc_zero(add_ctx, struct mbof_add_operation);
@@ -376,11 +510,12 @@ static int mbof_append_addop(struct mbof_add_ctx *add_ctx,
     addop->parents = parents;
     addop->entry_dn = entry_dn;
 
-    if (add_ctx->add_list) {
-        lastop->next = addop;
+    if (add_ctx->add_tail) {
+        add_ctx->add_tail->next = addop;
     } else {
         add_ctx->add_list = addop;
     }
+    add_ctx->add_tail = addop;
 
     return LDB_SUCCESS;
 }
@@ -423,6 +558,7 @@ static int mbof_add_fill_ghop_ex(struct mbof_add_ctx *add_ctx,
         for (j = 0; j < num_gh_vals; j++) {
             ret = mbof_append_muop(add_ctx, &add_ctx->muops,
                                    &add_ctx->num_muops,
+                                   &add_ctx->muop_index,
                                    LDB_FLAG_MOD_ADD,
                                    parents->dns[i],
                                    (const char *) ghvals[j].data,
@@ -777,6 +913,8 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
     struct ldb_dn *elval_dn;
     struct ldb_dn *valdn;
     struct mbof_dn_array *parents;
+    hash_table_t *memberofs;
+    bool added;
     int i, j, ret;
     const char *val;
     const char *name;
@@ -813,6 +951,12 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
         tmp_ctx = talloc_new(addop);
         if (!tmp_ctx) return LDB_ERR_OPERATIONS_ERROR;
 
+        ret = mbof_set_create(tmp_ctx, &memberofs);
+        if (ret != LDB_SUCCESS) {
+            talloc_free(tmp_ctx);
+            return ret;
+        }
+
         for (i = 0; i < el->num_values; i++) {
             elval_dn = ldb_dn_from_ldb_val(tmp_ctx, ldb, &el->values[i]);
             if (!elval_dn) {
@@ -821,20 +965,22 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
                 talloc_free(tmp_ctx);
                 return LDB_ERR_OPERATIONS_ERROR;
             }
-            for (j = 0; j < parents->num; j++) {
-                if (ldb_dn_compare(parents->dns[j], elval_dn) == 0) {
-                    /* duplicate found */
-                    break;
-                }
+            ret = mbof_set_add_dn(memberofs, elval_dn, &added);
+            if (ret != LDB_SUCCESS) {
+                talloc_free(tmp_ctx);
+                return ret;
             }
-            if (j < parents->num) {
-                /* remove duplicate */
-                for (;j+1 < parents->num; j++) {
-                    parents->dns[j] = parents->dns[j+1];
-                }
-                parents->num--;
+        }
+
+        /* remove duplicates */
+        for (i = 0, j = 0; i < parents->num; i++) {
+            if (mbof_set_has_dn(memberofs, parents->dns[i])) {
+                continue;
             }
+            parents->dns[j] = parents->dns[i];
+            j++;
         }
+        parents->num = j;
 
         if (parents->num == 0) {
             /* already contains all parents as memberof, skip to next */
@@ -895,6 +1041,7 @@ static int mbof_add_operation(struct mbof_add_operation *addop)
         for (i = 0; i < parents->num; i++) {
             ret = mbof_append_muop(add_ctx, &add_ctx->muops,
                                    &add_ctx->num_muops,
+                                   &add_ctx->muop_index,
                                    LDB_FLAG_MOD_ADD,
                                    parents->dns[i], name,
                                    DB_MEMBERUID);
@@ -2233,6 +2380,7 @@ static int mbof_del_mod_entry(struct mbof_del_operation *delop)
         for (i = 0; diff[i]; i++) {
             ret = mbof_append_muop(del_ctx, &del_ctx->muops,
                                    &del_ctx->num_muops,
+                                   &del_ctx->muop_index,
                                    LDB_FLAG_MOD_DELETE,
                                    diff[i], name,
                                    DB_MEMBERUID);
@@ -2382,23 +2530,22 @@ static int mbof_del_get_next(struct mbof_del_operation *delop,
 {
     struct mbof_del_operation *top, *cop;
     struct mbof_del_ctx *del_ctx;
-    struct mbof_dn *save, *tmp;
+    bool added;
+    int ret;
 
     del_ctx = delop->del_ctx;
 
     /* first of all, save the current delop in the history */
-    save = talloc_zero(del_ctx, struct mbof_dn);
-    if (!save) {
-        return LDB_ERR_OPERATIONS_ERROR;
+    if (!del_ctx->history) {
+        ret = mbof_set_create(del_ctx, &del_ctx->history);
+        if (ret != LDB_SUCCESS) {
+            return ret;
+        }
     }
-    save->dn = delop->entry_dn;
 
-    if (del_ctx->history) {
-        tmp = del_ctx->history;
-        while (tmp->next) tmp = tmp->next;
-        tmp->next = save;
-    } else {
-        del_ctx->history = save;
+    ret = mbof_set_add_dn(del_ctx->history, delop->entry_dn, &added);
+    if (ret != LDB_SUCCESS) {
+        return ret;
     }
 
     /* Find next one */
@@ -2413,12 +2560,7 @@ static int mbof_del_get_next(struct mbof_del_operation *delop,
             top->next_child++;
 
             /* verify this operation has not already been performed */
-            for (tmp = del_ctx->history; tmp; tmp = tmp->next) {
-                if (ldb_dn_compare(tmp->dn, cop->entry_dn) == 0) {
-                    break;
-                }
-            }
-            if (tmp == NULL) {
+            if (!mbof_set_has_dn(del_ctx->history, cop->entry_dn)) {
                 /* and return the current one */
                 *nextop = cop;
                 return LDB_SUCCESS;
@@ -2481,6 +2623,7 @@ static int mbof_del_fill_muop(struct mbof_del_ctx *del_ctx,
 
         ret = mbof_append_muop(del_ctx, &del_ctx->muops,
                                &del_ctx->num_muops,
+                               &del_ctx->muop_index,
                                LDB_FLAG_MOD_DELETE,
                                valdn, name,
                                DB_MEMBERUID);
@@ -2548,6 +2691,7 @@ static int mbof_del_fill_ghop_ex(struct mbof_del_ctx *del_ctx,
         for (j = 0; j < num_gh_vals; j++) {
             ret = mbof_append_muop(del_ctx, &del_ctx->ghops,
                                    &del_ctx->num_ghops,
+                                   &del_ctx->ghop_index,
                                    LDB_FLAG_MOD_DELETE,
                                    valdn,
                                    (const char *) ghvals[j].data,
@@ -3419,6 +3563,70 @@ static int mbof_mod_process(struct mbof_mod_ctx *mod_ctx, bool *done)
     return LDB_SUCCESS;
 }
 
+/* Removes the DNs present in both arrays from both of them, the order of
+ * the remaining DNs is preserved */
+static int mbof_dn_array_remove_common(struct mbof_dn_array *a,
+                                       struct mbof_dn_array *b)
+{
+    TALLOC_CTX *tmp_ctx;
+    hash_table_t *in_b;
+    hash_table_t *common;
+    bool added;
+    int i, n;
+    int ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (!tmp_ctx) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    ret = mbof_set_create(tmp_ctx, &in_b);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
+
+    ret = mbof_set_create(tmp_ctx, &common);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
+
+    for (i = 0; i < b->num; i++) {
+        ret = mbof_set_add_dn(in_b, b->dns[i], &added);
+        if (ret != LDB_SUCCESS) {
+            goto done;
+        }
+    }
+
+    for (i = 0, n = 0; i < a->num; i++) {
+        if (mbof_set_has_dn(in_b, a->dns[i])) {
+            /* preexisting one, not removed, nor added */
+            ret = mbof_set_add_dn(common, a->dns[i], &added);
+            if (ret != LDB_SUCCESS) {
+                goto done;
+            }
+            continue;
+        }
+        a->dns[n] = a->dns[i];
+        n++;
+    }
+    a->num = n;
+
+    for (i = 0, n = 0; i < b->num; i++) {
+        if (mbof_set_has_dn(common, b->dns[i])) {
+            continue;
+        }
+        b->dns[n] = b->dns[i];
+        n++;
+    }
+    b->num = n;
+
+    ret = LDB_SUCCESS;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
                                    struct ldb_context *ldb,
                                    struct ldb_message *entry,
@@ -3429,7 +3637,7 @@ static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
     const struct ldb_message_element *el;
     struct mbof_dn_array *removed = NULL;
     struct mbof_dn_array *added = NULL;
-    int i, j, ret;
+    int ret;
 
     if (!membel) {
         /* Nothing to do.. */
@@ -3487,24 +3695,11 @@ static int mbof_mod_process_membel(TALLOC_CTX *mem_ctx,
 
         /* remove from arrays values that ended up unchanged */
         if (removed && removed->num && added && added->num) {
-            for (i = 0; i < added->num; i++) {
-                for (j = 0; j < removed->num; j++) {
-                    if (ldb_dn_compare(added->dns[i], removed->dns[j]) == 0) {
-                        break;
-                    }
-                }
-                if (j < removed->num) {
-                    /* preexisting one, not removed, nor added */
-                    for (; j+1 < removed->num; j++) {
-                        removed->dns[j] = removed->dns[j+1];
-                    }
-                    removed->num--;
-                    for (j = i; j+1 < added->num; j++) {
-                        added->dns[j] = added->dns[j+1];
-                    }
-                    added->num--;
-                    i--;
-                }
+            ret = mbof_dn_array_remove_common(added, removed);
+            if (ret != LDB_SUCCESS) {
+                talloc_free(added);
+                talloc_free(removed);
+                return ret;
             }
         }
         break;
@@ -3849,26 +4044,66 @@ static int mbof_fill_vals_array_el(TALLOC_CTX *memctx,
  * Cleanup task routines *
  *************************/
 
+/* The cleanup task rebuilds memberof and memberuid for all entries.
+ *
+ * All users and groups are loaded into an in-memory graph where each entry
+ * points to the groups it is a direct member of. The closure of an entry,
+ * i.e. the set of all groups it is a direct or indirect member of, is then
+ * computed by visiting the strongly connected components of the graph in
+ * topological order: groups nested in a loop are all members of each other
+ * and share the same closure, and every closure is computed only once, from
+ * the already final closures of its parents. The closures of users are
+ * computed last from the closures of their groups.
+ *
+ * Only entries whose memberof or memberuid values differ from the computed
+ * ones are modified, so running the task on a consistent cache does not
+ * write anything.
+ *
+ * The graph is only used by this task. The add, modify and delete handlers
+ * still walk the affected entries with their own request chains:
+ * - the module keeps no state between requests, so the graph would have to
+ *   be loaded for every membership change, which costs more than the walk
+ *   for the common small change,
+ * - the ghost attribute does not record whether a group owns a value or
+ *   inherited it, so the ghost values of the ancestors of a removed member
+ *   cannot be derived from a partial graph.
+ * The add walk visits every descendant once and stops at entries that
+ * already have all new parents, so it only touches the entries that change.
+ */
+
+struct mbof_closure {
+    int *groups;
+    int num;
+};
+
 struct mbof_member {
     struct mbof_member *prev;
     struct mbof_member *next;
 
     struct ldb_dn *dn;
     const char *name;
-    bool orig_has_memberof;
-    bool orig_has_memberuid;
+    bool is_user;
+    int idx;
+
+    struct ldb_message_element *orig_memberofs;
+    struct ldb_message_element *orig_memberuids;
     struct ldb_message_element *orig_members;
 
     struct mbof_member **members;
+    int num_members;
 
-    hash_table_t *memberofs;
+    struct mbof_member **parents;
+    int num_parents;
 
-    struct ldb_message_element *memuids;
+    struct mbof_closure *closure;
 
-    enum { MBOF_GROUP_TO_DO = 0,
-           MBOF_GROUP_DONE,
-           MBOF_USER,
-           MBOF_ITER_ERROR } status;
+    const char **memuids;
+    int num_memuids;
+
+    /* strongly connected components search state */
+    int scc_index;
+    int scc_lowlink;
+    bool on_stack;
 };
 
 struct mbof_rcmp_context {
@@ -3880,6 +4115,20 @@ struct mbof_rcmp_context {
 
     struct mbof_member *group_list;
     hash_table_t *group_table;
+
+    struct mbof_member **groups;
+    int num_groups;
+};
+
+struct mbof_scc_state {
+    struct mbof_member **stack;
+    int stack_num;
+
+    struct mbof_member **path;
+    int *path_edge;
+    int path_num;
+
+    int index;
 };
 
 static int mbof_steal_msg_el(TALLOC_CTX *memctx,
@@ -3908,15 +4157,31 @@ static int mbof_steal_msg_el(TALLOC_CTX *memctx,
     return LDB_SUCCESS;
 }
 
+static int mbof_steal_opt_msg_el(TALLOC_CTX *memctx,
+                                 const char *name,
+                                 struct ldb_message *msg,
+                                 struct ldb_message_element **_dest)
+{
+    int ret;
+
+    ret = mbof_steal_msg_el(memctx, name, msg, _dest);
+    if (ret == LDB_ERR_NO_SUCH_ATTRIBUTE) {
+        *_dest = NULL;
+        return LDB_SUCCESS;
+    }
+
+    return ret;
+}
+
 static int mbof_rcmp_usr_callback(struct ldb_request *req,
                                   struct ldb_reply *ares);
 static int mbof_rcmp_search_groups(struct mbof_rcmp_context *ctx);
 static int mbof_rcmp_grp_callback(struct ldb_request *req,
                                   struct ldb_reply *ares);
-static int mbof_member_update(struct mbof_rcmp_context *ctx,
-                              struct mbof_member *parent,
-                              struct mbof_member *mem);
-static bool mbof_member_iter(hash_entry_t *item, void *user_data);
+static int mbof_rcmp_build_graph(struct mbof_rcmp_context *ctx);
+static int mbof_rcmp_closures(struct mbof_rcmp_context *ctx);
+static int mbof_rcmp_closure(TALLOC_CTX *memctx,
+                             struct mbof_member **set, int num);
 static int mbof_add_memuid(struct mbof_member *grp, const char *user);
 static int mbof_rcmp_update(struct mbof_rcmp_context *ctx);
 static int mbof_rcmp_mod_callback(struct ldb_request *req,
@@ -3988,15 +4253,18 @@ static int mbof_rcmp_usr_callback(struct ldb_request *req,
                                    LDB_ERR_OPERATIONS_ERROR);
         }
 
-        usr->status = MBOF_USER;
+        usr->is_user = true;
         usr->dn = talloc_steal(usr, ares->message->dn);
         name = ldb_msg_find_attr_as_string(ares->message, DB_NAME, NULL);
         if (name) {
             usr->name = talloc_steal(usr, name);
         }
 
-        if (ldb_msg_find_element(ares->message, DB_MEMBEROF)) {
-            usr->orig_has_memberof = true;
+        ret = mbof_steal_opt_msg_el(usr, DB_MEMBEROF,
+                                    ares->message, &usr->orig_memberofs);
+        if (ret != LDB_SUCCESS) {
+            return ldb_module_done(ctx->req, NULL, NULL,
+                                   LDB_ERR_OPERATIONS_ERROR);
         }
 
         DLIST_ADD(ctx->user_list, usr);
@@ -4059,19 +4327,16 @@ static int mbof_rcmp_search_groups(struct mbof_rcmp_context *ctx)
 static int mbof_rcmp_grp_callback(struct ldb_request *req,
                                   struct ldb_reply *ares)
 {
-    struct ldb_context *ldb;
     struct mbof_rcmp_context *ctx;
-    struct ldb_message_element *el;
-    struct mbof_member *iter;
+    struct mbof_member *usr;
     struct mbof_member *grp;
     hash_value_t value;
     hash_key_t key;
     const char *name;
-    int i, j;
+    int i;
     int ret;
 
     ctx = talloc_get_type(req->context, struct mbof_rcmp_context);
-    ldb = ldb_module_get_ctx(ctx->module);
 
     if (!ares) {
         return ldb_module_done(ctx->req, NULL, NULL,
@@ -4093,25 +4358,30 @@ static int mbof_rcmp_grp_callback(struct ldb_request *req,
                                    LDB_ERR_OPERATIONS_ERROR);
         }
 
-        grp->status = MBOF_GROUP_TO_DO;
+        grp->is_user = false;
         grp->dn = talloc_steal(grp, ares->message->dn);
-        grp->name = ldb_msg_find_attr_as_string(ares->message, DB_NAME, NULL);
         name = ldb_msg_find_attr_as_string(ares->message, DB_NAME, NULL);
         if (name) {
             grp->name = talloc_steal(grp, name);
         }
 
-        if (ldb_msg_find_element(ares->message, DB_MEMBEROF)) {
-            grp->orig_has_memberof = true;
+        ret = mbof_steal_opt_msg_el(grp, DB_MEMBEROF,
+                                    ares->message, &grp->orig_memberofs);
+        if (ret != LDB_SUCCESS) {
+            return ldb_module_done(ctx->req, NULL, NULL,
+                                   LDB_ERR_OPERATIONS_ERROR);
         }
 
-        if (ldb_msg_find_element(ares->message, DB_MEMBERUID)) {
-            grp->orig_has_memberuid = true;
+        ret = mbof_steal_opt_msg_el(grp, DB_MEMBERUID,
+                                    ares->message, &grp->orig_memberuids);
+        if (ret != LDB_SUCCESS) {
+            return ldb_module_done(ctx->req, NULL, NULL,
+                                   LDB_ERR_OPERATIONS_ERROR);
         }
 
-        ret = mbof_steal_msg_el(grp, DB_MEMBER,
-                                ares->message, &grp->orig_members);
-        if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_ATTRIBUTE) {
+        ret = mbof_steal_opt_msg_el(grp, DB_MEMBER,
+                                    ares->message, &grp->orig_members);
+        if (ret != LDB_SUCCESS) {
             return ldb_module_done(ctx->req, NULL, NULL,
                                    LDB_ERR_OPERATIONS_ERROR);
         }
@@ -4143,87 +4413,34 @@ static int mbof_rcmp_grp_callback(struct ldb_request *req,
             return ldb_module_done(ctx->req, NULL, NULL, LDB_SUCCESS);
         }
 
-        /* for each group compute the members list */
-        for (iter = ctx->group_list; iter; iter = iter->next) {
-
-            el = iter->orig_members;
-            if (!el || el->num_values == 0) {
-                /* no members */
-                continue;
-            }
-
-            /* we have at most num_values group members */
-            iter->members = talloc_array(iter, struct mbof_member *,
-                                         el->num_values +1);
-            if (!iter->members) {
-                return ldb_module_done(ctx->req, NULL, NULL,
-                                       LDB_ERR_OPERATIONS_ERROR);
-            }
-
-            for (i = 0, j = 0; i < el->num_values; i++) {
-                key.type = HASH_KEY_STRING;
-                key.str = (char *)el->values[i].data;
-
-                ret = hash_lookup(ctx->user_table, &key, &value);
-                switch (ret) {
-                case HASH_SUCCESS:
-                    iter->members[j] = (struct mbof_member *)value.ptr;
-                    j++;
-                    break;
-
-                case HASH_ERROR_KEY_NOT_FOUND:
-                    /* not a user, see if it is a group */
-
-                    ret = hash_lookup(ctx->group_table, &key, &value);
-                    if (ret != HASH_SUCCESS) {
-                        if (ret != HASH_ERROR_KEY_NOT_FOUND) {
-                            return ldb_module_done(ctx->req, NULL, NULL,
-                                                   LDB_ERR_OPERATIONS_ERROR);
-                        }
-                    }
-                    if (ret == HASH_ERROR_KEY_NOT_FOUND) {
-                        /* not a known user, nor a known group!?
-                           give a warning and continue */
-                        ldb_debug(ldb, LDB_DEBUG_ERROR,
-                                  "member attribute [%s] has no corresponding"
-                                  " entry!", key.str);
-                        break;
-                    }
-
-                    iter->members[j] = (struct mbof_member *)value.ptr;
-                    j++;
-                    break;
-
-                default:
-                    return ldb_module_done(ctx->req, NULL, NULL,
-                                           LDB_ERR_OPERATIONS_ERROR);
-                }
-            }
-            /* terminate */
-            iter->members[j] = NULL;
-
-            talloc_zfree(iter->orig_members);
+        ret = mbof_rcmp_build_graph(ctx);
+        if (ret != LDB_SUCCESS) {
+            return ldb_module_done(ctx->req, NULL, NULL, ret);
         }
 
-        /* now generate correct memberof tables */
-        while (ctx->group_list->status == MBOF_GROUP_TO_DO) {
-
-            grp = ctx->group_list;
+        /* compute the closures of all groups */
+        ret = mbof_rcmp_closures(ctx);
+        if (ret != LDB_SUCCESS) {
+            return ldb_module_done(ctx->req, NULL, NULL, ret);
+        }
 
-            /* move to end of list and mark as done.
-             * NOTE: this is not efficient, but will do for now */
-            DLIST_DEMOTE(ctx->group_list, grp, struct mbof_member *);
-            grp->status = MBOF_GROUP_DONE;
+        /* then the closures of users, which also give the memberuid
+         * values of the groups */
+        for (usr = ctx->user_list; usr; usr = usr->next) {
+            ret = mbof_rcmp_closure(usr, &usr, 1);
+            if (ret != LDB_SUCCESS) {
+                return ldb_module_done(ctx->req, NULL, NULL, ret);
+            }
 
-            /* verify if members need updating */
-            if (!grp->members) {
+            if (!usr->name) {
                 continue;
             }
-            for (i = 0; grp->members[i]; i++) {
-                ret = mbof_member_update(ctx, grp, grp->members[i]);
+
+            for (i = 0; i < usr->closure->num; i++) {
+                ret = mbof_add_memuid(ctx->groups[usr->closure->groups[i]],
+                                      usr->name);
                 if (ret != LDB_SUCCESS) {
-                    return ldb_module_done(ctx->req, NULL, NULL,
-                                           LDB_ERR_OPERATIONS_ERROR);
+                    return ldb_module_done(ctx->req, NULL, NULL, ret);
                 }
             }
         }
@@ -4236,254 +4453,482 @@ static int mbof_rcmp_grp_callback(struct ldb_request *req,
     return LDB_SUCCESS;
 }
 
-static int mbof_member_update(struct mbof_rcmp_context *ctx,
-                              struct mbof_member *parent,
-                              struct mbof_member *mem)
+static int mbof_rcmp_build_graph(struct mbof_rcmp_context *ctx)
 {
+    struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+    struct ldb_message_element *el;
+    struct mbof_member *iter;
+    struct mbof_member *grp;
+    struct mbof_member *mem;
     hash_value_t value;
     hash_key_t key;
+    int i, j;
     int ret;
 
-    /* ignore loops */
-    if (parent == mem) return LDB_SUCCESS;
+    ctx->num_groups = 0;
+    for (iter = ctx->group_list; iter; iter = iter->next) {
+        ctx->num_groups++;
+    }
 
-    key.type = HASH_KEY_STRING;
-    key.str = discard_const(ldb_dn_get_linearized(parent->dn));
+    ctx->groups = talloc_array(ctx, struct mbof_member *, ctx->num_groups);
+    if (!ctx->groups) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
 
-    if (!mem->memberofs) {
-        ret = hash_create_ex(0, &mem->memberofs, 0, 0, 0, 0,
-                             hash_alloc, hash_free, mem, NULL, NULL);
-        if (ret != HASH_SUCCESS) {
+    for (iter = ctx->group_list, i = 0; iter; iter = iter->next, i++) {
+        iter->idx = i;
+        iter->scc_index = -1;
+        ctx->groups[i] = iter;
+    }
+
+    /* for each group compute the members list, counting how many parents
+     * each member has */
+    for (i = 0; i < ctx->num_groups; i++) {
+        grp = ctx->groups[i];
+
+        el = grp->orig_members;
+        if (!el || el->num_values == 0) {
+            /* no members */
+            continue;
+        }
+
+        /* we have at most num_values group members */
+        grp->members = talloc_array(grp, struct mbof_member *,
+                                    el->num_values);
+        if (!grp->members) {
             return LDB_ERR_OPERATIONS_ERROR;
         }
 
-        ret = HASH_ERROR_KEY_NOT_FOUND;
+        for (j = 0; j < el->num_values; j++) {
+            key.type = HASH_KEY_STRING;
+            key.str = (char *)el->values[j].data;
 
-    } else {
+            ret = hash_lookup(ctx->user_table, &key, &value);
+            if (ret == HASH_ERROR_KEY_NOT_FOUND) {
+                /* not a user, see if it is a group */
+                ret = hash_lookup(ctx->group_table, &key, &value);
+            }
 
-        ret = hash_lookup(mem->memberofs, &key, &value);
-        if (ret != HASH_SUCCESS) {
-            if (ret != HASH_ERROR_KEY_NOT_FOUND) {
-                /* fatal error */
+            if (ret == HASH_ERROR_KEY_NOT_FOUND) {
+                /* not a known user, nor a known group!?
+                   give a warning and continue */
+                ldb_debug(ldb, LDB_DEBUG_ERROR,
+                          "member attribute [%s] has no corresponding"
+                          " entry!", key.str);
+                continue;
+            }
+            if (ret != HASH_SUCCESS) {
                 return LDB_ERR_OPERATIONS_ERROR;
             }
+
+            mem = (struct mbof_member *)value.ptr;
+            mem->num_parents++;
+
+            grp->members[grp->num_members] = mem;
+            grp->num_members++;
         }
+
+        talloc_zfree(grp->orig_members);
     }
 
-    if (ret == HASH_ERROR_KEY_NOT_FOUND) {
+    /* now invert the member links */
+    for (i = 0; i < ctx->num_groups; i++) {
+        grp = ctx->groups[i];
 
-        /* it's missing, update member */
-        value.type = HASH_VALUE_PTR;
-        value.ptr = parent;
-
-        ret = hash_enter(mem->memberofs, &key, &value);
-        if (ret != HASH_SUCCESS) {
-            return LDB_ERR_OPERATIONS_ERROR;
-        }
+        for (j = 0; j < grp->num_members; j++) {
+            mem = grp->members[j];
 
-        if (mem->status == MBOF_USER) {
-            /* add corresponding memuid to the group */
-            ret = mbof_add_memuid(parent, mem->name);
-            if (ret != LDB_SUCCESS) {
-                return ret;
+            if (!mem->parents) {
+                mem->parents = talloc_array(mem, struct mbof_member *,
+                                            mem->num_parents);
+                if (!mem->parents) {
+                    return LDB_ERR_OPERATIONS_ERROR;
+                }
+                mem->num_parents = 0;
             }
+
+            mem->parents[mem->num_parents] = grp;
+            mem->num_parents++;
         }
 
-        /* if we updated a group, mark it as TO DO again */
-        if (mem->status == MBOF_GROUP_DONE) {
-            mem->status = MBOF_GROUP_TO_DO;
+        talloc_zfree(grp->members);
+        grp->num_members = 0;
+    }
+
+    return LDB_SUCCESS;
+}
+
+static int mbof_cmp_idx(const void *a, const void *b)
+{
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+
+    return (ia > ib) - (ia < ib);
+}
+
+static int mbof_cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/* Computes the closure shared by all the entries in @set as the union of
+ * their parents and of the closures of those parents. The parents that are
+ * not part of @set must already have their closure computed, the ones that
+ * are part of it are members of each other if @set has more than one entry */
+static int mbof_rcmp_closure(TALLOC_CTX *memctx,
+                             struct mbof_member **set, int num)
+{
+    struct mbof_closure *closure;
+    struct mbof_member *p;
+    int *groups;
+    int count;
+    int i, j, k, n;
+
+    closure = talloc_zero(memctx, struct mbof_closure);
+    if (!closure) {
+        return LDB_ERR_OPERATIONS_ERROR;
+    }
+
+    count = num > 1 ? num : 0;
+    for (i = 0; i < num; i++) {
+        for (j = 0; j < set[i]->num_parents; j++) {
+            p = set[i]->parents[j];
+            if (p->closure) {
+                count += 1 + p->closure->num;
+            }
         }
     }
 
-    /* now see if the parent has memberofs to pass down */
-    if (parent->memberofs) {
-        ret = hash_iterate(parent->memberofs, mbof_member_iter, mem);
-        if (ret != HASH_SUCCESS) {
+    if (count > 0) {
+        groups = talloc_array(closure, int, count);
+        if (!groups) {
+            talloc_free(closure);
             return LDB_ERR_OPERATIONS_ERROR;
         }
-        if (mem->status == MBOF_ITER_ERROR) {
-            return LDB_ERR_OPERATIONS_ERROR;
+
+        n = 0;
+        if (num > 1) {
+            for (i = 0; i < num; i++) {
+                groups[n++] = set[i]->idx;
+            }
+        }
+        for (i = 0; i < num; i++) {
+            for (j = 0; j < set[i]->num_parents; j++) {
+                p = set[i]->parents[j];
+                if (!p->closure) {
+                    /* part of the set itself */
+                    continue;
+                }
+                groups[n++] = p->idx;
+                for (k = 0; k < p->closure->num; k++) {
+                    groups[n++] = p->closure->groups[k];
+                }
+            }
+        }
+
+        /* sort and remove duplicates */
+        qsort(groups, n, sizeof(int), mbof_cmp_idx);
+        for (i = 0, k = 0; i < n; i++) {
+            if (k == 0 || groups[k - 1] != groups[i]) {
+                groups[k++] = groups[i];
+            }
         }
+
+        closure->groups = groups;
+        closure->num = k;
     }
 
-    /* finally, if it was made TO DO move it to the head */
-    if (mem->status == MBOF_GROUP_TO_DO) {
-        DLIST_PROMOTE(ctx->group_list, mem);
+    for (i = 0; i < num; i++) {
+        set[i]->closure = closure;
     }
 
     return LDB_SUCCESS;
 }
 
-static bool mbof_member_iter(hash_entry_t *item, void *user_data)
+static void mbof_scc_push(struct mbof_scc_state *st, struct mbof_member *v)
 {
-    struct mbof_member *parent;
-    struct mbof_member *mem;
-    hash_value_t value;
-    int ret;
+    v->scc_index = st->index;
+    v->scc_lowlink = st->index;
+    st->index++;
+
+    v->on_stack = true;
+    st->stack[st->stack_num] = v;
+    st->stack_num++;
 
-    mem = talloc_get_type(user_data, struct mbof_member);
+    st->path[st->path_num] = v;
+    st->path_edge[st->path_num] = 0;
+    st->path_num++;
+}
 
-    /* exclude self */
-    if (strcmp(item->key.str, ldb_dn_get_linearized(mem->dn)) == 0) {
-        return true;
+/* Iterative Tarjan search over the parent links of the groups, a component
+ * is complete only after all the components it has parents in, so closures
+ * can be computed as soon as a component is found */
+static int mbof_rcmp_closures(struct mbof_rcmp_context *ctx)
+{
+    struct mbof_scc_state st = { 0 };
+    struct mbof_member *v;
+    struct mbof_member *w;
+    int first;
+    int i, k;
+    int ret;
+
+    st.stack = talloc_array(ctx, struct mbof_member *, ctx->num_groups);
+    st.path = talloc_array(ctx, struct mbof_member *, ctx->num_groups);
+    st.path_edge = talloc_array(ctx, int, ctx->num_groups);
+    if (!st.stack || !st.path || !st.path_edge) {
+        ret = LDB_ERR_OPERATIONS_ERROR;
+        goto done;
     }
 
-    /* check if we already have it */
-    ret = hash_lookup(mem->memberofs, &item->key, &value);
-    if (ret != HASH_SUCCESS) {
-        if (ret != HASH_ERROR_KEY_NOT_FOUND) {
-            /* fatal error */
-            mem->status = MBOF_ITER_ERROR;
-            return false;
+    for (i = 0; i < ctx->num_groups; i++) {
+        if (ctx->groups[i]->scc_index != -1) {
+            continue;
         }
 
-        /* was not already here, add it and mark group as TO DO */
-        ret = hash_enter(mem->memberofs, &item->key, &item->value);
-        if (ret != HASH_SUCCESS) {
-            return LDB_ERR_OPERATIONS_ERROR;
-        }
+        mbof_scc_push(&st, ctx->groups[i]);
 
-        if (mem->status == MBOF_GROUP_DONE) {
-            mem->status = MBOF_GROUP_TO_DO;
-        }
+        while (st.path_num > 0) {
+            v = st.path[st.path_num - 1];
+
+            if (st.path_edge[st.path_num - 1] < v->num_parents) {
+                w = v->parents[st.path_edge[st.path_num - 1]];
+                st.path_edge[st.path_num - 1]++;
+
+                if (w->scc_index == -1) {
+                    mbof_scc_push(&st, w);
+                } else if (w->on_stack) {
+                    v->scc_lowlink = MIN(v->scc_lowlink, w->scc_index);
+                }
+                continue;
+            }
+
+            /* all parents visited */
+            st.path_num--;
+            if (st.path_num > 0) {
+                w = st.path[st.path_num - 1];
+                w->scc_lowlink = MIN(w->scc_lowlink, v->scc_lowlink);
+            }
 
-        if (mem->status == MBOF_USER) {
-            /* add corresponding memuid to the group */
-            parent = (struct mbof_member *)item->value.ptr;
-            ret = mbof_add_memuid(parent, mem->name);
+            if (v->scc_lowlink != v->scc_index) {
+                continue;
+            }
+
+            /* v is the root of a component, pop it from the stack */
+            for (first = st.stack_num - 1; st.stack[first] != v; first--) ;
+
+            ret = mbof_rcmp_closure(ctx, &st.stack[first],
+                                    st.stack_num - first);
             if (ret != LDB_SUCCESS) {
-                mem->status = MBOF_ITER_ERROR;
-                return false;
+                goto done;
             }
+
+            for (k = first; k < st.stack_num; k++) {
+                st.stack[k]->on_stack = false;
+            }
+            st.stack_num = first;
         }
     }
 
-    return true;
+    ret = LDB_SUCCESS;
+
+done:
+    talloc_free(st.stack);
+    talloc_free(st.path);
+    talloc_free(st.path_edge);
+    return ret;
 }
 
 static int mbof_add_memuid(struct mbof_member *grp, const char *user)
 {
-    struct ldb_val *vals;
-    int n;
-
-    if (!grp->memuids) {
-        grp->memuids = talloc_zero(grp, struct ldb_message_element);
-        if (!grp->memuids) {
-            return LDB_ERR_OPERATIONS_ERROR;
-        }
-
-        grp->memuids->name = talloc_strdup(grp->memuids, DB_MEMBERUID);
-        if (!grp->memuids->name) {
+    const char **memuids;
+    size_t size;
+
+    size = talloc_array_length(grp->memuids);
+    if (grp->num_memuids == size) {
+        memuids = talloc_realloc(grp, grp->memuids, const char *,
+                                 MAX(2 * size, 16));
+        if (!memuids) {
             return LDB_ERR_OPERATIONS_ERROR;
         }
+        grp->memuids = memuids;
     }
 
-    n = grp->memuids->num_values;
-    vals = talloc_realloc(grp->memuids,
-                          grp->memuids->values,
-                          struct ldb_val, n + 1);
-    if (!vals) {
-        return LDB_ERR_OPERATIONS_ERROR;
-    }
-
-    vals[n].data = (uint8_t *)talloc_strdup(vals, user);
-    vals[n].length = strlen(user);
-
-    grp->memuids->values = vals;
-    grp->memuids->num_values = n + 1;
+    grp->memuids[grp->num_memuids] = user;
+    grp->num_memuids++;
 
     return LDB_SUCCESS;
 }
 
-static int mbof_rcmp_update(struct mbof_rcmp_context *ctx)
+/* Adds to msg the change needed to replace the values in @orig with the
+ * values in @vals, if they differ. @vals is sorted in place. */
+static int mbof_rcmp_add_el(struct ldb_message *msg,
+                            const char *name,
+                            struct ldb_message_element *orig,
+                            const char **vals,
+                            int num)
 {
-    struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
     struct ldb_message_element *el;
-    struct ldb_message *msg = NULL;
-    struct ldb_request *req;
-    struct mbof_member *x = NULL;
-    hash_key_t *keys;
-    unsigned long count;
+    const char **orig_vals;
+    int num_orig;
     int flags;
-    int ret, i;
+    int i;
+    int ret;
+
+    num_orig = orig ? orig->num_values : 0;
+
+    if (num == 0) {
+        if (num_orig == 0) {
+            return LDB_SUCCESS;
+        }
+        return ldb_msg_add_empty(msg, name, LDB_FLAG_MOD_DELETE, NULL);
+    }
+
+    qsort(vals, num, sizeof(const char *), mbof_cmp_str);
+
+    if (num == num_orig) {
+        orig_vals = talloc_array(msg, const char *, num_orig);
+        if (!orig_vals) {
+            return LDB_ERR_OPERATIONS_ERROR;
+        }
+        for (i = 0; i < num_orig; i++) {
+            orig_vals[i] = (const char *)orig->values[i].data;
+        }
+        qsort(orig_vals, num_orig, sizeof(const char *), mbof_cmp_str);
 
-    /* we process all users first and then all groups */
-    if (ctx->user_list) {
-        /* take the next entry and remove it from the list */
-        x = ctx->user_list;
-        DLIST_REMOVE(ctx->user_list, x);
+        for (i = 0; i < num; i++) {
+            if (strcmp(vals[i], orig_vals[i]) != 0) {
+                break;
+            }
+        }
+        talloc_free(orig_vals);
+
+        if (i == num) {
+            /* already up to date */
+            return LDB_SUCCESS;
+        }
     }
-    else if (ctx->group_list) {
-        /* take the next entry and remove it from the list */
-        x = ctx->group_list;
-        DLIST_REMOVE(ctx->group_list, x);
+
+    if (orig) {
+        flags = LDB_FLAG_MOD_REPLACE;
+    } else {
+        flags = LDB_FLAG_MOD_ADD;
     }
-    else {
-        /* processing terminated, return */
-        ret = LDB_SUCCESS;
-        goto done;
+
+    ret = ldb_msg_add_empty(msg, name, flags, &el);
+    if (ret != LDB_SUCCESS) {
+        return ret;
+    }
+
+    el->values = talloc_array(msg, struct ldb_val, num);
+    if (!el->values) {
+        return LDB_ERR_OPERATIONS_ERROR;
     }
+    el->num_values = num;
+
+    for (i = 0; i < num; i++) {
+        el->values[i].data = (uint8_t *)discard_const(vals[i]);
+        el->values[i].length = strlen(vals[i]);
+    }
+
+    return LDB_SUCCESS;
+}
+
+/* Returns in @_msg the modification needed to bring the entry in line with
+ * the computed memberships, or NULL if the entry is already up to date */
+static int mbof_rcmp_build_msg(struct mbof_rcmp_context *ctx,
+                               struct mbof_member *x,
+                               struct ldb_message **_msg)
+{
+    struct ldb_message *msg;
+    const char **memberofs = NULL;
+    int num_memberofs = 0;
+    int idx;
+    int i;
+    int ret;
 
     msg = ldb_msg_new(ctx);
     if (!msg) {
-        ret = LDB_ERR_OPERATIONS_ERROR;
-        goto done;
+        return LDB_ERR_OPERATIONS_ERROR;
     }
-
     msg->dn = x->dn;
 
-    /* process memberof */
-    if (x->memberofs) {
-        ret = hash_keys(x->memberofs, &count, &keys);
-        if (ret != HASH_SUCCESS) {
+    if (x->closure && x->closure->num > 0) {
+        memberofs = talloc_array(msg, const char *, x->closure->num);
+        if (!memberofs) {
             ret = LDB_ERR_OPERATIONS_ERROR;
             goto done;
         }
 
-        if (x->orig_has_memberof) {
-            flags = LDB_FLAG_MOD_REPLACE;
-        } else {
-            flags = LDB_FLAG_MOD_ADD;
-        }
+        for (i = 0; i < x->closure->num; i++) {
+            idx = x->closure->groups[i];
 
-        ret = ldb_msg_add_empty(msg, DB_MEMBEROF, flags, &el);
-        if (ret != LDB_SUCCESS) {
-            goto done;
-        }
+            /* never add yourself as memberof */
+            if (!x->is_user && idx == x->idx) {
+                continue;
+            }
 
-        el->values = talloc_array(el, struct ldb_val, count);
-        if (!el->values) {
-            ret = LDB_ERR_OPERATIONS_ERROR;
-            goto done;
+            memberofs[num_memberofs] =
+                            ldb_dn_get_linearized(ctx->groups[idx]->dn);
+            num_memberofs++;
         }
-        el->num_values = count;
+    }
 
-        for (i = 0; i < count; i++) {
-            el->values[i].data = (uint8_t *)keys[i].str;
-            el->values[i].length = strlen(keys[i].str);
-        }
-    } else if (x->orig_has_memberof) {
-        ret = ldb_msg_add_empty(msg, DB_MEMBEROF, LDB_FLAG_MOD_DELETE, NULL);
-        if (ret != LDB_SUCCESS) {
-            goto done;
-        }
+    /* process memberof */
+    ret = mbof_rcmp_add_el(msg, DB_MEMBEROF, x->orig_memberofs,
+                           memberofs, num_memberofs);
+    if (ret != LDB_SUCCESS) {
+        goto done;
     }
 
     /* process memberuid */
-    if (x->memuids) {
-        if (x->orig_has_memberuid) {
-            flags = LDB_FLAG_MOD_REPLACE;
-        } else {
-            flags = LDB_FLAG_MOD_ADD;
-        }
+    ret = mbof_rcmp_add_el(msg, DB_MEMBERUID, x->orig_memberuids,
+                           x->memuids, x->num_memuids);
+    if (ret != LDB_SUCCESS) {
+        goto done;
+    }
 
-        ret = ldb_msg_add(msg, x->memuids, flags);
-        if (ret != LDB_SUCCESS) {
+    if (msg->num_elements == 0) {
+        talloc_zfree(msg);
+    }
+
+    *_msg = msg;
+    ret = LDB_SUCCESS;
+
+done:
+    if (ret != LDB_SUCCESS) {
+        talloc_free(msg);
+    }
+    return ret;
+}
+
+static int mbof_rcmp_update(struct mbof_rcmp_context *ctx)
+{
+    struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+    struct ldb_message *msg = NULL;
+    struct ldb_request *req;
+    struct mbof_member *x = NULL;
+    int ret;
+
+    /* skip all entries that are already up to date */
+    while (msg == NULL) {
+        /* we process all users first and then all groups */
+        if (ctx->user_list) {
+            /* take the next entry and remove it from the list */
+            x = ctx->user_list;
+            DLIST_REMOVE(ctx->user_list, x);
+        }
+        else if (ctx->group_list) {
+            /* take the next entry and remove it from the list */
+            x = ctx->group_list;
+            DLIST_REMOVE(ctx->group_list, x);
+        }
+        else {
+            /* processing terminated, return */
+            ret = LDB_SUCCESS;
             goto done;
         }
-    }
-    else if (x->orig_has_memberuid) {
-        ret = ldb_msg_add_empty(msg, DB_MEMBERUID, LDB_FLAG_MOD_DELETE, NULL);
+
+        ret = mbof_rcmp_build_msg(ctx, x, &msg);
         if (ret != LDB_SUCCESS) {
             goto done;
         }
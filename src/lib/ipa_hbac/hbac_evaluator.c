@@ -142,71 +142,102 @@ enum hbac_eval_result_int hbac_evaluate_rule(struct hbac_rule *rule,
                                              struct hbac_eval_req *hbac_req,
                                              enum hbac_error_code *error);
 
-enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
-                                    struct hbac_eval_req *hbac_req,
-                                    struct hbac_info **info)
+static bool hbac_info_new(struct hbac_info **info)
 {
-    uint32_t i;
-
-    enum hbac_error_code ret;
-    enum hbac_eval_result result = HBAC_EVAL_DENY;
-    enum hbac_eval_result_int intermediate_result;
-
-    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate()\n");
-    hbac_req_debug_print(hbac_req);
-
     if (info) {
         *info = malloc(sizeof(struct hbac_info));
         if (!*info) {
             HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
-            return HBAC_EVAL_OOM;
+            return false;
         }
         (*info)->code = HBAC_ERROR_UNKNOWN;
         (*info)->rule_name = NULL;
     }
 
+    return true;
+}
+
+/* Records the result of a rule, returns true if the evaluation is over */
+static bool hbac_rule_result(struct hbac_rule *rule,
+                             enum hbac_eval_result_int intermediate_result,
+                             enum hbac_error_code ret,
+                             struct hbac_info **info,
+                             enum hbac_eval_result *result)
+{
+    if (intermediate_result == HBAC_EVAL_UNMATCHED) {
+        /* This rule did not match at all. Skip it */
+        HBAC_DEBUG(HBAC_DBG_INFO, "The rule [%s] did not match.\n",
+                   rule->name);
+        return false;
+    } else if (intermediate_result == HBAC_EVAL_MATCHED) {
+        HBAC_DEBUG(HBAC_DBG_INFO, "ALLOWED by rule [%s].\n", rule->name);
+        *result = HBAC_EVAL_ALLOW;
+        if (info) {
+            (*info)->code = HBAC_SUCCESS;
+            (*info)->rule_name = strdup(rule->name);
+            if (!(*info)->rule_name) {
+                HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
+                *result = HBAC_EVAL_ERROR;
+                (*info)->code = HBAC_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        return true;
+    }
+
+    /* An error occurred processing this rule */
+    HBAC_DEBUG(HBAC_DBG_ERROR,
+               "Error %d occurred during evaluating of rule [%s].\n",
+               ret, rule->name);
+    *result = HBAC_EVAL_ERROR;
+    if (info) {
+        (*info)->code = ret;
+        (*info)->rule_name = strdup(rule->name);
+    }
+    /* Explicitly not checking the result of strdup(), since if
+     * it's NULL, we can't do anything anyway.
+     */
+    return true;
+}
+
+static enum hbac_eval_result hbac_evaluate_rules(struct hbac_rule **rules,
+                                                 struct hbac_eval_req *hbac_req,
+                                                 struct hbac_info **info)
+{
+    uint32_t i;
+
+    enum hbac_error_code ret;
+    enum hbac_eval_result result = HBAC_EVAL_DENY;
+    enum hbac_eval_result_int intermediate_result;
+
     for (i = 0; rules[i]; i++) {
         hbac_rule_debug_print(rules[i]);
         intermediate_result = hbac_evaluate_rule(rules[i], hbac_req, &ret);
-        if (intermediate_result == HBAC_EVAL_UNMATCHED) {
-            /* This rule did not match at all. Skip it */
-            HBAC_DEBUG(HBAC_DBG_INFO, "The rule [%s] did not match.\n",
-                       rules[i]->name);
-            continue;
-        } else if (intermediate_result == HBAC_EVAL_MATCHED) {
-            HBAC_DEBUG(HBAC_DBG_INFO, "ALLOWED by rule [%s].\n", rules[i]->name);
-            result = HBAC_EVAL_ALLOW;
-            if (info) {
-                (*info)->code = HBAC_SUCCESS;
-                (*info)->rule_name = strdup(rules[i]->name);
-                if (!(*info)->rule_name) {
-                    HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
-                    result = HBAC_EVAL_ERROR;
-                    (*info)->code = HBAC_ERROR_OUT_OF_MEMORY;
-                }
-            }
+        if (hbac_rule_result(rules[i], intermediate_result, ret,
+                             info, &result)) {
             break;
-        } else {
-            /* An error occurred processing this rule */
-            HBAC_DEBUG(HBAC_DBG_ERROR,
-                       "Error %d occurred during evaluating of rule [%s].\n",
-                       ret, rules[i]->name);
-            result = HBAC_EVAL_ERROR;
-            if (info) {
-                (*info)->code = ret;
-                (*info)->rule_name = strdup(rules[i]->name);
-            }
-            /* Explicitly not checking the result of strdup(), since if
-             * it's NULL, we can't do anything anyway.
-             */
-            goto done;
         }
     }
 
     /* If we've reached the end of the loop, we have either set the
      * result to ALLOW explicitly or we'll stick with the default DENY.
      */
-done:
+    return result;
+}
+
+enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
+                                    struct hbac_eval_req *hbac_req,
+                                    struct hbac_info **info)
+{
+    enum hbac_eval_result result;
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate()\n");
+    hbac_req_debug_print(hbac_req);
+
+    if (!hbac_info_new(info)) {
+        return HBAC_EVAL_OOM;
+    }
+
+    result = hbac_evaluate_rules(rules, hbac_req, info);
 
     HBAC_DEBUG(HBAC_DBG_INFO, "hbac_evaluate() >]\n");
     return result;
@@ -356,6 +387,658 @@ static errno_t hbac_evaluate_element(struct hbac_rule_element *rule_el,
     return EOK;
 }
 
+/* Compiled rules
+ *
+ * Names are case-folded once so that they can be compared bytewise, which
+ * is equivalent to sss_utf8_case_eq(). The rules are indexed by the folded
+ * names of the users and user groups they apply to and only the rules
+ * found for the user and the groups of a request are evaluated. The groups
+ * of each request element are put into a hash set.
+ *
+ * Rules which cannot be compiled, e.g. because they are incomplete or
+ * contain invalid UTF-8, are evaluated by hbac_evaluate_rule() for every
+ * request so that the result and the reported errors stay the same as
+ * without compiling. If the request itself cannot be compiled, all rules
+ * are evaluated that way.
+ */
+
+#define HBAC_NO_RULE ((size_t) -1)
+#define HBAC_MAP_MIN_SIZE 16
+
+struct hbac_fold {
+    uint8_t *str;
+    size_t len;
+    uint32_t hash;
+};
+
+struct hbac_map_entry {
+    const struct hbac_fold *key;
+    /* indexes of the rules, in ascending order */
+    size_t *rules;
+    size_t num_rules;
+};
+
+/* Open addressing hash table, the keys are not owned by the table */
+struct hbac_map {
+    size_t size;
+    size_t count;
+    struct hbac_map_entry *entries;
+};
+
+struct hbac_compiled_element {
+    bool all;
+    struct hbac_fold *names;
+    size_t num_names;
+    struct hbac_fold *groups;
+    size_t num_groups;
+};
+
+enum hbac_compiled_state {
+    HBAC_COMPILED_DISABLED,
+    HBAC_COMPILED_RAW,
+    HBAC_COMPILED_READY
+};
+
+struct hbac_compiled_rule {
+    struct hbac_rule *rule;
+    enum hbac_compiled_state state;
+
+    struct hbac_compiled_element users;
+    struct hbac_compiled_element services;
+    struct hbac_compiled_element targethosts;
+    struct hbac_compiled_element srchosts;
+};
+
+struct hbac_compiled_rules {
+    struct hbac_rule **rules;
+    size_t num_rules;
+    struct hbac_compiled_rule *compiled;
+
+    /* rules which must be evaluated for every request */
+    size_t *always;
+    size_t num_always;
+
+    /* folded user name or user group -> rules */
+    struct hbac_map user_names;
+    struct hbac_map user_groups;
+};
+
+struct hbac_compiled_request_element {
+    bool has_name;
+    struct hbac_fold name;
+    struct hbac_fold *groups;
+    size_t num_groups;
+    struct hbac_map group_set;
+};
+
+struct hbac_compiled_request {
+    struct hbac_compiled_request_element user;
+    struct hbac_compiled_request_element service;
+    struct hbac_compiled_request_element targethost;
+    struct hbac_compiled_request_element srchost;
+};
+
+static uint32_t hbac_hash(const uint8_t *s, size_t len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= s[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static errno_t hbac_fold(const char *name, struct hbac_fold *fold)
+{
+    errno = 0;
+    fold->str = sss_utf8_casefold((const uint8_t *) name, &fold->len);
+    if (fold->str == NULL) {
+        return errno != 0 ? errno : EINVAL;
+    }
+
+    fold->hash = hbac_hash(fold->str, fold->len);
+    return EOK;
+}
+
+static bool hbac_fold_eq(const struct hbac_fold *a, const struct hbac_fold *b)
+{
+    return a->hash == b->hash
+            && a->len == b->len
+            && memcmp(a->str, b->str, a->len) == 0;
+}
+
+static void hbac_free_folds(struct hbac_fold *folds, size_t num)
+{
+    size_t i;
+
+    if (folds == NULL) return;
+
+    for (i = 0; i < num; i++) {
+        free(folds[i].str);
+    }
+    free(folds);
+}
+
+static errno_t hbac_fold_list(const char **list,
+                              struct hbac_fold **_folds,
+                              size_t *_num)
+{
+    struct hbac_fold *folds;
+    size_t num;
+    size_t i;
+    errno_t ret;
+
+    *_folds = NULL;
+    *_num = 0;
+
+    if (list == NULL) return EOK;
+
+    num = 0;
+    while (list[num] != NULL) num++;
+    if (num == 0) return EOK;
+
+    folds = calloc(num, sizeof(struct hbac_fold));
+    if (folds == NULL) return ENOMEM;
+
+    for (i = 0; i < num; i++) {
+        ret = hbac_fold(list[i], &folds[i]);
+        if (ret != EOK) {
+            hbac_free_folds(folds, i);
+            return ret;
+        }
+    }
+
+    *_folds = folds;
+    *_num = num;
+    return EOK;
+}
+
+static struct hbac_map_entry *hbac_map_slot(struct hbac_map *map,
+                                            const struct hbac_fold *key)
+{
+    size_t mask = map->size - 1;
+    size_t i;
+
+    for (i = key->hash & mask;
+         map->entries[i].key != NULL;
+         i = (i + 1) & mask) {
+        if (hbac_fold_eq(map->entries[i].key, key)) {
+            break;
+        }
+    }
+
+    return &map->entries[i];
+}
+
+static struct hbac_map_entry *hbac_map_lookup(struct hbac_map *map,
+                                              const struct hbac_fold *key)
+{
+    struct hbac_map_entry *entry;
+
+    if (map->size == 0) return NULL;
+
+    entry = hbac_map_slot(map, key);
+    return entry->key != NULL ? entry : NULL;
+}
+
+static errno_t hbac_map_grow(struct hbac_map *map)
+{
+    struct hbac_map old = *map;
+    size_t i;
+
+    map->size = old.size == 0 ? HBAC_MAP_MIN_SIZE : old.size * 2;
+    map->entries = calloc(map->size, sizeof(struct hbac_map_entry));
+    if (map->entries == NULL) {
+        *map = old;
+        return ENOMEM;
+    }
+
+    for (i = 0; i < old.size; i++) {
+        if (old.entries[i].key != NULL) {
+            *hbac_map_slot(map, old.entries[i].key) = old.entries[i];
+        }
+    }
+
+    free(old.entries);
+    return EOK;
+}
+
+/* Adds key to the map and, unless it is HBAC_NO_RULE, rule_idx to the
+ * rules of the key. Rules must be added in ascending order. */
+static errno_t hbac_map_add(struct hbac_map *map,
+                            const struct hbac_fold *key,
+                            size_t rule_idx)
+{
+    struct hbac_map_entry *entry;
+    size_t *rules;
+    size_t n;
+    errno_t ret;
+
+    /* keep the load factor at or below 1/2 */
+    if ((map->count + 1) * 2 > map->size) {
+        ret = hbac_map_grow(map);
+        if (ret != EOK) return ret;
+    }
+
+    entry = hbac_map_slot(map, key);
+    if (entry->key == NULL) {
+        entry->key = key;
+        map->count++;
+    }
+
+    if (rule_idx == HBAC_NO_RULE) return EOK;
+
+    n = entry->num_rules;
+    if (n > 0 && entry->rules[n - 1] == rule_idx) return EOK;
+
+    /* the array is doubled whenever the count reaches a power of two */
+    if ((n & (n - 1)) == 0) {
+        rules = realloc(entry->rules, (n == 0 ? 1 : 2 * n) * sizeof(size_t));
+        if (rules == NULL) return ENOMEM;
+        entry->rules = rules;
+    }
+
+    entry->rules[n] = rule_idx;
+    entry->num_rules++;
+    return EOK;
+}
+
+static void hbac_map_free(struct hbac_map *map)
+{
+    size_t i;
+
+    if (map->entries == NULL) return;
+
+    for (i = 0; i < map->size; i++) {
+        free(map->entries[i].rules);
+    }
+    free(map->entries);
+}
+
+static void hbac_free_compiled_element(struct hbac_compiled_element *cel)
+{
+    hbac_free_folds(cel->names, cel->num_names);
+    hbac_free_folds(cel->groups, cel->num_groups);
+    memset(cel, 0, sizeof(struct hbac_compiled_element));
+}
+
+static errno_t hbac_compile_element(struct hbac_rule_element *el,
+                                    struct hbac_compiled_element *cel)
+{
+    errno_t ret;
+
+    memset(cel, 0, sizeof(struct hbac_compiled_element));
+
+    if (el->category & HBAC_CATEGORY_ALL) {
+        cel->all = true;
+        return EOK;
+    }
+
+    ret = hbac_fold_list(el->names, &cel->names, &cel->num_names);
+    if (ret != EOK) return ret;
+
+    ret = hbac_fold_list(el->groups, &cel->groups, &cel->num_groups);
+    if (ret != EOK) {
+        hbac_free_compiled_element(cel);
+        return ret;
+    }
+
+    return EOK;
+}
+
+static void hbac_free_compiled_rule(struct hbac_compiled_rule *crule)
+{
+    hbac_free_compiled_element(&crule->users);
+    hbac_free_compiled_element(&crule->services);
+    hbac_free_compiled_element(&crule->targethosts);
+    hbac_free_compiled_element(&crule->srchosts);
+}
+
+static errno_t hbac_compile_rule(struct hbac_rule *rule,
+                                 struct hbac_compiled_rule *crule)
+{
+    errno_t ret;
+
+    crule->rule = rule;
+
+    if (!rule->enabled) {
+        crule->state = HBAC_COMPILED_DISABLED;
+        return EOK;
+    }
+
+    crule->state = HBAC_COMPILED_RAW;
+
+    if (!rule->users
+     || !rule->services
+     || !rule->targethosts
+     || !rule->srchosts) {
+        return EOK;
+    }
+
+    ret = hbac_compile_element(rule->users, &crule->users);
+    if (ret == EOK) {
+        ret = hbac_compile_element(rule->services, &crule->services);
+    }
+    if (ret == EOK) {
+        ret = hbac_compile_element(rule->targethosts, &crule->targethosts);
+    }
+    if (ret == EOK) {
+        ret = hbac_compile_element(rule->srchosts, &crule->srchosts);
+    }
+
+    if (ret != EOK) {
+        hbac_free_compiled_rule(crule);
+        if (ret == ENOMEM) {
+            return ENOMEM;
+        }
+
+        HBAC_DEBUG(HBAC_DBG_TRACE, "Rule [%s] cannot be compiled [%d].\n",
+                   rule->name, ret);
+        return EOK;
+    }
+
+    crule->state = HBAC_COMPILED_READY;
+    return EOK;
+}
+
+static errno_t hbac_index_rule(struct hbac_compiled_rules *compiled,
+                               size_t idx)
+{
+    struct hbac_compiled_rule *crule = &compiled->compiled[idx];
+    size_t i;
+    errno_t ret;
+
+    switch (crule->state) {
+    case HBAC_COMPILED_DISABLED:
+        return EOK;
+    case HBAC_COMPILED_RAW:
+        compiled->always[compiled->num_always++] = idx;
+        return EOK;
+    case HBAC_COMPILED_READY:
+        break;
+    }
+
+    if (crule->users.all) {
+        compiled->always[compiled->num_always++] = idx;
+        return EOK;
+    }
+
+    for (i = 0; i < crule->users.num_names; i++) {
+        ret = hbac_map_add(&compiled->user_names,
+                           &crule->users.names[i], idx);
+        if (ret != EOK) return ret;
+    }
+
+    for (i = 0; i < crule->users.num_groups; i++) {
+        ret = hbac_map_add(&compiled->user_groups,
+                           &crule->users.groups[i], idx);
+        if (ret != EOK) return ret;
+    }
+
+    return EOK;
+}
+
+enum hbac_error_code hbac_compile_rules(struct hbac_rule **rules,
+                                        struct hbac_compiled_rules **_compiled)
+{
+    struct hbac_compiled_rules *compiled;
+    size_t num;
+    size_t i;
+    errno_t ret;
+
+    compiled = calloc(1, sizeof(struct hbac_compiled_rules));
+    if (compiled == NULL) {
+        return HBAC_ERROR_OUT_OF_MEMORY;
+    }
+
+    num = 0;
+    while (rules[num] != NULL) num++;
+
+    compiled->rules = rules;
+    compiled->compiled = calloc(num + 1, sizeof(struct hbac_compiled_rule));
+    compiled->always = calloc(num + 1, sizeof(size_t));
+    if (compiled->compiled == NULL || compiled->always == NULL) {
+        goto fail;
+    }
+
+    for (i = 0; i < num; i++) {
+        ret = hbac_compile_rule(rules[i], &compiled->compiled[i]);
+        if (ret != EOK) goto fail;
+        compiled->num_rules++;
+
+        ret = hbac_index_rule(compiled, i);
+        if (ret != EOK) goto fail;
+    }
+
+    *_compiled = compiled;
+    return HBAC_SUCCESS;
+
+fail:
+    HBAC_DEBUG(HBAC_DBG_ERROR, "Out of memory.\n");
+    hbac_free_compiled_rules(compiled);
+    return HBAC_ERROR_OUT_OF_MEMORY;
+}
+
+void hbac_free_compiled_rules(struct hbac_compiled_rules *compiled)
+{
+    size_t i;
+
+    if (compiled == NULL) return;
+
+    hbac_map_free(&compiled->user_names);
+    hbac_map_free(&compiled->user_groups);
+
+    if (compiled->compiled != NULL) {
+        for (i = 0; i < compiled->num_rules; i++) {
+            hbac_free_compiled_rule(&compiled->compiled[i]);
+        }
+        free(compiled->compiled);
+    }
+
+    free(compiled->always);
+    free(compiled);
+}
+
+static void
+hbac_free_request_element(struct hbac_compiled_request_element *cel)
+{
+    if (cel->has_name) {
+        free(cel->name.str);
+    }
+    hbac_map_free(&cel->group_set);
+    hbac_free_folds(cel->groups, cel->num_groups);
+}
+
+static errno_t
+hbac_compile_request_element(struct hbac_request_element *el,
+                             struct hbac_compiled_request_element *cel)
+{
+    size_t i;
+    errno_t ret;
+
+    if (el == NULL || el->groups == NULL) {
+        return EINVAL;
+    }
+
+    if (el->name != NULL) {
+        ret = hbac_fold(el->name, &cel->name);
+        if (ret != EOK) return ret;
+        cel->has_name = true;
+    }
+
+    ret = hbac_fold_list(el->groups, &cel->groups, &cel->num_groups);
+    if (ret != EOK) return ret;
+
+    for (i = 0; i < cel->num_groups; i++) {
+        ret = hbac_map_add(&cel->group_set, &cel->groups[i], HBAC_NO_RULE);
+        if (ret != EOK) return ret;
+    }
+
+    return EOK;
+}
+
+static void hbac_free_request(struct hbac_compiled_request *creq)
+{
+    hbac_free_request_element(&creq->user);
+    hbac_free_request_element(&creq->service);
+    hbac_free_request_element(&creq->targethost);
+    hbac_free_request_element(&creq->srchost);
+}
+
+static errno_t hbac_compile_request(struct hbac_eval_req *hbac_req,
+                                    struct hbac_compiled_request *creq)
+{
+    errno_t ret;
+
+    memset(creq, 0, sizeof(struct hbac_compiled_request));
+
+    ret = hbac_compile_request_element(hbac_req->user, &creq->user);
+    if (ret == EOK) {
+        ret = hbac_compile_request_element(hbac_req->service,
+                                           &creq->service);
+    }
+    if (ret == EOK) {
+        ret = hbac_compile_request_element(hbac_req->targethost,
+                                           &creq->targethost);
+    }
+    if (ret == EOK) {
+        ret = hbac_compile_request_element(hbac_req->srchost,
+                                           &creq->srchost);
+    }
+
+    return ret;
+}
+
+static bool
+hbac_compiled_element_match(struct hbac_compiled_element *cel,
+                            struct hbac_compiled_request_element *creq_el)
+{
+    size_t i;
+
+    if (cel->all) return true;
+
+    if (creq_el->has_name) {
+        for (i = 0; i < cel->num_names; i++) {
+            if (hbac_fold_eq(&cel->names[i], &creq_el->name)) {
+                return true;
+            }
+        }
+    }
+
+    for (i = 0; i < cel->num_groups; i++) {
+        if (hbac_map_lookup(&creq_el->group_set, &cel->groups[i]) != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static enum hbac_eval_result_int
+hbac_evaluate_compiled_rule(struct hbac_compiled_rule *crule,
+                            struct hbac_compiled_request *creq)
+{
+    /* The users were already matched by the index */
+    if (!hbac_compiled_element_match(&crule->services, &creq->service)
+            || !hbac_compiled_element_match(&crule->targethosts,
+                                            &creq->targethost)
+            || !hbac_compiled_element_match(&crule->srchosts,
+                                            &creq->srchost)) {
+        return HBAC_EVAL_UNMATCHED;
+    }
+
+    return HBAC_EVAL_MATCHED;
+}
+
+static void hbac_mark_candidates(unsigned char *candidates,
+                                 struct hbac_map_entry *entry)
+{
+    size_t i;
+
+    if (entry == NULL) return;
+
+    for (i = 0; i < entry->num_rules; i++) {
+        candidates[entry->rules[i]] = 1;
+    }
+}
+
+enum hbac_eval_result
+hbac_evaluate_compiled(struct hbac_compiled_rules *compiled,
+                       struct hbac_eval_req *hbac_req,
+                       struct hbac_info **info)
+{
+    struct hbac_compiled_request creq;
+    struct hbac_compiled_rule *crule;
+    unsigned char *candidates = NULL;
+    enum hbac_error_code ret = HBAC_SUCCESS;
+    enum hbac_eval_result result = HBAC_EVAL_DENY;
+    enum hbac_eval_result_int intermediate_result;
+    size_t i;
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "[< hbac_evaluate()\n");
+    hbac_req_debug_print(hbac_req);
+
+    if (!hbac_info_new(info)) {
+        return HBAC_EVAL_OOM;
+    }
+
+    if (hbac_compile_request(hbac_req, &creq) != EOK
+            || (candidates = calloc(compiled->num_rules + 1, 1)) == NULL) {
+        HBAC_DEBUG(HBAC_DBG_TRACE,
+                   "Request cannot be compiled, evaluating all rules.\n");
+        result = hbac_evaluate_rules(compiled->rules, hbac_req, info);
+        goto done;
+    }
+
+    for (i = 0; i < compiled->num_always; i++) {
+        candidates[compiled->always[i]] = 1;
+    }
+
+    if (creq.user.has_name) {
+        hbac_mark_candidates(candidates,
+                             hbac_map_lookup(&compiled->user_names,
+                                             &creq.user.name));
+    }
+
+    for (i = 0; i < creq.user.num_groups; i++) {
+        hbac_mark_candidates(candidates,
+                             hbac_map_lookup(&compiled->user_groups,
+                                             &creq.user.groups[i]));
+    }
+
+    /* Rules are evaluated in their original order, the first rule which
+     * matches or fails decides */
+    for (i = 0; i < compiled->num_rules; i++) {
+        if (!candidates[i]) continue;
+
+        crule = &compiled->compiled[i];
+        hbac_rule_debug_print(crule->rule);
+
+        if (crule->state == HBAC_COMPILED_READY) {
+            intermediate_result = hbac_evaluate_compiled_rule(crule, &creq);
+        } else {
+            intermediate_result = hbac_evaluate_rule(crule->rule, hbac_req,
+                                                     &ret);
+        }
+
+        if (hbac_rule_result(crule->rule, intermediate_result, ret,
+                             info, &result)) {
+            break;
+        }
+    }
+
+done:
+    free(candidates);
+    hbac_free_request(&creq);
+
+    HBAC_DEBUG(HBAC_DBG_INFO, "hbac_evaluate() >]\n");
+    return result;
+}
+
 const char *hbac_result_string(enum hbac_eval_result result)
 {
     switch (result) {
@@ -289,6 +289,53 @@ enum hbac_eval_result hbac_evaluate(struct hbac_rule **rules,
                                     struct hbac_eval_req *hbac_req,
                                     struct hbac_info **info);
 
+/**
+ * Opaque type of a set of HBAC rules prepared for repeated evaluation
+ */
+struct hbac_compiled_rules;
+
+/**
+ * @brief Prepare a set of HBAC rules for repeated evaluation
+ *
+ * The names of the rules are case-folded once and the rules are indexed by
+ * the users and user groups they apply to, so that an evaluation only has
+ * to look at the rules which can match the requesting user.
+ *
+ * @param[in] rules      A NULL-terminated list of rules. The list and the
+ *                       rules must not be changed or freed until the
+ *                       compiled rules are freed.
+ * @param[out] compiled  The compiled rules, to be freed with
+ *                       #hbac_free_compiled_rules
+ * @return
+ *  - #HBAC_SUCCESS:              The rules were compiled
+ *  - #HBAC_ERROR_OUT_OF_MEMORY:  Insufficient memory to compile the rules
+ */
+enum hbac_error_code hbac_compile_rules(struct hbac_rule **rules,
+                                        struct hbac_compiled_rules **compiled);
+
+/**
+ * @brief Evaluate an authorization request against compiled HBAC rules
+ *
+ * The result and the extended information are the same as the ones of
+ * #hbac_evaluate called with the rules passed to #hbac_compile_rules.
+ *
+ * @param[in] compiled Rules returned by #hbac_compile_rules
+ * @param[in] hbac_req A user authorization request
+ * @param[out] info    Extended information (including the name of the
+ *                     rule that allowed access (or caused a parse error)
+ * @return See #hbac_evaluate
+ */
+enum hbac_eval_result
+hbac_evaluate_compiled(struct hbac_compiled_rules *compiled,
+                       struct hbac_eval_req *hbac_req,
+                       struct hbac_info **info);
+
+/**
+ * @brief Free rules returned by #hbac_compile_rules
+ * @param compiled Rules returned by #hbac_compile_rules
+ */
+void hbac_free_compiled_rules(struct hbac_compiled_rules *compiled);
+
 /**
  * @brief Display result of hbac evaluation in human-readable form
  * @param[in] result Return value of #hbac_evaluate
@@ -240,12 +240,28 @@ struct ad_access_state {
     char *filter;
     struct sdap_id_conn_ctx **clist;
     int cindex;
+
+    /* The LDAP based checks and the GPO evaluation run concurrently. The
+     * result of the GPO evaluation is only used if the LDAP based checks
+     * allowed the access. */
+    uint64_t sdap_start_time;
+    bool sdap_done;
+    errno_t sdap_ret;
+
+    struct tevent_req *gpo_req;
+    uint64_t gpo_start_time;
+    bool gpo_done;
+    errno_t gpo_ret;
 };
 
 static errno_t
 ad_sdap_access_step(struct tevent_req *req, struct sdap_id_conn_ctx *conn);
 static void
 ad_sdap_access_done(struct tevent_req *req);
+static errno_t
+ad_gpo_access_start(struct tevent_req *req);
+static void
+ad_access_check_done(struct tevent_req *req);
 
 static struct tevent_req *
 ad_access_send(TALLOC_CTX *mem_ctx,
@@ -284,11 +300,17 @@ ad_access_send(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    state->sdap_start_time = get_start_time();
     ret = ad_sdap_access_step(req, state->clist[state->cindex]);
     if (ret != EOK) {
         goto done;
     }
 
+    ret = ad_gpo_access_start(req);
+    if (ret != EOK) {
+        goto done;
+    }
+
     ret = EOK;
 done:
     if (ret != EOK) {
@@ -332,6 +354,45 @@ ad_sdap_access_step(struct tevent_req *req, struct sdap_id_conn_ctx *conn)
 static void
 ad_gpo_access_done(struct tevent_req *subreq);
 
+static errno_t
+ad_gpo_access_start(struct tevent_req *req)
+{
+    struct ad_access_state *state;
+
+    state = tevent_req_data(req, struct ad_access_state);
+
+    switch (state->ctx->gpo_access_control_mode) {
+    case GPO_ACCESS_CONTROL_DISABLED:
+        /* do not evaluate gpos */
+        state->gpo_done = true;
+        state->gpo_ret = EOK;
+        return EOK;
+    case GPO_ACCESS_CONTROL_PERMISSIVE:
+    case GPO_ACCESS_CONTROL_ENFORCING:
+        /* start evaluating gpos */
+        break;
+    default:
+        state->gpo_done = true;
+        state->gpo_ret = EINVAL;
+        return EOK;
+    }
+
+    state->gpo_start_time = get_start_time();
+    state->gpo_req = ad_gpo_access_send(state,
+                                        state->be_ctx->ev,
+                                        state->domain,
+                                        state->ctx,
+                                        state->pd->user,
+                                        state->pd->service);
+    if (state->gpo_req == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(state->gpo_req, ad_gpo_access_done, req);
+
+    return EOK;
+}
+
 static void
 ad_sdap_access_done(struct tevent_req *subreq)
 {
@@ -348,8 +409,7 @@ ad_sdap_access_done(struct tevent_req *subreq)
     if (ret != EOK) {
         switch (ret) {
         case ERR_ACCOUNT_EXPIRED:
-            tevent_req_error(req, ret);
-            return;
+            goto done;
 
         case ERR_ACCESS_DENIED:
             /* Retry on ACCESS_DENIED, too, to make sure that we don't
@@ -369,14 +429,12 @@ ad_sdap_access_done(struct tevent_req *subreq)
             DEBUG(SSSDBG_OP_FAILURE,
                   "Error retrieving access check result: %s\n",
                   sss_strerror(ret));
-            tevent_req_error(req, ret);
-            return;
+            goto done;
         }
 
         ret = ad_sdap_access_step(req, state->clist[state->cindex]);
         if (ret != EOK) {
-            tevent_req_error(req, ret);
-            return;
+            goto done;
         }
 
         /* Another check in progress */
@@ -384,34 +442,21 @@ ad_sdap_access_done(struct tevent_req *subreq)
         return;
     }
 
-    switch (state->ctx->gpo_access_control_mode) {
-    case GPO_ACCESS_CONTROL_DISABLED:
-        /* do not evaluate gpos; mark request done */
-        tevent_req_done(req);
-        return;
-    case GPO_ACCESS_CONTROL_PERMISSIVE:
-    case GPO_ACCESS_CONTROL_ENFORCING:
-        /* continue on to evaluate gpos */
-        break;
-    default:
-        tevent_req_error(req, EINVAL);
-        return;
-    }
+done:
+    DEBUG(SSSDBG_PERF_STAT, "LDAP based access control returned [%d]: %s, "
+          "took %s.\n", ret, sss_strerror(ret),
+          sss_format_time(get_spend_time_us(state->sdap_start_time)));
 
-    subreq = ad_gpo_access_send(state,
-                                state->be_ctx->ev,
-                                state->domain,
-                                state->ctx,
-                                state->pd->user,
-                                state->pd->service);
+    state->sdap_done = true;
+    state->sdap_ret = ret;
 
-    if (!subreq) {
-        tevent_req_error(req, ENOMEM);
-        return;
+    if (ret != EOK) {
+        /* The result of the GPO evaluation does not matter any more */
+        talloc_zfree(state->gpo_req);
+        state->gpo_done = true;
     }
 
-    tevent_req_set_callback(subreq, ad_gpo_access_done, req);
-
+    ad_access_check_done(req);
 }
 
 static void
@@ -419,16 +464,56 @@ ad_gpo_access_done(struct tevent_req *subreq)
 {
     struct tevent_req *req;
     struct ad_access_state *state;
-    errno_t ret;
-    enum gpo_access_control_mode mode;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct ad_access_state);
-    mode = state->ctx->gpo_access_control_mode;
 
-    ret = ad_gpo_access_recv(subreq);
+    state->gpo_ret = ad_gpo_access_recv(subreq);
     talloc_zfree(subreq);
+    state->gpo_req = NULL;
+    state->gpo_done = true;
+
+    DEBUG(SSSDBG_PERF_STAT, "GPO-based access control returned [%d]: %s, "
+          "took %s.\n", state->gpo_ret, sss_strerror(state->gpo_ret),
+          sss_format_time(get_spend_time_us(state->gpo_start_time)));
+
+    ad_access_check_done(req);
+}
+
+static void
+ad_access_check_done(struct tevent_req *req)
+{
+    struct ad_access_state *state;
+    enum gpo_access_control_mode mode;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct ad_access_state);
+    mode = state->ctx->gpo_access_control_mode;
+
+    if (!state->sdap_done || !state->gpo_done) {
+        /* wait for the other check */
+        return;
+    }
+
+    if (state->sdap_ret != EOK) {
+        tevent_req_error(req, state->sdap_ret);
+        return;
+    }
+
+    switch (mode) {
+    case GPO_ACCESS_CONTROL_DISABLED:
+        /* gpos were not evaluated; mark request done */
+        tevent_req_done(req);
+        return;
+    case GPO_ACCESS_CONTROL_PERMISSIVE:
+    case GPO_ACCESS_CONTROL_ENFORCING:
+        break;
+    default:
+        tevent_req_error(req, EINVAL);
+        return;
+    }
 
+    ret = state->gpo_ret;
     if (ret == EOK) {
         DEBUG(SSSDBG_TRACE_FUNC, "GPO-based access control successful.\n");
         tevent_req_done(req);
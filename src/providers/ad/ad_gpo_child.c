@@ -659,7 +659,8 @@ main(int argc, const char *argv[])
     poptContext pc;
     int dumpable = 1;
     int debug_fd = -1;
-    uint64_t chain_id;
+    int helper = 0;
+    uint64_t chain_id = 0;
     const char *opt_logger = NULL;
     errno_t ret;
     int sysvol_gpt_version;
@@ -680,6 +681,8 @@ main(int argc, const char *argv[])
          _("An open file descriptor for the debug logs"), NULL},
         {"chain-id", 0, POPT_ARG_LONG, &chain_id,
          0, _("Tevent chain ID used for logging purposes"), NULL},
+        {SSS_CHILD_HELPER_OPT, 0, POPT_ARG_NONE, &helper, 0,
+         _("Serve requests until the input is closed"), NULL},
         SSSD_LOGGER_OPTS
         POPT_TABLEEND
     };
@@ -722,6 +725,11 @@ main(int argc, const char *argv[])
 
     DEBUG_INIT(debug_level, opt_logger);
 
+    if (helper != 0) {
+        sss_child_helper_serve("gpo_child", STDIN_FILENO,
+                               AD_GPO_CHILD_OUT_FILENO);
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "gpo_child started.\n");
 
     main_ctx = talloc_new(NULL);
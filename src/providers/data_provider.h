@@ -267,6 +267,10 @@ enum dp_res_opts {
     DP_RES_OPT_RESOLVER_SERVER_TIMEOUT,
     DP_RES_OPT_RESOLVER_USE_SEARCH_LIST,
     DP_RES_OPT_DNS_DOMAIN,
+    DP_RES_OPT_FAILOVER_PREFER_FASTER,
+    DP_RES_OPT_FAILOVER_PROBE_INTERVAL,
+    DP_RES_OPT_RESOLVER_CACHE,
+    DP_RES_OPT_RESOLVER_CACHE_NEGATIVE_TTL,
 
     DP_RES_OPTS /* attrs counter */
 };
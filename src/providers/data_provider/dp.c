@@ -45,7 +45,8 @@ dp_init_interface(struct data_provider *provider)
     SBUS_INTERFACE(iface_dp_backend,
         sssd_DataProvider_Backend,
         SBUS_METHODS(
-            SBUS_SYNC(METHOD, sssd_DataProvider_Backend, IsOnline, dp_backend_is_online, provider->be_ctx)
+            SBUS_SYNC(METHOD, sssd_DataProvider_Backend, IsOnline, dp_backend_is_online, provider->be_ctx),
+            SBUS_SYNC(METHOD, sssd_DataProvider_Backend, DNSCacheStats, dp_backend_dns_cache_stats, provider->be_ctx)
         ),
         SBUS_SIGNALS(SBUS_NO_SIGNALS),
         SBUS_PROPERTIES(SBUS_NO_PROPERTIES)
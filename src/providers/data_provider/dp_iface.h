@@ -211,6 +211,16 @@ errno_t dp_backend_is_online(TALLOC_CTX *mem_ctx,
                              const char *domname,
                              bool *_is_online);
 
+errno_t dp_backend_dns_cache_stats(TALLOC_CTX *mem_ctx,
+                                   struct sbus_request *sbus_req,
+                                   struct be_ctx *be_ctx,
+                                   uint64_t *_hits,
+                                   uint64_t *_negative_hits,
+                                   uint64_t *_misses,
+                                   uint64_t *_prefetches,
+                                   uint64_t *_evictions,
+                                   uint32_t *_entries);
+
 /* sssd.DataProvider.Failover */
 errno_t
 dp_failover_list_services(TALLOC_CTX *mem_ctx,
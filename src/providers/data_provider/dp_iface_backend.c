@@ -57,3 +57,37 @@ dp_backend_is_online(TALLOC_CTX *mem_ctx,
 
     return EOK;
 }
+
+errno_t
+dp_backend_dns_cache_stats(TALLOC_CTX *mem_ctx,
+                           struct sbus_request *sbus_req,
+                           struct be_ctx *be_ctx,
+                           uint64_t *_hits,
+                           uint64_t *_negative_hits,
+                           uint64_t *_misses,
+                           uint64_t *_prefetches,
+                           uint64_t *_evictions,
+                           uint32_t *_entries)
+{
+    struct resolv_cache_stats stats;
+    errno_t ret;
+
+    /* The resolver is set up by the failover code of the provider */
+    if (be_ctx->be_res == NULL) {
+        return ENOENT;
+    }
+
+    ret = resolv_get_cache_stats(be_ctx->be_res->resolv, &stats);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    *_hits = stats.hits;
+    *_negative_hits = stats.negative_hits;
+    *_misses = stats.misses;
+    *_prefetches = stats.prefetches;
+    *_evictions = stats.evictions;
+    *_entries = stats.num_entries;
+
+    return EOK;
+}
@@ -542,6 +542,9 @@ errno_t be_process_init(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    /* The back end is the main writer, flush its commits in groups */
+    sysdb_enable_group_commit(be_ctx->domain->sysdb, be_ctx->ev);
+
     ret = sysdb_master_domain_update(be_ctx->domain);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Unable to update master domain information!\n");
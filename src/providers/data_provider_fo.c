@@ -20,10 +20,18 @@
 */
 
 #include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
 #include <arpa/inet.h>
 #include "providers/backend.h"
 #include "resolv/async_resolv.h"
 
+/* Timeout of a single latency probe in seconds */
+#define BE_FO_PROBE_TIMEOUT 5
+
+/* Maximum number of records kept in the DNS cache */
+#define BE_RES_CACHE_SIZE 256
+
 struct be_svc_callback {
     struct be_svc_callback *prev;
     struct be_svc_callback *next;
@@ -51,6 +59,269 @@ static int be_fo_get_options(struct be_ctx *ctx,
     opts->retry_timeout = 30;
     opts->srv_retry_neg_timeout = 15;
     opts->family_order = ctx->be_res->family_order;
+    opts->prefer_faster_servers = dp_opt_get_bool(ctx->be_res->opts,
+                                        DP_RES_OPT_FAILOVER_PREFER_FASTER);
+
+    return EOK;
+}
+
+struct be_fo_probe_ctx {
+    struct be_ctx *be_ctx;
+    time_t interval;
+    int timeout;
+    size_t num_pending;
+};
+
+struct be_fo_probe_state {
+    int fd;
+    struct tevent_fd *fde;
+};
+
+static int be_fo_probe_state_destructor(struct be_fo_probe_state *state)
+{
+    if (state->fd != -1) {
+        close(state->fd);
+    }
+
+    return 0;
+}
+
+static void be_fo_probe_connected(struct tevent_context *ev,
+                                  struct tevent_fd *fde,
+                                  uint16_t flags,
+                                  void *pvt);
+
+/* Measure how long it takes to establish a TCP connection to the server. */
+static struct tevent_req *
+be_fo_probe_send(TALLOC_CTX *mem_ctx,
+                 struct tevent_context *ev,
+                 struct fo_server *server,
+                 void *pvt)
+{
+    struct be_fo_probe_ctx *probe_ctx;
+    struct be_fo_probe_state *state;
+    struct resolv_hostent *hostent;
+    struct sockaddr_storage *addr;
+    struct tevent_req *req;
+    socklen_t addr_len;
+    int port;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct be_fo_probe_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    state->fd = -1;
+    talloc_set_destructor(state, be_fo_probe_state_destructor);
+
+    probe_ctx = talloc_get_type(pvt, struct be_fo_probe_ctx);
+    port = fo_get_server_port(server);
+    hostent = fo_get_server_hostent(server);
+    if (port <= 0 || hostent == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Server '%s' has no port or address, "
+              "skipping\n", fo_get_server_str_name(server));
+        ret = EINVAL;
+        goto immediately;
+    }
+
+    addr = resolv_get_sockaddr_address(state, hostent, port);
+    if (addr == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    addr_len = addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                           : sizeof(struct sockaddr_in);
+
+    state->fd = socket(addr->ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (state->fd == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_OP_FAILURE, "socket() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto immediately;
+    }
+
+    ret = sss_fd_nonblocking(state->fd);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    ret = connect(state->fd, (struct sockaddr *)addr, addr_len);
+    if (ret == 0) {
+        ret = EOK;
+        goto immediately;
+    }
+
+    ret = errno;
+    if (ret != EINPROGRESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "connect() failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto immediately;
+    }
+
+    state->fde = tevent_add_fd(ev, state, state->fd, TEVENT_FD_WRITE,
+                               be_fo_probe_connected, req);
+    if (state->fde == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    if (!tevent_req_set_endtime(req, ev,
+                tevent_timeval_current_ofs(probe_ctx->timeout, 0))) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static void be_fo_probe_connected(struct tevent_context *ev,
+                                  struct tevent_fd *fde,
+                                  uint16_t flags,
+                                  void *pvt)
+{
+    struct be_fo_probe_state *state;
+    struct tevent_req *req;
+    socklen_t len;
+    int error = 0;
+    errno_t ret;
+
+    req = talloc_get_type(pvt, struct tevent_req);
+    state = tevent_req_data(req, struct be_fo_probe_state);
+
+    talloc_zfree(state->fde);
+
+    len = sizeof(error);
+    ret = getsockopt(state->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (ret != 0) {
+        error = errno;
+    }
+
+    if (error != 0) {
+        tevent_req_error(req, error);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t be_fo_probe_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+static void be_fo_probe_timer(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv,
+                              void *pvt);
+
+static errno_t be_fo_probe_schedule(struct be_fo_probe_ctx *probe_ctx)
+{
+    struct tevent_timer *te;
+    struct timeval tv;
+
+    tv = tevent_timeval_current_ofs(probe_ctx->interval, 0);
+    te = tevent_add_timer(probe_ctx->be_ctx->ev, probe_ctx, tv,
+                          be_fo_probe_timer, probe_ctx);
+    if (te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static void be_fo_probe_done(struct tevent_req *subreq);
+
+static void be_fo_probe_timer(struct tevent_context *ev,
+                              struct tevent_timer *te,
+                              struct timeval tv,
+                              void *pvt)
+{
+    struct be_fo_probe_ctx *probe_ctx;
+    struct tevent_req *subreq;
+    struct be_svc_data *svc;
+
+    probe_ctx = talloc_get_type(pvt, struct be_fo_probe_ctx);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Probing latency of fail over servers\n");
+
+    DLIST_FOR_EACH(svc, probe_ctx->be_ctx->be_fo->svcs) {
+        subreq = fo_probe_service_send(probe_ctx, ev, svc->fo_service);
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory\n");
+            continue;
+        }
+
+        tevent_req_set_callback(subreq, be_fo_probe_done, probe_ctx);
+        probe_ctx->num_pending++;
+    }
+
+    if (probe_ctx->num_pending == 0) {
+        be_fo_probe_schedule(probe_ctx);
+    }
+}
+
+static void be_fo_probe_done(struct tevent_req *subreq)
+{
+    struct be_fo_probe_ctx *probe_ctx;
+    errno_t ret;
+
+    probe_ctx = tevent_req_callback_data(subreq, struct be_fo_probe_ctx);
+
+    ret = fo_probe_service_recv(subreq);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to probe service [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    probe_ctx->num_pending--;
+    if (probe_ctx->num_pending == 0) {
+        be_fo_probe_schedule(probe_ctx);
+    }
+}
+
+static errno_t be_fo_probe_init(struct be_ctx *ctx, time_t interval)
+{
+    struct be_fo_probe_ctx *probe_ctx;
+    errno_t ret;
+
+    probe_ctx = talloc_zero(ctx->be_fo, struct be_fo_probe_ctx);
+    if (probe_ctx == NULL) {
+        return ENOMEM;
+    }
+    probe_ctx->be_ctx = ctx;
+    probe_ctx->interval = interval;
+    probe_ctx->timeout = MIN(interval, BE_FO_PROBE_TIMEOUT);
+
+    if (!fo_set_probe_plugin(ctx->be_fo->fo_ctx, be_fo_probe_send,
+                             be_fo_probe_recv, probe_ctx)) {
+        talloc_free(probe_ctx);
+        return EINVAL;
+    }
+
+    ret = be_fo_probe_schedule(probe_ctx);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    DEBUG(SSSDBG_CONF_SETTINGS, "Probing server latency every %ld seconds\n",
+          (long)interval);
 
     return EOK;
 }
@@ -58,6 +329,7 @@ static int be_fo_get_options(struct be_ctx *ctx,
 int be_init_failover(struct be_ctx *ctx)
 {
     int ret;
+    int interval;
     struct fo_options fopts;
 
     if (ctx->be_fo != NULL) {
@@ -90,6 +362,16 @@ int be_init_failover(struct be_ctx *ctx)
         return ENOMEM;
     }
 
+    interval = dp_opt_get_int(ctx->be_res->opts,
+                              DP_RES_OPT_FAILOVER_PROBE_INTERVAL);
+    if (interval > 0) {
+        ret = be_fo_probe_init(ctx, interval);
+        if (ret != EOK) {
+            talloc_zfree(ctx->be_fo);
+            return ret;
+        }
+    }
+
     return EOK;
 }
 
@@ -851,6 +1133,10 @@ static struct dp_option dp_res_default_opts[] = {
     { "dns_resolver_server_timeout", DP_OPT_NUMBER, { .number = 1000 }, NULL_NUMBER },
     { "dns_resolver_use_search_list", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
     { "dns_discovery_domain", DP_OPT_STRING, NULL_STRING, NULL_STRING },
+    { "failover_prefer_faster_servers", DP_OPT_BOOL, BOOL_FALSE, BOOL_FALSE },
+    { "failover_latency_probe_interval", DP_OPT_NUMBER, { .number = 0 }, NULL_NUMBER },
+    { "dns_resolver_cache", DP_OPT_BOOL, BOOL_TRUE, BOOL_TRUE },
+    { "dns_resolver_cache_negative_ttl", DP_OPT_NUMBER, { .number = 15 }, NULL_NUMBER },
     DP_OPTION_TERMINATOR
 };
 
@@ -891,6 +1177,7 @@ static errno_t be_res_get_opts(struct be_resolv_ctx *res_ctx,
 
 errno_t be_res_init(struct be_ctx *ctx)
 {
+    int negative_ttl;
     errno_t ret;
 
     if (ctx->be_res != NULL) {
@@ -921,5 +1208,16 @@ errno_t be_res_init(struct be_ctx *ctx)
         return ret;
     }
 
+    if (dp_opt_get_bool(ctx->be_res->opts, DP_RES_OPT_RESOLVER_CACHE)) {
+        negative_ttl = dp_opt_get_int(ctx->be_res->opts,
+                                      DP_RES_OPT_RESOLVER_CACHE_NEGATIVE_TTL);
+        ret = resolv_cache_init(ctx->be_res->resolv, BE_RES_CACHE_SIZE,
+                                negative_ttl < 0 ? 0 : negative_ttl);
+        if (ret != EOK) {
+            talloc_zfree(ctx->be_res);
+            return ret;
+        }
+    }
+
     return EOK;
 }
@@ -44,6 +44,14 @@
 #define DEFAULT_SERVER_STATUS SERVER_NAME_NOT_RESOLVED
 #define DEFAULT_SRV_STATUS SRV_NEUTRAL
 
+/* Weight of a new latency sample is 1/(2^FO_LATENCY_EWMA_SHIFT) */
+#define FO_LATENCY_EWMA_SHIFT 2
+/* Number of samples needed before the latency of a server is trusted */
+#define FO_LATENCY_MIN_SAMPLES 3
+/* Another server of the same group is only preferred if it is at least
+ * this many times faster, so that we do not flap between similar servers */
+#define FO_LATENCY_SWITCH_RATIO 2
+
 enum srv_lookup_status {
     SRV_NEUTRAL,        /* We didn't try this SRV lookup yet */
     SRV_RESOLVED,       /* This SRV lookup is resolved       */
@@ -60,6 +68,10 @@ struct fo_ctx {
     fo_srv_lookup_plugin_send_t srv_send_fn;
     fo_srv_lookup_plugin_recv_t srv_recv_fn;
     void *srv_pvt;
+
+    fo_probe_plugin_send_t probe_send_fn;
+    fo_probe_plugin_recv_t probe_recv_fn;
+    void *probe_pvt;
 };
 
 struct fo_service {
@@ -94,6 +106,13 @@ struct fo_server {
     struct timeval last_status_change;
     struct server_common *common;
 
+    /* SRV priority, 0 for statically configured servers */
+    unsigned short priority;
+    /* Moving averages of the response time in microseconds, one per
+     * measurement kind */
+    uint64_t latency[FO_LATENCY_KIND_COUNT];
+    uint32_t latency_samples[FO_LATENCY_KIND_COUNT];
+
     TALLOC_CTX *fo_internal_owner;
 };
 
@@ -161,6 +180,7 @@ fo_context_init(TALLOC_CTX *mem_ctx, struct fo_options *opts)
     ctx->opts->family_order  = opts->family_order;
     ctx->opts->service_resolv_timeout = opts->service_resolv_timeout;
     ctx->opts->use_search_list = opts->use_search_list;
+    ctx->opts->prefer_faster_servers = opts->prefer_faster_servers;
 
     DEBUG(SSSDBG_TRACE_FUNC,
           "Created new fail over context, retry timeout is %ld\n",
@@ -572,6 +592,9 @@ fo_server_alloc(struct fo_service *service, int port,
     server->srv_data = NULL;
     server->last_status_change.tv_sec = 0;
     server->last_status_change.tv_usec = 0;
+    server->priority = 0;
+    memset(server->latency, 0, sizeof(server->latency));
+    memset(server->latency_samples, 0, sizeof(server->latency_samples));
 
     server->port = port;
     server->user_data = user_data;
@@ -819,6 +842,7 @@ static errno_t fo_add_server_list(struct fo_service *service,
         }
 
         server->srv_data = srv_data;
+        server->priority = servers[i].priority;
 
         ret = fo_add_server_to_list(&srv_list, service->server_list,
                                     server, service->name);
@@ -871,6 +895,93 @@ void fo_ref_server(TALLOC_CTX *ref_ctx,
     }
 }
 
+static bool
+fo_server_same_group(struct fo_server *a, struct fo_server *b)
+{
+    return a->primary == b->primary
+            && a->srv_data == b->srv_data
+            && a->priority == b->priority;
+}
+
+/*
+ * Find the first kind of latency measurement for which both servers have
+ * enough samples, FO_LATENCY_KIND_COUNT if there is none.
+ */
+static enum fo_latency_kind
+fo_common_latency_kind(struct fo_server *a, struct fo_server *b)
+{
+    enum fo_latency_kind kind;
+
+    for (kind = 0; kind < FO_LATENCY_KIND_COUNT; kind++) {
+        if (a->latency_samples[kind] >= FO_LATENCY_MIN_SAMPLES
+                && b->latency_samples[kind] >= FO_LATENCY_MIN_SAMPLES) {
+            break;
+        }
+    }
+
+    return kind;
+}
+
+/*
+ * Return true if 'a' responds more than 'ratio' times faster than 'b'.
+ * Only averages of the same measurement kind are compared.
+ */
+static bool
+fo_server_faster(struct fo_server *a, struct fo_server *b, uint64_t ratio)
+{
+    enum fo_latency_kind kind;
+
+    kind = fo_common_latency_kind(a, b);
+    if (kind == FO_LATENCY_KIND_COUNT) {
+        return false;
+    }
+
+    return a->latency[kind] * ratio < b->latency[kind];
+}
+
+/*
+ * If latency based selection is enabled, look for a working server within
+ * the same priority group as 'server' that responds considerably faster.
+ * Servers without enough latency samples of a common kind are never
+ * preferred nor left.
+ */
+static struct fo_server *
+fo_find_faster_server(struct fo_service *service, struct fo_server *server)
+{
+    struct fo_server *iter;
+    struct fo_server *best = server;
+    enum fo_latency_kind kind;
+
+    if (!service->ctx->opts->prefer_faster_servers) {
+        return server;
+    }
+
+    DLIST_FOR_EACH(iter, service->server_list) {
+        if (iter == server || !fo_server_same_group(iter, server)) {
+            continue;
+        }
+
+        if (!fo_server_faster(iter, server, FO_LATENCY_SWITCH_RATIO)
+                || (best != server && !fo_server_faster(iter, best, 1))) {
+            continue;
+        }
+
+        if (service_works(iter)) {
+            best = iter;
+        }
+    }
+
+    if (best != server) {
+        kind = fo_common_latency_kind(best, server);
+        DEBUG(SSSDBG_TRACE_FUNC, "Preferring server '%s' [%"PRIu64" us] over "
+              "'%s' [%"PRIu64" us] of service '%s' (latency kind %d)\n",
+              SERVER_NAME(best), best->latency[kind], SERVER_NAME(server),
+              server->latency[kind], service->name, kind);
+    }
+
+    return best;
+}
+
 static int
 get_first_server_entity(struct fo_service *service, struct fo_server **_server)
 {
@@ -936,6 +1047,7 @@ get_first_server_entity(struct fo_service *service, struct fo_server **_server)
     return ENOENT;
 
 done:
+    server = fo_find_faster_server(service, server);
     service->last_tried_server = server;
     *_server = server;
     return EOK;
@@ -1564,6 +1676,44 @@ fo_set_port_status(struct fo_server *server, enum port_status status)
     }
 }
 
+void fo_server_report_latency(struct fo_server *server,
+                              enum fo_latency_kind kind,
+                              uint64_t latency)
+{
+    int64_t diff;
+
+    if (server == NULL || kind >= FO_LATENCY_KIND_COUNT) {
+        return;
+    }
+
+    if (server->latency_samples[kind] == 0) {
+        server->latency[kind] = latency;
+    } else {
+        diff = (int64_t)latency - (int64_t)server->latency[kind];
+        server->latency[kind] += diff / (1 << FO_LATENCY_EWMA_SHIFT);
+    }
+
+    if (server->latency_samples[kind] < UINT32_MAX) {
+        server->latency_samples[kind]++;
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Latency of server '%s' port %d (kind %d): sample %"PRIu64" us, "
+          "average %"PRIu64" us\n", SERVER_NAME(server), server->port, kind,
+          latency, server->latency[kind]);
+}
+
+uint64_t fo_get_server_latency(struct fo_server *server,
+                               enum fo_latency_kind kind)
+{
+    if (server == NULL || kind >= FO_LATENCY_KIND_COUNT
+            || server->latency_samples[kind] == 0) {
+        return 0;
+    }
+
+    return server->latency[kind];
+}
+
 struct fo_server *fo_get_active_server(struct fo_service *service)
 {
     return service->active_server;
@@ -1805,3 +1955,159 @@ bool fo_set_srv_lookup_plugin(struct fo_ctx *ctx,
 
     return true;
 }
+
+bool fo_set_probe_plugin(struct fo_ctx *ctx,
+                         fo_probe_plugin_send_t send_fn,
+                         fo_probe_plugin_recv_t recv_fn,
+                         void *pvt)
+{
+    if (ctx == NULL || send_fn == NULL || recv_fn == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid parameters\n");
+        return false;
+    }
+
+    if (ctx->probe_send_fn != NULL || ctx->probe_recv_fn != NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Probe plugin is already set\n");
+        return false;
+    }
+
+    ctx->probe_send_fn = send_fn;
+    ctx->probe_recv_fn = recv_fn;
+    ctx->probe_pvt = talloc_steal(ctx, pvt);
+
+    return true;
+}
+
+struct fo_probe_service_state {
+    TALLOC_CTX *probes;
+    size_t num_pending;
+};
+
+struct fo_probe_server_state {
+    struct tevent_req *req;
+    struct fo_server *server;
+    uint64_t start_time;
+};
+
+static void fo_probe_service_done(struct tevent_req *subreq);
+
+struct tevent_req *fo_probe_service_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         struct fo_service *service)
+{
+    struct fo_probe_service_state *state;
+    struct fo_probe_server_state *probe;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    struct fo_server *server;
+    struct fo_ctx *ctx;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct fo_probe_service_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create() failed\n");
+        return NULL;
+    }
+
+    ctx = service->ctx;
+    if (ctx->probe_send_fn == NULL || ctx->probe_recv_fn == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "No probe plugin is set\n");
+        ret = EOK;
+        goto done;
+    }
+
+    state->probes = talloc_new(state);
+    if (state->probes == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    DLIST_FOR_EACH(server, service->server_list) {
+        /* Only probe servers with a resolved address which are not
+         * known to be broken. */
+        if (server->common == NULL || server->common->rhostent == NULL
+                || !service_works(server)) {
+            continue;
+        }
+
+        probe = talloc_zero(state->probes, struct fo_probe_server_state);
+        if (probe == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        probe->req = req;
+        probe->server = server;
+        fo_ref_server(probe, server);
+
+        subreq = ctx->probe_send_fn(probe, ev, server, ctx->probe_pvt);
+        if (subreq == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        probe->start_time = get_start_time();
+        tevent_req_set_callback(subreq, fo_probe_service_done, probe);
+        state->num_pending++;
+    }
+
+    if (state->num_pending == 0) {
+        ret = EOK;
+        goto done;
+    }
+
+    return req;
+
+done:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        /* Cancel probes that were already started */
+        talloc_zfree(state->probes);
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, ev);
+
+    return req;
+}
+
+static void fo_probe_service_done(struct tevent_req *subreq)
+{
+    struct fo_probe_service_state *state;
+    struct fo_probe_server_state *probe;
+    struct tevent_req *req;
+    struct fo_ctx *ctx;
+    uint64_t latency;
+    errno_t ret;
+
+    probe = tevent_req_callback_data(subreq, struct fo_probe_server_state);
+    req = probe->req;
+    state = tevent_req_data(req, struct fo_probe_service_state);
+    ctx = probe->server->service->ctx;
+
+    ret = ctx->probe_recv_fn(subreq);
+    talloc_zfree(subreq);
+    latency = get_spend_time_us(probe->start_time);
+    if (ret == EOK) {
+        fo_server_report_latency(probe->server, FO_LATENCY_CONNECT, latency);
+    } else {
+        /* The regular connection code decides whether the server works,
+         * the probe only collects timing information. */
+        DEBUG(SSSDBG_MINOR_FAILURE, "Probing server '%s' failed [%d]: %s\n",
+              SERVER_NAME(probe->server), ret, sss_strerror(ret));
+    }
+
+    talloc_free(probe);
+
+    state->num_pending--;
+    if (state->num_pending == 0) {
+        tevent_req_done(req);
+    }
+}
+
+errno_t fo_probe_service_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
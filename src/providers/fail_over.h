@@ -45,6 +45,18 @@ enum port_status {
     PORT_NOT_WORKING /* This port was reported to not work. */
 };
 
+/*
+ * Kinds of response time measurements. The durations of different kinds
+ * of operations are not comparable, so a separate average is kept for each.
+ */
+enum fo_latency_kind {
+    FO_LATENCY_CONNECT,    /* TCP connection set up by the probe plugin. */
+    FO_LATENCY_LDAP_REPLY, /* Time until the first reply to an LDAP operation. */
+    FO_LATENCY_KRB5_AUTH,  /* Duration of a krb5_child authentication. */
+
+    FO_LATENCY_KIND_COUNT  /* Must be the last one. */
+};
+
 enum server_status {
     SERVER_NAME_NOT_RESOLVED, /* We didn't yet resolved the host name. */
     SERVER_RESOLVING_NAME,    /* Name resolving is in progress. */
@@ -86,6 +98,7 @@ struct fo_options {
     int service_resolv_timeout;
     bool use_search_list;
     enum restrict_family family_order;
+    bool prefer_faster_servers;
 };
 
 /*
@@ -183,6 +196,24 @@ void fo_set_server_status(struct fo_server *server,
 void fo_set_port_status(struct fo_server *server,
                         enum port_status status);
 
+/*
+ * Feed the response time of an operation of the given kind performed against
+ * 'server' into the moving average of that kind. If prefer_faster_servers is
+ * enabled, a considerably faster working server from the same priority group
+ * is returned by fo_resolve_service_send() instead of the slower one. Servers
+ * are only compared by averages of the same kind.
+ */
+void fo_server_report_latency(struct fo_server *server,
+                              enum fo_latency_kind kind,
+                              uint64_t latency);
+
+/*
+ * Return the average latency of the given kind of 'server' in microseconds,
+ * 0 if unknown.
+ */
+uint64_t fo_get_server_latency(struct fo_server *server,
+                               enum fo_latency_kind kind);
+
 /*
  * Instruct fail-over to try next server on the next connect attempt.
  * Should be used after connection to service was unexpectedly dropped
@@ -239,4 +270,36 @@ bool fo_set_srv_lookup_plugin(struct fo_ctx *ctx,
                               fo_srv_lookup_plugin_recv_t recv_fn,
                               void *pvt);
 
+/*
+ * Probe plugin is used to measure the response time of a resolved server
+ * in the background. The request should finish with EOK once the server
+ * responded, its duration is then reported as the latency of the server.
+ */
+typedef struct tevent_req *
+(*fo_probe_plugin_send_t)(TALLOC_CTX *mem_ctx,
+                          struct tevent_context *ev,
+                          struct fo_server *server,
+                          void *pvt);
+
+typedef errno_t
+(*fo_probe_plugin_recv_t)(struct tevent_req *req);
+
+/*
+ * pvt will be talloc_stealed to ctx
+ */
+bool fo_set_probe_plugin(struct fo_ctx *ctx,
+                         fo_probe_plugin_send_t send_fn,
+                         fo_probe_plugin_recv_t recv_fn,
+                         void *pvt);
+
+/*
+ * Run the probe plugin against all resolved and working servers of
+ * 'service' in parallel and record their latency.
+ */
+struct tevent_req *fo_probe_service_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         struct fo_service *service);
+
+errno_t fo_probe_service_recv(struct tevent_req *req);
+
 #endif /* !__FAIL_OVER_H__ */
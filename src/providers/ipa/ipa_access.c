@@ -25,6 +25,7 @@
 #include <security/pam_modules.h>
 
 #include "util/util.h"
+#include "shared/murmurhash3.h"
 #include "providers/ldap/sdap_async.h"
 #include "providers/ldap/sdap_access.h"
 #include "providers/ipa/ipa_common.h"
@@ -81,6 +82,115 @@ enum check_result {
     RULE_ERROR
 };
 
+/* The HBAC rules converted from the cache and compiled for evaluation.
+ * Converting them needs several cache lookups per rule, so they are kept
+ * until a refresh stores different rules, services or hosts. */
+struct ipa_hbac_rule_set {
+    uint64_t generation;
+    struct hbac_rule **rules;
+    struct hbac_compiled_rules *compiled;
+
+    /* Lower-cased original DNs of user members which were not cached when
+     * the rules were converted and are missing from the rules */
+    hash_table_t *unresolved_users;
+    size_t num_unresolved;
+};
+
+static bool ipa_hbac_is_version_attr(const char *name)
+{
+    return strcasecmp(name, IPA_ENTRY_USN) == 0
+            || strcasecmp(name, IPA_MODIFY_TIMESTAMP) == 0;
+}
+
+/* An entry with entryUSN or modifyTimestamp is identified by its DN and
+ * these attributes, other entries (e.g. hosts) by all of their values. */
+static uint64_t ipa_hbac_entry_hash(struct sysdb_attrs *entry)
+{
+    struct ldb_message_element *el;
+    bool versioned = false;
+    uint32_t h1 = 0;
+    uint32_t h2 = 0x9747b28c;
+    unsigned int j;
+    int i;
+
+    for (i = 0; i < entry->num; i++) {
+        if (ipa_hbac_is_version_attr(entry->a[i].name)) {
+            versioned = true;
+            break;
+        }
+    }
+
+    for (i = 0; i < entry->num; i++) {
+        el = &entry->a[i];
+        if (versioned && !ipa_hbac_is_version_attr(el->name)
+                && strcasecmp(el->name, SYSDB_ORIG_DN) != 0) {
+            continue;
+        }
+
+        h1 = murmurhash3(el->name, strlen(el->name), h1);
+        h2 = murmurhash3(el->name, strlen(el->name), h2);
+        for (j = 0; j < el->num_values; j++) {
+            h1 = murmurhash3((const char *) el->values[j].data,
+                             el->values[j].length, h1);
+            h2 = murmurhash3((const char *) el->values[j].data,
+                             el->values[j].length, h2);
+        }
+    }
+
+    return ((uint64_t) h1 << 32) | h2;
+}
+
+static uint64_t ipa_hbac_entries_generation(struct sysdb_attrs **entries,
+                                            size_t count)
+{
+    uint64_t generation = 0;
+    size_t i;
+
+    /* The order of the entries does not matter */
+    for (i = 0; i < count; i++) {
+        generation += ipa_hbac_entry_hash(entries[i]);
+    }
+
+    return generation;
+}
+
+static uint64_t ipa_hbac_generation(struct ipa_common_entries *hosts,
+                                    struct ipa_common_entries *services,
+                                    struct ipa_common_entries *rules)
+{
+    uint64_t generation;
+
+    generation = ipa_hbac_entries_generation(hosts->entries,
+                                             hosts->entry_count)
+               + ipa_hbac_entries_generation(hosts->groups,
+                                             hosts->group_count)
+               + ipa_hbac_entries_generation(services->entries,
+                                             services->entry_count)
+               + ipa_hbac_entries_generation(services->groups,
+                                             services->group_count)
+               + ipa_hbac_entries_generation(rules->entries,
+                                             rules->entry_count);
+
+    /* 0 means that the generation of the cached data is unknown */
+    return generation != 0 ? generation : 1;
+}
+
+static void ipa_hbac_set_generation(struct ipa_access_ctx *access_ctx,
+                                    uint64_t generation)
+{
+    if (generation != 0 && generation == access_ctx->hbac_generation) {
+        return;
+    }
+
+    if (access_ctx->hbac_rule_set != NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "HBAC rules changed, dropping the "
+              "converted rules.\n");
+        talloc_zfree(access_ctx->hbac_rule_set);
+    }
+
+    access_ctx->hbac_generation = generation;
+}
+
 struct ipa_fetch_hbac_state {
     struct tevent_context *ev;
     struct be_ctx *be_ctx;
@@ -100,6 +210,10 @@ struct ipa_fetch_hbac_state {
 
     /* Services */
     struct ipa_common_entries *services;
+
+    /* Hosts and services are searched concurrently */
+    struct tevent_req *hosts_req;
+    struct tevent_req *services_req;
 };
 
 static errno_t ipa_fetch_hbac_retry(struct tevent_req *req);
@@ -107,6 +221,7 @@ static void ipa_fetch_hbac_connect_done(struct tevent_req *subreq);
 static errno_t ipa_fetch_hbac_hostinfo(struct tevent_req *req);
 static void ipa_fetch_hbac_hostinfo_done(struct tevent_req *subreq);
 static void ipa_fetch_hbac_services_done(struct tevent_req *subreq);
+static errno_t ipa_fetch_hbac_rules(struct tevent_req *req);
 static void ipa_fetch_hbac_rules_done(struct tevent_req *subreq);
 
 static struct tevent_req *
@@ -250,7 +365,6 @@ done:
 static errno_t ipa_fetch_hbac_hostinfo(struct tevent_req *req)
 {
     struct ipa_fetch_hbac_state *state;
-    struct tevent_req *subreq;
     const char *hostname;
     bool srchost;
 
@@ -273,17 +387,31 @@ static errno_t ipa_fetch_hbac_hostinfo(struct tevent_req *req)
         hostname = dp_opt_get_string(state->ipa_options, IPA_HOSTNAME);
     }
 
-    subreq = ipa_host_info_send(state, state->ev,
-                                sdap_id_op_handle(state->sdap_op),
-                                state->sdap_ctx->opts, hostname,
-                                state->access_ctx->host_map,
-                                state->access_ctx->hostgroup_map,
-                                state->access_ctx->host_search_bases);
-    if (subreq == NULL) {
+    state->hosts_req = ipa_host_info_send(state, state->ev,
+                                          sdap_id_op_handle(state->sdap_op),
+                                          state->sdap_ctx->opts, hostname,
+                                          state->access_ctx->host_map,
+                                          state->access_ctx->hostgroup_map,
+                                          state->access_ctx->host_search_bases);
+    if (state->hosts_req == NULL) {
+        return ENOMEM;
+    }
+
+    tevent_req_set_callback(state->hosts_req,
+                            ipa_fetch_hbac_hostinfo_done, req);
+
+    /* The services do not depend on the host, search them at the same time */
+    state->services_req = ipa_hbac_service_info_send(state, state->ev,
+                                            sdap_id_op_handle(state->sdap_op),
+                                            state->sdap_ctx->opts,
+                                            state->search_bases);
+    if (state->services_req == NULL) {
+        talloc_zfree(state->hosts_req);
         return ENOMEM;
     }
 
-    tevent_req_set_callback(subreq, ipa_fetch_hbac_hostinfo_done, req);
+    tevent_req_set_callback(state->services_req,
+                            ipa_fetch_hbac_services_done, req);
 
     return EAGAIN;
 }
@@ -306,8 +434,11 @@ static void ipa_fetch_hbac_hostinfo_done(struct tevent_req *subreq)
     state->hosts->entry_subdir = HBAC_HOSTS_SUBDIR;
     state->hosts->group_subdir = HBAC_HOSTGROUPS_SUBDIR;
     talloc_zfree(subreq);
+    state->hosts_req = NULL;
 
     if (ret != EOK) {
+        talloc_zfree(state->services_req);
+
         /* Only call sdap_id_op_done in case of an error to trigger a
          * failover. In general changing the tevent_req layout would be better
          * so that all searches are in another sub-request so that we can
@@ -325,18 +456,15 @@ static void ipa_fetch_hbac_hostinfo_done(struct tevent_req *subreq)
         goto done;
     }
 
-    subreq = ipa_hbac_service_info_send(state, state->ev,
-                                        sdap_id_op_handle(state->sdap_op),
-                                        state->sdap_ctx->opts,
-                                        state->search_bases);
-    if (subreq == NULL) {
-        ret = ENOMEM;
-        goto done;
+    if (state->services_req != NULL) {
+        /* ipa_fetch_hbac_services_done() continues */
+        return;
     }
 
-    tevent_req_set_callback(subreq, ipa_fetch_hbac_services_done, req);
-
-    return;
+    ret = ipa_fetch_hbac_rules(req);
+    if (ret == EAGAIN) {
+        return;
+    }
 
 done:
     if (ret != EOK) {
@@ -364,10 +492,39 @@ static void ipa_fetch_hbac_services_done(struct tevent_req *subreq)
     state->services->entry_subdir = HBAC_SERVICES_SUBDIR;
     state->services->group_subdir = HBAC_SERVICEGROUPS_SUBDIR;
     talloc_zfree(subreq);
+    state->services_req = NULL;
     if (ret != EOK) {
+        talloc_zfree(state->hosts_req);
         goto done;
     }
 
+    if (state->hosts_req != NULL) {
+        /* ipa_fetch_hbac_hostinfo_done() continues */
+        return;
+    }
+
+    ret = ipa_fetch_hbac_rules(req);
+    if (ret == EAGAIN) {
+        return;
+    }
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t ipa_fetch_hbac_rules(struct tevent_req *req)
+{
+    struct ipa_fetch_hbac_state *state;
+    struct tevent_req *subreq;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct ipa_fetch_hbac_state);
+
     /* Get the ipa_host attrs */
     ret = ipa_get_host_attrs(state->ipa_options,
                              state->hosts->entry_count,
@@ -375,7 +532,7 @@ static void ipa_fetch_hbac_services_done(struct tevent_req *subreq)
                              &state->ipa_host);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not locate IPA host.\n");
-        goto done;
+        return ret;
     }
 
     subreq = ipa_hbac_rule_info_send(state, state->ev,
@@ -384,21 +541,12 @@ static void ipa_fetch_hbac_services_done(struct tevent_req *subreq)
                                      state->search_bases,
                                      state->ipa_host);
     if (subreq == NULL) {
-        ret = ENOMEM;
-        goto done;
+        return ENOMEM;
     }
 
     tevent_req_set_callback(subreq, ipa_fetch_hbac_rules_done, req);
 
-    return;
-
-done:
-    if (ret != EOK) {
-        tevent_req_error(req, ret);
-        return;
-    }
-
-    tevent_req_done(req);
+    return EAGAIN;
 }
 
 static void ipa_fetch_hbac_rules_done(struct tevent_req *subreq)
@@ -442,6 +590,7 @@ static void ipa_fetch_hbac_rules_done(struct tevent_req *subreq)
 
     if (found == false) {
         /* No rules were found that apply to this host. */
+        ipa_hbac_set_generation(state->access_ctx, 0);
         ret = ipa_common_purge_rules(state->be_ctx->domain,
                                      HBAC_RULES_SUBDIR);
         if (ret != EOK) {
@@ -459,9 +608,16 @@ static void ipa_fetch_hbac_rules_done(struct tevent_req *subreq)
 
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Unable to save HBAC rules\n");
+        /* The cache might contain a part of the new rules */
+        ipa_hbac_set_generation(state->access_ctx, 0);
         goto done;
     }
 
+    ipa_hbac_set_generation(state->access_ctx,
+                            ipa_hbac_generation(state->hosts,
+                                                state->services,
+                                                state->rules));
+
     ret = EOK;
 
 done:
@@ -480,17 +636,26 @@ static errno_t ipa_fetch_hbac_recv(struct tevent_req *req)
     return EOK;
 }
 
-errno_t ipa_hbac_evaluate_rules(struct be_ctx *be_ctx,
-                                struct dp_option *ipa_options,
-                                struct pam_data *pd)
+static int ipa_hbac_rule_set_destructor(struct ipa_hbac_rule_set *rule_set)
+{
+    hbac_free_compiled_rules(rule_set->compiled);
+    return 0;
+}
+
+static errno_t
+ipa_hbac_rule_set_new(TALLOC_CTX *mem_ctx,
+                      struct hbac_ctx *hbac_ctx,
+                      uint64_t generation,
+                      struct ipa_hbac_rule_set **_rule_set)
 {
     TALLOC_CTX *tmp_ctx;
-    struct hbac_ctx hbac_ctx;
-    struct hbac_rule **hbac_rules;
-    struct hbac_eval_req *eval_req;
-    enum hbac_eval_result result;
-    struct hbac_info *info = NULL;
+    struct ipa_hbac_rule_set *rule_set;
     const char **attrs_get_cached_rules;
+    char **unresolved;
+    hash_key_t key;
+    hash_value_t value;
+    size_t i;
+    int hret;
     errno_t ret;
 
     tmp_ctx = talloc_new(NULL);
@@ -498,9 +663,12 @@ errno_t ipa_hbac_evaluate_rules(struct be_ctx *be_ctx,
         return ENOMEM;
     }
 
-    hbac_ctx.be_ctx = be_ctx;
-    hbac_ctx.ipa_options = ipa_options;
-    hbac_ctx.pd = pd;
+    rule_set = talloc_zero(tmp_ctx, struct ipa_hbac_rule_set);
+    if (rule_set == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    rule_set->generation = generation;
 
     /* Get HBAC rules from the sysdb */
     attrs_get_cached_rules = hbac_get_attrs_to_get_cached_rules(tmp_ctx);
@@ -510,16 +678,176 @@ errno_t ipa_hbac_evaluate_rules(struct be_ctx *be_ctx,
         ret = ENOMEM;
         goto done;
     }
-    ret = ipa_common_get_cached_rules(tmp_ctx, be_ctx->domain,
+    ret = ipa_common_get_cached_rules(tmp_ctx, hbac_ctx->be_ctx->domain,
                                       IPA_HBAC_RULE, HBAC_RULES_SUBDIR,
                                       attrs_get_cached_rules,
-                                      &hbac_ctx.rule_count, &hbac_ctx.rules);
+                                      &hbac_ctx->rule_count, &hbac_ctx->rules);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not retrieve rules from the cache\n");
         goto done;
     }
 
-    ret = hbac_ctx_to_rules(tmp_ctx, &hbac_ctx, &hbac_rules, &eval_req);
+    ret = hbac_ctx_to_rule_list(rule_set, hbac_ctx, &rule_set->rules,
+                                &unresolved);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    if (hbac_compile_rules(rule_set->rules,
+                           &rule_set->compiled) != HBAC_SUCCESS) {
+        ret = ENOMEM;
+        goto done;
+    }
+    talloc_set_destructor(rule_set, ipa_hbac_rule_set_destructor);
+
+    ret = sss_hash_create(rule_set, 0, &rule_set->unresolved_users);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    key.type = HASH_KEY_STRING;
+    value.type = HASH_VALUE_UNDEF;
+    for (i = 0; unresolved[i] != NULL; i++) {
+        key.str = sss_tc_utf8_str_tolower(tmp_ctx, unresolved[i]);
+        if (key.str == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        hret = hash_enter(rule_set->unresolved_users, &key, &value);
+        if (hret != HASH_SUCCESS) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+    rule_set->num_unresolved = i;
+    talloc_free(unresolved);
+
+    *_rule_set = talloc_steal(mem_ctx, rule_set);
+    ret = EOK;
+
+done:
+    /* The cached rules are only needed for the conversion */
+    hbac_ctx->rules = NULL;
+    hbac_ctx->rule_count = 0;
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* A user member of a rule who was not cached when the rules were converted
+ * is missing from them, the rules must be converted again for this user. */
+static bool ipa_hbac_rule_set_misses_user(struct ipa_hbac_rule_set *rule_set,
+                                          struct be_ctx *be_ctx,
+                                          struct pam_data *pd)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct ldb_message *msg;
+    const char *attrs[] = { SYSDB_ORIG_DN, NULL };
+    const char *orig_dn;
+    hash_key_t key;
+    bool missing = true;
+    errno_t ret;
+
+    if (rule_set->num_unresolved == 0) {
+        return false;
+    }
+
+    /* Users of trusted domains are never members of a rule */
+    if (strcasecmp(pd->domain, be_ctx->domain->name) != 0) {
+        return false;
+    }
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return true;
+    }
+
+    ret = sysdb_search_user_by_name(tmp_ctx, be_ctx->domain, pd->user,
+                                    attrs, &msg);
+    if (ret == ENOENT) {
+        missing = false;
+        goto done;
+    } else if (ret != EOK) {
+        goto done;
+    }
+
+    orig_dn = ldb_msg_find_attr_as_string(msg, SYSDB_ORIG_DN, NULL);
+    if (orig_dn == NULL) {
+        missing = false;
+        goto done;
+    }
+
+    key.type = HASH_KEY_STRING;
+    key.str = sss_tc_utf8_str_tolower(tmp_ctx, orig_dn);
+    if (key.str == NULL) {
+        goto done;
+    }
+
+    missing = hash_has_key(rule_set->unresolved_users, &key);
+
+done:
+    talloc_free(tmp_ctx);
+    return missing;
+}
+
+static errno_t ipa_hbac_get_rule_set(struct ipa_access_ctx *access_ctx,
+                                     struct hbac_ctx *hbac_ctx,
+                                     struct ipa_hbac_rule_set **_rule_set)
+{
+    struct ipa_hbac_rule_set *rule_set;
+    uint64_t start_time;
+    errno_t ret;
+
+    rule_set = access_ctx->hbac_rule_set;
+    if (rule_set != NULL) {
+        if (rule_set->generation == access_ctx->hbac_generation
+                && !ipa_hbac_rule_set_misses_user(rule_set, hbac_ctx->be_ctx,
+                                                  hbac_ctx->pd)) {
+            DEBUG(SSSDBG_TRACE_INTERNAL, "Reusing converted HBAC rules.\n");
+            *_rule_set = rule_set;
+            return EOK;
+        }
+
+        talloc_zfree(access_ctx->hbac_rule_set);
+    }
+
+    start_time = get_start_time();
+    ret = ipa_hbac_rule_set_new(access_ctx, hbac_ctx,
+                                access_ctx->hbac_generation, &rule_set);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    DEBUG(SSSDBG_PERF_STAT, "Converting HBAC rules took %s.\n",
+          sss_format_time(get_spend_time_us(start_time)));
+
+    access_ctx->hbac_rule_set = rule_set;
+    *_rule_set = rule_set;
+    return EOK;
+}
+
+errno_t ipa_hbac_evaluate_rules(struct be_ctx *be_ctx,
+                                struct ipa_access_ctx *access_ctx,
+                                struct pam_data *pd)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct hbac_ctx hbac_ctx = { 0 };
+    struct ipa_hbac_rule_set *rule_set;
+    struct hbac_eval_req *eval_req;
+    enum hbac_eval_result result;
+    struct hbac_info *info = NULL;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    hbac_ctx.be_ctx = be_ctx;
+    hbac_ctx.ipa_options = access_ctx->ipa_options;
+    hbac_ctx.pd = pd;
+
+    ret = ipa_hbac_get_rule_set(access_ctx, &hbac_ctx, &rule_set);
     if (ret == EPERM) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "DENY rules detected. Denying access to all users\n");
@@ -530,9 +858,15 @@ errno_t ipa_hbac_evaluate_rules(struct be_ctx *be_ctx,
         goto done;
     }
 
+    ret = hbac_ctx_to_eval_request(tmp_ctx, &hbac_ctx, &eval_req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not construct eval request\n");
+        goto done;
+    }
+
     hbac_enable_debug(hbac_debug_messages);
 
-    result = hbac_evaluate(hbac_rules, eval_req, &info);
+    result = hbac_evaluate_compiled(rule_set->compiled, eval_req, &info);
     if (result == HBAC_EVAL_ALLOW) {
         DEBUG(SSSDBG_MINOR_FAILURE, "Access granted by HBAC rule [%s]\n",
               info->rule_name);
@@ -563,10 +897,23 @@ struct ipa_pam_access_handler_state {
     struct be_ctx *be_ctx;
     struct ipa_access_ctx *access_ctx;
     struct pam_data *pd;
+
+    /* The LDAP based checks and the HBAC rule refresh run concurrently,
+     * the HBAC rules are only evaluated if the LDAP based checks allowed
+     * the access. */
+    uint64_t sdap_start_time;
+    bool sdap_done;
+    errno_t sdap_ret;
+
+    struct tevent_req *hbac_req;
+    uint64_t hbac_start_time;
+    bool hbac_done;
+    errno_t hbac_ret;
 };
 
 static void ipa_pam_access_handler_sdap_done(struct tevent_req *subreq);
-static void ipa_pam_access_handler_done(struct tevent_req *subreq);
+static void ipa_pam_access_handler_hbac_done(struct tevent_req *subreq);
+static void ipa_pam_access_handler_done(struct tevent_req *req);
 
 struct tevent_req *
 ipa_pam_access_handler_send(TALLOC_CTX *mem_ctx,
@@ -590,6 +937,7 @@ ipa_pam_access_handler_send(TALLOC_CTX *mem_ctx,
     state->be_ctx = params->be_ctx;
     state->access_ctx = access_ctx;
 
+    state->sdap_start_time = get_start_time();
     subreq = sdap_access_send(state, params->ev, params->be_ctx,
                               params->domain, access_ctx->sdap_access_ctx,
                               access_ctx->sdap_ctx->conn, pd);
@@ -600,6 +948,18 @@ ipa_pam_access_handler_send(TALLOC_CTX *mem_ctx,
 
     tevent_req_set_callback(subreq, ipa_pam_access_handler_sdap_done, req);
 
+    state->hbac_start_time = get_start_time();
+    state->hbac_req = ipa_fetch_hbac_send(state, state->ev, state->be_ctx,
+                                          state->access_ctx);
+    if (state->hbac_req == NULL) {
+        talloc_free(subreq);
+        state->pd->pam_status = PAM_SYSTEM_ERR;
+        goto immediately;
+    }
+
+    tevent_req_set_callback(state->hbac_req,
+                            ipa_pam_access_handler_hbac_done, req);
+
     return req;
 
 immediately:
@@ -614,14 +974,68 @@ static void ipa_pam_access_handler_sdap_done(struct tevent_req *subreq)
 {
     struct ipa_pam_access_handler_state *state;
     struct tevent_req *req;
-    errno_t ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct ipa_pam_access_handler_state);
 
-    ret = sdap_access_recv(subreq);
+    state->sdap_ret = sdap_access_recv(subreq);
+    talloc_free(subreq);
+    state->sdap_done = true;
+
+    DEBUG(SSSDBG_PERF_STAT, "LDAP based access control returned [%d]: %s, "
+          "took %s.\n", state->sdap_ret, sss_strerror(state->sdap_ret),
+          sss_format_time(get_spend_time_us(state->sdap_start_time)));
+
+    switch (state->sdap_ret) {
+    case ERR_ACCESS_DENIED:
+    case ERR_PASSWORD_EXPIRED_REJECT:
+    case ERR_ACCOUNT_EXPIRED:
+        /* The HBAC rules do not matter any more */
+        talloc_zfree(state->hbac_req);
+        state->hbac_done = true;
+        break;
+    default:
+        break;
+    }
+
+    ipa_pam_access_handler_done(req);
+}
+
+static void ipa_pam_access_handler_hbac_done(struct tevent_req *subreq)
+{
+    struct ipa_pam_access_handler_state *state;
+    struct tevent_req *req;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct ipa_pam_access_handler_state);
+
+    state->hbac_ret = ipa_fetch_hbac_recv(subreq);
     talloc_free(subreq);
-    switch (ret) {
+    state->hbac_req = NULL;
+    state->hbac_done = true;
+
+    DEBUG(SSSDBG_PERF_STAT, "Fetching HBAC rules returned [%d]: %s, "
+          "took %s.\n", state->hbac_ret, sss_strerror(state->hbac_ret),
+          sss_format_time(get_spend_time_us(state->hbac_start_time)));
+
+    ipa_pam_access_handler_done(req);
+}
+
+static void ipa_pam_access_handler_done(struct tevent_req *req)
+{
+    struct ipa_pam_access_handler_state *state;
+    int preset_pam_status;
+    uint64_t start_time;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct ipa_pam_access_handler_state);
+
+    if (!state->sdap_done || !state->hbac_done) {
+        /* wait for the other check */
+        return;
+    }
+
+    switch (state->sdap_ret) {
     case EOK:
     case ERR_PASSWORD_EXPIRED_WARN:
         /* Account wasn't locked. Continue below to HBAC processing. */
@@ -640,43 +1054,12 @@ static void ipa_pam_access_handler_sdap_done(struct tevent_req *subreq)
         goto done;
     default:
         DEBUG(SSSDBG_CRIT_FAILURE, "Error retrieving access check result "
-              "[%d]: %s.\n", ret, sss_strerror(ret));
+              "[%d]: %s.\n", state->sdap_ret, sss_strerror(state->sdap_ret));
         state->pd->pam_status = PAM_SYSTEM_ERR;
         break;
     }
 
-    subreq = ipa_fetch_hbac_send(state, state->ev, state->be_ctx,
-                                 state->access_ctx);
-    if (subreq == NULL) {
-        state->pd->pam_status = PAM_SYSTEM_ERR;
-        goto done;
-    }
-
-    /* The callback function will not overwrite pam_status in case of
-     * success. Because of that, pam_status must be set to the desired
-     * value in advance. */
-    tevent_req_set_callback(subreq, ipa_pam_access_handler_done, req);
-
-    return;
-
-done:
-    /* TODO For backward compatibility we always return EOK to DP now. */
-    tevent_req_done(req);
-}
-
-static void ipa_pam_access_handler_done(struct tevent_req *subreq)
-{
-    struct ipa_pam_access_handler_state *state;
-    struct tevent_req *req;
-    int preset_pam_status;
-    errno_t ret;
-
-    req = tevent_req_callback_data(subreq, struct tevent_req);
-    state = tevent_req_data(req, struct ipa_pam_access_handler_state);
-
-    ret = ipa_fetch_hbac_recv(subreq);
-    talloc_free(subreq);
-
+    ret = state->hbac_ret;
     if (ret == ENOENT) {
         DEBUG(SSSDBG_CRIT_FAILURE, "No HBAC rules found, denying access\n");
         state->pd->pam_status = PAM_PERM_DENIED;
@@ -692,8 +1075,12 @@ static void ipa_pam_access_handler_done(struct tevent_req *subreq)
        we don't want that. Save the previous value and set it back in case
        of succcess. */
     preset_pam_status = state->pd->pam_status;
-    ret = ipa_hbac_evaluate_rules(state->be_ctx,
-                                  state->access_ctx->ipa_options, state->pd);
+    start_time = get_start_time();
+    ret = ipa_hbac_evaluate_rules(state->be_ctx, state->access_ctx,
+                                  state->pd);
+    DEBUG(SSSDBG_PERF_STAT, "Evaluating HBAC rules returned [%d]: %s, "
+          "took %s.\n", ret, sss_strerror(ret),
+          sss_format_time(get_spend_time_us(start_time)));
     if (ret == EOK) {
         state->pd->pam_status = preset_pam_status;
     } else if (ret == ERR_ACCESS_DENIED) {
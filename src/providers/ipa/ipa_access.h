@@ -32,12 +32,19 @@ enum ipa_access_mode {
     IPA_ACCESS_ALLOW
 };
 
+struct ipa_hbac_rule_set;
+
 struct ipa_access_ctx {
     struct sdap_id_ctx *sdap_ctx;
     struct dp_option *ipa_options;
     time_t last_update;
     struct sdap_access_ctx *sdap_access_ctx;
 
+    /* Changes whenever a refresh stores different HBAC data */
+    uint64_t hbac_generation;
+    /* Rules converted from the cache, valid for hbac_generation */
+    struct ipa_hbac_rule_set *hbac_rule_set;
+
     struct sdap_attr_map *host_map;
     struct sdap_attr_map *hostgroup_map;
     struct sdap_search_base **host_search_bases;
@@ -62,26 +62,22 @@ static errno_t
 hbac_attrs_to_rule(TALLOC_CTX *mem_ctx,
                    struct hbac_ctx *hbac_ctx,
                    size_t index,
+                   char ***unresolved_users,
                    struct hbac_rule **rule);
 
-static errno_t
-hbac_ctx_to_eval_request(TALLOC_CTX *mem_ctx,
-                         struct hbac_ctx *hbac_ctx,
-                         struct hbac_eval_req **request);
-
 errno_t
-hbac_ctx_to_rules(TALLOC_CTX *mem_ctx,
-                  struct hbac_ctx *hbac_ctx,
-                  struct hbac_rule ***rules,
-                  struct hbac_eval_req **request)
+hbac_ctx_to_rule_list(TALLOC_CTX *mem_ctx,
+                      struct hbac_ctx *hbac_ctx,
+                      struct hbac_rule ***rules,
+                      char ***unresolved_users)
 {
     errno_t ret;
     struct hbac_rule **new_rules;
-    struct hbac_eval_req *new_request = NULL;
+    char **unresolved;
     size_t i;
     TALLOC_CTX *tmp_ctx = NULL;
 
-    if (!rules || !request) return EINVAL;
+    if (!rules) return EINVAL;
 
     tmp_ctx = talloc_new(mem_ctx);
     if (tmp_ctx == NULL) return ENOMEM;
@@ -89,14 +85,16 @@ hbac_ctx_to_rules(TALLOC_CTX *mem_ctx,
     /* First create an array of rules */
     new_rules = talloc_array(tmp_ctx, struct hbac_rule *,
                              hbac_ctx->rule_count + 1);
-    if (new_rules == NULL) {
+    unresolved = talloc_zero_array(tmp_ctx, char *, 1);
+    if (new_rules == NULL || unresolved == NULL) {
         ret = ENOMEM;
         goto done;
     }
 
     /* Create each rule one at a time */
     for (i = 0; i < hbac_ctx->rule_count ; i++) {
-        ret = hbac_attrs_to_rule(new_rules, hbac_ctx, i, &(new_rules[i]));
+        ret = hbac_attrs_to_rule(new_rules, hbac_ctx, i, &unresolved,
+                                 &(new_rules[i]));
         if (ret == EPERM) {
             goto done;
         } else if (ret != EOK) {
@@ -106,15 +104,10 @@ hbac_ctx_to_rules(TALLOC_CTX *mem_ctx,
     }
     new_rules[i] = NULL;
 
-    /* Create the eval request */
-    ret = hbac_ctx_to_eval_request(tmp_ctx, hbac_ctx, &new_request);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "Could not construct eval request\n");
-        goto done;
-    }
-
     *rules = talloc_steal(mem_ctx, new_rules);
-    *request = talloc_steal(mem_ctx, new_request);
+    if (unresolved_users != NULL) {
+        *unresolved_users = talloc_steal(mem_ctx, unresolved);
+    }
     ret = EOK;
 
 done:
@@ -126,6 +119,7 @@ static errno_t
 hbac_attrs_to_rule(TALLOC_CTX *mem_ctx,
                    struct hbac_ctx *hbac_ctx,
                    size_t idx,
+                   char ***unresolved_users,
                    struct hbac_rule **rule)
 {
     errno_t ret;
@@ -174,6 +168,7 @@ hbac_attrs_to_rule(TALLOC_CTX *mem_ctx,
     ret = hbac_user_attrs_to_rule(new_rule, hbac_ctx->be_ctx->domain,
                                   new_rule->name,
                                   hbac_ctx->rules[idx],
+                                  unresolved_users,
                                   &new_rule->users);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "Could not parse users for rule [%s]\n",
@@ -282,7 +277,7 @@ hbac_eval_host_element(TALLOC_CTX *mem_ctx,
                        const char *hostname,
                        struct hbac_request_element **host_element);
 
-static errno_t
+errno_t
 hbac_ctx_to_eval_request(TALLOC_CTX *mem_ctx,
                          struct hbac_ctx *hbac_ctx,
                          struct hbac_eval_req **request)
@@ -44,6 +44,10 @@
 #define IPA_MEMBER_SERVICE "memberService"
 #define IPA_SERVICE_CATEGORY "serviceCategory"
 
+/* Requested to detect changes of the rules and services */
+#define IPA_ENTRY_USN "entryUSN"
+#define IPA_MODIFY_TIMESTAMP "modifyTimestamp"
+
 #define IPA_HBAC_BASE_TMPL "cn=hbac,%s"
 #define IPA_SERVICES_BASE_TMPL "cn=hbacservices,cn=accounts,%s"
 
@@ -59,10 +63,17 @@ replace_attribute_name(const char *old_name,
                        const char *new_name, const size_t count,
                        struct sysdb_attrs **list);
 
-errno_t hbac_ctx_to_rules(TALLOC_CTX *mem_ctx,
-                          struct hbac_ctx *hbac_ctx,
-                          struct hbac_rule ***rules,
-                          struct hbac_eval_req **request);
+/* Converts the cached rules of hbac_ctx. The original DNs of user
+ * members which are neither a cached user nor a group are returned in
+ * unresolved_users if it is not NULL. */
+errno_t hbac_ctx_to_rule_list(TALLOC_CTX *mem_ctx,
+                              struct hbac_ctx *hbac_ctx,
+                              struct hbac_rule ***rules,
+                              char ***unresolved_users);
+
+errno_t hbac_ctx_to_eval_request(TALLOC_CTX *mem_ctx,
+                                 struct hbac_ctx *hbac_ctx,
+                                 struct hbac_eval_req **request);
 
 errno_t
 hbac_get_category(struct sysdb_attrs *attrs,
@@ -121,6 +132,7 @@ hbac_user_attrs_to_rule(TALLOC_CTX *mem_ctx,
                         struct sss_domain_info *domain,
                         const char *rule_name,
                         struct sysdb_attrs *rule_attrs,
+                        char ***unresolved_users,
                         struct hbac_rule_element **users);
 
 errno_t
@@ -91,7 +91,7 @@ ipa_hbac_service_info_send(TALLOC_CTX *mem_ctx,
     state->service_filter = service_filter;
     state->cur_filter = NULL;
 
-    state->attrs = talloc_array(state, const char *, 6);
+    state->attrs = talloc_array(state, const char *, 8);
     if (state->attrs == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE,
               "Failed to allocate service attribute list.\n");
@@ -103,7 +103,9 @@ ipa_hbac_service_info_send(TALLOC_CTX *mem_ctx,
     state->attrs[2] = IPA_UNIQUE_ID;
     state->attrs[3] = IPA_MEMBER;
     state->attrs[4] = IPA_MEMBEROF;
-    state->attrs[5] = NULL;
+    state->attrs[5] = IPA_ENTRY_USN;
+    state->attrs[6] = IPA_MODIFY_TIMESTAMP;
+    state->attrs[7] = NULL;
 
     ret = ipa_hbac_service_info_next(req, state);
     if (ret == EOK) {
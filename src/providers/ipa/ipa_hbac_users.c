@@ -164,6 +164,7 @@ hbac_user_attrs_to_rule(TALLOC_CTX *mem_ctx,
                         struct sss_domain_info *domain,
                         const char *rule_name,
                         struct sysdb_attrs *rule_attrs,
+                        char ***unresolved_users,
                         struct hbac_rule_element **users)
 {
     errno_t ret;
@@ -335,6 +336,13 @@ hbac_user_attrs_to_rule(TALLOC_CTX *mem_ctx,
                     DEBUG(SSSDBG_CRIT_FAILURE,
                           "[%s] does not map to either a user or group. "
                               "Skipping\n", member_dn);
+
+                    /* It might be a user who is not cached yet */
+                    if (unresolved_users != NULL) {
+                        ret = add_string_to_list(mem_ctx, member_dn,
+                                                 unresolved_users);
+                        if (ret != EOK) goto done;
+                    }
                 }
             }
         }
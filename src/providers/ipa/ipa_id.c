@@ -873,7 +873,9 @@ static int ipa_id_get_account_info_post_proc_step(struct tevent_req *req)
                 || ((state->ar->entry_type & BE_REQ_TYPE_MASK) == BE_REQ_BY_UUID
                         && strcmp(class, SYSDB_GROUP_CLASS) == 0)) {
             /* check for ghost members because ghost members are not allowed
-             * if a view other than the default view is applied.*/
+             * if a view other than the default view is applied. With a view
+             * sysdb_store_group() keeps them in the entry and not in the
+             * ghost store. */
             state->ghosts = ldb_msg_find_element(state->obj_msg, SYSDB_GHOST);
         } else if ((state->ar->entry_type & BE_REQ_TYPE_MASK) == \
                         BE_REQ_INITGROUPS) {
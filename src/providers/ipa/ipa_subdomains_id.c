@@ -1407,6 +1407,7 @@ static errno_t ipa_check_ghost_members(struct tevent_req *req)
         }
     }
 
+    /* With a view the ghost members are never in the ghost store */
     ghosts = ldb_msg_find_element(state->obj_msg, SYSDB_GHOST);
 
     if (ghosts != NULL) {
@@ -220,7 +220,8 @@ int main(int argc, const char *argv[])
     bool needs_update;
     const char *username;
     const char *opt_logger = NULL;
-    uint64_t chain_id;
+    uint64_t chain_id = 0;
+    int helper = 0;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
@@ -231,6 +232,8 @@ int main(int argc, const char *argv[])
          _("An open file descriptor for the debug logs"), NULL},
         {"chain-id", 0, POPT_ARG_LONG, &chain_id,
          0, _("Tevent chain ID used for logging purposes"), NULL},
+        {SSS_CHILD_HELPER_OPT, 0, POPT_ARG_NONE, &helper, 0,
+         _("Serve requests until the input is closed"), NULL},
         SSSD_LOGGER_OPTS
         POPT_TABLEEND
     };
@@ -319,6 +322,10 @@ int main(int argc, const char *argv[])
           "Running with real IDs [%"SPRIuid"][%"SPRIgid"].\n",
           getuid(), getgid());
 
+    if (helper != 0) {
+        sss_child_helper_serve("selinux_child", STDIN_FILENO, STDOUT_FILENO);
+    }
+
     main_ctx = talloc_new(NULL);
     if (main_ctx == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc_new failed.\n");
@@ -439,6 +439,7 @@ struct krb5_auth_state {
     struct krb5child_req *kr;
 
     bool search_kpasswd;
+    uint64_t child_start_time;
 
     int pam_status;
     int dp_err;
@@ -792,6 +793,7 @@ static void krb5_auth_resolve_done(struct tevent_req *subreq)
         kr->is_offline = false;
     }
 
+    state->child_start_time = get_start_time();
     subreq = handle_child_send(state, state->ev, kr);
     if (subreq == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "handle_child_send failed.\n");
@@ -894,6 +896,13 @@ static void krb5_auth_done(struct tevent_req *subreq)
         goto done;
     }
 
+    /* Let fail over know how fast the KDC answered the authentication */
+    if (pd->cmd == SSS_PAM_AUTHENTICATE && !kr->is_offline
+            && res->msg_status != ERR_NETWORK_IO) {
+        fo_server_report_latency(kr->srv, FO_LATENCY_KRB5_AUTH,
+                                 get_spend_time_us(state->child_start_time));
+    }
+
     if (res->ccname) {
         kr->ccname = talloc_strdup(kr, res->ccname);
         if (!kr->ccname) {
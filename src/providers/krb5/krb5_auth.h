@@ -50,6 +50,7 @@
 #define CHILD_OPT_SSS_CREDS_PASSWORD "sss-creds-password"
 #define CHILD_OPT_CHAIN_ID "chain-id"
 #define CHILD_OPT_CHECK_PAC "check-pac"
+#define CHILD_OPT_WORKER "worker"
 
 struct krb5child_req {
     struct pam_data *pd;
@@ -109,6 +110,41 @@ struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
 int handle_child_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
                       uint8_t **buf, ssize_t *len);
 
+/* Starts krb5_child with the given arguments. The returned file descriptors
+ * are non-blocking and owned by the caller. */
+errno_t krb5_child_exec(const char **extra_args,
+                        pid_t *_pid,
+                        int *_read_fd,
+                        int *_write_fd);
+
+/* krb5_child_pool.c */
+struct krb5_child_pool;
+struct krb5_child_worker;
+
+struct krb5_child_pool *krb5_child_pool_new(TALLOC_CTX *mem_ctx,
+                                            struct tevent_context *ev,
+                                            size_t size,
+                                            size_t max_requests);
+
+/* Returns an idle worker started with the same arguments as a krb5_child
+ * for this request would be, or EBUSY if there is none and the pool cannot
+ * start another one. The worker is released by the request sent to it. */
+errno_t krb5_child_pool_acquire(struct krb5_child_pool *pool,
+                                struct krb5child_req *kr,
+                                struct krb5_child_worker **_worker);
+
+pid_t krb5_child_worker_pid(struct krb5_child_worker *worker);
+
+struct tevent_req *krb5_child_worker_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct krb5_child_worker *worker,
+                                          uint8_t *buf,
+                                          size_t len);
+errno_t krb5_child_worker_recv(struct tevent_req *req,
+                               TALLOC_CTX *mem_ctx,
+                               uint8_t **_buf,
+                               ssize_t *_len);
+
 struct krb5_child_response {
     int32_t msg_status;
     struct tgt_times tgtt;
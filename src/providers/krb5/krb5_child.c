@@ -117,6 +117,10 @@ struct krb5_req {
 static krb5_context krb5_error_ctx;
 #define KRB5_CHILD_DEBUG(level, error) KRB5_DEBUG(level, krb5_error_ctx, error)
 
+/* In worker mode the context is created once by the worker and every
+ * process handling a request starts with a copy of it */
+static krb5_context k5c_worker_ctx = NULL;
+
 static errno_t k5c_attach_otp_info_msg(struct krb5_req *kr);
 static errno_t k5c_attach_oauth2_info_msg(struct krb5_req *kr, struct sss_idp_oauth2 *data);
 static errno_t k5c_attach_keep_alive_msg(struct krb5_req *kr);
@@ -3646,10 +3650,15 @@ static krb5_error_code privileged_krb5_setup(struct krb5_req *kr,
         DEBUG(SSSDBG_MINOR_FAILURE, "Realm not available.\n");
     }
 
-    kerr = krb5_init_context(&kr->ctx);
-    if (kerr != 0) {
-        KRB5_CHILD_DEBUG(SSSDBG_CRIT_FAILURE, kerr);
-        return kerr;
+    if (k5c_worker_ctx != NULL) {
+        kr->ctx = k5c_worker_ctx;
+        k5c_worker_ctx = NULL;
+    } else {
+        kerr = krb5_init_context(&kr->ctx);
+        if (kerr != 0) {
+            KRB5_CHILD_DEBUG(SSSDBG_CRIT_FAILURE, kerr);
+            return kerr;
+        }
     }
 
     kerr = check_keytab_name(kr);
@@ -3738,6 +3747,82 @@ static void try_open_krb5_conf(void)
     }
 }
 
+/* Serves requests until the backend closes the pipe. Each request is
+ * preceded by its chain ID and handled by a new process which drops the
+ * privileges to the user while the worker keeps its own. The function only
+ * returns in the process handling a request, the worker exits here. */
+static void k5c_worker_loop(void)
+{
+    krb5_error_code kerr;
+    uint64_t chain_id;
+    size_t len;
+    ssize_t ret;
+    pid_t worker_pid;
+    pid_t pid;
+    int status;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "krb5_child worker started.\n");
+
+    /* Reading krb5.conf is the most expensive part of the setup which is
+     * not specific to the request */
+    kerr = krb5_init_context(&k5c_worker_ctx);
+    if (kerr != 0) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "krb5_init_context failed, each request will create one.\n");
+        k5c_worker_ctx = NULL;
+    }
+
+    worker_pid = getpid();
+
+    while (true) {
+        errno = 0;
+        ret = sss_atomic_read_safe_s(STDIN_FILENO, &chain_id,
+                                     sizeof(chain_id), &len);
+        if (ret == -1 && errno == EIO) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Input closed, worker finished.\n");
+            exit(0);
+        } else if (ret != sizeof(chain_id) || len != sizeof(chain_id)) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot read the next request.\n");
+            exit(-1);
+        }
+
+        sss_chain_id_set(chain_id);
+
+        pid = fork();
+        if (pid == 0) {
+            /* Do not keep running if the backend kills the worker */
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != worker_pid) {
+                _exit(-1);
+            }
+
+            debug_prg_name = talloc_asprintf(NULL, "krb5_child[%d]", getpid());
+            if (debug_prg_name == NULL) {
+                _exit(-1);
+            }
+            return;
+        } else if (pid < 0) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "fork failed [%d]: %s\n",
+                  errno, strerror(errno));
+            exit(-1);
+        }
+
+        do {
+            errno = 0;
+            ret = waitpid(pid, &status, 0);
+        } while (ret == -1 && errno == EINTR);
+
+        /* The process sends the reply only if it succeeds. Otherwise the
+         * worker exits as well so that the backend notices the missing
+         * reply from the closed pipe like with a single krb5_child. */
+        if (ret == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Request process [%d] failed, stopping the worker.\n", pid);
+            exit(-1);
+        }
+    }
+}
+
 int main(int argc, const char *argv[])
 {
     struct krb5_req *kr = NULL;
@@ -3754,6 +3839,7 @@ int main(int argc, const char *argv[])
     uint64_t chain_id = 0;
     struct cli_opts cli_opts = { 0 };
     int sss_creds_password = 0;
+    int worker = 0;
     long dummy_long = 0;
 
     struct poptOption long_options[] = {
@@ -3789,6 +3875,8 @@ int main(int argc, const char *argv[])
          0, _("Tevent chain ID used for logging purposes"), NULL},
         {CHILD_OPT_CHECK_PAC, 0, POPT_ARG_LONG, &dummy_long, 0,
          _("Check PAC flags"), NULL},
+        {CHILD_OPT_WORKER, 0, POPT_ARG_NONE, &worker, 0,
+         _("Serve requests until the input is closed"), NULL},
         POPT_TABLEEND
     };
 
@@ -3853,6 +3941,10 @@ int main(int argc, const char *argv[])
 
     DEBUG(SSSDBG_TRACE_FUNC, "krb5_child started.\n");
 
+    if (worker != 0) {
+        k5c_worker_loop();
+    }
+
     kr = talloc_zero(NULL, struct krb5_req);
     if (kr == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
@@ -512,33 +512,16 @@ static void child_keep_alive_timeout(struct tevent_context *ev,
     krb5_child_terminate(io->pid);
 }
 
-static errno_t fork_child(struct tevent_context *ev,
-                          struct krb5child_req *kr,
-                          pid_t *_child_pid,
-                          struct child_io_fds **_io)
+errno_t krb5_child_exec(const char **extra_args,
+                        pid_t *_pid,
+                        int *_read_fd,
+                        int *_write_fd)
 {
-    TALLOC_CTX *tmp_ctx;
     int pipefd_to_child[2] = PIPE_INIT;
     int pipefd_from_child[2] = PIPE_INIT;
-    const char **krb5_child_extra_args;
-    struct child_io_fds *io;
-    struct tevent_timer *te;
-    struct timeval tv;
-    char *io_key;
     pid_t pid = 0;
     errno_t ret;
 
-    tmp_ctx = talloc_new(NULL);
-    if (tmp_ctx == NULL) {
-        return ENOMEM;
-    }
-
-    ret = set_extra_args(tmp_ctx, kr->krb5_ctx, kr->dom, &krb5_child_extra_args);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_OP_FAILURE, "set_extra_args failed.\n");
-        goto done;
-    }
-
     ret = pipe(pipefd_from_child);
     if (ret == -1) {
         ret = errno;
@@ -558,10 +541,10 @@ static errno_t fork_child(struct tevent_context *ev,
     pid = fork();
 
     if (pid == 0) { /* child */
-        exec_child_ex(tmp_ctx,
+        exec_child_ex(NULL,
                       pipefd_to_child, pipefd_from_child,
                       KRB5_CHILD, KRB5_CHILD_LOG_FILE,
-                      krb5_child_extra_args, false,
+                      extra_args, false,
                       STDIN_FILENO, STDOUT_FILENO);
 
         /* We should never get here */
@@ -576,6 +559,58 @@ static errno_t fork_child(struct tevent_context *ev,
 
     /* parent */
 
+    PIPE_FD_CLOSE(pipefd_from_child[1]);
+    PIPE_FD_CLOSE(pipefd_to_child[0]);
+    sss_fd_nonblocking(pipefd_from_child[0]);
+    sss_fd_nonblocking(pipefd_to_child[1]);
+
+    *_pid = pid;
+    *_read_fd = pipefd_from_child[0];
+    *_write_fd = pipefd_to_child[1];
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        PIPE_CLOSE(pipefd_from_child);
+        PIPE_CLOSE(pipefd_to_child);
+    }
+
+    return ret;
+}
+
+static errno_t fork_child(struct tevent_context *ev,
+                          struct krb5child_req *kr,
+                          pid_t *_child_pid,
+                          struct child_io_fds **_io)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char **krb5_child_extra_args;
+    struct child_io_fds *io;
+    struct tevent_timer *te;
+    struct timeval tv;
+    char *io_key;
+    int read_fd = -1;
+    int write_fd = -1;
+    pid_t pid = 0;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = set_extra_args(tmp_ctx, kr->krb5_ctx, kr->dom, &krb5_child_extra_args);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "set_extra_args failed.\n");
+        goto done;
+    }
+
+    ret = krb5_child_exec(krb5_child_extra_args, &pid, &read_fd, &write_fd);
+    if (ret != EOK) {
+        goto done;
+    }
+
     io = talloc_zero(tmp_ctx, struct child_io_fds);
     if (io == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "talloc failed.\n");
@@ -587,12 +622,10 @@ static errno_t fork_child(struct tevent_context *ev,
     io->pid = pid;
 
     /* Set file descriptors. */
-    io->read_from_child_fd = pipefd_from_child[0];
-    io->write_to_child_fd = pipefd_to_child[1];
-    PIPE_FD_CLOSE(pipefd_from_child[1]);
-    PIPE_FD_CLOSE(pipefd_to_child[0]);
-    sss_fd_nonblocking(io->read_from_child_fd);
-    sss_fd_nonblocking(io->write_to_child_fd);
+    io->read_from_child_fd = read_fd;
+    io->write_to_child_fd = write_fd;
+    read_fd = -1;
+    write_fd = -1;
 
     /* Add io to pid:io hash table. */
     io_key = talloc_asprintf(tmp_ctx, "%d", pid);
@@ -639,8 +672,8 @@ static errno_t fork_child(struct tevent_context *ev,
 
 done:
     if (ret != EOK) {
-        PIPE_CLOSE(pipefd_from_child);
-        PIPE_CLOSE(pipefd_to_child);
+        PIPE_FD_CLOSE(read_fd);
+        PIPE_FD_CLOSE(write_fd);
         krb5_child_terminate(pid);
     }
 
@@ -650,6 +683,70 @@ done:
 
 static void handle_child_step(struct tevent_req *subreq);
 static void handle_child_done(struct tevent_req *subreq);
+static void handle_child_worker_done(struct tevent_req *subreq);
+
+/* Sends the request to an idle krb5_child worker. Returns EBUSY if there is
+ * none and a separate krb5_child must be started. */
+static errno_t handle_child_worker(struct tevent_req *req,
+                                   struct tevent_context *ev,
+                                   struct krb5child_req *kr,
+                                   struct io_buffer *buf)
+{
+    struct handle_child_state *state = tevent_req_data(req,
+                                                     struct handle_child_state);
+    struct krb5_child_worker *worker;
+    struct tevent_req *subreq;
+    int pool_size;
+    errno_t ret;
+
+    pool_size = dp_opt_get_int(kr->krb5_ctx->opts, KRB5_CHILD_POOL_SIZE);
+
+    /* The pre-authentication might have to keep its process alive for the
+     * next step which is not possible with a worker */
+    if (pool_size <= 0 || kr->pd->cmd == SSS_PAM_PREAUTH) {
+        return EBUSY;
+    }
+
+    if (kr->krb5_ctx->child_pool == NULL) {
+        kr->krb5_ctx->child_pool = krb5_child_pool_new(kr->krb5_ctx, ev,
+                    pool_size,
+                    dp_opt_get_int(kr->krb5_ctx->opts, KRB5_CHILD_MAX_REQUESTS));
+        if (kr->krb5_ctx->child_pool == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    /* The timeout is set up before the request is written to the worker,
+     * once written it must not fail over to a separate krb5_child, which
+     * would run the request a second time. Killing the worker on timeout
+     * kills the process of the request too. */
+    ret = activate_child_timeout_handler(req, ev,
+                    dp_opt_get_int(kr->krb5_ctx->opts, KRB5_AUTH_TIMEOUT));
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to setup child timeout "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = krb5_child_pool_acquire(kr->krb5_ctx->child_pool, kr, &worker);
+    if (ret != EOK) {
+        talloc_zfree(state->timeout_handler);
+        return ret;
+    }
+
+    state->child_pid = krb5_child_worker_pid(worker);
+
+    /* Nothing was written if the request could not be created */
+    subreq = krb5_child_worker_send(state, ev, worker, buf->data, buf->size);
+    if (subreq == NULL) {
+        talloc_zfree(state->timeout_handler);
+        state->child_pid = -1;
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, handle_child_worker_done, req);
+
+    return EOK;
+}
 
 struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
                                      struct tevent_context *ev,
@@ -689,6 +786,14 @@ struct tevent_req *handle_child_send(TALLOC_CTX *mem_ctx,
     }
 
     if (kr->pd->child_pid == 0) {
+        ret = handle_child_worker(req, ev, kr, buf);
+        if (ret == EOK) {
+            return req;
+        } else if (ret != EBUSY) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Unable to use a krb5_child worker "
+                  "[%d]: %s\n", ret, sss_strerror(ret));
+        }
+
         /* Create new child. */
         ret = fork_child(ev, kr, &state->child_pid, &state->io);
         if (ret != EOK) {
@@ -804,6 +909,26 @@ done:
     tevent_req_done(req);
 }
 
+static void handle_child_worker_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct handle_child_state *state = tevent_req_data(req,
+                                                    struct handle_child_state);
+    int ret;
+
+    talloc_zfree(state->timeout_handler);
+
+    ret = krb5_child_worker_recv(subreq, state, &state->buf, &state->len);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
 int handle_child_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
                       uint8_t **buf, ssize_t *len)
 {
@@ -0,0 +1,525 @@
+/*
+    SSSD
+
+    Kerberos 5 Backend Module - Pool of krb5_child workers
+
+    A worker is a krb5_child started with the --worker option. It reads
+    the chain ID of the next request and forks a process which handles the
+    request exactly like a krb5_child started for it, so the backend only
+    has to prefix each request with the chain ID.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <signal.h>
+
+#include "util/util.h"
+#include "util/child_common.h"
+#include "util/sss_chain_id.h"
+#include "providers/krb5/krb5_common.h"
+#include "providers/krb5/krb5_auth.h"
+
+/* Idle workers are stopped after this time, same as the keep alive timeout
+ * of a single krb5_child */
+#define KRB5_CHILD_WORKER_IDLE_TIMEOUT 300
+
+struct krb5_child_worker {
+    struct krb5_child_worker *prev;
+    struct krb5_child_worker *next;
+
+    struct krb5_child_pool *pool;
+    struct sss_child_ctx_old *child_ctx;
+    struct tevent_timer *idle_timer;
+
+    /* The krb5_child arguments the worker was started with */
+    char *key;
+    pid_t pid;
+    int read_fd;
+    int write_fd;
+
+    size_t num_requests;
+    bool busy;
+    bool exited;
+    bool retired;
+};
+
+struct krb5_child_pool {
+    struct tevent_context *ev;
+    size_t size;
+    size_t max_requests;
+
+    struct krb5_child_worker *workers;
+    size_t num_workers;
+};
+
+struct krb5_child_pool *krb5_child_pool_new(TALLOC_CTX *mem_ctx,
+                                            struct tevent_context *ev,
+                                            size_t size,
+                                            size_t max_requests)
+{
+    struct krb5_child_pool *pool;
+
+    pool = talloc_zero(mem_ctx, struct krb5_child_pool);
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->ev = ev;
+    pool->size = size;
+    pool->max_requests = max_requests;
+
+    return pool;
+}
+
+static int krb5_child_worker_destructor(struct krb5_child_worker *worker)
+{
+    if (worker->child_ctx != NULL) {
+        /* Kills the worker and the process handling its current request */
+        child_handler_destroy(worker->child_ctx);
+        worker->child_ctx = NULL;
+    }
+
+    if (!worker->retired) {
+        DLIST_REMOVE(worker->pool->workers, worker);
+        worker->pool->num_workers--;
+    }
+
+    PIPE_FD_CLOSE(worker->read_fd);
+    PIPE_FD_CLOSE(worker->write_fd);
+
+    return 0;
+}
+
+/* Closing the input lets the worker finish the current request and exit */
+static void krb5_child_worker_retire(struct krb5_child_worker *worker)
+{
+    DEBUG(SSSDBG_TRACE_FUNC, "Stopping krb5_child worker [%d] after %zu "
+          "requests.\n", worker->pid, worker->num_requests);
+
+    DLIST_REMOVE(worker->pool->workers, worker);
+    worker->pool->num_workers--;
+    worker->retired = true;
+
+    talloc_zfree(worker->idle_timer);
+    PIPE_FD_CLOSE(worker->write_fd);
+
+    if (worker->child_ctx == NULL) {
+        talloc_free(worker);
+    }
+}
+
+static void krb5_child_worker_exited(int child_status,
+                                     struct tevent_signal *sige,
+                                     void *pvt)
+{
+    struct krb5_child_worker *worker;
+
+    worker = talloc_get_type(pvt, struct krb5_child_worker);
+
+    /* The child context is freed by the caller */
+    worker->child_ctx = NULL;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "krb5_child worker [%d] exited.\n", worker->pid);
+
+    /* The request reading from it will fail and release the worker */
+    if (worker->busy) {
+        worker->exited = true;
+        return;
+    }
+
+    talloc_free(worker);
+}
+
+static void krb5_child_worker_idle_timeout(struct tevent_context *ev,
+                                           struct tevent_timer *te,
+                                           struct timeval tv,
+                                           void *pvt)
+{
+    struct krb5_child_worker *worker;
+
+    worker = talloc_get_type(pvt, struct krb5_child_worker);
+    worker->idle_timer = NULL;
+
+    krb5_child_worker_retire(worker);
+}
+
+static void krb5_child_worker_release(struct krb5_child_worker *worker,
+                                      errno_t error)
+{
+    struct krb5_child_pool *pool = worker->pool;
+    struct timeval tv;
+
+    /* Without a complete reply the state of the pipes is unknown */
+    if (error != EOK || worker->exited) {
+        talloc_free(worker);
+        return;
+    }
+
+    worker->busy = false;
+    worker->num_requests++;
+
+    if (pool->max_requests != 0 && worker->num_requests >= pool->max_requests) {
+        krb5_child_worker_retire(worker);
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(KRB5_CHILD_WORKER_IDLE_TIMEOUT, 0);
+    worker->idle_timer = tevent_add_timer(pool->ev, worker, tv,
+                                          krb5_child_worker_idle_timeout,
+                                          worker);
+    if (worker->idle_timer == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to setup worker idle timeout.\n");
+        krb5_child_worker_retire(worker);
+    }
+}
+
+/* The worker arguments are the ones of a single krb5_child without the chain
+ * ID, which is sent with each request instead. */
+static errno_t krb5_child_worker_args(TALLOC_CTX *mem_ctx,
+                                      struct krb5child_req *kr,
+                                      const char ***_args,
+                                      char **_key)
+{
+    TALLOC_CTX *tmp_ctx;
+    const char **extra_args;
+    const char **args;
+    char *key;
+    size_t c;
+    size_t n = 0;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = set_extra_args(tmp_ctx, kr->krb5_ctx, kr->dom, &extra_args);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "set_extra_args failed.\n");
+        goto done;
+    }
+
+    for (c = 0; extra_args[c] != NULL; c++);
+
+    args = talloc_zero_array(tmp_ctx, const char *, c + 2);
+    key = talloc_strdup(tmp_ctx, "");
+    if (args == NULL || key == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (c = 0; extra_args[c] != NULL; c++) {
+        if (strncmp(extra_args[c], "--" CHILD_OPT_CHAIN_ID "=",
+                    sizeof("--" CHILD_OPT_CHAIN_ID "=") - 1) == 0) {
+            continue;
+        }
+
+        args[n] = extra_args[c];
+        n++;
+
+        key = talloc_asprintf_append(key, "%s ", extra_args[c]);
+        if (key == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    args[n] = "--" CHILD_OPT_WORKER;
+    args[n + 1] = NULL;
+
+    *_args = talloc_steal(mem_ctx, args);
+    talloc_steal(*_args, extra_args);
+    *_key = talloc_steal(mem_ctx, key);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t krb5_child_worker_start(struct krb5_child_pool *pool,
+                                       const char **args,
+                                       char *key,
+                                       struct krb5_child_worker **_worker)
+{
+    struct krb5_child_worker *worker;
+    errno_t ret;
+
+    worker = talloc_zero(pool, struct krb5_child_worker);
+    if (worker == NULL) {
+        return ENOMEM;
+    }
+
+    worker->pool = pool;
+    worker->key = talloc_steal(worker, key);
+    worker->read_fd = -1;
+    worker->write_fd = -1;
+    worker->retired = true;
+    talloc_set_destructor(worker, krb5_child_worker_destructor);
+
+    ret = krb5_child_exec(args, &worker->pid,
+                          &worker->read_fd, &worker->write_fd);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to start krb5_child worker "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = child_handler_setup(pool->ev, worker->pid, krb5_child_worker_exited,
+                              worker, &worker->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not set up child signal handler "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        kill(worker->pid, SIGKILL);
+        goto done;
+    }
+
+    DLIST_ADD(pool->workers, worker);
+    pool->num_workers++;
+    worker->retired = false;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started krb5_child worker [%d].\n", worker->pid);
+
+    *_worker = worker;
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(worker);
+    }
+
+    return ret;
+}
+
+errno_t krb5_child_pool_acquire(struct krb5_child_pool *pool,
+                                struct krb5child_req *kr,
+                                struct krb5_child_worker **_worker)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct krb5_child_worker *worker;
+    struct krb5_child_worker *idle = NULL;
+    const char **args;
+    char *key;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = krb5_child_worker_args(tmp_ctx, kr, &args, &key);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    DLIST_FOR_EACH(worker, pool->workers) {
+        if (worker->busy || worker->exited) {
+            continue;
+        }
+
+        if (strcmp(worker->key, key) == 0) {
+            break;
+        }
+
+        idle = worker;
+    }
+
+    if (worker == NULL) {
+        if (pool->num_workers >= pool->size) {
+            if (idle == NULL) {
+                ret = EBUSY;
+                goto done;
+            }
+
+            /* The settings changed, e.g. the KDC went offline */
+            krb5_child_worker_retire(idle);
+        }
+
+        ret = krb5_child_worker_start(pool, args, key, &worker);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    talloc_zfree(worker->idle_timer);
+    worker->busy = true;
+
+    *_worker = worker;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+pid_t krb5_child_worker_pid(struct krb5_child_worker *worker)
+{
+    return worker->pid;
+}
+
+struct krb5_child_worker_state {
+    struct tevent_context *ev;
+    struct krb5_child_worker *worker;
+    struct tevent_req *subreq;
+
+    uint8_t *buf;
+    ssize_t len;
+};
+
+static int krb5_child_worker_state_destructor(struct krb5_child_worker_state *state)
+{
+    /* The request was cancelled, e.g. by the timeout. The pending read must
+     * not outlive the file descriptors of the worker. */
+    if (state->worker != NULL) {
+        talloc_zfree(state->subreq);
+        talloc_free(state->worker);
+    }
+
+    return 0;
+}
+
+static void krb5_child_worker_written(struct tevent_req *subreq);
+static void krb5_child_worker_done(struct tevent_req *subreq);
+
+struct tevent_req *krb5_child_worker_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          struct krb5_child_worker *worker,
+                                          uint8_t *buf,
+                                          size_t len)
+{
+    struct krb5_child_worker_state *state;
+    struct tevent_req *req;
+    uint8_t *msg;
+    uint64_t chain_id;
+    uint32_t ulen;
+    size_t rp = 0;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct krb5_child_worker_state);
+    if (req == NULL) {
+        krb5_child_worker_release(worker, ENOMEM);
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->worker = worker;
+    talloc_set_destructor(state, krb5_child_worker_state_destructor);
+
+    /* Both parts are framed the same way as sss_atomic_write_safe_s() does,
+     * so the worker reads the chain ID and its process the request. */
+    msg = talloc_size(state, 2 * sizeof(uint32_t) + sizeof(uint64_t) + len);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    chain_id = sss_chain_id_get();
+    ulen = sizeof(uint64_t);
+    SAFEALIGN_COPY_UINT32(&msg[rp], &ulen, &rp);
+    safealign_memcpy(&msg[rp], &chain_id, sizeof(uint64_t), &rp);
+    ulen = len;
+    SAFEALIGN_COPY_UINT32(&msg[rp], &ulen, &rp);
+    safealign_memcpy(&msg[rp], buf, len, &rp);
+
+    state->subreq = write_pipe_send(state, ev, msg, rp, worker->write_fd);
+    if (state->subreq == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    tevent_req_set_callback(state->subreq, krb5_child_worker_written, req);
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
+    }
+
+    return req;
+}
+
+static void krb5_child_worker_written(struct tevent_req *subreq)
+{
+    struct krb5_child_worker_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct krb5_child_worker_state);
+
+    ret = write_pipe_recv(subreq);
+    talloc_zfree(state->subreq);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    state->subreq = read_pipe_safe_send(state, state->ev,
+                                        state->worker->read_fd);
+    if (state->subreq == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    tevent_req_set_callback(state->subreq, krb5_child_worker_done, req);
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        krb5_child_worker_release(state->worker, ret);
+        state->worker = NULL;
+        tevent_req_error(req, ret);
+    }
+}
+
+static void krb5_child_worker_done(struct tevent_req *subreq)
+{
+    struct krb5_child_worker_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct krb5_child_worker_state);
+
+    ret = read_pipe_safe_recv(subreq, state, &state->buf, &state->len);
+    talloc_zfree(state->subreq);
+
+    krb5_child_worker_release(state->worker, ret);
+    state->worker = NULL;
+
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+errno_t krb5_child_worker_recv(struct tevent_req *req,
+                               TALLOC_CTX *mem_ctx,
+                               uint8_t **_buf,
+                               ssize_t *_len)
+{
+    struct krb5_child_worker_state *state;
+
+    state = tevent_req_data(req, struct krb5_child_worker_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_buf = talloc_move(mem_ctx, &state->buf);
+    *_len = state->len;
+
+    return EOK;
+}
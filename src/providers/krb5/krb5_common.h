@@ -65,6 +65,9 @@ enum krb5_opts {
     KRB5_KDCINFO_LOOKAHEAD,
     KRB5_MAP_USER,
     KRB5_USE_SUBDOMAIN_REALM,
+    KRB5_CHILD_POOL_SIZE,
+    KRB5_CHILD_MAX_REQUESTS,
+    KRB5_RENEW_MAX_CONCURRENT,
 
     KRB5_OPTS
 };
@@ -137,6 +140,7 @@ struct krb5_ctx {
 
     hash_table_t *wait_queue_hash;
     hash_table_t *io_table;
+    struct krb5_child_pool *child_pool;
 
     enum krb5_config_type config_type;
 
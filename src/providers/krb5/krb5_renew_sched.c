@@ -0,0 +1,655 @@
+/*
+    SSSD
+
+    Kerberos 5 Backend Module -- Scheduler of automatic TGT renewals
+
+    Renewals are kept in a binary heap ordered by the time they should be
+    started. A single timer is armed for the earliest one. The start times
+    are spread with a random delay of at most one renewal interval so that
+    tickets obtained at the same time, e.g. after a restart, are not renewed
+    at the same moment. Due renewals are queued per realm and each realm
+    runs only a limited number of them at the same time.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "util/sss_ptr_hash.h"
+#include "providers/krb5/krb5_renew_sched.h"
+
+enum krb5_renew_state {
+    KRB5_RENEW_IDLE,
+    KRB5_RENEW_QUEUED,
+    KRB5_RENEW_WAITING,
+    KRB5_RENEW_RUNNING,
+};
+
+struct krb5_renew_realm {
+    struct krb5_renew_realm *prev;
+    struct krb5_renew_realm *next;
+
+    const char *name;
+    unsigned int running;
+    size_t num_waiting;
+    size_t batch;
+    struct krb5_renew_item *waiting;
+};
+
+struct krb5_renew_item {
+    struct krb5_renew_item *prev;
+    struct krb5_renew_item *next;
+
+    struct krb5_renew_sched *sched;
+    struct krb5_renew_realm *realm;
+    const char *key;
+    void *data;
+
+    enum krb5_renew_state state;
+    time_t renew_at;
+    time_t run_at;
+    size_t heap_idx;
+
+    /* Removed while the renewal was running */
+    bool detached;
+
+    /* A new ticket was added while the renewal was running */
+    bool requeue;
+    time_t next_renew_at;
+    time_t next_expires_at;
+    void *next_data;
+};
+
+struct krb5_renew_sched {
+    struct tevent_context *ev;
+    time_t interval;
+    unsigned int max_concurrent;
+    krb5_renew_send_fn send_fn;
+    krb5_renew_recv_fn recv_fn;
+    void *pvt;
+
+    hash_table_t *items;
+    struct krb5_renew_item **heap;
+    size_t heap_len;
+    struct krb5_renew_realm *realms;
+
+    struct tevent_timer *te;
+    time_t te_at;
+    bool paused;
+    bool freeing;
+
+    struct krb5_renew_stats stats;
+};
+
+static void krb5_renew_heap_swap(struct krb5_renew_sched *sched,
+                                 size_t a, size_t b)
+{
+    struct krb5_renew_item *tmp;
+
+    tmp = sched->heap[a];
+    sched->heap[a] = sched->heap[b];
+    sched->heap[b] = tmp;
+
+    sched->heap[a]->heap_idx = a;
+    sched->heap[b]->heap_idx = b;
+}
+
+static void krb5_renew_heap_up(struct krb5_renew_sched *sched, size_t idx)
+{
+    size_t parent;
+
+    while (idx > 0) {
+        parent = (idx - 1) / 2;
+        if (sched->heap[parent]->run_at <= sched->heap[idx]->run_at) {
+            break;
+        }
+        krb5_renew_heap_swap(sched, parent, idx);
+        idx = parent;
+    }
+}
+
+static void krb5_renew_heap_down(struct krb5_renew_sched *sched, size_t idx)
+{
+    size_t child;
+
+    while ((child = 2 * idx + 1) < sched->heap_len) {
+        if (child + 1 < sched->heap_len
+                && sched->heap[child + 1]->run_at < sched->heap[child]->run_at) {
+            child++;
+        }
+        if (sched->heap[idx]->run_at <= sched->heap[child]->run_at) {
+            break;
+        }
+        krb5_renew_heap_swap(sched, idx, child);
+        idx = child;
+    }
+}
+
+static errno_t krb5_renew_heap_push(struct krb5_renew_sched *sched,
+                                    struct krb5_renew_item *item)
+{
+    struct krb5_renew_item **heap;
+
+    if (sched->heap_len == talloc_array_length(sched->heap)) {
+        heap = talloc_realloc(sched, sched->heap, struct krb5_renew_item *,
+                              MAX(16, 2 * sched->heap_len));
+        if (heap == NULL) {
+            return ENOMEM;
+        }
+        sched->heap = heap;
+    }
+
+    item->heap_idx = sched->heap_len;
+    sched->heap[sched->heap_len] = item;
+    sched->heap_len++;
+    krb5_renew_heap_up(sched, item->heap_idx);
+
+    return EOK;
+}
+
+static void krb5_renew_heap_remove(struct krb5_renew_sched *sched,
+                                   struct krb5_renew_item *item)
+{
+    size_t idx = item->heap_idx;
+
+    sched->heap_len--;
+    if (idx == sched->heap_len) {
+        return;
+    }
+
+    sched->heap[idx] = sched->heap[sched->heap_len];
+    sched->heap[idx]->heap_idx = idx;
+    krb5_renew_heap_down(sched, idx);
+    krb5_renew_heap_up(sched, idx);
+}
+
+static void krb5_renew_item_unlink(struct krb5_renew_item *item)
+{
+    switch (item->state) {
+    case KRB5_RENEW_QUEUED:
+        krb5_renew_heap_remove(item->sched, item);
+        break;
+    case KRB5_RENEW_WAITING:
+        DLIST_REMOVE(item->realm->waiting, item);
+        item->realm->num_waiting--;
+        break;
+    case KRB5_RENEW_RUNNING:
+        item->realm->running--;
+        break;
+    case KRB5_RENEW_IDLE:
+        break;
+    }
+
+    item->state = KRB5_RENEW_IDLE;
+}
+
+static int krb5_renew_item_destructor(struct krb5_renew_item *item)
+{
+    if (!item->sched->freeing) {
+        krb5_renew_item_unlink(item);
+    }
+
+    return 0;
+}
+
+static int krb5_renew_sched_destructor(struct krb5_renew_sched *sched)
+{
+    sched->freeing = true;
+
+    return 0;
+}
+
+static void krb5_renew_sched_timer(struct tevent_context *ev,
+                                   struct tevent_timer *te,
+                                   struct timeval current_time,
+                                   void *pvt);
+
+static void krb5_renew_sched_arm(struct krb5_renew_sched *sched)
+{
+    time_t run_at;
+
+    if (sched->paused || sched->heap_len == 0) {
+        talloc_zfree(sched->te);
+        return;
+    }
+
+    run_at = sched->heap[0]->run_at;
+    if (sched->te != NULL && sched->te_at == run_at) {
+        return;
+    }
+
+    talloc_zfree(sched->te);
+    sched->te = tevent_add_timer(sched->ev, sched,
+                                 tevent_timeval_set(run_at, 0),
+                                 krb5_renew_sched_timer, sched);
+    if (sched->te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed, renewals will "
+              "be started when the next one is scheduled.\n");
+        return;
+    }
+    sched->te_at = run_at;
+}
+
+static errno_t krb5_renew_sched_queue(struct krb5_renew_sched *sched,
+                                      struct krb5_renew_item *item,
+                                      time_t renew_at,
+                                      time_t expires_at)
+{
+    time_t start;
+    time_t jitter;
+    errno_t ret;
+
+    start = MAX(renew_at, time(NULL));
+
+    /* Spread the renewals over the interval they were checked at before,
+     * but stay well before the ticket expires. */
+    jitter = MIN(sched->interval, (expires_at - start) / 2);
+    if (jitter > 0) {
+        start += sss_rand() % (jitter + 1);
+    }
+
+    item->renew_at = renew_at;
+    item->run_at = start;
+
+    ret = krb5_renew_heap_push(sched, item);
+    if (ret != EOK) {
+        return ret;
+    }
+    item->state = KRB5_RENEW_QUEUED;
+
+    DEBUG(SSSDBG_TRACE_LIBS, "Renewal of [%s] scheduled at [%.24s].\n",
+          item->key, ctime(&item->run_at));
+
+    return EOK;
+}
+
+static void krb5_renew_sched_retry(struct krb5_renew_sched *sched,
+                                   struct krb5_renew_item *item)
+{
+    errno_t ret;
+
+    sched->stats.deferred++;
+
+    item->run_at = time(NULL) + MAX(sched->interval, 1);
+    ret = krb5_renew_heap_push(sched, item);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot reschedule renewal of [%s].\n",
+              item->key);
+        talloc_free(item);
+        return;
+    }
+    item->state = KRB5_RENEW_QUEUED;
+}
+
+static void krb5_renew_sched_done(struct tevent_req *req);
+
+static void krb5_renew_sched_start(struct krb5_renew_sched *sched,
+                                   struct krb5_renew_item *item)
+{
+    struct tevent_req *req;
+
+    /* The ticket may be added again already while the request is created */
+    item->state = KRB5_RENEW_RUNNING;
+    item->realm->running++;
+
+    req = sched->send_fn(item, sched->ev, item->key, item->data, sched->pvt);
+    if (req == NULL) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot start renewal of [%s], "
+              "will retry later.\n", item->key);
+        krb5_renew_item_unlink(item);
+        krb5_renew_sched_retry(sched, item);
+        return;
+    }
+
+    tevent_req_set_callback(req, krb5_renew_sched_done, item);
+}
+
+static void krb5_renew_sched_run_realm(struct krb5_renew_sched *sched,
+                                       struct krb5_renew_realm *realm)
+{
+    struct krb5_renew_item *item;
+    unsigned int started = 0;
+    size_t deferred;
+
+    while (realm->waiting != NULL && !sched->paused
+            && (sched->max_concurrent == 0
+                    || realm->running < sched->max_concurrent)) {
+        item = realm->waiting;
+        DLIST_REMOVE(realm->waiting, item);
+        realm->num_waiting--;
+        item->state = KRB5_RENEW_IDLE;
+
+        krb5_renew_sched_start(sched, item);
+        started++;
+    }
+
+    /* Only count the renewals of the current batch which have to wait,
+     * the older ones were counted already. */
+    deferred = MIN(realm->batch, realm->num_waiting);
+    sched->stats.deferred += deferred;
+
+    if (realm->batch > 0) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Started %u renewals for realm [%s], "
+              "%zu deferred.\n", started, realm->name, deferred);
+    }
+    realm->batch = 0;
+}
+
+static void krb5_renew_sched_log_stats(struct krb5_renew_sched *sched)
+{
+    struct krb5_renew_stats stats;
+
+    krb5_renew_sched_get_stats(sched, &stats);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "TGT renewals: %"PRIu64" done, %"PRIu64" failed, "
+          "%"PRIu64" deferred, %zu queued, %zu running.\n",
+          stats.done, stats.failed, stats.deferred, stats.queued,
+          stats.running);
+}
+
+static void krb5_renew_sched_timer(struct tevent_context *ev,
+                                   struct tevent_timer *te,
+                                   struct timeval current_time,
+                                   void *pvt)
+{
+    struct krb5_renew_sched *sched;
+    struct krb5_renew_realm *realm;
+    struct krb5_renew_item *item;
+    time_t until;
+
+    sched = talloc_get_type(pvt, struct krb5_renew_sched);
+
+    /* forget the timer event, it will be freed by the tevent timer loop */
+    sched->te = NULL;
+
+    /* Batch the renewals due shortly to avoid a wakeup for each of them */
+    until = time(NULL) + KRB5_RENEW_BATCH_WINDOW;
+    while (sched->heap_len > 0 && sched->heap[0]->run_at <= until) {
+        item = sched->heap[0];
+        krb5_renew_heap_remove(sched, item);
+
+        item->state = KRB5_RENEW_WAITING;
+        DLIST_ADD_END(item->realm->waiting, item, struct krb5_renew_item *);
+        item->realm->num_waiting++;
+        item->realm->batch++;
+    }
+
+    DLIST_FOR_EACH(realm, sched->realms) {
+        krb5_renew_sched_run_realm(sched, realm);
+    }
+
+    krb5_renew_sched_log_stats(sched);
+    krb5_renew_sched_arm(sched);
+}
+
+static void krb5_renew_sched_done(struct tevent_req *req)
+{
+    struct krb5_renew_item *item;
+    struct krb5_renew_sched *sched;
+    struct krb5_renew_realm *realm;
+    enum krb5_renew_result result;
+    errno_t ret;
+
+    item = tevent_req_callback_data(req, struct krb5_renew_item);
+    sched = item->sched;
+    realm = item->realm;
+
+    result = sched->recv_fn(req);
+    talloc_free(req);
+
+    krb5_renew_item_unlink(item);
+
+    switch (result) {
+    case KRB5_RENEW_DONE:
+        DEBUG(SSSDBG_TRACE_FUNC, "Renewed [%s].\n", item->key);
+        sched->stats.done++;
+        break;
+    case KRB5_RENEW_FAILED:
+        DEBUG(SSSDBG_OP_FAILURE, "Failed to renew [%s].\n", item->key);
+        sched->stats.failed++;
+        break;
+    case KRB5_RENEW_RETRY:
+        DEBUG(SSSDBG_TRACE_FUNC, "Renewal of [%s] deferred.\n", item->key);
+        break;
+    }
+
+    if (item->detached) {
+        talloc_free(item);
+    } else if (item->requeue) {
+        talloc_free(item->data);
+        item->data = item->next_data;
+        item->next_data = NULL;
+        item->requeue = false;
+
+        ret = krb5_renew_sched_queue(sched, item, item->next_renew_at,
+                                     item->next_expires_at);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Cannot schedule renewal of [%s].\n",
+                  item->key);
+            talloc_free(item);
+        }
+    } else if (result == KRB5_RENEW_RETRY) {
+        krb5_renew_sched_retry(sched, item);
+    } else {
+        talloc_free(item);
+    }
+
+    /* A slot of the realm is free again */
+    krb5_renew_sched_run_realm(sched, realm);
+    krb5_renew_sched_arm(sched);
+}
+
+static struct krb5_renew_realm *
+krb5_renew_sched_get_realm(struct krb5_renew_sched *sched,
+                           const char *principal)
+{
+    struct krb5_renew_realm *realm;
+    const char *name;
+
+    name = strrchr(principal, '@');
+    name = (name == NULL) ? "" : name + 1;
+
+    DLIST_FOR_EACH(realm, sched->realms) {
+        if (strcmp(realm->name, name) == 0) {
+            return realm;
+        }
+    }
+
+    realm = talloc_zero(sched, struct krb5_renew_realm);
+    if (realm == NULL) {
+        return NULL;
+    }
+
+    realm->name = talloc_strdup(realm, name);
+    if (realm->name == NULL) {
+        talloc_free(realm);
+        return NULL;
+    }
+
+    DLIST_ADD_END(sched->realms, realm, struct krb5_renew_realm *);
+
+    return realm;
+}
+
+struct krb5_renew_sched *
+krb5_renew_sched_new(TALLOC_CTX *mem_ctx,
+                     struct tevent_context *ev,
+                     time_t interval,
+                     unsigned int max_concurrent,
+                     krb5_renew_send_fn send_fn,
+                     krb5_renew_recv_fn recv_fn,
+                     void *pvt)
+{
+    struct krb5_renew_sched *sched;
+
+    sched = talloc_zero(mem_ctx, struct krb5_renew_sched);
+    if (sched == NULL) {
+        return NULL;
+    }
+
+    sched->ev = ev;
+    sched->interval = interval;
+    sched->max_concurrent = max_concurrent;
+    sched->send_fn = send_fn;
+    sched->recv_fn = recv_fn;
+    sched->pvt = pvt;
+
+    sched->items = sss_ptr_hash_create(sched, NULL, NULL);
+    if (sched->items == NULL) {
+        talloc_free(sched);
+        return NULL;
+    }
+
+    talloc_set_destructor(sched, krb5_renew_sched_destructor);
+
+    return sched;
+}
+
+errno_t krb5_renew_sched_add(struct krb5_renew_sched *sched,
+                             const char *key,
+                             const char *principal,
+                             time_t renew_at,
+                             time_t expires_at,
+                             void *data)
+{
+    struct krb5_renew_item *item;
+    errno_t ret;
+
+    item = sss_ptr_hash_lookup(sched->items, key, struct krb5_renew_item);
+    if (item != NULL) {
+        if (item->state == KRB5_RENEW_RUNNING) {
+            if (renew_at != item->renew_at) {
+                talloc_free(item->next_data);
+                item->next_data = talloc_steal(item, data);
+                item->next_renew_at = renew_at;
+                item->next_expires_at = expires_at;
+                item->requeue = true;
+            } else {
+                talloc_free(data);
+            }
+            return EOK;
+        }
+
+        if (renew_at == item->renew_at) {
+            /* Already scheduled, keep the spread start time */
+            talloc_free(data);
+            return EOK;
+        }
+
+        krb5_renew_item_unlink(item);
+        talloc_free(item->data);
+        item->data = talloc_steal(item, data);
+    } else {
+        item = talloc_zero(sched, struct krb5_renew_item);
+        if (item == NULL) {
+            talloc_free(data);
+            return ENOMEM;
+        }
+        item->sched = sched;
+        item->data = talloc_steal(item, data);
+        talloc_set_destructor(item, krb5_renew_item_destructor);
+
+        item->key = talloc_strdup(item, key);
+        if (item->key == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        item->realm = krb5_renew_sched_get_realm(sched, principal);
+        if (item->realm == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sss_ptr_hash_add(sched->items, key, item,
+                               struct krb5_renew_item);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = krb5_renew_sched_queue(sched, item, renew_at, expires_at);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    krb5_renew_sched_arm(sched);
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot schedule renewal of [%s] "
+              "[%d]: %s\n", key, ret, sss_strerror(ret));
+        talloc_free(item);
+    }
+
+    return ret;
+}
+
+void krb5_renew_sched_remove(struct krb5_renew_sched *sched,
+                             const char *key)
+{
+    struct krb5_renew_item *item;
+
+    item = sss_ptr_hash_lookup(sched->items, key, struct krb5_renew_item);
+    if (item == NULL) {
+        return;
+    }
+
+    if (item->state == KRB5_RENEW_RUNNING) {
+        /* Let the renewal finish, the entry is freed afterwards */
+        sss_ptr_hash_delete(sched->items, key, false);
+        item->detached = true;
+        return;
+    }
+
+    talloc_free(item);
+    krb5_renew_sched_arm(sched);
+}
+
+void krb5_renew_sched_pause(struct krb5_renew_sched *sched, bool paused)
+{
+    struct krb5_renew_realm *realm;
+
+    if (sched->paused == paused) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%s TGT renewals.\n",
+          paused ? "Pausing" : "Resuming");
+    sched->paused = paused;
+
+    if (!paused) {
+        DLIST_FOR_EACH(realm, sched->realms) {
+            krb5_renew_sched_run_realm(sched, realm);
+        }
+    }
+
+    krb5_renew_sched_arm(sched);
+}
+
+void krb5_renew_sched_get_stats(struct krb5_renew_sched *sched,
+                                struct krb5_renew_stats *stats)
+{
+    struct krb5_renew_realm *realm;
+
+    *stats = sched->stats;
+    stats->queued = sched->heap_len;
+    stats->running = 0;
+
+    DLIST_FOR_EACH(realm, sched->realms) {
+        stats->queued += realm->num_waiting;
+        stats->running += realm->running;
+    }
+}
@@ -0,0 +1,86 @@
+/*
+    SSSD
+
+    Kerberos 5 Backend Module -- Scheduler of automatic TGT renewals
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __KRB5_RENEW_SCHED_H__
+#define __KRB5_RENEW_SCHED_H__
+
+#include "util/util.h"
+
+/* Renewals due within this many seconds are started by the same wakeup */
+#define KRB5_RENEW_BATCH_WINDOW 5
+
+enum krb5_renew_result {
+    KRB5_RENEW_DONE,    /* renewed, drop the entry unless it was re-added */
+    KRB5_RENEW_FAILED,  /* cannot be renewed, drop the entry */
+    KRB5_RENEW_RETRY,   /* e.g. offline, try again after the interval */
+};
+
+typedef struct tevent_req *
+(*krb5_renew_send_fn)(TALLOC_CTX *mem_ctx,
+                      struct tevent_context *ev,
+                      const char *key,
+                      void *data,
+                      void *pvt);
+
+typedef enum krb5_renew_result
+(*krb5_renew_recv_fn)(struct tevent_req *req);
+
+struct krb5_renew_stats {
+    uint64_t done;
+    uint64_t failed;
+    uint64_t deferred;
+    size_t queued;
+    size_t running;
+};
+
+struct krb5_renew_sched;
+
+/* Renewals are started no earlier than requested, spread randomly over at
+ * most @interval seconds. At most @max_concurrent renewals per realm run at
+ * the same time (0 means no limit). */
+struct krb5_renew_sched *
+krb5_renew_sched_new(TALLOC_CTX *mem_ctx,
+                     struct tevent_context *ev,
+                     time_t interval,
+                     unsigned int max_concurrent,
+                     krb5_renew_send_fn send_fn,
+                     krb5_renew_recv_fn recv_fn,
+                     void *pvt);
+
+/* Schedules the renewal of the ticket identified by @key of @principal
+ * at @renew_at. The ticket expires at @expires_at. @data is stolen and
+ * passed to the send function. An existing entry with the same key is
+ * replaced unless it is already scheduled for the same @renew_at. */
+errno_t krb5_renew_sched_add(struct krb5_renew_sched *sched,
+                             const char *key,
+                             const char *principal,
+                             time_t renew_at,
+                             time_t expires_at,
+                             void *data);
+
+void krb5_renew_sched_remove(struct krb5_renew_sched *sched,
+                             const char *key);
+
+/* No renewals are started while the scheduler is paused */
+void krb5_renew_sched_pause(struct krb5_renew_sched *sched, bool paused);
+
+void krb5_renew_sched_get_stats(struct krb5_renew_sched *sched,
+                                struct krb5_renew_stats *stats);
+
+#endif /* __KRB5_RENEW_SCHED_H__ */
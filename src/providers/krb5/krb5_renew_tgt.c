@@ -28,14 +28,14 @@
 #include "providers/krb5/krb5_auth.h"
 #include "providers/krb5/krb5_utils.h"
 #include "providers/krb5/krb5_ccache.h"
+#include "providers/krb5/krb5_renew_sched.h"
 
 struct renew_tgt_ctx {
     hash_table_t *tgt_table;
     struct be_ctx *be_ctx;
     struct tevent_context *ev;
     struct krb5_ctx *krb5_ctx;
-    time_t timer_interval;
-    struct tevent_timer *te;
+    struct krb5_renew_sched *sched;
 };
 
 struct renew_data {
@@ -56,40 +56,122 @@ struct auth_data {
 };
 
 
-static void renew_tgt_done(struct tevent_req *req);
-static void renew_tgt(struct tevent_context *ev, struct tevent_timer *te,
-                      struct timeval current_time, void *private_data)
+struct renew_tgt_state {
+    struct auth_data *auth_data;
+    enum krb5_renew_result result;
+};
+
+static void renew_tgt_done(struct tevent_req *subreq);
+
+static struct tevent_req *renew_tgt_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         const char *key,
+                                         void *data,
+                                         void *pvt)
 {
-    struct auth_data *auth_data = talloc_get_type(private_data,
-                                                  struct auth_data);
+    struct renew_tgt_ctx *renew_tgt_ctx = talloc_get_type(pvt,
+                                                          struct renew_tgt_ctx);
+    struct renew_tgt_state *state;
     struct tevent_req *req;
+    struct tevent_req *subreq;
+    struct auth_data *auth_data;
+    struct renew_data *renew_data;
+    hash_key_t hkey;
+    hash_value_t value;
+    int ret;
 
-    req = krb5_auth_queue_send(auth_data, ev, auth_data->be_ctx, auth_data->pd,
-                               auth_data->krb5_ctx);
+    req = tevent_req_create(mem_ctx, &state, struct renew_tgt_state);
     if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_req_create failed.\n");
+        return NULL;
+    }
+
+    hkey.type = HASH_KEY_STRING;
+    hkey.str = discard_const_p(char, key);
+    ret = hash_lookup(renew_tgt_ctx->tgt_table, &hkey, &value);
+    if (ret != HASH_SUCCESS || value.type != HASH_VALUE_PTR) {
+        DEBUG(SSSDBG_OP_FAILURE, "No renewal data for [%s].\n", key);
+        state->result = KRB5_RENEW_FAILED;
+        goto immediately;
+    }
+
+    renew_data = talloc_get_type(value.ptr, struct renew_data);
+    DEBUG(SSSDBG_TRACE_ALL, "Renewing [%s].\n", renew_data->ccfile);
+
+    /* If renew_data->pd == NULL a renewal request for this data is
+     * currently running so we skip it. */
+    if (renew_data->pd == NULL) {
+        state->result = KRB5_RENEW_RETRY;
+        goto immediately;
+    }
+
+    auth_data = talloc_zero(state, struct auth_data);
+    if (auth_data == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+        talloc_free(req);
+        return NULL;
+    }
+
+    auth_data->key.type = HASH_KEY_STRING;
+    auth_data->key.str = talloc_strdup(auth_data, key);
+    if (auth_data->key.str == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "talloc_strdup failed.\n");
+        talloc_free(req);
+        return NULL;
+    }
+
+/* We need to steal the pam_data here, because a successful renewal of the
+ * ticket might add a new renewal item to the list with the same key (upn).
+ * This would delete renew_data and all its children. But we cannot be sure
+ * that adding the new renewal item is the last operation of the renewal
+ * process with access the pam_data. To be on the safe side we steal the
+ * pam_data and make it a child of auth_data which is only freed after the
+ * renewal process is finished. In the case of an error during renewal we
+ * might want to steal the pam_data back to renew_data before freeing
+ * auth_data to allow a new renewal attempt. */
+    auth_data->pd = talloc_move(auth_data, &renew_data->pd);
+    auth_data->krb5_ctx = renew_tgt_ctx->krb5_ctx;
+    auth_data->be_ctx = renew_tgt_ctx->be_ctx;
+    auth_data->table = renew_tgt_ctx->tgt_table;
+    auth_data->renew_data = renew_data;
+    state->auth_data = auth_data;
+
+    subreq = krb5_auth_queue_send(state, ev, auth_data->be_ctx, auth_data->pd,
+                                  auth_data->krb5_ctx);
+    if (subreq == NULL) {
         DEBUG(SSSDBG_CRIT_FAILURE, "krb5_auth_send failed.\n");
 /* Give back the pam data to the renewal item to be able to retry at the next
  * time the renewals re run. */
-        auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
-                                                 auth_data->pd);
-        talloc_free(auth_data);
-        return;
+        renew_data->pd = talloc_steal(renew_data, auth_data->pd);
+        talloc_free(req);
+        return NULL;
     }
 
-    tevent_req_set_callback(req, renew_tgt_done, auth_data);
+    tevent_req_set_callback(subreq, renew_tgt_done, req);
+
+    return req;
+
+immediately:
+    tevent_req_done(req);
+    tevent_req_post(req, ev);
+
+    return req;
 }
 
-static void renew_tgt_done(struct tevent_req *req)
+static void renew_tgt_done(struct tevent_req *subreq)
 {
-    struct auth_data *auth_data = tevent_req_callback_data(req,
-                                                           struct auth_data);
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct renew_tgt_state *state = tevent_req_data(req,
+                                                    struct renew_tgt_state);
+    struct auth_data *auth_data = state->auth_data;
     int ret;
     int pam_status = PAM_SYSTEM_ERR;
     int dp_err;
     hash_value_t value;
 
-    ret = krb5_auth_queue_recv(req, &pam_status, &dp_err);
-    talloc_free(req);
+    ret = krb5_auth_queue_recv(subreq, &pam_status, &dp_err);
+    talloc_free(subreq);
     if (ret) {
         DEBUG(SSSDBG_CRIT_FAILURE, "krb5_auth request failed.\n");
         if (auth_data->renew_data != NULL) {
@@ -97,6 +179,7 @@ static void renew_tgt_done(struct tevent_req *req)
             auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
                                                      auth_data->pd);
         }
+        state->result = KRB5_RENEW_RETRY;
     } else {
         switch (pam_status) {
             case PAM_SUCCESS:
@@ -124,6 +207,7 @@ static void renew_tgt_done(struct tevent_req *req)
                         }
                     }
                 }
+                state->result = KRB5_RENEW_DONE;
                 break;
             case PAM_AUTHINFO_UNAVAIL:
             case PAM_AUTHTOK_LOCK_BUSY:
@@ -136,6 +220,7 @@ static void renew_tgt_done(struct tevent_req *req)
                     auth_data->renew_data->pd = talloc_steal(auth_data->renew_data,
                                                              auth_data->pd);
                 }
+                state->result = KRB5_RENEW_RETRY;
                 break;
             default:
                 DEBUG(SSSDBG_CRIT_FAILURE,
@@ -145,97 +230,28 @@ static void renew_tgt_done(struct tevent_req *req)
                 if (ret != HASH_SUCCESS) {
                     DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
                 }
+                state->result = KRB5_RENEW_FAILED;
         }
     }
 
-    talloc_zfree(auth_data);
+    tevent_req_done(req);
 }
 
-static errno_t renew_all_tgts(struct renew_tgt_ctx *renew_tgt_ctx)
+static enum krb5_renew_result renew_tgt_recv(struct tevent_req *req)
 {
-    int ret;
-    hash_entry_t *entries;
-    unsigned long count;
-    size_t c;
-    time_t now;
-    struct auth_data *auth_data;
-    struct renew_data *renew_data;
-    struct tevent_timer *te = NULL;
-
-    ret = hash_entries(renew_tgt_ctx->tgt_table, &count, &entries);
-    if (ret != HASH_SUCCESS) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "hash_entries failed.\n");
-        return ENOMEM;
-    }
+    struct renew_tgt_state *state = tevent_req_data(req,
+                                                    struct renew_tgt_state);
 
-    now = time(NULL);
-
-    for (c = 0; c < count; c++) {
-        renew_data = talloc_get_type(entries[c].value.ptr, struct renew_data);
-        DEBUG(SSSDBG_TRACE_ALL,
-              "Checking [%s] for renewal at [%.24s].\n", renew_data->ccfile,
-                  ctime(&renew_data->start_renew_at));
-        /* If renew_data->pd == NULL a renewal request for this data is
-         * currently running so we skip it. */
-        if (renew_data->start_renew_at < now && renew_data->pd != NULL) {
-            auth_data = talloc_zero(renew_tgt_ctx, struct auth_data);
-            if (auth_data == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
-            } else {
-/* We need to steal the pam_data here, because a successful renewal of the
- * ticket might add a new renewal item to the list with the same key (upn).
- * This would delete renew_data and all its children. But we cannot be sure
- * that adding the new renewal item is the last operation of the renewal
- * process with access the pam_data. To be on the safe side we steal the
- * pam_data and make it a child of auth_data which is only freed after the
- * renewal process is finished. In the case of an error during renewal we
- * might want to steal the pam_data back to renew_data before freeing
- * auth_data to allow a new renewal attempt. */
-                auth_data->pd = talloc_move(auth_data, &renew_data->pd);
-                auth_data->krb5_ctx = renew_tgt_ctx->krb5_ctx;
-                auth_data->be_ctx = renew_tgt_ctx->be_ctx;
-                auth_data->table = renew_tgt_ctx->tgt_table;
-                auth_data->renew_data = renew_data;
-                auth_data->key.type = entries[c].key.type;
-                auth_data->key.str = talloc_strdup(auth_data,
-                                                   entries[c].key.str);
-                if (auth_data->key.str == NULL) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "talloc_strdup failed.\n");
-                } else {
-                    te = tevent_add_timer(renew_tgt_ctx->ev,
-                                          auth_data, tevent_timeval_current(),
-                                          renew_tgt, auth_data);
-                    if (te == NULL) {
-                        DEBUG(SSSDBG_CRIT_FAILURE,
-                              "tevent_add_timer failed.\n");
-                    }
-                }
-            }
-
-            if (auth_data == NULL || te == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "Failed to renew TGT in [%s].\n", renew_data->ccfile);
-                ret = hash_delete(renew_tgt_ctx->tgt_table, &entries[c].key);
-                if (ret != HASH_SUCCESS) {
-                    DEBUG(SSSDBG_CRIT_FAILURE, "hash_delete failed.\n");
-                }
-            }
-        }
-    }
-
-    talloc_free(entries);
-
-    return EOK;
+    return state->result;
 }
 
-static void renew_handler(struct renew_tgt_ctx *renew_tgt_ctx);
-
 static void renew_tgt_offline_callback(void *private_data)
 {
     struct renew_tgt_ctx *renew_tgt_ctx = talloc_get_type(private_data,
                                                           struct renew_tgt_ctx);
 
-    talloc_zfree(renew_tgt_ctx->te);
+    DEBUG(SSSDBG_CONF_SETTINGS, "Offline, pausing automatic TGT renewal.\n");
+    krb5_renew_sched_pause(renew_tgt_ctx->sched, true);
 }
 
 static void renew_tgt_online_callback(void *private_data)
@@ -243,61 +259,7 @@ static void renew_tgt_online_callback(void *private_data)
     struct renew_tgt_ctx *renew_tgt_ctx = talloc_get_type(private_data,
                                                           struct renew_tgt_ctx);
 
-    renew_handler(renew_tgt_ctx);
-}
-
-static void renew_tgt_timer_handler(struct tevent_context *ev,
-                                    struct tevent_timer *te,
-                                    struct timeval current_time, void *data)
-{
-    struct renew_tgt_ctx *renew_tgt_ctx = talloc_get_type(data,
-                                                          struct renew_tgt_ctx);
-
-    /* forget the timer event, it will be freed by the tevent timer loop */
-    renew_tgt_ctx->te = NULL;
-
-    renew_handler(renew_tgt_ctx);
-}
-
-static void renew_handler(struct renew_tgt_ctx *renew_tgt_ctx)
-{
-    struct timeval next;
-    int ret;
-
-    if (be_is_offline(renew_tgt_ctx->be_ctx)) {
-        DEBUG(SSSDBG_CONF_SETTINGS, "Offline, disable renew timer.\n");
-        return;
-    }
-
-    ret = renew_all_tgts(renew_tgt_ctx);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "renew_all_tgts failed. "
-                  "Disabling automatic TGT renewal\n");
-        sss_log(SSS_LOG_ERR, "Disabling automatic TGT renewal.");
-        talloc_zfree(renew_tgt_ctx);
-        return;
-    }
-
-    if (renew_tgt_ctx->te != NULL) {
-        DEBUG(SSSDBG_TRACE_LIBS,
-              "There is an active renewal timer, doing nothing.\n");
-        return;
-    }
-
-    DEBUG(SSSDBG_TRACE_LIBS, "Adding new renew timer.\n");
-
-    next = tevent_timeval_current_ofs(renew_tgt_ctx->timer_interval,
-                                      0);
-    renew_tgt_ctx->te = tevent_add_timer(renew_tgt_ctx->ev, renew_tgt_ctx,
-                                         next, renew_tgt_timer_handler,
-                                         renew_tgt_ctx);
-    if (renew_tgt_ctx->te == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        sss_log(SSS_LOG_ERR, "Disabling automatic TGT renewal.");
-        talloc_zfree(renew_tgt_ctx);
-    }
-
-    return;
+    krb5_renew_sched_pause(renew_tgt_ctx->sched, false);
 }
 
 static void renew_del_cb(hash_entry_t *entry, hash_destroy_enum type, void *pvt)
@@ -474,7 +436,7 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
                        struct tevent_context *ev, time_t renew_intv)
 {
     int ret;
-    struct timeval next;
+    int max_concurrent;
 
     krb5_ctx->renew_tgt_ctx = talloc_zero(krb5_ctx, struct renew_tgt_ctx);
     if (krb5_ctx->renew_tgt_ctx == NULL) {
@@ -493,7 +455,20 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
     krb5_ctx->renew_tgt_ctx->be_ctx = be_ctx;
     krb5_ctx->renew_tgt_ctx->krb5_ctx = krb5_ctx;
     krb5_ctx->renew_tgt_ctx->ev = ev;
-    krb5_ctx->renew_tgt_ctx->timer_interval = renew_intv;
+
+    max_concurrent = dp_opt_get_int(krb5_ctx->opts, KRB5_RENEW_MAX_CONCURRENT);
+    krb5_ctx->renew_tgt_ctx->sched = krb5_renew_sched_new(
+                                                    krb5_ctx->renew_tgt_ctx,
+                                                    ev, renew_intv,
+                                                    MAX(max_concurrent, 0),
+                                                    renew_tgt_send,
+                                                    renew_tgt_recv,
+                                                    krb5_ctx->renew_tgt_ctx);
+    if (krb5_ctx->renew_tgt_ctx->sched == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "krb5_renew_sched_new failed.\n");
+        ret = ENOMEM;
+        goto fail;
+    }
 
     ret = check_ccache_files(krb5_ctx->renew_tgt_ctx);
     if (ret != EOK) {
@@ -501,19 +476,8 @@ errno_t init_renew_tgt(struct krb5_ctx *krb5_ctx, struct be_ctx *be_ctx,
               "Failed to read ccache files, continuing ...\n");
     }
 
-    next = tevent_timeval_current_ofs(krb5_ctx->renew_tgt_ctx->timer_interval,
-                                      0);
-    krb5_ctx->renew_tgt_ctx->te = tevent_add_timer(ev, krb5_ctx->renew_tgt_ctx,
-                                                   next, renew_tgt_timer_handler,
-                                                   krb5_ctx->renew_tgt_ctx);
-    if (krb5_ctx->renew_tgt_ctx->te == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        ret = ENOMEM;
-        goto fail;
-    }
-
     DEBUG(SSSDBG_TRACE_LIBS,
-          "Adding offline callback to remove renewal timer.\n");
+          "Adding offline callback to pause renewals.\n");
     ret = be_add_offline_cb(krb5_ctx->renew_tgt_ctx, be_ctx,
                             renew_tgt_offline_callback, krb5_ctx->renew_tgt_ctx,
                             NULL);
@@ -619,6 +583,16 @@ errno_t add_tgt_to_renew_table(struct krb5_ctx *krb5_ctx, const char *ccfile,
         goto done;
     }
 
+    ret = krb5_renew_sched_add(krb5_ctx->renew_tgt_ctx->sched, upn, upn,
+                               renew_data->start_renew_at,
+                               renew_data->lifetime, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "krb5_renew_sched_add failed.\n");
+        /* renew_data is freed by renew_del_cb() */
+        hash_delete(krb5_ctx->renew_tgt_ctx->tgt_table, &key);
+        return ret;
+    }
+
     DEBUG(SSSDBG_TRACE_LIBS,
           "Added [%s] for renewal at [%.24s].\n", renew_data->ccfile,
                                            ctime(&renew_data->start_renew_at));
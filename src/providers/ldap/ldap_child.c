@@ -622,6 +622,7 @@ int main(int argc, const char *argv[])
     int opt;
     int dumpable = 1;
     int debug_fd = -1;
+    int helper = 0;
     const char *opt_logger = NULL;
     poptContext pc;
     TALLOC_CTX *main_ctx = NULL;
@@ -641,6 +642,8 @@ int main(int argc, const char *argv[])
          _("Allow core dumps"), NULL },
         {"debug-fd", 0, POPT_ARG_INT, &debug_fd, 0,
          _("An open file descriptor for the debug logs"), NULL},
+        {SSS_CHILD_HELPER_OPT, 0, POPT_ARG_NONE, &helper, 0,
+         _("Serve requests until the input is closed"), NULL},
         SSSD_LOGGER_OPTS
         POPT_TABLEEND
     };
@@ -684,6 +687,10 @@ int main(int argc, const char *argv[])
     BlockSignals(false, SIGTERM);
     CatchSignal(SIGTERM, sig_term_handler);
 
+    if (helper != 0) {
+        sss_child_helper_serve("ldap_child", STDIN_FILENO, STDOUT_FILENO);
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "ldap_child started.\n");
 
     main_ctx = talloc_new(NULL);
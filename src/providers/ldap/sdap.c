@@ -399,6 +399,288 @@ int sdap_get_map(TALLOC_CTX *memctx,
 
 /* =Parse-msg============================================================= */
 
+/* Scratch memory for parsing a single entry. */
+#define SDAP_PARSE_ENTRY_POOL_SIZE 1024
+
+/* Values of an LDAP attribute of the entry which are stored, together with
+ * the elements of the result they are copied to. */
+struct sdap_parse_attr {
+    const char *name;
+    bool base64;
+    struct berval **vals;
+    size_t *els;
+    size_t num_els;
+};
+
+/* Element of the result, collected before the result is allocated so that
+ * it can be sized exactly. */
+struct sdap_parse_el {
+    const char *name;
+    size_t num_values;
+};
+
+struct sdap_parse_plan {
+    struct sdap_parse_attr *attrs;
+    size_t num_attrs;
+    struct sdap_parse_el *els;
+    size_t num_els;
+
+    /* Number and total size of the talloc objects of the result */
+    size_t num_objects;
+    size_t size;
+};
+
+static size_t sdap_parse_value_size(struct berval *val, bool base64)
+{
+    if (base64) {
+        return (val->bv_len + 2) / 3 * 4 + 1;
+    }
+
+    return val->bv_len + 1;
+}
+
+static errno_t sdap_parse_plan_el(TALLOC_CTX *mem_ctx,
+                                  struct sdap_parse_plan *plan,
+                                  const char *name,
+                                  size_t *_idx)
+{
+    struct sdap_parse_el *els;
+    size_t i;
+
+    for (i = 0; i < plan->num_els; i++) {
+        if (strcasecmp(name, plan->els[i].name) == 0) {
+            *_idx = i;
+            return EOK;
+        }
+    }
+
+    els = talloc_realloc(mem_ctx, plan->els, struct sdap_parse_el,
+                         plan->num_els + 1);
+    if (els == NULL) {
+        return ENOMEM;
+    }
+
+    els[plan->num_els].name = name;
+    els[plan->num_els].num_values = 0;
+    plan->els = els;
+
+    /* The name and the value array of the element */
+    plan->num_objects += 2;
+    plan->size += strlen(name) + 1;
+
+    *_idx = plan->num_els++;
+    return EOK;
+}
+
+static errno_t sdap_parse_plan_attr_el(TALLOC_CTX *mem_ctx,
+                                       struct sdap_parse_plan *plan,
+                                       struct sdap_parse_attr *pa,
+                                       const char *name,
+                                       size_t num_values,
+                                       size_t size)
+{
+    size_t *els;
+    size_t idx;
+    errno_t ret;
+
+    ret = sdap_parse_plan_el(mem_ctx, plan, name, &idx);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    els = talloc_realloc(mem_ctx, pa->els, size_t, pa->num_els + 1);
+    if (els == NULL) {
+        return ENOMEM;
+    }
+    els[pa->num_els++] = idx;
+    pa->els = els;
+
+    plan->els[idx].num_values += num_values;
+    plan->num_objects += num_values;
+    plan->size += size + num_values * sizeof(struct ldb_val);
+
+    return EOK;
+}
+
+/* Remember the values of an LDAP attribute and add them to all elements
+ * they are stored in. Takes the ownership of vals. */
+static errno_t sdap_parse_plan_attr(TALLOC_CTX *mem_ctx,
+                                    struct sdap_parse_plan *plan,
+                                    struct sdap_attr_map *map,
+                                    int attrs_num,
+                                    int map_idx,
+                                    const char *name,
+                                    bool base64,
+                                    struct berval **vals)
+{
+    struct sdap_parse_attr *pattrs;
+    struct sdap_parse_attr *pa;
+    size_t num_values = 0;
+    size_t size = 0;
+    errno_t ret;
+    int ai;
+    int i;
+
+    for (i = 0; vals[i]; i++) {
+        if (vals[i]->bv_len == 0) {
+            DEBUG(SSSDBG_TRACE_LIBS, "Value of attribute [%s] is empty. "
+                  "Skipping this value.\n", name);
+            continue;
+        }
+        num_values++;
+        size += sdap_parse_value_size(vals[i], base64);
+    }
+
+    if (num_values == 0) {
+        ldap_value_free_len(vals);
+        return EOK;
+    }
+
+    pattrs = talloc_realloc(mem_ctx, plan->attrs, struct sdap_parse_attr,
+                            plan->num_attrs + 1);
+    if (pattrs == NULL) {
+        ldap_value_free_len(vals);
+        return ENOMEM;
+    }
+    plan->attrs = pattrs;
+
+    pa = &plan->attrs[plan->num_attrs++];
+    pa->name = name;
+    pa->base64 = base64;
+    pa->vals = vals;
+    pa->els = NULL;
+    pa->num_els = 0;
+
+    if (map == NULL) {
+        /* No map, just store the attribute */
+        return sdap_parse_plan_attr_el(mem_ctx, plan, pa, name,
+                                       num_values, size);
+    }
+
+    /* The same LDAP attr might be used for more sysdb attrs in case
+     * there is a map. Find all that match and copy the values. */
+    for (ai = map_idx; ai < attrs_num; ai++) {
+        /* check if this attr is valid with the chosen schema */
+        if (!map[ai].name) continue;
+
+        /* check if it is an attr we are interested in */
+        if (strcasecmp(name, map[ai].name) != 0) continue;
+
+        ret = sdap_parse_plan_attr_el(mem_ctx, plan, pa, map[ai].sys_name,
+                                      num_values, size);
+        if (ret != EOK) {
+            return ret;
+        }
+    }
+
+    return EOK;
+}
+
+static void sdap_parse_plan_free_vals(struct sdap_parse_plan *plan)
+{
+    size_t i;
+
+    for (i = 0; i < plan->num_attrs; i++) {
+        if (plan->attrs[i].vals != NULL) {
+            ldap_value_free_len(plan->attrs[i].vals);
+            plan->attrs[i].vals = NULL;
+        }
+    }
+}
+
+/* Allocate the result with all its names, value arrays and values in a
+ * single pool which goes away together with the entry. */
+static errno_t sdap_parse_plan_build(TALLOC_CTX *memctx,
+                                     struct sdap_parse_plan *plan,
+                                     struct ldb_val *orig_dn,
+                                     struct sysdb_attrs **_attrs)
+{
+    struct sysdb_attrs *attrs;
+    struct ldb_message_element *el;
+    struct sdap_parse_attr *pa;
+    struct ldb_val v;
+    size_t i;
+    size_t e;
+    int j;
+
+    attrs = talloc_pooled_object(memctx, struct sysdb_attrs,
+                                 plan->num_objects + 1,
+                                 plan->size + plan->num_els
+                                     * sizeof(struct ldb_message_element));
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+    memset(attrs, 0, sizeof(struct sysdb_attrs));
+
+    attrs->a = talloc_zero_array(attrs, struct ldb_message_element,
+                                 plan->num_els);
+    if (attrs->a == NULL) {
+        goto fail;
+    }
+
+    for (i = 0; i < plan->num_els; i++) {
+        el = &attrs->a[i];
+        el->name = talloc_strdup(attrs->a, plan->els[i].name);
+        el->values = talloc_array(attrs->a, struct ldb_val,
+                                  plan->els[i].num_values);
+        if (el->name == NULL || el->values == NULL) {
+            goto fail;
+        }
+    }
+    attrs->num = plan->num_els;
+
+    /* The DN is always the first element */
+    el = &attrs->a[0];
+    el->values[0] = ldb_val_dup(el->values, orig_dn);
+    if (el->values[0].data == NULL && orig_dn->length != 0) {
+        goto fail;
+    }
+    el->num_values = 1;
+
+    for (i = 0; i < plan->num_attrs; i++) {
+        pa = &plan->attrs[i];
+
+        for (j = 0; pa->vals[j]; j++) {
+            if (pa->vals[j]->bv_len == 0) {
+                continue;
+            }
+
+            PROBE(SDAP_PARSE_ENTRY, pa->name, pa->vals[j]->bv_val,
+                  pa->vals[j]->bv_len);
+
+            for (e = 0; e < pa->num_els; e++) {
+                el = &attrs->a[pa->els[e]];
+
+                if (pa->base64) {
+                    v.data = (uint8_t *) sss_base64_encode(el->values,
+                                            (uint8_t *) pa->vals[j]->bv_val,
+                                            pa->vals[j]->bv_len);
+                    if (v.data == NULL) {
+                        goto fail;
+                    }
+                    v.length = strlen((const char *) v.data);
+                } else {
+                    v.data = (uint8_t *) pa->vals[j]->bv_val;
+                    v.length = pa->vals[j]->bv_len;
+                    v = ldb_val_dup(el->values, &v);
+                    if (v.data == NULL) {
+                        goto fail;
+                    }
+                }
+
+                el->values[el->num_values++] = v;
+            }
+        }
+    }
+
+    *_attrs = attrs;
+    return EOK;
+
+fail:
+    talloc_free(attrs);
+    return ENOMEM;
+}
+
 static bool objectclass_matched(struct sdap_attr_map *map,
                                 const char *objcl, int len);
 int sdap_parse_entry(TALLOC_CTX *memctx,
@@ -408,19 +690,20 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
                      bool disable_range_retrieval)
 {
     struct sysdb_attrs *attrs;
+    struct sdap_parse_plan plan = { 0 };
     BerElement *ber = NULL;
     struct berval **vals;
-    struct ldb_val v;
+    struct ldb_val dn;
+    size_t idx;
     char *str;
     int lerrno;
-    int i, ret, ai;
+    int i, ret;
     int base_attr_idx = 0;
-    const char *name = NULL;
     bool store;
     bool base64;
-    char *base_attr;
+    char *base_attr = NULL;
     uint32_t range_offset;
-    TALLOC_CTX *tmp_ctx = talloc_new(NULL);
+    TALLOC_CTX *tmp_ctx = talloc_pool(NULL, SDAP_PARSE_ENTRY_POOL_SIZE);
     if (!tmp_ctx) return ENOMEM;
 
     lerrno = 0;
@@ -430,12 +713,6 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
               sss_ldap_err2string(ret));
     }
 
-    attrs = sysdb_new_attrs(tmp_ctx);
-    if (!attrs) {
-        ret = ENOMEM;
-        goto done;
-    }
-
     str = ldap_get_dn(sh->ldap, sm->msg);
     if (!str) {
         ldap_get_option(sh->ldap, LDAP_OPT_RESULT_CODE, &lerrno);
@@ -447,9 +724,20 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
 
     DEBUG(SSSDBG_TRACE_LIBS, "OriginalDN: [%s].\n", str);
     PROBE(SDAP_PARSE_ENTRY, "OriginalDN", str, strlen(str));
-    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, str);
+    dn.data = (uint8_t *) talloc_strdup(tmp_ctx, str);
+    dn.length = strlen(str);
     ldap_memfree(str);
-    if (ret) goto done;
+    if (dn.data == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    /* Every entry has a DN */
+    ret = sdap_parse_plan_el(tmp_ctx, &plan, SYSDB_ORIG_DN, &idx);
+    if (ret != EOK) goto done;
+    plan.els[idx].num_values = 1;
+    plan.num_objects++;
+    plan.size += dn.length + 1 + sizeof(struct ldb_val);
 
     if (map) {
         vals = ldap_get_values_len(sh->ldap, sm->msg, "objectClass");
@@ -525,16 +813,15 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
             /* interesting attr */
             if (i < attrs_num) {
                 store = true;
-                name = map[i].sys_name;
                 base_attr_idx = i;
-                if (strcmp(name, SYSDB_SSH_PUBKEY) == 0) {
+                if (strcmp(map[i].sys_name, SYSDB_SSH_PUBKEY) == 0) {
                     base64 = true;
                 }
             } else {
                 store = false;
             }
         } else {
-            name = base_attr;
+            base_attr_idx = 0;
             store = true;
         }
 
@@ -561,62 +848,20 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
                     ret = EINVAL;
                     goto done;
                 }
-                for (i = 0; vals[i]; i++) {
-                    if (vals[i]->bv_len == 0) {
-                        DEBUG(SSSDBG_TRACE_LIBS,
-                              "Value of attribute [%s] is empty. "
-                               "Skipping this value.\n", str);
-                        continue;
-                    }
-                    if (base64) {
-                        v.data = (uint8_t *) sss_base64_encode(attrs,
-                                 (uint8_t *) vals[i]->bv_val, vals[i]->bv_len);
-                        if (!v.data) {
-                            ldap_value_free_len(vals);
-                            ret = ENOMEM;
-                            goto done;
-                        }
-                        v.length = strlen((const char *)v.data);
-                    } else {
-                        v.data = (uint8_t *)vals[i]->bv_val;
-                        v.length = vals[i]->bv_len;
-                    }
-                    PROBE(SDAP_PARSE_ENTRY, str, v.data, v.length);
-
-                    if (map) {
-                        /* The same LDAP attr might be used for more sysdb
-                         * attrs in case there is a map. Find all that match
-                         * and copy the value
-                         */
-                        for (ai = base_attr_idx; ai < attrs_num; ai++) {
-                            /* check if this attr is valid with the chosen
-                             * schema */
-                            if (!map[ai].name) continue;
-
-                            /* check if it is an attr we are interested in */
-                            if (strcasecmp(base_attr, map[ai].name) == 0) {
-                                ret = sysdb_attrs_add_val(attrs,
-                                                          map[ai].sys_name,
-                                                          &v);
-                                if (ret) {
-                                    ldap_value_free_len(vals);
-                                    goto done;
-                                }
-                            }
-                        }
-                    } else {
-                        /* No map, just store the attribute */
-                        ret = sysdb_attrs_add_val(attrs, name, &v);
-                        if (ret) {
-                            ldap_value_free_len(vals);
-                            goto done;
-                        }
-                    }
+
+                /* The values are copied once all attributes are known,
+                 * the plan keeps base_attr until then. */
+                ret = sdap_parse_plan_attr(tmp_ctx, &plan, map, attrs_num,
+                                           base_attr_idx, base_attr, base64,
+                                           vals);
+                if (ret != EOK) {
+                    goto done;
                 }
-                ldap_value_free_len(vals);
+                base_attr = NULL;
             }
         }
 
+        talloc_zfree(base_attr);
         ldap_memfree(str);
         str = ldap_next_attribute(sh->ldap, sm->msg, ber);
     }
@@ -631,11 +876,17 @@ int sdap_parse_entry(TALLOC_CTX *memctx,
         goto done;
     }
 
+    ret = sdap_parse_plan_build(memctx, &plan, &dn, &attrs);
+    if (ret != EOK) {
+        goto done;
+    }
+
     PROBE(SDAP_PARSE_ENTRY_DONE);
-    *_attrs = talloc_steal(memctx, attrs);
+    *_attrs = attrs;
     ret = EOK;
 
 done:
+    sdap_parse_plan_free_vals(&plan);
     if (ber) ber_free(ber, 0);
     talloc_free(tmp_ctx);
     return ret;
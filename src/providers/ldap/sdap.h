@@ -78,6 +78,10 @@ struct sdap_handle {
 
     struct sdap_op *ops;
 
+    /* Fail over server the handle is connected to (if known), used to
+     * report response times of the operations */
+    struct fo_server *fo_server;
+
     /* during release we need to lock access to the handler
      * from the destructor to avoid recursion */
     bool destructor_lock;
@@ -235,6 +239,8 @@ enum sdap_basic_opt {
     SDAP_PWDLOCKOUT_DN,
     SDAP_WILDCARD_LIMIT,
     SDAP_LIBRARY_DEBUG_LEVEL,
+    SDAP_SEARCH_BASES_PARALLEL,
+    SDAP_CONNECT_ATTEMPT_DELAY,
 
     SDAP_OPTS_BASIC /* opts counter */
 };
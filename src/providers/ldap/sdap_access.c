@@ -101,9 +101,16 @@ static errno_t sdap_access_host(struct ldb_message *user_entry);
 
 errno_t sdap_access_rhost(struct ldb_message *user_entry, char *rhost);
 
-enum sdap_access_control_type {
-    SDAP_ACCESS_CONTROL_FILTER,
-    SDAP_ACCESS_CONTROL_PPOLICY_LOCK,
+/* Rules which have to contact the server are started together when the
+ * request is created. Their results are still consumed in the configured
+ * order, so the first rule which fails decides as if the rules were
+ * evaluated one after the other. */
+struct sdap_access_rule_req {
+    struct tevent_req *req;
+    size_t index;
+    uint64_t start_time;
+    bool done;
+    errno_t ret;
 };
 
 struct sdap_access_req_ctx {
@@ -115,9 +122,13 @@ struct sdap_access_req_ctx {
     struct sss_domain_info *domain;
     struct ldb_message *user_entry;
     size_t current_rule;
-    enum sdap_access_control_type ac_type;
+    /* indexed like access_ctx->access_rule, NULL for local rules */
+    struct sdap_access_rule_req *rules[LDAP_ACCESS_LAST + 1];
 };
 
+static errno_t sdap_access_start_rules(struct sdap_access_req_ctx *state,
+                                       struct tevent_req *req);
+static void sdap_access_cancel_rules(struct sdap_access_req_ctx *state);
 static errno_t sdap_access_check_next_rule(struct sdap_access_req_ctx *state,
                                            struct tevent_req *req);
 static void sdap_access_done(struct tevent_req *subreq);
@@ -188,6 +199,12 @@ sdap_access_send(TALLOC_CTX *mem_ctx,
 
     state->user_entry = res->msgs[0];
 
+    ret = sdap_access_start_rules(state, req);
+    if (ret != EOK) {
+        sdap_access_cancel_rules(state);
+        goto done;
+    }
+
     ret = sdap_access_check_next_rule(state, req);
     if (ret == EAGAIN) {
         return req;
@@ -203,18 +220,70 @@ done:
     return req;
 }
 
-static errno_t sdap_access_check_next_rule(struct sdap_access_req_ctx *state,
-                                           struct tevent_req *req)
+static const char *sdap_access_rule_name(int rule)
+{
+    switch (rule) {
+    case LDAP_ACCESS_FILTER:
+        return LDAP_ACCESS_FILTER_NAME;
+    case LDAP_ACCESS_EXPIRE:
+        return LDAP_ACCESS_EXPIRE_NAME;
+    case LDAP_ACCESS_SERVICE:
+        return LDAP_ACCESS_SERVICE_NAME;
+    case LDAP_ACCESS_HOST:
+        return LDAP_ACCESS_HOST_NAME;
+    case LDAP_ACCESS_RHOST:
+        return LDAP_ACCESS_RHOST_NAME;
+    case LDAP_ACCESS_LOCKOUT:
+        return LDAP_ACCESS_LOCK_NAME;
+    case LDAP_ACCESS_EXPIRE_POLICY_REJECT:
+        return LDAP_ACCESS_EXPIRE_POLICY_REJECT_NAME;
+    case LDAP_ACCESS_EXPIRE_POLICY_WARN:
+        return LDAP_ACCESS_EXPIRE_POLICY_WARN_NAME;
+    case LDAP_ACCESS_EXPIRE_POLICY_RENEW:
+        return LDAP_ACCESS_EXPIRE_POLICY_RENEW_NAME;
+    case LDAP_ACCESS_PPOLICY:
+        return LDAP_ACCESS_PPOLICY_NAME;
+    }
+
+    return "unknown";
+}
+
+static void sdap_access_rule_finished(int rule, uint64_t start_time,
+                                      errno_t ret)
 {
+    DEBUG(SSSDBG_PERF_STAT, "Access rule [%s] returned [%d]: %s, took %s.\n",
+          sdap_access_rule_name(rule), ret, sss_strerror(ret),
+          sss_format_time(get_spend_time_us(start_time)));
+}
+
+static errno_t sdap_access_start_rules(struct sdap_access_req_ctx *state,
+                                       struct tevent_req *req)
+{
+    struct sdap_access_rule_req *rule;
     struct tevent_req *subreq;
-    int ret = EOK;
+    size_t c;
 
-    while (ret == EOK) {
-        switch (state->access_ctx->access_rule[state->current_rule]) {
-        case LDAP_ACCESS_EMPTY:
-            /* we are done with no errors */
-            return EOK;
+    for (c = 0; state->access_ctx->access_rule[c] != LDAP_ACCESS_EMPTY; c++) {
+        switch (state->access_ctx->access_rule[c]) {
+        case LDAP_ACCESS_LOCKOUT:
+        case LDAP_ACCESS_PPOLICY:
+        case LDAP_ACCESS_FILTER:
+            break;
+        default:
+            /* evaluated locally when it is its turn */
+            continue;
+        }
 
+        rule = talloc_zero(state, struct sdap_access_rule_req);
+        if (rule == NULL) {
+            return ENOMEM;
+        }
+
+        rule->req = req;
+        rule->index = c;
+        rule->start_time = get_start_time();
+
+        switch (state->access_ctx->access_rule[c]) {
         /* This option is deprecated by LDAP_ACCESS_PPOLICY */
         case LDAP_ACCESS_LOCKOUT:
             DEBUG(SSSDBG_MINOR_FAILURE,
@@ -222,59 +291,85 @@ static errno_t sdap_access_check_next_rule(struct sdap_access_req_ctx *state,
                   "a future release. Please migrate to %s option instead.\n",
                   LDAP_ACCESS_LOCK_NAME, LDAP_ACCESS_PPOLICY_NAME);
 
-            subreq = sdap_access_ppolicy_send(state, state->ev, state->be_ctx,
+            subreq = sdap_access_ppolicy_send(rule, state->ev, state->be_ctx,
                                               state->domain,
                                               state->access_ctx,
                                               state->conn,
                                               state->pd->user,
                                               state->user_entry,
                                               PWP_LOCKOUT_ONLY);
-            if (subreq == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "sdap_access_ppolicy_send failed.\n");
-                return ENOMEM;
-            }
-
-            state->ac_type = SDAP_ACCESS_CONTROL_PPOLICY_LOCK;
-
-            tevent_req_set_callback(subreq, sdap_access_done, req);
-            return EAGAIN;
-
+            break;
         case LDAP_ACCESS_PPOLICY:
-            subreq = sdap_access_ppolicy_send(state, state->ev, state->be_ctx,
+            subreq = sdap_access_ppolicy_send(rule, state->ev, state->be_ctx,
                                               state->domain,
                                               state->access_ctx,
                                               state->conn,
                                               state->pd->user,
                                               state->user_entry,
                                               PWP_LOCKOUT_EXPIRE);
-            if (subreq == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE,
-                      "sdap_access_ppolicy_send failed.\n");
-                return ENOMEM;
-            }
-
-            state->ac_type = SDAP_ACCESS_CONTROL_PPOLICY_LOCK;
-
-            tevent_req_set_callback(subreq, sdap_access_done, req);
-            return EAGAIN;
-
-        case LDAP_ACCESS_FILTER:
-            subreq = sdap_access_filter_send(state, state->ev, state->be_ctx,
+            break;
+        default:
+            subreq = sdap_access_filter_send(rule, state->ev, state->be_ctx,
                                              state->domain,
                                              state->access_ctx,
                                              state->conn,
                                              state->pd->user,
                                              state->user_entry);
-            if (subreq == NULL) {
-                DEBUG(SSSDBG_CRIT_FAILURE, "sdap_access_filter_send failed.\n");
-                return ENOMEM;
-            }
+            break;
+        }
+        if (subreq == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Unable to start access rule [%s].\n",
+                  sdap_access_rule_name(state->access_ctx->access_rule[c]));
+            talloc_free(rule);
+            return ENOMEM;
+        }
+
+        state->rules[c] = rule;
+        tevent_req_set_callback(subreq, sdap_access_done, rule);
+    }
+
+    return EOK;
+}
+
+static void sdap_access_cancel_rules(struct sdap_access_req_ctx *state)
+{
+    size_t c;
+
+    for (c = 0; c < LDAP_ACCESS_LAST; c++) {
+        if (state->rules[c] != NULL && !state->rules[c]->done) {
+            /* frees the running subrequest as well */
+            talloc_zfree(state->rules[c]);
+        }
+    }
+}
+
+static errno_t sdap_access_check_next_rule(struct sdap_access_req_ctx *state,
+                                           struct tevent_req *req)
+{
+    struct sdap_access_rule_req *rule;
+    uint64_t start_time;
+    int ret = EOK;
 
-            state->ac_type = SDAP_ACCESS_CONTROL_FILTER;
+    while (ret == EOK) {
+        start_time = get_start_time();
 
-            tevent_req_set_callback(subreq, sdap_access_done, req);
-            return EAGAIN;
+        switch (state->access_ctx->access_rule[state->current_rule]) {
+        case LDAP_ACCESS_EMPTY:
+            /* we are done with no errors */
+            return EOK;
+
+        case LDAP_ACCESS_LOCKOUT:
+        case LDAP_ACCESS_PPOLICY:
+        case LDAP_ACCESS_FILTER:
+            rule = state->rules[state->current_rule];
+            if (!rule->done) {
+                /* sdap_access_done() continues when the result arrives */
+                return EAGAIN;
+            }
+
+            ret = rule->ret;
+            state->current_rule++;
+            continue;
 
         case LDAP_ACCESS_EXPIRE:
             ret = sdap_account_expired(state->access_ctx,
@@ -327,9 +422,16 @@ static errno_t sdap_access_check_next_rule(struct sdap_access_req_ctx *state,
             ret = ERR_ACCESS_DENIED;
         }
 
+        sdap_access_rule_finished(
+                    state->access_ctx->access_rule[state->current_rule],
+                    start_time, ret);
+
         state->current_rule++;
     }
 
+    /* The result is known, the remaining rules are not needed */
+    sdap_access_cancel_rules(state);
+
     return ret;
 }
 
@@ -338,26 +440,36 @@ static void sdap_access_done(struct tevent_req *subreq)
     errno_t ret;
     struct tevent_req *req;
     struct sdap_access_req_ctx *state;
+    struct sdap_access_rule_req *rule;
+    int rule_type;
 
-    req = tevent_req_callback_data(subreq, struct tevent_req);
+    rule = tevent_req_callback_data(subreq, struct sdap_access_rule_req);
+    req = rule->req;
     state = tevent_req_data(req, struct sdap_access_req_ctx);
+    rule_type = state->access_ctx->access_rule[rule->index];
 
     /* process subrequest */
-    switch(state->ac_type) {
-    case SDAP_ACCESS_CONTROL_FILTER:
+    switch(rule_type) {
+    case LDAP_ACCESS_FILTER:
         ret = sdap_access_filter_recv(subreq);
         break;
-    case SDAP_ACCESS_CONTROL_PPOLICY_LOCK:
+    case LDAP_ACCESS_LOCKOUT:
+    case LDAP_ACCESS_PPOLICY:
         ret = sdap_access_ppolicy_recv(subreq);
         break;
     default:
         ret = EINVAL;
         DEBUG(SSSDBG_MINOR_FAILURE, "Unknown access control type: %d.\n",
-              state->ac_type);
+              rule_type);
         break;
     }
 
     talloc_zfree(subreq);
+
+    rule->done = true;
+    rule->ret = ret;
+    sdap_access_rule_finished(rule_type, rule->start_time, ret);
+
     if (ret != EOK) {
         if (ret == ERR_ACCESS_DENIED) {
             DEBUG(SSSDBG_TRACE_FUNC, "Access was denied.\n");
@@ -365,11 +477,13 @@ static void sdap_access_done(struct tevent_req *subreq)
             DEBUG(SSSDBG_CRIT_FAILURE,
                   "Error retrieving access check result.\n");
         }
-        tevent_req_error(req, ret);
-        return;
     }
 
-    state->current_rule++;
+    if (rule->index != state->current_rule) {
+        /* An earlier rule is still running, the result is used when it is
+         * the turn of this rule. */
+        return;
+    }
 
     ret = sdap_access_check_next_rule(state, req);
     switch (ret) {
@@ -29,6 +29,11 @@
 
 #define REPLY_REALLOC_INCREMENT 10
 
+/* Replies to an operation are usually processed one by one as they arrive,
+ * so a small pool is enough to recycle the memory of the sdap_msg wrappers
+ * for all entries returned by a search or a single page of it. */
+#define SDAP_OP_REPLY_POOL_SIZE 1024
+
 struct sdap_op {
     struct sdap_op *prev, *next;
     struct sdap_handle *sh;
@@ -44,6 +49,7 @@ struct sdap_op {
     void *data;
 
     struct tevent_context *ev;
+    TALLOC_CTX *reply_pool;
     struct sdap_msg *list;
     struct sdap_msg *last;
 };
@@ -112,6 +118,13 @@ static void sdap_call_op_callback(struct sdap_op *op, struct sdap_msg *reply,
                                          op->msgid, info, op->timeout);
         }
 
+        /* The time until the first reply arrived is a good estimate of
+         * the server response time */
+        if (error == EOK && reply != NULL) {
+            fo_server_report_latency(op->sh->fo_server,
+                                     FO_LATENCY_LDAP_REPLY, time_spend);
+        }
+
         /* Avoid multiple outputs for the same operation if multiple results
          * are returned */
         op->start_time = 0;
@@ -390,7 +403,10 @@ static void sdap_process_message(struct tevent_context *ev,
         return;
     }
 
-    reply = talloc_zero(op, struct sdap_msg);
+    /* The reply is freed as soon as it is processed, which returns its
+     * memory to the pool for the next one. */
+    reply = talloc_zero(op->reply_pool != NULL ? op->reply_pool : op,
+                        struct sdap_msg);
     if (!reply) {
         ldap_msgfree(msg);
         ret = ENOMEM;
@@ -525,6 +541,11 @@ int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
     op->ev = ev;
     op->chain_id = sss_chain_id_get();
 
+    op->reply_pool = talloc_pool(op, SDAP_OP_REPLY_POOL_SIZE);
+    if (op->reply_pool == NULL) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Failed to create reply pool, ignored.\n");
+    }
+
     DEBUG(SSSDBG_TRACE_INTERNAL,
           "New operation %d timeout %d\n", op->msgid, timeout);
 
@@ -1277,7 +1298,10 @@ static errno_t add_to_reply(TALLOC_CTX *mem_ctx,
                             struct sysdb_attrs *msg)
 {
     if (sreply->reply == NULL || sreply->reply_max == sreply->reply_count) {
-        sreply->reply_max += REPLY_REALLOC_INCREMENT;
+        /* Grow geometrically, large searches return many thousands of
+         * entries and copying the array every few entries adds up. */
+        sreply->reply_max = sreply->reply_max == 0 ? REPLY_REALLOC_INCREMENT
+                                                   : sreply->reply_max * 2;
         sreply->reply = talloc_realloc(mem_ctx, sreply->reply,
                                        struct sysdb_attrs *,
                                        sreply->reply_max);
@@ -1316,7 +1340,9 @@ static errno_t add_to_deref_reply(TALLOC_CTX *mem_ctx,
 
         if (dreply->reply == NULL ||
             dreply->reply_max == dreply->reply_count) {
-            dreply->reply_max += REPLY_REALLOC_INCREMENT;
+            dreply->reply_max = dreply->reply_max == 0
+                                    ? REPLY_REALLOC_INCREMENT
+                                    : dreply->reply_max * 2;
             dreply->reply = talloc_realloc(mem_ctx, dreply->reply,
                                         struct sdap_deref_attrs *,
                                         dreply->reply_max);
@@ -0,0 +1,388 @@
+/*
+    SSSD
+
+    Async LDAP Helper routines - race connection attempts to all addresses
+    of a server
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "util/util.h"
+#include "providers/ldap/sdap_async_private.h"
+
+/* A server name may resolve to several addresses, possibly of both address
+ * families. Instead of waiting for the full network timeout on a single
+ * unreachable address, start a connection attempt to the next address every
+ * ldap_connection_attempt_delay milliseconds and use whichever connection
+ * is established first (RFC 8305). The addresses of the other family are
+ * resolved in parallel with the first attempt. */
+
+struct sdap_connect_race_state {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    const char *uri;
+    bool use_start_tls;
+    int delay;
+    int port;
+
+    struct sockaddr_storage **addrs;
+    size_t num_addrs;
+    size_t next_addr;
+
+    struct tevent_req *resolve_req;
+    struct tevent_timer *timer;
+    TALLOC_CTX *attempts;
+    size_t running;
+    errno_t last_error;
+
+    struct sdap_handle *sh;
+};
+
+static errno_t sdap_connect_race_add(struct sdap_connect_race_state *state,
+                                     struct resolv_hostent *hostent,
+                                     bool prefer);
+static errno_t sdap_connect_race_next(struct tevent_req *req);
+static void sdap_connect_race_timeout(struct tevent_context *ev,
+                                      struct tevent_timer *te,
+                                      struct timeval tv, void *pvt);
+static void sdap_connect_race_resolve_done(struct tevent_req *subreq);
+static void sdap_connect_race_attempt_done(struct tevent_req *subreq);
+static void sdap_connect_race_check_done(struct tevent_req *req);
+
+struct tevent_req *
+sdap_connect_race_send(TALLOC_CTX *memctx,
+                       struct tevent_context *ev,
+                       struct sdap_options *opts,
+                       struct be_resolv_ctx *be_res,
+                       struct fo_server *srv,
+                       const char *uri,
+                       struct sockaddr_storage *sockaddr,
+                       bool use_start_tls)
+{
+    struct sdap_connect_race_state *state;
+    struct resolv_hostent *hostent = NULL;
+    enum restrict_family other_family;
+    const char *name;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(memctx, &state, struct sdap_connect_race_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ev = ev;
+    state->opts = opts;
+    state->uri = uri;
+    state->use_start_tls = use_start_tls;
+    state->delay = dp_opt_get_int(opts->basic, SDAP_CONNECT_ATTEMPT_DELAY);
+    state->last_error = EIO;
+
+    state->attempts = talloc_new(state);
+    if (state->attempts == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    if (state->delay > 0 && srv != NULL) {
+        hostent = fo_get_server_hostent(srv);
+        state->port = fo_get_server_port(srv);
+    }
+
+    if (hostent == NULL) {
+        /* Racing disabled or nothing to race, connect to the address
+         * selected by the fail over code only. */
+        state->addrs = talloc_array(state, struct sockaddr_storage *, 1);
+        if (state->addrs == NULL) {
+            ret = ENOMEM;
+            goto immediately;
+        }
+        state->addrs[0] = sockaddr;
+        state->num_addrs = 1;
+    } else {
+        ret = sdap_connect_race_add(state, hostent, false);
+        if (ret != EOK) {
+            goto immediately;
+        }
+
+        name = fo_get_server_name(srv);
+        if (be_res != NULL && name != NULL && !resolv_is_address(name)
+                && ((be_res->family_order == IPV4_FIRST
+                        && hostent->family == AF_INET)
+                    || (be_res->family_order == IPV6_FIRST
+                        && hostent->family == AF_INET6))) {
+            other_family = hostent->family == AF_INET ? IPV6_ONLY : IPV4_ONLY;
+            state->resolve_req = resolv_gethostbyname_send(state, ev,
+                                                           be_res->resolv,
+                                                           name, other_family,
+                                                           default_host_dbs);
+            if (state->resolve_req == NULL) {
+                ret = ENOMEM;
+                goto immediately;
+            }
+            tevent_req_set_callback(state->resolve_req,
+                                    sdap_connect_race_resolve_done, req);
+        }
+    }
+
+    ret = sdap_connect_race_next(req);
+    if (ret != EOK) {
+        goto immediately;
+    }
+
+    return req;
+
+immediately:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+/* Add addresses from hostent to the candidates that were not tried yet. If
+ * prefer is true, the new addresses are interleaved with the pending ones
+ * starting with a new one, otherwise the pending ones go first. */
+static errno_t sdap_connect_race_add(struct sdap_connect_race_state *state,
+                                     struct resolv_hostent *hostent,
+                                     bool prefer)
+{
+    struct sockaddr_storage **addrs;
+    struct sockaddr_storage **pending;
+    struct sockaddr_storage *sa;
+    size_t num_pending;
+    size_t num_new;
+    size_t n = 0;
+    size_t i;
+    size_t p;
+
+    if (hostent->addr_list == NULL) {
+        return EOK;
+    }
+
+    for (num_new = 0; hostent->addr_list[num_new] != NULL; num_new++);
+    if (num_new == 0) {
+        return EOK;
+    }
+
+    pending = state->addrs + state->next_addr;
+    num_pending = state->num_addrs - state->next_addr;
+
+    addrs = talloc_zero_array(state, struct sockaddr_storage *,
+                              num_pending + num_new);
+    if (addrs == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0, p = 0; i < num_new || p < num_pending; ) {
+        if (p < num_pending && (!prefer || i >= num_new)) {
+            addrs[n++] = talloc_steal(addrs, pending[p++]);
+        }
+
+        if (i < num_new) {
+            sa = resolv_get_sockaddr_address_index(addrs, hostent,
+                                                   state->port, i++);
+            if (sa == NULL) {
+                talloc_free(addrs);
+                return ENOMEM;
+            }
+            addrs[n++] = sa;
+        }
+
+        if (p < num_pending && prefer) {
+            addrs[n++] = talloc_steal(addrs, pending[p++]);
+        }
+    }
+
+    talloc_free(state->addrs);
+    state->addrs = addrs;
+    state->num_addrs = n;
+    state->next_addr = 0;
+
+    return EOK;
+}
+
+static errno_t sdap_connect_race_next(struct tevent_req *req)
+{
+    struct sdap_connect_race_state *state;
+    struct tevent_req *subreq;
+    size_t idx;
+
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+
+    talloc_zfree(state->timer);
+
+    if (state->next_addr >= state->num_addrs) {
+        return EOK;
+    }
+
+    idx = state->next_addr++;
+    DEBUG(SSSDBG_TRACE_FUNC, "Starting connection attempt #%zu to [%s]\n",
+          idx + 1, state->uri);
+
+    subreq = sdap_connect_send(state->attempts, state->ev, state->opts,
+                               state->uri, state->addrs[idx],
+                               state->use_start_tls);
+    if (subreq == NULL) {
+        return ENOMEM;
+    }
+    tevent_req_set_callback(subreq, sdap_connect_race_attempt_done, req);
+    state->running++;
+
+    if (state->next_addr < state->num_addrs || state->resolve_req != NULL) {
+        state->timer = tevent_add_timer(state->ev, state,
+                                        tevent_timeval_current_ofs(
+                                            state->delay / 1000,
+                                            (state->delay % 1000) * 1000),
+                                        sdap_connect_race_timeout, req);
+        if (state->timer == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    return EOK;
+}
+
+static void sdap_connect_race_timeout(struct tevent_context *ev,
+                                      struct tevent_timer *te,
+                                      struct timeval tv, void *pvt)
+{
+    struct sdap_connect_race_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = talloc_get_type(pvt, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+    state->timer = NULL;
+
+    if (state->next_addr >= state->num_addrs) {
+        /* Still waiting for the other address family, it will be tried
+         * as soon as it is resolved. */
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "No connection to [%s] within %d ms, "
+          "trying next address in parallel\n", state->uri, state->delay);
+
+    ret = sdap_connect_race_next(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+}
+
+static void sdap_connect_race_resolve_done(struct tevent_req *subreq)
+{
+    struct sdap_connect_race_state *state;
+    struct resolv_hostent *hostent = NULL;
+    struct tevent_req *req;
+    int status;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+
+    ret = resolv_gethostbyname_recv(subreq, state, &status, NULL, &hostent);
+    talloc_zfree(subreq);
+    state->resolve_req = NULL;
+    if (ret != EOK) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Unable to resolve the other address "
+              "family for [%s] [%d]: %s\n", state->uri, status,
+              resolv_strerror(status));
+        sdap_connect_race_check_done(req);
+        return;
+    }
+
+    ret = sdap_connect_race_add(state, hostent, true);
+    talloc_free(hostent);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    /* Start immediately if the delay has already passed or if all previous
+     * attempts have failed meanwhile. */
+    if (state->timer == NULL || state->running == 0) {
+        ret = sdap_connect_race_next(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+    }
+
+    sdap_connect_race_check_done(req);
+}
+
+static void sdap_connect_race_attempt_done(struct tevent_req *subreq)
+{
+    struct sdap_connect_race_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+
+    ret = sdap_connect_recv(subreq, state, &state->sh);
+    talloc_zfree(subreq);
+    state->running--;
+    if (ret == EOK) {
+        /* We have a winner, cancel all other attempts. */
+        talloc_zfree(state->attempts);
+        talloc_zfree(state->timer);
+        talloc_zfree(state->resolve_req);
+        tevent_req_done(req);
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Connection attempt to [%s] failed [%d]: %s\n",
+          state->uri, ret, sss_strerror(ret));
+    state->last_error = ret;
+
+    /* Do not wait for the delay, try the next address right away. */
+    ret = sdap_connect_race_next(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    sdap_connect_race_check_done(req);
+}
+
+static void sdap_connect_race_check_done(struct tevent_req *req)
+{
+    struct sdap_connect_race_state *state;
+
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+
+    if (state->running > 0 || state->resolve_req != NULL
+            || state->next_addr < state->num_addrs) {
+        return;
+    }
+
+    DEBUG(SSSDBG_OP_FAILURE, "All connection attempts to [%s] failed\n",
+          state->uri);
+    tevent_req_error(req, state->last_error);
+}
+
+int sdap_connect_race_recv(struct tevent_req *req,
+                           TALLOC_CTX *memctx,
+                           struct sdap_handle **sh)
+{
+    struct sdap_connect_race_state *state;
+
+    state = tevent_req_data(req, struct sdap_connect_race_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *sh = talloc_steal(memctx, state->sh);
+    return EOK;
+}
@@ -1473,6 +1473,7 @@ struct sdap_cli_connect_state {
 
 static int sdap_cli_resolve_next(struct tevent_req *req);
 static void sdap_cli_resolve_done(struct tevent_req *subreq);
+static errno_t sdap_cli_connect_step(struct tevent_req *req);
 static void sdap_cli_connect_done(struct tevent_req *subreq);
 static void sdap_cli_rootdse_step(struct tevent_req *req);
 static void sdap_cli_rootdse_done(struct tevent_req *subreq);
@@ -1598,15 +1599,29 @@ static void sdap_cli_resolve_done(struct tevent_req *subreq)
         return;
     }
 
-    subreq = sdap_connect_send(state, state->ev, state->opts,
-                               state->service->uri,
-                               state->service->sockaddr,
-                               state->use_tls);
+    ret = sdap_cli_connect_step(req);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+    }
+}
+
+static errno_t sdap_cli_connect_step(struct tevent_req *req)
+{
+    struct sdap_cli_connect_state *state = tevent_req_data(req,
+                                             struct sdap_cli_connect_state);
+    struct tevent_req *subreq;
+
+    subreq = sdap_connect_race_send(state, state->ev, state->opts,
+                                    state->be->be_res, state->srv,
+                                    state->service->uri,
+                                    state->service->sockaddr,
+                                    state->use_tls);
     if (!subreq) {
-        tevent_req_error(req, ENOMEM);
-        return;
+        return ENOMEM;
     }
     tevent_req_set_callback(subreq, sdap_cli_connect_done, req);
+
+    return EOK;
 }
 
 static void sdap_cli_connect_done(struct tevent_req *subreq)
@@ -1619,24 +1634,17 @@ static void sdap_cli_connect_done(struct tevent_req *subreq)
     int ret;
 
     talloc_zfree(state->sh);
-    ret = sdap_connect_recv(subreq, state, &state->sh);
+    ret = sdap_connect_race_recv(subreq, state, &state->sh);
     talloc_zfree(subreq);
     if (ret == ERR_TLS_HANDSHAKE_INTERRUPTED &&
         state->retry_attempts < MAX_RETRY_ATTEMPTS) {
         DEBUG(SSSDBG_OP_FAILURE,
               "TLS handshake was interruped, provider will retry\n");
         state->retry_attempts++;
-        subreq = sdap_connect_send(state, state->ev, state->opts,
-                                   state->service->uri,
-                                   state->service->sockaddr,
-                                   state->use_tls);
-
-        if (!subreq) {
-            tevent_req_error(req, ENOMEM);
-            return;
+        ret = sdap_cli_connect_step(req);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
         }
-
-        tevent_req_set_callback(subreq, sdap_cli_connect_done, req);
         return;
     } else if (ret != EOK) {
         state->retry_attempts = 0;
@@ -2154,6 +2162,11 @@ int sdap_cli_connect_recv(struct tevent_req *req,
 
         be_fo_set_port_status(state->be, state->service->name,
                               state->srv, PORT_WORKING);
+
+        if (state->sh != NULL) {
+            fo_ref_server(state->sh, state->srv);
+            state->sh->fo_server = state->srv;
+        }
     }
 
     if (gsh) {
@@ -27,6 +27,7 @@
 #include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap_idmap.h"
+#include "providers/ldap/sdap_ops.h"
 
 /* ==Group-Parsing Routines=============================================== */
 
@@ -1742,7 +1743,6 @@ struct sdap_get_groups_state {
     struct sysdb_ctx *sysdb;
     const char **attrs;
     const char *base_filter;
-    char *filter;
     int timeout;
     enum sdap_entry_lookup_type lookup_type;
     bool no_members;
@@ -1756,14 +1756,13 @@ struct sdap_get_groups_state {
     hash_table_t *user_hash;
     hash_table_t *group_hash;
 
-    size_t base_iter;
     struct sdap_search_base **search_bases;
 
     struct sdap_handle *ldap_sh;
     struct sdap_id_op *op;
 };
 
-static errno_t sdap_get_groups_next_base(struct tevent_req *req);
+static errno_t sdap_get_groups_search(struct tevent_req *req);
 static void sdap_get_groups_ldap_connect_done(struct tevent_req *subreq);
 static void sdap_get_groups_process(struct tevent_req *subreq);
 static void sdap_get_groups_done(struct tevent_req *subreq);
@@ -1802,7 +1801,6 @@ struct tevent_req *sdap_get_groups_send(TALLOC_CTX *memctx,
     state->lookup_type = lookup_type;
     state->no_members = no_members;
     state->base_filter = filter;
-    state->base_iter = 0;
     state->search_bases = sdom->group_search_bases;
 
     if (!state->search_bases) {
@@ -1836,7 +1834,7 @@ struct tevent_req *sdap_get_groups_send(TALLOC_CTX *memctx,
         return req;
     }
 
-    ret = sdap_get_groups_next_base(req);
+    ret = sdap_get_groups_search(req);
 
 done:
     if (ret != EOK) {
@@ -1867,7 +1865,7 @@ static void sdap_get_groups_ldap_connect_done(struct tevent_req *subreq)
 
     state->ldap_sh = sdap_id_op_handle(state->op);
 
-    ret = sdap_get_groups_next_base(req);
+    ret = sdap_get_groups_search(req);
     if (ret != EOK) {
         tevent_req_error(req, ret);
     }
@@ -1875,50 +1873,22 @@ static void sdap_get_groups_ldap_connect_done(struct tevent_req *subreq)
     return;
 }
 
-static errno_t sdap_get_groups_next_base(struct tevent_req *req)
+static errno_t sdap_get_groups_search(struct tevent_req *req)
 {
     struct tevent_req *subreq;
     struct sdap_get_groups_state *state;
-    bool need_paging = false;
-    int sizelimit = 0;
 
     state = tevent_req_data(req, struct sdap_get_groups_state);
 
-    talloc_zfree(state->filter);
-    state->filter = sdap_combine_filters(state, state->base_filter,
-                        state->search_bases[state->base_iter]->filter);
-    if (!state->filter) {
-        return ENOMEM;
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Searching for groups with base [%s]\n",
-           state->search_bases[state->base_iter]->basedn);
-
-    switch (state->lookup_type) {
-    case SDAP_LOOKUP_SINGLE:
-        break;
-    /* Only requests that can return multiple entries should require
-     * the paging control
-     */
-    case SDAP_LOOKUP_WILDCARD:
-        sizelimit = dp_opt_get_int(state->opts->basic, SDAP_WILDCARD_LIMIT);
-        need_paging = true;
-        break;
-    case SDAP_LOOKUP_ENUMERATE:
-        need_paging = true;
-        break;
-    }
+    DEBUG(SSSDBG_TRACE_FUNC, "Searching for groups\n");
 
-    subreq = sdap_get_and_parse_generic_send(
+    subreq = sdap_search_bases_lookup_send(
             state, state->ev, state->opts,
             state->ldap_sh != NULL ? state->ldap_sh : state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
+            state->search_bases,
             state->opts->group_map, SDAP_OPTS_GROUP,
-            0, NULL, NULL, sizelimit, state->timeout,
-            need_paging);
+            state->lookup_type, state->timeout,
+            state->base_filter, state->attrs);
     if (!subreq) {
         return ENOMEM;
     }
@@ -1940,13 +1910,11 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
                         tevent_req_data(req, struct sdap_get_groups_state);
     int ret;
     int i;
-    bool next_base = false;
     size_t count;
     struct sysdb_attrs **groups;
     char **sysdb_groupnamelist;
 
-    ret = sdap_get_and_parse_generic_recv(subreq, state,
-                                          &count, &groups);
+    ret = sdap_search_bases_lookup_recv(subreq, state, &count, &groups);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -1956,13 +1924,6 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
     DEBUG(SSSDBG_TRACE_FUNC,
           "Search for groups, returned %zu results.\n", count);
 
-    if (state->lookup_type == SDAP_LOOKUP_WILDCARD || \
-            state->lookup_type == SDAP_LOOKUP_ENUMERATE || \
-        count == 0) {
-        /* No users found in this search or looking up multiple entries */
-        next_base = true;
-    }
-
     /* Add this batch of groups to the list */
     if (count > 0) {
         state->groups =
@@ -1978,21 +1939,7 @@ static void sdap_get_groups_process(struct tevent_req *subreq)
         sdap_search_group_copy_batch(state, groups, count);
     }
 
-    if (next_base) {
-        state->base_iter++;
-        if (state->search_bases[state->base_iter]) {
-            /* There are more search bases to try */
-            ret = sdap_get_groups_next_base(req);
-            if (ret != EOK) {
-                tevent_req_error(req, ret);
-            }
-            return;
-        }
-    }
-
-    /* No more search bases
-     * Return ENOENT if no groups were found
-     */
+    /* Return ENOENT if no groups were found */
     if (state->count == 0) {
         tevent_req_error(req, ENOENT);
         return;
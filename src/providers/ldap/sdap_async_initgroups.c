@@ -27,6 +27,7 @@
 #include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap_idmap.h"
+#include "providers/ldap/sdap_ops.h"
 #include "providers/ldap/sdap_users.h"
 
 /* ==Save-fake-group-list=====================================*/
@@ -390,7 +391,6 @@ struct sdap_initgr_rfc2307_state {
     const char *name;
     char *base_filter;
     const char *orig_dn;
-    char *filter;
     int timeout;
 
     struct sdap_op *op;
@@ -398,11 +398,9 @@ struct sdap_initgr_rfc2307_state {
     struct sysdb_attrs **ldap_groups;
     size_t ldap_groups_count;
 
-    size_t base_iter;
     struct sdap_search_base **search_bases;
 };
 
-static errno_t sdap_initgr_rfc2307_next_base(struct tevent_req *req);
 static void sdap_initgr_rfc2307_process(struct tevent_req *subreq);
 struct tevent_req *sdap_initgr_rfc2307_send(TALLOC_CTX *memctx,
                                             struct tevent_context *ev,
@@ -413,6 +411,7 @@ struct tevent_req *sdap_initgr_rfc2307_send(TALLOC_CTX *memctx,
                                             const char *name)
 {
     struct tevent_req *req;
+    struct tevent_req *subreq;
     struct sdap_initgr_rfc2307_state *state;
     const char **attr_filter;
     char *clean_name;
@@ -432,7 +431,6 @@ struct tevent_req *sdap_initgr_rfc2307_send(TALLOC_CTX *memctx,
     state->timeout = dp_opt_get_int(state->opts->basic, SDAP_SEARCH_TIMEOUT);
     state->ldap_groups = NULL;
     state->ldap_groups_count = 0;
-    state->base_iter = 0;
     state->search_bases = opts->sdom->group_search_bases;
 
     if (!state->search_bases) {
@@ -511,7 +509,21 @@ struct tevent_req *sdap_initgr_rfc2307_send(TALLOC_CTX *memctx,
         goto done;
     }
 
-    ret = sdap_initgr_rfc2307_next_base(req);
+    DEBUG(SSSDBG_TRACE_FUNC, "Searching for groups of user [%s]\n", name);
+
+    subreq = sdap_search_bases_send(state, state->ev, state->opts,
+                                    state->sh, state->search_bases,
+                                    state->opts->group_map, true,
+                                    state->timeout, state->base_filter,
+                                    state->attrs, NULL);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tevent_req_set_callback(subreq, sdap_initgr_rfc2307_process, req);
+
+    ret = EOK;
 
 done:
     if (ret != EOK) {
@@ -522,42 +534,6 @@ done:
     return req;
 }
 
-static errno_t sdap_initgr_rfc2307_next_base(struct tevent_req *req)
-{
-    struct tevent_req *subreq;
-    struct sdap_initgr_rfc2307_state *state;
-
-    state = tevent_req_data(req, struct sdap_initgr_rfc2307_state);
-
-    talloc_zfree(state->filter);
-
-    state->filter = sdap_combine_filters( state, state->base_filter,
-                        state->search_bases[state->base_iter]->filter);
-    if (!state->filter) {
-        return ENOMEM;
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Searching for groups with base [%s]\n",
-           state->search_bases[state->base_iter]->basedn);
-
-    subreq = sdap_get_generic_send(
-            state, state->ev, state->opts, state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->group_map, SDAP_OPTS_GROUP,
-            state->timeout,
-            true);
-    if (!subreq) {
-        return ENOMEM;
-    }
-
-    tevent_req_set_callback(subreq, sdap_initgr_rfc2307_process, req);
-
-    return EOK;
-}
-
 static void sdap_initgr_rfc2307_process(struct tevent_req *subreq)
 {
     struct tevent_req *req;
@@ -566,55 +542,30 @@ static void sdap_initgr_rfc2307_process(struct tevent_req *subreq)
     char **sysdb_grouplist = NULL;
     size_t count;
     int ret;
-    int i;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct sdap_initgr_rfc2307_state);
 
-    ret = sdap_get_generic_recv(subreq, state, &count, &ldap_groups);
+    ret = sdap_search_bases_recv(subreq, state, &count, &ldap_groups);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
         return;
     }
 
-    /* Add this batch of groups to the list */
+    /* Replies from all search bases are already merged */
     if (count > 0) {
-        state->ldap_groups =
-                talloc_realloc(state,
-                               state->ldap_groups,
-                               struct sysdb_attrs *,
-                               state->ldap_groups_count + count + 1);
+        state->ldap_groups = talloc_realloc(state, ldap_groups,
+                                            struct sysdb_attrs *, count + 1);
         if (!state->ldap_groups) {
             tevent_req_error(req, ENOMEM);
             return;
         }
 
-        /* Copy the new groups into the list.
-         */
-        for (i = 0; i < count; i++) {
-            state->ldap_groups[state->ldap_groups_count + i] =
-                talloc_steal(state->ldap_groups, ldap_groups[i]);
-        }
-
-        state->ldap_groups_count += count;
-
+        state->ldap_groups_count = count;
         state->ldap_groups[state->ldap_groups_count] = NULL;
     }
 
-    state->base_iter++;
-
-    /* Check for additional search bases, and iterate
-     * through again.
-     */
-    if (state->search_bases[state->base_iter] != NULL) {
-        ret = sdap_initgr_rfc2307_next_base(req);
-        if (ret != EOK) {
-            tevent_req_error(req, ret);
-        }
-        return;
-    }
-
     /* Search for all groups for which this user is a member */
     ret = get_sysdb_grouplist(state, state->sysdb, state->domain,
                               state->name, &sysdb_grouplist);
@@ -1559,13 +1510,11 @@ struct sdap_initgr_rfc2307bis_state {
     struct sdap_handle *sh;
     const char *name;
     char *base_filter;
-    char *filter;
     const char **attrs;
     const char *orig_dn;
 
     int timeout;
 
-    size_t base_iter;
     struct sdap_search_base **search_bases;
 
     struct sdap_op *op;
@@ -1581,7 +1530,6 @@ struct sdap_nested_group {
     size_t parents_count;
 };
 
-static errno_t sdap_initgr_rfc2307bis_next_base(struct tevent_req *req);
 static void sdap_initgr_rfc2307bis_process(struct tevent_req *subreq);
 static void sdap_initgr_rfc2307bis_done(struct tevent_req *subreq);
 errno_t save_rfc2307bis_user_memberships(
@@ -1598,6 +1546,7 @@ static struct tevent_req *sdap_initgr_rfc2307bis_send(
 {
     errno_t ret;
     struct tevent_req *req;
+    struct tevent_req *subreq;
     struct sdap_initgr_rfc2307bis_state *state;
     const char **attr_filter;
     char *clean_orig_dn;
@@ -1617,7 +1566,6 @@ static struct tevent_req *sdap_initgr_rfc2307bis_send(
     state->direct_groups = NULL;
     state->num_direct_parents = 0;
     state->timeout = dp_opt_get_int(state->opts->basic, SDAP_SEARCH_TIMEOUT);
-    state->base_iter = 0;
     state->search_bases = sdom->group_search_bases;
     state->orig_dn = orig_dn;
 
@@ -1692,7 +1640,21 @@ static struct tevent_req *sdap_initgr_rfc2307bis_send(
 
     talloc_zfree(clean_orig_dn);
 
-    ret = sdap_initgr_rfc2307bis_next_base(req);
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Searching for parent groups for user [%s]\n", state->orig_dn);
+
+    subreq = sdap_search_bases_send(state, state->ev, state->opts,
+                                    state->sh, state->search_bases,
+                                    state->opts->group_map, true,
+                                    state->timeout, state->base_filter,
+                                    state->attrs, NULL);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    tevent_req_set_callback(subreq, sdap_initgr_rfc2307bis_process, req);
+
+    ret = EOK;
 
 done:
     if (ret != EOK) {
@@ -1702,55 +1664,18 @@ done:
     return req;
 }
 
-static errno_t sdap_initgr_rfc2307bis_next_base(struct tevent_req *req)
-{
-    struct tevent_req *subreq;
-    struct sdap_initgr_rfc2307bis_state *state;
-
-    state = tevent_req_data(req, struct sdap_initgr_rfc2307bis_state);
-
-    talloc_zfree(state->filter);
-    state->filter = sdap_combine_filters(state, state->base_filter,
-                        state->search_bases[state->base_iter]->filter);
-    if (!state->filter) {
-        return ENOMEM;
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Searching for parent groups for user [%s] with base [%s]\n",
-           state->orig_dn, state->search_bases[state->base_iter]->basedn);
-
-    subreq = sdap_get_generic_send(
-            state, state->ev, state->opts, state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->group_map, SDAP_OPTS_GROUP,
-            state->timeout,
-            true);
-    if (!subreq) {
-        return ENOMEM;
-    }
-    tevent_req_set_callback(subreq, sdap_initgr_rfc2307bis_process, req);
-
-    return EOK;
-}
-
 static void sdap_initgr_rfc2307bis_process(struct tevent_req *subreq)
 {
     struct tevent_req *req;
     struct sdap_initgr_rfc2307bis_state *state;
     struct sysdb_attrs **ldap_groups;
     size_t count;
-    size_t i;
     int ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct sdap_initgr_rfc2307bis_state);
 
-    ret = sdap_get_generic_recv(subreq, state,
-                                &count,
-                                &ldap_groups);
+    ret = sdap_search_bases_recv(subreq, state, &count, &ldap_groups);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -1759,43 +1684,20 @@ static void sdap_initgr_rfc2307bis_process(struct tevent_req *subreq)
     DEBUG(SSSDBG_TRACE_LIBS,
           "Found %zu parent groups for user [%s]\n", count, state->name);
 
-    /* Add this batch of groups to the list */
+    /* Replies from all search bases are already merged */
     if (count > 0) {
-        state->direct_groups =
-                talloc_realloc(state,
-                               state->direct_groups,
-                               struct sysdb_attrs *,
-                               state->num_direct_parents + count + 1);
+        state->direct_groups = talloc_realloc(state, ldap_groups,
+                                              struct sysdb_attrs *,
+                                              count + 1);
         if (!state->direct_groups) {
             tevent_req_error(req, ENOMEM);
             return;
         }
 
-        /* Copy the new groups into the list.
-         */
-        for (i = 0; i < count; i++) {
-            state->direct_groups[state->num_direct_parents + i] =
-                    talloc_steal(state->direct_groups, ldap_groups[i]);
-        }
-
-        state->num_direct_parents += count;
-
+        state->num_direct_parents = count;
         state->direct_groups[state->num_direct_parents] = NULL;
     }
 
-    state->base_iter++;
-
-    /* Check for additional search bases, and iterate
-     * through again.
-     */
-    if (state->search_bases[state->base_iter] != NULL) {
-        ret = sdap_initgr_rfc2307bis_next_base(req);
-        if (ret != EOK) {
-            tevent_req_error(req, ret);
-        }
-        return;
-    }
-
     if (state->num_direct_parents == 0) {
         /* Start a transaction to look up the groups in the sysdb
          * and update them with LDAP data
@@ -26,6 +26,7 @@
 #include "db/sysdb.h"
 #include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/ldap_common.h"
+#include "providers/ldap/sdap_ops.h"
 
 bool is_dn(const char *str)
 {
@@ -567,18 +568,15 @@ struct sdap_get_netgroups_state {
     struct sysdb_ctx *sysdb;
     const char **attrs;
     const char *base_filter;
-    char *filter;
     int timeout;
 
     char *higher_timestamp;
     struct sysdb_attrs **netgroups;
     size_t count;
 
-    size_t base_iter;
     struct sdap_search_base **search_bases;
 };
 
-static errno_t sdap_get_netgroups_next_base(struct tevent_req *req);
 static void sdap_get_netgroups_process(struct tevent_req *subreq);
 static void netgr_translate_members_done(struct tevent_req *subreq);
 
@@ -595,6 +593,7 @@ struct tevent_req *sdap_get_netgroups_send(TALLOC_CTX *memctx,
 {
     errno_t ret;
     struct tevent_req *req;
+    struct tevent_req *subreq;
     struct sdap_get_netgroups_state *state;
 
     req = tevent_req_create(memctx, &state, struct sdap_get_netgroups_state);
@@ -611,7 +610,6 @@ struct tevent_req *sdap_get_netgroups_send(TALLOC_CTX *memctx,
     state->count = 0;
     state->timeout = timeout;
     state->base_filter = filter;
-    state->base_iter = 0;
     state->search_bases = search_bases;
 
     if (!state->search_bases) {
@@ -621,8 +619,23 @@ struct tevent_req *sdap_get_netgroups_send(TALLOC_CTX *memctx,
         goto done;
     }
 
+    DEBUG(SSSDBG_TRACE_FUNC, "Searching for netgroups\n");
+
+    /* The first search base that contains matching netgroups wins */
+    subreq = sdap_search_bases_return_first_send(state, state->ev,
+                                                 state->opts, state->sh,
+                                                 state->search_bases,
+                                                 state->opts->netgroup_map,
+                                                 false, state->timeout,
+                                                 state->base_filter,
+                                                 state->attrs, NULL);
+    if (!subreq) {
+        ret = ENOMEM;
+        goto done;
+    }
+    tevent_req_set_callback(subreq, sdap_get_netgroups_process, req);
 
-    ret = sdap_get_netgroups_next_base(req);
+    ret = EOK;
 
 done:
     if (ret != EOK) {
@@ -632,40 +645,6 @@ done:
     return req;
 }
 
-static errno_t sdap_get_netgroups_next_base(struct tevent_req *req)
-{
-    struct tevent_req *subreq;
-    struct sdap_get_netgroups_state *state;
-
-    state = tevent_req_data(req, struct sdap_get_netgroups_state);
-
-    talloc_zfree(state->filter);
-    state->filter = sdap_combine_filters(state, state->base_filter,
-                        state->search_bases[state->base_iter]->filter);
-    if (!state->filter) {
-        return ENOMEM;
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Searching for netgroups with base [%s]\n",
-           state->search_bases[state->base_iter]->basedn);
-
-    subreq = sdap_get_generic_send(
-            state, state->ev, state->opts, state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->netgroup_map, SDAP_OPTS_NETGROUP,
-            state->timeout,
-            false);
-    if (!subreq) {
-        return ENOMEM;
-    }
-    tevent_req_set_callback(subreq, sdap_get_netgroups_process, req);
-
-    return EOK;
-}
-
 static void sdap_get_netgroups_process(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq,
@@ -674,8 +653,8 @@ static void sdap_get_netgroups_process(struct tevent_req *subreq)
                                                struct sdap_get_netgroups_state);
     int ret;
 
-    ret = sdap_get_generic_recv(subreq, state,
-                                &state->count, &state->netgroups);
+    ret = sdap_search_bases_return_first_recv(subreq, state, &state->count,
+                                              &state->netgroups);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -686,17 +665,7 @@ static void sdap_get_netgroups_process(struct tevent_req *subreq)
           "Search for netgroups, returned %zu results.\n", state->count);
 
     if (state->count == 0) {
-        /* No netgroups found in this search */
-        state->base_iter++;
-        if (state->search_bases[state->base_iter]) {
-            /* There are more search bases to try */
-            ret = sdap_get_netgroups_next_base(req);
-            if (ret != EOK) {
-                tevent_req_error(req, ENOENT);
-            }
-            return;
-        }
-
+        /* No netgroups found in any search base */
         tevent_req_error(req, ENOENT);
         return;
     }
@@ -58,6 +58,22 @@ errno_t sdap_call_conn_cb(const char *uri,int fd, struct sdap_handle *sh);
 
 int sdap_op_get_msgid(struct sdap_op *op);
 
+/* Connect to all addresses of srv in a staggered way, the first established
+ * connection wins. If srv is NULL or racing is disabled, only sockaddr is
+ * used. Implemented in sdap_async_connect_race.c */
+struct tevent_req *
+sdap_connect_race_send(TALLOC_CTX *memctx,
+                       struct tevent_context *ev,
+                       struct sdap_options *opts,
+                       struct be_resolv_ctx *be_res,
+                       struct fo_server *srv,
+                       const char *uri,
+                       struct sockaddr_storage *sockaddr,
+                       bool use_start_tls);
+int sdap_connect_race_recv(struct tevent_req *req,
+                           TALLOC_CTX *memctx,
+                           struct sdap_handle **sh);
+
 int sdap_op_add(TALLOC_CTX *memctx, struct tevent_context *ev,
                 struct sdap_handle *sh, int msgid, const char *stat_info,
                 sdap_op_callback_t *callback, void *data,
@@ -29,6 +29,7 @@
 #include "providers/ldap/sdap_async_private.h"
 #include "providers/ldap/ldap_common.h"
 #include "providers/ldap/sdap_idmap.h"
+#include "providers/ldap/sdap_ops.h"
 #include "providers/ldap/sdap_users.h"
 
 #define REALM_SEPARATOR '@'
@@ -754,7 +755,6 @@ struct sdap_search_user_state {
 
     const char **attrs;
     const char *base_filter;
-    const char *filter;
     int timeout;
     enum sdap_entry_lookup_type lookup_type;
 
@@ -762,11 +762,9 @@ struct sdap_search_user_state {
     struct sysdb_attrs **users;
     size_t count;
 
-    size_t base_iter;
     struct sdap_search_base **search_bases;
 };
 
-static errno_t sdap_search_user_next_base(struct tevent_req *req);
 static void sdap_search_user_copy_batch(struct sdap_search_user_state *state,
                                         struct sysdb_attrs **users,
                                         size_t count);
@@ -785,6 +783,7 @@ struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
 {
     errno_t ret;
     struct tevent_req *req;
+    struct tevent_req *subreq;
     struct sdap_search_user_state *state;
 
     req = tevent_req_create(memctx, &state, struct sdap_search_user_state);
@@ -800,7 +799,6 @@ struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
     state->count = 0;
     state->timeout = timeout;
     state->base_filter = filter;
-    state->base_iter = 0;
     state->search_bases = search_bases;
     state->lookup_type = lookup_type;
 
@@ -811,7 +809,23 @@ struct tevent_req *sdap_search_user_send(TALLOC_CTX *memctx,
         goto done;
     }
 
-    ret = sdap_search_user_next_base(req);
+    DEBUG(SSSDBG_TRACE_FUNC, "Searching for users\n");
+
+    subreq = sdap_search_bases_lookup_send(state, state->ev, state->opts,
+                                           state->sh, state->search_bases,
+                                           state->opts->user_map,
+                                           state->opts->user_map_cnt,
+                                           state->lookup_type,
+                                           state->timeout,
+                                           state->base_filter,
+                                           state->attrs);
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    tevent_req_set_callback(subreq, sdap_search_user_process, req);
+
+    ret = EOK;
 
 done:
     if (ret != EOK) {
@@ -822,57 +836,6 @@ done:
     return req;
 }
 
-static errno_t sdap_search_user_next_base(struct tevent_req *req)
-{
-    struct tevent_req *subreq;
-    struct sdap_search_user_state *state;
-    bool need_paging = false;
-    int sizelimit = 0;
-
-    state = tevent_req_data(req, struct sdap_search_user_state);
-
-    talloc_zfree(state->filter);
-    state->filter = sdap_combine_filters(state, state->base_filter,
-                        state->search_bases[state->base_iter]->filter);
-    if (state->filter == NULL) {
-        return ENOMEM;
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Searching for users with base [%s]\n",
-           state->search_bases[state->base_iter]->basedn);
-
-    switch (state->lookup_type) {
-    case SDAP_LOOKUP_SINGLE:
-        break;
-    /* Only requests that can return multiple entries should require
-     * the paging control
-     */
-    case SDAP_LOOKUP_WILDCARD:
-        sizelimit = dp_opt_get_int(state->opts->basic, SDAP_WILDCARD_LIMIT);
-        need_paging = true;
-        break;
-    case SDAP_LOOKUP_ENUMERATE:
-        need_paging = true;
-        break;
-    }
-
-    subreq = sdap_get_and_parse_generic_send(
-            state, state->ev, state->opts, state->sh,
-            state->search_bases[state->base_iter]->basedn,
-            state->search_bases[state->base_iter]->scope,
-            state->filter, state->attrs,
-            state->opts->user_map, state->opts->user_map_cnt,
-            0, NULL, NULL, sizelimit, state->timeout,
-            need_paging);
-    if (subreq == NULL) {
-        return ENOMEM;
-    }
-    tevent_req_set_callback(subreq, sdap_search_user_process, req);
-
-    return EOK;
-}
-
 static void sdap_search_user_process(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq,
@@ -882,10 +845,8 @@ static void sdap_search_user_process(struct tevent_req *subreq)
     int ret;
     size_t count;
     struct sysdb_attrs **users;
-    bool next_base = false;
 
-    ret = sdap_get_and_parse_generic_recv(subreq, state,
-                                          &count, &users);
+    ret = sdap_search_bases_lookup_recv(subreq, state, &count, &users);
     talloc_zfree(subreq);
     if (ret) {
         tevent_req_error(req, ret);
@@ -895,13 +856,6 @@ static void sdap_search_user_process(struct tevent_req *subreq)
     DEBUG(SSSDBG_TRACE_FUNC,
           "Search for users, returned %zu results.\n", count);
 
-    if (state->lookup_type == SDAP_LOOKUP_WILDCARD || \
-            state->lookup_type == SDAP_LOOKUP_ENUMERATE || \
-        count == 0) {
-        /* No users found in this search or looking up multiple entries */
-        next_base = true;
-    }
-
     /* Add this batch of users to the list */
     if (count > 0) {
         state->users =
@@ -917,23 +871,9 @@ static void sdap_search_user_process(struct tevent_req *subreq)
         sdap_search_user_copy_batch(state, users, count);
     }
 
-    if (next_base) {
-        state->base_iter++;
-        if (state->search_bases[state->base_iter]) {
-            /* There are more search bases to try */
-            ret = sdap_search_user_next_base(req);
-            if (ret != EOK) {
-                tevent_req_error(req, ret);
-            }
-            return;
-        }
-    }
-
     DEBUG(SSSDBG_TRACE_INTERNAL, "Retrieved total %zu users\n", state->count);
 
-    /* No more search bases
-     * Return ENOENT if no users were found
-     */
+    /* Return ENOENT if no users were found */
     if (state->count == 0) {
         tevent_req_error(req, ENOENT);
         return;
@@ -45,105 +45,6 @@
 #define LDAP_CHILD_USER  "nobody"
 #endif
 
-struct sdap_child {
-    /* child info */
-    pid_t pid;
-    struct child_io_fds *io;
-};
-
-static void sdap_close_fd(int *fd)
-{
-    int ret;
-
-    if (*fd == -1) {
-        DEBUG(SSSDBG_TRACE_FUNC, "fd already closed\n");
-        return;
-    }
-
-    ret = close(*fd);
-    if (ret) {
-        ret = errno;
-        DEBUG(SSSDBG_OP_FAILURE, "Closing fd %d, return error %d (%s)\n",
-                  *fd, ret, strerror(ret));
-    }
-
-    *fd = -1;
-}
-
-static void child_callback(int child_status,
-                           struct tevent_signal *sige,
-                           void *pvt)
-{
-    if (WEXITSTATUS(child_status) == CHILD_TIMEOUT_EXIT_CODE) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "LDAP child was terminated due to timeout\n");
-
-        struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
-        tevent_req_error(req, ETIMEDOUT);
-    }
-}
-
-static errno_t sdap_fork_child(struct tevent_context *ev,
-                               struct sdap_child *child, struct tevent_req *req)
-{
-    int pipefd_to_child[2] = PIPE_INIT;
-    int pipefd_from_child[2] = PIPE_INIT;
-    pid_t pid;
-    errno_t ret;
-
-    ret = pipe(pipefd_from_child);
-    if (ret == -1) {
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "pipe(from) failed [%d][%s].\n", ret, strerror(ret));
-        goto fail;
-    }
-    ret = pipe(pipefd_to_child);
-    if (ret == -1) {
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "pipe(to) failed [%d][%s].\n", ret, strerror(ret));
-        goto fail;
-    }
-
-    pid = fork();
-
-    if (pid == 0) { /* child */
-        exec_child(child,
-                   pipefd_to_child, pipefd_from_child,
-                   LDAP_CHILD, LDAP_CHILD_LOG_FILE);
-
-        /* We should never get here */
-        DEBUG(SSSDBG_CRIT_FAILURE, "BUG: Could not exec LDAP child\n");
-    } else if (pid > 0) { /* parent */
-        child->pid = pid;
-        child->io->read_from_child_fd = pipefd_from_child[0];
-        PIPE_FD_CLOSE(pipefd_from_child[1]);
-        child->io->write_to_child_fd = pipefd_to_child[1];
-        PIPE_FD_CLOSE(pipefd_to_child[0]);
-        sss_fd_nonblocking(child->io->read_from_child_fd);
-        sss_fd_nonblocking(child->io->write_to_child_fd);
-
-        ret = child_handler_setup(ev, pid, child_callback, req, NULL);
-        if (ret != EOK) {
-            goto fail;
-        }
-
-    } else { /* error */
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "fork failed [%d][%s].\n", ret, strerror(ret));
-        goto fail;
-    }
-
-    return EOK;
-
-fail:
-    PIPE_CLOSE(pipefd_from_child);
-    PIPE_CLOSE(pipefd_to_child);
-    return ret;
-}
-
 static errno_t create_tgt_req_send_buffer(TALLOC_CTX *mem_ctx,
                                           const char *realm_str,
                                           const char *princ_str,
@@ -267,17 +168,10 @@ static int parse_child_response(TALLOC_CTX *mem_ctx,
 
 struct sdap_get_tgt_state {
     struct tevent_context *ev;
-    struct sdap_child *child;
     ssize_t len;
     uint8_t *buf;
-
-    struct tevent_timer *kill_te;
 };
 
-static errno_t set_tgt_child_timeout(struct tevent_req *req,
-                                     struct tevent_context *ev,
-                                     int timeout);
-static void sdap_get_tgt_step(struct tevent_req *subreq);
 static void sdap_get_tgt_done(struct tevent_req *subreq);
 
 struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
@@ -300,21 +194,6 @@ struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
 
     state->ev = ev;
 
-    state->child = talloc_zero(state, struct sdap_child);
-    if (!state->child) {
-        ret = ENOMEM;
-        goto fail;
-    }
-
-    state->child->io = talloc(state, struct child_io_fds);
-    if (state->child->io == NULL) {
-        ret = ENOMEM;
-        goto fail;
-    }
-    state->child->io->read_from_child_fd = -1;
-    state->child->io->write_to_child_fd = -1;
-    talloc_set_destructor((TALLOC_CTX *) state->child->io, child_io_destructor);
-
     /* prepare the data to pass to child */
     ret = create_tgt_req_send_buffer(state,
                                      realm_str, princ_str, keytab_name, lifetime,
@@ -324,25 +203,18 @@ struct tevent_req *sdap_get_tgt_send(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
-    ret = sdap_fork_child(state->ev, state->child, req);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "sdap_fork_child failed.\n");
-        goto fail;
-    }
-
-    ret = set_tgt_child_timeout(req, ev, timeout);
-    if (ret != EOK) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "set_tgt_child_timeout failed.\n");
-        goto fail;
-    }
+    DEBUG(SSSDBG_TRACE_FUNC,
+          "Setting %d seconds timeout for TGT child\n", timeout);
 
-    subreq = write_pipe_send(state, ev, buf->data, buf->size,
-                             state->child->io->write_to_child_fd);
+    /* The helper is kept running between the TGT requests */
+    subreq = sss_child_helper_send(state, ev, LDAP_CHILD, LDAP_CHILD_LOG_FILE,
+                                   STDOUT_FILENO, buf->data, buf->size,
+                                   timeout);
     if (!subreq) {
         ret = ENOMEM;
         goto fail;
     }
-    tevent_req_set_callback(subreq, sdap_get_tgt_step, req);
+    tevent_req_set_callback(subreq, sdap_get_tgt_done, req);
 
     return req;
 
@@ -352,55 +224,32 @@ fail:
     return req;
 }
 
-static void sdap_get_tgt_step(struct tevent_req *subreq)
-{
-    struct tevent_req *req = tevent_req_callback_data(subreq,
-                                                      struct tevent_req);
-    struct sdap_get_tgt_state *state = tevent_req_data(req,
-                                                  struct sdap_get_tgt_state);
-    int ret;
-
-    ret = write_pipe_recv(subreq);
-    talloc_zfree(subreq);
-    if (ret != EOK) {
-        tevent_req_error(req, ret);
-        return;
-    }
-
-    sdap_close_fd(&state->child->io->write_to_child_fd);
-
-    subreq = read_pipe_send(state, state->ev,
-                            state->child->io->read_from_child_fd);
-    if (!subreq) {
-        tevent_req_error(req, ENOMEM);
-        return;
-    }
-    tevent_req_set_callback(subreq, sdap_get_tgt_done, req);
-}
-
 static void sdap_get_tgt_done(struct tevent_req *subreq)
 {
     struct tevent_req *req = tevent_req_callback_data(subreq,
                                                       struct tevent_req);
     struct sdap_get_tgt_state *state = tevent_req_data(req,
                                                   struct sdap_get_tgt_state);
+    int child_status;
     int ret;
 
-    ret = read_pipe_recv(subreq, state, &state->buf, &state->len);
+    ret = sss_child_helper_recv(subreq, state, &state->buf, &state->len,
+                                &child_status);
     talloc_zfree(subreq);
     if (ret != EOK) {
         tevent_req_error(req, ret);
         return;
     }
 
-    sdap_close_fd(&state->child->io->read_from_child_fd);
-
-    if (state->kill_te == NULL) {
-        tevent_req_done(req);
+    if (WIFEXITED(child_status)
+            && WEXITSTATUS(child_status) == CHILD_TIMEOUT_EXIT_CODE) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "LDAP child was terminated due to timeout\n");
+        tevent_req_error(req, ETIMEDOUT);
         return;
     }
 
-    /* wait for child callback to terminate the request */
+    tevent_req_done(req);
 }
 
 int sdap_get_tgt_recv(struct tevent_req *req,
@@ -436,79 +285,3 @@ int sdap_get_tgt_recv(struct tevent_req *req,
     *expire_time_out = expire_time;
     return EOK;
 }
-
-static void get_tgt_sigkill_handler(struct tevent_context *ev,
-                                    struct tevent_timer *te,
-                                    struct timeval tv, void *pvt)
-{
-    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
-    struct sdap_get_tgt_state *state = tevent_req_data(req,
-                                            struct sdap_get_tgt_state);
-    int ret;
-
-    DEBUG(SSSDBG_TRACE_ALL,
-          "timeout for sending SIGKILL to TGT child [%d] reached.\n",
-          state->child->pid);
-
-    ret = kill(state->child->pid, SIGKILL);
-    if (ret == -1) {
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "kill failed [%d][%s].\n", errno, strerror(errno));
-    }
-
-    tevent_req_error(req, ETIMEDOUT);
-}
-
-static void get_tgt_timeout_handler(struct tevent_context *ev,
-                                      struct tevent_timer *te,
-                                      struct timeval tv, void *pvt)
-{
-    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
-    struct sdap_get_tgt_state *state = tevent_req_data(req,
-                                            struct sdap_get_tgt_state);
-    int ret;
-
-    DEBUG(SSSDBG_TRACE_ALL,
-          "timeout for sending SIGTERM to TGT child [%d] reached.\n",
-          state->child->pid);
-
-    ret = kill(state->child->pid, SIGTERM);
-    if (ret == -1) {
-        ret = errno;
-        DEBUG(SSSDBG_CRIT_FAILURE,
-              "Sending SIGTERM failed [%d][%s].\n", ret, strerror(ret));
-    }
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Setting %d seconds timeout for sending SIGKILL to TGT child\n",
-          SIGTERM_TO_SIGKILL_TIME);
-
-    tv = tevent_timeval_current_ofs(SIGTERM_TO_SIGKILL_TIME, 0);
-
-    state->kill_te = tevent_add_timer(ev, req, tv, get_tgt_sigkill_handler, req);
-    if (state->kill_te == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        tevent_req_error(req, ECANCELED);
-    }
-}
-
-static errno_t set_tgt_child_timeout(struct tevent_req *req,
-                                     struct tevent_context *ev,
-                                     int timeout)
-{
-    struct tevent_timer *te;
-    struct timeval tv;
-
-    DEBUG(SSSDBG_TRACE_FUNC,
-          "Setting %d seconds timeout for TGT child\n", timeout);
-
-    tv = tevent_timeval_current_ofs(timeout, 0);
-
-    te = tevent_add_timer(ev, req, tv, get_tgt_timeout_handler, req);
-    if (te == NULL) {
-        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
-        return ENOMEM;
-    }
-
-    return EOK;
-}
@@ -26,6 +26,13 @@
 #include "providers/ldap/sdap_async.h"
 #include "providers/ldap/ldap_common.h"
 
+struct sdap_search_bases_ex_result {
+    struct tevent_req *subreq;
+    bool done;
+    size_t count;
+    struct sysdb_attrs **reply;
+};
+
 struct sdap_search_bases_ex_state {
     struct tevent_context *ev;
     struct sdap_options *opts;
@@ -35,21 +42,47 @@ struct sdap_search_bases_ex_state {
     struct sdap_attr_map *map;
     int map_num_attrs;
     int timeout;
+    int sizelimit;
     bool allow_paging;
     bool return_first_reply;
     const char *base_dn;
 
-    size_t base_iter;
-    struct sdap_search_base *cur_base;
     struct sdap_search_base **bases;
+    size_t num_bases;
+
+    /* Searches for up to max_parallel bases are outstanding at any time.
+     * Replies are collected per base and merged strictly in the configured
+     * order so the result does not depend on which server reply arrives
+     * first. */
+    size_t max_parallel;
+    size_t running;
+    size_t launch_iter;
+    size_t merge_iter;
+    struct sdap_search_bases_ex_result *results;
 
     size_t reply_count;
     struct sysdb_attrs **reply;
 };
 
 static errno_t sdap_search_bases_ex_next_base(struct tevent_req *req);
+static void sdap_search_bases_ex_cancel(struct sdap_search_bases_ex_state *state);
 static void sdap_search_bases_ex_done(struct tevent_req *subreq);
 
+static int sdap_search_bases_map_count(struct sdap_attr_map *map)
+{
+    int num_attrs;
+
+    if (map == NULL) {
+        return 0;
+    }
+
+    for (num_attrs = 0; map[num_attrs].opt_name != NULL; num_attrs++) {
+        /* no op */;
+    }
+
+    return num_attrs;
+}
+
 static struct tevent_req *
 sdap_search_bases_ex_send(TALLOC_CTX *mem_ctx,
                           struct tevent_context *ev,
@@ -57,8 +90,10 @@ sdap_search_bases_ex_send(TALLOC_CTX *mem_ctx,
                           struct sdap_handle *sh,
                           struct sdap_search_base **bases,
                           struct sdap_attr_map *map,
+                          int map_num_attrs,
                           bool allow_paging,
                           bool return_first_reply,
+                          int sizelimit,
                           int timeout,
                           const char *filter,
                           const char **attrs,
@@ -66,6 +101,7 @@ sdap_search_bases_ex_send(TALLOC_CTX *mem_ctx,
 {
     struct tevent_req *req;
     struct sdap_search_bases_ex_state *state;
+    int max_parallel;
     errno_t ret;
 
     req = tevent_req_create(mem_ctx, &state, struct sdap_search_bases_ex_state);
@@ -84,26 +120,18 @@ sdap_search_bases_ex_send(TALLOC_CTX *mem_ctx,
     state->sh = sh;
     state->bases = bases;
     state->map = map;
+    state->map_num_attrs = map_num_attrs;
     state->filter = filter;
     state->attrs = attrs;
     state->allow_paging = allow_paging;
     state->return_first_reply = return_first_reply;
+    state->sizelimit = sizelimit;
     state->base_dn = base_dn;
 
     state->timeout = timeout == 0
                      ? dp_opt_get_int(opts->basic, SDAP_SEARCH_TIMEOUT)
                      : timeout;
 
-    if (state->map != NULL) {
-        for (state->map_num_attrs = 0;
-                state->map[state->map_num_attrs].opt_name != NULL;
-                state->map_num_attrs++) {
-            /* no op */;
-        }
-    } else {
-        state->map_num_attrs = 0;
-    }
-
     if (state->attrs == NULL && state->map != NULL) {
         ret = build_attrs_from_map(state, state->map, state->map_num_attrs,
                                    NULL, &state->attrs, NULL);
@@ -114,13 +142,35 @@ sdap_search_bases_ex_send(TALLOC_CTX *mem_ctx,
         }
     }
 
-    state->base_iter = 0;
+    for (state->num_bases = 0; bases[state->num_bases] != NULL;
+            state->num_bases++) {
+        /* no op */;
+    }
+
+    if (state->num_bases == 0) {
+        ret = EOK;
+        goto immediately;
+    }
+
+    state->results = talloc_zero_array(state,
+                                       struct sdap_search_bases_ex_result,
+                                       state->num_bases);
+    if (state->results == NULL) {
+        ret = ENOMEM;
+        goto immediately;
+    }
+
+    max_parallel = dp_opt_get_int(opts->basic, SDAP_SEARCH_BASES_PARALLEL);
+    state->max_parallel = max_parallel > 1 ? max_parallel : 1;
+
     ret = sdap_search_bases_ex_next_base(req);
     if (ret == EAGAIN) {
         /* asynchronous processing */
         return req;
     }
 
+    sdap_search_bases_ex_cancel(state);
+
 immediately:
     if (ret == EOK) {
         tevent_req_done(req);
@@ -132,92 +182,171 @@ immediately:
     return req;
 }
 
+static void sdap_search_bases_ex_cancel(struct sdap_search_bases_ex_state *state)
+{
+    size_t i;
+
+    for (i = 0; i < state->num_bases; i++) {
+        talloc_zfree(state->results[i].subreq);
+    }
+
+    state->running = 0;
+}
+
+/* Issue searches for further search bases until the concurrency limit is
+ * reached. Returns EAGAIN while there are outstanding searches and EOK once
+ * every base has been searched. */
 static errno_t sdap_search_bases_ex_next_base(struct tevent_req *req)
 {
     struct sdap_search_bases_ex_state *state;
+    struct sdap_search_base *base;
     struct tevent_req *subreq;
     const char *base_dn;
     char *filter;
 
     state = tevent_req_data(req, struct sdap_search_bases_ex_state);
-    state->cur_base = state->bases[state->base_iter];
-    if (state->cur_base == NULL) {
-        return EOK;
-    }
 
-    /* Combine lookup and search base filters. */
-    filter = sdap_combine_filters(state, state->filter,
-                                  state->cur_base->filter);
-    if (filter == NULL) {
-        return ENOMEM;
-    }
+    while (state->running < state->max_parallel
+            && state->launch_iter < state->num_bases) {
+        base = state->bases[state->launch_iter];
+
+        /* Combine lookup and search base filters. */
+        filter = sdap_combine_filters(state, state->filter, base->filter);
+        if (filter == NULL) {
+            return ENOMEM;
+        }
 
-    base_dn = state->base_dn != NULL ? state->base_dn : state->cur_base->basedn;
+        base_dn = state->base_dn != NULL ? state->base_dn : base->basedn;
+
+        DEBUG(SSSDBG_TRACE_FUNC, "Issuing LDAP lookup with base [%s]\n",
+                                 base_dn);
+
+        subreq = sdap_get_and_parse_generic_send(state, state->ev, state->opts,
+                                                 state->sh, base_dn,
+                                                 base->scope, filter,
+                                                 state->attrs, state->map,
+                                                 state->map_num_attrs,
+                                                 0, NULL, NULL,
+                                                 state->sizelimit,
+                                                 state->timeout,
+                                                 state->allow_paging);
+        if (subreq == NULL) {
+            return ENOMEM;
+        }
 
-    DEBUG(SSSDBG_TRACE_FUNC, "Issuing LDAP lookup with base [%s]\n", base_dn);
+        tevent_req_set_callback(subreq, sdap_search_bases_ex_done, req);
 
-    subreq = sdap_get_generic_send(state, state->ev, state->opts, state->sh,
-                                   base_dn, state->cur_base->scope, filter,
-                                   state->attrs, state->map,
-                                   state->map_num_attrs, state->timeout,
-                                   state->allow_paging);
-    if (subreq == NULL) {
-        return ENOMEM;
+        state->results[state->launch_iter].subreq = subreq;
+        state->launch_iter++;
+        state->running++;
     }
 
-    tevent_req_set_callback(subreq, sdap_search_bases_ex_done, req);
+    if (state->running == 0 && state->merge_iter == state->num_bases) {
+        return EOK;
+    }
 
-    state->base_iter++;
     return EAGAIN;
 }
 
+/* Merge replies of finished searches in the order of the search bases.
+ * Returns EOK when the request is complete, EAGAIN otherwise. */
+static errno_t sdap_search_bases_ex_merge(struct sdap_search_bases_ex_state *state)
+{
+    struct sdap_search_bases_ex_result *result;
+    size_t i;
+
+    while (state->merge_iter < state->num_bases) {
+        result = &state->results[state->merge_iter];
+        if (!result->done) {
+            return EAGAIN;
+        }
+
+        state->merge_iter++;
+
+        if (result->count == 0) {
+            continue;
+        }
+
+        if (state->return_first_reply) {
+            /* Return the first successful search result. */
+            state->reply_count = result->count;
+            state->reply = talloc_steal(state, result->reply);
+            return EOK;
+        }
+
+        /* Merge with previous reply. */
+        state->reply = talloc_realloc(state, state->reply,
+                                      struct sysdb_attrs *,
+                                      state->reply_count + result->count);
+        if (state->reply == NULL) {
+            return ENOMEM;
+        }
+
+        for (i = 0; i < result->count; i++) {
+            state->reply[state->reply_count + i] =
+                                talloc_steal(state->reply, result->reply[i]);
+        }
+
+        state->reply_count += result->count;
+        talloc_zfree(result->reply);
+    }
+
+    return EOK;
+}
+
 static void sdap_search_bases_ex_done(struct tevent_req *subreq)
 {
     struct tevent_req *req;
     struct sdap_search_bases_ex_state *state;
-    struct sysdb_attrs **attrs;
-    size_t count;
+    struct sdap_search_bases_ex_result *result = NULL;
     size_t i;
     int ret;
 
     req = tevent_req_callback_data(subreq, struct tevent_req);
     state = tevent_req_data(req, struct sdap_search_bases_ex_state);
 
+    for (i = 0; i < state->launch_iter; i++) {
+        if (state->results[i].subreq == subreq) {
+            result = &state->results[i];
+            break;
+        }
+    }
+
+    if (result == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Reply for an unknown search base!\n");
+        talloc_zfree(subreq);
+        sdap_search_bases_ex_cancel(state);
+        tevent_req_error(req, ERR_INTERNAL);
+        return;
+    }
+
     DEBUG(SSSDBG_TRACE_FUNC, "Receiving data from base [%s]\n",
-                             state->cur_base->basedn);
+                             state->bases[i]->basedn);
 
-    ret = sdap_get_generic_recv(subreq, state, &count, &attrs);
+    ret = sdap_get_and_parse_generic_recv(subreq, state, &result->count,
+                                          &result->reply);
     talloc_zfree(subreq);
+    result->subreq = NULL;
+    state->running--;
     if (ret != EOK) {
+        sdap_search_bases_ex_cancel(state);
         tevent_req_error(req, ret);
         return;
     }
 
-    /* Add rules to result. */
-    if (count > 0) {
-        if (state->return_first_reply == false) {
-            /* Merge with previous reply. */
-            state->reply = talloc_realloc(state, state->reply,
-                                          struct sysdb_attrs *,
-                                          state->reply_count + count);
-            if (state->reply == NULL) {
-                tevent_req_error(req, ENOMEM);
-                return;
-            }
-
-            for (i = 0; i < count; i++) {
-                state->reply[state->reply_count + i] = talloc_steal(state->reply,
-                                                                    attrs[i]);
-            }
+    result->done = true;
 
-            state->reply_count += count;
-        } else {
-            /* Return the first successful search result. */
-            state->reply_count = count;
-            state->reply = attrs;
-            tevent_req_done(req);
-            return;
-        }
+    ret = sdap_search_bases_ex_merge(state);
+    if (ret == EOK) {
+        /* When returning the first reply, searches of the remaining
+         * bases may still be outstanding but are no longer needed. */
+        sdap_search_bases_ex_cancel(state);
+        tevent_req_done(req);
+        return;
+    } else if (ret != EAGAIN) {
+        sdap_search_bases_ex_cancel(state);
+        tevent_req_error(req, ret);
+        return;
     }
 
     /* Try next search base. */
@@ -225,6 +354,7 @@ static void sdap_search_bases_ex_done(struct tevent_req *subreq)
     if (ret == EOK) {
         tevent_req_done(req);
     } else if (ret != EAGAIN) {
+        sdap_search_bases_ex_cancel(state);
         tevent_req_error(req, ret);
     }
 
@@ -261,7 +391,8 @@ sdap_search_bases_send(TALLOC_CTX *mem_ctx,
                        const char *base_dn)
 {
     return sdap_search_bases_ex_send(mem_ctx, ev, opts, sh, bases, map,
-                                     allow_paging, false, timeout,
+                                     sdap_search_bases_map_count(map),
+                                     allow_paging, false, 0, timeout,
                                      filter, attrs, base_dn);
 }
 
@@ -287,7 +418,8 @@ sdap_search_bases_return_first_send(TALLOC_CTX *mem_ctx,
                                     const char *base_dn)
 {
     return sdap_search_bases_ex_send(mem_ctx, ev, opts, sh, bases, map,
-                                     allow_paging, true, timeout,
+                                     sdap_search_bases_map_count(map),
+                                     allow_paging, true, 0, timeout,
                                      filter, attrs, base_dn);
 }
 
@@ -299,6 +431,53 @@ int sdap_search_bases_return_first_recv(struct tevent_req *req,
     return sdap_search_bases_ex_recv(req, mem_ctx, _reply_count, _reply);
 }
 
+struct tevent_req *
+sdap_search_bases_lookup_send(TALLOC_CTX *mem_ctx,
+                              struct tevent_context *ev,
+                              struct sdap_options *opts,
+                              struct sdap_handle *sh,
+                              struct sdap_search_base **bases,
+                              struct sdap_attr_map *map,
+                              int map_num_attrs,
+                              enum sdap_entry_lookup_type lookup_type,
+                              int timeout,
+                              const char *filter,
+                              const char **attrs)
+{
+    bool return_first_reply = false;
+    bool allow_paging = false;
+    int sizelimit = 0;
+
+    switch (lookup_type) {
+    case SDAP_LOOKUP_SINGLE:
+        return_first_reply = true;
+        break;
+    /* Only requests that can return multiple entries should require
+     * the paging control
+     */
+    case SDAP_LOOKUP_WILDCARD:
+        sizelimit = dp_opt_get_int(opts->basic, SDAP_WILDCARD_LIMIT);
+        allow_paging = true;
+        break;
+    case SDAP_LOOKUP_ENUMERATE:
+        allow_paging = true;
+        break;
+    }
+
+    return sdap_search_bases_ex_send(mem_ctx, ev, opts, sh, bases, map,
+                                     map_num_attrs, allow_paging,
+                                     return_first_reply, sizelimit, timeout,
+                                     filter, attrs, NULL);
+}
+
+int sdap_search_bases_lookup_recv(struct tevent_req *req,
+                                  TALLOC_CTX *mem_ctx,
+                                  size_t *_reply_count,
+                                  struct sysdb_attrs ***_reply)
+{
+    return sdap_search_bases_ex_recv(req, mem_ctx, _reply_count, _reply);
+}
+
 struct sdap_deref_bases_ex_state {
     struct tevent_context *ev;
     struct sdap_options *opts;
@@ -24,6 +24,7 @@
 #include <talloc.h>
 #include <tevent.h>
 #include "providers/ldap/ldap_common.h"
+#include "providers/ldap/sdap_async.h"
 
 struct tevent_req *sdap_search_bases_send(TALLOC_CTX *mem_ctx,
                                           struct tevent_context *ev,
@@ -60,6 +61,26 @@ int sdap_search_bases_return_first_recv(struct tevent_req *req,
                                         size_t *_reply_count,
                                         struct sysdb_attrs ***_reply);
 
+/* Search all bases with the paging, size limit and first-reply semantics
+ * that belong to the given lookup type. */
+struct tevent_req *
+sdap_search_bases_lookup_send(TALLOC_CTX *mem_ctx,
+                              struct tevent_context *ev,
+                              struct sdap_options *opts,
+                              struct sdap_handle *sh,
+                              struct sdap_search_base **bases,
+                              struct sdap_attr_map *map,
+                              int map_num_attrs,
+                              enum sdap_entry_lookup_type lookup_type,
+                              int timeout,
+                              const char *filter,
+                              const char **attrs);
+
+int sdap_search_bases_lookup_recv(struct tevent_req *req,
+                                  TALLOC_CTX *mem_ctx,
+                                  size_t *_reply_count,
+                                  struct sysdb_attrs ***_reply);
+
 struct tevent_req *
 sdap_deref_bases_send(TALLOC_CTX *mem_ctx,
                       struct tevent_context *ev,
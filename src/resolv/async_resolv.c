@@ -60,6 +60,14 @@
 #define DNS_RR_LEN(r)                   DNS__16BIT((r) + 8)
 #define DNS_RR_TTL(r)                   DNS__32BIT((r) + 4)
 
+/* Entries with at least this many hits are refreshed in the background
+ * when the remaining part of their TTL drops under 1/RESOLV_CACHE_PREFETCH
+ * of the original TTL. */
+#define RESOLV_CACHE_PREFETCH_HITS 2
+#define RESOLV_CACHE_PREFETCH 10
+/* Cache statistics are logged every this many lookups */
+#define RESOLV_CACHE_STATS_INTERVAL 100
+
 enum host_database default_host_dbs[] = { DB_FILES, DB_DNS, DB_SENTINEL };
 
 struct fd_watch {
@@ -91,6 +99,40 @@ struct resolv_ctx {
      * if our pending requests didn't timeout. */
     int pending_requests;
     struct tevent_timer *timeout_watcher;
+
+    /* DNS cache, NULL if caching is disabled */
+    struct resolv_cache *cache;
+};
+
+struct resolv_cache_entry {
+    struct resolv_cache_entry *prev;
+    struct resolv_cache_entry *next;
+
+    char *name;
+    int type;
+
+    /* ARES_SUCCESS or a negative answer */
+    int status;
+    unsigned char *abuf;
+    int alen;
+
+    time_t stored;
+    time_t expires;
+    uint32_t hits;
+    bool refreshing;
+};
+
+struct resolv_cache {
+    struct resolv_ctx *ctx;
+
+    /* Most recently used entries are at the head of the list. The cache
+     * is small (it holds the servers of the configured domains), so a
+     * list is sufficient. */
+    struct resolv_cache_entry *entries;
+    size_t max_entries;
+    uint32_t negative_ttl;
+
+    struct resolv_cache_stats stats;
 };
 
 struct request_watch {
@@ -249,7 +291,6 @@ schedule_request_timeout(struct tevent_context *ev, struct resolv_ctx *ctx,
      * before c-ares returns */
     rreq = talloc(ctx, struct resolv_request);
     if (!rreq) {
-        talloc_zfree(req);
         return NULL;
     }
     rreq->ctx = ctx;
@@ -264,7 +305,7 @@ schedule_request_timeout(struct tevent_context *ev, struct resolv_ctx *ctx,
     /* The watch will go away when the request finishes */
     rreq->rwatch = talloc(req, struct request_watch);
     if (!rreq->rwatch) {
-        talloc_zfree(req);
+        talloc_free(rreq);
         return NULL;
     }
 
@@ -312,6 +353,576 @@ unschedule_timeout_watcher(struct resolv_ctx *ctx, struct resolv_request *rreq)
     }
 }
 
+/* ========================= DNS cache ==================================*/
+
+static bool
+resolv_get_ttl(const unsigned char *abuf, const int alen, uint32_t *_ttl);
+
+static const char *
+resolv_cache_type_str(int type)
+{
+    switch (type) {
+    case ns_t_a:
+        return "A";
+    case ns_t_aaaa:
+        return "AAAA";
+    case ns_t_srv:
+        return "SRV";
+    case ns_t_txt:
+        return "TXT";
+    }
+
+    return "unknown";
+}
+
+static struct resolv_cache_entry *
+resolv_cache_find(struct resolv_cache *cache, const char *name, int type)
+{
+    struct resolv_cache_entry *entry;
+
+    DLIST_FOR_EACH(entry, cache->entries) {
+        if (entry->type == type && strcasecmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+resolv_cache_remove(struct resolv_cache *cache,
+                    struct resolv_cache_entry *entry)
+{
+    DLIST_REMOVE(cache->entries, entry);
+    cache->stats.num_entries--;
+    talloc_free(entry);
+}
+
+static void
+resolv_cache_log_stats(struct resolv_cache *cache)
+{
+    uint64_t total;
+
+    total = cache->stats.hits + cache->stats.negative_hits
+            + cache->stats.misses;
+    if (total == 0 || total % RESOLV_CACHE_STATS_INTERVAL != 0) {
+        return;
+    }
+
+    DEBUG(SSSDBG_PERF_STAT, "DNS cache: %"PRIu64" lookups, %"PRIu64" hits, "
+          "%"PRIu64" negative hits, %"PRIu64" misses, %"PRIu64" prefetches, "
+          "%"PRIu64" evictions, %zu entries\n", total, cache->stats.hits,
+          cache->stats.negative_hits, cache->stats.misses,
+          cache->stats.prefetches, cache->stats.evictions,
+          cache->stats.num_entries);
+}
+
+static void
+resolv_cache_remove_lru(struct resolv_cache *cache)
+{
+    struct resolv_cache_entry *entry;
+
+    if (cache->entries == NULL) {
+        return;
+    }
+
+    for (entry = cache->entries; entry->next != NULL; entry = entry->next);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Evicting %s record of '%s' from the "
+          "DNS cache\n", resolv_cache_type_str(entry->type), entry->name);
+    resolv_cache_remove(cache, entry);
+    cache->stats.evictions++;
+}
+
+/* Rewrite TTLs of the answer records so that consumers see how long
+ * the data is still valid instead of the original TTL. */
+static void
+resolv_cache_age_ttl(unsigned char *abuf, int alen, uint32_t elapsed)
+{
+    unsigned char *aptr;
+    unsigned char *tptr;
+    char *name = NULL;
+    unsigned int ancount;
+    unsigned int rr_len;
+    uint32_t rr_ttl;
+    unsigned int i;
+    long len;
+    int ret;
+
+    if (alen < NS_HFIXEDSZ) {
+        return;
+    }
+
+    ancount = DNS_HEADER_ANCOUNT(abuf);
+    aptr = abuf + NS_HFIXEDSZ;
+
+    ret = ares_expand_name(aptr, abuf, alen, &name, &len);
+    ares_free_string(name);
+    if (ret != ARES_SUCCESS) {
+        return;
+    }
+
+    aptr += len + NS_QFIXEDSZ;
+    if (aptr > abuf + alen) {
+        return;
+    }
+
+    for (i = 0; i < ancount; i++) {
+        ret = ares_expand_name(aptr, abuf, alen, &name, &len);
+        ares_free_string(name);
+        if (ret != ARES_SUCCESS) {
+            return;
+        }
+
+        aptr += len;
+        if (aptr + NS_RRFIXEDSZ > abuf + alen) {
+            return;
+        }
+
+        rr_len = DNS_RR_LEN(aptr);
+        rr_ttl = DNS_RR_TTL(aptr);
+        if (aptr + rr_len > abuf + alen) {
+            return;
+        }
+
+        rr_ttl = rr_ttl > elapsed ? rr_ttl - elapsed : 0;
+        tptr = aptr + 4;
+        NS_PUT32(rr_ttl, tptr);
+
+        aptr += NS_RRFIXEDSZ + rr_len;
+    }
+}
+
+static void
+resolv_cache_store(struct resolv_cache *cache, const char *name, int type,
+                   int status, unsigned char *abuf, int alen)
+{
+    struct resolv_cache_entry *entry;
+    uint32_t ttl;
+    time_t now;
+
+    if (status == ARES_SUCCESS) {
+        if (abuf == NULL || !resolv_get_ttl(abuf, alen, &ttl)) {
+            return;
+        }
+    } else if (status == ARES_ENOTFOUND || status == ARES_ENODATA) {
+        ttl = cache->negative_ttl;
+        abuf = NULL;
+        alen = 0;
+    } else {
+        /* Do not cache server failures and timeouts */
+        return;
+    }
+
+    entry = resolv_cache_find(cache, name, type);
+    if (entry != NULL) {
+        resolv_cache_remove(cache, entry);
+    }
+
+    if (ttl == 0) {
+        return;
+    }
+
+    if (cache->stats.num_entries >= cache->max_entries) {
+        resolv_cache_remove_lru(cache);
+    }
+
+    entry = talloc_zero(cache, struct resolv_cache_entry);
+    if (entry == NULL) {
+        return;
+    }
+
+    entry->name = talloc_strdup(entry, name);
+    if (entry->name == NULL) {
+        talloc_free(entry);
+        return;
+    }
+
+    if (abuf != NULL) {
+        entry->abuf = talloc_memdup(entry, abuf, alen);
+        if (entry->abuf == NULL) {
+            talloc_free(entry);
+            return;
+        }
+        entry->alen = alen;
+    }
+
+    now = time(NULL);
+    entry->type = type;
+    entry->status = status;
+    entry->stored = now;
+    entry->expires = now + ttl;
+
+    DLIST_ADD(cache->entries, entry);
+    cache->stats.num_entries++;
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Cached %s %s record of '%s' for %"PRIu32
+          " seconds\n", status == ARES_SUCCESS ? "positive" : "negative",
+          resolv_cache_type_str(type), name, ttl);
+}
+
+struct resolv_cache_query {
+    struct resolv_cache *cache;
+    char *name;
+    int type;
+    ares_callback callback;
+    void *arg;
+};
+
+static void
+resolv_cache_query_done(void *arg, int status, int timeouts,
+                        unsigned char *abuf, int alen)
+{
+    struct resolv_cache_query *query;
+    ares_callback callback;
+    void *callback_arg;
+
+    query = talloc_get_type(arg, struct resolv_cache_query);
+    callback = query->callback;
+    callback_arg = query->arg;
+
+    resolv_cache_store(query->cache, query->name, query->type,
+                       status, abuf, alen);
+
+    /* The query is allocated on the resolv request which is freed by
+     * the callback, do not touch it after this point. */
+    callback(callback_arg, status, timeouts, abuf, alen);
+}
+
+static void
+resolv_query_send(struct resolv_ctx *ctx, struct resolv_request *rreq,
+                  const char *name, int type, bool search, bool use_cache,
+                  ares_callback callback);
+
+struct resolv_cache_refresh_state {
+    struct resolv_ctx *ctx;
+    const char *name;
+    int type;
+    bool search;
+};
+
+static void resolv_cache_refresh_wakeup(struct tevent_req *subreq);
+static void resolv_cache_refresh_done(void *arg, int status, int timeouts,
+                                      unsigned char *abuf, int alen);
+
+static struct tevent_req *
+resolv_cache_refresh_send(TALLOC_CTX *mem_ctx,
+                          struct resolv_ctx *ctx,
+                          const char *name,
+                          int type,
+                          bool search)
+{
+    struct resolv_cache_refresh_state *state;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+
+    req = tevent_req_create(mem_ctx, &state,
+                            struct resolv_cache_refresh_state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    state->ctx = ctx;
+    state->type = type;
+    state->search = search;
+    state->name = talloc_strdup(state, name);
+    if (state->name == NULL) {
+        talloc_free(req);
+        return NULL;
+    }
+
+    /* ares may call the callback immediately */
+    subreq = tevent_wakeup_send(state, ctx->ev_ctx, tevent_timeval_zero());
+    if (subreq == NULL) {
+        talloc_free(req);
+        return NULL;
+    }
+    tevent_req_set_callback(subreq, resolv_cache_refresh_wakeup, req);
+
+    return req;
+}
+
+static void resolv_cache_refresh_wakeup(struct tevent_req *subreq)
+{
+    struct resolv_cache_refresh_state *state;
+    struct resolv_request *rreq;
+    struct tevent_req *req;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct resolv_cache_refresh_state);
+
+    if (!tevent_wakeup_recv(subreq)) {
+        tevent_req_error(req, EIO);
+        return;
+    }
+    talloc_zfree(subreq);
+
+    if (state->ctx->channel == NULL) {
+        tevent_req_error(req, EIO);
+        return;
+    }
+
+    rreq = schedule_timeout_watcher(state->ctx->ev_ctx, state->ctx, req);
+    if (rreq == NULL) {
+        /* Let resolv_cache_refreshed() reset the entry */
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+
+    /* Bypass the cache, its entry is being refreshed */
+    resolv_query_send(state->ctx, rreq, state->name, state->type,
+                      state->search, false, resolv_cache_refresh_done);
+}
+
+static void resolv_cache_refresh_done(void *arg, int status, int timeouts,
+                                      unsigned char *abuf, int alen)
+{
+    struct resolv_request *rreq = talloc_get_type(arg, struct resolv_request);
+    struct tevent_req *req;
+
+    if (rreq->rwatch == NULL) {
+        unschedule_timeout_watcher(rreq->ctx, rreq);
+        return;
+    }
+
+    req = rreq->rwatch->req;
+    unschedule_timeout_watcher(rreq->ctx, rreq);
+
+    /* The answer was already stored in the cache */
+    if (status != ARES_SUCCESS) {
+        tevent_req_error(req, return_code(status));
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t resolv_cache_refresh_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    return EOK;
+}
+
+static void resolv_cache_refreshed(struct tevent_req *req)
+{
+    struct resolv_cache_refresh_state *state;
+    struct resolv_cache_entry *entry;
+    struct resolv_cache *cache;
+    errno_t ret;
+
+    cache = tevent_req_callback_data(req, struct resolv_cache);
+    state = tevent_req_data(req, struct resolv_cache_refresh_state);
+
+    ret = resolv_cache_refresh_recv(req);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to refresh %s record of '%s' "
+              "[%d]: %s\n", resolv_cache_type_str(state->type), state->name,
+              ret, sss_strerror(ret));
+
+        /* Let the next hit try again */
+        entry = resolv_cache_find(cache, state->name, state->type);
+        if (entry != NULL) {
+            entry->refreshing = false;
+        }
+    }
+
+    talloc_free(req);
+}
+
+static void
+resolv_cache_prefetch(struct resolv_cache *cache,
+                      struct resolv_cache_entry *entry,
+                      bool search, time_t now)
+{
+    struct tevent_req *req;
+    time_t ttl;
+
+    ttl = entry->expires - entry->stored;
+    if (entry->status != ARES_SUCCESS
+            || entry->refreshing
+            || entry->hits < RESOLV_CACHE_PREFETCH_HITS
+            || (entry->expires - now) * RESOLV_CACHE_PREFETCH > ttl) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Refreshing %s record of '%s' before it "
+          "expires\n", resolv_cache_type_str(entry->type), entry->name);
+
+    req = resolv_cache_refresh_send(cache, cache->ctx, entry->name,
+                                    entry->type, search);
+    if (req == NULL) {
+        return;
+    }
+    tevent_req_set_callback(req, resolv_cache_refreshed, cache);
+
+    entry->refreshing = true;
+    cache->stats.prefetches++;
+}
+
+/* Try to answer the query from the cache. Returns true if the callback
+ * was already called. */
+static bool
+resolv_cache_lookup(struct resolv_cache *cache, struct resolv_request *rreq,
+                    const char *name, int type, bool search,
+                    ares_callback callback)
+{
+    struct resolv_cache_entry *entry;
+    unsigned char *abuf = NULL;
+    time_t now;
+
+    entry = resolv_cache_find(cache, name, type);
+    if (entry == NULL) {
+        cache->stats.misses++;
+        resolv_cache_log_stats(cache);
+        return false;
+    }
+
+    now = time(NULL);
+    if (entry->expires <= now) {
+        DEBUG(SSSDBG_TRACE_INTERNAL, "Cached %s record of '%s' expired\n",
+              resolv_cache_type_str(type), name);
+        resolv_cache_remove(cache, entry);
+        cache->stats.misses++;
+        return false;
+    }
+
+    if (entry->abuf != NULL) {
+        /* The callback frees rreq before parsing the answer, keep the copy
+         * outside of it. */
+        abuf = talloc_memdup(NULL, entry->abuf, entry->alen);
+        if (abuf == NULL) {
+            cache->stats.misses++;
+            return false;
+        }
+        resolv_cache_age_ttl(abuf, entry->alen, now - entry->stored);
+    }
+
+    if (entry->status == ARES_SUCCESS) {
+        cache->stats.hits++;
+    } else {
+        cache->stats.negative_hits++;
+    }
+    entry->hits++;
+    resolv_cache_log_stats(cache);
+
+    /* Keep the most recently used entries at the head */
+    DLIST_PROMOTE(cache->entries, entry);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Using cached %s record of '%s'\n",
+          resolv_cache_type_str(type), name);
+
+    resolv_cache_prefetch(cache, entry, search, now);
+
+    callback(rreq, entry->status, 0, abuf, entry->alen);
+    talloc_free(abuf);
+    return true;
+}
+
+/* Send the query to DNS, or answer it from the cache if possible and
+ * use_cache is true. With search set to true the resolv.conf search list
+ * is used. The answer is stored in the cache if caching is enabled. */
+static void
+resolv_query_send(struct resolv_ctx *ctx, struct resolv_request *rreq,
+                  const char *name, int type, bool search, bool use_cache,
+                  ares_callback callback)
+{
+    struct resolv_cache_query *query;
+    void *arg = rreq;
+
+    if (ctx->cache != NULL) {
+        if (use_cache && resolv_cache_lookup(ctx->cache, rreq, name, type,
+                                             search, callback)) {
+            return;
+        }
+
+        query = talloc_zero(rreq, struct resolv_cache_query);
+        if (query != NULL) {
+            query->cache = ctx->cache;
+            query->type = type;
+            query->callback = callback;
+            query->arg = rreq;
+            query->name = talloc_strdup(query, name);
+            if (query->name != NULL) {
+                callback = resolv_cache_query_done;
+                arg = query;
+            } else {
+                talloc_free(query);
+            }
+        }
+    }
+
+    if (search) {
+        ares_search(ctx->channel, name, ns_c_in, type, callback, arg);
+    } else {
+        ares_query(ctx->channel, name, ns_c_in, type, callback, arg);
+    }
+}
+
+errno_t
+resolv_cache_init(struct resolv_ctx *ctx, size_t max_entries,
+                  uint32_t negative_ttl)
+{
+    struct resolv_cache *cache;
+
+    if (max_entries == 0) {
+        return EINVAL;
+    }
+
+    /* Pending queries keep a pointer to the cache, so it is never freed
+     * before the resolver context, only reconfigured. */
+    cache = ctx->cache;
+    if (cache == NULL) {
+        cache = talloc_zero(ctx, struct resolv_cache);
+        if (cache == NULL) {
+            return ENOMEM;
+        }
+        cache->ctx = ctx;
+        ctx->cache = cache;
+    }
+
+    cache->max_entries = max_entries;
+    cache->negative_ttl = negative_ttl;
+    while (cache->stats.num_entries > max_entries) {
+        resolv_cache_remove_lru(cache);
+    }
+
+    DEBUG(SSSDBG_CONF_SETTINGS, "DNS cache enabled, up to %zu entries, "
+          "negative TTL %"PRIu32" seconds\n", max_entries, negative_ttl);
+
+    return EOK;
+}
+
+void
+resolv_cache_flush(struct resolv_ctx *ctx)
+{
+    if (ctx == NULL || ctx->cache == NULL) {
+        return;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Flushing the DNS cache\n");
+
+    while (ctx->cache->entries != NULL) {
+        resolv_cache_remove(ctx->cache, ctx->cache->entries);
+    }
+}
+
+errno_t
+resolv_get_cache_stats(struct resolv_ctx *ctx,
+                       struct resolv_cache_stats *_stats)
+{
+    if (ctx == NULL || _stats == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->cache == NULL) {
+        return ENOENT;
+    }
+
+    *_stats = ctx->cache->stats;
+    return EOK;
+}
+
 static void fd_event_add(struct resolv_ctx *ctx, int s, int flags);
 static void fd_event_close(struct resolv_ctx *ctx, int s);
 
@@ -500,6 +1111,9 @@ void
 resolv_reread_configuration(struct resolv_ctx *ctx)
 {
     recreate_ares_channel(ctx);
+
+    /* The name servers might have changed */
+    resolv_cache_flush(ctx);
 }
 
 static errno_t
@@ -879,10 +1493,9 @@ resolv_gethostbyname_dns_query(struct tevent_req *req,
         return;
     }
 
-    ares_search(state->resolv_ctx->channel,
-                state->name, ns_c_in,
-                (state->family == AF_INET) ? ns_t_a : ns_t_aaaa,
-                resolv_gethostbyname_dns_query_done, rreq);
+    resolv_query_send(state->resolv_ctx, rreq, state->name,
+                      (state->family == AF_INET) ? ns_t_a : ns_t_aaaa,
+                      true, true, resolv_gethostbyname_dns_query_done);
 }
 
 static void
@@ -1839,8 +2452,8 @@ resolv_getsrv_query(struct tevent_req *req,
         return;
     }
 
-    ares_query(state->resolv_ctx->channel, state->query,
-               ns_c_in, ns_t_srv, resolv_getsrv_done, rreq);
+    resolv_query_send(state->resolv_ctx, rreq, state->query, ns_t_srv,
+                      false, true, resolv_getsrv_done);
 }
 
 /* TXT parsing is not used anywhere in the code yet, so we disable it
@@ -57,6 +57,31 @@ int resolv_init(TALLOC_CTX *mem_ctx, struct tevent_context *ev_ctx,
 
 void resolv_reread_configuration(struct resolv_ctx *ctx);
 
+/* The DNS cache keeps answers of A, AAAA and SRV queries for as long as
+ * their TTL allows. Negative answers are cached for negative_ttl seconds,
+ * zero disables negative caching. Frequently used entries are refreshed
+ * in the background shortly before they expire. The cache counters are
+ * logged periodically at the SSSDBG_PERF_STAT level and can be read with
+ * resolv_get_cache_stats(). */
+struct resolv_cache_stats {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t prefetches;
+    uint64_t evictions;
+    size_t num_entries;
+};
+
+errno_t resolv_cache_init(struct resolv_ctx *ctx,
+                          size_t max_entries,
+                          uint32_t negative_ttl);
+
+void resolv_cache_flush(struct resolv_ctx *ctx);
+
+/* Returns ENOENT if the cache is disabled */
+errno_t resolv_get_cache_stats(struct resolv_ctx *ctx,
+                               struct resolv_cache_stats *_stats);
+
 const char *resolv_strerror(int ares_code);
 
 struct resolv_hostent *
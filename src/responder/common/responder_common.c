@@ -1483,6 +1483,19 @@ int sss_process_init(TALLOC_CTX *mem_ctx,
         goto fail;
     }
 
+    for (dom = rctx->domains; dom != NULL; dom = get_next_domain(dom, 0)) {
+        if (!dom->cache_shared_search_results) {
+            continue;
+        }
+
+        ret = sysdb_obj_cache_enable(dom->sysdb);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Search results of domain %s will "
+                  "not be shared [%d]: %s\n", dom->name,
+                  ret, sss_strerror(ret));
+        }
+    }
+
     /* after all initializations we are ready to listen on our socket */
     ret = activate_unix_sockets(rctx, conn_setup);
     if (ret != EOK) {
@@ -1020,3 +1020,121 @@ ifp_domains_domain_refresh_access_rules_recv(TALLOC_CTX *mem_ctx,
 
     return EOK;
 }
+
+struct ifp_domains_domain_dns_cache_stats_state {
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t prefetches;
+    uint64_t evictions;
+    uint32_t entries;
+};
+
+static void ifp_domains_domain_dns_cache_stats_done(struct tevent_req *subreq);
+
+struct tevent_req *
+ifp_domains_domain_dns_cache_stats_send(TALLOC_CTX *mem_ctx,
+                                        struct tevent_context *ev,
+                                        struct sbus_request *sbus_req,
+                                        struct ifp_ctx *ifp_ctx)
+{
+    struct ifp_domains_domain_dns_cache_stats_state *state;
+    struct sss_domain_info *dom;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    struct be_conn *be_conn;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state,
+                            struct ifp_domains_domain_dns_cache_stats_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create tevent request!\n");
+        return NULL;
+    }
+
+    dom = get_domain_info_from_req(sbus_req, ifp_ctx);
+    if (dom == NULL) {
+        ret = ERR_DOMAIN_NOT_FOUND;
+        goto done;
+    }
+
+    ret = sss_dp_get_domain_conn(ifp_ctx->rctx, dom->conn_name, &be_conn);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "BUG: The Data Provider connection for "
+              "%s is not available!\n", dom->name);
+        goto done;
+    }
+
+    subreq = sbus_call_dp_backend_DNSCacheStats_send(state, be_conn->conn,
+                be_conn->bus_name, SSS_BUS_PATH);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create subrequest!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tevent_req_set_callback(subreq, ifp_domains_domain_dns_cache_stats_done,
+                            req);
+
+    ret = EAGAIN;
+
+done:
+    if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
+    }
+
+    return req;
+}
+
+static void ifp_domains_domain_dns_cache_stats_done(struct tevent_req *subreq)
+{
+    struct ifp_domains_domain_dns_cache_stats_state *state;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req,
+                            struct ifp_domains_domain_dns_cache_stats_state);
+
+    ret = sbus_call_dp_backend_DNSCacheStats_recv(subreq, &state->hits,
+                                                  &state->negative_hits,
+                                                  &state->misses,
+                                                  &state->prefetches,
+                                                  &state->evictions,
+                                                  &state->entries);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+    return;
+}
+
+errno_t
+ifp_domains_domain_dns_cache_stats_recv(TALLOC_CTX *mem_ctx,
+                                        struct tevent_req *req,
+                                        uint64_t *_hits,
+                                        uint64_t *_negative_hits,
+                                        uint64_t *_misses,
+                                        uint64_t *_prefetches,
+                                        uint64_t *_evictions,
+                                        uint32_t *_entries)
+{
+    struct ifp_domains_domain_dns_cache_stats_state *state;
+    state = tevent_req_data(req,
+                            struct ifp_domains_domain_dns_cache_stats_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_hits = state->hits;
+    *_negative_hits = state->negative_hits;
+    *_misses = state->misses;
+    *_prefetches = state->prefetches;
+    *_evictions = state->evictions;
+    *_entries = state->entries;
+
+    return EOK;
+}
@@ -190,4 +190,20 @@ errno_t
 ifp_domains_domain_refresh_access_rules_recv(TALLOC_CTX *mem_ctx,
                                              struct tevent_req *req);
 
+struct tevent_req *
+ifp_domains_domain_dns_cache_stats_send(TALLOC_CTX *mem_ctx,
+                                        struct tevent_context *ev,
+                                        struct sbus_request *sbus_req,
+                                        struct ifp_ctx *ifp_ctx);
+
+errno_t
+ifp_domains_domain_dns_cache_stats_recv(TALLOC_CTX *mem_ctx,
+                                        struct tevent_req *req,
+                                        uint64_t *_hits,
+                                        uint64_t *_negative_hits,
+                                        uint64_t *_misses,
+                                        uint64_t *_prefetches,
+                                        uint64_t *_evictions,
+                                        uint32_t *_entries);
+
 #endif /* IFP_DOMAINS_H_ */
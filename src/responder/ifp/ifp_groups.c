@@ -624,9 +624,32 @@ struct resolv_ghosts_state {
 
     struct sss_domain_info *domain;
     const char **ghosts;
+    size_t num_ghosts;
     int index;
 };
 
+static errno_t resolv_ghosts_collect(const char *name, void *pvt)
+{
+    struct resolv_ghosts_state *state = pvt;
+    const char **ghosts;
+
+    ghosts = talloc_realloc(state, state->ghosts, const char *,
+                            state->num_ghosts + 2);
+    if (ghosts == NULL) {
+        return ENOMEM;
+    }
+    state->ghosts = ghosts;
+
+    state->ghosts[state->num_ghosts] = talloc_strdup(state->ghosts, name);
+    if (state->ghosts[state->num_ghosts] == NULL) {
+        return ENOMEM;
+    }
+    state->num_ghosts++;
+    state->ghosts[state->num_ghosts] = NULL;
+
+    return EOK;
+}
+
 static void resolv_ghosts_group_done(struct tevent_req *subreq);
 static errno_t resolv_ghosts_step(struct tevent_req *req);
 static void resolv_ghosts_done(struct tevent_req *subreq);
@@ -709,14 +732,24 @@ static void resolv_ghosts_group_done(struct tevent_req *subreq)
     }
 
     el = ldb_msg_find_element(group, SYSDB_GHOST);
-    if (el == NULL || el->num_values == 0) {
-        ret = EOK;
+    if (el != NULL && el->num_values != 0) {
+        state->ghosts = sss_ldb_el_to_string_list(state, el);
+        if (state->ghosts == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        state->num_ghosts = el->num_values;
+    }
+
+    /* Ghost members of large groups are kept in the ghost store */
+    ret = sysdb_ghost_store_traverse(state->domain, group,
+                                     resolv_ghosts_collect, state);
+    if (ret != EOK) {
         goto done;
     }
 
-    state->ghosts = sss_ldb_el_to_string_list(state, el);
-    if (state->ghosts == NULL) {
-        ret = ENOMEM;
+    if (state->num_ghosts == 0) {
+        ret = EOK;
         goto done;
     }
 
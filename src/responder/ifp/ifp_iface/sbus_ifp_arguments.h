@@ -183,6 +183,26 @@ _sbus_ifp_invoker_write_su
    (DBusMessageIter *iter,
     struct _sbus_ifp_invoker_args_su *args);
 
+struct _sbus_ifp_invoker_args_tttttu {
+    uint64_t arg0;
+    uint64_t arg1;
+    uint64_t arg2;
+    uint64_t arg3;
+    uint64_t arg4;
+    uint32_t arg5;
+};
+
+errno_t
+_sbus_ifp_invoker_read_tttttu
+   (TALLOC_CTX *mem_ctx,
+    DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_tttttu *args);
+
+errno_t
+_sbus_ifp_invoker_write_tttttu
+   (DBusMessageIter *iter,
+    struct _sbus_ifp_invoker_args_tttttu *args);
+
 struct _sbus_ifp_invoker_args_u {
     uint32_t arg0;
 };
@@ -265,6 +265,66 @@ done:
     return ret;
 }
 
+static errno_t
+sbus_method_in__out_tttttu
+    (struct sbus_sync_connection *conn,
+     const char *bus,
+     const char *path,
+     const char *iface,
+     const char *method,
+     uint64_t* _arg0,
+     uint64_t* _arg1,
+     uint64_t* _arg2,
+     uint64_t* _arg3,
+     uint64_t* _arg4,
+     uint32_t* _arg5)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct _sbus_ifp_invoker_args_tttttu *out;
+    DBusMessage *reply;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Out of memory!\n");
+        return ENOMEM;
+    }
+
+    out = talloc_zero(tmp_ctx, struct _sbus_ifp_invoker_args_tttttu);
+    if (out == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to allocate space for output parameters!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+
+    ret = sbus_sync_call_method(tmp_ctx, conn, NULL, NULL,
+                                bus, path, iface, method, NULL, &reply);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sbus_read_output(out, reply, (sbus_invoker_reader_fn)_sbus_ifp_invoker_read_tttttu, out);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    *_arg0 = out->arg0;
+    *_arg1 = out->arg1;
+    *_arg2 = out->arg2;
+    *_arg3 = out->arg3;
+    *_arg4 = out->arg4;
+    *_arg5 = out->arg5;
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
 static errno_t
 sbus_method_in_s_out_ao
     (TALLOC_CTX *mem_ctx,
@@ -986,6 +1046,28 @@ sbus_call_ifp_domain_ActiveServer
           _arg_server);
 }
 
+errno_t
+sbus_call_ifp_domain_DNSCacheStats
+    (struct sbus_sync_connection *conn,
+     const char *busname,
+     const char *object_path,
+     uint64_t* _arg_hits,
+     uint64_t* _arg_negative_hits,
+     uint64_t* _arg_misses,
+     uint64_t* _arg_prefetches,
+     uint64_t* _arg_evictions,
+     uint32_t* _arg_entries)
+{
+     return sbus_method_in__out_tttttu(conn,
+          busname, object_path, "org.freedesktop.sssd.infopipe.Domains.Domain", "DNSCacheStats",
+          _arg_hits,
+          _arg_negative_hits,
+          _arg_misses,
+          _arg_prefetches,
+          _arg_evictions,
+          _arg_entries);
+}
+
 errno_t
 sbus_call_ifp_domain_IsOnline
     (struct sbus_sync_connection *conn,
@@ -163,6 +163,18 @@ sbus_call_ifp_domain_ActiveServer
      const char * arg_service,
      const char ** _arg_server);
 
+errno_t
+sbus_call_ifp_domain_DNSCacheStats
+    (struct sbus_sync_connection *conn,
+     const char *busname,
+     const char *object_path,
+     uint64_t* _arg_hits,
+     uint64_t* _arg_negative_hits,
+     uint64_t* _arg_misses,
+     uint64_t* _arg_prefetches,
+     uint64_t* _arg_evictions,
+     uint32_t* _arg_entries);
+
 errno_t
 sbus_call_ifp_domain_IsOnline
     (struct sbus_sync_connection *conn,
@@ -1078,6 +1078,28 @@
         (handler_send), (handler_recv), (data)); \
 })
 
+/* Method: org.freedesktop.sssd.infopipe.Domains.Domain.DNSCacheStats */
+#define SBUS_METHOD_SYNC_org_freedesktop_sssd_infopipe_Domains_Domain_DNSCacheStats(handler, data) ({ \
+    SBUS_CHECK_SYNC((handler), (data), uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint32_t*); \
+    sbus_method_sync("DNSCacheStats", \
+        &_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_DNSCacheStats, \
+        NULL, \
+        _sbus_ifp_invoke_in__out_tttttu_send, \
+        _sbus_ifp_key_, \
+        (handler), (data)); \
+})
+
+#define SBUS_METHOD_ASYNC_org_freedesktop_sssd_infopipe_Domains_Domain_DNSCacheStats(handler_send, handler_recv, data) ({ \
+    SBUS_CHECK_SEND((handler_send), (data)); \
+    SBUS_CHECK_RECV((handler_recv), uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint32_t*); \
+    sbus_method_async("DNSCacheStats", \
+        &_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_DNSCacheStats, \
+        NULL, \
+        _sbus_ifp_invoke_in__out_tttttu_send, \
+        _sbus_ifp_key_, \
+        (handler_send), (handler_recv), (data)); \
+})
+
 /* Method: org.freedesktop.sssd.infopipe.Domains.Domain.IsOnline */
 #define SBUS_METHOD_SYNC_org_freedesktop_sssd_infopipe_Domains_Domain_IsOnline(handler, data) ({ \
     SBUS_CHECK_SYNC((handler), (data), bool*); \
@@ -46,6 +46,7 @@ _sbus_ifp_declare_invoker(, b);
 _sbus_ifp_declare_invoker(, ifp_extra);
 _sbus_ifp_declare_invoker(, o);
 _sbus_ifp_declare_invoker(, s);
+_sbus_ifp_declare_invoker(, tttttu);
 _sbus_ifp_declare_invoker(, u);
 _sbus_ifp_declare_invoker(s, ao);
 _sbus_ifp_declare_invoker(s, as);
@@ -205,6 +205,22 @@ _sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_ActiveServer = {
     }
 };
 
+const struct sbus_method_arguments
+_sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_DNSCacheStats = {
+    .input = (const struct sbus_argument[]){
+        {NULL}
+    },
+    .output = (const struct sbus_argument[]){
+        {.type = "t", .name = "hits"},
+        {.type = "t", .name = "negative_hits"},
+        {.type = "t", .name = "misses"},
+        {.type = "t", .name = "prefetches"},
+        {.type = "t", .name = "evictions"},
+        {.type = "u", .name = "entries"},
+        {NULL}
+    }
+};
+
 const struct sbus_method_arguments
 _sbus_ifp_args_org_freedesktop_sssd_infopipe_Domains_Domain_IsOnline = {
     .input = (const struct sbus_argument[]){
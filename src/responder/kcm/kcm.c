@@ -91,6 +91,7 @@ static errno_t kcm_get_ccdb_be(struct kcm_ctx *kctx)
 {
     errno_t ret;
     char *str_db;
+    int window;
 
     ret = confdb_get_string(kctx->rctx->cdb,
                             kctx->rctx,
@@ -114,6 +115,27 @@ static errno_t kcm_get_ccdb_be(struct kcm_ctx *kctx)
         DEBUG(SSSDBG_FATAL_FAILURE, "Unexpected KCM database type %s\n", str_db);
     }
 
+    ret = confdb_get_int(kctx->rctx->cdb,
+                         kctx->rctx->confdb_service_path,
+                         CONFDB_KCM_WRITE_BACK_WINDOW,
+                         0,
+                         &window);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot get the write-back window [%d]: %s\n",
+               ret, strerror(ret));
+        return ret;
+    }
+
+    if (window > 0) {
+        if (kctx->cc_be == CCDB_BE_SECDB) {
+            kctx->cc_be = CCDB_BE_SECDB_WRITE_BACK;
+        } else {
+            DEBUG(SSSDBG_CONF_SETTINGS, "The write-back window is only "
+                  "used with the secdb database, ignoring it\n");
+        }
+    }
+
     return EOK;
 }
 
@@ -189,6 +211,8 @@ static int kcm_data_destructor(void *ptr)
     struct kcm_resp_ctx *kcm_data = talloc_get_type(ptr, struct kcm_resp_ctx);
 
     if (kcm_data != NULL) {
+        /* Pending write-back changes are stored with the krb5 context */
+        talloc_zfree(kcm_data->db);
         krb5_free_context(kcm_data->k5c);
     }
     return 0;
@@ -209,8 +233,17 @@ static struct kcm_resp_ctx *kcm_data_setup(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
+    kret = sss_krb5_init_context(&kcm_data->k5c);
+    if (kret != EOK) {
+        talloc_free(kcm_data);
+        return NULL;
+    }
+    talloc_set_destructor((TALLOC_CTX*)kcm_data, kcm_data_destructor);
+
+    /* The ccache database shares the krb5 context of the responder */
     kcm_data->db = kcm_ccdb_init(kcm_data,
                                  ev,
+                                 kcm_data->k5c,
                                  cdb,
                                  confdb_service_path,
                                  cc_be);
@@ -219,13 +252,6 @@ static struct kcm_resp_ctx *kcm_data_setup(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    kret = sss_krb5_init_context(&kcm_data->k5c);
-    if (kret != EOK) {
-        talloc_free(kcm_data);
-        return NULL;
-    }
-    talloc_set_destructor((TALLOC_CTX*)kcm_data, kcm_data_destructor);
-
     return kcm_data;
 }
 
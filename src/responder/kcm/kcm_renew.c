@@ -33,28 +33,13 @@
 
 extern struct dp_option default_krb5_opts[];
 
-struct kcm_renew_auth_ctx {
-    struct tevent_context *ev;
-    struct krb5child_req *kr;
-
-    struct krb5_ctx *krb5_ctx;
-    struct kcm_auth_data *auth_data;
-
-    uint8_t *buf;
-    ssize_t len;
-};
-
 struct kcm_auth_data {
-    struct kcm_renew_auth_ctx *auth_ctx;
-    struct krb5_ctx *krb5_ctx;
     uid_t uid;
     gid_t gid;
     const char *ccname;
     const char *upn;
 };
 
-static void kcm_renew_tgt_done(struct tevent_req *req);
-
 static errno_t kcm_set_options(struct krb5_ctx *krb5_ctx,
                                char *lifetime,
                                char *rtime,
@@ -62,6 +47,7 @@ static errno_t kcm_set_options(struct krb5_ctx *krb5_ctx,
                                bool canonicalize,
                                int timeout,
                                char *renew_intv,
+                               int max_concurrent,
                                time_t *_renew_intv_tm)
 {
     errno_t ret;
@@ -139,6 +125,19 @@ static errno_t kcm_set_options(struct krb5_ctx *krb5_ctx,
                              CONFDB_KCM_KRB5_AUTH_TIMEOUT,
                              timeout);
 
+    ret = dp_opt_set_int(krb5_ctx->opts, KRB5_RENEW_MAX_CONCURRENT,
+                         max_concurrent);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot set maximal number of concurrent "
+                                 "renewals [%d]: %s\n",
+                                 ret, sss_strerror(ret));
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Option [%s] set to [%d]\n",
+                             CONFDB_KCM_KRB5_RENEW_MAX_CONCURRENT,
+                             max_concurrent);
+
     ret = EOK;
 done:
     return ret;
@@ -152,7 +151,8 @@ static errno_t kcm_read_options(TALLOC_CTX *mem_ctx,
                                 bool *_validate,
                                 bool *_canonicalize,
                                 int *_timeout,
-                                char **_renew_intv)
+                                char **_renew_intv,
+                                int *_max_concurrent)
 {
     TALLOC_CTX *tmp_ctx;
     char *lifetime;
@@ -161,6 +161,7 @@ static errno_t kcm_read_options(TALLOC_CTX *mem_ctx,
     bool canonicalize;
     int timeout;
     char *renew_intv;
+    int max_concurrent;
     errno_t ret;
 
     tmp_ctx = talloc_new(NULL);
@@ -222,6 +223,14 @@ static errno_t kcm_read_options(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = confdb_get_int(cdb, cpath,
+                         CONFDB_KCM_KRB5_RENEW_MAX_CONCURRENT, 10,
+                         &max_concurrent);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read %s/%s [%d]: %s\n", cpath,
+              CONFDB_KCM_KRB5_RENEW_MAX_CONCURRENT, ret, sss_strerror(ret));
+        goto done;
+    }
 
     *_lifetime = talloc_steal(mem_ctx, lifetime);
     *_rtime = talloc_steal(mem_ctx, rtime);
@@ -229,6 +238,7 @@ static errno_t kcm_read_options(TALLOC_CTX *mem_ctx,
     *_canonicalize = canonicalize;
     *_timeout = timeout;
     *_renew_intv = renew_intv;
+    *_max_concurrent = max_concurrent;
 
     ret = EOK;
 
@@ -249,6 +259,7 @@ int kcm_get_renewal_config(struct kcm_ctx *kctx,
     bool canonicalize;
     int timeout;
     char *renew_intv;
+    int max_concurrent;
     time_t renew_intv_tm;
     bool tgt_renewal;
     char *tgt_renewal_inherit;
@@ -340,7 +351,7 @@ int kcm_get_renewal_config(struct kcm_ctx *kctx,
     if (tgt_renewal_inherit == NULL) {
         ret = kcm_read_options(kctx, kctx->rctx->cdb, kctx->rctx->confdb_service_path,
                                &lifetime, &rtime, &validate, &canonicalize,
-                               &timeout, &renew_intv);
+                               &timeout, &renew_intv, &max_concurrent);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "Failed to read krb5 options from "
                                      "[kcm] section [%d]: %s\n", ret, sss_strerror(ret));
@@ -359,7 +370,7 @@ int kcm_get_renewal_config(struct kcm_ctx *kctx,
                                  conf_path);
         ret = kcm_read_options(kctx, kctx->rctx->cdb, conf_path,
                                &lifetime, &rtime, &validate, &canonicalize,
-                               &timeout, &renew_intv);
+                               &timeout, &renew_intv, &max_concurrent);
         if (ret != EOK) {
             DEBUG(SSSDBG_OP_FAILURE, "Failed reading domain [%s] inherit krb5 options "
                                      "[%d]: %s\n", conf_path, ret, sss_strerror(ret));
@@ -368,7 +379,8 @@ int kcm_get_renewal_config(struct kcm_ctx *kctx,
     }
 
     ret = kcm_set_options(krb5_ctx, lifetime, rtime, validate, canonicalize,
-                          timeout, renew_intv, &renew_intv_tm);
+                          timeout, renew_intv, max_concurrent,
+                          &renew_intv_tm);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Failed setting krb5 options for renewal "
                                  "[%d]: %s\n", ret, sss_strerror(ret));
@@ -467,63 +479,78 @@ fail:
     return ret;
 }
 
-static void kcm_renew_tgt(struct tevent_context *ev,
-                          struct tevent_immediate *imm,
-                          void *private_data)
+struct kcm_renew_tgt_state {
+    struct krb5child_req *kr;
+    enum krb5_renew_result result;
+};
+
+static void kcm_renew_tgt_done(struct tevent_req *subreq);
+
+static struct tevent_req *kcm_renew_tgt_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             const char *key,
+                                             void *data,
+                                             void *pvt)
 {
+    struct kcm_renew_tgt_ctx *renew_tgt_ctx;
     struct kcm_auth_data *auth_data;
+    struct kcm_renew_tgt_state *state;
     struct tevent_req *req;
-    struct kcm_renew_auth_ctx *ctx;
+    struct tevent_req *subreq;
     errno_t ret;
 
-    auth_data = talloc_get_type(private_data, struct kcm_auth_data);
+    renew_tgt_ctx = talloc_get_type(pvt, struct kcm_renew_tgt_ctx);
+    auth_data = talloc_get_type(data, struct kcm_auth_data);
 
-    ctx = talloc_zero(auth_data, struct kcm_renew_auth_ctx);
-    if (ctx == NULL) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to allocate renew auth ctx\n");
-        return;
+    req = tevent_req_create(mem_ctx, &state, struct kcm_renew_tgt_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to allocate renewal request\n");
+        return NULL;
     }
-    auth_data->auth_ctx = ctx;
+    state->result = KRB5_RENEW_FAILED;
 
-    ret = kcm_child_req_setup(ctx, auth_data, auth_data->krb5_ctx, &ctx->kr);
+    ret = kcm_child_req_setup(state, auth_data, renew_tgt_ctx->krb5_ctx,
+                              &state->kr);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Failed to setup krb5 child for renewal [%d]: %s\n",
                                     ret, sss_strerror(ret));
-        talloc_free(auth_data);
-        return;
+        talloc_free(req);
+        return NULL;
     }
 
-    req = handle_child_send(ctx, ev, ctx->kr);
-    if (req == NULL) {
-        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to trigger krb5 child process request"
-                                    "[%d]: %s\n", ret, sss_strerror(ret));
-        talloc_free(auth_data);
-        return;
+    subreq = handle_child_send(state, ev, state->kr);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_FATAL_FAILURE, "Failed to trigger krb5 child process "
+                                    "request\n");
+        talloc_free(req);
+        return NULL;
     }
 
-    tevent_req_set_callback(req, kcm_renew_tgt_done, auth_data);
+    tevent_req_set_callback(subreq, kcm_renew_tgt_done, req);
 
-    return;
+    return req;
 }
 
-static void kcm_renew_tgt_done(struct tevent_req *req)
+static void kcm_renew_tgt_done(struct tevent_req *subreq)
 {
-    struct kcm_auth_data *auth_data;
-    struct kcm_renew_auth_ctx *ctx;
-    int ret;
+    struct tevent_req *req;
+    struct kcm_renew_tgt_state *state;
     struct krb5_child_response *res;
+    uint8_t *buf;
+    ssize_t len;
+    int ret;
 
-    auth_data = tevent_req_callback_data(req, struct kcm_auth_data);
-    ctx = auth_data->auth_ctx;
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct kcm_renew_tgt_state);
 
-    ret = handle_child_recv(req, ctx, &ctx->buf, &ctx->len);
-    talloc_free(req);
+    ret = handle_child_recv(subreq, state, &buf, &len);
+    talloc_free(subreq);
     if (ret != EOK) {
         DEBUG(SSSDBG_FATAL_FAILURE, "Failed to receive krb5 child process request"
                                     "[%d]: %s\n", ret, sss_strerror(ret));
         goto done;
     }
-    ret = parse_krb5_child_response(ctx, ctx->buf, ctx->len, ctx->kr->pd,
+    ret = parse_krb5_child_response(state, buf, len, state->kr->pd,
                                     0, &res);
     if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE, "Krb5 child returned error! Please " \
@@ -538,10 +565,18 @@ static void kcm_renew_tgt_done(struct tevent_req *req)
     }
 
     DEBUG(SSSDBG_TRACE_FUNC, "Successfully renewed [%s]\n", res->ccname);
+    state->result = KRB5_RENEW_DONE;
 done:
-    talloc_zfree(ctx);
-    talloc_zfree(auth_data);
-    return;
+    tevent_req_done(req);
+}
+
+static enum krb5_renew_result kcm_renew_tgt_recv(struct tevent_req *req)
+{
+    struct kcm_renew_tgt_state *state;
+
+    state = tevent_req_data(req, struct kcm_renew_tgt_state);
+
+    return state->result;
 }
 
 static errno_t kcm_creds_check_times(TALLOC_CTX *mem_ctx,
@@ -554,7 +589,7 @@ static errno_t kcm_creds_check_times(TALLOC_CTX *mem_ctx,
     time_t now;
     time_t start_renew;
     struct kcm_auth_data *auth_data;
-    struct tevent_immediate *imm;
+    const char *key;
     int ret;
 
     memset(&tgtt, 0, sizeof(tgtt));
@@ -564,11 +599,12 @@ static errno_t kcm_creds_check_times(TALLOC_CTX *mem_ctx,
     tgtt.renew_till = creds->times.renew_till;
 
     now = time(NULL);
-    /* Attempt renewal only after half of the ticket lifetime has exceeded */
+    /* Attempt renewal only after half of the ticket lifetime has exceeded,
+     * the scheduler keeps the ticket until then. */
     start_renew = (time_t) (tgtt.starttime + 0.5 * (tgtt.endtime - tgtt.starttime));
     if (tgtt.renew_till >= tgtt.endtime && tgtt.renew_till >= now
-        && tgtt.endtime >= now && start_renew <= now) {
-            DEBUG(SSSDBG_TRACE_INTERNAL, "Renewal cred ready!\n");
+        && tgtt.endtime >= now) {
+            DEBUG(SSSDBG_TRACE_INTERNAL, "Renewal cred found!\n");
             auth_data = talloc_zero(renew_tgt_ctx, struct kcm_auth_data);
             if (auth_data == NULL) {
                 ret = ENOMEM;
@@ -576,26 +612,31 @@ static errno_t kcm_creds_check_times(TALLOC_CTX *mem_ctx,
                 goto done;
             }
 
-            auth_data->krb5_ctx = renew_tgt_ctx->krb5_ctx;
             auth_data->upn = talloc_strdup(auth_data, client_name);
             auth_data->uid = cc->owner.uid;
             auth_data->gid = cc->owner.gid;
-            auth_data->ccname = cc->name;
-            if (auth_data->upn == NULL) {
+            auth_data->ccname = talloc_strdup(auth_data, cc->name);
+            if (auth_data->upn == NULL || auth_data->ccname == NULL) {
                 ret = ENOMEM;
                 DEBUG(SSSDBG_CRIT_FAILURE, "Unable to allocate auth_data->upn for renewals\n");
+                talloc_free(auth_data);
                 goto done;
             }
 
-            imm = tevent_create_immediate(auth_data);
-            if (imm == NULL) {
+            key = talloc_asprintf(mem_ctx, "%s:%s", cc->name, client_name);
+            if (key == NULL) {
                 ret = ENOMEM;
-                DEBUG(SSSDBG_CRIT_FAILURE, "tevent_create_immediate failed\n");
+                DEBUG(SSSDBG_CRIT_FAILURE, "Unable to allocate renewal key\n");
+                talloc_free(auth_data);
                 goto done;
             }
 
-            tevent_schedule_immediate(imm, renew_tgt_ctx->ev, kcm_renew_tgt,
-                                      auth_data);
+            ret = krb5_renew_sched_add(renew_tgt_ctx->sched, key, client_name,
+                                       start_renew, tgtt.endtime, auth_data);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_CRIT_FAILURE, "Unable to schedule renewal\n");
+                goto done;
+            }
         } else {
             DEBUG(SSSDBG_TRACE_INTERNAL, "Time not applicable\n");
         }
@@ -605,6 +646,36 @@ done:
     return ret;
 }
 
+static bool kcm_creds_is_tgt(TALLOC_CTX *mem_ctx,
+                             krb5_context krb_context,
+                             krb5_creds *creds,
+                             const char *client_name)
+{
+    const char *realm;
+    char *server_name;
+    char *tgt_name;
+    krb5_error_code kerr;
+    bool is_tgt;
+
+    realm = strrchr(client_name, '@');
+    if (realm == NULL) {
+        return false;
+    }
+    realm++;
+
+    kerr = krb5_unparse_name(krb_context, creds->server, &server_name);
+    if (kerr != 0) {
+        return false;
+    }
+
+    tgt_name = talloc_asprintf(mem_ctx, "krbtgt/%s@%s", realm, realm);
+    is_tgt = (tgt_name != NULL && strcmp(server_name, tgt_name) == 0);
+
+    talloc_free(tgt_name);
+    krb5_free_unparsed_name(krb_context, server_name);
+    return is_tgt;
+}
+
 errno_t kcm_renew_all_tgts(TALLOC_CTX *mem_ctx,
                            struct kcm_renew_tgt_ctx *renew_tgt_ctx,
                            struct kcm_ccache **cc_list)
@@ -664,6 +735,13 @@ errno_t kcm_renew_all_tgts(TALLOC_CTX *mem_ctx,
                 goto done;
             }
 
+            /* Renewing the TGT renews the whole ccache, do not schedule
+             * the same ccache again for each service ticket */
+            if (!kcm_creds_is_tgt(tmp_ctx, krb_context, extracted_creds[j],
+                                  client_name)) {
+                continue;
+            }
+
             kcm_creds_check_times(tmp_ctx, renew_tgt_ctx, extracted_creds[j],
                                   cc, client_name);
         }
@@ -740,6 +818,7 @@ errno_t kcm_renewal_setup(struct resp_ctx *rctx,
                           time_t renew_intv)
 {
     int ret;
+    int max_concurrent;
     struct timeval next;
 
     krb5_ctx->kcm_renew_tgt_ctx = talloc_zero(krb5_ctx, struct kcm_renew_tgt_ctx);
@@ -754,6 +833,20 @@ errno_t kcm_renewal_setup(struct resp_ctx *rctx,
     krb5_ctx->kcm_renew_tgt_ctx->ev = ev;
     krb5_ctx->kcm_renew_tgt_ctx->timer_interval = renew_intv;
 
+    max_concurrent = dp_opt_get_int(krb5_ctx->opts, KRB5_RENEW_MAX_CONCURRENT);
+    krb5_ctx->kcm_renew_tgt_ctx->sched = krb5_renew_sched_new(
+                                                krb5_ctx->kcm_renew_tgt_ctx,
+                                                ev, renew_intv,
+                                                MAX(max_concurrent, 0),
+                                                kcm_renew_tgt_send,
+                                                kcm_renew_tgt_recv,
+                                                krb5_ctx->kcm_renew_tgt_ctx);
+    if (krb5_ctx->kcm_renew_tgt_ctx->sched == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to setup renewal scheduler\n");
+        ret = ENOMEM;
+        goto fail;
+    }
+
     /* Check KCM for tickets to renew */
     next = tevent_timeval_current_ofs(krb5_ctx->kcm_renew_tgt_ctx->timer_interval,
                                       0);
@@ -770,6 +863,6 @@ errno_t kcm_renewal_setup(struct resp_ctx *rctx,
     return EOK;
 
 fail:
-    talloc_zfree(krb5_ctx->renew_tgt_ctx);
+    talloc_zfree(krb5_ctx->kcm_renew_tgt_ctx);
     return ret;
 }
@@ -28,6 +28,7 @@
 
 #include "providers/krb5/krb5_common.h"
 #include "src/providers/krb5/krb5_ccache.h"
+#include "providers/krb5/krb5_renew_sched.h"
 #include "responder/kcm/kcmsrv_pvt.h"
 #include "util/sss_ptr_hash.h"
 
@@ -39,6 +40,7 @@ struct kcm_renew_tgt_ctx {
     struct kcm_ccdb *db;
     time_t timer_interval;
     struct tevent_timer *te;
+    struct krb5_renew_sched *sched;
 };
 
 
@@ -345,6 +345,61 @@ errno_t kcm_cc_store_creds(struct kcm_ccache *cc,
     return EOK;
 }
 
+/* Credentials that kcm_cc_remove_duplicates() considers the same ticket get
+ * the same key, i.e. the client and server principal. If the credential can
+ * not be parsed its UUID is used so it does not replace anything. */
+errno_t kcm_cred_get_key(TALLOC_CTX *mem_ctx,
+                         krb5_context kctx,
+                         struct kcm_cred *crd,
+                         const char **_key)
+{
+    char uuid_str[UUID_STR_SIZE];
+    const char *key = NULL;
+#ifdef HAVE_KRB5_UNMARSHAL_CREDENTIALS
+    krb5_error_code kerr = 0;
+    krb5_creds *kcrd;
+    char *client = NULL;
+    char *server = NULL;
+
+    kcrd = kcm_cred_to_krb5(kctx, crd);
+    if (kcrd != NULL) {
+        kerr = krb5_unparse_name(kctx, kcrd->client, &client);
+        if (kerr == 0) {
+            kerr = krb5_unparse_name(kctx, kcrd->server, &server);
+        }
+
+        if (kerr == 0) {
+            key = talloc_asprintf(mem_ctx, "%s\n%s", client, server);
+            if (key == NULL) {
+                kerr = ENOMEM;
+            }
+        } else {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Unable to unparse principal\n");
+        }
+
+        krb5_free_unparsed_name(kctx, client);
+        krb5_free_unparsed_name(kctx, server);
+        krb5_free_creds(kctx, kcrd);
+    }
+
+    if (kerr == ENOMEM) {
+        return ENOMEM;
+    }
+#endif
+
+    if (key == NULL) {
+        uuid_unparse(crd->uuid, uuid_str);
+        key = talloc_strdup(mem_ctx, uuid_str);
+        if (key == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    *_key = key;
+
+    return EOK;
+}
+
 errno_t kcm_cc_set_header(struct kcm_ccache *cc,
                           const char *sec_key,
                           struct cli_creds *client)
@@ -485,6 +540,7 @@ done:
 
 struct kcm_ccdb *kcm_ccdb_init(TALLOC_CTX *mem_ctx,
                                struct tevent_context *ev,
+                               krb5_context k5c,
                                struct confdb_ctx *cdb,
                                const char *confdb_service_path,
                                enum kcm_ccdb_be cc_be)
@@ -501,6 +557,7 @@ struct kcm_ccdb *kcm_ccdb_init(TALLOC_CTX *mem_ctx,
         return NULL;
     }
     ccdb->ev = ev;
+    ccdb->k5c = k5c;
 
     switch (cc_be) {
     case CCDB_BE_MEMORY:
@@ -511,6 +568,11 @@ struct kcm_ccdb *kcm_ccdb_init(TALLOC_CTX *mem_ctx,
         DEBUG(SSSDBG_FUNC_DATA, "KCM back end: libsss_secrets\n");
         ccdb->ops = &ccdb_secdb_ops;
         break;
+    case CCDB_BE_SECDB_WRITE_BACK:
+        DEBUG(SSSDBG_FUNC_DATA,
+              "KCM back end: libsss_secrets with write-back\n");
+        ccdb->ops = &ccdb_wb_ops;
+        break;
     default:
         DEBUG(SSSDBG_CRIT_FAILURE, "Unknown ccache database\n");
         break;
@@ -108,6 +108,13 @@ struct kcm_cred *kcm_cred_new(TALLOC_CTX *mem_ctx,
 errno_t kcm_cc_store_creds(struct kcm_ccache *cc,
                            struct kcm_cred *crd);
 
+/* Key identifying the credential within its ccache. Credentials with the
+ * same key replace each other, see kcm_cc_store_creds. */
+errno_t kcm_cred_get_key(TALLOC_CTX *mem_ctx,
+                         krb5_context kctx,
+                         struct kcm_cred *crd,
+                         const char **_key);
+
 /* Set cc header information from sec key and client */
 errno_t kcm_cc_set_header(struct kcm_ccache *cc,
                           const char *sec_key,
@@ -142,6 +149,7 @@ struct kcm_ccdb;
  */
 struct kcm_ccdb *kcm_ccdb_init(TALLOC_CTX *mem_ctx,
                                struct tevent_context *ev,
+                               krb5_context k5c,
                                struct confdb_ctx *cdb,
                                const char *confdb_service_path,
                                enum kcm_ccdb_be cc_be);
@@ -374,6 +382,22 @@ errno_t kcm_ccache_to_sec_input_binary(TALLOC_CTX *mem_ctx,
                                        struct kcm_ccache *cc,
                                        struct sss_iobuf **_payload);
 
+/* Convert a kcm_ccache without its credentials to its binary representation.
+ * The credentials are stored separately, see kcm_cred_to_sec_input_binary.
+ */
+errno_t kcm_ccache_header_to_sec_input_binary(TALLOC_CTX *mem_ctx,
+                                              struct kcm_ccache *cc,
+                                              struct sss_iobuf **_payload);
+
+/* Convert a single credential to its binary representation and back. */
+errno_t kcm_cred_to_sec_input_binary(TALLOC_CTX *mem_ctx,
+                                     struct kcm_cred *crd,
+                                     struct sss_iobuf **_payload);
+
+errno_t sec_value_to_kcm_cred_binary(TALLOC_CTX *mem_ctx,
+                                     struct sss_iobuf *sec_value,
+                                     struct kcm_cred **_crd);
+
 errno_t bin_to_krb_data(TALLOC_CTX *mem_ctx,
                         struct sss_iobuf *buf,
                         krb5_data *out);
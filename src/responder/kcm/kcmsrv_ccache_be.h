@@ -212,5 +212,16 @@ struct kcm_ccdb_ops {
 
 extern const struct kcm_ccdb_ops ccdb_mem_ops;
 extern const struct kcm_ccdb_ops ccdb_secdb_ops;
+extern const struct kcm_ccdb_ops ccdb_wb_ops;
+
+/* Sets up db as a write-back tier in front of store. Changes are written to
+ * the store after window seconds, the ccaches of up to max_uids users are
+ * kept in memory. The store must outlive db, pending changes are written
+ * when db is freed. Exposed for tests, ccdb_wb_ops.init reads the options
+ * and uses the secdb back end as the store. */
+errno_t ccdb_wb_setup(struct kcm_ccdb *db,
+                      struct kcm_ccdb *store,
+                      time_t window,
+                      size_t max_uids);
 
 #endif /* _KCMSRV_CCACHE_BE_ */
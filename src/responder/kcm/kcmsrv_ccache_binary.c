@@ -72,6 +72,18 @@ static errno_t princ_to_bin(krb5_principal princ, struct sss_iobuf *buf)
     return EOK;
 }
 
+static errno_t cred_to_bin(struct kcm_cred *crd, struct sss_iobuf *buf)
+{
+    errno_t ret;
+
+    ret = sss_iobuf_write_len(buf, (uint8_t *)crd->uuid, sizeof(uuid_t));
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return sss_iobuf_write_iobuf(buf, crd->cred_blob);
+}
+
 static errno_t creds_to_bin(struct kcm_cred *creds, struct sss_iobuf *buf)
 {
     struct kcm_cred *crd;
@@ -88,12 +100,7 @@ static errno_t creds_to_bin(struct kcm_cred *creds, struct sss_iobuf *buf)
     }
 
     DLIST_FOR_EACH(crd, creds) {
-        ret = sss_iobuf_write_len(buf, (uint8_t *)crd->uuid, sizeof(uuid_t));
-        if (ret != EOK) {
-            return ret;
-        }
-
-        ret = sss_iobuf_write_iobuf(buf, crd->cred_blob);
+        ret = cred_to_bin(crd, buf);
         if (ret != EOK) {
             return ret;
         }
@@ -102,9 +109,10 @@ static errno_t creds_to_bin(struct kcm_cred *creds, struct sss_iobuf *buf)
     return EOK;
 }
 
-errno_t kcm_ccache_to_sec_input_binary(TALLOC_CTX *mem_ctx,
-                                       struct kcm_ccache *cc,
-                                       struct sss_iobuf **_payload)
+static errno_t ccache_to_bin(TALLOC_CTX *mem_ctx,
+                             struct kcm_ccache *cc,
+                             struct kcm_cred *creds,
+                             struct sss_iobuf **_payload)
 {
     struct sss_iobuf *buf;
     errno_t ret;
@@ -124,7 +132,7 @@ errno_t kcm_ccache_to_sec_input_binary(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
-    ret = creds_to_bin(cc->creds, buf);
+    ret = creds_to_bin(creds, buf);
     if (ret != EOK) {
         goto done;
     }
@@ -141,6 +149,43 @@ done:
     return ret;
 }
 
+errno_t kcm_ccache_to_sec_input_binary(TALLOC_CTX *mem_ctx,
+                                       struct kcm_ccache *cc,
+                                       struct sss_iobuf **_payload)
+{
+    return ccache_to_bin(mem_ctx, cc, cc->creds, _payload);
+}
+
+errno_t kcm_ccache_header_to_sec_input_binary(TALLOC_CTX *mem_ctx,
+                                              struct kcm_ccache *cc,
+                                              struct sss_iobuf **_payload)
+{
+    return ccache_to_bin(mem_ctx, cc, NULL, _payload);
+}
+
+errno_t kcm_cred_to_sec_input_binary(TALLOC_CTX *mem_ctx,
+                                     struct kcm_cred *crd,
+                                     struct sss_iobuf **_payload)
+{
+    struct sss_iobuf *buf;
+    errno_t ret;
+
+    buf = sss_iobuf_init_empty(mem_ctx, sizeof(uuid_t), 0);
+    if (buf == NULL) {
+        return ENOMEM;
+    }
+
+    ret = cred_to_bin(crd, buf);
+    if (ret != EOK) {
+        talloc_free(buf);
+        return ret;
+    }
+
+    *_payload = buf;
+
+    return EOK;
+}
+
 errno_t bin_to_krb_data(TALLOC_CTX *mem_ctx,
                         struct sss_iobuf *buf,
                         krb5_data *out)
@@ -218,15 +263,43 @@ static errno_t bin_to_princ(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+static errno_t bin_to_cred(TALLOC_CTX *mem_ctx,
+                           struct sss_iobuf *buf,
+                           struct kcm_cred **_crd)
+{
+    struct sss_iobuf *cred_blob;
+    struct kcm_cred *crd;
+    uuid_t uuid;
+    errno_t ret;
+
+    ret = sss_iobuf_read_len(buf, sizeof(uuid_t), (uint8_t*)uuid);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sss_iobuf_read_iobuf(NULL, buf, &cred_blob);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    crd = kcm_cred_new(mem_ctx, uuid, cred_blob);
+    if (crd == NULL) {
+        talloc_free(cred_blob);
+        return ENOMEM;
+    }
+
+    *_crd = crd;
+
+    return EOK;
+}
+
 static errno_t bin_to_creds(TALLOC_CTX *mem_ctx,
                             struct sss_iobuf *buf,
                             struct kcm_cred **_creds)
 {
     struct kcm_cred *creds = NULL;
     struct kcm_cred *crd;
-    struct sss_iobuf *cred_blob;
     uint32_t count;
-    uuid_t uuid;
     errno_t ret;
 
     ret = sss_iobuf_read_uint32(buf, &count);
@@ -235,22 +308,11 @@ static errno_t bin_to_creds(TALLOC_CTX *mem_ctx,
     }
 
     for (uint32_t i = 0; i < count; i++) {
-        ret = sss_iobuf_read_len(buf, sizeof(uuid_t), (uint8_t*)uuid);
+        ret = bin_to_cred(mem_ctx, buf, &crd);
         if (ret != EOK) {
             return ret;
         }
 
-        ret = sss_iobuf_read_iobuf(NULL, buf, &cred_blob);
-        if (ret != EOK) {
-            return ret;
-        }
-
-        crd = kcm_cred_new(mem_ctx, uuid, cred_blob);
-        if (crd == NULL) {
-            talloc_free(cred_blob);
-            return ENOMEM;
-        }
-
         DLIST_ADD(creds, crd);
     }
 
@@ -259,6 +321,13 @@ static errno_t bin_to_creds(TALLOC_CTX *mem_ctx,
     return EOK;
 }
 
+errno_t sec_value_to_kcm_cred_binary(TALLOC_CTX *mem_ctx,
+                                     struct sss_iobuf *sec_value,
+                                     struct kcm_cred **_crd)
+{
+    return bin_to_cred(mem_ctx, sec_value, _crd);
+}
+
 errno_t sec_kv_to_ccache_binary(TALLOC_CTX *mem_ctx,
                                 const char *sec_key,
                                 struct sss_iobuf *sec_value,
@@ -27,8 +27,7 @@
 #include "util/util.h"
 #include "responder/kcm/kcmsrv_ccache_pvt.h"
 #include "responder/kcm/kcmsrv_ccache_be.h"
-
-struct ccdb_mem;
+#include "responder/kcm/kcmsrv_ccache_mem.h"
 
 /*
  * The KCM memory database is just a double-linked list of kcm_ccache structures
@@ -50,15 +49,12 @@ struct ccdb_mem {
 };
 
 static struct ccache_mem_wrap *memdb_get_by_uuid(struct ccdb_mem *memdb,
-                                                 struct cli_creds *client,
+                                                 uid_t uid,
                                                  uuid_t uuid)
 {
-    uid_t uid;
     struct ccache_mem_wrap *ccwrap = NULL;
     struct ccache_mem_wrap *out = NULL;
 
-    uid = cli_creds_get_uid(client);
-
     DLIST_FOR_EACH(ccwrap, memdb->head) {
         if (ccwrap->cc == NULL) {
             /* since KCM stores ccaches, better not crash.. */
@@ -78,15 +74,12 @@ static struct ccache_mem_wrap *memdb_get_by_uuid(struct ccdb_mem *memdb,
 }
 
 static struct ccache_mem_wrap *memdb_get_by_name(struct ccdb_mem *memdb,
-                                                 struct cli_creds *client,
+                                                 uid_t uid,
                                                  const char *name)
 {
-    uid_t uid;
     struct ccache_mem_wrap *ccwrap = NULL;
     struct ccache_mem_wrap *out = NULL;
 
-    uid = cli_creds_get_uid(client);
-
     DLIST_FOR_EACH(ccwrap, memdb->head) {
         if (ccwrap->cc == NULL) {
             /* since KCM stores ccaches, better not crash.. */
@@ -134,13 +127,176 @@ static int ccwrap_destructor(void *ptr)
     return 0;
 }
 
+struct ccdb_mem *memdb_new(TALLOC_CTX *mem_ctx)
+{
+    return talloc_zero(mem_ctx, struct ccdb_mem);
+}
+
+struct kcm_ccache *memdb_cc_by_uuid(struct ccdb_mem *memdb,
+                                    uid_t uid,
+                                    uuid_t uuid)
+{
+    struct ccache_mem_wrap *ccwrap;
+
+    ccwrap = memdb_get_by_uuid(memdb, uid, uuid);
+    return ccwrap != NULL ? ccwrap->cc : NULL;
+}
+
+struct kcm_ccache *memdb_cc_by_name(struct ccdb_mem *memdb,
+                                    uid_t uid,
+                                    const char *name)
+{
+    struct ccache_mem_wrap *ccwrap;
+
+    ccwrap = memdb_get_by_name(memdb, uid, name);
+    return ccwrap != NULL ? ccwrap->cc : NULL;
+}
+
+errno_t memdb_list(TALLOC_CTX *mem_ctx,
+                   struct ccdb_mem *memdb,
+                   uid_t uid,
+                   uuid_t **_uuid_list)
+{
+    struct ccache_mem_wrap *ccwrap = NULL;
+    uuid_t *uuid_list;
+    size_t num_ccaches = 0;
+    size_t cc_index = 0;
+
+    DLIST_FOR_EACH(ccwrap, memdb->head) {
+        if (ccwrap->cc->owner.uid == uid) {
+            num_ccaches++;
+        }
+    }
+
+    uuid_list = talloc_zero_array(mem_ctx, uuid_t, num_ccaches+1);
+    if (uuid_list == NULL) {
+        return ENOMEM;
+    }
+
+    cc_index = 0;
+    DLIST_FOR_EACH(ccwrap, memdb->head) {
+        if (ccwrap->cc->owner.uid == uid) {
+            uuid_copy(uuid_list[cc_index], ccwrap->cc->uuid);
+            cc_index++;
+        }
+    }
+    uuid_clear(uuid_list[num_ccaches]);
+
+    *_uuid_list = uuid_list;
+    return EOK;
+}
+
+void memdb_set_default(struct ccdb_mem *memdb,
+                       uid_t uid,
+                       uuid_t uuid)
+{
+    struct ccache_mem_wrap *ccwrap = NULL;
+
+    /* Reset all ccache defaults first */
+    DLIST_FOR_EACH(ccwrap, memdb->head) {
+        if (ccwrap->cc == NULL) {
+            /* since KCM stores ccaches, better not crash.. */
+            DEBUG(SSSDBG_CRIT_FAILURE, "BUG: ccwrap contains NULL cc\n");
+            continue;
+        }
+
+        if (ccwrap->cc->owner.uid == uid) {
+            ccwrap->is_default = false;
+        }
+    }
+
+    /* Then set the default for the right ccache. This also allows to
+     * pass a null uuid to just reset the old ccache (for example after
+     * deleting the default
+     */
+    ccwrap = memdb_get_by_uuid(memdb, uid, uuid);
+    if (ccwrap != NULL) {
+        ccwrap->is_default = true;
+    }
+}
+
+void memdb_get_default(struct ccdb_mem *memdb,
+                       uid_t uid,
+                       uuid_t _uuid)
+{
+    struct ccache_mem_wrap *ccwrap = NULL;
+
+    DLIST_FOR_EACH(ccwrap, memdb->head) {
+        if (ccwrap->cc == NULL) {
+            /* since KCM stores ccaches, better not crash.. */
+            DEBUG(SSSDBG_CRIT_FAILURE, "BUG: ccwrap contains NULL cc\n");
+            continue;
+        }
+
+        if (ccwrap->cc->owner.uid == uid && ccwrap->is_default == true) {
+            break;
+        }
+    }
+
+    if (ccwrap == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC,
+               "No ccache marked as default, returning null ccache\n");
+        uuid_clear(_uuid);
+    } else {
+        uuid_copy(_uuid, ccwrap->cc->uuid);
+    }
+}
+
+errno_t memdb_add(struct ccdb_mem *memdb,
+                  struct kcm_ccache *cc)
+{
+    struct ccache_mem_wrap *ccwrap;
+
+    ccwrap = talloc_zero(memdb, struct ccache_mem_wrap);
+    if (ccwrap == NULL) {
+        return ENOMEM;
+    }
+    ccwrap->cc = cc;
+    ccwrap->mem_be = memdb;
+    talloc_steal(ccwrap, cc);
+
+    DLIST_ADD(memdb->head, ccwrap);
+    talloc_set_destructor((TALLOC_CTX *) ccwrap, ccwrap_destructor);
+
+    return EOK;
+}
+
+errno_t memdb_delete(struct ccdb_mem *memdb,
+                     uid_t uid,
+                     uuid_t uuid)
+{
+    struct ccache_mem_wrap *ccwrap;
+
+    ccwrap = memdb_get_by_uuid(memdb, uid, uuid);
+    if (ccwrap == NULL) {
+        return ERR_KCM_CC_END;
+    }
+
+    /* Destructor takes care of everything */
+    talloc_free(ccwrap);
+    return EOK;
+}
+
+void memdb_delete_uid(struct ccdb_mem *memdb,
+                      uid_t uid)
+{
+    struct ccache_mem_wrap *ccwrap;
+    struct ccache_mem_wrap *next;
+
+    DLIST_FOR_EACH_SAFE(ccwrap, next, memdb->head) {
+        if (ccwrap->cc != NULL && ccwrap->cc->owner.uid == uid) {
+            talloc_free(ccwrap);
+        }
+    }
+}
+
 static errno_t ccdb_mem_init(struct kcm_ccdb *db,
                              struct confdb_ctx *cdb,
                              const char *confdb_service_path)
 {
     struct ccdb_mem *memdb = NULL;
 
-    memdb = talloc_zero(db, struct ccdb_mem);
+    memdb = memdb_new(db);
     if (memdb == NULL) {
         return ENOMEM;
     }
@@ -208,42 +364,21 @@ static struct tevent_req *ccdb_mem_list_send(TALLOC_CTX *mem_ctx,
                                              struct cli_creds *client)
 {
     struct tevent_req *req = NULL;
-    struct ccache_mem_wrap *ccwrap = NULL;
     struct ccdb_mem_list_state *state = NULL;
     struct ccdb_mem *memdb = talloc_get_type(db->db_handle, struct ccdb_mem);
-    size_t num_ccaches = 0;
-    size_t cc_index = 0;
     errno_t ret;
-    uid_t uid;
 
     req = tevent_req_create(mem_ctx, &state, struct ccdb_mem_list_state);
     if (req == NULL) {
         return NULL;
     }
 
-    uid = cli_creds_get_uid(client);
-
-    DLIST_FOR_EACH(ccwrap, memdb->head) {
-        if (ccwrap->cc->owner.uid == uid) {
-            num_ccaches++;
-        }
-    }
-
-    state->uuid_list = talloc_zero_array(state, uuid_t, num_ccaches+1);
-    if (state->uuid_list == NULL) {
-        ret = ENOMEM;
+    ret = memdb_list(state, memdb, cli_creds_get_uid(client),
+                     &state->uuid_list);
+    if (ret != EOK) {
         goto immediate;
     }
 
-    cc_index = 0;
-    DLIST_FOR_EACH(ccwrap, memdb->head) {
-        if (ccwrap->cc->owner.uid == uid) {
-            uuid_copy(state->uuid_list[cc_index], ccwrap->cc->uuid);
-            cc_index++;
-        }
-    }
-    uuid_clear(state->uuid_list[num_ccaches]);
-
     ret = EOK;
 immediate:
     if (ret == EOK) {
@@ -276,35 +411,13 @@ static struct tevent_req *ccdb_mem_set_default_send(TALLOC_CTX *mem_ctx,
     struct tevent_req *req = NULL;
     struct ccdb_mem_dummy_state *state = NULL;
     struct ccdb_mem *memdb = talloc_get_type(db->db_handle, struct ccdb_mem);
-    struct ccache_mem_wrap *ccwrap = NULL;
-    uid_t uid = cli_creds_get_uid(client);
 
     req = tevent_req_create(mem_ctx, &state, struct ccdb_mem_dummy_state);
     if (req == NULL) {
         return NULL;
     }
 
-    /* Reset all ccache defaults first */
-    DLIST_FOR_EACH(ccwrap, memdb->head) {
-        if (ccwrap->cc == NULL) {
-            /* since KCM stores ccaches, better not crash.. */
-            DEBUG(SSSDBG_CRIT_FAILURE, "BUG: ccwrap contains NULL cc\n");
-            continue;
-        }
-
-        if (ccwrap->cc->owner.uid == uid) {
-            ccwrap->is_default = false;
-        }
-    }
-
-    /* Then set the default for the right ccache. This also allows to
-     * pass a null uuid to just reset the old ccache (for example after
-     * deleting the default
-     */
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
-    if (ccwrap != NULL) {
-        ccwrap->is_default = true;
-    }
+    memdb_set_default(memdb, cli_creds_get_uid(client), uuid);
 
     tevent_req_done(req);
     tevent_req_post(req, ev);
@@ -328,36 +441,14 @@ static struct tevent_req *ccdb_mem_get_default_send(TALLOC_CTX *mem_ctx,
 {
     struct tevent_req *req = NULL;
     struct ccdb_mem_get_default_state *state = NULL;
-    struct ccache_mem_wrap *ccwrap = NULL;
     struct ccdb_mem *memdb = talloc_get_type(db->db_handle, struct ccdb_mem);
-    uid_t uid = cli_creds_get_uid(client);
 
     req = tevent_req_create(mem_ctx, &state, struct ccdb_mem_get_default_state);
     if (req == NULL) {
         return NULL;
     }
 
-
-    /* Reset all ccache defaults first */
-    DLIST_FOR_EACH(ccwrap, memdb->head) {
-        if (ccwrap->cc == NULL) {
-            /* since KCM stores ccaches, better not crash.. */
-            DEBUG(SSSDBG_CRIT_FAILURE, "BUG: ccwrap contains NULL cc\n");
-            continue;
-        }
-
-        if (ccwrap->cc->owner.uid == uid && ccwrap->is_default == true) {
-            break;
-        }
-    }
-
-    if (ccwrap == NULL) {
-        DEBUG(SSSDBG_TRACE_FUNC,
-               "No ccache marked as default, returning null ccache\n");
-        uuid_clear(state->dfl_uuid);
-    } else {
-        uuid_copy(state->dfl_uuid, ccwrap->cc->uuid);
-    }
+    memdb_get_default(memdb, cli_creds_get_uid(client), state->dfl_uuid);
 
     tevent_req_done(req);
     tevent_req_post(req, ev);
@@ -397,7 +488,7 @@ static struct tevent_req *ccdb_mem_getbyuuid_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
+    ccwrap = memdb_get_by_uuid(memdb, cli_creds_get_uid(client), uuid);
     if (ccwrap != NULL) {
         /* In order to provide a consistent interface, we need to let the caller
          * of getbyXXX own the ccache, therefore the memory back end returns a shallow
@@ -454,7 +545,7 @@ static struct tevent_req *ccdb_mem_getbyname_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_name(memdb, client, name);
+    ccwrap = memdb_get_by_name(memdb, cli_creds_get_uid(client), name);
     if (ccwrap != NULL) {
         /* In order to provide a consistent interface, we need to let the caller
          * of getbyXXX own the ccache, therefore the memory back end returns a shallow
@@ -511,7 +602,7 @@ struct tevent_req *ccdb_mem_name_by_uuid_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
+    ccwrap = memdb_get_by_uuid(memdb, cli_creds_get_uid(client), uuid);
     if (ccwrap == NULL) {
         ret = ERR_KCM_CC_END;
         goto immediate;
@@ -566,7 +657,7 @@ struct tevent_req *ccdb_mem_uuid_by_name_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_name(memdb, client, name);
+    ccwrap = memdb_get_by_name(memdb, cli_creds_get_uid(client), name);
     if (ccwrap == NULL) {
         ret = ERR_NO_CREDS;
         goto immediate;
@@ -604,7 +695,6 @@ static struct tevent_req *ccdb_mem_create_send(TALLOC_CTX *mem_ctx,
 {
     struct tevent_req *req = NULL;
     struct ccdb_mem_dummy_state *state = NULL;
-    struct ccache_mem_wrap *ccwrap;
     struct ccdb_mem *memdb = talloc_get_type(db->db_handle, struct ccdb_mem);
     errno_t ret;
 
@@ -613,17 +703,10 @@ static struct tevent_req *ccdb_mem_create_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = talloc_zero(memdb, struct ccache_mem_wrap);
-    if (ccwrap == NULL) {
-        ret = ENOMEM;
+    ret = memdb_add(memdb, cc);
+    if (ret != EOK) {
         goto immediate;
     }
-    ccwrap->cc = cc;
-    ccwrap->mem_be = memdb;
-    talloc_steal(ccwrap, cc);
-
-    DLIST_ADD(memdb->head, ccwrap);
-    talloc_set_destructor((TALLOC_CTX *) ccwrap, ccwrap_destructor);
 
     ret = EOK;
 immediate:
@@ -661,7 +744,7 @@ static struct tevent_req *ccdb_mem_mod_send(TALLOC_CTX *mem_ctx,
     }
 
     /* UUID is immutable, so search by that */
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
+    ccwrap = memdb_get_by_uuid(memdb, cli_creds_get_uid(client), uuid);
     if (ccwrap == NULL) {
         ret = ERR_KCM_CC_END;
         goto immediate;
@@ -710,7 +793,7 @@ static struct tevent_req *ccdb_mem_store_cred_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
+    ccwrap = memdb_get_by_uuid(memdb, cli_creds_get_uid(client), uuid);
     if (ccwrap == NULL) {
         ret = ERR_KCM_CC_END;
         goto immediate;
@@ -749,7 +832,6 @@ static struct tevent_req *ccdb_mem_delete_send(TALLOC_CTX *mem_ctx,
 {
     struct tevent_req *req = NULL;
     struct ccdb_mem_dummy_state *state = NULL;
-    struct ccache_mem_wrap *ccwrap;
     struct ccdb_mem *memdb = talloc_get_type(db->db_handle, struct ccdb_mem);
     errno_t ret;
 
@@ -758,17 +840,14 @@ static struct tevent_req *ccdb_mem_delete_send(TALLOC_CTX *mem_ctx,
         return NULL;
     }
 
-    ccwrap = memdb_get_by_uuid(memdb, client, uuid);
-    if (ccwrap == NULL) {
+    ret = memdb_delete(memdb, cli_creds_get_uid(client), uuid);
+    if (ret == ERR_KCM_CC_END) {
         DEBUG(SSSDBG_MINOR_FAILURE,
               "BUG: Attempting to free unknown ccache\n");
-        ret = ERR_KCM_CC_END;
         goto immediate;
     }
 
     ret = EOK;
-    /* Destructor takes care of everything */
-    talloc_free(ccwrap);
 immediate:
     if (ret == EOK) {
         tevent_req_done(req);
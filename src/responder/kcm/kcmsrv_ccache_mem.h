@@ -0,0 +1,74 @@
+/*
+   SSSD
+
+   KCM Server - ccache in-memory storage
+
+   The synchronous interface of the in-memory ccache database. Besides the
+   memory back end itself, it is used by the write-back tier in front of
+   the secdb back end. Should be accessed only from the ccache layer.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _KCMSRV_CCACHE_MEM_H_
+#define _KCMSRV_CCACHE_MEM_H_
+
+#include "responder/kcm/kcmsrv_ccache_pvt.h"
+
+struct ccdb_mem;
+
+struct ccdb_mem *memdb_new(TALLOC_CTX *mem_ctx);
+
+/*
+ * The lookups return the stored ccache itself, not a copy. The caller
+ * must not free it and must not keep it past the next modification of
+ * the database.
+ */
+struct kcm_ccache *memdb_cc_by_uuid(struct ccdb_mem *memdb,
+                                    uid_t uid,
+                                    uuid_t uuid);
+
+struct kcm_ccache *memdb_cc_by_name(struct ccdb_mem *memdb,
+                                    uid_t uid,
+                                    const char *name);
+
+/* The returned list is terminated by a null UUID */
+errno_t memdb_list(TALLOC_CTX *mem_ctx,
+                   struct ccdb_mem *memdb,
+                   uid_t uid,
+                   uuid_t **_uuid_list);
+
+/* A null UUID unsets the default ccache */
+void memdb_set_default(struct ccdb_mem *memdb,
+                       uid_t uid,
+                       uuid_t uuid);
+
+void memdb_get_default(struct ccdb_mem *memdb,
+                       uid_t uid,
+                       uuid_t _uuid);
+
+/* The database takes ownership of cc */
+errno_t memdb_add(struct ccdb_mem *memdb,
+                  struct kcm_ccache *cc);
+
+/* Returns ERR_KCM_CC_END if there is no such ccache */
+errno_t memdb_delete(struct ccdb_mem *memdb,
+                     uid_t uid,
+                     uuid_t uuid);
+
+/* Removes all ccaches of the given user */
+void memdb_delete_uid(struct ccdb_mem *memdb,
+                      uid_t uid);
+
+#endif /* _KCMSRV_CCACHE_MEM_H_ */
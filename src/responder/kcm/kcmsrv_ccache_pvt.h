@@ -43,6 +43,8 @@ struct kcm_cred {
 struct kcm_ccdb {
     enum kcm_ccdb_be cc_be_type;
     struct tevent_context *ev;
+    /* owned by the KCM responder context */
+    krb5_context k5c;
 
     void *db_handle;
     const struct kcm_ccdb_ops *ops;
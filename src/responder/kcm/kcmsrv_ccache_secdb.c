@@ -427,6 +427,185 @@ done:
     return ret;
 }
 
+/* Each credential is a record of the ccache secret so that storing one does
+ * not rewrite the whole ccache. Records are returned oldest first, the ccache
+ * keeps the newest credential first as kcm_cc_store_creds() does. */
+static errno_t secdb_get_cc_creds(struct kcm_ccache *cc,
+                                  struct sss_sec_req *sreq)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_sec_record *records;
+    size_t num_records;
+    struct sss_iobuf *buf;
+    struct kcm_cred *crd;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(cc);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_sec_get_records(tmp_ctx, sreq, &records, &num_records);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < num_records; i++) {
+        buf = sss_iobuf_init_readonly(tmp_ctx, records[i].data,
+                                      records[i].len);
+        if (buf == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = sec_value_to_kcm_cred_binary(cc, buf, &crd);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_MINOR_FAILURE,
+                  "Cannot convert record %s to credentials [%d]: %s, "
+                  "skipping\n", records[i].key, ret, sss_strerror(ret));
+            continue;
+        }
+
+        DLIST_ADD(cc->creds, crd);
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static errno_t secdb_cred_record(TALLOC_CTX *mem_ctx,
+                                 krb5_context k5c,
+                                 struct kcm_cred *crd,
+                                 struct sss_sec_record *record)
+{
+    struct sss_iobuf *payload;
+    errno_t ret;
+
+    ret = kcm_cred_get_key(mem_ctx, k5c, crd, &record->key);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = kcm_cred_to_sec_input_binary(mem_ctx, crd, &payload);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    record->data = sss_iobuf_get_data(payload);
+    record->len = sss_iobuf_get_size(payload);
+
+    return EOK;
+}
+
+/* Writes the ccache header cc, or keeps the stored one if cc is NULL, and
+ * appends crd, if any, as a new record. A ccache stored by an older version
+ * keeps all credentials in its header, these are moved to records on the
+ * first write. */
+static errno_t secdb_put_cc(TALLOC_CTX *mem_ctx,
+                            krb5_context k5c,
+                            struct sss_sec_ctx *sctx,
+                            const char *secdb_key,
+                            struct cli_creds *client,
+                            struct kcm_ccache *cc,
+                            struct kcm_cred *crd)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sss_sec_req *sreq;
+    struct sss_sec_record *records;
+    struct kcm_ccache *stored_cc;
+    struct kcm_cred **legacy;
+    struct kcm_cred *p;
+    struct sss_iobuf *ccbuf;
+    struct sss_iobuf *header = NULL;
+    size_t num_legacy = 0;
+    size_t num_records = 0;
+    errno_t ret;
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = secdb_cc_key_req(tmp_ctx, sctx, client, secdb_key, &sreq);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sec_get(tmp_ctx, sreq, &ccbuf);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sec_kv_to_ccache_binary(tmp_ctx, secdb_key, ccbuf, client,
+                                  &stored_cc);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot convert data to ccache [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    DLIST_FOR_EACH(p, stored_cc->creds) {
+        num_legacy++;
+    }
+
+    legacy = talloc_zero_array(tmp_ctx, struct kcm_cred *, num_legacy + 1);
+    records = talloc_zero_array(tmp_ctx, struct sss_sec_record,
+                                num_legacy + 1);
+    if (legacy == NULL || records == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    num_legacy = 0;
+    DLIST_FOR_EACH(p, stored_cc->creds) {
+        legacy[num_legacy++] = p;
+    }
+
+    /* Records are read back newest last, store the list tail first */
+    while (num_legacy > 0) {
+        ret = secdb_cred_record(tmp_ctx, k5c, legacy[--num_legacy],
+                                &records[num_records++]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    if (crd != NULL) {
+        ret = secdb_cred_record(tmp_ctx, k5c, crd, &records[num_records++]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    if (cc != NULL || stored_cc->creds != NULL) {
+        ret = kcm_ccache_header_to_sec_input_binary(tmp_ctx,
+                                                    cc != NULL ? cc : stored_cc,
+                                                    &header);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sss_sec_put_records(sreq,
+                              header != NULL ? sss_iobuf_get_data(header) : NULL,
+                              header != NULL ? sss_iobuf_get_size(header) : 0,
+                              records, num_records);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot write the ccache [%d]: %s\n", ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 static errno_t secdb_get_cc(TALLOC_CTX *mem_ctx,
                             struct sss_sec_ctx *sctx,
                             const char *secdb_key,
@@ -471,6 +650,13 @@ static errno_t secdb_get_cc(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = secdb_get_cc_creds(cc, sreq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot read ccache credentials [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
     ret = EOK;
     DEBUG(SSSDBG_TRACE_INTERNAL, "Fetched the ccache\n");
     *_cc = talloc_steal(mem_ctx, cc);
@@ -1402,8 +1588,6 @@ static struct tevent_req *ccdb_secdb_mod_send(TALLOC_CTX *mem_ctx,
     errno_t ret;
     char *secdb_key = NULL;
     struct kcm_ccache *cc = NULL;
-    struct sss_iobuf *payload = NULL;
-    struct sss_sec_req *sreq = NULL;
 
     DEBUG(SSSDBG_TRACE_INTERNAL, "Modifying ccache\n");
 
@@ -1436,17 +1620,9 @@ static struct tevent_req *ccdb_secdb_mod_send(TALLOC_CTX *mem_ctx,
         goto immediate;
     }
 
-    ret = kcm_ccache_to_sec_input_binary(state, cc, &payload);
-    if (ret != EOK) {
-        goto immediate;
-    }
-
-    ret = secdb_cc_key_req(state, secdb->sctx, client, secdb_key, &sreq);
-    if (ret != EOK) {
-        goto immediate;
-    }
-
-    ret = sec_update(state, sreq, payload);
+    /* Only the header changes, the credentials stay in their records */
+    ret = secdb_put_cc(state, db->k5c, secdb->sctx, secdb_key, client,
+                       cc, NULL);
     if (ret != EOK) {
         goto immediate;
     }
@@ -1479,9 +1655,8 @@ static struct tevent_req *ccdb_secdb_store_cred_send(TALLOC_CTX *mem_ctx,
     struct tevent_req *req = NULL;
     struct ccdb_secdb_state *state = NULL;
     char *secdb_key = NULL;
-    struct kcm_ccache *cc = NULL;
-    struct sss_iobuf *payload = NULL;
-    struct sss_sec_req *sreq = NULL;
+    struct kcm_cred *crd;
+    uuid_t cred_uuid;
     errno_t ret;
 
     DEBUG(SSSDBG_TRACE_INTERNAL, "Storing creds in ccache\n");
@@ -1499,37 +1674,27 @@ static struct tevent_req *ccdb_secdb_store_cred_send(TALLOC_CTX *mem_ctx,
         goto immediate;
     }
 
-    ret = secdb_get_cc(state, secdb->sctx, secdb_key, client, &cc);
+    uuid_generate(cred_uuid);
+    crd = kcm_cred_new(state, cred_uuid, cred_blob);
+    if (crd == NULL) {
+        ret = ENOMEM;
+        goto immediate;
+    }
+
+    /* The credential is appended as a new record, replacing the record of
+     * the same ticket, without reading or rewriting the other ones. */
+    ret = secdb_put_cc(state, db->k5c, secdb->sctx, secdb_key, client,
+                       NULL, crd);
     if (ret == ENOENT) {
         ret = ERR_NO_CREDS;
         goto immediate;
     } else if (ret != EOK) {
-        goto immediate;
-    }
-
-    ret = kcm_cc_store_cred_blob(cc, cred_blob);
-    if (ret != EOK) {
         DEBUG(SSSDBG_OP_FAILURE,
               "Cannot store credentials to ccache [%d]: %s\n",
               ret, sss_strerror(ret));
         goto immediate;
     }
 
-    ret = kcm_ccache_to_sec_input_binary(state, cc, &payload);
-    if (ret != EOK) {
-        goto immediate;
-    }
-
-    ret = secdb_cc_key_req(state, secdb->sctx, client, secdb_key, &sreq);
-    if (ret != EOK) {
-        goto immediate;
-    }
-
-    ret = sec_update(state, sreq, payload);
-    if (ret != EOK) {
-        goto immediate;
-    }
-
     ret = EOK;
 immediate:
     if (ret == EOK) {
@@ -0,0 +1,1720 @@
+/*
+   SSSD
+
+   KCM Server - write-back in-memory tier in front of the ccache storage
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <talloc.h>
+#include <stdio.h>
+
+#include "util/util.h"
+#include "confdb/confdb.h"
+#include "responder/kcm/kcmsrv_ccache_pvt.h"
+#include "responder/kcm/kcmsrv_ccache_be.h"
+#include "responder/kcm/kcmsrv_ccache_mem.h"
+
+#define DEFAULT_KCM_WRITE_BACK_MAX_UIDS 64
+
+/*
+ * The write-back tier keeps the ccaches of recently active users in the
+ * in-memory database and serves all operations of these users from there.
+ * The ccaches of a user are read from the store, normally the secdb back
+ * end, on the first operation of the user.
+ *
+ * Modifications are applied to the in-memory database at once and recorded
+ * in a journal. The journal is written to the store in one batch when the
+ * write-back window expires, when the tier is freed on shutdown and before
+ * the renewal code reads all ccaches from the store. Modifications of a
+ * ccache that is deleted before they were written are dropped.
+ */
+
+struct ccdb_wb;
+
+struct ccdb_wb_waiter {
+    struct tevent_req *req;
+    struct ccdb_wb_user *user;
+
+    struct ccdb_wb_waiter *next;
+    struct ccdb_wb_waiter *prev;
+};
+
+struct ccdb_wb_user {
+    uid_t uid;
+    bool loaded;
+    bool loading;
+    /* A journal entry of this user could not be written, the ccaches are
+     * read from the store again once the journal entries are gone */
+    bool stale;
+    /* Journal entries not written to the store yet */
+    size_t pending;
+    /* Requests waiting for the ccaches to be loaded */
+    struct ccdb_wb_waiter *waiters;
+
+    struct ccdb_wb *wb;
+    struct ccdb_wb_user *next;
+    struct ccdb_wb_user *prev;
+};
+
+enum ccdb_wb_op {
+    CCDB_WB_CREATE,
+    CCDB_WB_MOD,
+    CCDB_WB_STORE_CRED,
+    CCDB_WB_DELETE,
+    CCDB_WB_SET_DEFAULT,
+};
+
+struct ccdb_wb_entry {
+    enum ccdb_wb_op op;
+    struct ccdb_wb_user *user;
+    struct cli_creds client;
+    uuid_t uuid;
+
+    /* CCDB_WB_CREATE: the ccache as a secdb key and value,
+     * CCDB_WB_STORE_CRED: the credential */
+    const char *key;
+    struct sss_iobuf *payload;
+    /* CCDB_WB_MOD */
+    struct kcm_mod_ctx *mod_cc;
+
+    struct ccdb_wb_entry *next;
+    struct ccdb_wb_entry *prev;
+};
+
+struct ccdb_wb {
+    struct tevent_context *ev;
+    struct kcm_ccdb *store;
+    struct ccdb_mem *memdb;
+
+    time_t window;
+    size_t max_uids;
+
+    /* Most recently used first */
+    struct ccdb_wb_user *users;
+    size_t num_users;
+
+    /* Modifications not written yet, oldest first */
+    struct ccdb_wb_entry *journal;
+    /* The batch being written */
+    struct ccdb_wb_entry *flushing;
+    struct tevent_timer *flush_te;
+    bool flush_in_progress;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t written;
+    uint64_t dropped;
+};
+
+static void ccdb_wb_report(struct ccdb_wb *wb, int level)
+{
+    uint64_t total = wb->hits + wb->misses;
+
+    DEBUG(level, "ccache write-back: %"PRIu64" hits, %"PRIu64" misses "
+          "(%.1f%% hit rate), %"PRIu64" writes, %"PRIu64" writes dropped, "
+          "%zu users cached\n",
+          wb->hits, wb->misses,
+          total > 0 ? 100.0 * wb->hits / total : 0.0,
+          wb->written, wb->dropped, wb->num_users);
+}
+
+/* ==================== Journal ==================== */
+
+static int ccdb_wb_entry_destructor(struct ccdb_wb_entry *entry)
+{
+    if (entry->payload != NULL) {
+        sss_erase_mem_securely(sss_iobuf_get_data(entry->payload),
+                               sss_iobuf_get_size(entry->payload));
+    }
+
+    if (entry->mod_cc != NULL) {
+        krb5_free_principal(NULL, entry->mod_cc->client);
+    }
+
+    return 0;
+}
+
+static struct ccdb_wb_entry *ccdb_wb_entry_new(struct ccdb_wb *wb,
+                                               struct ccdb_wb_user *user,
+                                               struct cli_creds *client,
+                                               enum ccdb_wb_op op,
+                                               uuid_t uuid)
+{
+    struct ccdb_wb_entry *entry;
+
+    entry = talloc_zero(wb, struct ccdb_wb_entry);
+    if (entry == NULL) {
+        return NULL;
+    }
+    talloc_set_destructor(entry, ccdb_wb_entry_destructor);
+
+    entry->op = op;
+    entry->user = user;
+    entry->client.ucred.uid = cli_creds_get_uid(client);
+    entry->client.ucred.gid = cli_creds_get_gid(client);
+    uuid_copy(entry->uuid, uuid);
+
+    return entry;
+}
+
+static void ccdb_wb_schedule_flush(struct ccdb_wb *wb);
+
+static void ccdb_wb_journal_add(struct ccdb_wb *wb,
+                                struct ccdb_wb_entry *entry)
+{
+    DLIST_ADD_END(wb->journal, entry, struct ccdb_wb_entry *);
+    entry->user->pending++;
+
+    ccdb_wb_schedule_flush(wb);
+}
+
+static void ccdb_wb_journal_drop(struct ccdb_wb *wb,
+                                 struct ccdb_wb_entry *entry)
+{
+    DLIST_REMOVE(wb->journal, entry);
+    entry->user->pending--;
+    wb->dropped++;
+    talloc_free(entry);
+}
+
+/* Drops the journal entries that modify a ccache which is being deleted.
+ * Returns true if the ccache was created in the journal as well, the store
+ * has never seen the ccache then. */
+static bool ccdb_wb_journal_drop_cc(struct ccdb_wb *wb,
+                                    struct ccdb_wb_user *user,
+                                    uuid_t uuid)
+{
+    struct ccdb_wb_entry *entry;
+    struct ccdb_wb_entry *next;
+    bool created = false;
+
+    DLIST_FOR_EACH_SAFE(entry, next, wb->journal) {
+        if (entry->user != user || uuid_compare(entry->uuid, uuid) != 0) {
+            continue;
+        }
+
+        switch (entry->op) {
+        case CCDB_WB_CREATE:
+            created = true;
+            break;
+        case CCDB_WB_MOD:
+        case CCDB_WB_STORE_CRED:
+            break;
+        default:
+            continue;
+        }
+
+        ccdb_wb_journal_drop(wb, entry);
+    }
+
+    return created;
+}
+
+/* Only the last default ccache of a user needs to be written */
+static void ccdb_wb_journal_drop_default(struct ccdb_wb *wb,
+                                         struct ccdb_wb_user *user)
+{
+    struct ccdb_wb_entry *entry;
+    struct ccdb_wb_entry *next;
+
+    DLIST_FOR_EACH_SAFE(entry, next, wb->journal) {
+        if (entry->user == user && entry->op == CCDB_WB_SET_DEFAULT) {
+            ccdb_wb_journal_drop(wb, entry);
+        }
+    }
+}
+
+/* ==================== Writing to the store ==================== */
+
+struct ccdb_wb_write_state {
+    struct ccdb_wb_entry *entry;
+};
+
+static void ccdb_wb_write_done(struct tevent_req *subreq);
+
+static struct tevent_req *ccdb_wb_write_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             struct ccdb_wb *wb,
+                                             struct ccdb_wb_entry *entry)
+{
+    const struct kcm_ccdb_ops *ops = wb->store->ops;
+    struct tevent_req *req = NULL;
+    struct tevent_req *subreq = NULL;
+    struct ccdb_wb_write_state *state = NULL;
+    struct kcm_ccache *cc;
+    struct sss_iobuf *cc_blob;
+    struct sss_iobuf *cred_blob;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct ccdb_wb_write_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->entry = entry;
+
+    switch (entry->op) {
+    case CCDB_WB_CREATE:
+        /* The serialized payload is positioned at its end */
+        cc_blob = sss_iobuf_init_readonly(state,
+                                          sss_iobuf_get_data(entry->payload),
+                                          sss_iobuf_get_size(entry->payload));
+        if (cc_blob == NULL) {
+            ret = ENOMEM;
+            goto immediate;
+        }
+
+        ret = sec_kv_to_ccache_binary(state, entry->key, cc_blob,
+                                      &entry->client, &cc);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Cannot convert the ccache [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            goto immediate;
+        }
+
+        subreq = ops->create_send(state, ev, wb->store, &entry->client, cc);
+        break;
+    case CCDB_WB_MOD:
+        subreq = ops->mod_send(state, ev, wb->store, &entry->client,
+                               entry->uuid, entry->mod_cc);
+        break;
+    case CCDB_WB_STORE_CRED:
+        /* The back end takes over the blob, keep the journal copy */
+        cred_blob = sss_iobuf_init_readonly(state,
+                                            sss_iobuf_get_data(entry->payload),
+                                            sss_iobuf_get_size(entry->payload));
+        if (cred_blob == NULL) {
+            ret = ENOMEM;
+            goto immediate;
+        }
+
+        subreq = ops->store_cred_send(state, ev, wb->store, &entry->client,
+                                      entry->uuid, cred_blob);
+        break;
+    case CCDB_WB_DELETE:
+        subreq = ops->delete_send(state, ev, wb->store, &entry->client,
+                                  entry->uuid);
+        break;
+    case CCDB_WB_SET_DEFAULT:
+        subreq = ops->set_default_send(state, ev, wb->store, &entry->client,
+                                       entry->uuid);
+        break;
+    }
+
+    if (subreq == NULL) {
+        ret = ENOMEM;
+        goto immediate;
+    }
+    tevent_req_set_callback(subreq, ccdb_wb_write_done, req);
+    return req;
+
+immediate:
+    tevent_req_error(req, ret);
+    tevent_req_post(req, ev);
+    return req;
+}
+
+static void ccdb_wb_write_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ccdb_wb_write_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_write_state);
+    const struct kcm_ccdb_ops *ops = state->entry->user->wb->store->ops;
+    errno_t ret = EINVAL;
+
+    switch (state->entry->op) {
+    case CCDB_WB_CREATE:
+        ret = ops->create_recv(subreq);
+        break;
+    case CCDB_WB_MOD:
+        ret = ops->mod_recv(subreq);
+        break;
+    case CCDB_WB_STORE_CRED:
+        ret = ops->store_cred_recv(subreq);
+        break;
+    case CCDB_WB_DELETE:
+        ret = ops->delete_recv(subreq);
+        break;
+    case CCDB_WB_SET_DEFAULT:
+        ret = ops->set_default_recv(subreq);
+        break;
+    }
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+}
+
+static errno_t ccdb_wb_write_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    return EOK;
+}
+
+static void ccdb_wb_written(struct ccdb_wb *wb,
+                            struct ccdb_wb_entry *entry,
+                            errno_t ret)
+{
+    if (ret != EOK) {
+        /* The client was already told the operation succeeded, the best
+         * we can do is to not serve the lost change from memory */
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot write a ccache change of user %"SPRIuid" [%d]: %s, "
+              "the ccaches will be read from the database again\n",
+              entry->user->uid, ret, sss_strerror(ret));
+        entry->user->stale = true;
+    }
+
+    entry->user->pending--;
+    wb->written++;
+    talloc_free(entry);
+}
+
+struct ccdb_wb_flush_state {
+    struct tevent_context *ev;
+    struct ccdb_wb *wb;
+    struct ccdb_wb_entry *entry;
+};
+
+static void ccdb_wb_flush_next(struct tevent_req *req);
+static void ccdb_wb_flush_written(struct tevent_req *subreq);
+
+static struct tevent_req *ccdb_wb_flush_send(TALLOC_CTX *mem_ctx,
+                                             struct tevent_context *ev,
+                                             struct ccdb_wb *wb)
+{
+    struct tevent_req *req = NULL;
+    struct ccdb_wb_flush_state *state = NULL;
+    struct ccdb_wb_entry *entry;
+
+    req = tevent_req_create(mem_ctx, &state, struct ccdb_wb_flush_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->ev = ev;
+    state->wb = wb;
+
+    /* Entries added from now on go to the next batch */
+    while ((entry = wb->journal) != NULL) {
+        DLIST_REMOVE(wb->journal, entry);
+        DLIST_ADD_END(wb->flushing, entry, struct ccdb_wb_entry *);
+    }
+
+    ccdb_wb_flush_next(req);
+    if (!tevent_req_is_in_progress(req)) {
+        tevent_req_post(req, ev);
+    }
+    return req;
+}
+
+static void ccdb_wb_flush_next(struct tevent_req *req)
+{
+    struct ccdb_wb_flush_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_flush_state);
+    struct tevent_req *subreq;
+
+    /* The entry is taken off the list before it is written so that
+     * ccdb_wb_flush_sync() can take over the rest at any time */
+    state->entry = state->wb->flushing;
+    if (state->entry == NULL) {
+        tevent_req_done(req);
+        return;
+    }
+    DLIST_REMOVE(state->wb->flushing, state->entry);
+
+    subreq = ccdb_wb_write_send(state, state->ev, state->wb, state->entry);
+    if (subreq == NULL) {
+        ccdb_wb_written(state->wb, state->entry, ENOMEM);
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+    tevent_req_set_callback(subreq, ccdb_wb_flush_written, req);
+}
+
+static void ccdb_wb_flush_written(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ccdb_wb_flush_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_flush_state);
+    errno_t ret;
+
+    ret = ccdb_wb_write_recv(subreq);
+    talloc_zfree(subreq);
+
+    ccdb_wb_written(state->wb, state->entry, ret);
+    state->entry = NULL;
+
+    ccdb_wb_flush_next(req);
+}
+
+static errno_t ccdb_wb_flush_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    return EOK;
+}
+
+static void ccdb_wb_flush_done(struct tevent_req *subreq);
+
+static void ccdb_wb_flush_timer(struct tevent_context *ev,
+                                struct tevent_timer *te,
+                                struct timeval current_time,
+                                void *pvt)
+{
+    struct ccdb_wb *wb = talloc_get_type(pvt, struct ccdb_wb);
+    struct tevent_req *subreq;
+
+    wb->flush_te = NULL;
+
+    subreq = ccdb_wb_flush_send(wb, ev, wb);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot write the ccache changes\n");
+        ccdb_wb_schedule_flush(wb);
+        return;
+    }
+    tevent_req_set_callback(subreq, ccdb_wb_flush_done, wb);
+    wb->flush_in_progress = true;
+}
+
+static void ccdb_wb_flush_done(struct tevent_req *subreq)
+{
+    struct ccdb_wb *wb = tevent_req_callback_data(subreq, struct ccdb_wb);
+    errno_t ret;
+
+    ret = ccdb_wb_flush_recv(subreq);
+    talloc_zfree(subreq);
+    wb->flush_in_progress = false;
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot write the ccache changes [%d]: %s\n",
+              ret, sss_strerror(ret));
+    }
+
+    ccdb_wb_report(wb, SSSDBG_TRACE_FUNC);
+
+    if (wb->journal != NULL || wb->flushing != NULL) {
+        ccdb_wb_schedule_flush(wb);
+    }
+}
+
+static void ccdb_wb_schedule_flush(struct ccdb_wb *wb)
+{
+    struct timeval tv;
+
+    /* A running flush schedules the next one when it finishes */
+    if (wb->flush_te != NULL || wb->flush_in_progress) {
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(wb->window, 0);
+    wb->flush_te = tevent_add_timer(wb->ev, wb, tv, ccdb_wb_flush_timer, wb);
+    if (wb->flush_te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Cannot schedule writing the ccache changes\n");
+    }
+}
+
+/* Writes all pending changes before returning. The store requests are
+ * polled, which does not iterate the event loop at all with the secdb back
+ * end as it performs the writes before returning the request. */
+static void ccdb_wb_flush_sync(struct ccdb_wb *wb)
+{
+    struct ccdb_wb_entry *entry;
+    struct tevent_req *subreq;
+    errno_t ret;
+
+    talloc_zfree(wb->flush_te);
+
+    while (wb->flushing != NULL || wb->journal != NULL) {
+        if (wb->flushing != NULL) {
+            entry = wb->flushing;
+            DLIST_REMOVE(wb->flushing, entry);
+        } else {
+            entry = wb->journal;
+            DLIST_REMOVE(wb->journal, entry);
+        }
+
+        subreq = ccdb_wb_write_send(wb, wb->ev, wb, entry);
+        if (subreq == NULL) {
+            ret = ENOMEM;
+        } else if (!tevent_req_poll(subreq, wb->ev)) {
+            ret = EIO;
+        } else {
+            ret = ccdb_wb_write_recv(subreq);
+        }
+        talloc_free(subreq);
+
+        ccdb_wb_written(wb, entry, ret);
+    }
+}
+
+/* ==================== Users ==================== */
+
+static void ccdb_wb_user_free(struct ccdb_wb *wb,
+                              struct ccdb_wb_user *user)
+{
+    memdb_delete_uid(wb->memdb, user->uid);
+    DLIST_REMOVE(wb->users, user);
+    wb->num_users--;
+    talloc_free(user);
+}
+
+/* Frees the least recently used users that can be read from the store
+ * again as long as there are more than max_uids */
+static void ccdb_wb_evict(struct ccdb_wb *wb)
+{
+    struct ccdb_wb_user *user;
+    struct ccdb_wb_user *prev;
+
+    if (wb->num_users <= wb->max_uids) {
+        return;
+    }
+
+    for (user = wb->users; user != NULL && user->next != NULL;
+         user = user->next) {
+        /* no op, find the tail */
+    }
+
+    for (; user != NULL && wb->num_users > wb->max_uids; user = prev) {
+        prev = user->prev;
+
+        if (user->loading || user->pending > 0 || user->waiters != NULL) {
+            continue;
+        }
+
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Dropping ccaches of user %"SPRIuid" from memory\n", user->uid);
+        ccdb_wb_user_free(wb, user);
+    }
+}
+
+static struct ccdb_wb_user *ccdb_wb_user_get(struct ccdb_wb *wb,
+                                             uid_t uid)
+{
+    struct ccdb_wb_user *user;
+
+    DLIST_FOR_EACH(user, wb->users) {
+        if (user->uid == uid) {
+            DLIST_PROMOTE(wb->users, user);
+            break;
+        }
+    }
+
+    if (user != NULL && user->stale && user->pending == 0
+            && !user->loading) {
+        memdb_delete_uid(wb->memdb, uid);
+        user->stale = false;
+        user->loaded = false;
+    }
+
+    if (user == NULL) {
+        user = talloc_zero(wb, struct ccdb_wb_user);
+        if (user == NULL) {
+            return NULL;
+        }
+        user->uid = uid;
+        user->wb = wb;
+
+        DLIST_ADD(wb->users, user);
+        wb->num_users++;
+    }
+
+    return user;
+}
+
+struct ccdb_wb_load_state {
+    struct tevent_context *ev;
+    struct ccdb_wb *wb;
+    struct ccdb_wb_user *user;
+    struct cli_creds client;
+
+    uuid_t *uuid_list;
+    size_t idx;
+};
+
+static void ccdb_wb_load_list_done(struct tevent_req *subreq);
+static void ccdb_wb_load_next(struct tevent_req *req);
+static void ccdb_wb_load_cc_done(struct tevent_req *subreq);
+static void ccdb_wb_load_default_done(struct tevent_req *subreq);
+
+/* Reads all ccaches of a user from the store into memory */
+static struct tevent_req *ccdb_wb_load_send(TALLOC_CTX *mem_ctx,
+                                            struct tevent_context *ev,
+                                            struct ccdb_wb *wb,
+                                            struct ccdb_wb_user *user,
+                                            struct cli_creds *client)
+{
+    struct tevent_req *req = NULL;
+    struct tevent_req *subreq = NULL;
+    struct ccdb_wb_load_state *state = NULL;
+
+    req = tevent_req_create(mem_ctx, &state, struct ccdb_wb_load_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->ev = ev;
+    state->wb = wb;
+    state->user = user;
+    state->client.ucred.uid = cli_creds_get_uid(client);
+    state->client.ucred.gid = cli_creds_get_gid(client);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL,
+          "Reading ccaches of user %"SPRIuid"\n", user->uid);
+
+    subreq = wb->store->ops->list_send(state, ev, wb->store, &state->client);
+    if (subreq == NULL) {
+        tevent_req_error(req, ENOMEM);
+        tevent_req_post(req, ev);
+        return req;
+    }
+    tevent_req_set_callback(subreq, ccdb_wb_load_list_done, req);
+
+    return req;
+}
+
+static void ccdb_wb_load_list_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ccdb_wb_load_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_load_state);
+    errno_t ret;
+
+    ret = state->wb->store->ops->list_recv(subreq, state, &state->uuid_list);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    state->idx = 0;
+    ccdb_wb_load_next(req);
+}
+
+static void ccdb_wb_load_next(struct tevent_req *req)
+{
+    struct ccdb_wb_load_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_load_state);
+    const struct kcm_ccdb_ops *ops = state->wb->store->ops;
+    struct tevent_req *subreq;
+
+    if (uuid_is_null(state->uuid_list[state->idx])) {
+        subreq = ops->get_default_send(state, state->ev, state->wb->store,
+                                       &state->client);
+        if (subreq == NULL) {
+            tevent_req_error(req, ENOMEM);
+            return;
+        }
+        tevent_req_set_callback(subreq, ccdb_wb_load_default_done, req);
+        return;
+    }
+
+    subreq = ops->getbyuuid_send(state, state->ev, state->wb->store,
+                                 &state->client,
+                                 state->uuid_list[state->idx]);
+    if (subreq == NULL) {
+        tevent_req_error(req, ENOMEM);
+        return;
+    }
+    tevent_req_set_callback(subreq, ccdb_wb_load_cc_done, req);
+}
+
+static void ccdb_wb_load_cc_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ccdb_wb_load_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_load_state);
+    struct kcm_ccache *cc = NULL;
+    errno_t ret;
+
+    ret = state->wb->store->ops->getbyuuid_recv(subreq, state, &cc);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    /* The ccache might have been removed as unparsable */
+    if (cc != NULL) {
+        ret = memdb_add(state->wb->memdb, cc);
+        if (ret != EOK) {
+            tevent_req_error(req, ret);
+            return;
+        }
+    }
+
+    state->idx++;
+    ccdb_wb_load_next(req);
+}
+
+static void ccdb_wb_load_default_done(struct tevent_req *subreq)
+{
+    struct tevent_req *req = tevent_req_callback_data(subreq,
+                                                      struct tevent_req);
+    struct ccdb_wb_load_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_load_state);
+    uuid_t dfl;
+    errno_t ret;
+
+    ret = state->wb->store->ops->get_default_recv(subreq, dfl);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    memdb_set_default(state->wb->memdb, state->user->uid, dfl);
+
+    tevent_req_done(req);
+}
+
+static errno_t ccdb_wb_load_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    return EOK;
+}
+
+/* ==================== Operations ==================== */
+
+/* Runs the operation against the in-memory database once the ccaches of
+ * the user are loaded */
+typedef errno_t (*ccdb_wb_op_fn)(struct tevent_req *req);
+
+struct ccdb_wb_op_state {
+    struct tevent_context *ev;
+    struct ccdb_wb *wb;
+    struct ccdb_wb_user *user;
+    struct cli_creds *client;
+    ccdb_wb_op_fn fn;
+    struct ccdb_wb_waiter *waiter;
+
+    uuid_t uuid;
+    const char *name;
+    struct kcm_ccache *cc;
+    struct kcm_mod_ctx *mod_cc;
+    struct sss_iobuf *cred_blob;
+
+    unsigned int nextid;
+    uuid_t *uuid_list;
+};
+
+static int ccdb_wb_waiter_destructor(struct ccdb_wb_waiter *waiter)
+{
+    DLIST_REMOVE(waiter->user->waiters, waiter);
+    return 0;
+}
+
+static void ccdb_wb_user_load_done(struct tevent_req *subreq)
+{
+    struct ccdb_wb_user *user = tevent_req_callback_data(subreq,
+                                                    struct ccdb_wb_user);
+    struct ccdb_wb *wb = user->wb;
+    struct ccdb_wb_op_state *state;
+    struct ccdb_wb_waiter *waiter;
+    struct tevent_req *req;
+    errno_t op_ret;
+    errno_t ret;
+
+    ret = ccdb_wb_load_recv(subreq);
+    talloc_zfree(subreq);
+    user->loading = false;
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot read ccaches of user %"SPRIuid" [%d]: %s\n",
+              user->uid, ret, sss_strerror(ret));
+        memdb_delete_uid(wb->memdb, user->uid);
+    } else {
+        user->loaded = true;
+    }
+
+    while ((waiter = user->waiters) != NULL) {
+        req = waiter->req;
+        state = tevent_req_data(req, struct ccdb_wb_op_state);
+
+        DLIST_REMOVE(user->waiters, waiter);
+        talloc_set_destructor(waiter, NULL);
+        talloc_zfree(state->waiter);
+
+        /* The callbacks must not run while we iterate over the waiters */
+        tevent_req_defer_callback(req, state->ev);
+        op_ret = (ret == EOK) ? state->fn(req) : ret;
+        if (op_ret == EOK) {
+            tevent_req_done(req);
+        } else {
+            tevent_req_error(req, op_ret);
+        }
+    }
+
+    ccdb_wb_evict(wb);
+}
+
+static struct tevent_req *ccdb_wb_op_create(TALLOC_CTX *mem_ctx,
+                                            struct tevent_context *ev,
+                                            struct kcm_ccdb *db,
+                                            struct cli_creds *client,
+                                            ccdb_wb_op_fn fn,
+                                            struct ccdb_wb_op_state **_state)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = tevent_req_create(mem_ctx, &state, struct ccdb_wb_op_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->ev = ev;
+    state->wb = talloc_get_type(db->db_handle, struct ccdb_wb);
+    state->client = client;
+    state->fn = fn;
+
+    *_state = state;
+    return req;
+}
+
+static struct tevent_req *ccdb_wb_op_run(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb *wb = state->wb;
+    struct tevent_req *subreq;
+    errno_t ret;
+
+    state->user = ccdb_wb_user_get(wb, cli_creds_get_uid(state->client));
+    if (state->user == NULL) {
+        ret = ENOMEM;
+        goto immediate;
+    }
+
+    if (state->user->loaded) {
+        wb->hits++;
+        ret = state->fn(req);
+        goto immediate;
+    }
+
+    wb->misses++;
+
+    state->waiter = talloc_zero(state, struct ccdb_wb_waiter);
+    if (state->waiter == NULL) {
+        ret = ENOMEM;
+        goto immediate;
+    }
+    state->waiter->req = req;
+    state->waiter->user = state->user;
+
+    if (!state->user->loading) {
+        /* The load belongs to the user, it goes on even if this
+         * request is cancelled */
+        subreq = ccdb_wb_load_send(state->user, state->ev, wb, state->user,
+                                   state->client);
+        if (subreq == NULL) {
+            ret = ENOMEM;
+            goto immediate;
+        }
+        tevent_req_set_callback(subreq, ccdb_wb_user_load_done, state->user);
+        state->user->loading = true;
+    }
+
+    DLIST_ADD_END(state->user->waiters, state->waiter,
+                  struct ccdb_wb_waiter *);
+    talloc_set_destructor(state->waiter, ccdb_wb_waiter_destructor);
+    return req;
+
+immediate:
+    if (ret == EOK) {
+        tevent_req_done(req);
+    } else {
+        tevent_req_error(req, ret);
+    }
+    tevent_req_post(req, state->ev);
+    return req;
+}
+
+static errno_t ccdb_wb_op_recv(struct tevent_req *req)
+{
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    return EOK;
+}
+
+static errno_t ccdb_wb_nextid_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    uid_t uid = state->user->uid;
+    const int maxtries = 3;
+    char *nextid_name;
+    int numtry;
+
+    /* All ccaches of the user are in memory, the ones deleted but not
+     * written yet are replaced in the store only after their deletion */
+    for (numtry = 0; numtry < maxtries; numtry++) {
+        state->nextid = sss_rand() % MAX_CC_NUM;
+        nextid_name = talloc_asprintf(state, "%"SPRIuid":%u",
+                                      uid, state->nextid);
+        if (nextid_name == NULL) {
+            return ENOMEM;
+        }
+
+        if (memdb_cc_by_name(state->wb->memdb, uid, nextid_name) == NULL) {
+            DEBUG(SSSDBG_TRACE_LIBS, "Generated next ID %u\n", state->nextid);
+            return EOK;
+        }
+    }
+
+    DEBUG(SSSDBG_CRIT_FAILURE,
+          "Failed to find a random ccache in %d tries\n", numtry);
+    return EBUSY;
+}
+
+static struct tevent_req *ccdb_wb_nextid_send(TALLOC_CTX *mem_ctx,
+                                              struct tevent_context *ev,
+                                              struct kcm_ccdb *db,
+                                              struct cli_creds *client)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_nextid_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_nextid_recv(struct tevent_req *req,
+                                   unsigned int *_nextid)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    *_nextid = state->nextid;
+    return EOK;
+}
+
+static errno_t ccdb_wb_set_default_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb_entry *entry;
+
+    entry = ccdb_wb_entry_new(state->wb, state->user, state->client,
+                              CCDB_WB_SET_DEFAULT, state->uuid);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    memdb_set_default(state->wb->memdb, state->user->uid, state->uuid);
+
+    ccdb_wb_journal_drop_default(state->wb, state->user);
+    ccdb_wb_journal_add(state->wb, entry);
+    return EOK;
+}
+
+static struct tevent_req *ccdb_wb_set_default_send(TALLOC_CTX *mem_ctx,
+                                                   struct tevent_context *ev,
+                                                   struct kcm_ccdb *db,
+                                                   struct cli_creds *client,
+                                                   uuid_t uuid)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_set_default_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_get_default_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    memdb_get_default(state->wb->memdb, state->user->uid, state->uuid);
+    return EOK;
+}
+
+static struct tevent_req *ccdb_wb_get_default_send(TALLOC_CTX *mem_ctx,
+                                                   struct tevent_context *ev,
+                                                   struct kcm_ccdb *db,
+                                                   struct cli_creds *client)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_get_default_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_get_default_recv(struct tevent_req *req,
+                                        uuid_t dfl)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    uuid_copy(dfl, state->uuid);
+    return EOK;
+}
+
+static errno_t ccdb_wb_list_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    return memdb_list(state, state->wb->memdb, state->user->uid,
+                      &state->uuid_list);
+}
+
+static struct tevent_req *ccdb_wb_list_send(TALLOC_CTX *mem_ctx,
+                                            struct tevent_context *ev,
+                                            struct kcm_ccdb *db,
+                                            struct cli_creds *client)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_list_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_list_recv(struct tevent_req *req,
+                                 TALLOC_CTX *mem_ctx,
+                                 uuid_t **_uuid_list)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    *_uuid_list = talloc_steal(mem_ctx, state->uuid_list);
+    return EOK;
+}
+
+/* Like the memory back end, let the caller own a copy of the ccache */
+static errno_t ccdb_wb_return_cc(struct ccdb_wb_op_state *state,
+                                 struct kcm_ccache *cc)
+{
+    if (cc == NULL) {
+        state->cc = NULL;
+        return EOK;
+    }
+
+    state->cc = kcm_cc_dup(state, cc);
+    if (state->cc == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static errno_t ccdb_wb_getbyname_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    return ccdb_wb_return_cc(state, memdb_cc_by_name(state->wb->memdb,
+                                                     state->user->uid,
+                                                     state->name));
+}
+
+static struct tevent_req *ccdb_wb_getbyname_send(TALLOC_CTX *mem_ctx,
+                                                 struct tevent_context *ev,
+                                                 struct kcm_ccdb *db,
+                                                 struct cli_creds *client,
+                                                 const char *name)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_getbyname_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->name = name;
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_getbyuuid_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    return ccdb_wb_return_cc(state, memdb_cc_by_uuid(state->wb->memdb,
+                                                     state->user->uid,
+                                                     state->uuid));
+}
+
+static struct tevent_req *ccdb_wb_getbyuuid_send(TALLOC_CTX *mem_ctx,
+                                                 struct tevent_context *ev,
+                                                 struct kcm_ccdb *db,
+                                                 struct cli_creds *client,
+                                                 uuid_t uuid)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_getbyuuid_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_getcc_recv(struct tevent_req *req,
+                                  TALLOC_CTX *mem_ctx,
+                                  struct kcm_ccache **_cc)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    *_cc = talloc_steal(mem_ctx, state->cc);
+    return EOK;
+}
+
+static errno_t ccdb_wb_name_by_uuid_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct kcm_ccache *cc;
+
+    cc = memdb_cc_by_uuid(state->wb->memdb, state->user->uid, state->uuid);
+    if (cc == NULL) {
+        return ERR_KCM_CC_END;
+    }
+
+    state->name = talloc_strdup(state, cc->name);
+    if (state->name == NULL) {
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static struct tevent_req *ccdb_wb_name_by_uuid_send(TALLOC_CTX *mem_ctx,
+                                                    struct tevent_context *ev,
+                                                    struct kcm_ccdb *db,
+                                                    struct cli_creds *client,
+                                                    uuid_t uuid)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_name_by_uuid_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_name_by_uuid_recv(struct tevent_req *req,
+                                         TALLOC_CTX *mem_ctx,
+                                         const char **_name)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    *_name = talloc_steal(mem_ctx, state->name);
+    return EOK;
+}
+
+static errno_t ccdb_wb_uuid_by_name_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct kcm_ccache *cc;
+
+    cc = memdb_cc_by_name(state->wb->memdb, state->user->uid, state->name);
+    if (cc == NULL) {
+        return ERR_NO_CREDS;
+    }
+
+    uuid_copy(state->uuid, cc->uuid);
+    return EOK;
+}
+
+static struct tevent_req *ccdb_wb_uuid_by_name_send(TALLOC_CTX *mem_ctx,
+                                                    struct tevent_context *ev,
+                                                    struct kcm_ccdb *db,
+                                                    struct cli_creds *client,
+                                                    const char *name)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_uuid_by_name_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->name = name;
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_uuid_by_name_recv(struct tevent_req *req,
+                                         TALLOC_CTX *mem_ctx,
+                                         uuid_t _uuid)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+    uuid_copy(_uuid, state->uuid);
+    return EOK;
+}
+
+static errno_t ccdb_wb_create_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb_entry *entry;
+    errno_t ret;
+
+    entry = ccdb_wb_entry_new(state->wb, state->user, state->client,
+                              CCDB_WB_CREATE, state->cc->uuid);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    /* The ccache in memory changes before the entry is written, the
+     * entry keeps the ccache as it was created */
+    entry->key = sec_key_create(entry, state->cc->name, state->cc->uuid);
+    if (entry->key == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = kcm_ccache_to_sec_input_binary(entry, state->cc, &entry->payload);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = memdb_add(state->wb->memdb, state->cc);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ccdb_wb_journal_add(state->wb, entry);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(entry);
+    }
+    return ret;
+}
+
+static struct tevent_req *ccdb_wb_create_send(TALLOC_CTX *mem_ctx,
+                                              struct tevent_context *ev,
+                                              struct kcm_ccdb *db,
+                                              struct cli_creds *client,
+                                              struct kcm_ccache *cc)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_create_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->cc = cc;
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_mod_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb_entry *entry;
+    struct kcm_ccache *cc;
+    krb5_error_code kret;
+    errno_t ret;
+
+    cc = memdb_cc_by_uuid(state->wb->memdb, state->user->uid, state->uuid);
+    if (cc == NULL) {
+        return ERR_KCM_CC_END;
+    }
+
+    entry = ccdb_wb_entry_new(state->wb, state->user, state->client,
+                              CCDB_WB_MOD, state->uuid);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    entry->mod_cc = kcm_mod_ctx_new(entry);
+    if (entry->mod_cc == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    entry->mod_cc->kdc_offset = state->mod_cc->kdc_offset;
+
+    if (state->mod_cc->client != NULL) {
+        kret = krb5_copy_principal(NULL, state->mod_cc->client,
+                                   &entry->mod_cc->client);
+        if (kret != 0) {
+            DEBUG(SSSDBG_OP_FAILURE, "krb5_copy_principal failed: %d\n", kret);
+            ret = ERR_INTERNAL;
+            goto done;
+        }
+    }
+
+    ret = kcm_mod_cc(cc, state->mod_cc);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot modify ccache [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ccdb_wb_journal_add(state->wb, entry);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(entry);
+    }
+    return ret;
+}
+
+static struct tevent_req *ccdb_wb_mod_send(TALLOC_CTX *mem_ctx,
+                                           struct tevent_context *ev,
+                                           struct kcm_ccdb *db,
+                                           struct cli_creds *client,
+                                           uuid_t uuid,
+                                           struct kcm_mod_ctx *mod_cc)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_mod_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+    state->mod_cc = mod_cc;
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_store_cred_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb_entry *entry;
+    struct kcm_ccache *cc;
+    errno_t ret;
+
+    cc = memdb_cc_by_uuid(state->wb->memdb, state->user->uid, state->uuid);
+    if (cc == NULL) {
+        return ERR_KCM_CC_END;
+    }
+
+    entry = ccdb_wb_entry_new(state->wb, state->user, state->client,
+                              CCDB_WB_STORE_CRED, state->uuid);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    /* The ccache takes over the blob */
+    entry->payload = sss_iobuf_init_readonly(entry,
+                                        sss_iobuf_get_data(state->cred_blob),
+                                        sss_iobuf_get_size(state->cred_blob));
+    if (entry->payload == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = kcm_cc_store_cred_blob(cc, state->cred_blob);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Cannot store credentials to ccache [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    ccdb_wb_journal_add(state->wb, entry);
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        talloc_free(entry);
+    }
+    return ret;
+}
+
+static struct tevent_req *ccdb_wb_store_cred_send(TALLOC_CTX *mem_ctx,
+                                                  struct tevent_context *ev,
+                                                  struct kcm_ccdb *db,
+                                                  struct cli_creds *client,
+                                                  uuid_t uuid,
+                                                  struct sss_iobuf *cred_blob)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_store_cred_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+    state->cred_blob = cred_blob;
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_delete_fn(struct tevent_req *req)
+{
+    struct ccdb_wb_op_state *state = tevent_req_data(req,
+                                                struct ccdb_wb_op_state);
+    struct ccdb_wb_entry *entry;
+    errno_t ret;
+
+    entry = ccdb_wb_entry_new(state->wb, state->user, state->client,
+                              CCDB_WB_DELETE, state->uuid);
+    if (entry == NULL) {
+        return ENOMEM;
+    }
+
+    ret = memdb_delete(state->wb->memdb, state->user->uid, state->uuid);
+    if (ret != EOK) {
+        talloc_free(entry);
+        return ret;
+    }
+
+    if (ccdb_wb_journal_drop_cc(state->wb, state->user, state->uuid)) {
+        /* Neither the ccache nor its deletion ever reach the store */
+        DEBUG(SSSDBG_TRACE_INTERNAL,
+              "Deleted ccache was not written yet, nothing to delete\n");
+        talloc_free(entry);
+        return EOK;
+    }
+
+    ccdb_wb_journal_add(state->wb, entry);
+    return EOK;
+}
+
+static struct tevent_req *ccdb_wb_delete_send(TALLOC_CTX *mem_ctx,
+                                              struct tevent_context *ev,
+                                              struct kcm_ccdb *db,
+                                              struct cli_creds *client,
+                                              uuid_t uuid)
+{
+    struct tevent_req *req;
+    struct ccdb_wb_op_state *state;
+
+    req = ccdb_wb_op_create(mem_ctx, ev, db, client, ccdb_wb_delete_fn,
+                            &state);
+    if (req == NULL) {
+        return NULL;
+    }
+    uuid_copy(state->uuid, uuid);
+
+    return ccdb_wb_op_run(req);
+}
+
+static errno_t ccdb_wb_list_all_cc(TALLOC_CTX *mem_ctx,
+                                   struct krb5_ctx *krb5_ctx,
+                                   struct tevent_context *ev,
+                                   struct kcm_ccdb *db,
+                                   struct kcm_ccache ***_cc_list)
+{
+    struct ccdb_wb *wb = talloc_get_type(db->db_handle, struct ccdb_wb);
+
+    if (wb->store->ops->list_all_cc == NULL) {
+        return EINVAL;
+    }
+
+    /* The renewals read the store directly */
+    ccdb_wb_flush_sync(wb);
+
+    return wb->store->ops->list_all_cc(mem_ctx, krb5_ctx, ev, wb->store,
+                                       _cc_list);
+}
+
+/* ==================== Setup ==================== */
+
+static int ccdb_wb_destructor(struct ccdb_wb *wb)
+{
+    ccdb_wb_flush_sync(wb);
+    ccdb_wb_report(wb, SSSDBG_CONF_SETTINGS);
+
+    return 0;
+}
+
+errno_t ccdb_wb_setup(struct kcm_ccdb *db,
+                      struct kcm_ccdb *store,
+                      time_t window,
+                      size_t max_uids)
+{
+    struct ccdb_wb *wb;
+
+    wb = talloc_zero(db, struct ccdb_wb);
+    if (wb == NULL) {
+        return ENOMEM;
+    }
+
+    wb->memdb = memdb_new(wb);
+    if (wb->memdb == NULL) {
+        talloc_free(wb);
+        return ENOMEM;
+    }
+
+    wb->ev = db->ev;
+    wb->store = store;
+    wb->window = window;
+    wb->max_uids = max_uids;
+    talloc_set_destructor(wb, ccdb_wb_destructor);
+
+    db->db_handle = wb;
+    return EOK;
+}
+
+static errno_t ccdb_wb_init(struct kcm_ccdb *db,
+                            struct confdb_ctx *cdb,
+                            const char *confdb_service_path)
+{
+    struct kcm_ccdb *store;
+    int window;
+    int max_uids;
+    errno_t ret;
+
+    ret = confdb_get_int(cdb, confdb_service_path,
+                         CONFDB_KCM_WRITE_BACK_WINDOW, 0, &window);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot get the write-back window "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = confdb_get_int(cdb, confdb_service_path,
+                         CONFDB_KCM_WRITE_BACK_MAX_UIDS,
+                         DEFAULT_KCM_WRITE_BACK_MAX_UIDS, &max_uids);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot get the number of users kept in "
+              "memory [%d]: %s\n", ret, sss_strerror(ret));
+        return ret;
+    }
+
+    if (window <= 0 || max_uids <= 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Invalid write-back configuration: "
+              "window %d, users %d\n", window, max_uids);
+        return EINVAL;
+    }
+
+    store = talloc_zero(db, struct kcm_ccdb);
+    if (store == NULL) {
+        return ENOMEM;
+    }
+    store->ev = db->ev;
+    store->k5c = db->k5c;
+    store->ops = &ccdb_secdb_ops;
+
+    ret = store->ops->init(store, cdb, confdb_service_path);
+    if (ret != EOK) {
+        talloc_free(store);
+        return ret;
+    }
+
+    ret = ccdb_wb_setup(db, store, window, max_uids);
+    if (ret != EOK) {
+        talloc_free(store);
+        return ret;
+    }
+    /* The pending changes are written by the destructor of the tier,
+     * which runs before the store is freed as its child */
+    talloc_steal(db->db_handle, store);
+
+    DEBUG(SSSDBG_CONF_SETTINGS, "ccache changes are written after %d "
+          "seconds, ccaches of up to %d users are kept in memory\n",
+          window, max_uids);
+    return EOK;
+}
+
+const struct kcm_ccdb_ops ccdb_wb_ops = {
+    .init = ccdb_wb_init,
+
+    .nextid_send = ccdb_wb_nextid_send,
+    .nextid_recv = ccdb_wb_nextid_recv,
+
+    .set_default_send = ccdb_wb_set_default_send,
+    .set_default_recv = ccdb_wb_op_recv,
+
+    .get_default_send = ccdb_wb_get_default_send,
+    .get_default_recv = ccdb_wb_get_default_recv,
+
+    .list_all_cc = ccdb_wb_list_all_cc,
+
+    .list_send = ccdb_wb_list_send,
+    .list_recv = ccdb_wb_list_recv,
+
+    .getbyname_send = ccdb_wb_getbyname_send,
+    .getbyname_recv = ccdb_wb_getcc_recv,
+
+    .getbyuuid_send = ccdb_wb_getbyuuid_send,
+    .getbyuuid_recv = ccdb_wb_getcc_recv,
+
+    .name_by_uuid_send = ccdb_wb_name_by_uuid_send,
+    .name_by_uuid_recv = ccdb_wb_name_by_uuid_recv,
+
+    .uuid_by_name_send = ccdb_wb_uuid_by_name_send,
+    .uuid_by_name_recv = ccdb_wb_uuid_by_name_recv,
+
+    .create_send = ccdb_wb_create_send,
+    .create_recv = ccdb_wb_op_recv,
+
+    .mod_send = ccdb_wb_mod_send,
+    .mod_recv = ccdb_wb_op_recv,
+
+    .store_cred_send = ccdb_wb_store_cred_send,
+    .store_cred_recv = ccdb_wb_op_recv,
+
+    .delete_send = ccdb_wb_delete_send,
+    .delete_recv = ccdb_wb_op_recv,
+};
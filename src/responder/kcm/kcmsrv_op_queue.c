@@ -25,6 +25,8 @@
 
 struct kcm_ops_queue_entry {
     struct tevent_req *req;
+    enum kcm_op_access access;
+    bool running;
 
     struct kcm_ops_queue *queue;
 
@@ -54,6 +56,12 @@ struct kcm_ops_queue_ctx {
  * hash table entry is kcm_ops_queue structure which in turn contains a
  * linked list of kcm_ops_queue_entry structures * which primarily hold the
  * tevent request being queued.
+ *
+ * The head of the list is always running. Readers that follow the head run
+ * together with it as long as no writer is queued in front of them, so a
+ * writer waits for all the readers before it and the readers enqueued after
+ * a writer wait for the writer. This keeps the order of modifications while
+ * not serializing e.g. a number of concurrent klist calls.
  */
 struct kcm_ops_queue_ctx *kcm_ops_queue_create(TALLOC_CTX *mem_ctx,
                                                struct kcm_ctx *kctx)
@@ -116,9 +124,53 @@ void queue_removal_cb(struct tevent_context *ctx,
     talloc_free(kq);
 }
 
+static bool kcm_op_queue_entry_may_run(struct kcm_ops_queue_entry *entry)
+{
+    struct kcm_ops_queue_entry *prev;
+
+    if (entry->prev == NULL) {
+        /* The head of the queue */
+        return true;
+    }
+
+    if (entry->access != KCM_OP_READ) {
+        return false;
+    }
+
+    for (prev = entry->prev; prev != NULL; prev = prev->prev) {
+        if (prev->access != KCM_OP_READ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void kcm_op_queue_run_next(struct kcm_ops_queue *kq)
+{
+    struct kcm_ops_queue_entry *entry;
+
+    DLIST_FOR_EACH(entry, kq->head) {
+        if (entry->running) {
+            continue;
+        }
+
+        if (!kcm_op_queue_entry_may_run(entry)) {
+            break;
+        }
+
+        /* Mark the entry as done to run the request. The callback is
+         * deferred so that the queue is not modified while we iterate
+         * over it
+         */
+        entry->running = true;
+        tevent_req_defer_callback(entry->req, kq->ev);
+        tevent_req_done(entry->req);
+    }
+}
+
 static int kcm_op_queue_entry_destructor(struct kcm_ops_queue_entry *entry)
 {
-    struct kcm_ops_queue_entry *next_entry;
     struct tevent_immediate *imm;
 
     if (entry == NULL) {
@@ -128,13 +180,10 @@ static int kcm_op_queue_entry_destructor(struct kcm_ops_queue_entry *entry)
         return 0;
     }
 
-    /* Take the next entry from the queue */
-    next_entry = entry->next;
-
     /* Remove the current entry from the queue */
     DLIST_REMOVE(entry->queue->head, entry);
 
-    if (next_entry == NULL) {
+    if (entry->queue->head == NULL) {
         /* If there was no other entry, schedule removal of the queue. Do it
          * in another tevent tick to avoid issues with callbacks invoking
          * the destructor while another request is touching the queue
@@ -148,8 +197,8 @@ static int kcm_op_queue_entry_destructor(struct kcm_ops_queue_entry *entry)
         return 0;
     }
 
-    /* Otherwise, mark the current head as done to run the next request */
-    tevent_req_done(next_entry->req);
+    /* Otherwise, run the requests that are no longer blocked */
+    kcm_op_queue_run_next(entry->queue);
     return 0;
 }
 
@@ -220,22 +269,25 @@ struct kcm_op_queue_state {
 };
 
 static errno_t kcm_op_queue_add_req(struct kcm_ops_queue *kq,
-                                    struct tevent_req *req);
+                                    struct tevent_req *req,
+                                    enum kcm_op_access access);
 
 /*
  * Enqueue a request.
  *
  * If the request queue /for the given ID/ is empty, that is, if this
- * request is the first one in the queue, run the request immediately.
+ * request is the first one in the queue, run the request immediately. A
+ * reader also runs immediately if only other readers are queued.
  *
- * Otherwise just add it to the queue and wait until the previous request
- * finishes and only at that point mark the current request as done, which
+ * Otherwise just add it to the queue and wait until the previous requests
+ * finish and only at that point mark the current request as done, which
  * will trigger calling the recv function and allow the request to continue.
  */
 struct tevent_req *kcm_op_queue_send(TALLOC_CTX *mem_ctx,
                                      struct tevent_context *ev,
                                      struct kcm_ops_queue_ctx *qctx,
-                                     struct cli_creds *client)
+                                     struct cli_creds *client,
+                                     enum kcm_op_access access)
 {
     errno_t ret;
     struct tevent_req *req;
@@ -261,10 +313,10 @@ struct tevent_req *kcm_op_queue_send(TALLOC_CTX *mem_ctx,
         goto immediate;
     }
 
-    ret = kcm_op_queue_add_req(kq, req);
+    ret = kcm_op_queue_add_req(kq, req, access);
     if (ret == EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
-              "Queue was empty, running the request immediately\n");
+              "The request is not blocked, running it immediately\n");
         goto immediate;
     } else if (ret != EAGAIN) {
         DEBUG(SSSDBG_OP_FAILURE,
@@ -286,7 +338,8 @@ immediate:
 }
 
 static errno_t kcm_op_queue_add_req(struct kcm_ops_queue *kq,
-                                    struct tevent_req *req)
+                                    struct tevent_req *req,
+                                    enum kcm_op_access access)
 {
     errno_t ret;
     struct kcm_op_queue_state *state = tevent_req_data(req,
@@ -298,17 +351,21 @@ static errno_t kcm_op_queue_add_req(struct kcm_ops_queue *kq,
     }
     state->entry->req = req;
     state->entry->queue = kq;
+    state->entry->access = access;
     talloc_set_destructor(state->entry, kcm_op_queue_entry_destructor);
 
-    if (kq->head == NULL) {
-        /* First entry, will run callback at once */
+    DLIST_ADD_END(kq->head, state->entry, struct kcm_ops_queue_entry *);
+
+    if (kcm_op_queue_entry_may_run(state->entry)) {
+        /* First entry or a reader behind other readers, will run
+         * callback at once */
+        state->entry->running = true;
         ret = EOK;
     } else {
         /* Will wait for the previous callbacks to finish */
         ret = EAGAIN;
     }
 
-    DLIST_ADD_END(kq->head, state->entry, struct kcm_ops_queue_entry *);
     return ret;
 }
 
@@ -68,6 +68,8 @@ struct kcm_op {
     const char *name;
     kcm_srv_send_method fn_send;
     kcm_srv_recv_method fn_recv;
+    /* Operations that do not modify any ccache are KCM_OP_READ */
+    enum kcm_op_access access;
 };
 
 struct kcm_cmd_state {
@@ -166,7 +168,7 @@ struct tevent_req *kcm_cmd_send(TALLOC_CTX *mem_ctx,
         goto immediate;
     }
 
-    subreq = kcm_op_queue_send(state, ev, qctx, client);
+    subreq = kcm_op_queue_send(state, ev, qctx, client, op->access);
     if (subreq == NULL) {
         ret = ENOMEM;
         goto immediate;
@@ -2391,9 +2393,9 @@ static struct kcm_op kcm_optable[] = {
     { "DESTROY",             kcm_op_destroy_send, NULL },
     { "STORE",               kcm_op_store_send, kcm_op_store_recv },
     { "RETRIEVE",            NULL, NULL },
-    { "GET_PRINCIPAL",       kcm_op_get_principal_send, NULL },
-    { "GET_CRED_UUID_LIST",  kcm_op_get_cred_uuid_list_send, NULL },
-    { "GET_CRED_BY_UUID",    kcm_op_get_cred_by_uuid_send, kcm_op_get_cred_by_uuid_recv },
+    { "GET_PRINCIPAL",       kcm_op_get_principal_send, NULL, KCM_OP_READ },
+    { "GET_CRED_UUID_LIST",  kcm_op_get_cred_uuid_list_send, NULL, KCM_OP_READ },
+    { "GET_CRED_BY_UUID",    kcm_op_get_cred_by_uuid_send, kcm_op_get_cred_by_uuid_recv, KCM_OP_READ },
     { "REMOVE_CRED",         kcm_op_remove_cred_send, NULL },
     { "SET_FLAGS",           NULL, NULL },
     { "CHOWN",               NULL, NULL },
@@ -2401,11 +2403,11 @@ static struct kcm_op kcm_optable[] = {
     { "GET_INITIAL_TICKET",  NULL, NULL },
     { "GET_TICKET",          NULL, NULL },
     { "MOVE_CACHE",          NULL, NULL },
-    { "GET_CACHE_UUID_LIST", kcm_op_get_cache_uuid_list_send, NULL },
-    { "GET_CACHE_BY_UUID",   kcm_op_get_cache_by_uuid_send, NULL },
-    { "GET_DEFAULT_CACHE",   kcm_op_get_default_ccache_send, kcm_op_get_default_ccache_recv },
+    { "GET_CACHE_UUID_LIST", kcm_op_get_cache_uuid_list_send, NULL, KCM_OP_READ },
+    { "GET_CACHE_BY_UUID",   kcm_op_get_cache_by_uuid_send, NULL, KCM_OP_READ },
+    { "GET_DEFAULT_CACHE",   kcm_op_get_default_ccache_send, kcm_op_get_default_ccache_recv, KCM_OP_READ },
     { "SET_DEFAULT_CACHE",   kcm_op_set_default_ccache_send, kcm_op_set_default_ccache_recv },
-    { "GET_KDC_OFFSET",      kcm_op_get_kdc_offset_send, NULL },
+    { "GET_KDC_OFFSET",      kcm_op_get_kdc_offset_send, NULL, KCM_OP_READ },
     { "SET_KDC_OFFSET",      kcm_op_set_kdc_offset_send, kcm_op_set_kdc_offset_recv },
     { "ADD_NTLM_CRED",       NULL, NULL },
     { "HAVE_NTLM_CRED",      NULL, NULL },
@@ -2419,7 +2421,7 @@ static struct kcm_op kcm_optable[] = {
 /* MIT EXTENSIONS, see private header src/include/kcm.h in krb5 sources */
 #define KCM_MIT_OFFSET 13001
 static struct kcm_op kcm_mit_optable[] = {
-    { "GET_CRED_LIST", kcm_op_get_cred_list_send, NULL },
+    { "GET_CRED_LIST", kcm_op_get_cred_list_send, NULL, KCM_OP_READ },
 
     { NULL, NULL, NULL }
 };
@@ -61,6 +61,8 @@ struct kcm_resp_ctx {
 enum kcm_ccdb_be {
     CCDB_BE_MEMORY,
     CCDB_BE_SECDB,
+    /* secdb behind an in-memory write-back tier */
+    CCDB_BE_SECDB_WRITE_BACK,
 };
 
 /*
@@ -88,16 +90,24 @@ int kcm_connection_setup(struct cli_ctx *cctx);
 krb5_error_code sss2krb5_error(errno_t err);
 
 /* We enqueue all requests by the same UID to avoid concurrency issues.
+ * Requests that only read the ccaches may run concurrently with other
+ * readers, requests that modify them run alone.
  */
 struct kcm_ops_queue_entry;
 
+enum kcm_op_access {
+    KCM_OP_WRITE = 0,
+    KCM_OP_READ,
+};
+
 struct kcm_ops_queue_ctx *kcm_ops_queue_create(TALLOC_CTX *mem_ctx,
                                                struct kcm_ctx *kctx);
 
 struct tevent_req *kcm_op_queue_send(TALLOC_CTX *mem_ctx,
                                      struct tevent_context *ev,
                                      struct kcm_ops_queue_ctx *qctx,
-                                     struct cli_creds *client);
+                                     struct cli_creds *client,
+                                     enum kcm_op_access access);
 
 errno_t kcm_op_queue_recv(struct tevent_req *req,
                           TALLOC_CTX *mem_ctx,
@@ -38,11 +38,19 @@
 
 #define LOCAL_CONTAINER_FILTER     "(type=container)"
 #define LOCAL_NON_CONTAINER_FILTER "(!"LOCAL_CONTAINER_FILTER")"
+#define LOCAL_RECORD_FILTER        "(type=record)"
+/* Records belong to their secret, they are not secrets on their own */
+#define LOCAL_SECRET_FILTER \
+    "(&"LOCAL_NON_CONTAINER_FILTER"(!"LOCAL_RECORD_FILTER"))"
 
 #define SEC_ATTR_SECRET  "secret"
 #define SEC_ATTR_TYPE    "type"
 #define SEC_ATTR_CTIME   "creationTime"
 
+#define SEC_ATTR_RECORD_KEY  "recordKey"
+#define SEC_ATTR_RECORD_SEQ  "recordSeq"
+#define SEC_ATTR_RECORD_SIZE "recordSize"
+
 static struct sss_sec_quota default_kcm_quota = {
     .max_secrets = DEFAULT_SEC_KCM_MAX_SECRETS,
     .max_uid_secrets = DEFAULT_SEC_KCM_MAX_UID_SECRETS,
@@ -125,7 +133,7 @@ static int local_db_check_number_of_secrets(TALLOC_CTX *mem_ctx,
     }
 
     ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, dn, LDB_SCOPE_SUBTREE,
-                     attrs, LOCAL_NON_CONTAINER_FILTER);
+                     attrs, LOCAL_SECRET_FILTER);
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
               "ldb_search returned %d: %s\n", ret, ldb_strerror(ret));
@@ -206,7 +214,7 @@ static int local_db_check_peruid_number_of_secrets(TALLOC_CTX *mem_ctx,
     }
 
     ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, cli_basedn, LDB_SCOPE_SUBTREE,
-                     attrs, LOCAL_NON_CONTAINER_FILTER);
+                     attrs, LOCAL_SECRET_FILTER);
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
               "ldb_search returned %d: %s\n", ret, ldb_strerror(ret));
@@ -584,7 +592,7 @@ errno_t sss_sec_list_cc_uuids(TALLOC_CTX *mem_ctx,
     dn = ldb_dn_new(tmp_ctx, sec->ldb, "cn=persistent,cn=kcm");
 
     ret = ldb_search(sec->ldb, tmp_ctx, &res, dn, LDB_SCOPE_SUBTREE,
-           attrs, LOCAL_NON_CONTAINER_FILTER);
+           attrs, LOCAL_SECRET_FILTER);
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
               "ldb_search returned [%d]: %s\n", ret, ldb_strerror(ret));
@@ -669,7 +677,7 @@ errno_t sss_sec_list(TALLOC_CTX *mem_ctx,
           ldb_dn_get_linearized(req->req_dn));
 
     ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, req->req_dn, LDB_SCOPE_SUBTREE,
-                     attrs, LOCAL_NON_CONTAINER_FILTER);
+                     attrs, LOCAL_SECRET_FILTER);
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
               "ldb_search returned [%d]: %s\n", ret, ldb_strerror(ret));
@@ -732,7 +740,7 @@ errno_t sss_sec_get(TALLOC_CTX *mem_ctx,
           ldb_dn_get_linearized(req->req_dn));
 
     ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, req->req_dn, LDB_SCOPE_BASE,
-                     attrs, LOCAL_NON_CONTAINER_FILTER);
+                     attrs, LOCAL_SECRET_FILTER);
     if (ret != EOK) {
         DEBUG(SSSDBG_TRACE_LIBS,
               "ldb_search returned [%d]: %s\n", ret, ldb_strerror(ret));
@@ -972,11 +980,416 @@ done:
     return ret;
 }
 
+static struct ldb_dn *local_db_record_dn(TALLOC_CTX *mem_ctx,
+                                         struct sss_sec_req *req,
+                                         const char *key)
+{
+    struct ldb_val val;
+    struct ldb_dn *dn;
+    char *escaped;
+    bool bret;
+
+    dn = ldb_dn_copy(mem_ctx, req->req_dn);
+    if (dn == NULL) {
+        return NULL;
+    }
+
+    val.data = (uint8_t *)discard_const(key);
+    val.length = strlen(key);
+
+    escaped = ldb_dn_escape_value(dn, val);
+    if (escaped == NULL) {
+        talloc_free(dn);
+        return NULL;
+    }
+
+    bret = ldb_dn_add_child_fmt(dn, "cn=%s", escaped);
+    if (!bret) {
+        talloc_free(dn);
+        return NULL;
+    }
+
+    return dn;
+}
+
+static int local_db_delete_records(TALLOC_CTX *mem_ctx,
+                                   struct sss_sec_req *req)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { NULL };
+    struct ldb_result *res;
+    int ret;
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) return ENOMEM;
+
+    ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, req->req_dn,
+                     LDB_SCOPE_ONELEVEL, attrs, LOCAL_RECORD_FILTER);
+    if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+        ret = EOK;
+        goto done;
+    } else if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_TRACE_LIBS,
+              "ldb_search returned %d: %s\n", ret, ldb_strerror(ret));
+        ret = sss_ldb_error_to_errno(ret);
+        goto done;
+    }
+
+    for (unsigned i = 0; i < res->count; i++) {
+        ret = ldb_delete(req->sctx->ldb, res->msgs[i]->dn);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Failed to delete record [%s]: [%d]: %s\n",
+                  ldb_dn_get_linearized(res->msgs[i]->dn),
+                  ret, ldb_strerror(ret));
+            ret = sss_ldb_error_to_errno(ret);
+            goto done;
+        }
+    }
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Deleted %u records of [%s]\n",
+          res->count, req->path);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+/* Replaces the record with the same key. Only the record itself is touched,
+ * its size is accounted in _size. */
+static int local_db_put_record(TALLOC_CTX *mem_ctx,
+                               struct sss_sec_req *req,
+                               struct sss_sec_record *record,
+                               uint64_t seq,
+                               uint64_t *_size)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SEC_ATTR_SECRET, NULL };
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    const struct ldb_val *old;
+    struct ldb_val val;
+    int ret;
+
+    if (record->key == NULL || record->data == NULL || record->len == 0) {
+        return EINVAL;
+    }
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) return ENOMEM;
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    msg->dn = local_db_record_dn(msg, req, record->key);
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, msg->dn, LDB_SCOPE_BASE,
+                     attrs, LOCAL_RECORD_FILTER);
+    if (ret == LDB_SUCCESS && res->count == 1) {
+        old = ldb_msg_find_ldb_val(res->msgs[0], SEC_ATTR_SECRET);
+        if (old != NULL) {
+            *_size -= MIN(*_size, old->length);
+        }
+
+        ret = ldb_delete(req->sctx->ldb, msg->dn);
+    }
+
+    if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to replace record [%s]: [%d]: %s\n",
+              ldb_dn_get_linearized(msg->dn), ret, ldb_strerror(ret));
+        ret = sss_ldb_error_to_errno(ret);
+        goto done;
+    }
+
+    ret = ldb_msg_add_string(msg, SEC_ATTR_TYPE, "record");
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_string(msg, SEC_ATTR_RECORD_KEY, record->key);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_fmt(msg, SEC_ATTR_RECORD_SEQ, "%"PRIu64, seq);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_fmt(msg, SEC_ATTR_CTIME, "%lu", time(NULL));
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    val.length = record->len;
+    val.data = record->data;
+    ret = ldb_msg_add_value(msg, SEC_ATTR_SECRET, &val, NULL);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_add(req->sctx->ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "Failed to add record [%s]: [%d]: %s\n",
+              ldb_dn_get_linearized(msg->dn), ret,
+              ldb_errstring(req->sctx->ldb));
+        goto ldb_done;
+    }
+
+    *_size += record->len;
+
+ldb_done:
+    ret = sss_ldb_error_to_errno(ret);
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+errno_t sss_sec_put_records(struct sss_sec_req *req,
+                            uint8_t *secret,
+                            size_t secret_len,
+                            struct sss_sec_record *records,
+                            size_t num_records)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SEC_ATTR_SECRET,
+                                   SEC_ATTR_RECORD_SEQ,
+                                   SEC_ATTR_RECORD_SIZE,
+                                   NULL };
+    struct ldb_context *ldb;
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    const struct ldb_val *stored;
+    struct ldb_val secret_val;
+    bool in_transaction = false;
+    uint64_t seq;
+    uint64_t size;
+    int ret;
+
+    if (req == NULL || (records == NULL && num_records > 0)) {
+        return EINVAL;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Adding %zu records to [%s]\n",
+          num_records, req->path);
+
+    tmp_ctx = talloc_new(req);
+    if (!tmp_ctx) return ENOMEM;
+
+    ldb = req->sctx->ldb;
+
+    ret = ldb_transaction_start(ldb);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to start transaction [%d]: %s\n",
+              ret, ldb_strerror(ret));
+        ret = sss_ldb_error_to_errno(ret);
+        goto done;
+    }
+    in_transaction = true;
+
+    ret = ldb_search(ldb, tmp_ctx, &res, req->req_dn, LDB_SCOPE_BASE,
+                     attrs, LOCAL_SECRET_FILTER);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_TRACE_LIBS,
+              "ldb_search returned [%d]: %s\n", ret, ldb_strerror(ret));
+        ret = sss_ldb_error_to_errno(ret);
+        goto done;
+    }
+
+    if (res->count != 1) {
+        DEBUG(SSSDBG_TRACE_LIBS, "No secret found\n");
+        ret = ENOENT;
+        goto done;
+    }
+
+    seq = ldb_msg_find_attr_as_uint64(res->msgs[0], SEC_ATTR_RECORD_SEQ, 0);
+    size = ldb_msg_find_attr_as_uint64(res->msgs[0], SEC_ATTR_RECORD_SIZE, 0);
+    if (secret == NULL) {
+        stored = ldb_msg_find_ldb_val(res->msgs[0], SEC_ATTR_SECRET);
+        secret_len = stored != NULL ? stored->length : 0;
+    }
+
+    for (size_t i = 0; i < num_records; i++) {
+        ret = local_db_put_record(tmp_ctx, req, &records[i], seq, &size);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "local_db_put_record failed [%d]: %s\n",
+                  ret, sss_strerror(ret));
+            goto done;
+        }
+        seq++;
+    }
+
+    /* The quota covers the secret together with its records */
+    if (secret_len + size > INT_MAX) {
+        ret = ERR_SEC_PAYLOAD_SIZE_IS_TOO_LARGE;
+        goto done;
+    }
+
+    ret = local_check_max_payload_size(req, secret_len + size);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE,
+              "local_check_max_payload_size failed [%d]: %s\n",
+              ret, sss_strerror(ret));
+        goto done;
+    }
+
+    msg = ldb_msg_new(tmp_ctx);
+    if (msg == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    msg->dn = req->req_dn;
+
+    if (secret != NULL) {
+        secret_val.length = secret_len;
+        secret_val.data = secret;
+
+        ret = ldb_msg_add_empty(msg, SEC_ATTR_SECRET, LDB_FLAG_MOD_REPLACE,
+                                NULL);
+        if (ret != LDB_SUCCESS) goto ldb_done;
+
+        ret = ldb_msg_add_value(msg, SEC_ATTR_SECRET, &secret_val, NULL);
+        if (ret != LDB_SUCCESS) goto ldb_done;
+    }
+
+    ret = ldb_msg_add_empty(msg, SEC_ATTR_RECORD_SEQ, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_fmt(msg, SEC_ATTR_RECORD_SEQ, "%"PRIu64, seq);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_empty(msg, SEC_ATTR_RECORD_SIZE, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_msg_add_fmt(msg, SEC_ATTR_RECORD_SIZE, "%"PRIu64, size);
+    if (ret != LDB_SUCCESS) goto ldb_done;
+
+    ret = ldb_modify(ldb, msg);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_MINOR_FAILURE,
+              "ldb_modify failed: [%s](%d)[%s]\n",
+              ldb_strerror(ret), ret, ldb_errstring(ldb));
+        goto ldb_done;
+    }
+
+    ret = ldb_transaction_commit(ldb);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Failed to commit transaction [%d]: %s\n",
+              ret, ldb_strerror(ret));
+        goto ldb_done;
+    }
+    in_transaction = false;
+
+ldb_done:
+    ret = sss_ldb_error_to_errno(ret);
+done:
+    if (in_transaction) {
+        ldb_transaction_cancel(ldb);
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+static int local_db_record_cmp(const void *a, const void *b)
+{
+    uint64_t seq_a;
+    uint64_t seq_b;
+
+    seq_a = ldb_msg_find_attr_as_uint64(*(struct ldb_message * const *)a,
+                                        SEC_ATTR_RECORD_SEQ, 0);
+    seq_b = ldb_msg_find_attr_as_uint64(*(struct ldb_message * const *)b,
+                                        SEC_ATTR_RECORD_SEQ, 0);
+
+    return seq_a < seq_b ? -1 : seq_a > seq_b;
+}
+
+errno_t sss_sec_get_records(TALLOC_CTX *mem_ctx,
+                            struct sss_sec_req *req,
+                            struct sss_sec_record **_records,
+                            size_t *_num_records)
+{
+    TALLOC_CTX *tmp_ctx;
+    static const char *attrs[] = { SEC_ATTR_SECRET,
+                                   SEC_ATTR_RECORD_KEY,
+                                   SEC_ATTR_RECORD_SEQ,
+                                   NULL };
+    struct sss_sec_record *records;
+    const struct ldb_val *val;
+    struct ldb_result *res;
+    size_t count = 0;
+    int ret;
+
+    if (req == NULL || _records == NULL || _num_records == NULL) {
+        return EINVAL;
+    }
+
+    tmp_ctx = talloc_new(mem_ctx);
+    if (!tmp_ctx) return ENOMEM;
+
+    ret = ldb_search(req->sctx->ldb, tmp_ctx, &res, req->req_dn,
+                     LDB_SCOPE_ONELEVEL, attrs, LOCAL_RECORD_FILTER);
+    if (ret != LDB_SUCCESS) {
+        DEBUG(SSSDBG_TRACE_LIBS,
+              "ldb_search returned [%d]: %s\n", ret, ldb_strerror(ret));
+        ret = sss_ldb_error_to_errno(ret);
+        goto done;
+    }
+
+    if (res->count > 1) {
+        qsort(res->msgs, res->count, sizeof(struct ldb_message *),
+              local_db_record_cmp);
+    }
+
+    records = talloc_zero_array(tmp_ctx, struct sss_sec_record, res->count);
+    if (records == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (unsigned i = 0; i < res->count; i++) {
+        val = ldb_msg_find_ldb_val(res->msgs[i], SEC_ATTR_SECRET);
+        if (val == NULL || val->length == 0) {
+            DEBUG(SSSDBG_MINOR_FAILURE, "Record [%s] has no data, skipping\n",
+                  ldb_dn_get_linearized(res->msgs[i]->dn));
+            continue;
+        }
+
+        records[count].key = talloc_strdup(records,
+                ldb_msg_find_attr_as_string(res->msgs[i],
+                                            SEC_ATTR_RECORD_KEY, ""));
+        records[count].data = talloc_memdup(records, val->data, val->length);
+        if (records[count].key == NULL || records[count].data == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+        records[count].len = val->length;
+        count++;
+    }
+
+    DEBUG(SSSDBG_TRACE_LIBS, "Returning %zu records of [%s]\n",
+          count, req->path);
+
+    *_records = talloc_steal(mem_ctx, records);
+    *_num_records = count;
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
 errno_t sss_sec_delete(struct sss_sec_req *req)
 {
     TALLOC_CTX *tmp_ctx;
     static const char *attrs[] = { NULL };
     struct ldb_result *res;
+    bool in_transaction = false;
     int ret;
 
     if (req == NULL) {
@@ -1017,6 +1430,21 @@ errno_t sss_sec_delete(struct sss_sec_req *req)
                   "Failed to remove '%s': Container is not empty\n",
                   ldb_dn_get_linearized(req->req_dn));
 
+            goto done;
+        }
+    } else {
+        ret = ldb_transaction_start(req->sctx->ldb);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Failed to start transaction [%d]: %s\n",
+                  ret, ldb_strerror(ret));
+            ret = sss_ldb_error_to_errno(ret);
+            goto done;
+        }
+        in_transaction = true;
+
+        ret = local_db_delete_records(tmp_ctx, req);
+        if (ret != EOK) {
             goto done;
         }
     }
@@ -1035,7 +1463,22 @@ errno_t sss_sec_delete(struct sss_sec_req *req)
     }
     ret = sss_ldb_error_to_errno (ret);
 
+    if (ret == EOK && in_transaction) {
+        ret = ldb_transaction_commit(req->sctx->ldb);
+        if (ret != LDB_SUCCESS) {
+            DEBUG(SSSDBG_CRIT_FAILURE,
+                  "Failed to commit transaction [%d]: %s\n",
+                  ret, ldb_strerror(ret));
+            ret = sss_ldb_error_to_errno(ret);
+            goto done;
+        }
+        in_transaction = false;
+    }
+
 done:
+    if (in_transaction) {
+        ldb_transaction_cancel(req->sctx->ldb);
+    }
     talloc_free(tmp_ctx);
     return ret;
 }
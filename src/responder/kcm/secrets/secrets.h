@@ -94,6 +94,30 @@ errno_t sss_sec_update(struct sss_sec_req *req,
 
 errno_t sss_sec_create_container(struct sss_sec_req *req);
 
+/* Records are stored below a secret, e.g. the credentials of a ccache, so
+ * that adding one does not rewrite the whole secret. Storing a record
+ * replaces the record with the same key of the same secret. */
+struct sss_sec_record {
+    const char *key;
+    uint8_t *data;
+    size_t len;
+};
+
+/* Stores the records below the existing secret of req and, unless secret
+ * is NULL, replaces the secret in the same transaction. The payload quota
+ * covers the secret together with all its records. */
+errno_t sss_sec_put_records(struct sss_sec_req *req,
+                            uint8_t *secret,
+                            size_t secret_len,
+                            struct sss_sec_record *records,
+                            size_t num_records);
+
+/* Returns the records of the secret of req in the order they were stored */
+errno_t sss_sec_get_records(TALLOC_CTX *mem_ctx,
+                            struct sss_sec_req *req,
+                            struct sss_sec_record **_records,
+                            size_t *_num_records);
+
 
 errno_t sss_sec_get_quota(struct confdb_ctx *cdb,
                           const char *section_config_path,
@@ -112,6 +112,57 @@ sss_nss_get_group_ghosts(struct sss_domain_info *domain,
     return el;
 }
 
+struct sss_nss_fill_member_state {
+    TALLOC_CTX *mem_ctx;
+    struct sss_packet *packet;
+    struct sss_nss_ctx *nss_ctx;
+    struct sss_domain_info *domain;
+    const char *group_name;
+    size_t *_rp;
+    uint32_t num_members;
+};
+
+static errno_t sss_nss_protocol_fill_member(const char *member_name, void *pvt)
+{
+    struct sss_nss_fill_member_state *state = pvt;
+    struct resp_ctx *rctx = state->nss_ctx->rctx;
+    struct sized_string *name;
+    size_t body_len;
+    uint8_t *body;
+    errno_t ret;
+
+    if (state->nss_ctx->filter_users_in_groups) {
+        ret = sss_ncache_check_user(rctx->ncache, state->domain, member_name);
+        if (ret == EEXIST) {
+            DEBUG(SSSDBG_TRACE_FUNC,
+                  "Group [%s] member [%s] filtered out! "
+                  "(negative cache)\n", state->group_name, member_name);
+            return EOK;
+        }
+    }
+
+    ret = sized_domain_name(state->mem_ctx, rctx, member_name, &name);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to get sized name [%d]: %s\n",
+              ret, sss_strerror(ret));
+        return ret;
+    }
+
+    ret = sss_packet_grow(state->packet, name->len);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    sss_packet_get_body(state->packet, &body, &body_len);
+    SAFEALIGN_SET_STRING(&body[*state->_rp], name->str, name->len,
+                         state->_rp);
+
+    state->num_members++;
+    talloc_free(name);
+
+    return EOK;
+}
+
 static errno_t
 sss_nss_protocol_fill_members(struct sss_packet *packet,
                               struct sss_nss_ctx *nss_ctx,
@@ -125,11 +176,7 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
     struct resp_ctx *rctx = nss_ctx->rctx;
     struct ldb_message_element *members[2];
     struct ldb_message_element *el;
-    struct sized_string *name;
-    const char *member_name;
-    uint32_t num_members = 0;
-    size_t body_len;
-    uint8_t *body;
+    struct sss_nss_fill_member_state state;
     errno_t ret;
     int i, j;
 
@@ -138,6 +185,14 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
         return ENOMEM;
     }
 
+    state.mem_ctx = tmp_ctx;
+    state.packet = packet;
+    state.nss_ctx = nss_ctx;
+    state.domain = domain;
+    state.group_name = group_name;
+    state._rp = _rp;
+    state.num_members = 0;
+
     members[0] = sss_nss_get_group_members(domain, msg);
     members[1] = sss_nss_get_group_ghosts(domain, msg, group_name);
 
@@ -159,8 +214,6 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
         goto done;
     }
 
-    sss_packet_get_body(packet, &body, &body_len);
-
     for (i = 0; i < sizeof(members) / sizeof(members[0]); i++) {
         el = members[i];
         if (el == NULL) {
@@ -168,41 +221,31 @@ sss_nss_protocol_fill_members(struct sss_packet *packet,
         }
 
         for (j = 0; j < el->num_values; j++) {
-            member_name = (const char *)el->values[j].data;
-
-            if (nss_ctx->filter_users_in_groups) {
-                ret = sss_ncache_check_user(rctx->ncache, domain, member_name);
-                if (ret == EEXIST) {
-                    DEBUG(SSSDBG_TRACE_FUNC,
-                          "Group [%s] member [%s] filtered out! "
-                          "(negative cache)\n", group_name, member_name);
-                    continue;
-                }
-            }
-
-            ret = sized_domain_name(tmp_ctx, rctx, member_name, &name);
-            if (ret != EOK) {
-                DEBUG(SSSDBG_OP_FAILURE, "Unable to get sized name [%d]: %s\n",
-                      ret, sss_strerror(ret));
-                goto done;
-            }
-
-            ret = sss_packet_grow(packet, name->len);
+            ret = sss_nss_protocol_fill_member(
+                                (const char *)el->values[j].data, &state);
             if (ret != EOK) {
                 goto done;
             }
+        }
+    }
 
-            sss_packet_get_body(packet, &body, &body_len);
-            SAFEALIGN_SET_STRING(&body[*_rp], name->str, name->len, _rp);
-
-            num_members++;
+    /* Ghost members of large groups are streamed from the ghost store */
+    if (!domain->ignore_group_members
+            && (!DOM_HAS_VIEWS(domain) || is_local_view(domain->view_name))) {
+        ret = sysdb_ghost_store_traverse(domain, msg,
+                                         sss_nss_protocol_fill_member, &state);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE,
+                  "Unable to read stored ghost members of [%s] [%d]: %s\n",
+                  group_name, ret, sss_strerror(ret));
+            goto done;
         }
     }
 
     ret = EOK;
 
 done:
-    *_num_members = num_members;
+    *_num_members = state.num_members;
     talloc_free(tmp_ctx);
 
     return ret;
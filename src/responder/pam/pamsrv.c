@@ -177,6 +177,7 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
     struct pam_ctx *pctx;
     int ret;
     int id_timeout;
+    int offline_timeout;
     int fd_limit;
     char *tmpstr = NULL;
 
@@ -246,6 +247,24 @@ static int pam_process_init(TALLOC_CTX *mem_ctx,
         goto done;
     }
 
+    ret = confdb_get_int(cdb, CONFDB_PAM_CONF_ENTRY,
+                         CONFDB_PAM_OFFLINE_AUTH_TIMEOUT,
+                         CONFDB_DEFAULT_PAM_OFFLINE_AUTH_TIMEOUT,
+                         &offline_timeout);
+    if (ret != EOK) goto done;
+
+    pctx->cached_auth = pam_cached_auth_ctx_new(pctx, offline_timeout);
+    if (pctx->cached_auth == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    pctx->session_tokens = pam_session_tokens_new(pctx, rctx->ev);
+    if (pctx->session_tokens == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
     /* Set up file descriptor limits */
     ret = confdb_get_int(pctx->rctx->cdb,
                          CONFDB_PAM_CONF_ENTRY,
@@ -32,6 +32,20 @@ struct pam_auth_req;
 
 typedef void (pam_dp_callback_t)(struct pam_auth_req *preq);
 
+enum pam_cached_auth_fast_path {
+    PAM_CACHED_AUTH_NONE,
+    PAM_CACHED_AUTH_OFFLINE,   /* the backend reported the domain offline */
+    PAM_CACHED_AUTH_TIMEOUT,   /* cached_auth_timeout applies */
+};
+
+/* Users with this many failed cached authentications within the window do
+ * not use the fast path */
+#define PAM_CACHED_AUTH_MAX_FAILURES 3
+#define PAM_CACHED_AUTH_FAILURE_WINDOW 60
+
+struct pam_cached_auth_ctx;
+struct pam_session_tokens;
+
 enum pam_initgroups_scheme {
     PAM_INITGR_NEVER,
     PAM_INITGR_NO_SESSION,
@@ -43,6 +57,8 @@ struct pam_ctx {
     struct resp_ctx *rctx;
     time_t id_timeout;
     hash_table_t *id_table;
+    struct pam_cached_auth_ctx *cached_auth;
+    struct pam_session_tokens *session_tokens;
     size_t trusted_uids_count;
     uid_t *trusted_uids;
 
@@ -88,6 +104,10 @@ struct pam_auth_req {
     bool use_cached_auth;
     /* whether cached authentication was tried and failed */
     bool cached_auth_failed;
+    /* cached authentication without contacting the backend */
+    enum pam_cached_auth_fast_path fast_path;
+    /* user_obj and domain were taken from the session token */
+    bool session_token_used;
 
     struct ldb_message *user_obj;
     struct cert_auth_info *cert_list;
@@ -157,6 +177,39 @@ errno_t pam_eval_prompting_config(struct pam_ctx *pctx, struct pam_data *pd);
 enum pam_initgroups_scheme pam_initgroups_string_to_enum(const char *str);
 const char *pam_initgroup_enum_to_string(enum pam_initgroups_scheme scheme);
 
+struct pam_cached_auth_ctx *
+pam_cached_auth_ctx_new(TALLOC_CTX *mem_ctx, time_t offline_timeout);
+
+/* Whether the backend of @domain reported it offline recently */
+bool pam_cached_auth_is_offline(struct pam_cached_auth_ctx *ctx,
+                                struct sss_domain_info *domain);
+
+/* Remembers if the backend answered an authentication as offline */
+void pam_cached_auth_dp_result(struct pam_cached_auth_ctx *ctx,
+                               struct sss_domain_info *domain,
+                               struct pam_data *pd);
+
+/* Whether the user @name may use the fast path */
+bool pam_cached_auth_allowed(struct pam_cached_auth_ctx *ctx,
+                             const char *name);
+
+/* Records the result of cached authentication on the fast path */
+void pam_cached_auth_done(struct pam_cached_auth_ctx *ctx,
+                          const char *name,
+                          int pam_status);
+
+struct pam_session_tokens *
+pam_session_tokens_new(TALLOC_CTX *mem_ctx, struct tevent_context *ev);
+
+/* Sets user_obj and domain of @preq if the session token sent by the client
+ * can be used, returns ENOENT if the user must be looked up */
+errno_t pam_session_token_use(struct pam_ctx *pctx,
+                              struct pam_auth_req *preq);
+
+/* Adds the session token to the reply if the client supports it */
+errno_t pam_session_token_reply(struct pam_ctx *pctx,
+                                struct pam_auth_req *preq);
+
 int pam_cmd_gssapi_init(struct cli_ctx *cli_ctx);
 int pam_cmd_gssapi_sec_ctx(struct cli_ctx *cctx);
 
@@ -0,0 +1,220 @@
+/*
+    SSSD
+
+    PAM Responder - state of the cached authentication fast path
+
+    Authentication with cached credentials can be done by the responder
+    alone if the domain was reported offline by the backend shortly before
+    or if cached_auth_timeout applies. Failed attempts are counted per user
+    and a user with too many recent failures is sent through the complete
+    request again, so the fast path cannot be used to guess passwords more
+    quickly.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <security/pam_appl.h>
+
+#include "util/util.h"
+#include "util/sss_ptr_hash.h"
+#include "util/sss_pam_data.h"
+#include "responder/pam/pamsrv.h"
+
+struct pam_cached_auth_domain {
+    time_t offline_until;
+};
+
+struct pam_cached_auth_user {
+    time_t window_start;
+    unsigned int failures;
+};
+
+struct pam_cached_auth_ctx {
+    time_t offline_timeout;
+
+    /* domain name -> struct pam_cached_auth_domain */
+    hash_table_t *domains;
+    /* internal user name -> struct pam_cached_auth_user */
+    hash_table_t *users;
+};
+
+struct pam_cached_auth_ctx *
+pam_cached_auth_ctx_new(TALLOC_CTX *mem_ctx, time_t offline_timeout)
+{
+    struct pam_cached_auth_ctx *ctx;
+
+    ctx = talloc_zero(mem_ctx, struct pam_cached_auth_ctx);
+    if (ctx == NULL) {
+        return NULL;
+    }
+
+    ctx->offline_timeout = offline_timeout;
+
+    ctx->domains = sss_ptr_hash_create(ctx, NULL, NULL);
+    ctx->users = sss_ptr_hash_create(ctx, NULL, NULL);
+    if (ctx->domains == NULL || ctx->users == NULL) {
+        talloc_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+bool pam_cached_auth_is_offline(struct pam_cached_auth_ctx *ctx,
+                                struct sss_domain_info *domain)
+{
+    struct pam_cached_auth_domain *dom;
+
+    if (ctx->offline_timeout <= 0) {
+        return false;
+    }
+
+    dom = sss_ptr_hash_lookup(ctx->domains, domain->name,
+                              struct pam_cached_auth_domain);
+    if (dom == NULL) {
+        return false;
+    }
+
+    if (time(NULL) >= dom->offline_until) {
+        talloc_free(dom);
+        return false;
+    }
+
+    return true;
+}
+
+void pam_cached_auth_dp_result(struct pam_cached_auth_ctx *ctx,
+                               struct sss_domain_info *domain,
+                               struct pam_data *pd)
+{
+    struct pam_cached_auth_domain *dom;
+    errno_t ret;
+
+    if (ctx->offline_timeout <= 0 || domain == NULL
+            || pd->cmd != SSS_PAM_AUTHENTICATE) {
+        return;
+    }
+
+    dom = sss_ptr_hash_lookup(ctx->domains, domain->name,
+                              struct pam_cached_auth_domain);
+
+    if (pd->pam_status != PAM_AUTHINFO_UNAVAIL) {
+        /* The backend handled the request itself */
+        talloc_free(dom);
+        return;
+    }
+
+    if (dom == NULL) {
+        dom = talloc_zero(ctx->domains, struct pam_cached_auth_domain);
+        if (dom == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+            return;
+        }
+
+        ret = sss_ptr_hash_add(ctx->domains, domain->name, dom,
+                               struct pam_cached_auth_domain);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Unable to remember offline state of "
+                  "[%s] [%d]: %s\n", domain->name, ret, sss_strerror(ret));
+            talloc_free(dom);
+            return;
+        }
+    }
+
+    dom->offline_until = time(NULL) + ctx->offline_timeout;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Domain [%s] is offline, cached authentication "
+          "will not contact the backend for %ld seconds.\n",
+          domain->name, (long) ctx->offline_timeout);
+}
+
+static struct pam_cached_auth_user *
+pam_cached_auth_get_user(struct pam_cached_auth_ctx *ctx,
+                         const char *name,
+                         time_t now)
+{
+    struct pam_cached_auth_user *user;
+
+    user = sss_ptr_hash_lookup(ctx->users, name, struct pam_cached_auth_user);
+    if (user != NULL
+            && now >= user->window_start + PAM_CACHED_AUTH_FAILURE_WINDOW) {
+        talloc_free(user);
+        user = NULL;
+    }
+
+    return user;
+}
+
+bool pam_cached_auth_allowed(struct pam_cached_auth_ctx *ctx,
+                             const char *name)
+{
+    struct pam_cached_auth_user *user;
+
+    user = pam_cached_auth_get_user(ctx, name, time(NULL));
+    if (user != NULL && user->failures >= PAM_CACHED_AUTH_MAX_FAILURES) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Too many failed cached authentications of "
+              "[%s], not using the fast path.\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+void pam_cached_auth_done(struct pam_cached_auth_ctx *ctx,
+                          const char *name,
+                          int pam_status)
+{
+    struct pam_cached_auth_user *user;
+    time_t now;
+    errno_t ret;
+
+    now = time(NULL);
+    user = pam_cached_auth_get_user(ctx, name, now);
+
+    switch (pam_status) {
+    case PAM_SUCCESS:
+        talloc_free(user);
+        return;
+    case PAM_AUTH_ERR:
+    case PAM_PERM_DENIED:
+        break;
+    default:
+        return;
+    }
+
+    if (user == NULL) {
+        user = talloc_zero(ctx->users, struct pam_cached_auth_user);
+        if (user == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "talloc_zero failed.\n");
+            return;
+        }
+
+        ret = sss_ptr_hash_add(ctx->users, name, user,
+                               struct pam_cached_auth_user);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Unable to count failed authentication "
+                  "of [%s] [%d]: %s\n", name, ret, sss_strerror(ret));
+            talloc_free(user);
+            return;
+        }
+
+        user->window_start = now;
+    }
+
+    user->failures++;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Cached authentication of [%s] failed, "
+          "%u failure(s) since %ld.\n", name, user->failures,
+          (long) user->window_start);
+}
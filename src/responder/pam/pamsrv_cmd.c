@@ -370,6 +370,11 @@ static int pam_parse_in_data_v2(struct pam_data *pd,
                                            body, blen, &c);
                     if (ret != EOK) return ret;
                     break;
+                case SSS_PAM_ITEM_SESSION_TOKEN:
+                    ret = extract_string(&pd->session_token, size, body, blen,
+                                         &c);
+                    if (ret != EOK) return ret;
+                    break;
                 default:
                     DEBUG(SSSDBG_CRIT_FAILURE,
                           "Ignoring unknown data type [%d].\n", type);
@@ -1084,6 +1089,12 @@ void pam_reply(struct pam_auth_req *preq)
         inform_user(pd, pam_account_locked_message);
     }
 
+    ret = pam_session_token_reply(pctx, preq);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Unable to add session token, "
+              "not fatal.\n");
+    }
+
     ret = filter_responses(pctx, pd->resp_list, pd);
     if (ret != EOK) {
         DEBUG(SSSDBG_CRIT_FAILURE, "filter_responses failed, not fatal.\n");
@@ -1173,6 +1184,7 @@ static void pam_handle_cached_login(struct pam_auth_req *preq, int ret,
                                     time_t expire_date, time_t delayed_until,
                                     bool use_cached_auth)
 {
+    struct pam_ctx *pctx;
     uint32_t resp_type;
     size_t resp_len;
     uint8_t *resp;
@@ -1180,6 +1192,13 @@ static void pam_handle_cached_login(struct pam_auth_req *preq, int ret,
 
     preq->pd->pam_status = cached_login_pam_status(ret);
 
+    if (preq->fast_path != PAM_CACHED_AUTH_NONE) {
+        pctx = talloc_get_type(preq->cctx->rctx->pvt_ctx, struct pam_ctx);
+        pam_cached_auth_done(pctx->cached_auth, preq->pd->user,
+                             preq->pd->pam_status);
+        preq->fast_path = PAM_CACHED_AUTH_NONE;
+    }
+
     switch (preq->pd->pam_status) {
         case PAM_SUCCESS:
             resp_type = SSS_PAM_USER_INFO_OFFLINE_AUTH;
@@ -1246,10 +1265,6 @@ static void pam_forwarder_cert_cb(struct tevent_req *req);
 int pam_check_user_search(struct pam_auth_req *preq);
 
 
-/* TODO: we should probably return some sort of cookie that is set in the
- * PAM_ENVIRONMENT, so that we can save performing some calls and cache
- * data. */
-
 static errno_t pam_forwarder_parse_data(struct cli_ctx *cctx, struct pam_data *pd)
 {
     struct cli_protocol *prctx;
@@ -1970,6 +1985,10 @@ static void pam_check_user_search_next(struct tevent_req *req);
 static void pam_check_user_search_lookup(struct tevent_req *req);
 static void pam_check_user_search_done(struct pam_auth_req *preq, int ret,
                                        struct cache_req_result *result);
+static bool pam_check_cached_auth_fast_path(struct pam_ctx *pctx,
+                                            struct pam_auth_req *preq,
+                                            struct sss_domain_info *domain,
+                                            struct ldb_message *user_obj);
 
 /* lookup the user uid from the cache first,
  * then we'll refresh initgroups if needed */
@@ -1977,6 +1996,20 @@ int pam_check_user_search(struct pam_auth_req *preq)
 {
     struct tevent_req *dpreq;
     struct cache_req_data *data;
+    struct pam_ctx *pctx;
+    errno_t ret;
+
+    pctx = talloc_get_type(preq->cctx->rctx->pvt_ctx, struct pam_ctx);
+
+    /* A previous request of the same PAM handle already found the user */
+    ret = pam_session_token_use(pctx, preq);
+    if (ret == EOK) {
+        pd_set_primary_name(preq->user_obj, preq->pd);
+        (void) pam_check_cached_auth_fast_path(pctx, preq, preq->domain,
+                                               preq->user_obj);
+        pam_dom_forwarder(preq);
+        return EOK;
+    }
 
     data = cache_req_data_name(preq,
                                CACHE_REQ_INITGROUPS,
@@ -2034,6 +2067,14 @@ static void pam_check_user_search_next(struct tevent_req *req)
     if (ret == EOK) {
         bool user_has_session = false;
 
+        /* Cached authentication without the backend does not need fresh
+         * group memberships, they are refreshed for account management. */
+        if (pam_check_cached_auth_fast_path(pctx, preq, result->domain,
+                                            result->msgs[0])) {
+            pam_check_user_search_done(preq, EOK, result);
+            return;
+        }
+
         if (pctx->initgroups_scheme == PAM_INITGR_NO_SESSION) {
             uid_t uid = ldb_msg_find_attr_as_uint64(result->msgs[0],
                                                     SYSDB_UIDNUM, 0);
@@ -2148,14 +2189,16 @@ static void pam_check_user_search_done(struct pam_auth_req *preq, int ret,
         pd_set_primary_name(preq->user_obj, preq->pd);
         preq->domain = result->domain;
 
-        ret = pam_initgr_cache_set(pctx->rctx->ev,
-                                   pctx->id_table,
-                                   preq->pd->logon_name,
-                                   pctx->id_timeout);
-        if (ret != EOK) {
-            DEBUG(SSSDBG_OP_FAILURE,
-                  "Could not save initgr timestamp."
-                  "Proceeding with PAM actions\n");
+        if (preq->fast_path == PAM_CACHED_AUTH_NONE) {
+            ret = pam_initgr_cache_set(pctx->rctx->ev,
+                                       pctx->id_table,
+                                       preq->pd->logon_name,
+                                       pctx->id_timeout);
+            if (ret != EOK) {
+                DEBUG(SSSDBG_OP_FAILURE,
+                      "Could not save initgr timestamp."
+                      "Proceeding with PAM actions\n");
+            }
         }
 
         pam_dom_forwarder(preq);
@@ -2280,6 +2323,50 @@ static bool pam_can_user_cache_auth(struct sss_domain_info *domain,
     return result;
 }
 
+static bool pam_check_cached_auth_fast_path(struct pam_ctx *pctx,
+                                            struct pam_auth_req *preq,
+                                            struct sss_domain_info *domain,
+                                            struct ldb_message *user_obj)
+{
+    const char *name;
+
+    if (preq->pd->cmd != SSS_PAM_AUTHENTICATE
+            || !domain->cache_credentials
+            || preq->cached_auth_failed
+            || !pam_is_authtok_cachable(preq->pd->authtok)) {
+        return false;
+    }
+
+    name = ldb_msg_find_attr_as_string(user_obj, SYSDB_NAME, NULL);
+    if (name == NULL
+            || !pam_cached_auth_allowed(pctx->cached_auth, name)) {
+        return false;
+    }
+
+    if (pam_cached_auth_is_offline(pctx->cached_auth, domain)) {
+        preq->fast_path = PAM_CACHED_AUTH_OFFLINE;
+    } else if (pam_can_user_cache_auth(domain, preq->pd->cmd,
+                                       preq->pd->authtok, name,
+                                       preq->cached_auth_failed)) {
+        preq->fast_path = PAM_CACHED_AUTH_TIMEOUT;
+    } else {
+        return false;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Authenticating [%s] with cached credentials "
+          "without contacting the backend.\n", name);
+    return true;
+}
+
+static void pam_dp_reply(struct pam_auth_req *preq)
+{
+    struct pam_ctx *pctx =
+            talloc_get_type(preq->cctx->rctx->pvt_ctx, struct pam_ctx);
+
+    pam_cached_auth_dp_result(pctx->cached_auth, preq->domain, preq->pd);
+    pam_reply(preq);
+}
+
 static void pam_dom_forwarder(struct pam_auth_req *preq)
 {
     int ret;
@@ -2315,6 +2402,20 @@ static void pam_dom_forwarder(struct pam_auth_req *preq)
         return;
     }
 
+    switch (preq->fast_path) {
+    case PAM_CACHED_AUTH_OFFLINE:
+        /* Continue as if the backend replied it is offline */
+        preq->pd->pam_status = PAM_AUTHINFO_UNAVAIL;
+        pam_reply(preq);
+        return;
+    case PAM_CACHED_AUTH_TIMEOUT:
+        preq->use_cached_auth = true;
+        pam_reply(preq);
+        return;
+    case PAM_CACHED_AUTH_NONE:
+        break;
+    }
+
     if (pam_can_user_cache_auth(preq->domain,
                                 preq->pd->cmd,
                                 preq->pd->authtok,
@@ -2411,7 +2512,7 @@ static void pam_dom_forwarder(struct pam_auth_req *preq)
         }
     }
 
-    preq->callback = pam_reply;
+    preq->callback = pam_dp_reply;
     ret = pam_dp_send_req(preq);
     DEBUG(SSSDBG_CONF_SETTINGS, "pam_dp_send_req returned %d\n", ret);
 
@@ -0,0 +1,305 @@
+/*
+    SSSD
+
+    PAM Responder - session tokens
+
+    A PAM conversation sends several requests for the same user, e.g.
+    SSS_PAM_PREAUTH, SSS_PAM_AUTHENTICATE, SSS_PAM_ACCT_MGMT and
+    SSS_PAM_OPEN_SESSION. Clients which support it receive a token with the
+    reply which they send back with the next request of the same PAM
+    handle. For pam_id_timeout seconds after the last request, the user entry
+    and the domain resolved for the token are reused instead of looking the
+    user up again.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <security/pam_appl.h>
+
+#include "util/util.h"
+#include "util/sss_ptr_hash.h"
+#include "util/sss_pam_data.h"
+#include "util/crypto/sss_crypto.h"
+#include "responder/pam/pamsrv.h"
+#include "responder/pam/pam_helpers.h"
+
+#define PAM_SESSION_TOKEN_BYTES 16
+
+struct pam_session_token {
+    char *token;
+    uid_t client_uid;
+    uint32_t cli_pid;
+    char *logon_name;
+    char *service;
+    char *domain_name;
+    struct ldb_message *user_obj;
+    struct tevent_timer *te;
+};
+
+struct pam_session_tokens {
+    struct tevent_context *ev;
+    /* token -> struct pam_session_token */
+    hash_table_t *table;
+};
+
+struct pam_session_tokens *
+pam_session_tokens_new(TALLOC_CTX *mem_ctx, struct tevent_context *ev)
+{
+    struct pam_session_tokens *tokens;
+
+    tokens = talloc_zero(mem_ctx, struct pam_session_tokens);
+    if (tokens == NULL) {
+        return NULL;
+    }
+
+    tokens->ev = ev;
+    tokens->table = sss_ptr_hash_create(tokens, NULL, NULL);
+    if (tokens->table == NULL) {
+        talloc_free(tokens);
+        return NULL;
+    }
+
+    return tokens;
+}
+
+static void pam_session_token_expire(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv,
+                                     void *pvt)
+{
+    struct pam_session_token *entry;
+
+    entry = talloc_get_type(pvt, struct pam_session_token);
+
+    DEBUG(SSSDBG_TRACE_INTERNAL, "Session token of [%s] expired.\n",
+          entry->logon_name);
+
+    /* removes the entry from the table as well */
+    talloc_free(entry);
+}
+
+static errno_t pam_session_token_touch(struct pam_session_tokens *tokens,
+                                       struct pam_session_token *entry,
+                                       time_t timeout)
+{
+    talloc_zfree(entry->te);
+
+    entry->te = tevent_add_timer(tokens->ev, entry,
+                                 tevent_timeval_current_ofs(timeout, 0),
+                                 pam_session_token_expire, entry);
+    if (entry->te == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "tevent_add_timer failed.\n");
+        return ENOMEM;
+    }
+
+    return EOK;
+}
+
+static bool pam_session_token_matches(struct pam_session_token *entry,
+                                      struct pam_auth_req *preq)
+{
+    struct pam_data *pd = preq->pd;
+    const char *service = pd->service != NULL ? pd->service : "";
+
+    return entry->client_uid == client_euid(preq->cctx->creds)
+            && entry->cli_pid == pd->cli_pid
+            && pd->logon_name != NULL
+            && strcmp(entry->logon_name, pd->logon_name) == 0
+            && strcmp(entry->service, service) == 0;
+}
+
+static struct pam_session_token *
+pam_session_token_find(struct pam_session_tokens *tokens,
+                       struct pam_auth_req *preq)
+{
+    struct pam_session_token *entry;
+
+    if (preq->pd->session_token == NULL) {
+        return NULL;
+    }
+
+    entry = sss_ptr_hash_lookup(tokens->table, preq->pd->session_token,
+                                struct pam_session_token);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    if (!pam_session_token_matches(entry, preq)) {
+        DEBUG(SSSDBG_MINOR_FAILURE, "Session token was issued for another "
+              "client or user, ignoring it.\n");
+        return NULL;
+    }
+
+    return entry;
+}
+
+errno_t pam_session_token_use(struct pam_ctx *pctx,
+                              struct pam_auth_req *preq)
+{
+    struct pam_session_token *entry;
+    struct sss_domain_info *domain;
+    errno_t ret;
+
+    entry = pam_session_token_find(pctx->session_tokens, preq);
+    if (entry == NULL) {
+        return ENOENT;
+    }
+
+    /* Do not skip an online refresh of the group memberships which the
+     * complete lookup would do now. */
+    if (pctx->initgroups_scheme != PAM_INITGR_NEVER) {
+        ret = pam_initgr_check_timeout(pctx->id_table, preq->pd->logon_name);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Initgroups of [%s] must be refreshed, "
+                  "not using the session token.\n", entry->logon_name);
+            return ENOENT;
+        }
+    }
+
+    domain = find_domain_by_name(pctx->rctx->domains, entry->domain_name,
+                                 true);
+    if (domain == NULL
+            || sss_domain_get_state(domain) == DOM_DISABLED) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Domain [%s] of the session token is not "
+              "available.\n", entry->domain_name);
+        talloc_free(entry);
+        return ENOENT;
+    }
+
+    preq->user_obj = ldb_msg_copy(preq, entry->user_obj);
+    if (preq->user_obj == NULL) {
+        return ENOMEM;
+    }
+    preq->domain = domain;
+    preq->session_token_used = true;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Reusing the user data of [%s] from the "
+          "session token.\n", entry->logon_name);
+
+    return EOK;
+}
+
+static char *pam_session_token_generate(TALLOC_CTX *mem_ctx)
+{
+    uint8_t buf[PAM_SESSION_TOKEN_BYTES];
+    char *token;
+    size_t c;
+    int ret;
+
+    ret = sss_generate_csprng_buffer(buf, sizeof(buf));
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to generate session token.\n");
+        return NULL;
+    }
+
+    token = talloc_zero_size(mem_ctx, 2 * sizeof(buf) + 1);
+    if (token == NULL) {
+        return NULL;
+    }
+
+    for (c = 0; c < sizeof(buf); c++) {
+        snprintf(&token[2 * c], 3, "%02x", buf[c]);
+    }
+
+    return token;
+}
+
+static struct pam_session_token *
+pam_session_token_create(struct pam_session_tokens *tokens,
+                         struct pam_auth_req *preq)
+{
+    struct pam_session_token *entry;
+    errno_t ret;
+
+    entry = talloc_zero(tokens->table, struct pam_session_token);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->token = pam_session_token_generate(entry);
+    entry->logon_name = talloc_strdup(entry, preq->pd->logon_name);
+    entry->service = talloc_strdup(entry, preq->pd->service != NULL
+                                                ? preq->pd->service : "");
+    entry->domain_name = talloc_strdup(entry, preq->domain->name);
+    entry->user_obj = ldb_msg_copy(entry, preq->user_obj);
+    if (entry->token == NULL || entry->logon_name == NULL
+            || entry->service == NULL || entry->domain_name == NULL
+            || entry->user_obj == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    entry->client_uid = client_euid(preq->cctx->creds);
+    entry->cli_pid = preq->pd->cli_pid;
+
+    ret = sss_ptr_hash_add(tokens->table, entry->token, entry,
+                           struct pam_session_token);
+
+done:
+    if (ret != EOK) {
+        DEBUG(SSSDBG_OP_FAILURE, "Unable to create session token [%d]: %s\n",
+              ret, sss_strerror(ret));
+        talloc_free(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+errno_t pam_session_token_reply(struct pam_ctx *pctx,
+                                struct pam_auth_req *preq)
+{
+    struct pam_data *pd = preq->pd;
+    struct pam_session_token *entry;
+    errno_t ret;
+
+    entry = pam_session_token_find(pctx->session_tokens, preq);
+
+    if (pd->cmd == SSS_PAM_CLOSE_SESSION) {
+        /* The conversation is over */
+        talloc_free(entry);
+        return EOK;
+    }
+
+    if (!(pd->cli_flags & PAM_CLI_FLAGS_SESSION_TOKEN)
+            || pd->pam_status != PAM_SUCCESS
+            || pctx->id_timeout <= 0
+            || preq->user_obj == NULL || preq->domain == NULL
+            || pd->logon_name == NULL) {
+        return EOK;
+    }
+
+    if (entry != NULL && !preq->session_token_used) {
+        /* The user was looked up again, replace the old data */
+        talloc_zfree(entry);
+    }
+
+    if (entry == NULL) {
+        entry = pam_session_token_create(pctx->session_tokens, preq);
+        if (entry == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    ret = pam_session_token_touch(pctx->session_tokens, entry,
+                                  pctx->id_timeout);
+    if (ret != EOK) {
+        talloc_free(entry);
+        return ret;
+    }
+
+    return pam_add_response(pd, SSS_PAM_SESSION_TOKEN,
+                            strlen(entry->token) + 1,
+                            (const uint8_t *) entry->token);
+}
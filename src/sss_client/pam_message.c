@@ -127,6 +127,8 @@ int pack_message_v3(struct pam_items *pi, size_t *size, uint8_t **buffer)
 
     len += *pi->requested_domains != '\0' ?
                 2*sizeof(uint32_t) + pi->requested_domains_size : 0;
+    len += (pi->session_token != NULL && *pi->session_token != '\0') ?
+                2*sizeof(uint32_t) + pi->session_token_size : 0;
     len += 3*sizeof(uint32_t); /* flags */
 
     /* optional child_pid */
@@ -161,6 +163,9 @@ int pack_message_v3(struct pam_items *pi, size_t *size, uint8_t **buffer)
     rp += add_string_item(SSS_PAM_ITEM_REQUESTED_DOMAINS, pi->requested_domains, pi->requested_domains_size,
                           &buf[rp]);
 
+    rp += add_string_item(SSS_PAM_ITEM_SESSION_TOKEN, pi->session_token,
+                          pi->session_token_size, &buf[rp]);
+
     rp += add_uint32_t_item(SSS_PAM_ITEM_CLI_PID, (uint32_t) pi->cli_pid,
                             &buf[rp]);
 
@@ -57,6 +57,8 @@ struct pam_items {
     char *domain_name;
     const char *requested_domains;
     size_t requested_domains_size;
+    const char *session_token;
+    size_t session_token_size;
     char *otp_vendor;
     char *otp_token_id;
     char *otp_challenge;
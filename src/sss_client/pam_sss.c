@@ -59,6 +59,7 @@
 #define PAM_SSS_AUTHOK_TYPE "pam_sss:authtok_type"
 #define PAM_SSS_AUTHOK_SIZE "pam_sss:authtok_size"
 #define PAM_SSS_AUTHOK_DATA "pam_sss:authtok_data"
+#define PAM_SSS_SESSION_TOKEN "pam_sss:session_token"
 
 #define PW_RESET_MSG_FILENAME_TEMPLATE SSSD_CONF_DIR"/customize/%s/pam_sss_pw_reset_message.%s"
 #define PW_RESET_MSG_MAX_SIZE 4096
@@ -109,6 +110,11 @@ static void free_exp_data(pam_handle_t *pamh, void *ptr, int err)
     free(ptr);
 }
 
+static void free_session_token(pam_handle_t *pamh, void *ptr, int err)
+{
+    free(ptr);
+}
+
 static void close_fd(pam_handle_t *pamh, void *ptr, int err)
 {
 #ifdef PAM_DATA_REPLACE
@@ -1035,6 +1041,7 @@ static int eval_response(pam_handle_t *pamh, size_t buflen, uint8_t *buf,
     size_t offset;
     const char *cert_user;
     const char *pam_cert_user;
+    char *session_token;
 
     if (buflen < (2*sizeof(int32_t))) {
         D(("response buffer is too small"));
@@ -1284,6 +1291,28 @@ static int eval_response(pam_handle_t *pamh, size_t buflen, uint8_t *buf,
                     break;
                 }
 
+                break;
+            case SSS_PAM_SESSION_TOKEN:
+                if (buf[p + (len - 1)] != '\0') {
+                    D(("session token does not end with \\0."));
+                    break;
+                }
+
+                session_token = strdup((char *) &buf[p]);
+                if (session_token == NULL) {
+                    D(("strdup failed"));
+                    break;
+                }
+
+                ret = pam_set_data(pamh, PAM_SSS_SESSION_TOKEN, session_token,
+                                   free_session_token);
+                if (ret != PAM_SUCCESS) {
+                    D(("pam_set_data failed."));
+                    free(session_token);
+                    break;
+                }
+                pi->session_token = session_token;
+                pi->session_token_size = strlen(session_token) + 1;
                 break;
             case SSS_PAM_PASSKEY_INFO:
                 if (buf[p + (len - 1)] != '\0') {
@@ -1401,6 +1430,13 @@ static int get_pam_items(pam_handle_t *pamh, uint32_t flags,
     if (pi->requested_domains == NULL) pi->requested_domains = "";
     pi->requested_domains_size = strlen(pi->requested_domains) + 1;
 
+    ret = pam_get_data(pamh, PAM_SSS_SESSION_TOKEN,
+                       (const void **) &(pi->session_token));
+    if (ret != PAM_SUCCESS || pi->session_token == NULL) {
+        pi->session_token = "";
+    }
+    pi->session_token_size = strlen(pi->session_token) + 1;
+
     pi->otp_vendor = NULL;
     pi->otp_token_id = NULL;
     pi->otp_challenge = NULL;
@@ -1411,7 +1447,7 @@ static int get_pam_items(pam_handle_t *pamh, uint32_t flags,
 
     pi->pc = NULL;
 
-    pi->flags = flags;
+    pi->flags = flags | PAM_CLI_FLAGS_SESSION_TOKEN;
 
     return PAM_SUCCESS;
 }
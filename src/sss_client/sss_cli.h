@@ -406,6 +406,7 @@ enum pam_item_type {
     SSS_PAM_ITEM_CHILD_PID,
     SSS_PAM_ITEM_REQUESTED_DOMAINS,
     SSS_PAM_ITEM_FLAGS,
+    SSS_PAM_ITEM_SESSION_TOKEN,
 };
 
 #define PAM_CLI_FLAGS_USE_FIRST_PASS (1 << 0)
@@ -418,6 +419,7 @@ enum pam_item_type {
 #define PAM_CLI_FLAGS_PROMPT_ALWAYS (1 << 7)
 #define PAM_CLI_FLAGS_TRY_CERT_AUTH (1 << 8)
 #define PAM_CLI_FLAGS_REQUIRE_CERT_AUTH (1 << 9)
+#define PAM_CLI_FLAGS_SESSION_TOKEN (1 << 10)
 
 #define SSS_NSS_MAX_ENTRIES 256
 #define SSS_NSS_HEADER_SIZE (sizeof(uint32_t) * 4)
@@ -539,6 +541,13 @@ enum response_type {
                             * which dictates whether prompting for PIN is
                             * needed.
                             * @param prompt_pin. */
+    SSS_PAM_SESSION_TOKEN, /**< Token which identifies the user data the
+                            * responder resolved for this PAM handle. It is
+                            * sent back with the following requests of the
+                            * same handle so that the responder can reuse
+                            * the data for a short time. Only sent if the
+                            * client set PAM_CLI_FLAGS_SESSION_TOKEN.
+                            * @param token, zero terminated. */
 };
 
 /**
@@ -416,6 +416,85 @@ errno_t _sbus_sss_invoker_write_ssau
     return EOK;
 }
 
+errno_t _sbus_sss_invoker_read_tttttu
+   (TALLOC_CTX *mem_ctx,
+    DBusMessageIter *iter,
+    struct _sbus_sss_invoker_args_tttttu *args)
+{
+    errno_t ret;
+
+    ret = sbus_iterator_read_t(iter, &args->arg0);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_t(iter, &args->arg1);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_t(iter, &args->arg2);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_t(iter, &args->arg3);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_t(iter, &args->arg4);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_read_u(iter, &args->arg5);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return EOK;
+}
+
+errno_t _sbus_sss_invoker_write_tttttu
+   (DBusMessageIter *iter,
+    struct _sbus_sss_invoker_args_tttttu *args)
+{
+    errno_t ret;
+
+    ret = sbus_iterator_write_t(iter, args->arg0);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_t(iter, args->arg1);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_t(iter, args->arg2);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_t(iter, args->arg3);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_t(iter, args->arg4);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sbus_iterator_write_u(iter, args->arg5);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return EOK;
+}
+
 errno_t _sbus_sss_invoker_read_u
    (TALLOC_CTX *mem_ctx,
     DBusMessageIter *iter,
@@ -108,6 +108,115 @@ sbus_method_in__out__recv
     return EOK;
 }
 
+struct sbus_method_in__out_tttttu_state {
+    struct _sbus_sss_invoker_args_tttttu *out;
+};
+
+static void sbus_method_in__out_tttttu_done(struct tevent_req *subreq);
+
+static struct tevent_req *
+sbus_method_in__out_tttttu_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     sbus_invoker_keygen keygen,
+     const char *bus,
+     const char *path,
+     const char *iface,
+     const char *method)
+{
+    struct sbus_method_in__out_tttttu_state *state;
+    struct tevent_req *subreq;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sbus_method_in__out_tttttu_state);
+    if (req == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create tevent request!\n");
+        return NULL;
+    }
+
+    state->out = talloc_zero(state, struct _sbus_sss_invoker_args_tttttu);
+    if (state->out == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "Unable to allocate space for output parameters!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+
+    subreq = sbus_call_method_send(state, conn, NULL, keygen, NULL,
+                                   bus, path, iface, method, NULL);
+    if (subreq == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to create subrequest!\n");
+        ret = ENOMEM;
+        goto done;
+    }
+
+    tevent_req_set_callback(subreq, sbus_method_in__out_tttttu_done, req);
+
+    ret = EAGAIN;
+
+done:
+    if (ret != EAGAIN) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, conn->ev);
+    }
+
+    return req;
+}
+
+static void sbus_method_in__out_tttttu_done(struct tevent_req *subreq)
+{
+    struct sbus_method_in__out_tttttu_state *state;
+    struct tevent_req *req;
+    DBusMessage *reply;
+    errno_t ret;
+
+    req = tevent_req_callback_data(subreq, struct tevent_req);
+    state = tevent_req_data(req, struct sbus_method_in__out_tttttu_state);
+
+    ret = sbus_call_method_recv(state, subreq, &reply);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    ret = sbus_read_output(state->out, reply, (sbus_invoker_reader_fn)_sbus_sss_invoker_read_tttttu, state->out);
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        return;
+    }
+
+    tevent_req_done(req);
+    return;
+}
+
+static errno_t
+sbus_method_in__out_tttttu_recv
+    (struct tevent_req *req,
+     uint64_t* _arg0,
+     uint64_t* _arg1,
+     uint64_t* _arg2,
+     uint64_t* _arg3,
+     uint64_t* _arg4,
+     uint32_t* _arg5)
+{
+    struct sbus_method_in__out_tttttu_state *state;
+    state = tevent_req_data(req, struct sbus_method_in__out_tttttu_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_arg0 = state->out->arg0;
+    *_arg1 = state->out->arg1;
+    *_arg2 = state->out->arg2;
+    *_arg3 = state->out->arg3;
+    *_arg4 = state->out->arg4;
+    *_arg5 = state->out->arg5;
+
+    return EOK;
+}
+
 struct sbus_method_in_pam_data_out_pam_response_state {
     struct _sbus_sss_invoker_args_pam_data in;
     struct _sbus_sss_invoker_args_pam_response *out;
@@ -1915,6 +2024,30 @@ sbus_call_dp_autofs_GetMap_recv
     return sbus_method_in_usu_out__recv(req);
 }
 
+struct tevent_req *
+sbus_call_dp_backend_DNSCacheStats_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     const char *busname,
+     const char *object_path)
+{
+    return sbus_method_in__out_tttttu_send(mem_ctx, conn, NULL,
+        busname, object_path, "sssd.DataProvider.Backend", "DNSCacheStats");
+}
+
+errno_t
+sbus_call_dp_backend_DNSCacheStats_recv
+    (struct tevent_req *req,
+     uint64_t* _hits,
+     uint64_t* _negative_hits,
+     uint64_t* _misses,
+     uint64_t* _prefetches,
+     uint64_t* _evictions,
+     uint32_t* _entries)
+{
+    return sbus_method_in__out_tttttu_recv(req, _hits, _negative_hits, _misses, _prefetches, _evictions, _entries);
+}
+
 struct tevent_req *
 sbus_call_dp_backend_IsOnline_send
     (TALLOC_CTX *mem_ctx,
@@ -96,6 +96,23 @@ errno_t
 sbus_call_dp_autofs_GetMap_recv
     (struct tevent_req *req);
 
+struct tevent_req *
+sbus_call_dp_backend_DNSCacheStats_send
+    (TALLOC_CTX *mem_ctx,
+     struct sbus_connection *conn,
+     const char *busname,
+     const char *object_path);
+
+errno_t
+sbus_call_dp_backend_DNSCacheStats_recv
+    (struct tevent_req *req,
+     uint64_t* _hits,
+     uint64_t* _negative_hits,
+     uint64_t* _misses,
+     uint64_t* _prefetches,
+     uint64_t* _evictions,
+     uint32_t* _entries);
+
 struct tevent_req *
 sbus_call_dp_backend_IsOnline_send
     (TALLOC_CTX *mem_ctx,
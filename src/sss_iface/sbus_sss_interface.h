@@ -231,6 +231,28 @@
         (methods), (signals), (properties)); \
 })
 
+/* Method: sssd.DataProvider.Backend.DNSCacheStats */
+#define SBUS_METHOD_SYNC_sssd_DataProvider_Backend_DNSCacheStats(handler, data) ({ \
+    SBUS_CHECK_SYNC((handler), (data), uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint32_t*); \
+    sbus_method_sync("DNSCacheStats", \
+        &_sbus_sss_args_sssd_DataProvider_Backend_DNSCacheStats, \
+        NULL, \
+        _sbus_sss_invoke_in__out_tttttu_send, \
+        NULL, \
+        (handler), (data)); \
+})
+
+#define SBUS_METHOD_ASYNC_sssd_DataProvider_Backend_DNSCacheStats(handler_send, handler_recv, data) ({ \
+    SBUS_CHECK_SEND((handler_send), (data)); \
+    SBUS_CHECK_RECV((handler_recv), uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint32_t*); \
+    sbus_method_async("DNSCacheStats", \
+        &_sbus_sss_args_sssd_DataProvider_Backend_DNSCacheStats, \
+        NULL, \
+        _sbus_sss_invoke_in__out_tttttu_send, \
+        NULL, \
+        (handler_send), (handler_recv), (data)); \
+})
+
 /* Method: sssd.DataProvider.Backend.IsOnline */
 #define SBUS_METHOD_SYNC_sssd_DataProvider_Backend_IsOnline(handler, data) ({ \
     SBUS_CHECK_SYNC((handler), (data), const char *, bool*); \
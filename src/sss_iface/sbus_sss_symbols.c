@@ -122,6 +122,22 @@ _sbus_sss_args_sssd_DataProvider_Autofs_GetMap = {
     }
 };
 
+const struct sbus_method_arguments
+_sbus_sss_args_sssd_DataProvider_Backend_DNSCacheStats = {
+    .input = (const struct sbus_argument[]){
+        {NULL}
+    },
+    .output = (const struct sbus_argument[]){
+        {.type = "t", .name = "hits"},
+        {.type = "t", .name = "negative_hits"},
+        {.type = "t", .name = "misses"},
+        {.type = "t", .name = "prefetches"},
+        {.type = "t", .name = "evictions"},
+        {.type = "u", .name = "entries"},
+        {NULL}
+    }
+};
+
 const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Backend_IsOnline = {
     .input = (const struct sbus_argument[]){
@@ -46,6 +46,9 @@ _sbus_sss_args_sssd_DataProvider_Autofs_GetEntry;
 extern const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Autofs_GetMap;
 
+extern const struct sbus_method_arguments
+_sbus_sss_args_sssd_DataProvider_Backend_DNSCacheStats;
+
 extern const struct sbus_method_arguments
 _sbus_sss_args_sssd_DataProvider_Backend_IsOnline;
 
@@ -44,6 +44,7 @@ int main(int argc, const char *argv[])
     const char *guitar;
     const char *drums;
     int timestamp_opt;
+    int helper = 0;
 
     struct poptOption long_options[] = {
         POPT_AUTOHELP
@@ -53,6 +54,8 @@ int main(int argc, const char *argv[])
          _("Allow core dumps"), NULL },
         {"guitar", 0, POPT_ARG_STRING, &guitar, 0, _("Who plays guitar"), NULL },
         {"drums", 0, POPT_ARG_STRING, &drums, 0, _("Who plays drums"), NULL },
+        {SSS_CHILD_HELPER_OPT, 0, POPT_ARG_NONE, &helper, 0,
+         _("Serve requests until the input is closed"), NULL },
         POPT_TABLEEND
     };
 
@@ -76,6 +79,10 @@ int main(int argc, const char *argv[])
     timestamp_opt = debug_timestamps; /* save value for verification */
     DEBUG_INIT(debug_level, opt_logger);
 
+    if (helper != 0) {
+        sss_child_helper_serve("dummy_child", STDIN_FILENO, 3);
+    }
+
     action = getenv("TEST_CHILD_ACTION");
     if (action) {
         if (strcasecmp(action, "check_extra_args") == 0) {
@@ -450,6 +450,83 @@ static void echo_child_read_done(struct tevent_req *subreq)
     echo_state->child_test_ctx->test_ctx->done = true;
 }
 
+struct test_helper_echo {
+    struct sss_test_ctx *test_ctx;
+    const char *input;
+    int *pending;
+};
+
+static void test_helper_echo_done(struct tevent_req *req)
+{
+    struct test_helper_echo *echo;
+    int child_status;
+    uint8_t *buf;
+    ssize_t len;
+    errno_t ret;
+
+    echo = tevent_req_callback_data(req, struct test_helper_echo);
+
+    ret = sss_child_helper_recv(req, echo, &buf, &len, &child_status);
+    talloc_zfree(req);
+    assert_int_equal(ret, EOK);
+    assert_true(WIFEXITED(child_status));
+    assert_int_equal(WEXITSTATUS(child_status), 0);
+    assert_int_equal(len, strlen(echo->input) + 1);
+    assert_string_equal((const char *)buf, echo->input);
+
+    (*echo->pending)--;
+    if (*echo->pending == 0) {
+        echo->test_ctx->done = true;
+    }
+}
+
+static void test_helper_echo_send(struct child_test_ctx *child_tctx,
+                                  const char *input,
+                                  int *pending)
+{
+    struct test_helper_echo *echo;
+    struct tevent_req *req;
+
+    echo = talloc_zero(child_tctx, struct test_helper_echo);
+    assert_non_null(echo);
+    echo->test_ctx = child_tctx->test_ctx;
+    echo->input = input;
+    echo->pending = pending;
+
+    req = sss_child_helper_send(echo, child_tctx->test_ctx->ev,
+                                CHILD_DIR"/"TEST_BIN, NULL, 3,
+                                (uint8_t *)discard_const(input),
+                                strlen(input) + 1, 0);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_helper_echo_done, echo);
+
+    (*pending)++;
+}
+
+/* Requests sent at the same time are all answered by the same helper, which
+ * keeps running for the next ones */
+void test_child_helper_echo(void **state)
+{
+    struct child_test_ctx *child_tctx = talloc_get_type(*state,
+                                                        struct child_test_ctx);
+    int pending = 0;
+    errno_t ret;
+
+    setenv("TEST_CHILD_ACTION", "echo", 1);
+
+    test_helper_echo_send(child_tctx, ECHO_STR, &pending);
+    test_helper_echo_send(child_tctx, "Hello helper", &pending);
+
+    ret = test_ev_loop(child_tctx->test_ctx);
+    assert_int_equal(ret, EOK);
+
+    child_tctx->test_ctx->done = false;
+    test_helper_echo_send(child_tctx, "Hello again", &pending);
+
+    ret = test_ev_loop(child_tctx->test_ctx);
+    assert_int_equal(ret, EOK);
+}
+
 void sss_child_cb(int pid, int wait_status, void *pvt);
 
 /* Just make sure the exec works. The child does nothing but exits */
@@ -530,6 +607,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_sss_child,
                                         child_test_setup,
                                         child_test_teardown),
+        cmocka_unit_test_setup_teardown(test_child_helper_echo,
+                                        child_test_setup,
+                                        child_test_teardown),
         cmocka_unit_test_setup_teardown(test_exec_child_only_extra_args,
                                         only_extra_args_setup,
                                         only_extra_args_teardown),
@@ -0,0 +1,363 @@
+/*
+    SSSD
+
+    Tests: Reuse of the HBAC rules converted from the cache
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+
+/* In order to access opaque types */
+#include "providers/ipa/ipa_access.c"
+
+#include "providers/ipa/ipa_opts.h"
+#include "tests/cmocka/common_mock.h"
+#include "tests/cmocka/common_mock_be.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_ipa_hbac_rule_set_conf.ldb"
+#define TEST_DOM_NAME "ipa.test"
+#define TEST_ID_PROVIDER "ipa"
+
+#define TEST_RULE_NAME "allow_users"
+#define TEST_RULE_ID "6f0a5e2c-0b4e-11e6-9a4b-525400e7bf2a"
+#define TEST_RULE_DN "ipaUniqueID="TEST_RULE_ID",cn=hbac,dc=ipa,dc=test"
+
+#define TEST_USER1 "user1"
+#define TEST_USER1_DN "uid=user1,cn=users,cn=accounts,dc=ipa,dc=test"
+#define TEST_USER2 "user2"
+#define TEST_USER2_DN "uid=user2,cn=users,cn=accounts,dc=ipa,dc=test"
+
+/* Not needed by the tests, avoids linking the whole IPA provider */
+errno_t ipa_get_host_attrs(struct dp_option *ipa_options,
+                           size_t host_count,
+                           struct sysdb_attrs **hosts,
+                           struct sysdb_attrs **_ipa_host)
+{
+    return ENOENT;
+}
+
+struct hbac_rule_set_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct be_ctx *be_ctx;
+    struct ipa_access_ctx *access_ctx;
+    struct pam_data *pd;
+};
+
+static int test_hbac_rule_set_setup(void **state)
+{
+    struct hbac_rule_set_test_ctx *test_ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct hbac_rule_set_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->be_ctx = mock_be_ctx(test_ctx, test_ctx->tctx);
+    assert_non_null(test_ctx->be_ctx);
+
+    test_ctx->access_ctx = talloc_zero(test_ctx, struct ipa_access_ctx);
+    assert_non_null(test_ctx->access_ctx);
+
+    ret = dp_copy_defaults(test_ctx->access_ctx, ipa_basic_opts,
+                           IPA_OPTS_BASIC, &test_ctx->access_ctx->ipa_options);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->pd = talloc_zero(test_ctx, struct pam_data);
+    assert_non_null(test_ctx->pd);
+    test_ctx->pd->domain = test_ctx->tctx->dom->name;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_hbac_rule_set_teardown(void **state)
+{
+    struct hbac_rule_set_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct hbac_rule_set_test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void store_user(struct hbac_rule_set_test_ctx *test_ctx,
+                       const char *name, uid_t uid, const char *orig_dn)
+{
+    struct sysdb_attrs *attrs;
+    char *fqname;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_DN, orig_dn);
+    assert_int_equal(ret, EOK);
+
+    fqname = sss_create_internal_fqname(attrs, name,
+                                        test_ctx->tctx->dom->name);
+    assert_non_null(fqname);
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, fqname, NULL, uid, uid,
+                           NULL, NULL, NULL, orig_dn, attrs, NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+/* Stores the rule as a refresh does and sets the generation of the
+ * stored data */
+static void store_rule(struct hbac_rule_set_test_ctx *test_ctx,
+                       const char *usn, const char **member_users)
+{
+    struct ipa_common_entries hosts = { 0 };
+    struct ipa_common_entries services = { 0 };
+    struct ipa_common_entries rules = { 0 };
+    struct sysdb_attrs *rule;
+    errno_t ret;
+    int i;
+
+    rule = sysdb_new_attrs(test_ctx);
+    assert_non_null(rule);
+
+    ret = sysdb_attrs_add_string(rule, SYSDB_OBJECTCLASS, IPA_HBAC_RULE);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_CN, TEST_RULE_NAME);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, SYSDB_ORIG_DN, TEST_RULE_DN);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_UNIQUE_ID, TEST_RULE_ID);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_ENABLED_FLAG, "TRUE");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_ACCESS_RULE_TYPE, IPA_HBAC_ALLOW);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_SERVICE_CATEGORY, "all");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_HOST_CATEGORY, "all");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(rule, IPA_ENTRY_USN, usn);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; member_users[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(rule, IPA_MEMBER_USER, member_users[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_store_custom(test_ctx->tctx->dom, TEST_RULE_ID,
+                             HBAC_RULES_SUBDIR, rule);
+    assert_int_equal(ret, EOK);
+
+    rules.entry_count = 1;
+    rules.entries = &rule;
+    ipa_hbac_set_generation(test_ctx->access_ctx,
+                            ipa_hbac_generation(&hosts, &services, &rules));
+
+    talloc_free(rule);
+}
+
+static struct ipa_hbac_rule_set *
+get_rule_set(struct hbac_rule_set_test_ctx *test_ctx, const char *user)
+{
+    struct hbac_ctx hbac_ctx = { 0 };
+    struct ipa_hbac_rule_set *rule_set = NULL;
+    errno_t ret;
+
+    talloc_zfree(test_ctx->pd->user);
+    test_ctx->pd->user = sss_create_internal_fqname(test_ctx->pd, user,
+                                                test_ctx->tctx->dom->name);
+    assert_non_null(test_ctx->pd->user);
+
+    hbac_ctx.be_ctx = test_ctx->be_ctx;
+    hbac_ctx.ipa_options = test_ctx->access_ctx->ipa_options;
+    hbac_ctx.pd = test_ctx->pd;
+
+    ret = ipa_hbac_get_rule_set(test_ctx->access_ctx, &hbac_ctx, &rule_set);
+    assert_int_equal(ret, EOK);
+    assert_non_null(rule_set);
+    assert_ptr_equal(rule_set, test_ctx->access_ctx->hbac_rule_set);
+    assert_non_null(rule_set->rules[0]);
+    assert_null(rule_set->rules[1]);
+
+    return rule_set;
+}
+
+static bool rule_set_has_user(struct ipa_hbac_rule_set *rule_set,
+                              const char *name)
+{
+    const char **names = rule_set->rules[0]->users->names;
+    int i;
+
+    for (i = 0; names[i] != NULL; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void test_hbac_rule_set_reused(void **state)
+{
+    struct hbac_rule_set_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct hbac_rule_set_test_ctx);
+    const char *members[] = { TEST_USER1_DN, NULL };
+    struct ipa_hbac_rule_set *rule_set;
+
+    store_user(test_ctx, TEST_USER1, 10001, TEST_USER1_DN);
+    store_rule(test_ctx, "1", members);
+
+    rule_set = get_rule_set(test_ctx, TEST_USER1);
+    assert_true(rule_set_has_user(rule_set, TEST_USER1));
+    assert_int_equal(rule_set->num_unresolved, 0);
+
+    /* The same generation returns the same converted rules */
+    assert_ptr_equal(get_rule_set(test_ctx, TEST_USER1), rule_set);
+
+    /* A refresh which stores unchanged rules keeps them as well */
+    store_rule(test_ctx, "1", members);
+    assert_ptr_equal(test_ctx->access_ctx->hbac_rule_set, rule_set);
+    assert_ptr_equal(get_rule_set(test_ctx, TEST_USER1), rule_set);
+}
+
+static void test_hbac_rule_set_usn_changed(void **state)
+{
+    struct hbac_rule_set_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct hbac_rule_set_test_ctx);
+    const char *members[] = { TEST_USER1_DN, NULL };
+    const char *new_members[] = { TEST_USER1_DN, TEST_USER2_DN, NULL };
+    struct ipa_hbac_rule_set *rule_set;
+    uint64_t generation;
+
+    store_user(test_ctx, TEST_USER1, 10001, TEST_USER1_DN);
+    store_user(test_ctx, TEST_USER2, 10002, TEST_USER2_DN);
+    store_rule(test_ctx, "1", members);
+    generation = test_ctx->access_ctx->hbac_generation;
+
+    rule_set = get_rule_set(test_ctx, TEST_USER1);
+    assert_true(rule_set_has_user(rule_set, TEST_USER1));
+    assert_false(rule_set_has_user(rule_set, TEST_USER2));
+
+    /* A new member changes the entryUSN of the rule */
+    store_rule(test_ctx, "2", new_members);
+    assert_true(test_ctx->access_ctx->hbac_generation != generation);
+    assert_null(test_ctx->access_ctx->hbac_rule_set);
+
+    rule_set = get_rule_set(test_ctx, TEST_USER1);
+    assert_int_equal(rule_set->generation,
+                     test_ctx->access_ctx->hbac_generation);
+    assert_true(rule_set_has_user(rule_set, TEST_USER1));
+    assert_true(rule_set_has_user(rule_set, TEST_USER2));
+}
+
+static void test_hbac_rule_set_unresolved_user(void **state)
+{
+    struct hbac_rule_set_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct hbac_rule_set_test_ctx);
+    const char *members[] = { TEST_USER1_DN, TEST_USER2_DN, NULL };
+    struct ipa_hbac_rule_set *rule_set;
+
+    /* user2 is not cached when the rules are converted */
+    store_user(test_ctx, TEST_USER1, 10001, TEST_USER1_DN);
+    store_rule(test_ctx, "1", members);
+
+    rule_set = get_rule_set(test_ctx, TEST_USER1);
+    assert_true(rule_set_has_user(rule_set, TEST_USER1));
+    assert_false(rule_set_has_user(rule_set, TEST_USER2));
+    assert_int_equal(rule_set->num_unresolved, 1);
+
+    /* user1 is in the rules, they are reused */
+    assert_ptr_equal(get_rule_set(test_ctx, TEST_USER1), rule_set);
+
+    /* user2 logs in and is cached now, the rules are converted again */
+    store_user(test_ctx, TEST_USER2, 10002, TEST_USER2_DN);
+
+    rule_set = get_rule_set(test_ctx, TEST_USER2);
+    assert_true(rule_set_has_user(rule_set, TEST_USER1));
+    assert_true(rule_set_has_user(rule_set, TEST_USER2));
+    assert_int_equal(rule_set->num_unresolved, 0);
+
+    /* Nothing is missing any more */
+    assert_ptr_equal(get_rule_set(test_ctx, TEST_USER2), rule_set);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+          _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_hbac_rule_set_reused,
+                                        test_hbac_rule_set_setup,
+                                        test_hbac_rule_set_teardown),
+        cmocka_unit_test_setup_teardown(test_hbac_rule_set_usn_changed,
+                                        test_hbac_rule_set_setup,
+                                        test_hbac_rule_set_teardown),
+        cmocka_unit_test_setup_teardown(test_hbac_rule_set_unresolved_user,
+                                        test_hbac_rule_set_setup,
+                                        test_hbac_rule_set_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old DB to be sure */
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+    if (rv == 0 && !no_cleanup) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+
+    return rv;
+}
@@ -0,0 +1,372 @@
+/*
+    SSSD
+
+    Tests: KCM write-back ccache tier
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "util/util_creds.h"
+#include "tests/cmocka/common_mock.h"
+#include "responder/kcm/kcmsrv_ccache.h"
+#include "responder/kcm/kcmsrv_ccache_be.h"
+#include "responder/kcm/kcmsrv_ccache_pvt.h"
+
+/* The memory back end stands in for the secdb back end */
+const struct kcm_ccdb_ops ccdb_secdb_ops;
+
+#define TEST_WINDOW 1
+#define TEST_MAX_UIDS 8
+
+#define TEST_UID    1000
+#define TEST_NAME   "1000:1"
+#define TEST_UID2   1001
+#define TEST_NAME2  "1001:1"
+#define TEST_UID3   1002
+#define TEST_NAME3  "1002:1"
+
+struct wb_test_ctx {
+    struct tevent_context *ev;
+    struct kcm_ccdb *store;
+    struct kcm_ccdb *db;
+};
+
+static struct kcm_ccdb *test_ccdb_new(struct wb_test_ctx *test_ctx,
+                                      const struct kcm_ccdb_ops *ops)
+{
+    struct kcm_ccdb *ccdb;
+
+    ccdb = talloc_zero(test_ctx, struct kcm_ccdb);
+    assert_non_null(ccdb);
+    ccdb->ev = test_ctx->ev;
+    ccdb->ops = ops;
+
+    return ccdb;
+}
+
+static void setup_wb(struct wb_test_ctx *test_ctx, size_t max_uids)
+{
+    errno_t ret;
+
+    test_ctx->db = test_ccdb_new(test_ctx, &ccdb_wb_ops);
+    ret = ccdb_wb_setup(test_ctx->db, test_ctx->store, TEST_WINDOW, max_uids);
+    assert_int_equal(ret, EOK);
+}
+
+static int setup_kcm_ccache_wb(void **state)
+{
+    struct wb_test_ctx *test_ctx;
+    errno_t ret;
+
+    test_ctx = talloc_zero(NULL, struct wb_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->store = test_ccdb_new(test_ctx, &ccdb_mem_ops);
+    ret = test_ctx->store->ops->init(test_ctx->store, NULL, NULL);
+    assert_int_equal(ret, EOK);
+
+    setup_wb(test_ctx, TEST_MAX_UIDS);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int teardown_kcm_ccache_wb(void **state)
+{
+    struct wb_test_ctx *test_ctx = talloc_get_type(*state,
+                                                   struct wb_test_ctx);
+
+    /* The tier writes to the store when it is freed */
+    talloc_free(test_ctx->db);
+    talloc_free(test_ctx);
+    return 0;
+}
+
+static void test_client(struct cli_creds *client, uid_t uid)
+{
+    memset(client, 0, sizeof(struct cli_creds));
+    client->ucred.uid = uid;
+    client->ucred.gid = uid;
+}
+
+static void test_done(struct tevent_context *ev,
+                      struct tevent_timer *te,
+                      struct timeval current_time,
+                      void *pvt)
+{
+    bool *done = (bool *) pvt;
+
+    *done = true;
+}
+
+/* Runs the event loop until the write-back window has passed */
+static void wait_for_flush(struct wb_test_ctx *test_ctx)
+{
+    struct tevent_timer *te;
+    bool done = false;
+
+    te = tevent_add_timer(test_ctx->ev, test_ctx,
+                          tevent_timeval_current_ofs(TEST_WINDOW + 1, 0),
+                          test_done, &done);
+    assert_non_null(te);
+
+    while (!done) {
+        tevent_loop_once(test_ctx->ev);
+    }
+}
+
+static void create_cc(struct wb_test_ctx *test_ctx,
+                      struct kcm_ccdb *db,
+                      uid_t uid,
+                      const char *name,
+                      uuid_t _uuid)
+{
+    struct cli_creds client;
+    struct kcm_ccache *cc;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_client(&client, uid);
+
+    ret = kcm_cc_new(test_ctx, NULL, &client, name, NULL, &cc);
+    assert_int_equal(ret, EOK);
+    uuid_copy(_uuid, cc->uuid);
+
+    req = kcm_ccdb_create_cc_send(test_ctx, test_ctx->ev, db, &client, cc);
+    assert_non_null(req);
+    assert_true(tevent_req_poll(req, test_ctx->ev));
+    ret = kcm_ccdb_create_cc_recv(req);
+    assert_int_equal(ret, EOK);
+    talloc_free(req);
+}
+
+static struct kcm_ccache *get_cc(struct wb_test_ctx *test_ctx,
+                                 struct kcm_ccdb *db,
+                                 uid_t uid,
+                                 const char *name)
+{
+    struct cli_creds client;
+    struct kcm_ccache *cc;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_client(&client, uid);
+
+    req = kcm_ccdb_getbyname_send(test_ctx, test_ctx->ev, db, &client, name);
+    assert_non_null(req);
+    assert_true(tevent_req_poll(req, test_ctx->ev));
+    ret = kcm_ccdb_getbyname_recv(req, test_ctx, &cc);
+    assert_int_equal(ret, EOK);
+    talloc_free(req);
+
+    return cc;
+}
+
+static void mod_cc(struct wb_test_ctx *test_ctx,
+                   struct kcm_ccdb *db,
+                   uid_t uid,
+                   uuid_t uuid,
+                   int32_t kdc_offset)
+{
+    struct cli_creds client;
+    struct kcm_mod_ctx *mod_ctx;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_client(&client, uid);
+
+    mod_ctx = kcm_mod_ctx_new(test_ctx);
+    assert_non_null(mod_ctx);
+    mod_ctx->kdc_offset = kdc_offset;
+
+    req = kcm_ccdb_mod_cc_send(test_ctx, test_ctx->ev, db, &client,
+                               uuid, mod_ctx);
+    assert_non_null(req);
+    assert_true(tevent_req_poll(req, test_ctx->ev));
+    ret = kcm_ccdb_mod_cc_recv(req);
+    assert_int_equal(ret, EOK);
+    talloc_free(req);
+    talloc_free(mod_ctx);
+}
+
+static void delete_cc(struct wb_test_ctx *test_ctx,
+                      struct kcm_ccdb *db,
+                      uid_t uid,
+                      uuid_t uuid)
+{
+    struct cli_creds client;
+    struct tevent_req *req;
+    errno_t ret;
+
+    test_client(&client, uid);
+
+    req = kcm_ccdb_delete_cc_send(test_ctx, test_ctx->ev, db, &client, uuid);
+    assert_non_null(req);
+    assert_true(tevent_req_poll(req, test_ctx->ev));
+    ret = kcm_ccdb_delete_cc_recv(req);
+    assert_int_equal(ret, EOK);
+    talloc_free(req);
+}
+
+static void test_kcm_ccache_wb_write_back(void **state)
+{
+    struct wb_test_ctx *test_ctx = talloc_get_type(*state,
+                                                   struct wb_test_ctx);
+    struct kcm_ccache *cc;
+    uuid_t uuid;
+
+    create_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME, uuid);
+
+    /* Served from memory, not written yet */
+    cc = get_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME);
+    assert_non_null(cc);
+    assert_null(get_cc(test_ctx, test_ctx->store, TEST_UID, TEST_NAME));
+
+    mod_cc(test_ctx, test_ctx->db, TEST_UID, uuid, 42);
+
+    wait_for_flush(test_ctx);
+
+    cc = get_cc(test_ctx, test_ctx->store, TEST_UID, TEST_NAME);
+    assert_non_null(cc);
+    assert_int_equal(kcm_cc_get_offset(cc), 42);
+}
+
+static void test_kcm_ccache_wb_read_memory(void **state)
+{
+    struct wb_test_ctx *test_ctx = talloc_get_type(*state,
+                                                   struct wb_test_ctx);
+    struct kcm_ccache *cc;
+    uuid_t uuid;
+
+    create_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME, uuid);
+    wait_for_flush(test_ctx);
+
+    /* A change behind the back of the tier is not seen, the ccache
+     * is not read from the store again */
+    mod_cc(test_ctx, test_ctx->store, TEST_UID, uuid, 42);
+
+    cc = get_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME);
+    assert_non_null(cc);
+    assert_int_equal(kcm_cc_get_offset(cc), 0);
+}
+
+static void test_kcm_ccache_wb_coalesce(void **state)
+{
+    struct wb_test_ctx *test_ctx = talloc_get_type(*state,
+                                                   struct wb_test_ctx);
+    uuid_t uuid;
+    uuid_t uuid2;
+
+    create_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME, uuid);
+    mod_cc(test_ctx, test_ctx->db, TEST_UID, uuid, 42);
+    delete_cc(test_ctx, test_ctx->db, TEST_UID, uuid);
+
+    create_cc(test_ctx, test_ctx->db, TEST_UID2, TEST_NAME2, uuid2);
+
+    /* Freeing the tier writes the pending changes at once. The deleted
+     * ccache never reaches the store, the mod would fail otherwise. */
+    talloc_zfree(test_ctx->db);
+
+    assert_null(get_cc(test_ctx, test_ctx->store, TEST_UID, TEST_NAME));
+    assert_non_null(get_cc(test_ctx, test_ctx->store, TEST_UID2, TEST_NAME2));
+
+    /* A fresh tier reads the ccaches from the store */
+    setup_wb(test_ctx, TEST_MAX_UIDS);
+    assert_null(get_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME));
+    assert_non_null(get_cc(test_ctx, test_ctx->db, TEST_UID2, TEST_NAME2));
+}
+
+static void test_kcm_ccache_wb_evict(void **state)
+{
+    struct wb_test_ctx *test_ctx = talloc_get_type(*state,
+                                                   struct wb_test_ctx);
+    struct kcm_ccache *cc;
+    uuid_t uuid;
+    uuid_t uuid2;
+
+    talloc_zfree(test_ctx->db);
+    setup_wb(test_ctx, 1);
+
+    create_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME, uuid);
+    /* The first user still has a pending change and is not evicted */
+    create_cc(test_ctx, test_ctx->db, TEST_UID2, TEST_NAME2, uuid2);
+    wait_for_flush(test_ctx);
+
+    mod_cc(test_ctx, test_ctx->store, TEST_UID, uuid, 42);
+
+    /* Loading a third user drops the least recently used one, which is
+     * read from the store on its next operation */
+    assert_null(get_cc(test_ctx, test_ctx->db, TEST_UID3, TEST_NAME3));
+
+    cc = get_cc(test_ctx, test_ctx->db, TEST_UID, TEST_NAME);
+    assert_non_null(cc);
+    assert_int_equal(kcm_cc_get_offset(cc), 42);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    int rv;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_kcm_ccache_wb_write_back,
+                                        setup_kcm_ccache_wb,
+                                        teardown_kcm_ccache_wb),
+        cmocka_unit_test_setup_teardown(test_kcm_ccache_wb_read_memory,
+                                        setup_kcm_ccache_wb,
+                                        teardown_kcm_ccache_wb),
+        cmocka_unit_test_setup_teardown(test_kcm_ccache_wb_coalesce,
+                                        setup_kcm_ccache_wb,
+                                        teardown_kcm_ccache_wb),
+        cmocka_unit_test_setup_teardown(test_kcm_ccache_wb_evict,
+                                        setup_kcm_ccache_wb,
+                                        teardown_kcm_ccache_wb),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    return rv;
+}
@@ -40,6 +40,7 @@
 
 const struct kcm_ccdb_ops ccdb_mem_ops;
 const struct kcm_ccdb_ops ccdb_secdb_ops;
+const struct kcm_ccdb_ops ccdb_wb_ops;
 
 struct kcm_marshalling_test_ctx {
     krb5_context kctx;
@@ -205,6 +206,90 @@ static void test_kcm_ccache_marshall_unmarshall_binary(void **state)
     assert_int_equal(ret, EINVAL);
 }
 
+static void test_kcm_ccache_header_and_cred_binary(void **state)
+{
+    struct kcm_marshalling_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_marshalling_test_ctx);
+    errno_t ret;
+    struct cli_creds owner;
+    struct kcm_ccache *cc;
+    struct kcm_ccache *cc2;
+    struct kcm_cred *crd;
+    struct kcm_cred *crd2;
+    struct sss_iobuf *cred_blob;
+    struct sss_iobuf *payload;
+    struct sss_iobuf *blob2;
+    char uuid_str[UUID_STR_SIZE];
+    const char *name;
+    const char *key;
+    uuid_t uuid;
+    uuid_t uuid2;
+
+    owner.ucred.uid = getuid();
+    owner.ucred.gid = getuid();
+
+    name = talloc_asprintf(test_ctx, "%"SPRIuid, getuid());
+    assert_non_null(name);
+
+    ret = kcm_cc_new(test_ctx,
+                     test_ctx->kctx,
+                     &owner,
+                     name,
+                     test_ctx->princ,
+                     &cc);
+    assert_int_equal(ret, EOK);
+
+    cred_blob = sss_iobuf_init_readonly(cc, (const uint8_t *)TEST_CREDS,
+                                        sizeof(TEST_CREDS));
+    assert_non_null(cred_blob);
+
+    ret = kcm_cc_store_cred_blob(cc, cred_blob);
+    assert_int_equal(ret, EOK);
+
+    crd = kcm_cc_get_cred(cc);
+    assert_non_null(crd);
+
+    /* The header does not carry the credentials */
+    ret = kcm_ccache_header_to_sec_input_binary(test_ctx, cc, &payload);
+    assert_int_equal(ret, EOK);
+
+    ret = kcm_cc_get_uuid(cc, uuid);
+    assert_int_equal(ret, EOK);
+    key = sec_key_create(test_ctx, name, uuid);
+    assert_non_null(key);
+
+    sss_iobuf_cursor_reset(payload);
+    ret = sec_kv_to_ccache_binary(test_ctx, key, payload, &owner, &cc2);
+    assert_int_equal(ret, EOK);
+
+    assert_cc_equal(cc, cc2);
+    assert_null(kcm_cc_get_cred(cc2));
+
+    /* The credential round-trips on its own */
+    ret = kcm_cred_to_sec_input_binary(test_ctx, crd, &payload);
+    assert_int_equal(ret, EOK);
+
+    sss_iobuf_cursor_reset(payload);
+    ret = sec_value_to_kcm_cred_binary(test_ctx, payload, &crd2);
+    assert_int_equal(ret, EOK);
+
+    ret = kcm_cred_get_uuid(crd, uuid);
+    assert_int_equal(ret, EOK);
+    ret = kcm_cred_get_uuid(crd2, uuid2);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(uuid_compare(uuid, uuid2), 0);
+    blob2 = kcm_cred_get_creds(crd2);
+    assert_int_equal(sss_iobuf_get_size(blob2), sizeof(TEST_CREDS));
+    assert_memory_equal(sss_iobuf_get_data(blob2), TEST_CREDS,
+                        sizeof(TEST_CREDS));
+
+    /* Credentials that are not Kerberos tickets are keyed by their UUID */
+    ret = kcm_cred_get_key(test_ctx, test_ctx->kctx, crd2, &key);
+    assert_int_equal(ret, EOK);
+    uuid_unparse(uuid, uuid_str);
+    assert_string_equal(key, uuid_str);
+}
+
 static void test_kcm_ccache_no_princ_binary(void **state)
 {
     struct kcm_marshalling_test_ctx *test_ctx = talloc_get_type(*state,
@@ -331,6 +416,9 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_kcm_ccache_no_princ_binary,
                                         setup_kcm_marshalling,
                                         teardown_kcm_marshalling),
+        cmocka_unit_test_setup_teardown(test_kcm_ccache_header_and_cred_binary,
+                                        setup_kcm_marshalling,
+                                        teardown_kcm_marshalling),
         cmocka_unit_test(test_sec_key_get_uuid),
         cmocka_unit_test(test_sec_key_get_name),
         cmocka_unit_test(test_sec_key_match_name),
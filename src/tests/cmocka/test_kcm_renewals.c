@@ -49,6 +49,7 @@ errno_t kcm_renew_all_tgts(TALLOC_CTX *mem_ctx,
 
 const struct kcm_ccdb_ops ccdb_mem_ops;
 const struct kcm_ccdb_ops ccdb_secdb_ops;
+const struct kcm_ccdb_ops ccdb_wb_ops;
 
 struct test_ctx {
     struct krb5_ctx *krb5_ctx;
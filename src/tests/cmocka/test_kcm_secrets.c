@@ -0,0 +1,322 @@
+/*
+    SSSD
+
+    Tests: KCM secrets database records
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <popt.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "tests/cmocka/common_mock.h"
+#include "responder/kcm/secrets/secrets.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_DB_FULL_PATH  TESTS_PATH "/secrets.ldb"
+
+#define TEST_CONTAINER_URL "persistent/1000/ccache/"
+#define TEST_SECRET_URL    TEST_CONTAINER_URL "cc"
+#define TEST_HEADER        "header"
+
+/* 1 KiB */
+#define TEST_MAX_PAYLOAD   1
+
+errno_t sss_sec_init_with_path(TALLOC_CTX *mem_ctx,
+                               struct sss_sec_quota *quota,
+                               const char *dbpath,
+                               struct sss_sec_ctx **_sec_ctx);
+
+struct kcm_secrets_test_ctx {
+    struct sss_sec_quota quota;
+    struct sss_sec_ctx *sctx;
+    struct sss_sec_req *sreq;
+};
+
+static struct sss_sec_req *test_req(struct kcm_secrets_test_ctx *test_ctx,
+                                    const char *url)
+{
+    struct sss_sec_req *sreq;
+    errno_t ret;
+
+    ret = sss_sec_new_req(test_ctx, test_ctx->sctx, url, 0, &sreq);
+    assert_int_equal(ret, EOK);
+
+    return sreq;
+}
+
+static int setup_kcm_secrets(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx;
+    int fd;
+    errno_t ret;
+
+    test_ctx = talloc_zero(NULL, struct kcm_secrets_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->quota.max_payload_size = TEST_MAX_PAYLOAD;
+
+    ret = mkdir(TESTS_PATH, 0700);
+    assert_int_equal(ret, 0);
+
+    fd = open(TEST_DB_FULL_PATH, O_CREAT|O_EXCL|O_WRONLY, 0600);
+    assert_true(fd >= 0);
+    close(fd);
+
+    ret = sss_sec_init_with_path(test_ctx, &test_ctx->quota,
+                                 TEST_DB_FULL_PATH, &test_ctx->sctx);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_sec_create_container(test_req(test_ctx, TEST_CONTAINER_URL));
+    assert_int_equal(ret, EOK);
+
+    test_ctx->sreq = test_req(test_ctx, TEST_SECRET_URL);
+    ret = sss_sec_put(test_ctx->sreq, (uint8_t *)discard_const(TEST_HEADER),
+                      sizeof(TEST_HEADER));
+    assert_int_equal(ret, EOK);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int teardown_kcm_secrets(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_secrets_test_ctx);
+
+    talloc_free(test_ctx);
+    unlink(TEST_DB_FULL_PATH);
+    rmdir(TESTS_PATH);
+    return 0;
+}
+
+static errno_t put_record(struct sss_sec_req *sreq,
+                          const char *key,
+                          const char *data)
+{
+    struct sss_sec_record record;
+
+    record.key = key;
+    record.data = (uint8_t *)discard_const(data);
+    record.len = strlen(data) + 1;
+
+    return sss_sec_put_records(sreq, NULL, 0, &record, 1);
+}
+
+static void assert_records(struct kcm_secrets_test_ctx *test_ctx,
+                           const char **expected)
+{
+    struct sss_sec_record *records;
+    size_t num_records;
+    size_t i;
+    errno_t ret;
+
+    ret = sss_sec_get_records(test_ctx, test_ctx->sreq,
+                              &records, &num_records);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; expected[i] != NULL; i++) {
+        assert_true(i < num_records);
+        assert_string_equal((const char *)records[i].data, expected[i]);
+    }
+    assert_int_equal(num_records, i);
+
+    talloc_free(records);
+}
+
+static void assert_header(struct kcm_secrets_test_ctx *test_ctx,
+                          const char *expected)
+{
+    uint8_t *secret;
+    size_t secret_len;
+    errno_t ret;
+
+    ret = sss_sec_get(test_ctx, test_ctx->sreq, &secret, &secret_len);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(secret_len, strlen(expected) + 1);
+    assert_string_equal((const char *)secret, expected);
+
+    talloc_free(secret);
+}
+
+static void test_kcm_secrets_records_append(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_secrets_test_ctx);
+    const char *first[] = { "tgt", NULL };
+    const char *appended[] = { "tgt", "http", NULL };
+    const char *replaced[] = { "http", "tgt2", NULL };
+    char **keys;
+    size_t num_keys;
+    errno_t ret;
+
+    ret = put_record(test_ctx->sreq, "krbtgt", "tgt");
+    assert_int_equal(ret, EOK);
+    assert_records(test_ctx, first);
+
+    ret = put_record(test_ctx->sreq, "HTTP", "http");
+    assert_int_equal(ret, EOK);
+    assert_records(test_ctx, appended);
+
+    /* A record with the same key is replaced and becomes the newest one */
+    ret = put_record(test_ctx->sreq, "krbtgt", "tgt2");
+    assert_int_equal(ret, EOK);
+    assert_records(test_ctx, replaced);
+
+    /* The secret itself is kept and the records are not listed as secrets */
+    assert_header(test_ctx, TEST_HEADER);
+
+    ret = sss_sec_list(test_ctx, test_req(test_ctx, TEST_CONTAINER_URL),
+                       &keys, &num_keys);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(num_keys, 1);
+    assert_string_equal(keys[0], "cc");
+}
+
+static void test_kcm_secrets_records_secret(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_secrets_test_ctx);
+    const char *expected[] = { "tgt", NULL };
+    struct sss_sec_record record;
+    const char *header = "new header";
+    errno_t ret;
+
+    record.key = "krbtgt";
+    record.data = (uint8_t *)discard_const("tgt");
+    record.len = sizeof("tgt");
+
+    ret = sss_sec_put_records(test_ctx->sreq,
+                              (uint8_t *)discard_const(header),
+                              strlen(header) + 1, &record, 1);
+    assert_int_equal(ret, EOK);
+
+    assert_header(test_ctx, header);
+    assert_records(test_ctx, expected);
+}
+
+static void test_kcm_secrets_records_quota(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_secrets_test_ctx);
+    const char *expected[] = { NULL, NULL };
+    char *data;
+    errno_t ret;
+
+    data = talloc_zero_array(test_ctx, char, TEST_MAX_PAYLOAD * 1024 / 2);
+    assert_non_null(data);
+    memset(data, 'a', TEST_MAX_PAYLOAD * 1024 / 2 - 1);
+    expected[0] = data;
+
+    ret = put_record(test_ctx->sreq, "first", data);
+    assert_int_equal(ret, EOK);
+
+    /* Two records together with the secret exceed the quota, the whole
+     * write is discarded */
+    ret = put_record(test_ctx->sreq, "second", data);
+    assert_int_equal(ret, ERR_SEC_PAYLOAD_SIZE_IS_TOO_LARGE);
+    assert_records(test_ctx, expected);
+
+    /* Replacing a record does not count it twice */
+    ret = put_record(test_ctx->sreq, "first", data);
+    assert_int_equal(ret, EOK);
+    assert_records(test_ctx, expected);
+}
+
+static void test_kcm_secrets_records_delete(void **state)
+{
+    struct kcm_secrets_test_ctx *test_ctx = talloc_get_type(*state,
+                                        struct kcm_secrets_test_ctx);
+    struct sss_sec_record *records;
+    size_t num_records;
+    errno_t ret;
+
+    ret = put_record(test_ctx->sreq, "krbtgt", "tgt");
+    assert_int_equal(ret, EOK);
+
+    /* The records are deleted together with their secret */
+    ret = sss_sec_delete(test_ctx->sreq);
+    assert_int_equal(ret, EOK);
+
+    ret = sss_sec_get_records(test_ctx, test_ctx->sreq,
+                              &records, &num_records);
+    assert_int_equal(ret, ENOENT);
+
+    /* Records can only be stored below an existing secret */
+    ret = put_record(test_ctx->sreq, "krbtgt", "tgt");
+    assert_int_equal(ret, ENOENT);
+
+    /* The container is empty again */
+    ret = sss_sec_delete(test_req(test_ctx, TEST_CONTAINER_URL));
+    assert_int_equal(ret, EOK);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    int rv;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_kcm_secrets_records_append,
+                                        setup_kcm_secrets,
+                                        teardown_kcm_secrets),
+        cmocka_unit_test_setup_teardown(test_kcm_secrets_records_secret,
+                                        setup_kcm_secrets,
+                                        teardown_kcm_secrets),
+        cmocka_unit_test_setup_teardown(test_kcm_secrets_records_quota,
+                                        setup_kcm_secrets,
+                                        teardown_kcm_secrets),
+        cmocka_unit_test_setup_teardown(test_kcm_secrets_records_delete,
+                                        setup_kcm_secrets,
+                                        teardown_kcm_secrets),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    /* Even though normally the tests should clean up after themselves
+     * they might not after a failed run. Remove the old DB to be sure */
+    tests_set_cwd();
+    unlink(TEST_DB_FULL_PATH);
+    rmdir(TESTS_PATH);
+
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    return rv;
+}
@@ -0,0 +1,378 @@
+/*
+    SSSD
+
+    Tests: Kerberos TGT renewal scheduler
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "providers/krb5/krb5_renew_sched.h"
+#include "tests/cmocka/common_mock.h"
+
+#define TEST_MAX_CONCURRENT 2
+#define TEST_RENEWALS_PER_REALM 10
+
+struct test_renew_ctx {
+    struct sss_test_ctx *tctx;
+    struct krb5_renew_sched *sched;
+
+    int running_a;
+    int running_b;
+    int started;
+    int finished;
+    int expected;
+    int retries;
+
+    /* Key to add again while its renewal is running */
+    const char *readd_key;
+};
+
+struct test_renew_state {
+    struct test_renew_ctx *test_ctx;
+    const char *realm;
+};
+
+static void test_renew_timeout(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval tv,
+                               void *pvt)
+{
+    struct tevent_req *req = talloc_get_type(pvt, struct tevent_req);
+
+    tevent_req_done(req);
+}
+
+static int *test_renew_running(struct test_renew_ctx *test_ctx,
+                               const char *realm)
+{
+    return strcmp(realm, "A") == 0 ? &test_ctx->running_a
+                                   : &test_ctx->running_b;
+}
+
+static struct tevent_req *test_renew_send(TALLOC_CTX *mem_ctx,
+                                          struct tevent_context *ev,
+                                          const char *key,
+                                          void *data,
+                                          void *pvt)
+{
+    struct test_renew_ctx *test_ctx;
+    struct test_renew_state *state;
+    struct tevent_req *req;
+    struct tevent_timer *te;
+    int *running;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(pvt, struct test_renew_ctx);
+
+    req = tevent_req_create(mem_ctx, &state, struct test_renew_state);
+    assert_non_null(req);
+
+    state->test_ctx = test_ctx;
+    state->realm = talloc_get_type(data, char);
+    assert_non_null(state->realm);
+
+    running = test_renew_running(test_ctx, state->realm);
+    (*running)++;
+    assert_true(*running <= TEST_MAX_CONCURRENT);
+    test_ctx->started++;
+
+    if (test_ctx->readd_key != NULL && strcmp(key, test_ctx->readd_key) == 0) {
+        ret = krb5_renew_sched_add(test_ctx->sched, key, "user@A",
+                                   time(NULL) + 3600, time(NULL) + 7200,
+                                   talloc_strdup(NULL, "A"));
+        assert_int_equal(ret, EOK);
+    }
+
+    te = tevent_add_timer(ev, req, tevent_timeval_current_ofs(0, 10000),
+                          test_renew_timeout, req);
+    assert_non_null(te);
+
+    return req;
+}
+
+static enum krb5_renew_result test_renew_recv(struct tevent_req *req)
+{
+    struct test_renew_state *state;
+    struct test_renew_ctx *test_ctx;
+
+    state = tevent_req_data(req, struct test_renew_state);
+    test_ctx = state->test_ctx;
+
+    (*test_renew_running(test_ctx, state->realm))--;
+    test_ctx->finished++;
+
+    if (test_ctx->finished == test_ctx->expected) {
+        test_ev_done(test_ctx->tctx, EOK);
+    }
+
+    if (test_ctx->retries > 0) {
+        test_ctx->retries--;
+        return KRB5_RENEW_RETRY;
+    }
+
+    return KRB5_RENEW_DONE;
+}
+
+static int test_renew_setup(void **state, time_t interval)
+{
+    struct test_renew_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct test_renew_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->tctx = create_ev_test_ctx(test_ctx);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->sched = krb5_renew_sched_new(test_ctx, test_ctx->tctx->ev,
+                                           interval, TEST_MAX_CONCURRENT,
+                                           test_renew_send, test_renew_recv,
+                                           test_ctx);
+    assert_non_null(test_ctx->sched);
+
+    check_leaks_push(test_ctx);
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_renew_setup_no_jitter(void **state)
+{
+    return test_renew_setup(state, 0);
+}
+
+static int test_renew_setup_jitter(void **state)
+{
+    return test_renew_setup(state, 1);
+}
+
+static int test_renew_teardown(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+
+    talloc_zfree(test_ctx->sched);
+    assert_true(check_leaks_pop(test_ctx));
+
+    talloc_free(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static void test_renew_add(struct test_renew_ctx *test_ctx,
+                           const char *key,
+                           const char *realm,
+                           time_t renew_at)
+{
+    const char *principal;
+    errno_t ret;
+
+    principal = talloc_asprintf(test_ctx, "%s@%s", key, realm);
+    assert_non_null(principal);
+
+    ret = krb5_renew_sched_add(test_ctx->sched, key, principal,
+                               renew_at, renew_at + 7200,
+                               talloc_strdup(NULL, realm));
+    assert_int_equal(ret, EOK);
+
+    talloc_free(discard_const(principal));
+}
+
+static void test_krb5_renew_sched_limit(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+    struct krb5_renew_stats stats;
+    char key[32];
+    errno_t ret;
+    int i;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+    test_ctx->expected = 2 * TEST_RENEWALS_PER_REALM;
+
+    for (i = 0; i < TEST_RENEWALS_PER_REALM; i++) {
+        snprintf(key, sizeof(key), "a%d", i);
+        test_renew_add(test_ctx, key, "A", time(NULL) - 10);
+        snprintf(key, sizeof(key), "b%d", i);
+        test_renew_add(test_ctx, key, "B", time(NULL) - 10);
+    }
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.queued, 2 * TEST_RENEWALS_PER_REALM);
+    assert_int_equal(stats.running, 0);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.done, 2 * TEST_RENEWALS_PER_REALM);
+    assert_int_equal(stats.failed, 0);
+    assert_int_equal(stats.deferred,
+                     2 * (TEST_RENEWALS_PER_REALM - TEST_MAX_CONCURRENT));
+    assert_int_equal(stats.queued, 0);
+    assert_int_equal(stats.running, 0);
+}
+
+static void test_krb5_renew_sched_retry(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+    struct krb5_renew_stats stats;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+    test_ctx->expected = 2;
+    test_ctx->retries = 1;
+
+    test_renew_add(test_ctx, "user", "A", time(NULL) - 10);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.done, 1);
+    assert_int_equal(stats.deferred, 1);
+    assert_int_equal(stats.queued, 0);
+}
+
+static void test_krb5_renew_sched_readd(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+    struct krb5_renew_stats stats;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+    test_ctx->expected = 1;
+    test_ctx->readd_key = "user";
+
+    test_renew_add(test_ctx, "user", "A", time(NULL) - 10);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    /* The new ticket is scheduled once the renewal finished */
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.done, 1);
+    assert_int_equal(stats.queued, 1);
+    assert_int_equal(stats.running, 0);
+}
+
+static void test_krb5_renew_sched_update(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+    struct krb5_renew_stats stats;
+    time_t renew_at;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+    renew_at = time(NULL) + 3600;
+
+    test_renew_add(test_ctx, "user", "A", renew_at);
+    test_renew_add(test_ctx, "user", "A", renew_at);
+    test_renew_add(test_ctx, "other", "A", renew_at);
+    test_renew_add(test_ctx, "other", "A", renew_at + 60);
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.queued, 2);
+
+    krb5_renew_sched_remove(test_ctx->sched, "user");
+    krb5_renew_sched_remove(test_ctx->sched, "missing");
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.queued, 1);
+    assert_int_equal(test_ctx->started, 0);
+}
+
+static void test_krb5_renew_sched_pause(void **state)
+{
+    struct test_renew_ctx *test_ctx;
+    struct krb5_renew_stats stats;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct test_renew_ctx);
+    test_ctx->expected = 1;
+
+    krb5_renew_sched_pause(test_ctx->sched, true);
+    test_renew_add(test_ctx, "user", "A", time(NULL) - 10);
+
+    /* Nothing may be started while paused */
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.queued, 1);
+    assert_int_equal(stats.running, 0);
+
+    krb5_renew_sched_pause(test_ctx->sched, false);
+
+    ret = test_ev_loop(test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+
+    krb5_renew_sched_get_stats(test_ctx->sched, &stats);
+    assert_int_equal(stats.done, 1);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        /* Renewals are limited per realm */
+        cmocka_unit_test_setup_teardown(test_krb5_renew_sched_limit,
+                                        test_renew_setup_no_jitter,
+                                        test_renew_teardown),
+        /* A deferred renewal is retried after the interval */
+        cmocka_unit_test_setup_teardown(test_krb5_renew_sched_retry,
+                                        test_renew_setup_jitter,
+                                        test_renew_teardown),
+        /* A ticket added during its renewal is scheduled afterwards */
+        cmocka_unit_test_setup_teardown(test_krb5_renew_sched_readd,
+                                        test_renew_setup_no_jitter,
+                                        test_renew_teardown),
+        /* Adding the same ticket again does not duplicate it */
+        cmocka_unit_test_setup_teardown(test_krb5_renew_sched_update,
+                                        test_renew_setup_jitter,
+                                        test_renew_teardown),
+        /* Nothing is started while paused */
+        cmocka_unit_test_setup_teardown(test_krb5_renew_sched_pause,
+                                        test_renew_setup_no_jitter,
+                                        test_renew_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -140,6 +140,9 @@ struct pam_ctx *mock_pctx(TALLOC_CTX *mem_ctx)
     ret = sss_hash_create(pctx, 10, &pctx->id_table);
     assert_int_equal(ret, EOK);
 
+    pctx->cached_auth = pam_cached_auth_ctx_new(pctx, 30);
+    assert_non_null(pctx->cached_auth);
+
     /* Two NULLs so that tests can just assign a const to the first slot
      * should they need it. The code iterates until first NULL anyway
      */
@@ -224,6 +227,11 @@ void test_pam_setup(struct sss_test_conf_param dom_params[],
     pam_test_ctx->rctx->cdb = pam_test_ctx->tctx->confdb;
     pam_test_ctx->pctx->rctx = pam_test_ctx->rctx;
 
+    pam_test_ctx->pctx->session_tokens =
+                    pam_session_tokens_new(pam_test_ctx->pctx,
+                                           pam_test_ctx->tctx->ev);
+    assert_non_null(pam_test_ctx->pctx->session_tokens);
+
     ret = add_pam_params(pam_params, pam_test_ctx->rctx->cdb);
     assert_int_equal(ret, EOK);
 
@@ -723,6 +731,59 @@ static void mock_input_pam(TALLOC_CTX *mem_ctx,
     return mock_input_pam_ex(mem_ctx, name, pwd, fa2, NULL, false);
 }
 
+/* Without @lookup the user must be taken from the session token */
+static void mock_input_pam_session_token(TALLOC_CTX *mem_ctx,
+                                         const char *name,
+                                         const char *pwd,
+                                         const char *svc,
+                                         const char *token,
+                                         bool lookup)
+{
+    size_t buf_size;
+    uint8_t *m_buf;
+    uint8_t *buf;
+    struct pam_items pi = { 0 };
+    int ret;
+
+    pi.pam_user = name;
+    pi.pam_user_size = strlen(pi.pam_user) + 1;
+
+    if (pwd != NULL) {
+        pi.pam_authtok = discard_const(pwd);
+        pi.pam_authtok_size = strlen(pi.pam_authtok) + 1;
+        pi.pam_authtok_type = SSS_AUTHTOK_TYPE_PASSWORD;
+    }
+
+    pi.pam_service = svc;
+    pi.pam_service_size = strlen(pi.pam_service) + 1;
+    pi.pam_tty = "/dev/tty";
+    pi.pam_tty_size = strlen(pi.pam_tty) + 1;
+    pi.pam_ruser = "remuser";
+    pi.pam_ruser_size = strlen(pi.pam_ruser) + 1;
+    pi.pam_rhost = "remhost";
+    pi.pam_rhost_size = strlen(pi.pam_rhost) + 1;
+    pi.requested_domains = "";
+    pi.cli_pid = 12345;
+    pi.flags = PAM_CLI_FLAGS_SESSION_TOKEN;
+    pi.session_token = token;
+    pi.session_token_size = token != NULL ? strlen(token) + 1 : 0;
+
+    ret = pack_message_v3(&pi, &buf_size, &m_buf);
+    assert_int_equal(ret, 0);
+
+    buf = talloc_memdup(mem_ctx, m_buf, buf_size);
+    free(m_buf);
+    assert_non_null(buf);
+
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_WRAPPER);
+    will_return(__wrap_sss_packet_get_body, buf);
+    will_return(__wrap_sss_packet_get_body, buf_size);
+
+    if (lookup) {
+        mock_parse_inp(name, NULL, EOK);
+    }
+}
+
 static void mock_input_pam_cert(TALLOC_CTX *mem_ctx, const char *name,
                                 const char *pin, const char *token_name,
                                 const char *module_name, const char *key_id,
@@ -1326,6 +1387,109 @@ void test_pam_authenticate(void **state)
     assert_int_equal(ret, EOK);
 }
 
+static char session_token[64];
+
+static int test_pam_session_token_check(uint32_t status, uint8_t *body,
+                                        size_t blen)
+{
+    size_t rp = 0;
+    uint32_t val;
+    uint32_t num;
+    uint32_t type;
+    uint32_t len;
+    bool found = false;
+
+    assert_int_equal(status, 0);
+
+    SAFEALIGN_COPY_UINT32(&val, body + rp, &rp);
+    assert_int_equal(val, pam_test_ctx->exp_pam_status);
+
+    SAFEALIGN_COPY_UINT32(&num, body + rp, &rp);
+    assert_int_equal(num, 2);
+
+    for (; num > 0; num--) {
+        SAFEALIGN_COPY_UINT32(&type, body + rp, &rp);
+        SAFEALIGN_COPY_UINT32(&len, body + rp, &rp);
+        assert_true(rp + len <= blen);
+        assert_int_equal(*(body + rp + len - 1), 0);
+
+        if (type == SSS_PAM_SESSION_TOKEN) {
+            assert_true(len <= sizeof(session_token));
+            memcpy(session_token, body + rp, len);
+            found = true;
+        } else {
+            assert_int_equal(type, SSS_PAM_DOMAIN_NAME);
+            assert_string_equal(body + rp, TEST_DOM_NAME);
+        }
+        rp += len;
+    }
+
+    assert_true(found);
+    return EOK;
+}
+
+static void common_test_pam_session_token(enum sss_cli_command cmd,
+                                          const char *pwd,
+                                          const char *svc,
+                                          const char *token,
+                                          bool lookup)
+{
+    int ret;
+
+    mock_input_pam_session_token(pam_test_ctx, "pamuser", pwd, svc, token,
+                                 lookup);
+
+    will_return(__wrap_sss_packet_get_cmd, cmd);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    pam_test_ctx->exp_pam_status = PAM_SUCCESS;
+    pam_test_ctx->tctx->done = false;
+
+    set_cmd_cb(test_pam_session_token_check);
+    ret = sss_cmd_execute(pam_test_ctx->cctx, cmd, pam_test_ctx->pam_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(pam_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+void test_pam_session_token(void **state)
+{
+    char first[sizeof(session_token)];
+
+    pam_test_ctx->pctx->id_timeout = 30;
+
+    common_test_pam_session_token(SSS_PAM_AUTHENTICATE, "12345",
+                                  "pam_test_service", NULL, true);
+    memcpy(first, session_token, sizeof(first));
+
+    /* The user is not looked up again, mock_parse_inp() would be needed */
+    common_test_pam_session_token(SSS_PAM_ACCT_MGMT, NULL,
+                                  "pam_test_service", first, false);
+    assert_string_equal(session_token, first);
+
+    common_test_pam_session_token(SSS_PAM_OPEN_SESSION, NULL,
+                                  "pam_test_service", first, false);
+    assert_string_equal(session_token, first);
+}
+
+void test_pam_session_token_other_service(void **state)
+{
+    char first[sizeof(session_token)];
+
+    pam_test_ctx->pctx->id_timeout = 30;
+
+    common_test_pam_session_token(SSS_PAM_AUTHENTICATE, "12345",
+                                  "pam_test_service", NULL, true);
+    memcpy(first, session_token, sizeof(first));
+
+    /* The token is bound to the service, the user is looked up again */
+    common_test_pam_session_token(SSS_PAM_ACCT_MGMT, NULL,
+                                  "other_service", first, true);
+    assert_string_not_equal(session_token, first);
+}
+
 void test_pam_setcreds(void **state)
 {
     int ret;
@@ -1690,6 +1854,74 @@ void test_pam_offline_auth_wrong_pw(void **state)
     assert_int_equal(ret, EOK);
 }
 
+static void common_test_pam_offline_auth(const char *pwd, cmd_cb_fn_t fn)
+{
+    int ret;
+
+    mock_input_pam(pam_test_ctx, "pamuser", pwd, NULL);
+
+    will_return(__wrap_sss_packet_get_cmd, SSS_PAM_AUTHENTICATE);
+    will_return(__wrap_sss_packet_get_body, WRAP_CALL_REAL);
+
+    pam_test_ctx->exp_pam_status = PAM_AUTHINFO_UNAVAIL;
+    pam_test_ctx->provider_contacted = false;
+    pam_test_ctx->tctx->done = false;
+
+    set_cmd_cb(fn);
+    ret = sss_cmd_execute(pam_test_ctx->cctx, SSS_PAM_AUTHENTICATE,
+                          pam_test_ctx->pam_cmds);
+    assert_int_equal(ret, EOK);
+
+    /* Wait until the test finishes with EOK */
+    ret = test_ev_loop(pam_test_ctx->tctx);
+    assert_int_equal(ret, EOK);
+}
+
+void test_pam_offline_auth_fast_path(void **state)
+{
+    int ret;
+
+    ret = sysdb_cache_password(pam_test_ctx->tctx->dom,
+                               pam_test_ctx->pam_user_fqdn,
+                               "12345");
+    assert_int_equal(ret, EOK);
+
+    common_test_pam_offline_auth("12345",
+                                 test_pam_successful_offline_auth_check);
+    assert_true(pam_test_ctx->provider_contacted);
+
+    /* The domain is known to be offline now */
+    common_test_pam_offline_auth("12345",
+                                 test_pam_successful_offline_auth_check);
+    assert_false(pam_test_ctx->provider_contacted);
+}
+
+void test_pam_offline_auth_fast_path_rate_limit(void **state)
+{
+    int ret;
+    int i;
+
+    ret = sysdb_cache_password(pam_test_ctx->tctx->dom,
+                               pam_test_ctx->pam_user_fqdn,
+                               "12345");
+    assert_int_equal(ret, EOK);
+
+    common_test_pam_offline_auth("11111",
+                                 test_pam_wrong_pw_offline_auth_check);
+    assert_true(pam_test_ctx->provider_contacted);
+
+    for (i = 0; i < PAM_CACHED_AUTH_MAX_FAILURES; i++) {
+        common_test_pam_offline_auth("11111",
+                                     test_pam_wrong_pw_offline_auth_check);
+        assert_false(pam_test_ctx->provider_contacted);
+    }
+
+    /* Too many failures, the backend is asked again */
+    common_test_pam_offline_auth("12345",
+                                 test_pam_successful_offline_auth_check);
+    assert_true(pam_test_ctx->provider_contacted);
+}
+
 void test_pam_offline_auth_success_2fa(void **state)
 {
     int ret;
@@ -4407,6 +4639,10 @@ int main(int argc, const char *argv[])
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_setcreds,
                                         pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_session_token,
+                                        pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_session_token_other_service,
+                                        pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_acct_mgmt,
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_open_session,
@@ -4425,6 +4661,11 @@ int main(int argc, const char *argv[])
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_offline_auth_wrong_pw,
                                         pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(test_pam_offline_auth_fast_path,
+                                        pam_test_setup, pam_test_teardown),
+        cmocka_unit_test_setup_teardown(
+                                    test_pam_offline_auth_fast_path_rate_limit,
+                                    pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_offline_auth_success_2fa,
                                         pam_test_setup, pam_test_teardown),
         cmocka_unit_test_setup_teardown(test_pam_offline_auth_failed_2fa,
@@ -221,6 +221,9 @@ void __wrap_ares_query(ares_channel channel, const char *name, int dnsclass,
 struct resolv_fake_ctx {
     struct resolv_ctx *resolv;
     struct sss_test_ctx *ctx;
+
+    size_t num_replies;
+    uint32_t ttl;
 };
 
 static int test_resolv_fake_setup(void **state)
@@ -334,6 +337,152 @@ void test_resolv_fake_srv(void **state)
     assert_int_equal(ret, ERR_OK);
 }
 
+static void test_resolv_fake_srv_cache_done(struct tevent_req *req)
+{
+    struct ares_srv_reply *srv_replies = NULL;
+    struct resolv_fake_ctx *test_ctx;
+    int status;
+    errno_t ret;
+
+    test_ctx = tevent_req_callback_data(req, struct resolv_fake_ctx);
+
+    ret = resolv_getsrv_recv(test_ctx, req, &status, NULL,
+                             &srv_replies, &test_ctx->ttl);
+    talloc_free(req);
+
+    test_ctx->num_replies = 0;
+    while (srv_replies != NULL) {
+        test_ctx->num_replies++;
+        srv_replies = srv_replies->next;
+    }
+
+    test_ev_done(test_ctx->ctx, ret);
+}
+
+static errno_t test_resolv_fake_srv_cache_query(struct resolv_fake_ctx *test_ctx)
+{
+    struct tevent_req *req;
+
+    test_ctx->ctx->done = false;
+    test_ctx->num_replies = 0;
+    test_ctx->ttl = 0;
+
+    req = resolv_getsrv_send(test_ctx, test_ctx->ctx->ev,
+                             test_ctx->resolv, TEST_SRV_QUERY);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_resolv_fake_srv_cache_done, test_ctx);
+
+    return test_ev_loop(test_ctx->ctx);
+}
+
+void test_resolv_fake_srv_cache(void **state)
+{
+    struct resolv_fake_ctx *test_ctx =
+        talloc_get_type(*state, struct resolv_fake_ctx);
+    struct resolv_cache_stats stats;
+    struct srv_rrdata rr[2];
+    unsigned char *buf;
+    size_t buflen;
+    errno_t ret;
+
+    /* There are no counters without a cache */
+    ret = resolv_get_cache_stats(test_ctx->resolv, &stats);
+    assert_int_equal(ret, ENOENT);
+
+    ret = resolv_cache_init(test_ctx->resolv, 16, 15);
+    assert_int_equal(ret, EOK);
+
+    rr[0].prio = 1;
+    rr[0].port = 389;
+    rr[0].weight = 40;
+    rr[0].ttl = 600;
+    rr[0].hostname = "ldap.sssd.com";
+
+    rr[1].prio = 1;
+    rr[1].port = 389;
+    rr[1].weight = 60;
+    rr[1].ttl = 500;
+    rr[1].hostname = "ldap2.sssd.com";
+
+    buf = create_srv_buffer(test_ctx, TEST_SRV_QUERY, rr, 2, &buflen);
+    assert_non_null(buf);
+
+    /* Only the first lookup goes to DNS, a second query would fail
+     * because the mocked answer was already consumed */
+    mock_ares_query(0, 0, buf, buflen);
+
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(test_ctx->num_replies, 2);
+    assert_int_equal(test_ctx->ttl, 500);
+
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(test_ctx->num_replies, 2);
+    /* The remaining TTL is returned */
+    assert_true(test_ctx->ttl <= 500);
+    assert_true(test_ctx->ttl >= 498);
+
+    ret = resolv_get_cache_stats(test_ctx->resolv, &stats);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.negative_hits, 0);
+    assert_int_equal(stats.misses, 1);
+    assert_int_equal(stats.num_entries, 1);
+
+    /* After a flush the query is sent again */
+    resolv_cache_flush(test_ctx->resolv);
+    mock_ares_query(0, 0, buf, buflen);
+
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(test_ctx->num_replies, 2);
+
+    ret = resolv_get_cache_stats(test_ctx->resolv, &stats);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(stats.hits, 1);
+    assert_int_equal(stats.misses, 2);
+}
+
+void test_resolv_fake_srv_negative_cache(void **state)
+{
+    struct resolv_fake_ctx *test_ctx =
+        talloc_get_type(*state, struct resolv_fake_ctx);
+    struct resolv_cache_stats stats;
+    errno_t ret;
+
+    ret = resolv_cache_init(test_ctx->resolv, 16, 15);
+    assert_int_equal(ret, EOK);
+
+    mock_ares_query(ARES_ENOTFOUND, 0, NULL, 0);
+
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EIO);
+
+    /* The negative answer is served from the cache, no query is mocked */
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EIO);
+
+    ret = resolv_get_cache_stats(test_ctx->resolv, &stats);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(stats.hits, 0);
+    assert_int_equal(stats.negative_hits, 1);
+    assert_int_equal(stats.misses, 1);
+
+    /* Negative caching can be disabled */
+    resolv_cache_flush(test_ctx->resolv);
+    ret = resolv_cache_init(test_ctx->resolv, 16, 0);
+    assert_int_equal(ret, EOK);
+
+    mock_ares_query(ARES_ENOTFOUND, 0, NULL, 0);
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EIO);
+
+    mock_ares_query(ARES_ENOTFOUND, 0, NULL, 0);
+    ret = test_resolv_fake_srv_cache_query(test_ctx);
+    assert_int_equal(ret, EIO);
+}
+
 void test_resolv_is_address(void **state)
 {
     bool ret;
@@ -372,6 +521,12 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_resolv_fake_srv,
                                         test_resolv_fake_setup,
                                         test_resolv_fake_teardown),
+        cmocka_unit_test_setup_teardown(test_resolv_fake_srv_cache,
+                                        test_resolv_fake_setup,
+                                        test_resolv_fake_teardown),
+        cmocka_unit_test_setup_teardown(test_resolv_fake_srv_negative_cache,
+                                        test_resolv_fake_setup,
+                                        test_resolv_fake_teardown),
         cmocka_unit_test(test_resolv_is_address),
     };
 
@@ -388,6 +388,125 @@ void test_parse_no_map(void **state)
     talloc_free(attrs);
 }
 
+/* The whole entry is allocated at once, it must still be possible to
+ * extend and free it like any other sysdb_attrs */
+void test_parse_large_entry(void **state)
+{
+    int ret;
+    struct sysdb_attrs *attrs;
+    struct parse_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                      struct parse_test_ctx);
+    struct mock_ldap_entry test_group;
+    struct ldb_message_element *el;
+    TALLOC_CTX *owner;
+    const char **member_values;
+    char *expected;
+    size_t i;
+
+    const char *name_values[] = { "", "group1", NULL };
+    struct mock_ldap_attr test_group_attrs[] = {
+        { .name = "cn", .values = name_values },
+        { .name = "member", .values = NULL },
+        { NULL, NULL }
+    };
+
+    member_values = talloc_zero_array(test_ctx, const char *, 501);
+    assert_non_null(member_values);
+    for (i = 0; i < 500; i++) {
+        member_values[i] = talloc_asprintf(member_values,
+                                           "uid=user%zu,dc=example,dc=com", i);
+        assert_non_null(member_values[i]);
+    }
+    test_group_attrs[1].values = member_values;
+
+    test_group.dn = "cn=group1,dc=example,dc=com";
+    test_group.attrs = test_group_attrs;
+    set_entry_parse(&test_group);
+
+    ret = sdap_parse_entry(test_ctx, &test_ctx->sh, &test_ctx->sm,
+                           NULL, 0, &attrs, false);
+    assert_int_equal(ret, ERR_OK);
+
+    assert_int_equal(attrs->num, 3);
+    assert_entry_has_attr(attrs, SYSDB_ORIG_DN, "cn=group1,dc=example,dc=com");
+    /* Empty values are skipped */
+    assert_entry_has_attr(attrs, "cn", "group1");
+
+    ret = sysdb_attrs_get_el_ext(attrs, "member", false, &el);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(el->num_values, 500);
+    for (i = 0; i < 500; i++) {
+        assert_int_equal(el->values[i].length, strlen(member_values[i]));
+        assert_string_equal((const char *) el->values[i].data,
+                            member_values[i]);
+    }
+
+    /* Values and attributes can be added after parsing */
+    ret = sysdb_attrs_add_string(attrs, "member", "uid=added,dc=example,dc=com");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_NAME, "group1");
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_attrs_get_el_ext(attrs, "member", false, &el);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(el->num_values, 501);
+    assert_string_equal((const char *) el->values[500].data,
+                        "uid=added,dc=example,dc=com");
+    assert_string_equal((const char *) el->values[0].data, member_values[0]);
+    assert_entry_has_attr(attrs, SYSDB_NAME, "group1");
+
+    /* The entry can change its owner and does not reference the LDAP
+     * values it was parsed from */
+    owner = talloc_new(test_ctx);
+    assert_non_null(owner);
+    talloc_steal(owner, attrs);
+
+    expected = talloc_strdup(test_ctx, member_values[499]);
+    assert_non_null(expected);
+    talloc_free(member_values);
+
+    ret = sysdb_attrs_get_el_ext(attrs, "member", false, &el);
+    assert_int_equal(ret, ERR_OK);
+    assert_string_equal((const char *) el->values[499].data, expected);
+
+    talloc_free(expected);
+    talloc_free(owner);
+}
+
+/* The rootDSE has an empty DN */
+void test_parse_empty_dn(void **state)
+{
+    int ret;
+    struct sysdb_attrs *attrs;
+    struct parse_test_ctx *test_ctx = talloc_get_type_abort(*state,
+                                                      struct parse_test_ctx);
+    struct mock_ldap_entry test_rootdse;
+    struct ldb_message_element *el;
+
+    const char *nc_values[] = { "dc=example,dc=com", NULL };
+    struct mock_ldap_attr test_rootdse_attrs[] = {
+        { .name = "namingContexts", .values = nc_values },
+        { NULL, NULL }
+    };
+
+    test_rootdse.dn = "";
+    test_rootdse.attrs = test_rootdse_attrs;
+    set_entry_parse(&test_rootdse);
+
+    ret = sdap_parse_entry(test_ctx, &test_ctx->sh, &test_ctx->sm,
+                           NULL, 0, &attrs, false);
+    assert_int_equal(ret, ERR_OK);
+
+    assert_int_equal(attrs->num, 2);
+    ret = sysdb_attrs_get_el_ext(attrs, SYSDB_ORIG_DN, false, &el);
+    assert_int_equal(ret, ERR_OK);
+    assert_int_equal(el->num_values, 1);
+    assert_int_equal(el->values[0].length, 0);
+    assert_entry_has_attr(attrs, "namingContexts", "dc=example,dc=com");
+
+    talloc_free(attrs);
+}
+
 /* Only DN and OC, no real attributes */
 void test_parse_no_attrs(void **state)
 {
@@ -1236,6 +1355,12 @@ int main(int argc, const char *argv[])
         cmocka_unit_test_setup_teardown(test_parse_no_map,
                                         parse_entry_test_setup,
                                         parse_entry_test_teardown),
+        cmocka_unit_test_setup_teardown(test_parse_large_entry,
+                                        parse_entry_test_setup,
+                                        parse_entry_test_teardown),
+        cmocka_unit_test_setup_teardown(test_parse_empty_dn,
+                                        parse_entry_test_setup,
+                                        parse_entry_test_teardown),
         cmocka_unit_test_setup_teardown(test_parse_no_attrs,
                                         parse_entry_test_setup,
                                         parse_entry_test_teardown),
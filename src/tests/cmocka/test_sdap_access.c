@@ -32,6 +32,17 @@
 #include "tests/common.h"
 #include "tests/cmocka/test_expire_common.h"
 #include "tests/cmocka/test_sdap_access.h"
+#include "db/sysdb.h"
+#include "util/sss_pam_data.h"
+#include "providers/backend.h"
+#include "providers/ldap/ldap_common.h"
+#include "providers/ldap/sdap_access.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "test_sdap_access_conf.ldb"
+#define TEST_DOM_NAME "sdap_access_test"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_USER "access_user"
 
 /* linking against function from sdap_access.c module */
 extern bool nds_check_expired(const char *exp_time_str);
@@ -249,6 +260,187 @@ static void test_sdap_access_rhost(void **state)
     assert_int_equal(EOK, ret); /* Expected access allowed */
 }
 
+struct test_sdap_access_rules_ctx {
+    struct sss_test_ctx *tctx;
+    struct be_ctx *be_ctx;
+    struct sdap_access_ctx *access_ctx;
+    struct pam_data *pd;
+};
+
+static int test_sdap_access_rules_setup(void **state)
+{
+    struct test_sdap_access_rules_ctx *test_ctx;
+    struct sdap_id_ctx *id_ctx;
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    test_ctx = talloc_zero(NULL, struct test_sdap_access_rules_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    /* The filter rule decides from the cache when offline, so no server is
+     * needed but its result still arrives asynchronously. */
+    test_ctx->be_ctx = talloc_zero(test_ctx, struct be_ctx);
+    assert_non_null(test_ctx->be_ctx);
+    test_ctx->be_ctx->ev = test_ctx->tctx->ev;
+    test_ctx->be_ctx->domain = test_ctx->tctx->dom;
+    test_ctx->be_ctx->offline = true;
+
+    id_ctx = talloc_zero(test_ctx, struct sdap_id_ctx);
+    assert_non_null(id_ctx);
+    id_ctx->be = test_ctx->be_ctx;
+    ret = ldap_get_options(id_ctx, test_ctx->tctx->dom,
+                           test_ctx->tctx->confdb,
+                           test_ctx->tctx->conf_dom_path, NULL,
+                           &id_ctx->opts);
+    assert_int_equal(ret, EOK);
+    ret = dp_opt_set_string(id_ctx->opts->basic, SDAP_ACCOUNT_EXPIRE_POLICY,
+                            LDAP_ACCOUNT_EXPIRE_SHADOW);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->access_ctx = talloc_zero(test_ctx, struct sdap_access_ctx);
+    assert_non_null(test_ctx->access_ctx);
+    test_ctx->access_ctx->type = SDAP_TYPE_LDAP;
+    test_ctx->access_ctx->id_ctx = id_ctx;
+    test_ctx->access_ctx->filter = "(objectClass=posixAccount)";
+
+    test_ctx->pd = create_pam_data(test_ctx);
+    assert_non_null(test_ctx->pd);
+    test_ctx->pd->cmd = SSS_PAM_ACCT_MGMT;
+    test_ctx->pd->service = talloc_strdup(test_ctx->pd, "login");
+    test_ctx->pd->user = sss_create_internal_fqname(test_ctx->pd, TEST_USER,
+                                                    TEST_DOM_NAME);
+    assert_non_null(test_ctx->pd->user);
+
+    /* The user is expired and denied by the cached filter result */
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_SHADOWPW_EXPIRE, "1");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_bool(attrs, SYSDB_LDAP_ACCESS_FILTER, false);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, test_ctx->pd->user, NULL,
+                           1000, 1000, NULL, "/home/" TEST_USER, "/bin/sh",
+                           NULL, attrs, NULL, 300, 0);
+    assert_int_equal(ret, EOK);
+
+    *state = test_ctx;
+
+    return 0;
+}
+
+static int test_sdap_access_rules_teardown(void **state)
+{
+    struct test_sdap_access_rules_ctx *test_ctx;
+
+    test_ctx = talloc_get_type(*state, struct test_sdap_access_rules_ctx);
+    assert_non_null(test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+
+    return 0;
+}
+
+static void test_sdap_access_rules_done(struct tevent_req *req)
+{
+    struct sss_test_ctx *tctx;
+
+    tctx = tevent_req_callback_data(req, struct sss_test_ctx);
+
+    tctx->error = sdap_access_recv(req);
+    talloc_free(req);
+    tctx->done = true;
+}
+
+static errno_t
+test_sdap_access_rules_run(struct test_sdap_access_rules_ctx *test_ctx,
+                           const int *rules)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct tevent_req *req;
+    size_t c;
+    errno_t ret;
+
+    for (c = 0; rules[c] != LDAP_ACCESS_EMPTY; c++) {
+        test_ctx->access_ctx->access_rule[c] = rules[c];
+    }
+    test_ctx->access_ctx->access_rule[c] = LDAP_ACCESS_EMPTY;
+
+    tmp_ctx = talloc_new(test_ctx);
+    assert_non_null(tmp_ctx);
+
+    req = sdap_access_send(tmp_ctx, test_ctx->tctx->ev, test_ctx->be_ctx,
+                           test_ctx->tctx->dom, test_ctx->access_ctx, NULL,
+                           test_ctx->pd);
+    assert_non_null(req);
+    tevent_req_set_callback(req, test_sdap_access_rules_done,
+                            test_ctx->tctx);
+
+    test_ctx->tctx->done = false;
+    ret = test_ev_loop(test_ctx->tctx);
+    talloc_free(tmp_ctx);
+
+    return ret;
+}
+
+static void test_sdap_access_rules_order(void **state)
+{
+    struct test_sdap_access_rules_ctx *test_ctx;
+    const int filter_first[] = { LDAP_ACCESS_FILTER, LDAP_ACCESS_EXPIRE,
+                                 LDAP_ACCESS_EMPTY };
+    const int expire_first[] = { LDAP_ACCESS_EXPIRE, LDAP_ACCESS_FILTER,
+                                 LDAP_ACCESS_EMPTY };
+    const int service_first[] = { LDAP_ACCESS_SERVICE, LDAP_ACCESS_EXPIRE,
+                                  LDAP_ACCESS_FILTER, LDAP_ACCESS_EMPTY };
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct test_sdap_access_rules_ctx);
+
+    /* The filter result arrives later but it is the first rule */
+    ret = test_sdap_access_rules_run(test_ctx, filter_first);
+    assert_int_equal(ret, ERR_ACCESS_DENIED);
+
+    ret = test_sdap_access_rules_run(test_ctx, expire_first);
+    assert_int_equal(ret, ERR_ACCOUNT_EXPIRED);
+
+    /* No authorizedService attribute, the first rule denies */
+    ret = test_sdap_access_rules_run(test_ctx, service_first);
+    assert_int_equal(ret, ERR_ACCESS_DENIED);
+}
+
+static void test_sdap_access_rules_allow(void **state)
+{
+    struct test_sdap_access_rules_ctx *test_ctx;
+    const int rules[] = { LDAP_ACCESS_FILTER, LDAP_ACCESS_EXPIRE,
+                          LDAP_ACCESS_EMPTY };
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    test_ctx = talloc_get_type(*state, struct test_sdap_access_rules_ctx);
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_SHADOWPW_EXPIRE, "0");
+    assert_int_equal(ret, EOK);
+    ret = sysdb_attrs_add_bool(attrs, SYSDB_LDAP_ACCESS_FILTER, true);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_set_user_attr(test_ctx->tctx->dom, test_ctx->pd->user,
+                              attrs, SYSDB_MOD_REP);
+    assert_int_equal(ret, EOK);
+    talloc_free(attrs);
+
+    ret = test_sdap_access_rules_run(test_ctx, rules);
+    assert_int_equal(ret, EOK);
+}
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
@@ -258,6 +450,12 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_sdap_access_rhost,
                                         test_sdap_access_rhost_setup,
                                         test_sdap_access_rhost_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_access_rules_order,
+                                        test_sdap_access_rules_setup,
+                                        test_sdap_access_rules_teardown),
+        cmocka_unit_test_setup_teardown(test_sdap_access_rules_allow,
+                                        test_sdap_access_rules_setup,
+                                        test_sdap_access_rules_teardown),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,394 @@
+/*
+    SSSD
+
+    Tests: Racing connection attempts to all addresses of a server
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+#include <arpa/inet.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "providers/ldap/ldap_opts.h"
+#include "providers/ldap/sdap_async_connect_race.c"
+
+#define TEST_URI "ldap://ldap.test"
+#define TEST_PORT 389
+#define TEST_MAX_ADDRS 3
+
+static const char *test_addrs[] = { "192.0.2.1",
+                                    "192.0.2.2",
+                                    "192.0.2.3",
+                                    NULL };
+
+/* Every connection attempt started by the race ends up here. The test then
+ * decides in which order the attempts finish. */
+struct test_connect_race_ctx {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    struct fo_server *srv;
+    struct resolv_hostent *hostent;
+    struct sockaddr_storage *sockaddr;
+
+    struct tevent_req *attempts[TEST_MAX_ADDRS];
+    struct sdap_handle *handles[TEST_MAX_ADDRS];
+    bool cancelled[TEST_MAX_ADDRS];
+    size_t num_attempts;
+};
+
+static struct test_connect_race_ctx *test_ctx;
+
+struct resolv_hostent *fo_get_server_hostent(struct fo_server *server)
+{
+    assert_ptr_equal(server, test_ctx->srv);
+    return test_ctx->hostent;
+}
+
+int fo_get_server_port(struct fo_server *server)
+{
+    assert_ptr_equal(server, test_ctx->srv);
+    return TEST_PORT;
+}
+
+const char *fo_get_server_name(struct fo_server *server)
+{
+    assert_ptr_equal(server, test_ctx->srv);
+    return "ldap.test";
+}
+
+struct mock_connect_state {
+    size_t addr_idx;
+};
+
+static int mock_connect_destructor(struct mock_connect_state *state)
+{
+    test_ctx->cancelled[state->addr_idx] = true;
+    return 0;
+}
+
+struct tevent_req *sdap_connect_send(TALLOC_CTX *memctx,
+                                     struct tevent_context *ev,
+                                     struct sdap_options *opts,
+                                     const char *uri,
+                                     struct sockaddr_storage *sockaddr,
+                                     bool use_start_tls)
+{
+    struct mock_connect_state *state;
+    struct sockaddr_in *sin;
+    struct tevent_req *req;
+    char buf[INET_ADDRSTRLEN];
+    size_t i;
+
+    req = tevent_req_create(memctx, &state, struct mock_connect_state);
+    assert_non_null(req);
+
+    assert_string_equal(uri, TEST_URI);
+    assert_int_equal(sockaddr->ss_family, AF_INET);
+    sin = (struct sockaddr_in *) sockaddr;
+    assert_int_equal(ntohs(sin->sin_port), TEST_PORT);
+    assert_non_null(inet_ntop(AF_INET, &sin->sin_addr, buf, sizeof(buf)));
+
+    for (i = 0; test_addrs[i] != NULL; i++) {
+        if (strcmp(test_addrs[i], buf) == 0) {
+            break;
+        }
+    }
+    assert_non_null(test_addrs[i]);
+    assert_null(test_ctx->attempts[i]);
+
+    state->addr_idx = i;
+    talloc_set_destructor(state, mock_connect_destructor);
+
+    test_ctx->attempts[i] = req;
+    test_ctx->num_attempts++;
+
+    return req;
+}
+
+int sdap_connect_recv(struct tevent_req *req,
+                      TALLOC_CTX *memctx,
+                      struct sdap_handle **sh)
+{
+    struct mock_connect_state *state;
+
+    state = tevent_req_data(req, struct mock_connect_state);
+    talloc_set_destructor(state, NULL);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    test_ctx->handles[state->addr_idx] = talloc_zero(memctx,
+                                                     struct sdap_handle);
+    assert_non_null(test_ctx->handles[state->addr_idx]);
+
+    *sh = test_ctx->handles[state->addr_idx];
+    return EOK;
+}
+
+static void finish_attempt(size_t addr_idx, errno_t error)
+{
+    struct tevent_req *req = test_ctx->attempts[addr_idx];
+
+    assert_non_null(req);
+
+    if (error != EOK) {
+        tevent_req_error(req, error);
+    } else {
+        tevent_req_done(req);
+    }
+}
+
+static int test_connect_race_setup(void **state)
+{
+    struct resolv_addr *addr;
+    errno_t ret;
+    size_t i;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct test_connect_race_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->opts = talloc_zero(test_ctx, struct sdap_options);
+    assert_non_null(test_ctx->opts);
+
+    ret = dp_copy_defaults(test_ctx->opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &test_ctx->opts->basic);
+    assert_int_equal(ret, EOK);
+
+    /* Only used as an opaque handle by the mocked fail over functions */
+    test_ctx->srv = (struct fo_server *) talloc_size(test_ctx, 1);
+    assert_non_null(test_ctx->srv);
+
+    test_ctx->hostent = talloc_zero(test_ctx, struct resolv_hostent);
+    assert_non_null(test_ctx->hostent);
+    test_ctx->hostent->family = AF_INET;
+    test_ctx->hostent->addr_list = talloc_zero_array(test_ctx->hostent,
+                                                     struct resolv_addr *,
+                                                     TEST_MAX_ADDRS + 1);
+    assert_non_null(test_ctx->hostent->addr_list);
+
+    for (i = 0; test_addrs[i] != NULL; i++) {
+        addr = talloc_zero(test_ctx->hostent->addr_list, struct resolv_addr);
+        assert_non_null(addr);
+        addr->ipaddr = talloc_size(addr, sizeof(struct in_addr));
+        assert_non_null(addr->ipaddr);
+        assert_int_equal(inet_pton(AF_INET, test_addrs[i], addr->ipaddr), 1);
+        test_ctx->hostent->addr_list[i] = addr;
+    }
+
+    /* The address selected by fail over */
+    test_ctx->sockaddr = resolv_get_sockaddr_address(test_ctx,
+                                                     test_ctx->hostent,
+                                                     TEST_PORT);
+    assert_non_null(test_ctx->sockaddr);
+
+    check_leaks_push(test_ctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_connect_race_teardown(void **state)
+{
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static struct tevent_req *test_connect(int delay)
+{
+    struct tevent_req *req;
+    errno_t ret;
+
+    ret = dp_opt_set_int(test_ctx->opts->basic, SDAP_CONNECT_ATTEMPT_DELAY,
+                         delay);
+    assert_int_equal(ret, EOK);
+
+    /* No be_res, so the other address family is not resolved */
+    req = sdap_connect_race_send(test_ctx, test_ctx->ev, test_ctx->opts,
+                                 NULL, test_ctx->srv, TEST_URI,
+                                 test_ctx->sockaddr, false);
+    assert_non_null(req);
+
+    return req;
+}
+
+static void test_connect_race_first_wins(void **state)
+{
+    struct tevent_req *req;
+    struct sdap_handle *sh;
+    errno_t ret;
+
+    req = test_connect(10);
+    assert_int_equal(test_ctx->num_attempts, 1);
+    assert_non_null(test_ctx->attempts[0]);
+
+    /* The first address does not answer, the others are tried in parallel
+     * after the delay without cancelling the pending attempts */
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(test_ctx->num_attempts, 2);
+    assert_non_null(test_ctx->attempts[1]);
+
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(test_ctx->num_attempts, 3);
+    assert_non_null(test_ctx->attempts[2]);
+    assert_false(test_ctx->cancelled[0]);
+    assert_false(test_ctx->cancelled[1]);
+
+    /* The second address connects first and wins */
+    finish_attempt(1, EOK);
+    assert_false(tevent_req_is_in_progress(req));
+
+    /* The losers are cancelled */
+    assert_true(test_ctx->cancelled[0]);
+    assert_false(test_ctx->cancelled[1]);
+    assert_true(test_ctx->cancelled[2]);
+
+    ret = sdap_connect_race_recv(req, test_ctx, &sh);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(sh, test_ctx->handles[1]);
+
+    talloc_free(sh);
+    talloc_free(req);
+}
+
+static void test_connect_race_failure_starts_next(void **state)
+{
+    struct tevent_req *req;
+    struct sdap_handle *sh;
+    errno_t ret;
+
+    /* With a long delay only failures move the race forward */
+    req = test_connect(60000);
+    assert_int_equal(test_ctx->num_attempts, 1);
+
+    finish_attempt(0, ECONNREFUSED);
+    assert_int_equal(test_ctx->num_attempts, 2);
+    assert_true(tevent_req_is_in_progress(req));
+
+    finish_attempt(1, EOK);
+    assert_false(tevent_req_is_in_progress(req));
+
+    /* The last address was never tried */
+    assert_int_equal(test_ctx->num_attempts, 2);
+    assert_null(test_ctx->attempts[2]);
+
+    ret = sdap_connect_race_recv(req, test_ctx, &sh);
+    assert_int_equal(ret, EOK);
+    assert_ptr_equal(sh, test_ctx->handles[1]);
+
+    talloc_free(sh);
+    talloc_free(req);
+}
+
+static void test_connect_race_all_fail(void **state)
+{
+    struct tevent_req *req;
+    struct sdap_handle *sh = NULL;
+    errno_t ret;
+
+    req = test_connect(10);
+
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(tevent_loop_once(test_ctx->ev), 0);
+    assert_int_equal(test_ctx->num_attempts, 3);
+
+    /* The request only fails once the last pending attempt failed */
+    finish_attempt(2, ECONNREFUSED);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_attempt(0, ECONNREFUSED);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_attempt(1, ETIMEDOUT);
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = sdap_connect_race_recv(req, test_ctx, &sh);
+    assert_int_equal(ret, ETIMEDOUT);
+    assert_null(sh);
+
+    talloc_free(req);
+}
+
+static void test_connect_race_disabled(void **state)
+{
+    struct tevent_req *req;
+    struct sdap_handle *sh;
+    errno_t ret;
+
+    /* Only the first address is tried when racing is disabled */
+    req = test_connect(0);
+    assert_int_equal(test_ctx->num_attempts, 1);
+
+    finish_attempt(0, EIO);
+    assert_false(tevent_req_is_in_progress(req));
+    assert_int_equal(test_ctx->num_attempts, 1);
+
+    ret = sdap_connect_race_recv(req, test_ctx, &sh);
+    assert_int_equal(ret, EIO);
+
+    talloc_free(req);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_connect_race_first_wins,
+                                        test_connect_race_setup,
+                                        test_connect_race_teardown),
+        cmocka_unit_test_setup_teardown(test_connect_race_failure_starts_next,
+                                        test_connect_race_setup,
+                                        test_connect_race_teardown),
+        cmocka_unit_test_setup_teardown(test_connect_race_all_fail,
+                                        test_connect_race_setup,
+                                        test_connect_race_teardown),
+        cmocka_unit_test_setup_teardown(test_connect_race_disabled,
+                                        test_connect_race_setup,
+                                        test_connect_race_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
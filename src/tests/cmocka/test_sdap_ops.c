@@ -0,0 +1,436 @@
+/*
+    SSSD
+
+    Tests: Searches over multiple search bases
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <talloc.h>
+#include <tevent.h>
+#include <errno.h>
+#include <popt.h>
+#include <ldap.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "providers/ldap/ldap_opts.h"
+#include "providers/ldap/sdap_ops.c"
+
+#define TEST_MAX_BASES 4
+
+static const char *test_dns[] = { "dc=first,dc=test",
+                                  "dc=second,dc=test",
+                                  "dc=third,dc=test",
+                                  NULL };
+
+/* Every search issued by sdap_ops.c ends up here. The test then decides in
+ * which order the searches finish. */
+struct test_sdap_ops_ctx {
+    struct tevent_context *ev;
+    struct sdap_options *opts;
+    struct sdap_search_base **bases;
+
+    size_t reply_count[TEST_MAX_BASES];
+    errno_t reply_error[TEST_MAX_BASES];
+
+    struct tevent_req *searches[TEST_MAX_BASES];
+    bool cancelled[TEST_MAX_BASES];
+    size_t num_searches;
+};
+
+static struct test_sdap_ops_ctx *test_ctx;
+
+struct mock_search_state {
+    size_t base_idx;
+};
+
+static int mock_search_destructor(struct mock_search_state *state)
+{
+    test_ctx->cancelled[state->base_idx] = true;
+    return 0;
+}
+
+struct tevent_req *
+sdap_get_and_parse_generic_send(TALLOC_CTX *memctx,
+                                struct tevent_context *ev,
+                                struct sdap_options *opts,
+                                struct sdap_handle *sh,
+                                const char *search_base,
+                                int scope,
+                                const char *filter,
+                                const char **attrs,
+                                struct sdap_attr_map *map,
+                                int map_num_attrs,
+                                int attrsonly,
+                                LDAPControl **serverctrls,
+                                LDAPControl **clientctrls,
+                                int sizelimit,
+                                int timeout,
+                                bool allow_paging)
+{
+    struct tevent_req *req;
+    struct mock_search_state *state;
+    size_t i;
+
+    req = tevent_req_create(memctx, &state, struct mock_search_state);
+    assert_non_null(req);
+
+    for (i = 0; test_dns[i] != NULL; i++) {
+        if (strcmp(test_dns[i], search_base) == 0) {
+            break;
+        }
+    }
+    assert_non_null(test_dns[i]);
+
+    state->base_idx = i;
+    talloc_set_destructor(state, mock_search_destructor);
+
+    test_ctx->searches[i] = req;
+    test_ctx->num_searches++;
+
+    return req;
+}
+
+int sdap_get_and_parse_generic_recv(struct tevent_req *req,
+                                    TALLOC_CTX *mem_ctx,
+                                    size_t *reply_count,
+                                    struct sysdb_attrs ***reply)
+{
+    struct mock_search_state *state;
+    struct sysdb_attrs **attrs;
+    char *name;
+    size_t i;
+    errno_t ret;
+
+    state = tevent_req_data(req, struct mock_search_state);
+    talloc_set_destructor(state, NULL);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    attrs = talloc_zero_array(mem_ctx, struct sysdb_attrs *,
+                              test_ctx->reply_count[state->base_idx]);
+    assert_non_null(attrs);
+
+    for (i = 0; i < test_ctx->reply_count[state->base_idx]; i++) {
+        attrs[i] = sysdb_new_attrs(attrs);
+        assert_non_null(attrs[i]);
+
+        name = talloc_asprintf(attrs, "%s-%zu",
+                               test_dns[state->base_idx], i);
+        assert_non_null(name);
+
+        ret = sysdb_attrs_add_string(attrs[i], SYSDB_NAME, name);
+        assert_int_equal(ret, EOK);
+    }
+
+    *reply_count = test_ctx->reply_count[state->base_idx];
+    *reply = attrs;
+
+    return EOK;
+}
+
+static void finish_search(size_t base_idx)
+{
+    struct tevent_req *req = test_ctx->searches[base_idx];
+
+    assert_non_null(req);
+    test_ctx->searches[base_idx] = NULL;
+
+    if (test_ctx->reply_error[base_idx] != EOK) {
+        tevent_req_error(req, test_ctx->reply_error[base_idx]);
+    } else {
+        tevent_req_done(req);
+    }
+}
+
+static void assert_reply_name(struct sysdb_attrs *attrs, const char *expected)
+{
+    const char *name;
+    errno_t ret;
+
+    ret = sysdb_attrs_get_string(attrs, SYSDB_NAME, &name);
+    assert_int_equal(ret, EOK);
+    assert_string_equal(name, expected);
+}
+
+static int test_sdap_ops_setup(void **state)
+{
+    errno_t ret;
+    size_t i;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context, struct test_sdap_ops_ctx);
+    assert_non_null(test_ctx);
+
+    test_ctx->ev = tevent_context_init(test_ctx);
+    assert_non_null(test_ctx->ev);
+
+    test_ctx->opts = talloc_zero(test_ctx, struct sdap_options);
+    assert_non_null(test_ctx->opts);
+
+    ret = dp_copy_defaults(test_ctx->opts, default_basic_opts,
+                           SDAP_OPTS_BASIC, &test_ctx->opts->basic);
+    assert_int_equal(ret, EOK);
+
+    test_ctx->bases = talloc_zero_array(test_ctx, struct sdap_search_base *,
+                                        TEST_MAX_BASES);
+    assert_non_null(test_ctx->bases);
+
+    for (i = 0; test_dns[i] != NULL; i++) {
+        ret = sdap_create_search_base(test_ctx->bases, test_dns[i],
+                                      LDAP_SCOPE_SUBTREE, NULL,
+                                      &test_ctx->bases[i]);
+        assert_int_equal(ret, EOK);
+    }
+
+    check_leaks_push(test_ctx);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sdap_ops_teardown(void **state)
+{
+    assert_true(check_leaks_pop(test_ctx));
+    talloc_zfree(test_ctx);
+    assert_true(leak_check_teardown());
+    return 0;
+}
+
+static struct tevent_req *test_search(bool return_first, int parallel)
+{
+    static const char *attrs[] = { SYSDB_NAME, NULL };
+    struct tevent_req *req;
+    errno_t ret;
+
+    ret = dp_opt_set_int(test_ctx->opts->basic, SDAP_SEARCH_BASES_PARALLEL,
+                         parallel);
+    assert_int_equal(ret, EOK);
+
+    if (return_first) {
+        req = sdap_search_bases_return_first_send(test_ctx, test_ctx->ev,
+                                                  test_ctx->opts, NULL,
+                                                  test_ctx->bases, NULL,
+                                                  false, 0,
+                                                  "(objectClass=*)",
+                                                  attrs, NULL);
+    } else {
+        req = sdap_search_bases_send(test_ctx, test_ctx->ev, test_ctx->opts,
+                                     NULL, test_ctx->bases, NULL, false, 0,
+                                     "(objectClass=*)", attrs, NULL);
+    }
+    assert_non_null(req);
+
+    return req;
+}
+
+static void test_search_bases_sequential(void **state)
+{
+    struct tevent_req *req;
+    struct sysdb_attrs **reply;
+    size_t count;
+    errno_t ret;
+
+    test_ctx->reply_count[0] = 1;
+    test_ctx->reply_count[1] = 1;
+    test_ctx->reply_count[2] = 1;
+
+    req = test_search(false, 1);
+    assert_int_equal(test_ctx->num_searches, 1);
+
+    finish_search(0);
+    assert_int_equal(test_ctx->num_searches, 2);
+    finish_search(1);
+    assert_int_equal(test_ctx->num_searches, 3);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_search(2);
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = sdap_search_bases_recv(req, test_ctx, &count, &reply);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 3);
+    assert_reply_name(reply[0], "dc=first,dc=test-0");
+    assert_reply_name(reply[1], "dc=second,dc=test-0");
+    assert_reply_name(reply[2], "dc=third,dc=test-0");
+
+    talloc_free(reply);
+    talloc_free(req);
+}
+
+static void test_search_bases_parallel_merge_order(void **state)
+{
+    struct tevent_req *req;
+    struct sysdb_attrs **reply;
+    size_t count;
+    errno_t ret;
+
+    test_ctx->reply_count[0] = 1;
+    test_ctx->reply_count[1] = 2;
+    test_ctx->reply_count[2] = 1;
+
+    req = test_search(false, 3);
+    assert_int_equal(test_ctx->num_searches, 3);
+
+    /* Replies arrive in reverse order */
+    finish_search(2);
+    finish_search(1);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_search(0);
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = sdap_search_bases_recv(req, test_ctx, &count, &reply);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 4);
+    assert_reply_name(reply[0], "dc=first,dc=test-0");
+    assert_reply_name(reply[1], "dc=second,dc=test-0");
+    assert_reply_name(reply[2], "dc=second,dc=test-1");
+    assert_reply_name(reply[3], "dc=third,dc=test-0");
+
+    talloc_free(reply);
+    talloc_free(req);
+}
+
+static void test_search_bases_parallel_limit(void **state)
+{
+    struct tevent_req *req;
+    struct sysdb_attrs **reply;
+    size_t count;
+    errno_t ret;
+
+    test_ctx->reply_count[0] = 1;
+    test_ctx->reply_count[2] = 1;
+
+    req = test_search(false, 2);
+    assert_int_equal(test_ctx->num_searches, 2);
+
+    finish_search(1);
+    assert_int_equal(test_ctx->num_searches, 3);
+    finish_search(2);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_search(0);
+    assert_false(tevent_req_is_in_progress(req));
+
+    ret = sdap_search_bases_recv(req, test_ctx, &count, &reply);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 2);
+    assert_reply_name(reply[0], "dc=first,dc=test-0");
+    assert_reply_name(reply[1], "dc=third,dc=test-0");
+
+    talloc_free(reply);
+    talloc_free(req);
+}
+
+static void test_search_bases_parallel_return_first(void **state)
+{
+    struct tevent_req *req;
+    struct sysdb_attrs **reply;
+    size_t count;
+    errno_t ret;
+
+    test_ctx->reply_count[1] = 1;
+    test_ctx->reply_count[2] = 1;
+
+    req = test_search(true, 3);
+    assert_int_equal(test_ctx->num_searches, 3);
+
+    /* The second base must not win before the first one replied */
+    finish_search(1);
+    assert_true(tevent_req_is_in_progress(req));
+    finish_search(0);
+    assert_false(tevent_req_is_in_progress(req));
+
+    /* The search of the third base is no longer needed */
+    assert_true(test_ctx->cancelled[2]);
+
+    ret = sdap_search_bases_return_first_recv(req, test_ctx, &count, &reply);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 1);
+    assert_reply_name(reply[0], "dc=second,dc=test-0");
+
+    talloc_free(reply);
+    talloc_free(req);
+}
+
+static void test_search_bases_parallel_error(void **state)
+{
+    struct tevent_req *req;
+    struct sysdb_attrs **reply;
+    size_t count;
+    errno_t ret;
+
+    test_ctx->reply_count[0] = 1;
+    test_ctx->reply_error[1] = EIO;
+
+    req = test_search(false, 3);
+    assert_int_equal(test_ctx->num_searches, 3);
+
+    finish_search(1);
+    assert_false(tevent_req_is_in_progress(req));
+    assert_true(test_ctx->cancelled[0]);
+    assert_true(test_ctx->cancelled[2]);
+
+    ret = sdap_search_bases_recv(req, test_ctx, &count, &reply);
+    assert_int_equal(ret, EIO);
+
+    talloc_free(req);
+}
+
+int main(int argc, const char *argv[])
+{
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_search_bases_sequential,
+                                        test_sdap_ops_setup,
+                                        test_sdap_ops_teardown),
+        cmocka_unit_test_setup_teardown(test_search_bases_parallel_merge_order,
+                                        test_sdap_ops_setup,
+                                        test_sdap_ops_teardown),
+        cmocka_unit_test_setup_teardown(test_search_bases_parallel_limit,
+                                        test_sdap_ops_setup,
+                                        test_sdap_ops_teardown),
+        cmocka_unit_test_setup_teardown(test_search_bases_parallel_return_first,
+                                        test_sdap_ops_setup,
+                                        test_sdap_ops_teardown),
+        cmocka_unit_test_setup_teardown(test_search_bases_parallel_error,
+                                        test_sdap_ops_setup,
+                                        test_sdap_ops_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,532 @@
+/*
+    SSSD
+
+    sysdb_backend - Tests for storing the cache in different ldb backends
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DOM_NAME "test_sysdb_backend"
+
+#define TEST_USER_NAME "test_user"
+#define TEST_USER_UID  4321
+#define TEST_USER_GID  4322
+
+struct sysdb_backend_test_ctx {
+    char *ldb_file;
+    char *ts_file;
+};
+
+static struct sss_test_conf_param tdb_params[] = {
+    { CONFDB_DOMAIN_CACHE_BACKEND, CONFDB_DOMAIN_CACHE_BACKEND_TDB },
+    { NULL, NULL },
+};
+
+static struct sss_test_conf_param mdb_params[] = {
+    { CONFDB_DOMAIN_CACHE_BACKEND, CONFDB_DOMAIN_CACHE_BACKEND_MDB },
+    { NULL, NULL },
+};
+
+static struct sss_test_conf_param group_commit_params[] = {
+    { CONFDB_DOMAIN_CACHE_COMMIT_MODE, CONFDB_DOMAIN_CACHE_COMMIT_MODE_GROUP },
+    { CONFDB_DOMAIN_CACHE_COMMIT_WINDOW, "10" },
+    { NULL, NULL },
+};
+
+static struct sss_test_conf_param nosync_params[] = {
+    { CONFDB_DOMAIN_CACHE_COMMIT_MODE, CONFDB_DOMAIN_CACHE_COMMIT_MODE_NOSYNC },
+    { NULL, NULL },
+};
+
+/* ldb might be built without LMDB support */
+static bool mdb_available(void)
+{
+    struct ldb_context *ldb;
+    char *url;
+    bool ret;
+
+    ldb = ldb_init(NULL, NULL);
+    assert_non_null(ldb);
+
+    url = talloc_asprintf(ldb, "mdb://%s/mdb_probe.ldb", TESTS_PATH);
+    assert_non_null(url);
+
+    ret = (ldb_connect(ldb, url, 0, NULL) == LDB_SUCCESS);
+    talloc_free(ldb);
+
+    sysdb_remove_db_file(TESTS_PATH"/mdb_probe.ldb");
+    return ret;
+}
+
+static struct sss_test_ctx *open_domain(TALLOC_CTX *mem_ctx,
+                                        struct sss_test_conf_param *params)
+{
+    struct sss_test_ctx *tctx;
+
+    tctx = create_dom_test_ctx(mem_ctx, TESTS_PATH, TEST_CONF_DB,
+                               TEST_DOM_NAME, TEST_ID_PROVIDER, params);
+    assert_non_null(tctx);
+
+    return tctx;
+}
+
+static void add_test_user(struct sss_domain_info *dom)
+{
+    char *fqname;
+    errno_t ret;
+
+    fqname = sss_create_internal_fqname(NULL, TEST_USER_NAME, dom->name);
+    assert_non_null(fqname);
+
+    ret = sysdb_add_user(dom, fqname, TEST_USER_UID, TEST_USER_GID,
+                         NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(fqname);
+}
+
+static void assert_test_user(struct sss_domain_info *dom)
+{
+    struct ldb_result *res;
+    char *fqname;
+    errno_t ret;
+
+    fqname = sss_create_internal_fqname(NULL, TEST_USER_NAME, dom->name);
+    assert_non_null(fqname);
+
+    ret = sysdb_getpwnam(fqname, dom, fqname, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint(res->msgs[0], SYSDB_UIDNUM, 0),
+                     TEST_USER_UID);
+
+    talloc_free(fqname);
+}
+
+static void assert_special_records(struct sss_domain_info *dom)
+{
+    const char *dns[] = { "@ATTRIBUTES", "@INDEXLIST", "@MODULES", NULL };
+    struct ldb_context *ldb = sysdb_ctx_get_ldb(dom->sysdb);
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    int ret;
+    int i;
+
+    for (i = 0; dns[i] != NULL; i++) {
+        dn = ldb_dn_new(ldb, ldb, dns[i]);
+        assert_non_null(dn);
+
+        ret = ldb_search(ldb, dn, &res, dn, LDB_SCOPE_BASE, NULL, NULL);
+        assert_int_equal(ret, LDB_SUCCESS);
+        assert_int_equal(res->count, 1);
+
+        talloc_free(dn);
+    }
+}
+
+static void assert_file_backend(const char *filename,
+                                enum sss_cache_backend expected)
+{
+    enum sss_cache_backend backend;
+    errno_t ret;
+
+    ret = sysdb_get_db_file_backend(filename, &backend);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(backend, expected);
+}
+
+static int test_sysdb_backend_setup(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_backend_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    ret = sysdb_get_db_file(test_ctx, TEST_ID_PROVIDER, TEST_DOM_NAME,
+                            TESTS_PATH, &test_ctx->ldb_file,
+                            &test_ctx->ts_file);
+    assert_int_equal(ret, EOK);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_backend_teardown(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static void test_sysdb_backend_new_mdb(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+
+    if (!mdb_available()) {
+        skip();
+    }
+
+    tctx = open_domain(test_ctx, mdb_params);
+    assert_int_equal(tctx->dom->cache_backend, CACHE_BACKEND_MDB);
+    add_test_user(tctx->dom);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+
+    assert_file_backend(test_ctx->ldb_file, CACHE_BACKEND_MDB);
+    assert_file_backend(test_ctx->ts_file, CACHE_BACKEND_MDB);
+}
+
+static void test_sysdb_backend_existing_file_wins(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+
+    tctx = open_domain(test_ctx, tdb_params);
+    add_test_user(tctx->dom);
+    talloc_free(tctx);
+
+    /* Without an upgrade the cache is opened in the format it is stored in */
+    tctx = open_domain(test_ctx, mdb_params);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+
+    assert_file_backend(test_ctx->ldb_file, CACHE_BACKEND_TDB);
+}
+
+static void test_sysdb_backend_convert(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+    errno_t ret;
+
+    if (!mdb_available()) {
+        skip();
+    }
+
+    tctx = open_domain(test_ctx, tdb_params);
+    add_test_user(tctx->dom);
+    talloc_free(tctx);
+
+    ret = sysdb_upgrade_backend(test_ctx->ldb_file, CACHE_BACKEND_MDB);
+    assert_int_equal(ret, EOK);
+    assert_file_backend(test_ctx->ldb_file, CACHE_BACKEND_MDB);
+
+    /* Converting to the current backend is a no-op */
+    ret = sysdb_upgrade_backend(test_ctx->ldb_file, CACHE_BACKEND_MDB);
+    assert_int_equal(ret, EOK);
+
+    tctx = open_domain(test_ctx, mdb_params);
+    assert_test_user(tctx->dom);
+    assert_special_records(tctx->dom);
+    talloc_free(tctx);
+
+    ret = sysdb_upgrade_backend(test_ctx->ldb_file, CACHE_BACKEND_TDB);
+    assert_int_equal(ret, EOK);
+    assert_file_backend(test_ctx->ldb_file, CACHE_BACKEND_TDB);
+
+    /* The indexes and modules must survive both conversions */
+    tctx = open_domain(test_ctx, tdb_params);
+    assert_test_user(tctx->dom);
+    assert_special_records(tctx->dom);
+    talloc_free(tctx);
+}
+
+static void test_sysdb_backend_convert_missing(void **state)
+{
+    errno_t ret;
+
+    ret = sysdb_upgrade_backend(TESTS_PATH"/does_not_exist.ldb",
+                                CACHE_BACKEND_MDB);
+    assert_int_equal(ret, EOK);
+}
+
+static void test_sysdb_backend_unknown_file(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    enum sss_cache_backend backend;
+    struct ldb_context *ldb;
+    const char junk[] = "This is not a database, just a text file\n";
+    FILE *f;
+    errno_t ret;
+
+    f = fopen(test_ctx->ldb_file, "w");
+    assert_non_null(f);
+    assert_int_equal(fwrite(junk, 1, sizeof(junk), f), sizeof(junk));
+    assert_int_equal(fclose(f), 0);
+
+    ret = sysdb_get_db_file_backend(test_ctx->ldb_file, &backend);
+    assert_int_equal(ret, EINVAL);
+
+    /* The file must be neither converted nor opened */
+    ret = sysdb_upgrade_backend(test_ctx->ldb_file, CACHE_BACKEND_MDB);
+    assert_int_equal(ret, EINVAL);
+
+    ret = sysdb_ldb_connect_ext(test_ctx, test_ctx->ldb_file,
+                                CACHE_BACKEND_TDB, 0, NULL, &ldb);
+    assert_int_equal(ret, EINVAL);
+}
+
+static void test_sysdb_backend_group_commit(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+    struct sysdb_ctx *sysdb;
+
+    tctx = open_domain(test_ctx, group_commit_params);
+    sysdb = tctx->dom->sysdb;
+    assert_int_equal(sysdb->commit_mode, CACHE_COMMIT_GROUP);
+    assert_int_equal(sysdb->commit_window, 10);
+    sysdb_enable_group_commit(sysdb, tctx->ev);
+
+    /* The commit is visible at once, the flush is scheduled */
+    add_test_user(tctx->dom);
+    assert_true(sysdb->unsynced);
+    assert_non_null(sysdb->flush_te);
+    assert_test_user(tctx->dom);
+
+    /* The cache is flushed after the commit window */
+    while (sysdb->unsynced) {
+        assert_int_equal(tevent_loop_once(tctx->ev), 0);
+    }
+    assert_null(sysdb->flush_te);
+    talloc_free(tctx);
+
+    tctx = open_domain(test_ctx, NULL);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+}
+
+static void test_sysdb_backend_group_commit_cancel(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+    struct sysdb_ctx *sysdb;
+    struct sysdb_attrs *attrs;
+    struct ldb_result *res;
+    const char *gecos;
+    char *fqname;
+    errno_t ret;
+
+    tctx = open_domain(test_ctx, group_commit_params);
+    sysdb = tctx->dom->sysdb;
+    sysdb_enable_group_commit(sysdb, tctx->ev);
+
+    /* A is committed and waits for the flush */
+    add_test_user(tctx->dom);
+    assert_true(sysdb->unsynced);
+
+    fqname = sss_create_internal_fqname(tctx, TEST_USER_NAME,
+                                        tctx->dom->name);
+    assert_non_null(fqname);
+
+    /* B writes and is cancelled within the same commit window */
+    attrs = sysdb_new_attrs(tctx);
+    assert_non_null(attrs);
+    ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, "Test User");
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_set_user_attr(tctx->dom, fqname, attrs, SYSDB_MOD_REP);
+    assert_int_equal(ret, EOK);
+    ret = sysdb_transaction_cancel(sysdb);
+    assert_int_equal(ret, EOK);
+
+    /* Only B is rolled back */
+    ret = sysdb_getpwnam(tctx, tctx->dom, fqname, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    gecos = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_GECOS, NULL);
+    assert_null(gecos);
+    assert_non_null(ldb_msg_find_element(res->msgs[0], SYSDB_LAST_UPDATE));
+    assert_true(sysdb->unsynced);
+
+    while (sysdb->unsynced) {
+        assert_int_equal(tevent_loop_once(tctx->ev), 0);
+    }
+    talloc_free(tctx);
+
+    tctx = open_domain(test_ctx, NULL);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+}
+
+static void test_sysdb_backend_group_commit_sync(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+    struct sysdb_ctx *sysdb;
+    errno_t ret;
+
+    tctx = open_domain(test_ctx, group_commit_params);
+    sysdb = tctx->dom->sysdb;
+    sysdb_enable_group_commit(sysdb, tctx->ev);
+
+    /* Nothing is flushed before the outermost transaction is committed */
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    add_test_user(tctx->dom);
+    assert_false(sysdb->unsynced);
+
+    ret = sysdb_transaction_commit(sysdb);
+    assert_int_equal(ret, EOK);
+    assert_true(sysdb->unsynced);
+
+    /* An explicit flush does not wait for the commit window */
+    ret = sysdb_sync(sysdb);
+    assert_int_equal(ret, EOK);
+    assert_false(sysdb->unsynced);
+    assert_null(sysdb->flush_te);
+    talloc_free(tctx);
+
+    tctx = open_domain(test_ctx, NULL);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+}
+
+static void test_sysdb_backend_group_commit_no_ev(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+
+    /* Without an event loop every commit is flushed right away */
+    tctx = open_domain(test_ctx, group_commit_params);
+    add_test_user(tctx->dom);
+    assert_false(tctx->dom->sysdb->unsynced);
+    assert_null(tctx->dom->sysdb->flush_te);
+    talloc_free(tctx);
+}
+
+static void test_sysdb_backend_nosync(void **state)
+{
+    struct sysdb_backend_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_backend_test_ctx);
+    struct sss_test_ctx *tctx;
+
+    tctx = open_domain(test_ctx, nosync_params);
+    sysdb_enable_group_commit(tctx->dom->sysdb, tctx->ev);
+    add_test_user(tctx->dom);
+    assert_false(tctx->dom->sysdb->unsynced);
+    assert_null(tctx->dom->sysdb->flush_te);
+    talloc_free(tctx);
+
+    tctx = open_domain(test_ctx, NULL);
+    assert_test_user(tctx->dom);
+    talloc_free(tctx);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_new_mdb,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_existing_file_wins,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_convert,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_convert_missing,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_unknown_file,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_group_commit,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_group_commit_cancel,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_group_commit_sync,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_group_commit_no_ev,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_backend_nosync,
+                                        test_sysdb_backend_setup,
+                                        test_sysdb_backend_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,454 @@
+/*
+    SSSD
+
+    sysdb_ghost_store - Tests for the store of ghost members of large groups
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DOM_NAME "test_sysdb_ghost_store"
+
+#define TEST_GROUP_NAME     "test_group"
+#define TEST_GROUP_GID      1234
+#define TEST_PARENT_NAME    "test_parent"
+#define TEST_PARENT_GID     1235
+#define TEST_USER_UID       4321
+#define TEST_CACHE_TIMEOUT  5
+#define TEST_THRESHOLD      4
+/* More than two chunks of the store */
+#define TEST_LARGE_GROUP    (2 * SYSDB_GHOST_STORE_CHUNK + 44)
+
+struct sysdb_ghost_store_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct sysdb_ctx *sysdb;
+};
+
+static int test_sysdb_ghost_store_setup(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_ghost_store_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+    test_ctx->sysdb = test_ctx->tctx->dom->sysdb;
+    assert_non_null(test_ctx->sysdb->ghost_store);
+
+    /* Keep the groups of the tests small */
+    test_ctx->sysdb->ghost_store_threshold = TEST_THRESHOLD;
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_ghost_store_teardown(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static const char *ghost_name(TALLOC_CTX *mem_ctx,
+                              struct sysdb_ghost_store_test_ctx *test_ctx,
+                              const char *shortname)
+{
+    const char *name;
+
+    name = sss_create_internal_fqname(mem_ctx, shortname,
+                                      test_ctx->tctx->dom->name);
+    assert_non_null(name);
+    return name;
+}
+
+static void store_group(struct sysdb_ghost_store_test_ctx *test_ctx,
+                        const char *name, gid_t gid,
+                        const char **ghosts)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+    int i;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    for (i = 0; ghosts[i] != NULL; i++) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_GHOST,
+                                     ghost_name(attrs, test_ctx, ghosts[i]));
+        assert_int_equal(ret, EOK);
+    }
+
+    ret = sysdb_store_group(test_ctx->tctx->dom,
+                            ghost_name(attrs, test_ctx, name), gid, attrs,
+                            TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+static struct ldb_message *get_group(TALLOC_CTX *mem_ctx,
+                                     struct sysdb_ghost_store_test_ctx *test_ctx,
+                                     const char *name)
+{
+    struct ldb_result *res;
+    struct ldb_message *msg;
+    errno_t ret;
+
+    ret = sysdb_getgrnam(mem_ctx, test_ctx->tctx->dom,
+                         ghost_name(mem_ctx, test_ctx, name), &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+
+    msg = talloc_steal(mem_ctx, res->msgs[0]);
+    talloc_free(res);
+    return msg;
+}
+
+struct collect_state {
+    TALLOC_CTX *mem_ctx;
+    const char **names;
+    size_t count;
+};
+
+static errno_t collect_cb(const char *name, void *pvt)
+{
+    struct collect_state *state = pvt;
+
+    state->names = talloc_realloc(state->mem_ctx, state->names, const char *,
+                                  state->count + 1);
+    assert_non_null(state->names);
+    state->names[state->count] = talloc_strdup(state->names, name);
+    assert_non_null(state->names[state->count]);
+    state->count++;
+
+    return EOK;
+}
+
+static bool has_name(struct collect_state *state, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < state->count; i++) {
+        if (strcmp(state->names[i], name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Checks that the stored ghost members of the group are exactly ghosts */
+static void assert_stored_ghosts(struct sysdb_ghost_store_test_ctx *test_ctx,
+                                 struct ldb_message *group,
+                                 const char **ghosts)
+{
+    struct collect_state state = { 0 };
+    errno_t ret;
+    size_t i;
+
+    state.mem_ctx = talloc_new(test_ctx);
+    assert_non_null(state.mem_ctx);
+
+    ret = sysdb_ghost_store_traverse(test_ctx->tctx->dom, group,
+                                     collect_cb, &state);
+    assert_int_equal(ret, EOK);
+
+    for (i = 0; ghosts[i] != NULL; i++) {
+        assert_true(has_name(&state,
+                             ghost_name(state.mem_ctx, test_ctx, ghosts[i])));
+    }
+    assert_int_equal(state.count, i);
+
+    talloc_free(state.mem_ctx);
+}
+
+static void test_sysdb_ghost_store_small(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    const char *ghosts[] = { "g1", "g2", NULL };
+    struct ldb_message *group;
+
+    /* Groups below the threshold keep their ghost members in the entry */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_false(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_int_equal(ldb_msg_find_element(group, SYSDB_GHOST)->num_values, 2);
+    talloc_free(group);
+}
+
+static void test_sysdb_ghost_store_replace(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    const char *ghosts1[] = { "g1", "g2", "g3", "g4", "g5", NULL };
+    const char *ghosts2[] = { "g2", "g4", "g6", NULL };
+    struct ldb_message *group;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts1);
+
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_true(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_null(ldb_msg_find_element(group, SYSDB_GHOST));
+    assert_stored_ghosts(test_ctx, group, ghosts1);
+    talloc_free(group);
+
+    /* Once in the store the group stays there even if it shrinks */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts2);
+
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_true(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_null(ldb_msg_find_element(group, SYSDB_GHOST));
+    assert_stored_ghosts(test_ctx, group, ghosts2);
+    talloc_free(group);
+}
+
+static void test_sysdb_ghost_store_large(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    const char **ghosts;
+    struct ldb_message *group;
+    int i;
+
+    ghosts = talloc_zero_array(test_ctx, const char *, TEST_LARGE_GROUP + 1);
+    assert_non_null(ghosts);
+    for (i = 0; i < TEST_LARGE_GROUP; i++) {
+        ghosts[i] = talloc_asprintf(ghosts, "ghost_%d", i);
+        assert_non_null(ghosts[i]);
+    }
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_stored_ghosts(test_ctx, group, ghosts);
+    talloc_free(group);
+
+    /* Drop every other member, the chunks get holes */
+    for (i = 0; i < TEST_LARGE_GROUP / 2; i++) {
+        ghosts[i] = ghosts[2 * i];
+    }
+    ghosts[i] = NULL;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_stored_ghosts(test_ctx, group, ghosts);
+    talloc_free(group);
+
+    talloc_free(ghosts);
+}
+
+static void test_sysdb_ghost_store_resolve(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    const char *ghosts[] = { "g1", "g2", "g3", "g4", "g5", NULL };
+    const char *remaining[] = { "g1", "g2", "g4", "g5", NULL };
+    const char *none[] = { NULL };
+    struct ldb_message_element *el;
+    struct ldb_message *group;
+    struct ldb_dn *user_dn;
+    const char *user_name;
+    errno_t ret;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+
+    /* Adding the user turns the stored ghost into a real member */
+    user_name = ghost_name(test_ctx, test_ctx, "g3");
+    ret = sysdb_add_user(test_ctx->tctx->dom, user_name,
+                         TEST_USER_UID, TEST_GROUP_GID, NULL, NULL, NULL,
+                         NULL, NULL, TEST_CACHE_TIMEOUT, 0);
+    assert_int_equal(ret, EOK);
+
+    user_dn = sysdb_user_dn(test_ctx, test_ctx->tctx->dom, user_name);
+    assert_non_null(user_dn);
+
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    el = ldb_msg_find_element(group, SYSDB_MEMBER);
+    assert_non_null(el);
+    assert_int_equal(el->num_values, 1);
+    assert_string_equal((const char *) el->values[0].data,
+                        ldb_dn_get_linearized(user_dn));
+    assert_stored_ghosts(test_ctx, group, remaining);
+    talloc_free(group);
+
+    /* Deleting the group removes its stored ghost members */
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    ret = sysdb_delete_group(test_ctx->tctx->dom,
+                             ghost_name(test_ctx, test_ctx, TEST_GROUP_NAME),
+                             0);
+    assert_int_equal(ret, EOK);
+    assert_stored_ghosts(test_ctx, group, none);
+    talloc_free(group);
+
+    talloc_free(user_dn);
+}
+
+static void test_sysdb_ghost_store_nested(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    const char *ghosts[] = { "g1", "g2", "g3", "g4", "g5", NULL };
+    const char *parent_ghosts[] = { "p1", "g1", NULL };
+    const char *all_ghosts[] = { "p1", "g1", "g2", "g3", "g4", "g5", NULL };
+    struct ldb_message *group;
+    errno_t ret;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+    store_group(test_ctx, TEST_PARENT_NAME, TEST_PARENT_GID, parent_ghosts);
+
+    ret = sysdb_add_group_member(test_ctx->tctx->dom,
+                                 ghost_name(test_ctx, test_ctx,
+                                            TEST_PARENT_NAME),
+                                 ghost_name(test_ctx, test_ctx,
+                                            TEST_GROUP_NAME),
+                                 SYSDB_MEMBER_GROUP, false);
+    assert_int_equal(ret, EOK);
+
+    /* The parent keeps its own ghosts in the entry and sees the stored
+     * ghosts of the nested group */
+    group = get_group(test_ctx, test_ctx, TEST_PARENT_NAME);
+    assert_false(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_int_equal(ldb_msg_find_element(group, SYSDB_GHOST)->num_values, 2);
+    assert_stored_ghosts(test_ctx, group, ghosts);
+    talloc_free(group);
+
+    /* Names stored for both groups are reported once */
+    store_group(test_ctx, TEST_PARENT_NAME, TEST_PARENT_GID, all_ghosts);
+    group = get_group(test_ctx, test_ctx, TEST_PARENT_NAME);
+    assert_true(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_stored_ghosts(test_ctx, group, all_ghosts);
+    talloc_free(group);
+}
+
+static void test_sysdb_ghost_store_view(void **state)
+{
+    struct sysdb_ghost_store_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ghost_store_test_ctx);
+    struct sss_domain_info *dom = test_ctx->tctx->dom;
+    const char *ghosts[] = { "g1", "g2", "g3", "g4", "g5", NULL };
+    const char *none[] = { NULL };
+    struct ldb_message *group;
+    struct ldb_result *res;
+    errno_t ret;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+
+    dom->has_views = true;
+    dom->view_name = talloc_strdup(dom, "test_view");
+    assert_non_null(dom->view_name);
+
+    /* Overrides cannot be applied before the ghost members are resolved */
+    ret = sysdb_getgrnam_with_views(test_ctx, dom,
+                                    ghost_name(test_ctx, test_ctx,
+                                               TEST_GROUP_NAME),
+                                    &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 0);
+    talloc_free(res);
+
+    /* With a view the ghost members are moved back to the entry */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, ghosts);
+
+    group = get_group(test_ctx, test_ctx, TEST_GROUP_NAME);
+    assert_false(ldb_msg_find_attr_as_bool(group, SYSDB_GHOST_STORE, false));
+    assert_int_equal(ldb_msg_find_element(group, SYSDB_GHOST)->num_values, 5);
+    assert_stored_ghosts(test_ctx, group, none);
+    talloc_free(group);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_small,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_replace,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_large,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_resolve,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_nested,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ghost_store_view,
+                                        test_sysdb_ghost_store_setup,
+                                        test_sysdb_ghost_store_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,365 @@
+/*
+    SSSD
+
+    sysdb_obj_cache - Tests for the search results shared between processes
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+#include <fcntl.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DOM_NAME "test_sysdb_obj_cache"
+
+#define TEST_USER_NAME "user1"
+#define TEST_USER_UID 4321
+
+struct sysdb_obj_cache_test_ctx {
+    struct sss_test_ctx *tctx;
+    char *fqname;
+    char *cache_file;
+};
+
+static int test_sysdb_obj_cache_setup(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx;
+    errno_t ret;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_obj_cache_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->cache_file = talloc_asprintf(test_ctx,
+                                           "%s"SYSDB_OBJ_CACHE_SUFFIX,
+                                           test_ctx->tctx->dom->sysdb->ldb_file);
+    assert_non_null(test_ctx->cache_file);
+
+    test_ctx->fqname = sss_create_internal_fqname(test_ctx, TEST_USER_NAME,
+                                                  test_ctx->tctx->dom->name);
+    assert_non_null(test_ctx->fqname);
+
+    ret = sysdb_add_user(test_ctx->tctx->dom, test_ctx->fqname,
+                         TEST_USER_UID, TEST_USER_UID, "old gecos",
+                         NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_obj_cache_teardown(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+
+    unlink(test_ctx->cache_file);
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+/* Returns the gecos of the user or NULL if the user was not found */
+static const char *lookup_gecos(struct sysdb_obj_cache_test_ctx *test_ctx)
+{
+    struct ldb_result *res;
+    const char *gecos;
+    errno_t ret;
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, test_ctx->fqname,
+                         &res);
+    assert_int_equal(ret, EOK);
+
+    if (res->count == 0) {
+        talloc_free(res);
+        return NULL;
+    }
+    assert_int_equal(res->count, 1);
+
+    gecos = ldb_msg_find_attr_as_string(res->msgs[0], SYSDB_GECOS, NULL);
+    assert_non_null(gecos);
+    gecos = talloc_strdup(test_ctx, gecos);
+    assert_non_null(gecos);
+
+    talloc_free(res);
+    return gecos;
+}
+
+static void set_gecos(struct sysdb_obj_cache_test_ctx *test_ctx,
+                      const char *gecos)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, gecos);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_set_user_attr(test_ctx->tctx->dom, test_ctx->fqname, attrs,
+                              SYSDB_MOD_REP);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+static uint64_t get_seq(struct ldb_context *ldb)
+{
+    uint64_t seq;
+    int ret;
+
+    ret = ldb_sequence_number(ldb, LDB_SEQ_HIGHEST_SEQ, &seq);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    return seq;
+}
+
+/* Sets the sequence number of the cache without modifying it, the special
+ * entry holding it is the only one whose modification is not counted */
+static void rewind_seq(struct ldb_context *ldb, uint64_t seq)
+{
+    struct ldb_message *msg;
+    int ret;
+
+    msg = ldb_msg_new(NULL);
+    assert_non_null(msg);
+
+    msg->dn = ldb_dn_new(msg, ldb, "@BASEINFO");
+    assert_non_null(msg->dn);
+
+    ret = ldb_msg_add_empty(msg, "sequenceNumber", LDB_FLAG_MOD_REPLACE, NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_fmt(msg, "sequenceNumber", "%"PRIu64, seq);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    ret = ldb_modify(ldb, msg);
+    assert_int_equal(ret, LDB_SUCCESS);
+
+    talloc_free(msg);
+}
+
+static void test_sysdb_obj_cache_hit(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    struct ldb_context *ldb = test_ctx->tctx->dom->sysdb->ldb;
+    uint64_t seq;
+    errno_t ret;
+
+    ret = sysdb_obj_cache_enable(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    seq = get_seq(ldb);
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    /* With the sequence number rewound the stored result is used although
+     * the entry was modified */
+    set_gecos(test_ctx, "new gecos");
+    rewind_seq(ldb, seq);
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+}
+
+static void test_sysdb_obj_cache_modified(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    errno_t ret;
+
+    ret = sysdb_obj_cache_enable(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    set_gecos(test_ctx, "new gecos");
+    assert_string_equal(lookup_gecos(test_ctx), "new gecos");
+
+    ret = sysdb_delete_user(test_ctx->tctx->dom, test_ctx->fqname, 0);
+    assert_int_equal(ret, EOK);
+    assert_null(lookup_gecos(test_ctx));
+}
+
+static void test_sysdb_obj_cache_transaction(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    struct sysdb_ctx *sysdb = test_ctx->tctx->dom->sysdb;
+    errno_t ret;
+
+    ret = sysdb_obj_cache_enable(sysdb);
+    assert_int_equal(ret, EOK);
+
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    /* The cancelled write reuses the sequence number the uncommitted
+     * result would be stored with */
+    ret = sysdb_transaction_start(sysdb);
+    assert_int_equal(ret, EOK);
+    set_gecos(test_ctx, "uncommitted gecos");
+    assert_string_equal(lookup_gecos(test_ctx), "uncommitted gecos");
+    ret = sysdb_transaction_cancel(sysdb);
+    assert_int_equal(ret, EOK);
+
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    set_gecos(test_ctx, "new gecos");
+    assert_string_equal(lookup_gecos(test_ctx), "new gecos");
+}
+
+static void test_sysdb_obj_cache_large(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    char gecos[8192];
+    errno_t ret;
+
+    ret = sysdb_obj_cache_enable(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    /* Results which do not fit into a record are not stored */
+    memset(gecos, 'g', sizeof(gecos) - 1);
+    gecos[sizeof(gecos) - 1] = '\0';
+    set_gecos(test_ctx, gecos);
+
+    assert_string_equal(lookup_gecos(test_ctx), gecos);
+    assert_string_equal(lookup_gecos(test_ctx), gecos);
+}
+
+static void test_sysdb_obj_cache_foreign_file(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    struct ldb_context *ldb = test_ctx->tctx->dom->sysdb->ldb;
+    char garbage[100];
+    uint64_t seq;
+    ssize_t len;
+    errno_t ret;
+    int fd;
+
+    /* A file which is not a table is replaced */
+    fd = open(test_ctx->cache_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert_int_not_equal(fd, -1);
+    memset(garbage, 0xff, sizeof(garbage));
+    len = write(fd, garbage, sizeof(garbage));
+    assert_int_equal(len, sizeof(garbage));
+    close(fd);
+
+    ret = sysdb_obj_cache_enable(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    seq = get_seq(ldb);
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    set_gecos(test_ctx, "new gecos");
+    rewind_seq(ldb, seq);
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+}
+
+static void test_sysdb_obj_cache_disabled(void **state)
+{
+    struct sysdb_obj_cache_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_obj_cache_test_ctx);
+    struct ldb_context *ldb = test_ctx->tctx->dom->sysdb->ldb;
+    uint64_t seq;
+
+    seq = get_seq(ldb);
+    assert_string_equal(lookup_gecos(test_ctx), "old gecos");
+
+    set_gecos(test_ctx, "new gecos");
+    rewind_seq(ldb, seq);
+    assert_string_equal(lookup_gecos(test_ctx), "new gecos");
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_hit,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_modified,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_transaction,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_large,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_foreign_file,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_obj_cache_disabled,
+                                        test_sysdb_obj_cache_setup,
+                                        test_sysdb_obj_cache_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,415 @@
+/*
+    SSSD
+
+    sysdb_query_stats - Tests for the instrumentation of cache searches
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DOM_NAME "test_sysdb_query_stats"
+
+#define TEST_USER_UID 4321
+
+#define PWNAM_SHAPE "sub:(&(objectCategory=user)" \
+                    "(|(nameAlias=?)(nameAlias=?)(name=?)))"
+#define PWUID_SHAPE "sub:(&(objectCategory=user)(uidNumber=?))"
+#define GECOS_SHAPE "sub:(&(objectCategory=user)(gecos=*?*))"
+
+struct sysdb_query_stats_test_ctx {
+    struct sss_test_ctx *tctx;
+    char *dump_file;
+    char *other_file;
+};
+
+static struct sss_test_conf_param stats_params[] = {
+    { CONFDB_DOMAIN_CACHE_QUERY_STATS, "true" },
+    { NULL, NULL },
+};
+
+static struct sss_test_conf_param slow_params[] = {
+    { CONFDB_DOMAIN_CACHE_SLOW_QUERY_THRESHOLD, "100" },
+    { NULL, NULL },
+};
+
+static void open_domain(struct sysdb_query_stats_test_ctx *test_ctx,
+                        struct sss_test_conf_param *params)
+{
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         params);
+    assert_non_null(test_ctx->tctx);
+
+    test_ctx->dump_file = talloc_asprintf(test_ctx, "%s.stats.%s",
+                                          test_ctx->tctx->dom->sysdb->ldb_file,
+                                          debug_prg_name);
+    assert_non_null(test_ctx->dump_file);
+
+    test_ctx->other_file = talloc_asprintf(test_ctx, "%s.stats.other",
+                                          test_ctx->tctx->dom->sysdb->ldb_file);
+    assert_non_null(test_ctx->other_file);
+}
+
+static int test_sysdb_query_stats_setup(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_query_stats_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_query_stats_teardown(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+
+    if (test_ctx->dump_file != NULL) {
+        unlink(test_ctx->dump_file);
+    }
+    if (test_ctx->other_file != NULL) {
+        unlink(test_ctx->other_file);
+    }
+
+    talloc_free(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static void lookup_user(struct sss_domain_info *dom, const char *name)
+{
+    struct ldb_result *res;
+    char *fqname;
+    errno_t ret;
+
+    fqname = sss_create_internal_fqname(NULL, name, dom->name);
+    assert_non_null(fqname);
+
+    ret = sysdb_getpwnam(fqname, dom, fqname, &res);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(fqname);
+}
+
+static struct sysdb_query_shape_stats *
+find_shape(struct sysdb_query_shape_stats *stats, size_t count,
+           const char *shape)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(stats[i].shape, shape) == 0) {
+            return &stats[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns a copy of the statistics of shape, zero if it was not recorded */
+static struct sysdb_query_shape_stats
+dump_shape(struct sysdb_query_stats_test_ctx *test_ctx, const char *shape)
+{
+    struct sysdb_query_shape_stats result = { 0 };
+    struct sysdb_query_shape_stats *stats;
+    struct sysdb_query_shape_stats *found;
+    size_t count;
+    errno_t ret;
+
+    ret = sysdb_query_stats_dump(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_query_stats_read(test_ctx, test_ctx->tctx->dom->sysdb->ldb_file,
+                                 &stats, &count);
+    assert_int_equal(ret, EOK);
+
+    found = find_shape(stats, count, shape);
+    if (found != NULL) {
+        result = *found;
+        result.shape = NULL;
+    }
+
+    talloc_free(stats);
+    return result;
+}
+
+static void test_sysdb_query_stats_shapes(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+    struct sysdb_query_shape_stats before_nam;
+    struct sysdb_query_shape_stats before_uid;
+    struct sysdb_query_shape_stats shape;
+    struct sysdb_query_shape_stats *stats;
+    struct sss_domain_info *dom;
+    struct ldb_result *res;
+    char *fqname;
+    size_t count;
+    size_t i;
+    errno_t ret;
+
+    open_domain(test_ctx, stats_params);
+    dom = test_ctx->tctx->dom;
+
+    fqname = sss_create_internal_fqname(test_ctx, "user1", dom->name);
+    assert_non_null(fqname);
+    ret = sysdb_add_user(dom, fqname, TEST_USER_UID, TEST_USER_UID,
+                         NULL, NULL, NULL, NULL, NULL, 0, 0);
+    assert_int_equal(ret, EOK);
+
+    /* Adding the user searched the cache as well */
+    before_nam = dump_shape(test_ctx, PWNAM_SHAPE);
+    before_uid = dump_shape(test_ctx, PWUID_SHAPE);
+
+    /* Searches for different names have the same shape */
+    lookup_user(dom, "user1");
+    lookup_user(dom, "user2");
+    ret = sysdb_getpwuid(test_ctx, dom, TEST_USER_UID, &res);
+    assert_int_equal(ret, EOK);
+
+    shape = dump_shape(test_ctx, PWNAM_SHAPE);
+    assert_int_equal(shape.count - before_nam.count, 2);
+    assert_int_equal(shape.entries - before_nam.entries, 1);
+    assert_false(shape.unindexed);
+
+    shape = dump_shape(test_ctx, PWUID_SHAPE);
+    assert_int_equal(shape.count - before_uid.count, 1);
+    assert_int_equal(shape.entries - before_uid.entries, 1);
+    assert_false(shape.unindexed);
+
+    ret = sysdb_query_stats_read(test_ctx, dom->sysdb->ldb_file,
+                                 &stats, &count);
+    assert_int_equal(ret, EOK);
+
+    /* No asserted value makes it into the statistics */
+    for (i = 0; i < count; i++) {
+        assert_null(strstr(stats[i].shape, "user1"));
+        assert_null(strstr(stats[i].shape, "user2"));
+    }
+
+    /* Sorted by the time spent */
+    for (i = 1; i < count; i++) {
+        assert_true(stats[i - 1].total_us >= stats[i].total_us);
+    }
+}
+
+static void test_sysdb_query_stats_unindexed(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+    struct sysdb_query_shape_stats shape;
+    struct ldb_message **msgs;
+    size_t msgs_count;
+    errno_t ret;
+
+    open_domain(test_ctx, stats_params);
+
+    ret = sysdb_search_users(test_ctx, test_ctx->tctx->dom,
+                             "("SYSDB_GECOS"=*admin*)", NULL,
+                             &msgs_count, &msgs);
+    assert_int_equal(ret, ENOENT);
+
+    shape = dump_shape(test_ctx, GECOS_SHAPE);
+    assert_int_equal(shape.count, 1);
+    assert_int_equal(shape.entries, 0);
+    assert_true(shape.unindexed);
+}
+
+static void test_sysdb_query_stats_merge(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+    struct sysdb_query_shape_stats *stats;
+    struct sysdb_query_shape_stats *shape;
+    size_t count;
+    FILE *f;
+    errno_t ret;
+
+    open_domain(test_ctx, stats_params);
+    lookup_user(test_ctx->tctx->dom, "user1");
+
+    ret = sysdb_query_stats_dump(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    /* Statistics of another process */
+    f = fopen(test_ctx->other_file, "w");
+    assert_non_null(f);
+    fprintf(f, "3\t9000000\t5000000\t30\t0\t%s\n", PWNAM_SHAPE);
+    fprintf(f, "malformed line\n");
+    fprintf(f, "1\t10\t10\t0\t1\tsub:(other=*)\n");
+    assert_int_equal(fclose(f), 0);
+
+    ret = sysdb_query_stats_read(test_ctx, test_ctx->tctx->dom->sysdb->ldb_file,
+                                 &stats, &count);
+    assert_int_equal(ret, EOK);
+
+    /* The slowest shape comes first */
+    shape = &stats[0];
+    assert_string_equal(shape->shape, PWNAM_SHAPE);
+    assert_int_equal(shape->count, 4);
+    assert_int_equal(shape->max_us, 5000000);
+    assert_int_equal(shape->entries, 30);
+
+    shape = find_shape(stats, count, "sub:(other=*)");
+    assert_non_null(shape);
+    assert_true(shape->unindexed);
+}
+
+static void test_sysdb_query_stats_slow_only(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+    struct sysdb_query_shape_stats *stats;
+    size_t count;
+    errno_t ret;
+
+    /* The slow query log alone does not aggregate the searches */
+    open_domain(test_ctx, slow_params);
+    assert_non_null(test_ctx->tctx->dom->sysdb->query_stats);
+    lookup_user(test_ctx->tctx->dom, "user1");
+
+    ret = sysdb_query_stats_dump(test_ctx->tctx->dom->sysdb);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_query_stats_read(test_ctx, test_ctx->tctx->dom->sysdb->ldb_file,
+                                 &stats, &count);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(count, 0);
+}
+
+static void test_sysdb_query_stats_shutdown(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+    struct sysdb_query_shape_stats *stats;
+    struct sysdb_query_shape_stats *found;
+    char *ldb_file;
+    size_t count;
+    errno_t ret;
+
+    open_domain(test_ctx, stats_params);
+    ldb_file = talloc_strdup(test_ctx, test_ctx->tctx->dom->sysdb->ldb_file);
+    assert_non_null(ldb_file);
+
+    /* Nothing is written before the first dump interval expires */
+    lookup_user(test_ctx->tctx->dom, "user1");
+    assert_int_equal(access(test_ctx->dump_file, F_OK), -1);
+
+    /* The last searches are written when the sysdb context is freed */
+    talloc_zfree(test_ctx->tctx);
+    assert_int_equal(access(test_ctx->dump_file, F_OK), 0);
+
+    ret = sysdb_query_stats_read(test_ctx, ldb_file, &stats, &count);
+    assert_int_equal(ret, EOK);
+    found = find_shape(stats, count, PWNAM_SHAPE);
+    assert_non_null(found);
+    assert_true(found->count >= 1);
+
+    talloc_free(stats);
+    talloc_free(ldb_file);
+}
+
+static void test_sysdb_query_stats_disabled(void **state)
+{
+    struct sysdb_query_stats_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_query_stats_test_ctx);
+
+    open_domain(test_ctx, NULL);
+    assert_null(test_ctx->tctx->dom->sysdb->query_stats);
+    lookup_user(test_ctx->tctx->dom, "user1");
+
+    assert_int_equal(sysdb_query_stats_dump(test_ctx->tctx->dom->sysdb), EOK);
+    assert_int_equal(access(test_ctx->dump_file, F_OK), -1);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_shapes,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_unindexed,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_merge,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_slow_only,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_shutdown,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_query_stats_disabled,
+                                        test_sysdb_query_stats_setup,
+                                        test_sysdb_query_stats_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -0,0 +1,487 @@
+/*
+    SSSD
+
+    sysdb_ts_map - Tests for the memory mapped copy of the timestamp cache
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <popt.h>
+
+#include "tests/cmocka/common_mock.h"
+#include "db/sysdb_private.h"
+
+#define TESTS_PATH "tp_" BASE_FILE_STEM
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_ID_PROVIDER "ldap"
+#define TEST_DOM_NAME "test_sysdb_ts_map"
+
+#define TEST_GROUP_NAME     "test_group"
+#define TEST_GROUP_GID      1234
+#define TEST_USER_NAME      "test_user"
+#define TEST_USER_UID       4321
+#define TEST_USER_GID       4322
+
+#define TEST_MODSTAMP_1     "20160408132553Z"
+#define TEST_CACHE_TIMEOUT  5
+#define TEST_NOW_1          100
+#define TEST_NOW_2          200
+
+struct sysdb_ts_map_test_ctx {
+    struct sss_test_ctx *tctx;
+    struct sysdb_ctx *sysdb;
+};
+
+static int test_sysdb_ts_map_setup(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx;
+
+    assert_true(leak_check_setup());
+
+    test_ctx = talloc_zero(global_talloc_context,
+                           struct sysdb_ts_map_test_ctx);
+    assert_non_null(test_ctx);
+
+    test_dom_suite_setup(TESTS_PATH);
+
+    test_ctx->tctx = create_dom_test_ctx(test_ctx, TESTS_PATH, TEST_CONF_DB,
+                                         TEST_DOM_NAME, TEST_ID_PROVIDER,
+                                         NULL);
+    assert_non_null(test_ctx->tctx);
+    test_ctx->sysdb = test_ctx->tctx->dom->sysdb;
+    assert_non_null(test_ctx->sysdb->ts_map);
+
+    *state = test_ctx;
+    return 0;
+}
+
+static int test_sysdb_ts_map_teardown(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+
+    talloc_zfree(test_ctx);
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return 0;
+}
+
+static void store_group(struct sysdb_ts_map_test_ctx *test_ctx,
+                        const char *name, gid_t gid, time_t now)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(test_ctx);
+    assert_non_null(attrs);
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_ORIG_MODSTAMP, TEST_MODSTAMP_1);
+    assert_int_equal(ret, EOK);
+
+    ret = sysdb_store_group(test_ctx->tctx->dom, name, gid, attrs,
+                            TEST_CACHE_TIMEOUT, now);
+    assert_int_equal(ret, EOK);
+
+    talloc_free(attrs);
+}
+
+/* Returns the cache expiration stored in the map, 0 if it's not there */
+static uint64_t map_expire(struct sysdb_ts_map_test_ctx *test_ctx,
+                           struct sysdb_ts_map *map,
+                           struct ldb_dn *dn)
+{
+    struct ldb_message *msg;
+    uint64_t expire;
+    errno_t ret;
+
+    ret = sysdb_ts_map_get(test_ctx, map, dn, &msg);
+    if (ret == ENOENT) {
+        return 0;
+    }
+    assert_int_equal(ret, EOK);
+
+    expire = ldb_msg_find_attr_as_uint64(msg, SYSDB_CACHE_EXPIRE, 0);
+    talloc_free(msg);
+    return expire;
+}
+
+/* Returns the cache expiration stored in the timestamp cache itself */
+static uint64_t ts_expire(struct sysdb_ts_map_test_ctx *test_ctx,
+                          struct ldb_dn *dn)
+{
+    const char *attrs[] = { SYSDB_CACHE_EXPIRE, NULL };
+    struct ldb_result *res;
+    uint64_t expire;
+    errno_t ret;
+
+    ret = ldb_search(test_ctx->sysdb->ldb_ts, test_ctx, &res, dn,
+                     LDB_SCOPE_BASE, attrs, NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    assert_int_equal(res->count, 1);
+
+    expire = ldb_msg_find_attr_as_uint64(res->msgs[0], SYSDB_CACHE_EXPIRE, 0);
+    talloc_free(res);
+    return expire;
+}
+
+/* The map must hold exactly what the timestamp cache holds */
+static void assert_map_matches_ts(struct sysdb_ts_map_test_ctx *test_ctx,
+                                  struct ldb_dn *dn)
+{
+    const char *attrs[] = { SYSDB_LAST_UPDATE, SYSDB_CACHE_EXPIRE,
+                            SYSDB_ORIG_MODSTAMP, SYSDB_INITGR_EXPIRE,
+                            SYSDB_USN, NULL };
+    struct ldb_message *msg;
+    struct ldb_result *res;
+    errno_t ret;
+    int i;
+
+    ret = sysdb_ts_map_get(test_ctx, test_ctx->sysdb->ts_map, dn, &msg);
+    assert_int_equal(ret, EOK);
+
+    ret = ldb_search(test_ctx->sysdb->ldb_ts, test_ctx, &res, dn,
+                     LDB_SCOPE_BASE, attrs, NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    assert_int_equal(res->count, 1);
+
+    for (i = 0; attrs[i] != NULL; i++) {
+        assert_string_equal(
+                ldb_msg_find_attr_as_string(msg, attrs[i], "none"),
+                ldb_msg_find_attr_as_string(res->msgs[0], attrs[i], "none"));
+    }
+
+    talloc_free(msg);
+    talloc_free(res);
+}
+
+static void test_sysdb_ts_map_update(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+    struct ldb_dn *dn;
+    errno_t ret;
+
+    dn = sysdb_group_dn(test_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME);
+    assert_non_null(dn);
+    assert_int_equal(map_expire(test_ctx, test_ctx->sysdb->ts_map, dn), 0);
+
+    /* Creating the entry adds it to the map */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_1);
+    assert_int_equal(map_expire(test_ctx, test_ctx->sysdb->ts_map, dn),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+    assert_map_matches_ts(test_ctx, dn);
+
+    /* A refresh only touches the timestamps, they are updated in the map
+     * alone until they are written back */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_2);
+    assert_int_equal(map_expire(test_ctx, test_ctx->sysdb->ts_map, dn),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+    assert_int_equal(ts_expire(test_ctx, dn),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+
+    ret = sysdb_ts_map_flush(test_ctx->sysdb, NULL);
+    assert_int_equal(ret, EOK);
+    assert_map_matches_ts(test_ctx, dn);
+
+    ret = sysdb_invalidate_cache_entry(test_ctx->tctx->dom, TEST_GROUP_NAME,
+                                       false);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(map_expire(test_ctx, test_ctx->sysdb->ts_map, dn), 1);
+
+    ret = sysdb_ts_map_flush(test_ctx->sysdb, dn);
+    assert_int_equal(ret, EOK);
+    assert_map_matches_ts(test_ctx, dn);
+
+    /* Deleting an entry with deferred timestamps drops them */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_2);
+
+    ret = sysdb_delete_group(test_ctx->tctx->dom, TEST_GROUP_NAME, 0);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(map_expire(test_ctx, test_ctx->sysdb->ts_map, dn), 0);
+
+    talloc_free(dn);
+}
+
+static void test_sysdb_ts_map_merge(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+    struct ldb_result *res;
+    struct ldb_message *msg;
+    struct ldb_dn *dn;
+    errno_t ret;
+
+    ret = sysdb_store_user(test_ctx->tctx->dom, TEST_USER_NAME, NULL,
+                           TEST_USER_UID, TEST_USER_GID, TEST_USER_NAME,
+                           "/home/"TEST_USER_NAME, "/bin/bash", NULL,
+                           NULL, NULL, TEST_CACHE_TIMEOUT, TEST_NOW_1);
+    assert_int_equal(ret, EOK);
+
+    dn = sysdb_user_dn(test_ctx, test_ctx->tctx->dom, TEST_USER_NAME);
+    assert_non_null(dn);
+
+    /* Change the timestamp cache behind the map's back to see where the
+     * merged values come from */
+    msg = ldb_msg_new(test_ctx);
+    assert_non_null(msg);
+    msg->dn = dn;
+    ret = ldb_msg_add_empty(msg, SYSDB_CACHE_EXPIRE, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(msg, SYSDB_CACHE_EXPIRE, "42");
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_modify(test_ctx->sysdb->ldb_ts, msg);
+    assert_int_equal(ret, LDB_SUCCESS);
+    msg->elements[0].flags = 0;
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, TEST_USER_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+    talloc_free(res);
+
+    /* A failed write does not change anything, the record stays valid */
+    ret = sysdb_ts_ldb_add(test_ctx->sysdb, msg);
+    assert_int_equal(ret, LDB_ERR_ENTRY_ALREADY_EXISTS);
+
+    ret = sysdb_getpwnam(test_ctx, test_ctx->tctx->dom, TEST_USER_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+    talloc_free(res);
+
+    talloc_free(msg);
+}
+
+static void test_sysdb_ts_map_shared(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+    struct sysdb_ts_map *other;
+    struct ldb_dn *dn;
+    char *name;
+    errno_t ret;
+    int i;
+
+    /* Another process attaching to the same map, e.g. a responder */
+    ret = sysdb_ts_map_open(test_ctx, test_ctx->sysdb->ldb_ts_file, &other);
+    assert_int_equal(ret, EOK);
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_1);
+    dn = sysdb_group_dn(test_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME);
+    assert_non_null(dn);
+    assert_int_equal(map_expire(test_ctx, other, dn),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+
+    /* Fill the map beyond its initial size so it has to be replaced by a
+     * bigger one, the other user must follow */
+    ret = sysdb_transaction_start(test_ctx->sysdb);
+    assert_int_equal(ret, EOK);
+    for (i = 0; i < SYSDB_TS_MAP_MIN_SLOTS; i++) {
+        name = talloc_asprintf(test_ctx, "grow_group_%d", i);
+        assert_non_null(name);
+        store_group(test_ctx, name, TEST_GROUP_GID + 1 + i, TEST_NOW_1);
+        talloc_free(name);
+    }
+    ret = sysdb_transaction_commit(test_ctx->sysdb);
+    assert_int_equal(ret, EOK);
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_2);
+    assert_int_equal(map_expire(test_ctx, other, dn),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+
+    ret = sysdb_ts_map_flush(test_ctx->sysdb, NULL);
+    assert_int_equal(ret, EOK);
+    assert_map_matches_ts(test_ctx, dn);
+
+    for (i = 0; i < SYSDB_TS_MAP_MIN_SLOTS; i++) {
+        name = talloc_asprintf(test_ctx, "grow_group_%d", i);
+        assert_non_null(name);
+        talloc_free(dn);
+        dn = sysdb_group_dn(test_ctx, test_ctx->tctx->dom, name);
+        assert_non_null(dn);
+        assert_int_equal(map_expire(test_ctx, other, dn),
+                         TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+        talloc_free(name);
+    }
+
+    talloc_free(dn);
+    talloc_free(other);
+}
+
+static void test_sysdb_ts_map_deferred(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+    struct ldb_message *msg;
+    struct ldb_result res;
+    struct ldb_dn *dn;
+    errno_t ret;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_1);
+    dn = sysdb_group_dn(test_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME);
+    assert_non_null(dn);
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_2);
+    assert_int_equal(ts_expire(test_ctx, dn),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+
+    /* Searching the timestamp cache by the timestamps writes the deferred
+     * values back first */
+    ret = sysdb_search_ts_groups(test_ctx, test_ctx->tctx->dom,
+                                 "("SYSDB_CACHE_EXPIRE">=205)", NULL, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res.count, 1);
+    talloc_free(res.msgs);
+    assert_map_matches_ts(test_ctx, dn);
+
+    /* A modification which is not timestamp-only is written to the
+     * timestamp cache on top of the deferred values */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_1);
+    assert_int_equal(ts_expire(test_ctx, dn),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+
+    msg = ldb_msg_new(test_ctx);
+    assert_non_null(msg);
+    msg->dn = dn;
+    ret = ldb_msg_add_empty(msg, SYSDB_OBJECTCATEGORY, LDB_FLAG_MOD_REPLACE,
+                            NULL);
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = ldb_msg_add_string(msg, SYSDB_OBJECTCATEGORY, SYSDB_GROUP_CLASS);
+    assert_int_equal(ret, LDB_SUCCESS);
+    ret = sysdb_ts_ldb_modify(test_ctx->sysdb, msg);
+    assert_int_equal(ret, LDB_SUCCESS);
+    talloc_free(msg);
+
+    assert_int_equal(ts_expire(test_ctx, dn),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+    assert_map_matches_ts(test_ctx, dn);
+
+    talloc_free(dn);
+}
+
+static void test_sysdb_ts_map_corrupted(void **state)
+{
+    struct sysdb_ts_map_test_ctx *test_ctx =
+        talloc_get_type_abort(*state, struct sysdb_ts_map_test_ctx);
+    struct sysdb_ts_map *other;
+    struct ldb_result *res;
+    struct ldb_dn *dn;
+    char *map_file;
+    errno_t ret;
+    FILE *f;
+
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_1);
+    dn = sysdb_group_dn(test_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME);
+    assert_non_null(dn);
+
+    /* A map with a broken header is replaced by an empty one */
+    map_file = talloc_asprintf(test_ctx, "%s"SYSDB_TS_MAP_SUFFIX,
+                               test_ctx->sysdb->ldb_ts_file);
+    assert_non_null(map_file);
+    f = fopen(map_file, "r+");
+    assert_non_null(f);
+    fprintf(f, "this is not a timestamp map");
+    fclose(f);
+
+    ret = sysdb_ts_map_open(test_ctx, test_ctx->sysdb->ldb_ts_file, &other);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(map_expire(test_ctx, other, dn), 0);
+
+    /* The entry is still found in the timestamp cache */
+    ret = sysdb_getgrnam(test_ctx, test_ctx->tctx->dom, TEST_GROUP_NAME, &res);
+    assert_int_equal(ret, EOK);
+    assert_int_equal(res->count, 1);
+    assert_int_equal(ldb_msg_find_attr_as_uint64(res->msgs[0],
+                                                 SYSDB_CACHE_EXPIRE, 0),
+                     TEST_NOW_1 + TEST_CACHE_TIMEOUT);
+    talloc_free(res);
+
+    /* And added back to the map on the next update */
+    store_group(test_ctx, TEST_GROUP_NAME, TEST_GROUP_GID, TEST_NOW_2);
+    assert_int_equal(map_expire(test_ctx, other, dn),
+                     TEST_NOW_2 + TEST_CACHE_TIMEOUT);
+    assert_map_matches_ts(test_ctx, dn);
+
+    talloc_free(other);
+    talloc_free(map_file);
+    talloc_free(dn);
+}
+
+int main(int argc, const char *argv[])
+{
+    int rv;
+    int no_cleanup = 0;
+    poptContext pc;
+    int opt;
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        {"no-cleanup", 'n', POPT_ARG_NONE, &no_cleanup, 0,
+         _("Do not delete the test database after a test run"), NULL },
+        POPT_TABLEEND
+    };
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_map_update,
+                                        test_sysdb_ts_map_setup,
+                                        test_sysdb_ts_map_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_map_merge,
+                                        test_sysdb_ts_map_setup,
+                                        test_sysdb_ts_map_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_map_shared,
+                                        test_sysdb_ts_map_setup,
+                                        test_sysdb_ts_map_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_map_deferred,
+                                        test_sysdb_ts_map_setup,
+                                        test_sysdb_ts_map_teardown),
+        cmocka_unit_test_setup_teardown(test_sysdb_ts_map_corrupted,
+                                        test_sysdb_ts_map_setup,
+                                        test_sysdb_ts_map_teardown),
+    };
+
+    /* Set debug level to invalid value so we can decide if -d 0 was used. */
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while((opt = poptGetNextOpt(pc)) != -1) {
+        switch(opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+    rv = cmocka_run_group_tests(tests, NULL, NULL);
+
+    if (rv == 0 && no_cleanup == 0) {
+        test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    }
+    return rv;
+}
@@ -362,19 +362,15 @@ void test_multidom_suite_cleanup(const char *tests_path,
                 goto done;
             }
 
-            errno = 0;
-            ret = unlink(sysdb_path);
-            if (ret != 0 && errno != ENOENT) {
-                ret = errno;
+            ret = sysdb_remove_db_file(sysdb_path);
+            if (ret != EOK) {
                 DEBUG(SSSDBG_CRIT_FAILURE, "Could not delete the test domain "
                       "ldb file [%d]: (%s)\n", ret, sss_strerror(ret));
             }
 
             if (sysdb_ts_path) {
-                errno = 0;
-                ret = unlink(sysdb_ts_path);
-                if (ret != 0 && errno != ENOENT) {
-                    ret = errno;
+                ret = sysdb_remove_db_file(sysdb_ts_path);
+                if (ret != EOK) {
                     DEBUG(SSSDBG_CRIT_FAILURE, "Could not delete the test domain "
                         "ldb timestamp file [%d]: (%s)\n", ret, sss_strerror(ret));
                 }
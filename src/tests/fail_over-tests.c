@@ -58,7 +58,7 @@ struct task {
 };
 
 static struct test_ctx *
-setup_test(void)
+setup_test_ext(bool prefer_faster_servers)
 {
     struct test_ctx *ctx;
     struct fo_options fopts;
@@ -82,6 +82,7 @@ setup_test(void)
     memset(&fopts, 0, sizeof(fopts));
     fopts.retry_timeout = 30;
     fopts.family_order  = IPV4_FIRST;
+    fopts.prefer_faster_servers = prefer_faster_servers;
 
     ctx->fo_ctx = fo_context_init(ctx, &fopts);
     if (ctx->fo_ctx == NULL) {
@@ -92,6 +93,12 @@ setup_test(void)
     return ctx;
 }
 
+static struct test_ctx *
+setup_test(void)
+{
+    return setup_test_ext(false);
+}
+
 static void
 test_loop(struct test_ctx *data)
 {
@@ -289,6 +296,221 @@ START_TEST(test_fo_resolve_service)
 }
 END_TEST
 
+static void
+report_latency(struct fo_server *server, uint64_t latency, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        fo_server_report_latency(server, FO_LATENCY_LDAP_REPLY, latency);
+    }
+}
+
+START_TEST(test_fo_latency_selection)
+{
+    struct test_ctx *ctx;
+    struct fo_service *service;
+    struct fo_server *slow;
+    struct fo_server *fast;
+    struct fo_server *backup;
+    int ret;
+
+    ctx = setup_test_ext(true);
+    sss_ck_fail_if_msg(ctx == NULL, "Failed to allocate memory");
+
+    ret = fo_new_service(ctx->fo_ctx, "ldap", NULL, &service);
+    sss_ck_fail_if_msg(ret != EOK, "fo_new_service failed with error: %d", ret);
+
+    ret = fo_add_server(service, "127.0.0.1", 389, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+    ret = fo_add_server(service, "127.0.0.1", 390, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+    ret = fo_add_server(service, "127.0.0.1", 391, NULL, false);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+
+    /* Without latency information the configured order is used */
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    slow = fo_get_active_server(service);
+    sss_ck_fail_if_msg(slow == NULL, "Missing active server");
+    fast = fo_server_next(slow);
+    sss_ck_fail_if_msg(fast == NULL, "Missing second server");
+    backup = fo_server_next(fast);
+    sss_ck_fail_if_msg(backup == NULL, "Missing backup server");
+
+    /* Not enough samples for the faster server yet */
+    report_latency(slow, 100000, 3);
+    report_latency(fast, 10000, 1);
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    /* The faster primary server is preferred over the active one */
+    report_latency(fast, 10000, 2);
+    sss_ck_fail_if_msg(fo_get_server_latency(slow, FO_LATENCY_LDAP_REPLY)
+                            != 100000,
+                       "Unexpected latency of the slow server");
+    sss_ck_fail_if_msg(fo_get_server_latency(fast, FO_LATENCY_LDAP_REPLY)
+                            != 10000,
+                       "Unexpected latency of the fast server");
+    sss_ck_fail_if_msg(fo_get_server_latency(fast, FO_LATENCY_CONNECT) != 0,
+                       "Unexpected connect latency of the fast server");
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    /* A backup server is never preferred over a primary one */
+    report_latency(backup, 1, 3);
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    /* Similar response times do not cause switching back */
+    report_latency(fast, 80000, 10);
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    /* A broken server is not selected no matter how fast it was */
+    report_latency(fast, 500000, 10);
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+    fo_set_port_status(slow, PORT_NOT_WORKING);
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    talloc_free(ctx);
+}
+END_TEST
+
+START_TEST(test_fo_latency_kinds)
+{
+    struct test_ctx *ctx;
+    struct fo_service *service;
+    struct fo_server *first;
+    struct fo_server *second;
+    int ret;
+    int i;
+
+    ctx = setup_test_ext(true);
+    sss_ck_fail_if_msg(ctx == NULL, "Failed to allocate memory");
+
+    ret = fo_new_service(ctx->fo_ctx, "ldap", NULL, &service);
+    sss_ck_fail_if_msg(ret != EOK, "fo_new_service failed with error: %d", ret);
+
+    ret = fo_add_server(service, "127.0.0.1", 389, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+    ret = fo_add_server(service, "127.0.0.1", 390, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    first = fo_get_active_server(service);
+    sss_ck_fail_if_msg(first == NULL, "Missing active server");
+    second = fo_server_next(first);
+    sss_ck_fail_if_msg(second == NULL, "Missing second server");
+
+    /* A slow authentication of the active server must not be compared
+     * with a quick TCP connect to the other one */
+    for (i = 0; i < 3; i++) {
+        fo_server_report_latency(first, FO_LATENCY_KRB5_AUTH, 300000);
+        fo_server_report_latency(second, FO_LATENCY_CONNECT, 1000);
+    }
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    /* Once both have samples of the same kind they are compared */
+    for (i = 0; i < 3; i++) {
+        fo_server_report_latency(first, FO_LATENCY_CONNECT, 1000);
+        fo_server_report_latency(second, FO_LATENCY_KRB5_AUTH, 100000);
+    }
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    for (i = 0; i < 3; i++) {
+        fo_server_report_latency(first, FO_LATENCY_CONNECT, 10000);
+    }
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    talloc_free(ctx);
+}
+END_TEST
+
+/* Fake server which answers after a delay derived from its port */
+static struct tevent_req *
+test_probe_send(TALLOC_CTX *mem_ctx,
+                struct tevent_context *ev,
+                struct fo_server *server,
+                void *pvt)
+{
+    int port = fo_get_server_port(server);
+
+    return tevent_wakeup_send(mem_ctx, ev,
+                tevent_timeval_current_ofs(0, port == 389 ? 50000 : 5000));
+}
+
+static errno_t
+test_probe_recv(struct tevent_req *req)
+{
+    return tevent_wakeup_recv(req) ? EOK : EIO;
+}
+
+static void
+test_probe_done(struct tevent_req *req)
+{
+    struct test_ctx *ctx;
+    errno_t ret;
+
+    ctx = tevent_req_callback_data(req, struct test_ctx);
+    ctx->tasks--;
+
+    ret = fo_probe_service_recv(req);
+    talloc_free(req);
+    sss_ck_fail_if_msg(ret != EOK, "fo_probe_service_recv failed: %d", ret);
+}
+
+START_TEST(test_fo_probe_service)
+{
+    struct test_ctx *ctx;
+    struct fo_service *service;
+    struct fo_server *slow;
+    struct fo_server *fast;
+    struct tevent_req *req;
+    bool bret;
+    int ret;
+    int i;
+
+    ctx = setup_test_ext(true);
+    sss_ck_fail_if_msg(ctx == NULL, "Failed to allocate memory");
+
+    bret = fo_set_probe_plugin(ctx->fo_ctx, test_probe_send,
+                               test_probe_recv, NULL);
+    sss_ck_fail_if_msg(bret != true, "fo_set_probe_plugin failed");
+
+    ret = fo_new_service(ctx->fo_ctx, "ldap", NULL, &service);
+    sss_ck_fail_if_msg(ret != EOK, "fo_new_service failed with error: %d", ret);
+
+    ret = fo_add_server(service, "127.0.0.1", 389, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+    ret = fo_add_server(service, "127.0.0.1", 390, NULL, true);
+    sss_ck_fail_if_msg(ret != EOK, "fo_add_server failed with error: %d", ret);
+
+    /* Resolve the servers so that they can be probed */
+    get_request(ctx, service, EOK, 389, PORT_WORKING, -1);
+
+    slow = fo_get_active_server(service);
+    fast = fo_server_next(slow);
+
+    for (i = 0; i < 3; i++) {
+        req = fo_probe_service_send(ctx, ctx->ev, service);
+        sss_ck_fail_if_msg(req == NULL, "fo_probe_service_send failed");
+        tevent_req_set_callback(req, test_probe_done, ctx);
+        ctx->tasks++;
+        test_loop(ctx);
+    }
+
+    sss_ck_fail_if_msg(fo_get_server_latency(slow, FO_LATENCY_CONNECT) == 0,
+                       "Missing latency of the slow server");
+    sss_ck_fail_if_msg(fo_get_server_latency(fast, FO_LATENCY_CONNECT) == 0,
+                       "Missing latency of the fast server");
+    sss_ck_fail_if_msg(fo_get_server_latency(slow, FO_LATENCY_CONNECT)
+                            <= fo_get_server_latency(fast, FO_LATENCY_CONNECT),
+                       "Slow server reported faster than the fast one");
+
+    get_request(ctx, service, EOK, 390, PORT_WORKING, -1);
+
+    talloc_free(ctx);
+}
+END_TEST
+
 Suite *
 create_suite(void)
 {
@@ -300,6 +522,9 @@ create_suite(void)
     /* Do some testing */
     tcase_add_test(tc, test_fo_new_service);
     tcase_add_test(tc, test_fo_resolve_service);
+    tcase_add_test(tc, test_fo_latency_selection);
+    tcase_add_test(tc, test_fo_latency_kinds);
+    tcase_add_test(tc, test_fo_probe_service);
     if (use_net_test) {
     }
     /* Add all test cases to the test suite */
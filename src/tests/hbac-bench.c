@@ -0,0 +1,306 @@
+/*
+   SSSD
+
+   HBAC benchmark: cost of evaluating a large rule set for a user who is a
+   member of many groups, with and without compiling the rules
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   hbac-bench --rules=2000 --groups=800 --requests=1000
+ *
+ * Every rule applies to one user group and one service. The user is a
+ * member of --groups groups, half of them are used by the rules, and only
+ * the last rule allows the requested service. The program measures:
+ *   per-rule - --requests calls of hbac_evaluate(), which checks the rules
+ *              one by one until one of them matches
+ *   compile  - one call of hbac_compile_rules()
+ *   compiled - --requests calls of hbac_evaluate_compiled()
+ */
+
+#include <stdlib.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "lib/ipa_hbac/ipa_hbac.h"
+
+#define BENCH_SERVICE "sshd"
+
+static struct hbac_rule_element *bench_element(TALLOC_CTX *mem_ctx,
+                                               const char *name,
+                                               const char *group)
+{
+    struct hbac_rule_element *el;
+
+    el = talloc_zero(mem_ctx, struct hbac_rule_element);
+    if (el == NULL) {
+        return NULL;
+    }
+
+    if (name == NULL && group == NULL) {
+        el->category = HBAC_CATEGORY_ALL;
+        return el;
+    }
+
+    el->category = HBAC_CATEGORY_NULL;
+    el->names = talloc_zero_array(el, const char *, 2);
+    el->groups = talloc_zero_array(el, const char *, 2);
+    if (el->names == NULL || el->groups == NULL) {
+        talloc_free(el);
+        return NULL;
+    }
+
+    el->names[0] = name;
+    el->groups[0] = group;
+
+    return el;
+}
+
+static struct hbac_rule **bench_rules(TALLOC_CTX *mem_ctx,
+                                      int num_rules, int num_groups)
+{
+    struct hbac_rule **rules;
+    struct hbac_rule *rule;
+    const char *group;
+    const char *service;
+    int i;
+
+    rules = talloc_zero_array(mem_ctx, struct hbac_rule *, num_rules + 1);
+    if (rules == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < num_rules; i++) {
+        rule = talloc_zero(rules, struct hbac_rule);
+        if (rule == NULL) {
+            return NULL;
+        }
+
+        rule->enabled = true;
+        rule->name = talloc_asprintf(rule, "rule%d", i);
+        if (i == num_rules - 1) {
+            group = "Group0";
+            service = BENCH_SERVICE;
+        } else {
+            group = talloc_asprintf(rule, "Group%d",
+                                    (2 * i) % (2 * num_groups));
+            service = talloc_asprintf(rule, "service%d", i);
+        }
+        if (rule->name == NULL || group == NULL || service == NULL) {
+            return NULL;
+        }
+
+        rule->users = bench_element(rule, NULL, group);
+        rule->services = bench_element(rule, service, NULL);
+        rule->targethosts = bench_element(rule, NULL, NULL);
+        rule->srchosts = bench_element(rule, NULL, NULL);
+        if (rule->users == NULL || rule->services == NULL
+                || rule->targethosts == NULL || rule->srchosts == NULL) {
+            return NULL;
+        }
+
+        rules[i] = rule;
+    }
+
+    return rules;
+}
+
+static struct hbac_request_element *bench_req_element(TALLOC_CTX *mem_ctx,
+                                                      const char *name,
+                                                      int num_groups)
+{
+    struct hbac_request_element *el;
+    int i;
+
+    el = talloc_zero(mem_ctx, struct hbac_request_element);
+    if (el == NULL) {
+        return NULL;
+    }
+
+    el->name = name;
+    el->groups = talloc_zero_array(el, const char *, num_groups + 1);
+    if (el->groups == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < num_groups; i++) {
+        el->groups[i] = talloc_asprintf(el->groups, "group%d", i);
+        if (el->groups[i] == NULL) {
+            return NULL;
+        }
+    }
+
+    return el;
+}
+
+static struct hbac_eval_req *bench_request(TALLOC_CTX *mem_ctx,
+                                           int num_groups)
+{
+    struct hbac_eval_req *req;
+
+    req = talloc_zero(mem_ctx, struct hbac_eval_req);
+    if (req == NULL) {
+        return NULL;
+    }
+
+    req->user = bench_req_element(req, "user", num_groups);
+    req->service = bench_req_element(req, BENCH_SERVICE, 0);
+    req->targethost = bench_req_element(req, "host.example.com", 0);
+    req->srchost = bench_req_element(req, "client.example.com", 0);
+    if (req->user == NULL || req->service == NULL
+            || req->targethost == NULL || req->srchost == NULL) {
+        return NULL;
+    }
+
+    return req;
+}
+
+static errno_t bench_check(enum hbac_eval_result result,
+                           struct hbac_info *info,
+                           const char *expected_rule)
+{
+    errno_t ret;
+
+    if (result != HBAC_EVAL_ALLOW || info == NULL
+            || strcmp(info->rule_name, expected_rule) != 0) {
+        fprintf(stderr, "Unexpected result [%s]\n",
+                hbac_result_string(result));
+        ret = EINVAL;
+    } else {
+        ret = EOK;
+    }
+
+    hbac_free_info(info);
+    return ret;
+}
+
+static errno_t bench_run(int num_rules, int num_groups, int num_requests)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct hbac_rule **rules;
+    struct hbac_eval_req *req;
+    struct hbac_compiled_rules *compiled = NULL;
+    struct hbac_info *info;
+    enum hbac_eval_result result;
+    const char *expected_rule;
+    uint64_t per_rule_us;
+    uint64_t compile_us;
+    uint64_t compiled_us;
+    uint64_t start;
+    errno_t ret;
+    int i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    rules = bench_rules(tmp_ctx, num_rules, num_groups);
+    req = bench_request(tmp_ctx, num_groups);
+    if (rules == NULL || req == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    expected_rule = rules[num_rules - 1]->name;
+
+    start = get_start_time();
+    if (hbac_compile_rules(rules, &compiled) != HBAC_SUCCESS) {
+        fprintf(stderr, "Unable to compile the rules\n");
+        ret = ENOMEM;
+        goto done;
+    }
+    compile_us = get_spend_time_us(start);
+
+    start = get_start_time();
+    for (i = 0; i < num_requests; i++) {
+        result = hbac_evaluate(rules, req, &info);
+        ret = bench_check(result, info, expected_rule);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+    per_rule_us = get_spend_time_us(start);
+
+    start = get_start_time();
+    for (i = 0; i < num_requests; i++) {
+        result = hbac_evaluate_compiled(compiled, req, &info);
+        ret = bench_check(result, info, expected_rule);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+    compiled_us = get_spend_time_us(start);
+
+    printf("%8d %8d %10d %13.1f %12.1f %13.1f\n",
+           num_rules, num_groups, num_requests, per_rule_us / 1000.0,
+           compile_us / 1000.0, compiled_us / 1000.0);
+
+    ret = EOK;
+
+done:
+    hbac_free_compiled_rules(compiled);
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_rules = 2000;
+    int pc_groups = 800;
+    int pc_requests = 100;
+    errno_t ret;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "rules", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_rules, 0, "Number of rules", NULL },
+        { "groups", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_groups, 0, "Number of groups of the user", NULL },
+        { "requests", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_requests, 0, "Number of evaluated requests", NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_rules < 1 || pc_groups < 1 || pc_requests < 1) {
+        fprintf(stderr, "All numeric options must be positive\n");
+        return 1;
+    }
+
+    printf("%8s %8s %10s %13s %12s %13s\n", "rules", "groups",
+           "requests", "per-rule [ms]", "compile [ms]", "compiled [ms]");
+
+    ret = bench_run(pc_rules, pc_groups, pc_requests);
+
+    return ret == EOK ? 0 : 1;
+}
@@ -828,6 +828,143 @@ def test_krb5_auth(setup_krb5, env_for_sssctl):
                     "Authentication failure") != -1
 
 
+@pytest.fixture(params=[0, 4], ids=["no_pool", "pool"])
+def setup_krb5_pool(request, kdc_instance, passwd_ops_setup):
+    """
+    Setup SSSD for Kerberos authentication with and without a pool of
+    krb5_child workers
+    """
+    conf = format_pam_krb5_auth(config, kdc_instance)
+    conf += unindent("""\
+        krb5_child_pool_size = {}
+    """).format(request.param)
+    create_conf_fixture(request, conf)
+    create_sssd_fixture(request, kdc_instance.krb5_conf_path)
+
+    passwd_ops_setup.useradd(**USER1)
+    passwd_ops_setup.useradd(**USER2)
+    kdc_instance.add_principal("user1", "Secret123User1")
+    kdc_instance.add_principal("user2", "Secret123User2")
+    return request.param
+
+
+@pytest.mark.skipif(not have_files_provider(),
+                    reason="'files provider' disabled, skipping")
+def test_krb5_auth_login_storm(setup_krb5_pool, env_for_sssctl):
+    """
+    Run many concurrent Kerberos authentications and check that all of them
+    get the right result. The elapsed time is printed to compare the runs
+    with and without krb5_child workers.
+    """
+    storm_size = 32
+    passwords = {"user1": "Secret123User1", "user2": "Secret123User1"}
+    expected = {"user1": "Success", "user2": "Authentication failure"}
+
+    start = time.time()
+    checks = []
+    for i in range(storm_size):
+        user = "user1" if i % 2 == 0 else "user2"
+        sssctl = subprocess.Popen(["sssctl", "user-checks", user,
+                                   "--action=auth",
+                                   "--service=pam_sss_service"],
+                                  universal_newlines=True,
+                                  env=env_for_sssctl, stdin=subprocess.PIPE,
+                                  stdout=subprocess.PIPE,
+                                  stderr=subprocess.PIPE)
+        checks.append((user, sssctl))
+
+    for user, sssctl in checks:
+        try:
+            out, err = sssctl.communicate(input=passwords[user], timeout=60)
+        except Exception:
+            sssctl.kill()
+            out, err = sssctl.communicate()
+
+        assert sssctl.wait() == 0
+        assert err.find(r"pam_authenticate for user [{}]: {}".format(
+                        user, expected[user])) != -1
+
+    elapsed = time.time() - start
+    print("{} authentications with krb5_child_pool_size = {}: "
+          "{:.2f}s".format(storm_size, setup_krb5_pool, elapsed))
+
+
+@pytest.fixture(params=[0, 60], ids=["no_fast_path", "fast_path"])
+def setup_krb5_offline(request, kdc_instance, passwd_ops_setup):
+    """
+    Setup SSSD for Kerberos authentication with cached credentials with and
+    without the offline fast path of the PAM responder
+    """
+    conf = format_pam_krb5_auth(config, kdc_instance)
+    conf = conf.replace("[pam]\n", unindent("""\
+        [pam]
+        pam_offline_auth_timeout = {}
+    """).format(request.param))
+    conf += unindent("""\
+        cache_credentials = True
+    """)
+    create_conf_fixture(request, conf)
+    create_sssd_fixture(request, kdc_instance.krb5_conf_path)
+
+    passwd_ops_setup.useradd(**USER1)
+    kdc_instance.add_principal("user1", "Secret123User1")
+    return request.param
+
+
+def run_pam_auth(env, user, password):
+    """Authenticate with sssctl user-checks and return its stderr"""
+    sssctl = subprocess.Popen(["sssctl", "user-checks", user,
+                               "--action=auth",
+                               "--service=pam_sss_service"],
+                              universal_newlines=True,
+                              env=env, stdin=subprocess.PIPE,
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    try:
+        out, err = sssctl.communicate(input=password, timeout=60)
+    except Exception:
+        sssctl.kill()
+        out, err = sssctl.communicate()
+
+    assert sssctl.wait() == 0
+    return err
+
+
+@pytest.mark.skipif(not have_files_provider(),
+                    reason="'files provider' disabled, skipping")
+def test_krb5_offline_auth_throughput(setup_krb5_offline, kdc_instance,
+                                      env_for_sssctl):
+    """
+    Authenticate once online to cache the password, stop the KDC and run
+    many offline authentications. The elapsed time is printed to compare
+    the runs with and without the fast path of the PAM responder.
+    """
+    logins = 100
+
+    err = run_pam_auth(env_for_sssctl, "user1", "Secret123User1")
+    assert err.find(r"pam_authenticate for user [user1]: Success") != -1
+
+    kdc_instance.stop_kdc()
+    try:
+        start = time.time()
+        for i in range(logins):
+            err = run_pam_auth(env_for_sssctl, "user1", "Secret123User1")
+            assert err.find(
+                r"pam_authenticate for user [user1]: Success") != -1
+        elapsed = time.time() - start
+
+        err = run_pam_auth(env_for_sssctl, "user1", "Secret123User2")
+        assert err.find(r"pam_authenticate for user [user1]: "
+                        "Authentication failure") != -1
+    finally:
+        # The KDC is not running any more, do not stop it again on teardown
+        if os.path.exists(kdc_instance.kdc_pid_file):
+            os.unlink(kdc_instance.kdc_pid_file)
+
+    print("{} offline authentications with pam_offline_auth_timeout = {}: "
+          "{:.2f}s ({:.1f}/s)".format(logins, setup_krb5_offline, elapsed,
+                                      logins / elapsed))
+
+
 @pytest.fixture
 def setup_krb5_domains(request, kdc_instance, passwd_ops_setup):
     """
@@ -20,6 +20,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdlib.h>
+#include <string.h>
 #include <check.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -835,6 +836,238 @@ START_TEST(ipa_hbac_test_allow_srchostgroup)
 }
 END_TEST
 
+static bool hbac_test_fallback;
+
+static void hbac_test_debug(const char *file, int line,
+                            const char *function,
+                            enum hbac_debug_level level,
+                            const char *format, ...)
+{
+    if (strstr(format, "Request cannot be compiled") != NULL) {
+        hbac_test_fallback = true;
+    }
+}
+
+/* hbac_evaluate() checks the rules one by one, it is the reference for the
+ * compiled evaluation */
+static void check_compiled(struct hbac_rule **rules,
+                           struct hbac_compiled_rules *compiled,
+                           struct hbac_eval_req *eval_req,
+                           enum hbac_eval_result expected,
+                           enum hbac_error_code expected_code,
+                           const char *expected_rule)
+{
+    enum hbac_eval_result result;
+    enum hbac_eval_result raw_result;
+    struct hbac_info *info = NULL;
+    struct hbac_info *raw_info = NULL;
+
+    hbac_test_fallback = false;
+    result = hbac_evaluate_compiled(compiled, eval_req, &info);
+    ck_assert_msg(!hbac_test_fallback,
+                  "The request was not evaluated with the compiled rules");
+
+    raw_result = hbac_evaluate(rules, eval_req, &raw_info);
+
+    ck_assert_msg(result == expected,
+                  "Expected [%s], got [%s]; Error: [%s]",
+                  hbac_result_string(expected),
+                  hbac_result_string(result),
+                  info ? hbac_error_string(info->code) : "Unknown");
+    ck_assert_msg(raw_result == result,
+                  "Compiled and per-rule evaluation differ: [%s] vs [%s]",
+                  hbac_result_string(result),
+                  hbac_result_string(raw_result));
+    ck_assert_int_eq(info->code, expected_code);
+    ck_assert_int_eq(raw_info->code, info->code);
+
+    if (expected_rule == NULL) {
+        ck_assert_msg(info->rule_name == NULL,
+                      "Unexpected rule [%s]", info->rule_name);
+        ck_assert_msg(raw_info->rule_name == NULL,
+                      "Unexpected rule [%s]", raw_info->rule_name);
+    } else {
+        ck_assert_str_eq(info->rule_name, expected_rule);
+        ck_assert_str_eq(raw_info->rule_name, expected_rule);
+    }
+
+    hbac_free_info(info);
+    hbac_free_info(raw_info);
+}
+
+static struct hbac_request_element *get_plain_element(TALLOC_CTX *mem_ctx,
+                                                      const char *name,
+                                                      const char *group)
+{
+    struct hbac_request_element *el;
+
+    el = talloc_zero(mem_ctx, struct hbac_request_element);
+    sss_ck_fail_if_msg(el == NULL, "Failed to allocate memory");
+
+    el->name = name;
+    el->groups = talloc_zero_array(el, const char *, 2);
+    sss_ck_fail_if_msg(el->groups == NULL, "Failed to allocate memory");
+    el->groups[0] = group;
+
+    return el;
+}
+
+START_TEST(ipa_hbac_test_compiled)
+{
+    TALLOC_CTX *test_ctx;
+    struct hbac_rule **rules;
+    struct hbac_rule **broken_rules;
+    struct hbac_eval_req *eval_req;
+    struct hbac_request_element *test_user;
+    struct hbac_compiled_rules *compiled;
+    enum hbac_error_code ret;
+
+    test_ctx = talloc_new(global_talloc_context);
+
+    /* Create a request */
+    eval_req = talloc_zero(test_ctx, struct hbac_eval_req);
+    sss_ck_fail_if_msg(eval_req == NULL, "Failed to allocate memory");
+
+    get_test_user(eval_req, &test_user);
+    get_test_service(eval_req, &eval_req->service);
+    get_test_srchost(eval_req, &eval_req->srchost);
+    eval_req->targethost = get_plain_element(eval_req, "host.example.com",
+                                             NULL);
+
+    hbac_enable_debug(hbac_test_debug);
+
+    /* Create the rules to evaluate against */
+    rules = talloc_array(test_ctx, struct hbac_rule *, 7);
+    sss_ck_fail_if_msg(rules == NULL, "Failed to allocate memory");
+
+    /* A disabled rule is never used */
+    get_allow_all_rule(rules, &rules[0]);
+    rules[0]->name = "Disabled";
+    rules[0]->enabled = false;
+
+    /* Matches the group, but not the service */
+    get_allow_all_rule(rules, &rules[1]);
+    rules[1]->name = "Other service";
+    rules[1]->users->category = HBAC_CATEGORY_NULL;
+    rules[1]->users->groups = talloc_array(rules[1], const char *, 2);
+    sss_ck_fail_if_msg(rules[1]->users->groups == NULL,
+                       "Failed to allocate memory");
+    rules[1]->users->groups[0] = HBAC_TEST_GROUP2;
+    rules[1]->users->groups[1] = NULL;
+    rules[1]->services->category = HBAC_CATEGORY_NULL;
+    rules[1]->services->names = talloc_array(rules[1], const char *, 2);
+    sss_ck_fail_if_msg(rules[1]->services->names == NULL,
+                       "Failed to allocate memory");
+    rules[1]->services->names[0] = HBAC_TEST_INVALID_SERVICE;
+    rules[1]->services->names[1] = NULL;
+
+    /* Names are compared case-insensitively */
+    get_allow_all_rule(rules, &rules[2]);
+    rules[2]->name = "Allow utf8 user";
+    rules[2]->users->category = HBAC_CATEGORY_NULL;
+    rules[2]->users->names = talloc_array(rules[2], const char *, 2);
+    sss_ck_fail_if_msg(rules[2]->users->names == NULL,
+                       "Failed to allocate memory");
+    rules[2]->users->names[0] = (const char *) user_utf8_upcase;
+    rules[2]->users->names[1] = NULL;
+
+    /* A group rule before a user rule must win */
+    get_allow_all_rule(rules, &rules[3]);
+    rules[3]->name = "Allow group";
+    rules[3]->users->category = HBAC_CATEGORY_NULL;
+    rules[3]->users->groups = talloc_array(rules[3], const char *, 2);
+    sss_ck_fail_if_msg(rules[3]->users->groups == NULL,
+                       "Failed to allocate memory");
+    rules[3]->users->groups[0] = "TestGroup1";
+    rules[3]->users->groups[1] = NULL;
+
+    get_allow_all_rule(rules, &rules[4]);
+    rules[4]->name = "Allow user";
+    rules[4]->users->category = HBAC_CATEGORY_NULL;
+    rules[4]->users->names = talloc_array(rules[4], const char *, 2);
+    sss_ck_fail_if_msg(rules[4]->users->names == NULL,
+                       "Failed to allocate memory");
+    rules[4]->users->names[0] = HBAC_TEST_USER;
+    rules[4]->users->names[1] = NULL;
+
+    /* Applies to every user, it is not found through the user index */
+    get_allow_all_rule(rules, &rules[5]);
+    rules[5]->name = "Allow all users";
+    rules[5]->services->category = HBAC_CATEGORY_NULL;
+    rules[5]->services->names = talloc_array(rules[5], const char *, 2);
+    sss_ck_fail_if_msg(rules[5]->services->names == NULL,
+                       "Failed to allocate memory");
+    rules[5]->services->names[0] = HBAC_TEST_SERVICE;
+    rules[5]->services->names[1] = NULL;
+
+    rules[6] = NULL;
+
+    ret = hbac_compile_rules(rules, &compiled);
+    ck_assert_int_eq(ret, HBAC_SUCCESS);
+
+    /* The same compiled rules serve several requests */
+    eval_req->user = test_user;
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_ALLOW, HBAC_SUCCESS, "Allow group");
+
+    eval_req->user = get_plain_element(eval_req, HBAC_TEST_USER, NULL);
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_ALLOW, HBAC_SUCCESS, "Allow user");
+
+    eval_req->user = get_plain_element(eval_req,
+                                       (const char *) user_utf8_lowcase, NULL);
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_ALLOW, HBAC_SUCCESS, "Allow utf8 user");
+
+    /* The group index finds a rule for another service, the rule for all
+     * users still applies */
+    eval_req->user = get_plain_element(eval_req, HBAC_TEST_INVALID_USER,
+                                       HBAC_TEST_GROUP2);
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_ALLOW, HBAC_SUCCESS, "Allow all users");
+
+    /* For the other service the rule found by the group index applies */
+    eval_req->service = get_plain_element(eval_req, HBAC_TEST_INVALID_SERVICE,
+                                          NULL);
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_ALLOW, HBAC_SUCCESS, "Other service");
+
+    eval_req->user = get_plain_element(eval_req,
+                                       (const char *) user_utf8_lowcase_neg,
+                                       NULL);
+    check_compiled(rules, compiled, eval_req,
+                   HBAC_EVAL_DENY, HBAC_ERROR_UNKNOWN, NULL);
+
+    hbac_free_compiled_rules(compiled);
+    get_test_service(eval_req, &eval_req->service);
+
+    /* An incomplete rule is reported where the plain evaluation would
+     * report it, even if it cannot apply to the user */
+    broken_rules = talloc_array(test_ctx, struct hbac_rule *, 4);
+    sss_ck_fail_if_msg(broken_rules == NULL, "Failed to allocate memory");
+
+    broken_rules[0] = rules[1];
+    broken_rules[1] = talloc_zero(broken_rules, struct hbac_rule);
+    sss_ck_fail_if_msg(broken_rules[1] == NULL, "Failed to allocate memory");
+    broken_rules[1]->name = "Incomplete";
+    broken_rules[1]->enabled = true;
+    broken_rules[2] = rules[4];
+    broken_rules[3] = NULL;
+
+    ret = hbac_compile_rules(broken_rules, &compiled);
+    ck_assert_int_eq(ret, HBAC_SUCCESS);
+
+    eval_req->user = test_user;
+    check_compiled(broken_rules, compiled, eval_req,
+                   HBAC_EVAL_ERROR, HBAC_ERROR_UNPARSEABLE_RULE, "Incomplete");
+
+    hbac_free_compiled_rules(compiled);
+
+    hbac_enable_debug(NULL);
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST(ipa_hbac_test_incomplete)
 {
     TALLOC_CTX *test_ctx;
@@ -880,6 +1113,7 @@ Suite *hbac_test_suite (void)
     tcase_add_test(tc_hbac, ipa_hbac_test_allow_srchostgroup);
     tcase_add_test(tc_hbac, ipa_hbac_test_allow_utf8);
     tcase_add_test(tc_hbac, ipa_hbac_test_incomplete);
+    tcase_add_test(tc_hbac, ipa_hbac_test_compiled);
 
     suite_add_tcase(s, tc_hbac);
     return s;
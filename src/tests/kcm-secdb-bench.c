@@ -0,0 +1,483 @@
+/*
+   SSSD
+
+   KCM secdb benchmark: cost of storing credentials in the secrets database
+   during sequential kinit and kvno operations
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   kcm-secdb-bench --kinits=20 --kvnos=50
+ *
+ * Every kinit creates a new ccache and stores a TGT in it. Every kvno then
+ * reads the ccache and stores a new service ticket, as sssd_kcm does when
+ * a client obtains a ticket. The operations are run twice against a fresh
+ * database: "rewrite" stores the whole ccache with every new credential,
+ * the way ccaches were stored before credentials became separate records,
+ * "append" uses the secdb back end as it is.
+ *
+ * The secrets database only accepts requests from root, the benchmark has
+ * to run as root just like sssd_kcm.
+ */
+
+#include <stdlib.h>
+#include <popt.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#include "util/util.h"
+#include "tests/common.h"
+#include "responder/kcm/kcmsrv_ccache_secdb.c"
+
+#define TESTS_PATH "tp_kcm_secdb_bench"
+#define TEST_DB_FULL_PATH TESTS_PATH "/secrets.ldb"
+
+#define BENCH_REALM "KCM.BENCH"
+#define BENCH_TICKET_SIZE 1024
+
+errno_t sss_sec_init_with_path(TALLOC_CTX *mem_ctx,
+                               struct sss_sec_quota *quota,
+                               const char *dbpath,
+                               struct sss_sec_ctx **_sec_ctx);
+
+/* Only the secdb back end is used */
+const struct kcm_ccdb_ops ccdb_mem_ops;
+const struct kcm_ccdb_ops ccdb_wb_ops;
+
+struct bench_ctx {
+    struct tevent_context *ev;
+    krb5_context kctx;
+    krb5_principal princ;
+    struct kcm_ccdb *db;
+    struct ccdb_secdb *secdb;
+    struct sss_sec_quota quota;
+    struct cli_creds client;
+    bool rewrite;
+};
+
+static errno_t bench_wait(struct bench_ctx *bctx, struct tevent_req *req)
+{
+    if (req == NULL) {
+        return ENOMEM;
+    }
+
+    while (tevent_req_is_in_progress(req)) {
+        if (tevent_loop_once(bctx->ev) != 0) {
+            return EIO;
+        }
+    }
+
+    return EOK;
+}
+
+static void bench_cleanup(void)
+{
+    unlink(TEST_DB_FULL_PATH);
+    rmdir(TESTS_PATH);
+}
+
+static int bench_destructor(struct bench_ctx *bctx)
+{
+    if (bctx->kctx != NULL) {
+        krb5_free_principal(bctx->kctx, bctx->princ);
+        krb5_free_context(bctx->kctx);
+    }
+
+    return 0;
+}
+
+static errno_t bench_setup(TALLOC_CTX *mem_ctx, bool rewrite,
+                           struct bench_ctx **_bctx)
+{
+    struct bench_ctx *bctx;
+    krb5_error_code kerr;
+    errno_t ret;
+    int fd;
+
+    bench_cleanup();
+
+    ret = mkdir(TESTS_PATH, 0700);
+    if (ret != 0) {
+        return errno;
+    }
+
+    fd = open(TEST_DB_FULL_PATH, O_CREAT|O_EXCL|O_WRONLY, 0600);
+    if (fd == -1) {
+        return errno;
+    }
+    close(fd);
+
+    bctx = talloc_zero(mem_ctx, struct bench_ctx);
+    if (bctx == NULL) {
+        return ENOMEM;
+    }
+    talloc_set_destructor(bctx, bench_destructor);
+    bctx->rewrite = rewrite;
+    bctx->client.ucred.uid = geteuid();
+    bctx->client.ucred.gid = getegid();
+
+    bctx->ev = tevent_context_init(bctx);
+    if (bctx->ev == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    kerr = krb5_init_context(&bctx->kctx);
+    if (kerr != 0) {
+        ret = EIO;
+        goto done;
+    }
+
+    kerr = krb5_parse_name(bctx->kctx, "bench@"BENCH_REALM, &bctx->princ);
+    if (kerr != 0) {
+        ret = EIO;
+        goto done;
+    }
+
+    bctx->db = talloc_zero(bctx, struct kcm_ccdb);
+    bctx->secdb = talloc_zero(bctx->db, struct ccdb_secdb);
+    if (bctx->db == NULL || bctx->secdb == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+    bctx->db->ev = bctx->ev;
+    bctx->db->ops = &ccdb_secdb_ops;
+    bctx->db->db_handle = bctx->secdb;
+
+    /* No quota, the number of credentials is only limited by the options */
+    ret = sss_sec_init_with_path(bctx->secdb, &bctx->quota,
+                                 TEST_DB_FULL_PATH, &bctx->secdb->sctx);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    *_bctx = bctx;
+    return EOK;
+
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+static struct sss_iobuf *bench_cred_blob(TALLOC_CTX *mem_ctx,
+                                         struct bench_ctx *bctx,
+                                         const char *server)
+{
+    struct sss_iobuf *blob;
+#ifdef HAVE_KRB5_UNMARSHAL_CREDENTIALS
+    uint8_t ticket[BENCH_TICKET_SIZE] = { 0 };
+    krb5_creds creds = { 0 };
+    krb5_error_code kerr;
+    krb5_data *data;
+
+    creds.client = bctx->princ;
+    kerr = krb5_parse_name(bctx->kctx, server, &creds.server);
+    if (kerr != 0) {
+        return NULL;
+    }
+
+    creds.ticket.data = (char *)ticket;
+    creds.ticket.length = sizeof(ticket);
+    creds.times.endtime = time(NULL) + 3600;
+
+    kerr = krb5_marshal_credentials(bctx->kctx, &creds, &data);
+    krb5_free_principal(bctx->kctx, creds.server);
+    if (kerr != 0) {
+        return NULL;
+    }
+
+    blob = sss_iobuf_init_readonly(mem_ctx, (uint8_t *)data->data,
+                                   data->length);
+    krb5_free_data(bctx->kctx, data);
+#else
+    /* Without krb5_unmarshal_credentials() the credentials are never
+     * parsed, any unique blob will do */
+    blob = sss_iobuf_init_readonly(mem_ctx, NULL, BENCH_TICKET_SIZE);
+    if (blob != NULL) {
+        strncpy((char *)sss_iobuf_get_data(blob), server,
+                BENCH_TICKET_SIZE - 1);
+    }
+#endif
+
+    return blob;
+}
+
+static errno_t bench_kinit(TALLOC_CTX *mem_ctx,
+                           struct bench_ctx *bctx,
+                           int idx,
+                           uuid_t uuid)
+{
+    struct kcm_ccache *cc;
+    struct tevent_req *req;
+    const char *name;
+    errno_t ret;
+
+    name = talloc_asprintf(mem_ctx, "%"SPRIuid":%d",
+                           bctx->client.ucred.uid, idx);
+    if (name == NULL) {
+        return ENOMEM;
+    }
+
+    ret = kcm_cc_new(mem_ctx, bctx->kctx, &bctx->client, name, bctx->princ,
+                     &cc);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    req = ccdb_secdb_create_send(mem_ctx, bctx->ev, bctx->db, &bctx->client,
+                                 cc);
+    ret = bench_wait(bctx, req);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = ccdb_secdb_create_recv(req);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return kcm_cc_get_uuid(cc, uuid);
+}
+
+static errno_t bench_lookup(TALLOC_CTX *mem_ctx,
+                            struct bench_ctx *bctx,
+                            uuid_t uuid)
+{
+    struct kcm_ccache *cc;
+    struct tevent_req *req;
+    errno_t ret;
+
+    req = ccdb_secdb_getbyuuid_send(mem_ctx, bctx->ev, bctx->db,
+                                    &bctx->client, uuid);
+    ret = bench_wait(bctx, req);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = ccdb_secdb_getbyuuid_recv(req, mem_ctx, &cc);
+    if (ret == EOK && cc == NULL) {
+        ret = ENOENT;
+    }
+
+    return ret;
+}
+
+/* Stores the credential the way the back end did when the whole ccache was
+ * a single secret */
+static errno_t bench_store_rewrite(TALLOC_CTX *mem_ctx,
+                                   struct bench_ctx *bctx,
+                                   uuid_t uuid,
+                                   struct sss_iobuf *blob)
+{
+    struct sss_sec_ctx *sctx = bctx->secdb->sctx;
+    struct sss_iobuf *payload;
+    struct sss_sec_req *sreq;
+    struct kcm_ccache *cc;
+    char *secdb_key;
+    errno_t ret;
+
+    ret = key_by_uuid(mem_ctx, sctx, &bctx->client, uuid, &secdb_key);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = secdb_get_cc(mem_ctx, sctx, secdb_key, &bctx->client, &cc);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = kcm_cc_store_cred_blob(cc, blob);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = kcm_ccache_to_sec_input_binary(mem_ctx, cc, &payload);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = secdb_cc_key_req(mem_ctx, sctx, &bctx->client, secdb_key, &sreq);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return sec_update(mem_ctx, sreq, payload);
+}
+
+static errno_t bench_store(TALLOC_CTX *mem_ctx,
+                           struct bench_ctx *bctx,
+                           uuid_t uuid,
+                           const char *server)
+{
+    struct sss_iobuf *blob;
+    struct tevent_req *req;
+    errno_t ret;
+
+    blob = bench_cred_blob(mem_ctx, bctx, server);
+    if (blob == NULL) {
+        return ENOMEM;
+    }
+
+    if (bctx->rewrite) {
+        return bench_store_rewrite(mem_ctx, bctx, uuid, blob);
+    }
+
+    req = ccdb_secdb_store_cred_send(mem_ctx, bctx->ev, bctx->db,
+                                     &bctx->client, uuid, blob);
+    ret = bench_wait(bctx, req);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    return ccdb_secdb_store_cred_recv(req);
+}
+
+static errno_t bench_run(bool rewrite, int kinits, int kvnos)
+{
+    struct bench_ctx *bctx = NULL;
+    TALLOC_CTX *tmp_ctx;
+    char server[128];
+    uint64_t store_us = 0;
+    uint64_t spent_us;
+    uint64_t start;
+    uint64_t op_start;
+    uuid_t uuid;
+    errno_t ret;
+    int i;
+    int j;
+
+    ret = bench_setup(NULL, rewrite, &bctx);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to set up the database: %d\n", ret);
+        return ret;
+    }
+
+    start = get_start_time();
+
+    for (i = 0; i < kinits; i++) {
+        tmp_ctx = talloc_new(bctx);
+        if (tmp_ctx == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        ret = bench_kinit(tmp_ctx, bctx, i, uuid);
+        if (ret != EOK) {
+            fprintf(stderr, "Unable to create ccache %d: %d\n", i, ret);
+            goto done;
+        }
+
+        op_start = get_start_time();
+        ret = bench_store(tmp_ctx, bctx, uuid,
+                          "krbtgt/"BENCH_REALM"@"BENCH_REALM);
+        store_us += get_spend_time_us(op_start);
+        if (ret != EOK) {
+            fprintf(stderr, "Unable to store TGT %d: %d\n", i, ret);
+            goto done;
+        }
+
+        for (j = 0; j < kvnos; j++) {
+            ret = bench_lookup(tmp_ctx, bctx, uuid);
+            if (ret != EOK) {
+                fprintf(stderr, "Unable to read ccache %d: %d\n", i, ret);
+                goto done;
+            }
+
+            snprintf(server, sizeof(server), "HTTP/host%d.kcm.bench@"
+                     BENCH_REALM, j);
+
+            op_start = get_start_time();
+            ret = bench_store(tmp_ctx, bctx, uuid, server);
+            store_us += get_spend_time_us(op_start);
+            if (ret != EOK) {
+                fprintf(stderr, "Unable to store ticket %d of ccache %d: %d\n",
+                        j, i, ret);
+                goto done;
+            }
+        }
+
+        talloc_free(tmp_ctx);
+    }
+
+    spent_us = get_spend_time_us(start);
+
+    printf("%8s %10d %12.1f %14.1f\n", rewrite ? "rewrite" : "append",
+           kinits * (kvnos + 1), spent_us / 1000.0,
+           (double) store_us / (kinits * (kvnos + 1)));
+
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_kinits = 10;
+    int pc_kvnos = 50;
+    errno_t ret;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "kinits", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_kinits, 0, "Number of ccaches obtained by kinit", NULL },
+        { "kvnos", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_kvnos, 0, "Number of service tickets stored in each ccache",
+          NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_kinits < 1 || pc_kvnos < 0) {
+        fprintf(stderr, "At least one kinit is needed, "
+                        "the number of kvnos must not be negative\n");
+        return 1;
+    }
+
+    if (geteuid() != 0) {
+        fprintf(stderr, "The secrets database requires root\n");
+        return 1;
+    }
+
+    tests_set_cwd();
+
+    printf("%8s %10s %12s %14s\n", "mode", "creds", "time [ms]",
+           "store [us/op]");
+
+    ret = bench_run(true, pc_kinits, pc_kvnos);
+    if (ret == EOK) {
+        ret = bench_run(false, pc_kinits, pc_kvnos);
+    }
+
+    bench_cleanup();
+    return ret == EOK ? 0 : 1;
+}
@@ -0,0 +1,396 @@
+/*
+   SSSD
+
+   memberof benchmark: cost of storing, rebuilding and removing the
+   members of a large group nested in a chain of groups, and of storing
+   a single member into such a group
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   memberof-bench --max-members=100000 --max-depth=16
+ *
+ * For every combination of group size (powers of ten up to --max-members)
+ * and nesting depth (powers of two up to --max-depth) a fresh cache is
+ * created with the users and a chain of nested groups, the innermost group
+ * being a member of the next one and so on. The program then measures:
+ *   store   - adding all users to the innermost group in one modification
+ *   add one - adding one more user to the populated innermost group
+ *   del one - removing that user again
+ *   rebuild - recomputing all memberof and memberuid values
+ *   remove  - removing all users from the innermost group
+ *
+ * "add one" and "del one" are the cost of the usual incremental update,
+ * which the add and delete handlers of the module pay for every stored
+ * entry regardless of how large or deep the surrounding groups are.
+ */
+
+#include <stdlib.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "tests/common.h"
+
+#define TESTS_PATH "tp_memberof_bench"
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_DOM_NAME "memberof_bench"
+#define TEST_ID_PROVIDER "ldap"
+
+#define BENCH_ID_BASE 100000
+
+struct bench_ctx {
+    struct sss_test_ctx *tctx;
+    struct sss_domain_info *dom;
+    const char **user_dns;
+    const char *extra_dn;
+    const char *leaf;
+    int num_users;
+};
+
+static const char *bench_fqname(TALLOC_CTX *mem_ctx,
+                                struct sss_domain_info *dom,
+                                const char *fmt, int idx)
+{
+    char *shortname;
+
+    shortname = talloc_asprintf(mem_ctx, fmt, idx);
+    if (shortname == NULL) {
+        return NULL;
+    }
+
+    return sss_create_internal_fqname(mem_ctx, shortname, dom->name);
+}
+
+static errno_t bench_setup(TALLOC_CTX *mem_ctx, int num_users, int depth,
+                           struct bench_ctx **_bctx)
+{
+    struct bench_ctx *bctx;
+    const char *name;
+    const char *parent;
+    errno_t ret;
+    int i;
+
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    bctx = talloc_zero(mem_ctx, struct bench_ctx);
+    if (bctx == NULL) {
+        return ENOMEM;
+    }
+
+    bctx->tctx = create_dom_test_ctx(bctx, TESTS_PATH, TEST_CONF_DB,
+                                     TEST_DOM_NAME, TEST_ID_PROVIDER, NULL);
+    if (bctx->tctx == NULL) {
+        ret = EIO;
+        goto done;
+    }
+    bctx->dom = bctx->tctx->dom;
+    bctx->num_users = num_users;
+
+    bctx->user_dns = talloc_array(bctx, const char *, num_users);
+    if (bctx->user_dns == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_transaction_start(bctx->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < num_users; i++) {
+        name = bench_fqname(bctx, bctx->dom, "bench_user_%d", i);
+        if (name == NULL) {
+            ret = ENOMEM;
+            goto cancel;
+        }
+
+        ret = sysdb_add_user(bctx->dom, name, BENCH_ID_BASE + i,
+                             BENCH_ID_BASE + i, NULL, NULL, NULL,
+                             NULL, NULL, 0, 0);
+        if (ret != EOK) {
+            goto cancel;
+        }
+
+        bctx->user_dns[i] = sysdb_user_strdn(bctx->user_dns,
+                                             bctx->dom->name, name);
+        if (bctx->user_dns[i] == NULL) {
+            ret = ENOMEM;
+            goto cancel;
+        }
+    }
+
+    /* one more user which is not part of the bulk store */
+    name = bench_fqname(bctx, bctx->dom, "bench_extra_%d", 0);
+    if (name == NULL) {
+        ret = ENOMEM;
+        goto cancel;
+    }
+
+    ret = sysdb_add_user(bctx->dom, name, BENCH_ID_BASE + num_users,
+                         BENCH_ID_BASE + num_users, NULL, NULL, NULL,
+                         NULL, NULL, 0, 0);
+    if (ret != EOK) {
+        goto cancel;
+    }
+
+    bctx->extra_dn = sysdb_user_strdn(bctx, bctx->dom->name, name);
+    if (bctx->extra_dn == NULL) {
+        ret = ENOMEM;
+        goto cancel;
+    }
+
+    /* group 0 is the innermost one, group depth - 1 the outermost one */
+    parent = NULL;
+    for (i = depth - 1; i >= 0; i--) {
+        name = bench_fqname(bctx, bctx->dom, "bench_group_%d", i);
+        if (name == NULL) {
+            ret = ENOMEM;
+            goto cancel;
+        }
+
+        ret = sysdb_add_group(bctx->dom, name, BENCH_ID_BASE + i,
+                              NULL, 0, 0);
+        if (ret != EOK) {
+            goto cancel;
+        }
+
+        if (parent != NULL) {
+            ret = sysdb_add_group_member(bctx->dom, parent, name,
+                                         SYSDB_MEMBER_GROUP, false);
+            if (ret != EOK) {
+                goto cancel;
+            }
+        }
+
+        parent = name;
+    }
+    bctx->leaf = parent;
+
+    ret = sysdb_transaction_commit(bctx->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    *_bctx = bctx;
+    return EOK;
+
+cancel:
+    sysdb_transaction_cancel(bctx->dom->sysdb);
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+static errno_t bench_mod_members(struct bench_ctx *bctx, int mod_op)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+    int i;
+
+    attrs = sysdb_new_attrs(bctx);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    for (i = 0; i < bctx->num_users; i++) {
+        ret = sysdb_attrs_add_string(attrs, SYSDB_MEMBER, bctx->user_dns[i]);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+    ret = sysdb_set_group_attr(bctx->dom, bctx->leaf, attrs, mod_op);
+
+done:
+    talloc_free(attrs);
+    return ret;
+}
+
+static errno_t bench_mod_one(struct bench_ctx *bctx, int mod_op)
+{
+    struct sysdb_attrs *attrs;
+    errno_t ret;
+
+    attrs = sysdb_new_attrs(bctx);
+    if (attrs == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sysdb_attrs_add_string(attrs, SYSDB_MEMBER, bctx->extra_dn);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    ret = sysdb_set_group_attr(bctx->dom, bctx->leaf, attrs, mod_op);
+
+done:
+    talloc_free(attrs);
+    return ret;
+}
+
+static errno_t bench_rebuild(struct bench_ctx *bctx)
+{
+    struct ldb_context *ldb;
+    struct ldb_message *msg;
+    errno_t ret;
+
+    ldb = sysdb_ctx_get_ldb(bctx->dom->sysdb);
+
+    msg = ldb_msg_new(bctx);
+    if (msg == NULL) {
+        return ENOMEM;
+    }
+
+    msg->dn = ldb_dn_new(msg, ldb, "@MEMBEROF-REBUILD");
+    if (msg->dn == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    ret = sysdb_error_to_errno(ldb_add(ldb, msg));
+
+done:
+    talloc_free(msg);
+    return ret;
+}
+
+static errno_t bench_run(int num_users, int depth)
+{
+    struct bench_ctx *bctx = NULL;
+    uint64_t store_us;
+    uint64_t add_one_us;
+    uint64_t del_one_us;
+    uint64_t rebuild_us;
+    uint64_t remove_us;
+    uint64_t start;
+    errno_t ret;
+
+    ret = bench_setup(NULL, num_users, depth, &bctx);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to set up the cache: %d\n", ret);
+        return ret;
+    }
+
+    start = get_start_time();
+    ret = bench_mod_members(bctx, SYSDB_MOD_ADD);
+    store_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to store the members: %d\n", ret);
+        goto done;
+    }
+
+    start = get_start_time();
+    ret = bench_mod_one(bctx, SYSDB_MOD_ADD);
+    add_one_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to store one member: %d\n", ret);
+        goto done;
+    }
+
+    start = get_start_time();
+    ret = bench_mod_one(bctx, SYSDB_MOD_DEL);
+    del_one_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to remove one member: %d\n", ret);
+        goto done;
+    }
+
+    start = get_start_time();
+    ret = bench_rebuild(bctx);
+    rebuild_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to rebuild memberships: %d\n", ret);
+        goto done;
+    }
+
+    start = get_start_time();
+    ret = bench_mod_members(bctx, SYSDB_MOD_DEL);
+    remove_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to remove the members: %d\n", ret);
+        goto done;
+    }
+
+    printf("%10d %6d %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+           num_users, depth, store_us / 1000.0, add_one_us / 1000.0,
+           del_one_us / 1000.0, rebuild_us / 1000.0, remove_us / 1000.0);
+
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_max_members = 10000;
+    int pc_max_depth = 8;
+    int num_users;
+    int depth;
+    errno_t ret = EOK;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "max-members", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_max_members, 0, "Largest group size to measure", NULL },
+        { "max-depth", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_max_depth, 0, "Deepest nesting to measure", NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_max_members < 1 || pc_max_depth < 1) {
+        fprintf(stderr, "All numeric options must be positive\n");
+        return 1;
+    }
+
+    tests_set_cwd();
+
+    printf("%10s %6s %12s %12s %12s %12s %12s\n",
+           "members", "depth", "store [ms]", "add one [ms]", "del one [ms]",
+           "rebuild [ms]", "remove [ms]");
+
+    for (num_users = 10; num_users <= pc_max_members; num_users *= 10) {
+        for (depth = 1; depth <= pc_max_depth; depth *= 2) {
+            ret = bench_run(num_users, depth);
+            if (ret != EOK) {
+                goto done;
+            }
+        }
+    }
+
+done:
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return ret == EOK ? 0 : 1;
+}
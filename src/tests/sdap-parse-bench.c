@@ -0,0 +1,351 @@
+/*
+   SSSD
+
+   sdap parse benchmark: time and memory needed to keep many parsed LDAP
+   entries, allocated as a single pool per entry or value by value
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   sdap-parse-bench --entries=20000 --attrs=20 --values=5 --mode=pooled
+ *   sdap-parse-bench --entries=20000 --attrs=20 --values=5 --mode=per-value
+ *
+ * libldap is replaced by a fake entry with --attrs attributes of --values
+ * values each. All --entries parsed entries are kept in memory, like the
+ * replies of a large search until they are stored in the cache. The
+ * program measures:
+ *   pooled    - entries as returned by sdap_parse_entry(), every entry is
+ *               a single talloc pool
+ *   per-value - every parsed entry is rebuilt with sysdb_attrs_add_val(),
+ *               i.e. with one allocation per value and reallocated arrays
+ *               as sdap_parse_entry() did before; the parse time then
+ *               includes the copy
+ * The maximum RSS only grows, so run each mode in its own process.
+ */
+
+#include <stdlib.h>
+#include <popt.h>
+#include <sys/resource.h>
+
+#include "util/util.h"
+#include "providers/ldap/sdap.h"
+
+#define BENCH_DN "cn=bench,ou=groups,dc=example,dc=com"
+
+struct bench_entry {
+    int num_attrs;
+    char **names;
+    char ***values;
+    int next_attr;
+};
+
+static struct bench_entry *bench_entry;
+
+/* libldap wrappers */
+int __wrap_ldap_set_option(LDAP *ld, int option, void *invalue)
+{
+    return LDAP_OPT_SUCCESS;
+}
+
+char *__wrap_ldap_get_dn(LDAP *ld, LDAPMessage *entry)
+{
+    return discard_const(BENCH_DN);
+}
+
+void __wrap_ldap_memfree(void *p)
+{
+    return;
+}
+
+struct berval **__wrap_ldap_get_values_len(LDAP *ld,
+                                           LDAPMessage *entry,
+                                           LDAP_CONST char *target)
+{
+    struct berval **vals;
+    char **values = NULL;
+    size_t count;
+    size_t i;
+    int a;
+
+    for (a = 0; a < bench_entry->num_attrs; a++) {
+        if (strcmp(bench_entry->names[a], target) == 0) {
+            values = bench_entry->values[a];
+            break;
+        }
+    }
+
+    if (values == NULL) {
+        return NULL;
+    }
+
+    for (count = 0; values[count] != NULL; count++);
+
+    vals = talloc_zero_array(NULL, struct berval *, count + 1);
+    if (vals == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        vals[i] = talloc_zero(vals, struct berval);
+        if (vals[i] == NULL) {
+            talloc_free(vals);
+            return NULL;
+        }
+        vals[i]->bv_val = values[i];
+        vals[i]->bv_len = strlen(values[i]);
+    }
+
+    return vals;
+}
+
+void __wrap_ldap_value_free_len(struct berval **vals)
+{
+    talloc_free(vals);
+}
+
+char *__wrap_ldap_first_attribute(LDAP *ld,
+                                  LDAPMessage *entry,
+                                  BerElement **berout)
+{
+    bench_entry->next_attr = 1;
+    return bench_entry->names[0];
+}
+
+char *__wrap_ldap_next_attribute(LDAP *ld,
+                                 LDAPMessage *entry,
+                                 BerElement *ber)
+{
+    if (bench_entry->next_attr >= bench_entry->num_attrs) {
+        return NULL;
+    }
+
+    return bench_entry->names[bench_entry->next_attr++];
+}
+
+/* Not needed by the benchmark, avoids linking the whole LDAP provider */
+errno_t sdap_parse_search_base(TALLOC_CTX *mem_ctx,
+                               struct dp_option *opts, int class,
+                               struct sdap_search_base ***_search_bases)
+{
+    return EOK;
+}
+
+static struct bench_entry *bench_entry_new(TALLOC_CTX *mem_ctx,
+                                           int num_attrs, int num_values)
+{
+    struct bench_entry *entry;
+    int a;
+    int v;
+
+    entry = talloc_zero(mem_ctx, struct bench_entry);
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    entry->num_attrs = num_attrs;
+    entry->names = talloc_zero_array(entry, char *, num_attrs);
+    entry->values = talloc_zero_array(entry, char **, num_attrs);
+    if (entry->names == NULL || entry->values == NULL) {
+        return NULL;
+    }
+
+    for (a = 0; a < num_attrs; a++) {
+        entry->names[a] = talloc_asprintf(entry, "benchAttribute%d", a);
+        entry->values[a] = talloc_zero_array(entry, char *, num_values + 1);
+        if (entry->names[a] == NULL || entry->values[a] == NULL) {
+            return NULL;
+        }
+
+        for (v = 0; v < num_values; v++) {
+            entry->values[a][v] = talloc_asprintf(entry->values[a],
+                                     "uid=user%d,ou=people,dc=example,dc=com",
+                                     a * num_values + v);
+            if (entry->values[a][v] == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    return entry;
+}
+
+static struct sysdb_attrs *bench_per_value(TALLOC_CTX *mem_ctx,
+                                           struct sysdb_attrs *src)
+{
+    struct sysdb_attrs *dst;
+    size_t c;
+    size_t d;
+    int ret;
+
+    dst = sysdb_new_attrs(mem_ctx);
+    if (dst == NULL) {
+        return NULL;
+    }
+
+    for (c = 0; c < src->num; c++) {
+        for (d = 0; d < src->a[c].num_values; d++) {
+            ret = sysdb_attrs_add_val(dst, src->a[c].name,
+                                      &src->a[c].values[d]);
+            if (ret != EOK) {
+                talloc_free(dst);
+                return NULL;
+            }
+        }
+    }
+
+    return dst;
+}
+
+static long bench_maxrss(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    return usage.ru_maxrss;
+}
+
+static errno_t bench_run(int num_entries, int num_attrs, int num_values,
+                         bool pooled)
+{
+    TALLOC_CTX *tmp_ctx;
+    struct sysdb_attrs **entries;
+    struct sysdb_attrs *attrs;
+    struct sdap_handle sh = { 0 };
+    struct sdap_msg sm = { 0 };
+    uint64_t start;
+    uint64_t spent;
+    long rss_start;
+    long rss_end;
+    errno_t ret;
+    int i;
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    bench_entry = bench_entry_new(tmp_ctx, num_attrs, num_values);
+    entries = talloc_zero_array(tmp_ctx, struct sysdb_attrs *, num_entries);
+    if (bench_entry == NULL || entries == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    rss_start = bench_maxrss();
+    start = get_start_time();
+    for (i = 0; i < num_entries; i++) {
+        ret = sdap_parse_entry(entries, &sh, &sm, NULL, 0, &attrs, false);
+        if (ret != EOK) {
+            fprintf(stderr, "sdap_parse_entry failed [%d]: %s\n",
+                    ret, sss_strerror(ret));
+            goto done;
+        }
+
+        if (!pooled) {
+            entries[i] = bench_per_value(entries, attrs);
+            talloc_free(attrs);
+            if (entries[i] == NULL) {
+                ret = ENOMEM;
+                goto done;
+            }
+        } else {
+            entries[i] = attrs;
+        }
+    }
+    spent = get_spend_time_us(start);
+    rss_end = bench_maxrss();
+
+    printf("%10s %8d %6d %7d %10.1f %12ld\n",
+           pooled ? "pooled" : "per-value", num_entries, num_attrs,
+           num_values, spent / 1000.0, rss_end - rss_start);
+
+    start = get_start_time();
+    talloc_zfree(entries);
+    spent = get_spend_time_us(start);
+    printf("Freeing the entries took %.1f ms\n", spent / 1000.0);
+
+    ret = EOK;
+
+done:
+    talloc_free(tmp_ctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    int pc_entries = 20000;
+    int pc_attrs = 20;
+    int pc_values = 5;
+    const char *pc_mode = "pooled";
+    bool pooled;
+    errno_t ret;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "entries", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_entries, 0, "Number of parsed entries", NULL },
+        { "attrs", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_attrs, 0, "Number of attributes of an entry", NULL },
+        { "values", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_values, 0, "Number of values of an attribute", NULL },
+        { "mode", '\0', POPT_ARG_STRING | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_mode, 0, "Allocation of the entries (pooled, per-value)",
+          NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_entries < 1 || pc_attrs < 1 || pc_values < 1) {
+        fprintf(stderr, "All numeric options must be positive\n");
+        return 1;
+    }
+
+    if (strcmp(pc_mode, "pooled") == 0) {
+        pooled = true;
+    } else if (strcmp(pc_mode, "per-value") == 0) {
+        pooled = false;
+    } else {
+        fprintf(stderr, "Unknown mode [%s]\n", pc_mode);
+        return 1;
+    }
+
+    printf("%10s %8s %6s %7s %10s %12s\n", "mode", "entries", "attrs",
+           "values", "parse [ms]", "RSS [KiB]");
+
+    ret = bench_run(pc_entries, pc_attrs, pc_values, pooled);
+
+    return ret == EOK ? 0 : 1;
+}
@@ -0,0 +1,403 @@
+/*
+   SSSD
+
+   sysdb benchmark: responder-like readers running concurrently with a
+   backend-like writer
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   sysdb-bench --backend=tdb --readers=4 --users=5000 --seconds=10
+ *   sysdb-bench --backend=mdb --readers=4 --users=5000 --seconds=10
+ *
+ * Every reader process opens its own connection to the cache, like the
+ * responders do, and looks up random users by name. A single writer process
+ * keeps updating batches of users in transactions, like the back end does
+ * when it refreshes the cache. The reported maximum read latency shows how
+ * long readers were blocked by the writer.
+ */
+
+#include <stdlib.h>
+#include <signal.h>
+#include <popt.h>
+#include <sys/wait.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "tests/common.h"
+
+#define TESTS_PATH "tp_sysdb_bench"
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_DOM_NAME "sysdb_bench"
+#define TEST_ID_PROVIDER "ldap"
+
+#define BENCH_USER_FMT "bench_user_%d"
+#define BENCH_UID_BASE 100000
+
+struct bench_result {
+    bool writer;
+    uint64_t ops;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t errors;
+};
+
+static struct sss_domain_info *bench_open_domain(TALLOC_CTX *mem_ctx)
+{
+    struct sss_domain_info *dom = NULL;
+    struct confdb_ctx *cdb;
+    errno_t ret;
+
+    ret = confdb_init(mem_ctx, &cdb, TESTS_PATH"/"TEST_CONF_DB);
+    if (ret != EOK) {
+        fprintf(stderr, "confdb_init failed: %d\n", ret);
+        return NULL;
+    }
+
+    ret = sssd_domain_init(mem_ctx, cdb, TEST_DOM_NAME, TESTS_PATH, &dom);
+    if (ret != EOK) {
+        fprintf(stderr, "sssd_domain_init failed: %d\n", ret);
+        return NULL;
+    }
+
+    return dom;
+}
+
+static char *bench_user_name(TALLOC_CTX *mem_ctx,
+                             struct sss_domain_info *dom,
+                             int idx)
+{
+    char *shortname;
+
+    shortname = talloc_asprintf(mem_ctx, BENCH_USER_FMT, idx);
+    if (shortname == NULL) {
+        return NULL;
+    }
+
+    return sss_create_internal_fqname(mem_ctx, shortname, dom->name);
+}
+
+static errno_t bench_populate(const char *backend, int num_users)
+{
+    struct sss_test_conf_param params[] = {
+        { CONFDB_DOMAIN_CACHE_BACKEND, backend },
+        { NULL, NULL },
+    };
+    struct sss_test_ctx *tctx;
+    char *name;
+    errno_t ret;
+    int i;
+
+    tctx = create_dom_test_ctx(NULL, TESTS_PATH, TEST_CONF_DB,
+                               TEST_DOM_NAME, TEST_ID_PROVIDER, params);
+    if (tctx == NULL) {
+        return EIO;
+    }
+
+    ret = sysdb_transaction_start(tctx->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < num_users; i++) {
+        name = bench_user_name(tctx, tctx->dom, i);
+        if (name == NULL) {
+            ret = ENOMEM;
+            break;
+        }
+
+        ret = sysdb_add_user(tctx->dom, name, BENCH_UID_BASE + i,
+                             BENCH_UID_BASE + i, name, "/home/bench",
+                             "/bin/sh", NULL, NULL, 3600, 0);
+        talloc_free(name);
+        if (ret != EOK) {
+            break;
+        }
+    }
+
+    if (ret == EOK) {
+        ret = sysdb_transaction_commit(tctx->sysdb);
+    } else {
+        sysdb_transaction_cancel(tctx->sysdb);
+    }
+
+done:
+    talloc_free(tctx);
+    return ret;
+}
+
+static void bench_account(struct bench_result *res, uint64_t start,
+                          errno_t ret)
+{
+    uint64_t spent = get_spend_time_us(start);
+
+    res->ops++;
+    res->total_us += spent;
+    if (spent > res->max_us) {
+        res->max_us = spent;
+    }
+    if (ret != EOK) {
+        res->errors++;
+    }
+}
+
+static void bench_reader(struct sss_domain_info *dom, int num_users,
+                         time_t deadline, struct bench_result *res)
+{
+    struct ldb_result *lres;
+    TALLOC_CTX *tmp_ctx;
+    uint64_t start;
+    char *name;
+    errno_t ret;
+
+    while (time(NULL) < deadline) {
+        tmp_ctx = talloc_new(NULL);
+        if (tmp_ctx == NULL) {
+            res->errors++;
+            return;
+        }
+
+        name = bench_user_name(tmp_ctx, dom, random() % num_users);
+        if (name == NULL) {
+            res->errors++;
+            talloc_free(tmp_ctx);
+            return;
+        }
+
+        start = get_start_time();
+        ret = sysdb_getpwnam(tmp_ctx, dom, name, &lres);
+        if (ret == EOK && lres->count != 1) {
+            ret = ENOENT;
+        }
+        bench_account(res, start, ret);
+
+        talloc_free(tmp_ctx);
+    }
+}
+
+static void bench_writer(struct sss_domain_info *dom, int num_users,
+                         int batch, time_t deadline, struct bench_result *res)
+{
+    struct sysdb_attrs *attrs;
+    TALLOC_CTX *tmp_ctx;
+    uint64_t start;
+    uint64_t round = 0;
+    char *name;
+    char *gecos;
+    errno_t ret;
+    int i;
+
+    while (time(NULL) < deadline) {
+        tmp_ctx = talloc_new(NULL);
+        if (tmp_ctx == NULL) {
+            res->errors++;
+            return;
+        }
+
+        start = get_start_time();
+        ret = sysdb_transaction_start(dom->sysdb);
+        for (i = 0; ret == EOK && i < batch; i++) {
+            attrs = sysdb_new_attrs(tmp_ctx);
+            name = bench_user_name(tmp_ctx, dom, random() % num_users);
+            gecos = talloc_asprintf(tmp_ctx, "Bench user %"PRIu64, round);
+            if (attrs == NULL || name == NULL || gecos == NULL) {
+                ret = ENOMEM;
+                break;
+            }
+
+            ret = sysdb_attrs_add_string(attrs, SYSDB_GECOS, gecos);
+            if (ret != EOK) {
+                break;
+            }
+
+            ret = sysdb_set_user_attr(dom, name, attrs, SYSDB_MOD_REP);
+        }
+
+        if (ret == EOK) {
+            ret = sysdb_transaction_commit(dom->sysdb);
+        } else {
+            sysdb_transaction_cancel(dom->sysdb);
+        }
+        bench_account(res, start, ret);
+
+        round++;
+        talloc_free(tmp_ctx);
+    }
+}
+
+static pid_t bench_spawn(bool writer, int num_users, int batch,
+                         time_t deadline, int out_fd)
+{
+    struct sss_domain_info *dom;
+    struct bench_result res = { .writer = writer };
+    TALLOC_CTX *mem_ctx;
+    pid_t pid;
+
+    pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    /* Each process needs its own connection to the database */
+    mem_ctx = talloc_new(NULL);
+    dom = bench_open_domain(mem_ctx);
+    if (dom == NULL) {
+        _exit(EXIT_FAILURE);
+    }
+
+    srandom(getpid());
+
+    if (writer) {
+        bench_writer(dom, num_users, batch, deadline, &res);
+    } else {
+        bench_reader(dom, num_users, deadline, &res);
+    }
+
+    if (sss_atomic_write_s(out_fd, &res, sizeof(res)) != sizeof(res)) {
+        _exit(EXIT_FAILURE);
+    }
+
+    talloc_free(mem_ctx);
+    _exit(EXIT_SUCCESS);
+}
+
+static void bench_print(const char *role, struct bench_result *res,
+                        int seconds)
+{
+    printf("%-7s %10"PRIu64" ops %10.1f ops/s  avg %8.1f us  "
+           "max %8"PRIu64" us  errors %"PRIu64"\n",
+           role, res->ops, (double) res->ops / seconds,
+           res->ops ? (double) res->total_us / res->ops : 0.0,
+           res->max_us, res->errors);
+}
+
+static void bench_merge(struct bench_result *dst, struct bench_result *src)
+{
+    dst->ops += src->ops;
+    dst->total_us += src->total_us;
+    dst->errors += src->errors;
+    if (src->max_us > dst->max_us) {
+        dst->max_us = src->max_us;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    int opt;
+    poptContext pc;
+    const char *pc_backend = CONFDB_DOMAIN_CACHE_BACKEND_TDB;
+    int pc_readers = 4;
+    int pc_users = 1000;
+    int pc_batch = 50;
+    int pc_seconds = 10;
+    struct bench_result readers = { 0 };
+    struct bench_result writer = { 0 };
+    struct bench_result res;
+    time_t deadline;
+    int fds[2];
+    int status;
+    int failed = 0;
+    errno_t ret;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "backend", '\0', POPT_ARG_STRING | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_backend, 0, "Cache backend, tdb or mdb", NULL },
+        { "readers", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_readers, 0, "Number of reader processes", NULL },
+        { "users", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_users, 0, "Number of users in the cache", NULL },
+        { "batch", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_batch, 0, "Users modified in one write transaction", NULL },
+        { "seconds", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_seconds, 0, "Duration of the benchmark", NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_readers < 1 || pc_users < 1 || pc_batch < 1 || pc_seconds < 1) {
+        fprintf(stderr, "All numeric options must be positive\n");
+        return 1;
+    }
+
+    tests_set_cwd();
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    ret = bench_populate(pc_backend, pc_users);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to populate the cache: %d\n", ret);
+        goto done;
+    }
+
+    if (pipe(fds) != 0) {
+        ret = errno;
+        goto done;
+    }
+
+    deadline = time(NULL) + pc_seconds;
+    for (i = 0; i <= pc_readers; i++) {
+        if (bench_spawn(i == 0, pc_users, pc_batch, deadline, fds[1]) == -1) {
+            ret = errno;
+            fprintf(stderr, "fork failed: %d\n", ret);
+            goto done;
+        }
+    }
+    close(fds[1]);
+
+    for (i = 0; i <= pc_readers; i++) {
+        if (sss_atomic_read_s(fds[0], &res, sizeof(res)) != sizeof(res)) {
+            failed++;
+            continue;
+        }
+
+        bench_merge(res.writer ? &writer : &readers, &res);
+    }
+    close(fds[0]);
+
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+
+    printf("backend %s, %d readers, %d users, %d users per write\n",
+           pc_backend, pc_readers, pc_users, pc_batch);
+    bench_print("writer", &writer, pc_seconds);
+    bench_print("readers", &readers, pc_seconds);
+
+    ret = failed ? EIO : EOK;
+
+done:
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return ret == EOK ? 0 : 1;
+}
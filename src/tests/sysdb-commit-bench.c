@@ -0,0 +1,325 @@
+/*
+   SSSD
+
+   sysdb commit benchmark: throughput of refresh cycles that store every
+   user in its own transaction, for each cache_commit_mode
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Example:
+ *   sysdb-commit-bench --users=2000 --cycles=3 --window=100
+ *
+ * For every commit mode a fresh cache is created with the users. The
+ * program then runs refresh cycles in which every user is stored again with
+ * a new timestamp in its own transaction, like the back end does when it
+ * refreshes expired entries. The writes are driven from the event loop, so
+ * the flush timer of the group mode fires as it would in the back end. The
+ * cache is flushed at the end of the run and the flush is included in the
+ * measured time.
+ */
+
+#include <stdlib.h>
+#include <popt.h>
+
+#include "util/util.h"
+#include "db/sysdb.h"
+#include "tests/common.h"
+
+#define TESTS_PATH "tp_sysdb_commit_bench"
+#define TEST_CONF_DB "tests_conf.ldb"
+#define TEST_DOM_NAME "sysdb_commit_bench"
+#define TEST_ID_PROVIDER "ldap"
+
+#define BENCH_ID_BASE 100000
+
+struct bench_ctx {
+    struct sss_test_ctx *tctx;
+    const char **names;
+    int num_users;
+    int num_writes;
+    int next;
+    time_t now;
+    char gecos[32];
+    bool done;
+    errno_t error;
+};
+
+static errno_t bench_store_user(struct bench_ctx *bctx, int idx)
+{
+    struct sss_domain_info *dom = bctx->tctx->dom;
+    errno_t ret;
+
+    ret = sysdb_transaction_start(dom->sysdb);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = sysdb_store_user(dom, bctx->names[idx], NULL,
+                           BENCH_ID_BASE + idx, BENCH_ID_BASE + idx,
+                           bctx->gecos, NULL, NULL, NULL, NULL, NULL,
+                           300, bctx->now);
+    if (ret != EOK) {
+        sysdb_transaction_cancel(dom->sysdb);
+        return ret;
+    }
+
+    return sysdb_transaction_commit(dom->sysdb);
+}
+
+static errno_t bench_setup(TALLOC_CTX *mem_ctx, const char *mode,
+                           const char *window, int num_users,
+                           struct bench_ctx **_bctx)
+{
+    struct sss_test_conf_param params[] = {
+        { CONFDB_DOMAIN_CACHE_COMMIT_MODE, mode },
+        { CONFDB_DOMAIN_CACHE_COMMIT_WINDOW, window },
+        { NULL, NULL },
+    };
+    struct bench_ctx *bctx;
+    char *shortname;
+    errno_t ret;
+    int i;
+
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    test_dom_suite_setup(TESTS_PATH);
+
+    bctx = talloc_zero(mem_ctx, struct bench_ctx);
+    if (bctx == NULL) {
+        return ENOMEM;
+    }
+
+    bctx->tctx = create_dom_test_ctx(bctx, TESTS_PATH, TEST_CONF_DB,
+                                     TEST_DOM_NAME, TEST_ID_PROVIDER, params);
+    if (bctx->tctx == NULL) {
+        ret = EIO;
+        goto done;
+    }
+    bctx->num_users = num_users;
+    bctx->now = time(NULL);
+
+    bctx->names = talloc_array(bctx, const char *, num_users);
+    if (bctx->names == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    for (i = 0; i < num_users; i++) {
+        shortname = talloc_asprintf(bctx, "bench_user_%d", i);
+        if (shortname == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+
+        bctx->names[i] = sss_create_internal_fqname(bctx->names, shortname,
+                                                    bctx->tctx->dom->name);
+        talloc_free(shortname);
+        if (bctx->names[i] == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    /* Populate the cache in one transaction, only refreshes are measured */
+    ret = sysdb_transaction_start(bctx->tctx->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    for (i = 0; i < num_users; i++) {
+        ret = sysdb_store_user(bctx->tctx->dom, bctx->names[i], NULL,
+                               BENCH_ID_BASE + i, BENCH_ID_BASE + i,
+                               NULL, NULL, NULL, NULL, NULL, NULL,
+                               300, bctx->now);
+        if (ret != EOK) {
+            sysdb_transaction_cancel(bctx->tctx->dom->sysdb);
+            goto done;
+        }
+    }
+
+    ret = sysdb_transaction_commit(bctx->tctx->dom->sysdb);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    sysdb_enable_group_commit(bctx->tctx->dom->sysdb, bctx->tctx->ev);
+
+    *_bctx = bctx;
+    return EOK;
+
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+static void bench_refresh_step(struct tevent_context *ev,
+                               struct tevent_timer *te,
+                               struct timeval tv,
+                               void *pvt)
+{
+    struct bench_ctx *bctx = talloc_get_type(pvt, struct bench_ctx);
+    errno_t ret;
+    int idx;
+
+    if (bctx->next == bctx->num_writes) {
+        bctx->done = true;
+        return;
+    }
+
+    idx = bctx->next % bctx->num_users;
+    if (idx == 0) {
+        /* New refresh cycle, the changed gecos makes sure every
+         * transaction writes to the cache and not only to the
+         * timestamp cache */
+        bctx->now++;
+        snprintf(bctx->gecos, sizeof(bctx->gecos), "refresh %lld",
+                 (long long) bctx->now);
+    }
+
+    ret = bench_store_user(bctx, idx);
+    if (ret != EOK) {
+        bctx->error = ret;
+        bctx->done = true;
+        return;
+    }
+    bctx->next++;
+
+    /* A timer instead of an immediate event lets a due flush timer run
+     * first, as it would between the requests of the back end */
+    te = tevent_add_timer(ev, bctx, tevent_timeval_current(),
+                          bench_refresh_step, bctx);
+    if (te == NULL) {
+        bctx->error = ENOMEM;
+        bctx->done = true;
+    }
+}
+
+static errno_t bench_run(const char *mode, const char *window,
+                         int num_users, int cycles)
+{
+    struct bench_ctx *bctx = NULL;
+    struct tevent_timer *te;
+    uint64_t spent_us;
+    uint64_t start;
+    errno_t ret;
+
+    ret = bench_setup(NULL, mode, window, num_users, &bctx);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to set up the cache: %d\n", ret);
+        return ret;
+    }
+    bctx->num_writes = num_users * cycles;
+
+    start = get_start_time();
+
+    te = tevent_add_timer(bctx->tctx->ev, bctx, tevent_timeval_current(),
+                          bench_refresh_step, bctx);
+    if (te == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    while (!bctx->done) {
+        if (tevent_loop_once(bctx->tctx->ev) != 0) {
+            ret = EIO;
+            goto done;
+        }
+    }
+
+    ret = bctx->error;
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to refresh user %d: %d\n", bctx->next, ret);
+        goto done;
+    }
+
+    ret = sysdb_sync(bctx->tctx->dom->sysdb);
+    spent_us = get_spend_time_us(start);
+    if (ret != EOK) {
+        fprintf(stderr, "Unable to flush the cache: %d\n", ret);
+        goto done;
+    }
+
+    printf("%8s %10d %12.1f %12.1f\n", mode, bctx->num_writes,
+           spent_us / 1000.0, bctx->num_writes * 1000000.0 / spent_us);
+
+done:
+    talloc_free(bctx);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *modes[] = { CONFDB_DOMAIN_CACHE_COMMIT_MODE_SYNC,
+                            CONFDB_DOMAIN_CACHE_COMMIT_MODE_GROUP,
+                            CONFDB_DOMAIN_CACHE_COMMIT_MODE_NOSYNC,
+                            NULL };
+    int opt;
+    poptContext pc;
+    int pc_users = 1000;
+    int pc_cycles = 3;
+    int pc_window = CONFDB_DOMAIN_CACHE_COMMIT_WINDOW_DEFAULT;
+    char window[16];
+    errno_t ret = EOK;
+    int i;
+
+    struct poptOption long_options[] = {
+        POPT_AUTOHELP
+        SSSD_DEBUG_OPTS
+        { "users", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_users, 0, "Number of users refreshed in each cycle", NULL },
+        { "cycles", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_cycles, 0, "Number of refresh cycles", NULL },
+        { "window", '\0', POPT_ARG_INT | POPT_ARGFLAG_SHOW_DEFAULT,
+          &pc_window, 0, "Commit window of the group mode in ms", NULL },
+        POPT_TABLEEND
+    };
+
+    debug_level = SSSDBG_INVALID;
+
+    pc = poptGetContext(argv[0], argc, argv, long_options, 0);
+    while ((opt = poptGetNextOpt(pc)) != -1) {
+        switch (opt) {
+        default:
+            fprintf(stderr, "\nInvalid option %s: %s\n\n",
+                    poptBadOption(pc, 0), poptStrerror(opt));
+            poptPrintUsage(pc, stderr, 0);
+            return 1;
+        }
+    }
+    poptFreeContext(pc);
+
+    DEBUG_CLI_INIT(debug_level);
+
+    if (pc_users < 1 || pc_cycles < 1 || pc_window < 0) {
+        fprintf(stderr, "Users and cycles must be positive, "
+                        "the window must not be negative\n");
+        return 1;
+    }
+    snprintf(window, sizeof(window), "%d", pc_window);
+
+    tests_set_cwd();
+
+    printf("%8s %10s %12s %12s\n", "mode", "commits", "time [ms]", "commits/s");
+
+    for (i = 0; modes[i] != NULL; i++) {
+        ret = bench_run(modes[i], window, pc_users, pc_cycles);
+        if (ret != EOK) {
+            goto done;
+        }
+    }
+
+done:
+    test_dom_suite_cleanup(TESTS_PATH, TEST_CONF_DB, TEST_DOM_NAME);
+    return ret == EOK ? 0 : 1;
+}
@@ -3130,6 +3130,35 @@ START_TEST (test_sysdb_memberof_check_memberuid)
 }
 END_TEST
 
+START_TEST (test_sysdb_memberof_rebuild)
+{
+    struct sysdb_test_ctx *test_ctx;
+    struct ldb_message *msg;
+    int ret;
+
+    /* Setup */
+    ret = setup_sysdb_tests(&test_ctx);
+    if (ret != EOK) {
+        ck_abort_msg("Could not set up the test");
+        return;
+    }
+
+    msg = ldb_msg_new(test_ctx);
+    sss_ck_fail_if_msg(msg == NULL, "Failed to allocate memory");
+
+    msg->dn = ldb_dn_new(msg, test_ctx->sysdb->ldb, "@MEMBEROF-REBUILD");
+    sss_ck_fail_if_msg(msg->dn == NULL, "Failed to allocate memory");
+
+    /* The memberships are already consistent, rebuilding them must
+     * yield the same memberof and memberuid values */
+    ret = ldb_add(test_ctx->sysdb->ldb, msg);
+    ck_assert_msg(ret == LDB_SUCCESS, "Rebuild failed [%d]: %s", ret,
+                  ldb_errstring(test_ctx->sysdb->ldb));
+
+    talloc_free(test_ctx);
+}
+END_TEST
+
 START_TEST (test_sysdb_memberof_check_memberuid_loop)
 {
     struct sysdb_test_ctx *test_ctx;
@@ -8053,6 +8082,9 @@ Suite *create_sysdb_suite(void)
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_store_user, 0, 10);
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_add_group_member,
                         0, 10);
+    tcase_add_loop_test(tc_memberof, test_sysdb_memberof_check_memberuid,
+                        0, 10);
+    tcase_add_test(tc_memberof, test_sysdb_memberof_rebuild);
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_check_memberuid,
                         0, 10);
     tcase_add_loop_test(tc_memberof, test_sysdb_remove_local_group_by_gid,
@@ -8070,6 +8102,9 @@ Suite *create_sysdb_suite(void)
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_store_user, 0, 10);
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_add_group_member,
                         0, 10);
+    tcase_add_loop_test(tc_memberof, test_sysdb_memberof_check_memberuid_loop,
+                        0, 10);
+    tcase_add_test(tc_memberof, test_sysdb_memberof_rebuild);
     tcase_add_loop_test(tc_memberof, test_sysdb_memberof_check_memberuid_loop,
                         0, 10);
     tcase_add_loop_test(tc_memberof, test_sysdb_remove_local_group_by_gid,
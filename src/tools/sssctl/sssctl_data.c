@@ -536,3 +536,107 @@ done:
 
     return ret;
 }
+
+static void sssctl_print_query_stats(struct sysdb_query_shape_stats *stats,
+                                     size_t count)
+{
+    size_t i;
+
+    if (count == 0) {
+        PRINT("  No statistics were collected, is cache_query_stats "
+              "enabled?\n");
+        return;
+    }
+
+    PRINT("  %10s %12s %10s %10s %10s %5s  %s\n", _("Searches"),
+          _("Total [ms]"), _("Avg [ms]"), _("Max [ms]"), _("Entries"),
+          _("Index"), _("Filter"));
+
+    for (i = 0; i < count; i++) {
+        printf("  %10"PRIu64" %12.1f %10.2f %10.1f %10"PRIu64" %5s  %s\n",
+               stats[i].count,
+               stats[i].total_us / 1000.0,
+               stats[i].total_us / 1000.0 / MAX(stats[i].count, 1),
+               stats[i].max_us / 1000.0,
+               stats[i].entries,
+               stats[i].unindexed ? _("no") : _("yes"),
+               stats[i].shape);
+    }
+}
+
+errno_t sssctl_cache_query_stats(struct sss_cmdline *cmdline,
+                                 struct sss_tool_ctx *tool_ctx,
+                                 void *pvt)
+{
+    struct sysdb_query_shape_stats *stats;
+    const char **domains = NULL;
+    const char **names;
+    const char **domain;
+    const char **p;
+    TALLOC_CTX *tmp_ctx;
+    size_t count;
+    char *cache;
+    errno_t ret;
+
+    /* Parse command line. */
+    struct poptOption options[] = {
+        { "domain", 'd', POPT_ARG_ARGV, &domains,
+            0, _("Target a specific domain"), _("domain") },
+        POPT_TABLEEND
+    };
+
+    tmp_ctx = talloc_new(NULL);
+    if (tmp_ctx == NULL) {
+        return ENOMEM;
+    }
+
+    ret = sss_tool_popt(cmdline, options, SSS_TOOL_OPT_OPTIONAL, NULL, NULL);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to parse command arguments\n");
+        goto done;
+    }
+
+    names = domains;
+    if (names == NULL) {
+        ret = get_confdb_domains(tmp_ctx, tool_ctx->confdb,
+                                 discard_const(&names));
+        if (ret != EOK) {
+            ERROR("Unable to list the domains\n");
+            goto done;
+        }
+    }
+
+    for (domain = names; *domain != NULL; domain++) {
+        ret = sysdb_get_db_file(tmp_ctx, NULL, *domain, DB_PATH, &cache, NULL);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Failed to get the cache db name\n");
+            goto done;
+        }
+
+        ret = sysdb_query_stats_read(tmp_ctx, cache, &stats, &count);
+        if (ret != EOK) {
+            ERROR("Unable to read the query statistics: %1$s\n",
+                  sss_strerror(ret));
+            goto done;
+        }
+
+        PRINT("Cache searches of domain %1$s:\n", *domain);
+        sssctl_print_query_stats(stats, count);
+        PRINT("\n");
+    }
+
+    PRINT("Statistics are written by every SSSD process at most once "
+          "a minute.\n");
+
+    ret = EOK;
+
+done:
+    if (domains != NULL) {
+        for (p = domains; *p != NULL; p++) {
+            free(discard_const(*p));
+        }
+        free(discard_const(domains));
+    }
+    talloc_free(tmp_ctx);
+    return ret;
+}
@@ -300,12 +300,55 @@ done:
     return ret;
 }
 
+static errno_t
+sssctl_domain_status_dns_cache(struct sbus_sync_connection *conn,
+                               const char *domain_path)
+{
+    uint64_t hits;
+    uint64_t negative_hits;
+    uint64_t misses;
+    uint64_t prefetches;
+    uint64_t evictions;
+    uint32_t entries;
+    uint64_t lookups;
+    errno_t ret;
+
+    ret = sbus_call_ifp_domain_DNSCacheStats(conn, IFP_BUS, domain_path,
+                                             &hits, &negative_hits, &misses,
+                                             &prefetches, &evictions,
+                                             &entries);
+    if (ret == ENOENT) {
+        PRINT("DNS cache is disabled.\n");
+        return EOK;
+    } else if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to get DNS cache statistics "
+              "[%d]: %s\n", ret, sss_strerror(ret));
+        PRINT_IFP_WARNING(ret);
+        return ret;
+    }
+
+    lookups = hits + negative_hits + misses;
+
+    PRINT("DNS cache:\n");
+    PRINT("Lookups: %"PRIu64"\n", lookups);
+    PRINT("Hits: %"PRIu64" (%.1f%%)\n", hits,
+          lookups == 0 ? 0.0 : 100.0 * hits / lookups);
+    PRINT("Negative hits: %"PRIu64"\n", negative_hits);
+    PRINT("Misses: %"PRIu64"\n", misses);
+    PRINT("Background refreshes: %"PRIu64"\n", prefetches);
+    PRINT("Evictions: %"PRIu64"\n", evictions);
+    PRINT("Entries: %"PRIu32"\n", entries);
+
+    return EOK;
+}
+
 struct sssctl_domain_status_opts {
     const char *domain;
     int online;
     int last;
     int active;
     int servers;
+    int dns_cache;
     int force_start;
 };
 
@@ -325,6 +368,7 @@ errno_t sssctl_domain_status(struct sss_cmdline *cmdline,
         {"online", 'o', POPT_ARG_NONE , &opts.online, 0, _("Show online status"), NULL },
         {"active-server", 'a', POPT_ARG_NONE, &opts.active, 0, _("Show information about active server"), NULL },
         {"servers", 'r', POPT_ARG_NONE, &opts.servers, 0, _("Show list of discovered servers"), NULL },
+        {"dns-cache", 'c', POPT_ARG_NONE, &opts.dns_cache, 0, _("Show DNS cache statistics"), NULL },
         {"start", 's', POPT_ARG_NONE, &opts.force_start, 0, _("Start SSSD if it is not running"), NULL },
         POPT_TABLEEND
     };
@@ -398,6 +442,18 @@ errno_t sssctl_domain_status(struct sss_cmdline *cmdline,
         }
     }
 
+    if (opts.dns_cache) {
+        if (opts.servers) {
+            printf("\n");
+        }
+
+        ret = sssctl_domain_status_dns_cache(conn, path);
+        if (ret != EOK) {
+            ERROR("Unable to get DNS cache statistics\n");
+            goto done;
+        }
+    }
+
     ret = EOK;
 
 done:
@@ -32,6 +32,7 @@
 
 #include "util/util.h"
 #include "util/find_uid.h"
+#include "util/sss_chain_id.h"
 #include "db/sysdb.h"
 #include "util/child_common.h"
 
@@ -911,6 +912,556 @@ int child_io_destructor(void *ptr)
     return EOK;
 }
 
+/* Long-lived helpers */
+
+struct sss_child_helper_state;
+
+struct sss_child_helper_proc {
+    struct sss_child_helper *helper;
+    pid_t pid;
+    int read_fd;
+    int write_fd;
+    struct sss_child_ctx_old *child_ctx;
+    struct tevent_timer *idle_timer;
+
+    /* Replies are read as they come, inbuf holds an incomplete one */
+    uint8_t *inbuf;
+    size_t inbuf_len;
+
+    struct sss_child_helper_state *requests;
+};
+
+struct sss_child_helper {
+    struct sss_child_helper *prev;
+    struct sss_child_helper *next;
+
+    struct tevent_context *ev;
+    const char *binary;
+    const char *logfile;
+    int child_out_fd;
+
+    uint32_t next_id;
+    struct sss_child_helper_proc *proc;
+};
+
+struct sss_child_helper_state {
+    struct sss_child_helper_state *prev;
+    struct sss_child_helper_state *next;
+
+    struct tevent_req *req;
+    struct sss_child_helper_proc *proc;
+    struct tevent_timer *timeout;
+    uint32_t id;
+
+    uint8_t *buf;
+    ssize_t len;
+    int child_status;
+};
+
+/* One helper for each binary and event context */
+static struct sss_child_helper *sss_child_helpers = NULL;
+
+static int sss_child_helper_destructor(struct sss_child_helper *helper)
+{
+    DLIST_REMOVE(sss_child_helpers, helper);
+    return 0;
+}
+
+static int sss_child_helper_proc_destructor(struct sss_child_helper_proc *proc)
+{
+    struct sss_child_helper_state *state;
+
+    /* The requests are being freed as well or were already failed */
+    while (proc->requests != NULL) {
+        state = proc->requests;
+        DLIST_REMOVE(proc->requests, state);
+        state->proc = NULL;
+    }
+
+    if (proc->helper->proc == proc) {
+        proc->helper->proc = NULL;
+    }
+
+    if (proc->child_ctx != NULL) {
+        child_handler_destroy(proc->child_ctx);
+        proc->child_ctx = NULL;
+    }
+
+    PIPE_FD_CLOSE(proc->read_fd);
+    PIPE_FD_CLOSE(proc->write_fd);
+
+    return 0;
+}
+
+/* Fails all pending requests, the next request starts a new helper */
+static void sss_child_helper_proc_fail(struct sss_child_helper_proc *proc,
+                                       errno_t error)
+{
+    struct sss_child_helper_state *state;
+
+    DEBUG(SSSDBG_OP_FAILURE, "Helper [%s][%d] failed [%d]: %s\n",
+          proc->helper->binary, proc->pid, error, sss_strerror(error));
+
+    if (proc->helper->proc == proc) {
+        proc->helper->proc = NULL;
+    }
+
+    while (proc->requests != NULL) {
+        state = proc->requests;
+        DLIST_REMOVE(proc->requests, state);
+        state->proc = NULL;
+        talloc_zfree(state->timeout);
+        tevent_req_error(state->req, error);
+    }
+
+    talloc_free(proc);
+}
+
+static void sss_child_helper_idle_timeout(struct tevent_context *ev,
+                                          struct tevent_timer *te,
+                                          struct timeval tv,
+                                          void *pvt)
+{
+    struct sss_child_helper_proc *proc;
+
+    proc = talloc_get_type(pvt, struct sss_child_helper_proc);
+    proc->idle_timer = NULL;
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Stopping idle helper [%s][%d].\n",
+          proc->helper->binary, proc->pid);
+
+    /* Nothing is running in the helper, it can be just killed */
+    talloc_free(proc);
+}
+
+static void sss_child_helper_proc_idle(struct sss_child_helper_proc *proc)
+{
+    struct timeval tv;
+
+    if (proc->requests != NULL || proc->idle_timer != NULL) {
+        return;
+    }
+
+    tv = tevent_timeval_current_ofs(SSS_CHILD_HELPER_IDLE_TIMEOUT, 0);
+    proc->idle_timer = tevent_add_timer(proc->helper->ev, proc, tv,
+                                        sss_child_helper_idle_timeout, proc);
+    if (proc->idle_timer == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Unable to set up the idle timeout.\n");
+        talloc_free(proc);
+    }
+}
+
+static void sss_child_helper_written(struct tevent_req *subreq)
+{
+    struct sss_child_helper_proc *proc;
+    errno_t ret;
+
+    proc = tevent_req_callback_data(subreq, struct sss_child_helper_proc);
+
+    ret = write_pipe_recv(subreq);
+    talloc_zfree(subreq);
+    if (ret != EOK) {
+        sss_child_helper_proc_fail(proc, ret);
+    }
+}
+
+/* Frame: request ID, length, chain ID and the request itself */
+static errno_t sss_child_helper_write(struct sss_child_helper_proc *proc,
+                                      uint32_t id,
+                                      uint8_t *buf,
+                                      size_t len,
+                                      bool cancel)
+{
+    struct tevent_req *subreq;
+    uint8_t *frame;
+    uint64_t chain_id;
+    uint32_t ulen;
+    size_t rp = 0;
+
+    frame = talloc_size(proc, 2 * sizeof(uint32_t) + sizeof(uint64_t) + len);
+    if (frame == NULL) {
+        return ENOMEM;
+    }
+
+    chain_id = sss_chain_id_get();
+    ulen = cancel ? SSS_CHILD_HELPER_CANCEL : len;
+    SAFEALIGN_COPY_UINT32(&frame[rp], &id, &rp);
+    SAFEALIGN_COPY_UINT32(&frame[rp], &ulen, &rp);
+    if (!cancel) {
+        safealign_memcpy(&frame[rp], &chain_id, sizeof(uint64_t), &rp);
+        safealign_memcpy(&frame[rp], buf, len, &rp);
+    }
+
+    subreq = write_pipe_send(proc, proc->helper->ev, frame, rp,
+                             proc->write_fd);
+    if (subreq == NULL) {
+        talloc_free(frame);
+        return ENOMEM;
+    }
+    talloc_steal(subreq, frame);
+    tevent_req_set_callback(subreq, sss_child_helper_written, proc);
+
+    return EOK;
+}
+
+static void sss_child_helper_cancel(struct sss_child_helper_state *state)
+{
+    struct sss_child_helper_proc *proc = state->proc;
+    errno_t ret;
+
+    DLIST_REMOVE(proc->requests, state);
+    state->proc = NULL;
+
+    ret = sss_child_helper_write(proc, state->id, NULL, 0, true);
+    if (ret != EOK) {
+        /* Without the cancel the process of the request would be left
+         * running, restart the helper instead */
+        sss_child_helper_proc_fail(proc, ret);
+        return;
+    }
+
+    sss_child_helper_proc_idle(proc);
+}
+
+static void sss_child_helper_reply(struct sss_child_helper_proc *proc,
+                                   uint32_t id,
+                                   int child_status,
+                                   uint8_t *data,
+                                   size_t len)
+{
+    struct sss_child_helper_state *state;
+
+    DLIST_FOR_EACH(state, proc->requests) {
+        if (state->id == id) {
+            break;
+        }
+    }
+
+    if (state == NULL) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Request %"PRIu32" was cancelled.\n", id);
+        return;
+    }
+
+    DLIST_REMOVE(proc->requests, state);
+    state->proc = NULL;
+    talloc_zfree(state->timeout);
+
+    state->child_status = child_status;
+    state->len = len;
+    state->buf = talloc_memdup(state, data, len);
+    if (state->buf == NULL && len > 0) {
+        tevent_req_error(state->req, ENOMEM);
+        return;
+    }
+
+    tevent_req_done(state->req);
+}
+
+static void sss_child_helper_read(struct tevent_context *ev,
+                                  struct tevent_fd *fde,
+                                  uint16_t flags,
+                                  void *pvt)
+{
+    struct sss_child_helper_proc *proc;
+    uint8_t buf[CHILD_MSG_CHUNK];
+    uint32_t header[3];
+    size_t frame_len;
+    ssize_t len;
+
+    proc = talloc_get_type(pvt, struct sss_child_helper_proc);
+
+    errno = 0;
+    len = read(proc->read_fd, buf, sizeof(buf));
+    if (len == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (len <= 0) {
+        sss_child_helper_proc_fail(proc, len == 0 ? EPIPE : errno);
+        return;
+    }
+
+    proc->inbuf = talloc_realloc(proc, proc->inbuf, uint8_t,
+                                 proc->inbuf_len + len);
+    if (proc->inbuf == NULL) {
+        sss_child_helper_proc_fail(proc, ENOMEM);
+        return;
+    }
+    memcpy(&proc->inbuf[proc->inbuf_len], buf, len);
+    proc->inbuf_len += len;
+
+    /* Frame: request ID, wait status, length and the reply */
+    while (proc->inbuf_len >= sizeof(header)) {
+        memcpy(header, proc->inbuf, sizeof(header));
+        frame_len = sizeof(header) + header[2];
+        if (proc->inbuf_len < frame_len) {
+            break;
+        }
+
+        sss_child_helper_reply(proc, header[0], (int) header[1],
+                               &proc->inbuf[sizeof(header)], header[2]);
+
+        memmove(proc->inbuf, &proc->inbuf[frame_len],
+                proc->inbuf_len - frame_len);
+        proc->inbuf_len -= frame_len;
+    }
+
+    sss_child_helper_proc_idle(proc);
+}
+
+static void sss_child_helper_exited(int child_status,
+                                    struct tevent_signal *sige,
+                                    void *pvt)
+{
+    struct sss_child_helper_proc *proc;
+
+    proc = talloc_get_type(pvt, struct sss_child_helper_proc);
+
+    /* The child context is freed by the caller */
+    proc->child_ctx = NULL;
+
+    sss_child_helper_proc_fail(proc, ECHILD);
+}
+
+static errno_t sss_child_helper_start(struct sss_child_helper *helper)
+{
+    struct sss_child_helper_proc *proc;
+    int pipefd_to_child[2] = PIPE_INIT;
+    int pipefd_from_child[2] = PIPE_INIT;
+    const char *extra_args[] = { "--" SSS_CHILD_HELPER_OPT, NULL };
+    struct tevent_fd *fde;
+    pid_t pid;
+    errno_t ret;
+
+    proc = talloc_zero(helper, struct sss_child_helper_proc);
+    if (proc == NULL) {
+        return ENOMEM;
+    }
+    proc->helper = helper;
+    proc->read_fd = -1;
+    proc->write_fd = -1;
+    talloc_set_destructor(proc, sss_child_helper_proc_destructor);
+
+    ret = pipe(pipefd_from_child);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "pipe (from) failed [%d][%s].\n", ret, strerror(ret));
+        goto done;
+    }
+
+    ret = pipe(pipefd_to_child);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "pipe (to) failed [%d][%s].\n", ret, strerror(ret));
+        goto done;
+    }
+
+    pid = fork();
+    if (pid == 0) { /* child */
+        exec_child_ex(NULL, pipefd_to_child, pipefd_from_child,
+                      helper->binary, helper->logfile, extra_args, false,
+                      STDIN_FILENO, helper->child_out_fd);
+
+        /* We should never get here */
+        DEBUG(SSSDBG_CRIT_FAILURE, "BUG: Could not exec %s\n", helper->binary);
+        exit(EXIT_FAILURE);
+    } else if (pid < 0) { /* error */
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE,
+              "fork failed [%d][%s].\n", ret, strerror(ret));
+        goto done;
+    }
+
+    proc->pid = pid;
+    proc->read_fd = pipefd_from_child[0];
+    proc->write_fd = pipefd_to_child[1];
+    pipefd_from_child[0] = -1;
+    pipefd_to_child[1] = -1;
+    sss_fd_nonblocking(proc->read_fd);
+    sss_fd_nonblocking(proc->write_fd);
+
+    ret = child_handler_setup(helper->ev, pid, sss_child_helper_exited, proc,
+                              &proc->child_ctx);
+    if (ret != EOK) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Could not set up child signal handler\n");
+        kill(pid, SIGKILL);
+        goto done;
+    }
+
+    fde = tevent_add_fd(helper->ev, proc, proc->read_fd, TEVENT_FD_READ,
+                        sss_child_helper_read, proc);
+    if (fde == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Started helper [%s][%d].\n",
+          helper->binary, pid);
+
+    helper->proc = proc;
+    ret = EOK;
+
+done:
+    PIPE_CLOSE(pipefd_from_child);
+    PIPE_CLOSE(pipefd_to_child);
+    if (ret != EOK) {
+        talloc_free(proc);
+    }
+
+    return ret;
+}
+
+static struct sss_child_helper *sss_child_helper_get(struct tevent_context *ev,
+                                                     const char *binary,
+                                                     const char *logfile,
+                                                     int child_out_fd)
+{
+    struct sss_child_helper *helper;
+
+    DLIST_FOR_EACH(helper, sss_child_helpers) {
+        if (helper->ev == ev && strcmp(helper->binary, binary) == 0) {
+            return helper;
+        }
+    }
+
+    helper = talloc_zero(ev, struct sss_child_helper);
+    if (helper == NULL) {
+        return NULL;
+    }
+
+    helper->ev = ev;
+    helper->binary = talloc_strdup(helper, binary);
+    helper->logfile = talloc_strdup(helper, logfile);
+    helper->child_out_fd = child_out_fd;
+    if (helper->binary == NULL || (logfile != NULL && helper->logfile == NULL)) {
+        talloc_free(helper);
+        return NULL;
+    }
+
+    DLIST_ADD(sss_child_helpers, helper);
+    talloc_set_destructor(helper, sss_child_helper_destructor);
+
+    return helper;
+}
+
+static int sss_child_helper_state_destructor(struct sss_child_helper_state *state)
+{
+    /* The caller is not interested in the reply anymore */
+    if (state->proc != NULL) {
+        sss_child_helper_cancel(state);
+    }
+
+    return 0;
+}
+
+static void sss_child_helper_timeout(struct tevent_context *ev,
+                                     struct tevent_timer *te,
+                                     struct timeval tv,
+                                     void *pvt)
+{
+    struct sss_child_helper_state *state;
+
+    state = talloc_get_type(pvt, struct sss_child_helper_state);
+    state->timeout = NULL;
+
+    DEBUG(SSSDBG_IMPORTANT_INFO, "Timeout for request %"PRIu32" of helper "
+          "[%d] reached.\n", state->id, state->proc->pid);
+
+    sss_child_helper_cancel(state);
+    tevent_req_error(state->req, ETIMEDOUT);
+}
+
+struct tevent_req *sss_child_helper_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         const char *binary,
+                                         const char *logfile,
+                                         int child_out_fd,
+                                         uint8_t *buf,
+                                         size_t len,
+                                         int timeout)
+{
+    struct sss_child_helper_state *state;
+    struct sss_child_helper *helper;
+    struct tevent_req *req;
+    struct timeval tv;
+    errno_t ret;
+
+    req = tevent_req_create(mem_ctx, &state, struct sss_child_helper_state);
+    if (req == NULL) {
+        return NULL;
+    }
+    state->req = req;
+
+    helper = sss_child_helper_get(ev, binary, logfile, child_out_fd);
+    if (helper == NULL) {
+        ret = ENOMEM;
+        goto done;
+    }
+
+    if (helper->proc == NULL) {
+        ret = sss_child_helper_start(helper);
+        if (ret != EOK) {
+            DEBUG(SSSDBG_OP_FAILURE, "Unable to start helper [%s] [%d]: %s\n",
+                  binary, ret, sss_strerror(ret));
+            goto done;
+        }
+    }
+
+    talloc_zfree(helper->proc->idle_timer);
+
+    state->id = helper->next_id++;
+
+    ret = sss_child_helper_write(helper->proc, state->id, buf, len, false);
+    if (ret != EOK) {
+        goto done;
+    }
+
+    state->proc = helper->proc;
+    DLIST_ADD(state->proc->requests, state);
+    talloc_set_destructor(state, sss_child_helper_state_destructor);
+
+    if (timeout > 0) {
+        tv = tevent_timeval_current_ofs(timeout, 0);
+        state->timeout = tevent_add_timer(ev, state, tv,
+                                          sss_child_helper_timeout, state);
+        if (state->timeout == NULL) {
+            ret = ENOMEM;
+            goto done;
+        }
+    }
+
+    ret = EOK;
+
+done:
+    if (ret != EOK) {
+        tevent_req_error(req, ret);
+        tevent_req_post(req, ev);
+    }
+
+    return req;
+}
+
+errno_t sss_child_helper_recv(struct tevent_req *req,
+                              TALLOC_CTX *mem_ctx,
+                              uint8_t **_buf,
+                              ssize_t *_len,
+                              int *_child_status)
+{
+    struct sss_child_helper_state *state;
+
+    state = tevent_req_data(req, struct sss_child_helper_state);
+
+    TEVENT_REQ_RETURN_ON_ERROR(req);
+
+    *_buf = talloc_steal(mem_ctx, state->buf);
+    *_len = state->len;
+    if (_child_status != NULL) {
+        *_child_status = state->child_status;
+    }
+
+    return EOK;
+}
+
 static errno_t child_debug_init(const char *logfile, int *debug_fd)
 {
     int ret;
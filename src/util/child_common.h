@@ -142,4 +142,42 @@ void exec_child(TALLOC_CTX *mem_ctx,
 
 int child_io_destructor(void *ptr);
 
+/* LONG-LIVED HELPERS
+ *
+ * Instead of starting the child binary for each request, a helper started
+ * with the --helper option is kept running and forks a new process for each
+ * request it receives. The helper is started on demand, stopped after
+ * SSS_CHILD_HELPER_IDLE_TIMEOUT seconds without requests and started again
+ * if it crashes. The request is the input the child reads until the end of
+ * the file and the reply is its complete output.
+ */
+#define SSS_CHILD_HELPER_OPT "helper"
+#define SSS_CHILD_HELPER_IDLE_TIMEOUT 60
+#define SSS_CHILD_HELPER_CANCEL UINT32_MAX
+
+/* A timeout of 0 means no timeout. There is only one helper for each binary
+ * and event context, child_out_fd is the descriptor the child writes the
+ * reply to. */
+struct tevent_req *sss_child_helper_send(TALLOC_CTX *mem_ctx,
+                                         struct tevent_context *ev,
+                                         const char *binary,
+                                         const char *logfile,
+                                         int child_out_fd,
+                                         uint8_t *buf,
+                                         size_t len,
+                                         int timeout);
+
+/* The child status is the wait status of the process handling the request */
+errno_t sss_child_helper_recv(struct tevent_req *req,
+                              TALLOC_CTX *mem_ctx,
+                              uint8_t **_buf,
+                              ssize_t *_len,
+                              int *_child_status);
+
+/* Called by the child with the --helper option. Serves requests until the
+ * input is closed and exits then. The function only returns in the process
+ * started for a request, which then reads the request from in_fd and
+ * writes the reply to out_fd. Implemented in child_helper.c. */
+void sss_child_helper_serve(const char *name, int in_fd, int out_fd);
+
 #endif /* __CHILD_COMMON_H__ */
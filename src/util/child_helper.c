@@ -0,0 +1,343 @@
+/*
+    SSSD
+
+    Long-lived helper mode of the child processes
+
+    A helper reads framed requests sent by sss_child_helper_send() and forks
+    a process for each of them. The process continues in the main() of the
+    child as if it was started for the single request, with its input and
+    output connected to pipes of the helper. The output is sent back framed
+    together with the exit status once the process finishes, so several
+    requests can be handled at the same time.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <poll.h>
+
+#include "util/util.h"
+#include "util/sss_chain_id.h"
+#include "util/child_common.h"
+
+struct child_helper_request {
+    uint32_t id;
+    pid_t pid;
+    int fd;
+    uint8_t *out;
+    size_t out_len;
+};
+
+struct child_helper {
+    const char *name;
+    int in_fd;
+    int out_fd;
+    pid_t pid;
+    bool input_closed;
+
+    struct child_helper_request *requests;
+    size_t num_requests;
+};
+
+static void child_helper_exit(int status)
+{
+    DEBUG(SSSDBG_TRACE_FUNC, "Helper finished.\n");
+    _exit(status);
+}
+
+static void child_helper_reply(struct child_helper *helper,
+                               struct child_helper_request *request)
+{
+    uint32_t header[3];
+    int status = 0;
+    ssize_t ret;
+
+    PIPE_FD_CLOSE(request->fd);
+
+    do {
+        errno = 0;
+        ret = waitpid(request->pid, &status, 0);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        ret = errno;
+        DEBUG(SSSDBG_CRIT_FAILURE, "waitpid failed [%zd]: %s\n",
+              ret, strerror(ret));
+        status = W_EXITCODE(EXIT_FAILURE, 0);
+    }
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Request %"PRIu32" handled by [%d] finished "
+          "with status [%d].\n", request->id, request->pid, status);
+
+    header[0] = request->id;
+    header[1] = (uint32_t) status;
+    header[2] = request->out_len;
+
+    errno = 0;
+    ret = sss_atomic_write_s(helper->out_fd, header, sizeof(header));
+    if (ret == sizeof(header) && request->out_len > 0) {
+        ret = sss_atomic_write_s(helper->out_fd, request->out,
+                                 request->out_len);
+        ret = (ret == request->out_len) ? sizeof(header) : -1;
+    }
+    if (ret != sizeof(header)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot send the reply, exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    free(request->out);
+    helper->num_requests--;
+    *request = helper->requests[helper->num_requests];
+}
+
+static void child_helper_read_output(struct child_helper *helper,
+                                     struct child_helper_request *request)
+{
+    uint8_t buf[CHILD_MSG_CHUNK];
+    uint8_t *out;
+    ssize_t len;
+
+    errno = 0;
+    len = read(request->fd, buf, sizeof(buf));
+    if (len == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+
+    if (len <= 0) {
+        /* End of the output, the process is finishing */
+        child_helper_reply(helper, request);
+        return;
+    }
+
+    out = realloc(request->out, request->out_len + len);
+    if (out == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    memcpy(out + request->out_len, buf, len);
+    request->out = out;
+    request->out_len += len;
+}
+
+static void child_helper_cancel(struct child_helper *helper, uint32_t id)
+{
+    size_t i;
+
+    for (i = 0; i < helper->num_requests; i++) {
+        if (helper->requests[i].id == id) {
+            DEBUG(SSSDBG_TRACE_FUNC, "Cancelling request %"PRIu32" handled "
+                  "by [%d].\n", id, helper->requests[i].pid);
+            kill(helper->requests[i].pid, SIGTERM);
+            return;
+        }
+    }
+}
+
+/* Returns only in the new process */
+static void child_helper_start(struct child_helper *helper,
+                               uint32_t id,
+                               uint8_t *data,
+                               size_t len)
+{
+    struct child_helper_request *requests;
+    int pipe_in[2] = PIPE_INIT;
+    int pipe_out[2] = PIPE_INIT;
+    ssize_t written;
+    size_t i;
+    pid_t pid;
+
+    requests = realloc(helper->requests, (helper->num_requests + 1)
+                                         * sizeof(struct child_helper_request));
+    if (requests == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+    helper->requests = requests;
+
+    if (pipe(pipe_in) == -1 || pipe(pipe_out) == -1) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "pipe failed [%d]: %s, exiting.\n",
+              errno, strerror(errno));
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        /* Do not keep running if the helper is killed */
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != helper->pid) {
+            _exit(EXIT_FAILURE);
+        }
+
+        for (i = 0; i < helper->num_requests; i++) {
+            close(helper->requests[i].fd);
+        }
+
+        if (dup2(pipe_in[0], helper->in_fd) == -1
+                || dup2(pipe_out[1], helper->out_fd) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+        PIPE_CLOSE(pipe_in);
+        PIPE_CLOSE(pipe_out);
+
+        debug_prg_name = talloc_asprintf(NULL, "%s[%d]", helper->name,
+                                         getpid());
+        if (debug_prg_name == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+
+        return;
+    } else if (pid < 0) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "fork failed [%d]: %s, exiting.\n",
+              errno, strerror(errno));
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    PIPE_FD_CLOSE(pipe_in[0]);
+    PIPE_FD_CLOSE(pipe_out[1]);
+
+    DEBUG(SSSDBG_TRACE_FUNC, "Request %"PRIu32" is handled by [%d].\n",
+          id, pid);
+
+    /* The children read the whole request before writing any output */
+    errno = 0;
+    written = sss_atomic_write_s(pipe_in[1], data, len);
+    if (written != len) {
+        DEBUG(SSSDBG_OP_FAILURE, "Cannot pass request %"PRIu32" to [%d].\n",
+              id, pid);
+    }
+    PIPE_FD_CLOSE(pipe_in[1]);
+
+    helper->requests[helper->num_requests].id = id;
+    helper->requests[helper->num_requests].pid = pid;
+    helper->requests[helper->num_requests].fd = pipe_out[0];
+    helper->requests[helper->num_requests].out = NULL;
+    helper->requests[helper->num_requests].out_len = 0;
+    helper->num_requests++;
+}
+
+/* Returns true only in the process started for the request */
+static bool child_helper_read_input(struct child_helper *helper)
+{
+    uint32_t header[2];
+    uint64_t chain_id;
+    uint8_t *data;
+    ssize_t len;
+
+    errno = 0;
+    len = sss_atomic_read_s(helper->in_fd, header, sizeof(header));
+    if (len == 0) {
+        DEBUG(SSSDBG_TRACE_FUNC, "Input closed.\n");
+        helper->input_closed = true;
+        return false;
+    } else if (len != sizeof(header)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot read the next request, "
+              "exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    if (header[1] == SSS_CHILD_HELPER_CANCEL) {
+        child_helper_cancel(helper, header[0]);
+        return false;
+    }
+
+    data = malloc(header[1] + sizeof(uint64_t));
+    if (data == NULL) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    len = sss_atomic_read_s(helper->in_fd, data, header[1] + sizeof(uint64_t));
+    if (len != header[1] + sizeof(uint64_t)) {
+        DEBUG(SSSDBG_CRIT_FAILURE, "Cannot read the request, exiting.\n");
+        child_helper_exit(EXIT_FAILURE);
+    }
+
+    memcpy(&chain_id, data, sizeof(uint64_t));
+    sss_chain_id_set(chain_id);
+
+    child_helper_start(helper, header[0], data + sizeof(uint64_t), header[1]);
+
+    free(data);
+
+    return (getpid() != helper->pid);
+}
+
+void sss_child_helper_serve(const char *name, int in_fd, int out_fd)
+{
+    struct child_helper helper = { 0 };
+    struct pollfd *fds = NULL;
+    size_t nfds;
+    size_t i;
+    int ret;
+
+    helper.name = name;
+    helper.in_fd = in_fd;
+    helper.out_fd = out_fd;
+    helper.pid = getpid();
+
+    DEBUG(SSSDBG_TRACE_FUNC, "%s started as a helper.\n", name);
+
+    while (!helper.input_closed || helper.num_requests > 0) {
+        fds = realloc(fds, (helper.num_requests + 1) * sizeof(struct pollfd));
+        if (fds == NULL) {
+            DEBUG(SSSDBG_CRIT_FAILURE, "Out of memory, exiting.\n");
+            child_helper_exit(EXIT_FAILURE);
+        }
+
+        nfds = 0;
+        for (i = 0; i < helper.num_requests; i++) {
+            fds[nfds].fd = helper.requests[i].fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+
+        if (!helper.input_closed) {
+            fds[nfds].fd = helper.in_fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+
+        ret = poll(fds, nfds, -1);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DEBUG(SSSDBG_CRIT_FAILURE, "poll failed [%d]: %s, exiting.\n",
+                  errno, strerror(errno));
+            child_helper_exit(EXIT_FAILURE);
+        }
+
+        /* Walk backwards, a finished request is replaced by the last one */
+        for (i = helper.num_requests; i > 0; i--) {
+            if (fds[i - 1].revents != 0) {
+                child_helper_read_output(&helper, &helper.requests[i - 1]);
+            }
+        }
+
+        if (!helper.input_closed && fds[nfds - 1].revents != 0) {
+            if (child_helper_read_input(&helper)) {
+                free(fds);
+                free(helper.requests);
+                return;
+            }
+        }
+    }
+
+    child_helper_exit(EXIT_SUCCESS);
+}
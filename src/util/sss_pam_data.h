@@ -60,6 +60,8 @@ struct pam_data {
     uint32_t child_pid;
     char *logon_name;
     uint32_t cli_flags;
+    /* only used by the PAM responder, not sent to the backend */
+    char *session_token;
 
     int pam_status;
     int response_delay;
@@ -40,5 +40,12 @@ bool sss_utf8_check(const uint8_t *s, size_t n);
  */
 errno_t sss_utf8_case_eq(const uint8_t *s1, const uint8_t *s2);
 
+/* Returns the case-folded form of s in a buffer allocated with malloc(),
+ * its length is stored in _len. Two strings are equal according to
+ * sss_utf8_case_eq() if and only if their folded forms are identical.
+ * Returns NULL and sets errno on failure.
+ */
+uint8_t *sss_utf8_casefold(const uint8_t *s, size_t *_len);
+
 
 #endif /* SSS_UTF8_H_ */